@@ -34,6 +34,8 @@
 // can be misleading.  When contemplating an algorithm change, always do
 // interleaved runs with the old & new algorithm.
 
+#include <memory>
+
 #include "benchmark/benchmark.h"
 #include "net/instaweb/rewriter/cached_result.pb.h"
 #include "net/instaweb/rewriter/public/image.h"
@@ -41,8 +43,10 @@
 #include "pagespeed/kernel/base/stdio_file_system.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/http/image_types.pb.h"
 #include "pagespeed/kernel/image/image_util.h"
+#include "pagespeed/kernel/util/platform.h"
 #include "test/pagespeed/kernel/base/gtest.h"
 #include "test/pagespeed/kernel/base/mock_message_handler.h"
 #include "test/pagespeed/kernel/base/mock_timer.h"
@@ -55,6 +59,7 @@ const char kTestData[] = "/test/net/instaweb/rewriter/testdata/";
 const char kCuppa[] = "Cuppa.png";
 const char kIronChef[] = "IronChef2.gif";
 const char kPuzzle[] = "Puzzle.jpg";
+const char kResolutionLimit[] = "ResolutionLimit.jpg";  // 4096x2048
 const char kScenery[] = "Scenery.webp";
 
 // The original quality of Puzzle.jpg is 97. Rewrite it to a lower
@@ -145,6 +150,25 @@ static void BM_ConvertPngToPng(benchmark::State& state) {
 }
 BENCHMARK(BM_ConvertPngToPng);
 
+// Same as BM_ConvertPngToPng, but trying the PNG compression settings on four
+// threads.  Compare wall time against BM_ConvertPngToPng for the latency win,
+// and CPU time for what abandoning losing settings early saves.
+static void BM_ConvertPngToPngConcurrent(benchmark::State& state) {
+  std::unique_ptr<net_instaweb::ThreadSystem> thread_system(
+      net_instaweb::Platform::CreateThreadSystem());
+  net_instaweb::Image::CompressionOptions options;
+  options.recompress_png = true;
+  options.thread_system = thread_system.get();
+  options.png_max_concurrent_encodes = 4;
+
+  TestImageRewrite test_rewrite(kCuppa, &options);
+  ASSERT_TRUE(test_rewrite.Initialize(net_instaweb::IMAGE_PNG));
+  for (int i = 0; i < state.iterations(); ++i) {
+    test_rewrite.Rewrite(NULL /* no resizing */);
+  }
+}
+BENCHMARK(BM_ConvertPngToPngConcurrent);
+
 static void BM_ConvertPngToWebp(benchmark::State& state) {
   net_instaweb::Image::CompressionOptions options;
   options.preferred_webp = pagespeed::image_compression::WEBP_LOSSLESS;
@@ -222,6 +246,24 @@ static void BM_ResizeGifToWebp(benchmark::State& state) {
 }
 BENCHMARK(BM_ResizeGifToWebp);
 
+// Shrinks a camera-sized photo to a thumbnail, which has libjpeg do most of
+// the shrinking while decoding.
+static void BM_ResizeJpegToJpeg(benchmark::State& state) {
+  net_instaweb::Image::CompressionOptions options;
+  options.recompress_jpeg = true;
+  options.jpeg_quality = kNewQuality;
+
+  TestImageRewrite test_rewrite(kResolutionLimit, &options);
+  ASSERT_TRUE(test_rewrite.Initialize(net_instaweb::IMAGE_JPEG));
+  ImageDim image_dim;
+  image_dim.set_width(400);
+  image_dim.set_height(200);
+  for (int i = 0; i < state.iterations(); ++i) {
+    test_rewrite.Rewrite(&image_dim);
+  }
+}
+BENCHMARK(BM_ResizeJpegToJpeg);
+
 }  // namespace
 
 }  // namespace net_instaweb
@@ -33,6 +33,9 @@
 // BM_MinifyJavascriptOld/32k      666505     669240       1000
 // BM_MinifyJavascriptOld/256k    4989183    5005530        100
 //
+// BM_TokenizeJavascript and BM_TokenizeJavascriptRegexOnly report MB/s for
+// the tokenizer alone, with and without its byte-class fast paths.
+//
 // Disclaimer: comparing runs over time and across different machines
 // can be misleading.  When contemplating an algorithm change, always do
 // interleaved runs with the old & new algorithm.
@@ -43,6 +46,8 @@
 #include "pagespeed/kernel/base/null_message_handler.h"
 #include "pagespeed/kernel/base/null_statistics.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/js/js_keywords.h"
 #include "pagespeed/kernel/js/js_tokenizer.h"
 
 namespace net_instaweb {
@@ -72,6 +77,34 @@ void TestMinifyJavascript(bool use_experimental_minifier,
     JavascriptCodeBlock block(in_text, &config, "" /* message_id */, &handler);
     block.Rewrite();
   }
+  SetBenchmarkBytesProcessed(
+      static_cast<int64>(state.iterations()) * in_text.size());
+}
+
+void TestTokenizeJavascript(bool use_fast_paths, benchmark::State& state) {
+  StopBenchmarkTiming();
+  GoogleString in_text;
+  while (in_text.size() < (1 << 18)) {
+    StrAppend(&in_text, JS_console_js, "\n");
+  }
+  pagespeed::js::JsTokenizerPatterns js_tokenizer_patterns;
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < state.iterations(); ++i) {
+    pagespeed::js::JsTokenizer tokenizer(&js_tokenizer_patterns, in_text);
+    if (!use_fast_paths) {
+      tokenizer.DisableFastPathsForTest();
+    }
+    StringPiece token;
+    pagespeed::JsKeywords::Type type;
+    do {
+      type = tokenizer.NextToken(&token);
+    } while (type != pagespeed::JsKeywords::kEndOfInput &&
+             type != pagespeed::JsKeywords::kError);
+    CHECK_EQ(pagespeed::JsKeywords::kEndOfInput, type);
+  }
+  SetBenchmarkBytesProcessed(
+      static_cast<int64>(state.iterations()) * in_text.size());
 }
 
 static void BM_MinifyJavascriptNew(benchmark::State& state) {
@@ -84,6 +117,16 @@ static void BM_MinifyJavascriptOld(benchmark::State& state) {
 }
 BENCHMARK_RANGE(BM_MinifyJavascriptOld, 1 << 6, 1 << 18);
 
+static void BM_TokenizeJavascript(benchmark::State& state) {
+  TestTokenizeJavascript(true, state);
+}
+BENCHMARK(BM_TokenizeJavascript);
+
+static void BM_TokenizeJavascriptRegexOnly(benchmark::State& state) {
+  TestTokenizeJavascript(false, state);
+}
+BENCHMARK(BM_TokenizeJavascriptRegexOnly);
+
 }  // namespace
 
 }  // namespace net_instaweb
@@ -17,8 +17,11 @@
  * under the License.
  */
 
+#include <cstring>
+
 #include "base/logging.h"
 #include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/stdio_file_system.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -35,6 +38,16 @@
 //   BM_1MWholeFile                10000            122070 ns/op
 //   BM_1MStreamingFile             2000            760416 ns/op
 //
+// The SharedString reads compare FileCache::Get's old path, which copied
+// each value twice, with ReadFileToSharedString, which maps files of
+// 256k and up.  Median of 5 runs on a 1-CPU VM, -O2, warm page cache:
+//   BM_4kCopyToSharedString                  4997 ns/op
+//   BM_4kReadFileToSharedString              3596 ns/op
+//   BM_256kCopyToSharedString              283214 ns/op
+//   BM_256kReadFileToSharedString           23089 ns/op
+//   BM_4MCopyToSharedString               8865152 ns/op
+//   BM_4MReadFileToSharedString            277859 ns/op
+//
 //
 // Disclaimer: comparing runs over time and across different machines
 // can be misleading.  When contemplating an algorithm change, always do
@@ -68,6 +81,32 @@ class FSTester {
     StopBenchmarkTiming();
   }
 
+  // Reads the file into a SharedString the way FileCache::Get used to,
+  // copying it once into a GoogleString and again into the SharedString,
+  // then scans the value as a consumer would.
+  void CopyToSharedString(benchmark::State& state) {
+    StartBenchmarkTiming();
+    for (int i = 0; i < state.iterations(); ++i) {
+      GoogleString buf;
+      CHECK(file_system_.ReadFile(filename_.c_str(), &buf, &handler_));
+      SharedString value(buf);
+      CHECK(memchr(value.data(), '\0', value.size()) == nullptr);
+    }
+    StopBenchmarkTiming();
+  }
+
+  // As above, but via ReadFileToSharedString, which maps large files.
+  void ReadFileToSharedString(benchmark::State& state) {
+    StartBenchmarkTiming();
+    for (int i = 0; i < state.iterations(); ++i) {
+      SharedString value;
+      CHECK(file_system_.ReadFileToSharedString(
+          filename_.c_str(), FileSystem::kUnlimitedSize, &value, &handler_));
+      CHECK(memchr(value.data(), '\0', value.size()) == nullptr);
+    }
+    StopBenchmarkTiming();
+  }
+
   void StreamingReadFile(benchmark::State& state) {
     StartBenchmarkTiming();
     for (int i = 0; i < state.iterations(); ++i) {
@@ -108,6 +147,42 @@ static void BM_1MStreamingFile(benchmark::State& state) {
 }
 BENCHMARK(BM_1MStreamingFile);
 
+static void BM_4kCopyToSharedString(benchmark::State& state) {
+  FSTester fs_tester(4 * 1024);
+  fs_tester.CopyToSharedString(state);
+}
+BENCHMARK(BM_4kCopyToSharedString);
+
+static void BM_4kReadFileToSharedString(benchmark::State& state) {
+  FSTester fs_tester(4 * 1024);
+  fs_tester.ReadFileToSharedString(state);
+}
+BENCHMARK(BM_4kReadFileToSharedString);
+
+static void BM_256kCopyToSharedString(benchmark::State& state) {
+  FSTester fs_tester(256 * 1024);
+  fs_tester.CopyToSharedString(state);
+}
+BENCHMARK(BM_256kCopyToSharedString);
+
+static void BM_256kReadFileToSharedString(benchmark::State& state) {
+  FSTester fs_tester(256 * 1024);
+  fs_tester.ReadFileToSharedString(state);
+}
+BENCHMARK(BM_256kReadFileToSharedString);
+
+static void BM_4MCopyToSharedString(benchmark::State& state) {
+  FSTester fs_tester(4 * 1024 * 1024);
+  fs_tester.CopyToSharedString(state);
+}
+BENCHMARK(BM_4MCopyToSharedString);
+
+static void BM_4MReadFileToSharedString(benchmark::State& state) {
+  FSTester fs_tester(4 * 1024 * 1024);
+  fs_tester.ReadFileToSharedString(state);
+}
+BENCHMARK(BM_4MReadFileToSharedString);
+
 }  // namespace
 
 }  // namespace net_instaweb
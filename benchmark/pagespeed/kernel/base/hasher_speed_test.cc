@@ -0,0 +1,110 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//
+// Compares MD5Hasher and XXH3Hasher hashing contents from 1KB to 10MB (the
+// benchmark range argument), both in one call to Hash and streamed through
+// a Hasher::Stream in 32KB pieces, as bodies arrive from a fetch.
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include <algorithm>
+#include <memory>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/hasher.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/xxh3_hasher.h"
+// clang-format off
+#include "benchmark/benchmark.h"
+// clang-format on
+
+namespace net_instaweb {
+
+namespace {
+
+const int kMinSize = 1 << 10;
+const int kMaxSize = 10 << 20;
+const int kChunkSize = 32 << 10;
+
+GoogleString MakeContents(int size) {
+  GoogleString contents(size, '\0');
+  for (int i = 0; i < size; ++i) {
+    contents[i] = static_cast<char>((i * 2654435761U) >> 13);
+  }
+  return contents;
+}
+
+void HashOneShot(const Hasher& hasher, benchmark::State& state) {
+  StopBenchmarkTiming();
+  GoogleString contents = MakeContents(state.range(0));
+  StartBenchmarkTiming();
+  for (int i = 0; i < state.iterations(); ++i) {
+    hasher.Hash(contents);
+  }
+  StopBenchmarkTiming();
+  state.SetBytesProcessed(static_cast<int64>(state.iterations()) *
+                          contents.size());
+}
+
+void HashStreamed(const Hasher& hasher, benchmark::State& state) {
+  StopBenchmarkTiming();
+  GoogleString contents = MakeContents(state.range(0));
+  StartBenchmarkTiming();
+  for (int i = 0; i < state.iterations(); ++i) {
+    std::unique_ptr<Hasher::Stream> stream(hasher.NewStream());
+    for (StringPiece remaining(contents); !remaining.empty();
+         remaining.remove_prefix(std::min<size_t>(kChunkSize,
+                                                  remaining.size()))) {
+      stream->Update(remaining.substr(0, kChunkSize));
+    }
+    stream->Finalize();
+  }
+  StopBenchmarkTiming();
+  state.SetBytesProcessed(static_cast<int64>(state.iterations()) *
+                          contents.size());
+}
+
+static void BM_MD5Hash(benchmark::State& state) {
+  HashOneShot(MD5Hasher(), state);
+}
+BENCHMARK_RANGE(BM_MD5Hash, kMinSize, kMaxSize);
+
+static void BM_XXH3Hash(benchmark::State& state) {
+  HashOneShot(XXH3Hasher(), state);
+}
+BENCHMARK_RANGE(BM_XXH3Hash, kMinSize, kMaxSize);
+
+static void BM_MD5Stream(benchmark::State& state) {
+  HashStreamed(MD5Hasher(), state);
+}
+BENCHMARK_RANGE(BM_MD5Stream, kMinSize, kMaxSize);
+
+static void BM_XXH3Stream(benchmark::State& state) {
+  HashStreamed(XXH3Hasher(), state);
+}
+BENCHMARK_RANGE(BM_XXH3Stream, kMinSize, kMaxSize);
+
+}  // namespace
+
+}  // namespace net_instaweb
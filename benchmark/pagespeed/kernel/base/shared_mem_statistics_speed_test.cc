@@ -0,0 +1,197 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//
+// Measures statistics increment throughput with 1, 8 and 64 threads all
+// hammering the same counter, comparing:
+//   - a sharded SharedMemStatistics Variable,
+//   - a single-slot SharedMemStatistics UpDownCounter, and
+//   - a mutex-protected SimpleStats Variable, as a baseline.
+//
+// Each iteration is kIncrementsPerIter Add(1) calls per thread, so the
+// increments/sec is kIncrementsPerIter * threads * 1e9 / Time(ns).
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include <memory>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/posix_timer.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/stdio_file_system.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_statistics.h"
+#include "pagespeed/kernel/thread/pthread_shared_mem.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+// clang-format off
+#include "benchmark/benchmark.h"
+// clang-format on
+
+namespace net_instaweb {
+
+namespace {
+
+const int kIncrementsPerIter = 100;
+const char kVariable[] = "speed_test_variable";
+const char kUpDown[] = "speed_test_up_down";
+const char kPrefix[] = "/prefix/";
+
+class IncrementThread : public ThreadSystem::Thread {
+ public:
+  IncrementThread(ThreadSystem* thread_system, Variable* variable,
+                  UpDownCounter* up_down, int iters)
+      : Thread(thread_system, "stats_increment", ThreadSystem::kJoinable),
+        variable_(variable),
+        up_down_(up_down),
+        iters_(iters) {}
+
+  void Run() override {
+    for (int i = 0; i < iters_; ++i) {
+      for (int k = 0; k < kIncrementsPerIter; ++k) {
+        if (variable_ != nullptr) {
+          variable_->Add(1);
+        } else {
+          up_down_->Add(1);
+        }
+      }
+    }
+  }
+
+ private:
+  Variable* variable_;
+  UpDownCounter* up_down_;
+  int iters_;
+
+  DISALLOW_COPY_AND_ASSIGN(IncrementThread);
+};
+
+void RunIncrements(benchmark::State& state, ThreadSystem* thread_system,
+                   int num_threads, Variable* variable,
+                   UpDownCounter* up_down) {
+  std::vector<std::unique_ptr<IncrementThread>> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back(new IncrementThread(thread_system, variable, up_down,
+                                             state.iterations()));
+  }
+
+  StartBenchmarkTiming();
+  for (auto& thread : threads) {
+    CHECK(thread->Start());
+  }
+  for (auto& thread : threads) {
+    thread->Join();
+  }
+  StopBenchmarkTiming();
+
+  int64 expected =
+      static_cast<int64>(state.iterations()) * kIncrementsPerIter * num_threads;
+  CHECK_EQ(expected,
+           variable != nullptr ? variable->Get() : up_down->Get());
+  state.SetItemsProcessed(expected);
+}
+
+void RunSharedMem(benchmark::State& state, int num_threads, bool up_down) {
+  StopBenchmarkTiming();
+  std::unique_ptr<ThreadSystem> thread_system(Platform::CreateThreadSystem());
+  PthreadSharedMem shmem_runtime;
+  GoogleMessageHandler handler;
+  StdioFileSystem file_system;
+  PosixTimer timer;
+  SharedMemStatistics stats(
+      0 /* logging_interval_ms */, 0 /* max_logfile_size_kb */,
+      "" /* logging_file */, false /* logging */, kPrefix, &shmem_runtime,
+      &handler, &file_system, &timer);
+  stats.AddVariable(kVariable);
+  stats.AddUpDownCounter(kUpDown);
+  CHECK(stats.Init(true /* parent */, &handler));
+
+  if (up_down) {
+    RunIncrements(state, thread_system.get(), num_threads, nullptr,
+                  stats.GetUpDownCounter(kUpDown));
+  } else {
+    RunIncrements(state, thread_system.get(), num_threads,
+                  stats.GetVariable(kVariable), nullptr);
+  }
+  stats.GlobalCleanup(&handler);
+}
+
+void RunSimpleStats(benchmark::State& state, int num_threads) {
+  StopBenchmarkTiming();
+  std::unique_ptr<ThreadSystem> thread_system(Platform::CreateThreadSystem());
+  SimpleStats stats(thread_system.get());
+  RunIncrements(state, thread_system.get(), num_threads,
+                stats.AddVariable(kVariable), nullptr);
+}
+
+static void BM_ShardedVariable1Thread(benchmark::State& state) {
+  RunSharedMem(state, 1, false);
+}
+BENCHMARK(BM_ShardedVariable1Thread);
+
+static void BM_UpDownCounter1Thread(benchmark::State& state) {
+  RunSharedMem(state, 1, true);
+}
+BENCHMARK(BM_UpDownCounter1Thread);
+
+static void BM_SimpleStatsVariable1Thread(benchmark::State& state) {
+  RunSimpleStats(state, 1);
+}
+BENCHMARK(BM_SimpleStatsVariable1Thread);
+
+static void BM_ShardedVariable8Threads(benchmark::State& state) {
+  RunSharedMem(state, 8, false);
+}
+BENCHMARK(BM_ShardedVariable8Threads);
+
+static void BM_UpDownCounter8Threads(benchmark::State& state) {
+  RunSharedMem(state, 8, true);
+}
+BENCHMARK(BM_UpDownCounter8Threads);
+
+static void BM_SimpleStatsVariable8Threads(benchmark::State& state) {
+  RunSimpleStats(state, 8);
+}
+BENCHMARK(BM_SimpleStatsVariable8Threads);
+
+static void BM_ShardedVariable64Threads(benchmark::State& state) {
+  RunSharedMem(state, 64, false);
+}
+BENCHMARK(BM_ShardedVariable64Threads);
+
+static void BM_UpDownCounter64Threads(benchmark::State& state) {
+  RunSharedMem(state, 64, true);
+}
+BENCHMARK(BM_UpDownCounter64Threads);
+
+static void BM_SimpleStatsVariable64Threads(benchmark::State& state) {
+  RunSimpleStats(state, 64);
+}
+BENCHMARK(BM_SimpleStatsVariable64Threads);
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -18,19 +18,32 @@
  */
 
 //
-// Tests the overhead of the CompressedCache adapter, using 1k/1M insert sizes,
-// with two different levels of entropy.  For high entropy we use a big block
-// of randomly generated bytes.  For low entropy we use a smaller block of
-// randomly generated bytes, concatenated together to form the total size
-// we want.
+// Tests the overhead of the CompressedCache adapter with each codec, using
+// 1k/1M insert sizes, with two different levels of entropy.  For high
+// entropy we use a big block of randomly generated bytes.  For low entropy we
+// use a smaller block of randomly generated bytes, concatenated together to
+// form the total size we want.  BM_Compress* use deflate, the default.
 //
+// Each iteration does a Put and a Get.  Ratio is the size of the stored entry
+// divided by the size of the value, and MB/s is the value size divided by
+// Time.  High-entropy values are detected as incompressible and stored as
+// they are, which is why they cost about the same with every codec.
 //
-// Benchmark                  Time(ns)    CPU(ns) Iterations
-// ---------------------------------------------------------
-// BM_Compress1MHighEntropy   38755898   38600000        100
-// BM_Compress1KHighEntropy      62425      63000      10000
-// BM_Compress1MLowEntropy     7175143    7100000        100
-// BM_Compress1KLowEntropy       16620      16514      41176
+// Benchmark                      Time(ns)   Ratio    MB/s
+// -------------------------------------------------------
+// BM_Compress1MHighEntropy        1836043   1.000     545
+// BM_Compress1KHighEntropy          38549   1.009      26
+// BM_Compress1MLowEntropy         7480442   0.006     134
+// BM_Compress1KLowEntropy           15891   0.080      63
+// BM_Brotli1MHighEntropy          1577603   1.000     634
+// BM_Brotli1KHighEntropy            39137   1.009      26
+// BM_Brotli1MLowEntropy           4151475   0.001     241
+// BM_Brotli1KLowEntropy             23452   0.085      43
+// BM_Uncompressed1MHighEntropy    1272667   1.000     786
+// BM_Uncompressed1MLowEntropy     1256076   1.000     796
+//
+// Before incompressible values were detected, BM_Compress1MHighEntropy took
+// 40292240ns on the same machine.
 //
 // Disclaimer: comparing runs over time and across different machines
 // can be misleading.  When contemplating an algorithm change, always do
@@ -64,7 +77,8 @@ class EmptyCallback : public net_instaweb::CacheInterface::Callback {
   DISALLOW_COPY_AND_ASSIGN(EmptyCallback);
 };
 
-void TestCachePayload(int payload_size, int chunk_size, int iters) {
+void TestCachePayload(net_instaweb::CompressedCache::Codec codec,
+                      int payload_size, int chunk_size, int iters) {
   GoogleString value;
   net_instaweb::SimpleRandom random(new net_instaweb::NullMutex);
   GoogleString chunk = random.GenerateHighEntropyString(chunk_size);
@@ -78,6 +92,8 @@ void TestCachePayload(int payload_size, int chunk_size, int iters) {
   net_instaweb::LRUCache* lru_cache =
       new net_instaweb::LRUCache(value.size() * 2);
   net_instaweb::CompressedCache compressed_cache(lru_cache, &stats);
+  compressed_cache.SetCodec(codec,
+                            net_instaweb::CompressedCache::kDefaultLevel);
   EmptyCallback empty_callback;
   net_instaweb::SharedString str(value);
   for (int i = 0; i < iters; ++i) {
@@ -87,19 +103,53 @@ void TestCachePayload(int payload_size, int chunk_size, int iters) {
 }
 
 static void BM_Compress1MHighEntropy(benchmark::State& state) {
-  TestCachePayload(1000 * 1000, 1000 * 1000, state.iterations());
+  TestCachePayload(net_instaweb::CompressedCache::kDeflate, 1000 * 1000,
+                   1000 * 1000, state.iterations());
 }
 
 static void BM_Compress1KHighEntropy(benchmark::State& state) {
-  TestCachePayload(1000, 1000, state.iterations());
+  TestCachePayload(net_instaweb::CompressedCache::kDeflate, 1000, 1000,
+                   state.iterations());
 }
 
 static void BM_Compress1MLowEntropy(benchmark::State& state) {
-  TestCachePayload(1000 * 1000, 1000, state.iterations());
+  TestCachePayload(net_instaweb::CompressedCache::kDeflate, 1000 * 1000, 1000,
+                   state.iterations());
 }
 
 static void BM_Compress1KLowEntropy(benchmark::State& state) {
-  TestCachePayload(1000, 50, state.iterations());
+  TestCachePayload(net_instaweb::CompressedCache::kDeflate, 1000, 50,
+                   state.iterations());
+}
+
+static void BM_Brotli1MHighEntropy(benchmark::State& state) {
+  TestCachePayload(net_instaweb::CompressedCache::kBrotli, 1000 * 1000,
+                   1000 * 1000, state.iterations());
+}
+
+static void BM_Brotli1KHighEntropy(benchmark::State& state) {
+  TestCachePayload(net_instaweb::CompressedCache::kBrotli, 1000, 1000,
+                   state.iterations());
+}
+
+static void BM_Brotli1MLowEntropy(benchmark::State& state) {
+  TestCachePayload(net_instaweb::CompressedCache::kBrotli, 1000 * 1000, 1000,
+                   state.iterations());
+}
+
+static void BM_Brotli1KLowEntropy(benchmark::State& state) {
+  TestCachePayload(net_instaweb::CompressedCache::kBrotli, 1000, 50,
+                   state.iterations());
+}
+
+static void BM_Uncompressed1MHighEntropy(benchmark::State& state) {
+  TestCachePayload(net_instaweb::CompressedCache::kNone, 1000 * 1000,
+                   1000 * 1000, state.iterations());
+}
+
+static void BM_Uncompressed1MLowEntropy(benchmark::State& state) {
+  TestCachePayload(net_instaweb::CompressedCache::kNone, 1000 * 1000, 1000,
+                   state.iterations());
 }
 
 }  // namespace
@@ -108,3 +158,9 @@ BENCHMARK(BM_Compress1MHighEntropy);
 BENCHMARK(BM_Compress1KHighEntropy);
 BENCHMARK(BM_Compress1MLowEntropy);
 BENCHMARK(BM_Compress1KLowEntropy);
+BENCHMARK(BM_Brotli1MHighEntropy);
+BENCHMARK(BM_Brotli1KHighEntropy);
+BENCHMARK(BM_Brotli1MLowEntropy);
+BENCHMARK(BM_Brotli1KLowEntropy);
+BENCHMARK(BM_Uncompressed1MHighEntropy);
+BENCHMARK(BM_Uncompressed1MLowEntropy);
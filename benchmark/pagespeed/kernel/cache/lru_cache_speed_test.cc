@@ -30,10 +30,22 @@
 // LRUFailedGets         16068878   16000000        100
 // LRUEvictions         143558421  143200000        100
 //
+// The threaded Get/Put benchmarks compare ThreadsafeCache(LRUCache) with a
+// 16-way ShardedLRUCache, 8 threads each doing 100k operations per
+// iteration.  Medians of five runs on a single-core VM, where the gain comes
+// from threads no longer queueing behind a preempted lock holder rather than
+// from parallelism; expect a bigger gap with more cores.
+//
+// Benchmark              Time(ns)
+// -------------------------------
+// LRUThreadsafeGetPuts  376268108
+// LRUShardedGetPuts     318174730
+//
 // Disclaimer: comparing runs over time and across different machines
 // can be misleading.  When contemplating an algorithm change, always do
 // interleaved runs with the old & new algorithm.
 
+#include <memory>
 #include <vector>
 
 #include "base/logging.h"
@@ -43,7 +55,12 @@
 #include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
+#include "pagespeed/kernel/cache/threadsafe_cache.h"
+#include "pagespeed/kernel/util/platform.h"
 #include "pagespeed/kernel/util/simple_random.h"
 // clang-format off
 #include "benchmark/benchmark.h"
@@ -192,6 +209,103 @@ static void LRUEvictions(benchmark::State& state) {
   CHECK_LT(0, static_cast<int>(payload.lru_cache()->num_evictions()));
 }
 
+// The multi-threaded benchmarks below have kNumThreads threads hammer one
+// cache with a 9:1 mix of Gets and Puts over a shared set of keys, all of
+// which fit in the cache.
+const int kNumThreads = 8;
+const int kNumSharedKeys = 10000;
+const int kOpsPerThread = 100000;
+const int kNumShards = 16;
+
+class GetPutThread : public net_instaweb::ThreadSystem::Thread {
+ public:
+  GetPutThread(net_instaweb::ThreadSystem* thread_system,
+               net_instaweb::CacheInterface* cache,
+               const net_instaweb::StringVector* keys,
+               const net_instaweb::SharedString* value, int index)
+      : Thread(thread_system, "get_put", net_instaweb::ThreadSystem::kJoinable),
+        cache_(cache),
+        keys_(keys),
+        value_(value),
+        index_(index) {}
+
+ protected:
+  void Run() override {
+    // Each thread walks the keys with a different stride, so they collide
+    // on the same keys only occasionally, as requests for popular
+    // resources would.
+    int num_keys = keys_->size();
+    int k = index_;
+    for (int i = 0; i < kOpsPerThread; ++i) {
+      k = (k + 2 * index_ + 1) % num_keys;
+      if (i % 10 == 0) {
+        cache_->Put((*keys_)[k], *value_);
+      } else {
+        cache_->Get((*keys_)[k], &callback_);
+      }
+    }
+  }
+
+ private:
+  net_instaweb::CacheInterface* cache_;
+  const net_instaweb::StringVector* keys_;
+  const net_instaweb::SharedString* value_;
+  int index_;
+  EmptyCallback callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(GetPutThread);
+};
+
+void ThreadedGetPuts(benchmark::State& state,
+                     net_instaweb::ThreadSystem* thread_system,
+                     net_instaweb::CacheInterface* cache) {
+  StopBenchmarkTiming();
+  net_instaweb::SimpleRandom random(new net_instaweb::NullMutex);
+  GoogleString key_prefix = random.GenerateHighEntropyString(kKeySize);
+  net_instaweb::SharedString value(
+      random.GenerateHighEntropyString(kPayloadSize));
+  net_instaweb::StringVector keys(kNumSharedKeys);
+  for (int k = 0; k < kNumSharedKeys; ++k) {
+    keys[k] = StrCat(key_prefix, net_instaweb::IntegerToString(k));
+    cache->Put(keys[k], value);
+  }
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < state.iterations(); ++i) {
+    std::vector<std::unique_ptr<GetPutThread>> threads;
+    for (int t = 0; t < kNumThreads; ++t) {
+      threads.emplace_back(
+          new GetPutThread(thread_system, cache, &keys, &value, t));
+    }
+    for (int t = 0; t < kNumThreads; ++t) {
+      CHECK(threads[t]->Start());
+    }
+    for (int t = 0; t < kNumThreads; ++t) {
+      threads[t]->Join();
+    }
+  }
+}
+
+static void LRUThreadsafeGetPuts(benchmark::State& state) {
+  std::unique_ptr<net_instaweb::ThreadSystem> thread_system(
+      net_instaweb::Platform::CreateThreadSystem());
+  net_instaweb::LRUCache lru_cache(kNumSharedKeys * 2 *
+                                   (kKeySize + kPayloadSize));
+  net_instaweb::ThreadsafeCache cache(&lru_cache, thread_system->NewMutex());
+  ThreadedGetPuts(state, thread_system.get(), &cache);
+  CHECK_EQ(0, static_cast<int>(lru_cache.num_evictions()));
+}
+
+static void LRUShardedGetPuts(benchmark::State& state) {
+  std::unique_ptr<net_instaweb::ThreadSystem> thread_system(
+      net_instaweb::Platform::CreateThreadSystem());
+  net_instaweb::ShardedLRUCache cache(
+      kNumSharedKeys * 2 * (kKeySize + kPayloadSize), kNumShards,
+      thread_system.get());
+  ThreadedGetPuts(state, thread_system.get(), &cache);
+  CHECK_EQ(0, static_cast<int>(cache.num_evictions()));
+}
+
 }  // namespace
 
 // TODO(XXX): this leaks and crashes. look into that.
@@ -201,3 +315,5 @@ static void LRUEvictions(benchmark::State& state) {
 //BENCHMARK(LRUGets);
 //BENCHMARK(LRUFailedGets);
 //BENCHMARK(LRUEvictions);
+BENCHMARK(LRUThreadsafeGetPuts);
+BENCHMARK(LRUShardedGetPuts);
@@ -0,0 +1,195 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//
+// Measures SharedMemCache Get throughput with 4, 16 and 64 processes all
+// reading from the same metadata-sized cache, comparing lock-free reads
+// with reads that take the sector lock.  The processes are forked the same
+// way PthreadSharedMemProcEnv does in the shared memory tests, and attach
+// to the cache before timing starts.
+//
+// Each iteration is kGetsPerIter Gets per process, so the Gets/sec is
+// kGetsPerIter * processes * 1e9 / Time(ns).
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/posix_timer.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_cache.h"
+#include "pagespeed/kernel/thread/pthread_shared_mem.h"
+// clang-format off
+#include "benchmark/benchmark.h"
+// clang-format on
+
+namespace net_instaweb {
+
+namespace {
+
+typedef SharedMemCache<64> MetadataCache;
+
+const int kGetsPerIter = 100;
+const int kNumKeys = 1000;
+const int kValueSize = 300;  // About the size of a metadata cache entry.
+const int kCacheKb = 10 * 1024;
+const int kSectors = 64;
+const char kSegment[] = "shared_mem_cache_speed_test";
+const char kStartSegment[] = "shared_mem_cache_speed_test_start";
+
+GoogleString Key(int index) { return StrCat("key", IntegerToString(index)); }
+
+MetadataCache* NewCache(AbstractSharedMem* shmem_runtime, Timer* timer,
+                        const Hasher* hasher, MessageHandler* handler) {
+  int entries, blocks;
+  int64 size_cap;
+  MetadataCache::ComputeDimensions(kCacheKb, 2 /* block/entry ratio */,
+                                   kSectors, &entries, &blocks, &size_cap);
+  return new MetadataCache(shmem_runtime, kSegment, timer, hasher, kSectors,
+                           entries, blocks, handler);
+}
+
+// Runs in a forked child: attaches to the cache, waits for the parent to
+// say go, and then does its share of Gets.  Never returns.
+void RunChild(int child_index, int num_gets, bool lock_free,
+              AbstractSharedMem* shmem_runtime, std::atomic<int32>* start) {
+  PosixTimer timer;
+  MD5Hasher hasher;
+  GoogleMessageHandler handler;
+  std::unique_ptr<MetadataCache> cache(
+      NewCache(shmem_runtime, &timer, &hasher, &handler));
+  if (!cache->Attach()) {
+    _exit(1);
+  }
+  cache->SetLockFreeReadsForTesting(lock_free);
+  while (start->load(std::memory_order_acquire) == 0) {
+    sched_yield();
+  }
+
+  // Each child walks the keys with a different stride, so they all read
+  // the same entries, but not in lock step.
+  int stride = 2 * child_index + 1;
+  for (int i = 0; i < num_gets; ++i) {
+    CacheInterface::SynchronousCallback callback;
+    cache->Get(Key((i * stride) % kNumKeys), &callback);
+    if (callback.state() != CacheInterface::kAvailable) {
+      _exit(2);
+    }
+  }
+  _exit(0);
+}
+
+void RunGets(benchmark::State& state, int num_processes, bool lock_free) {
+  StopBenchmarkTiming();
+  PthreadSharedMem shmem_runtime;
+  GoogleMessageHandler handler;
+  PosixTimer timer;
+  MD5Hasher hasher;
+
+  std::unique_ptr<AbstractSharedMemSegment> start_segment(
+      shmem_runtime.CreateSegment(kStartSegment, sizeof(std::atomic<int32>),
+                                  &handler));
+  CHECK(start_segment != nullptr);
+  std::atomic<int32>* start = reinterpret_cast<std::atomic<int32>*>(
+      const_cast<char*>(start_segment->Base()));
+  start->store(0);
+
+  std::unique_ptr<MetadataCache> cache(
+      NewCache(&shmem_runtime, &timer, &hasher, &handler));
+  CHECK(cache->Initialize());
+  SharedString value(GoogleString(kValueSize, 'v'));
+  for (int k = 0; k < kNumKeys; ++k) {
+    cache->Put(Key(k), value);
+  }
+
+  int num_gets = state.iterations() * kGetsPerIter;
+  std::vector<pid_t> children;
+  for (int p = 0; p < num_processes; ++p) {
+    pid_t pid = fork();
+    CHECK_NE(-1, pid);
+    if (pid == 0) {
+      RunChild(p, num_gets, lock_free, &shmem_runtime, start);
+    }
+    children.push_back(pid);
+  }
+
+  StartBenchmarkTiming();
+  start->store(1, std::memory_order_release);
+  for (pid_t child : children) {
+    int status;
+    CHECK_EQ(child, waitpid(child, &status, 0));
+    CHECK(WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+        << "Child failed with status " << status;
+  }
+  StopBenchmarkTiming();
+
+  state.SetItemsProcessed(static_cast<int64>(num_gets) * num_processes);
+  MetadataCache::GlobalCleanup(&shmem_runtime, kSegment, &handler);
+  shmem_runtime.DestroySegment(kStartSegment, &handler);
+}
+
+static void BM_LockFreeGets4Processes(benchmark::State& state) {
+  RunGets(state, 4, true);
+}
+BENCHMARK(BM_LockFreeGets4Processes);
+
+static void BM_LockedGets4Processes(benchmark::State& state) {
+  RunGets(state, 4, false);
+}
+BENCHMARK(BM_LockedGets4Processes);
+
+static void BM_LockFreeGets16Processes(benchmark::State& state) {
+  RunGets(state, 16, true);
+}
+BENCHMARK(BM_LockFreeGets16Processes);
+
+static void BM_LockedGets16Processes(benchmark::State& state) {
+  RunGets(state, 16, false);
+}
+BENCHMARK(BM_LockedGets16Processes);
+
+static void BM_LockFreeGets64Processes(benchmark::State& state) {
+  RunGets(state, 64, true);
+}
+BENCHMARK(BM_LockFreeGets64Processes);
+
+static void BM_LockedGets64Processes(benchmark::State& state) {
+  RunGets(state, 64, false);
+}
+BENCHMARK(BM_LockedGets64Processes);
+
+}  // namespace
+
+}  // namespace net_instaweb
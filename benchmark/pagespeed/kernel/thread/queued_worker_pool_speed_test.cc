@@ -0,0 +1,215 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//
+// Measures QueuedWorkerPool throughput for many short Functions with 1, 8
+// and 64 worker threads, with the default shared queue and with
+// EnableWorkStealing().
+//
+// Each iteration starts kNumSequences chains of kChainLength functions.
+// Every function records how long it waited to run, then adds the next
+// function in its chain to a different sequence, so most work is queued
+// from the worker threads themselves, as it is for rewrites.  The
+// items/sec is tasks/sec; the wait-time percentiles are printed after
+// each benchmark.
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/condvar.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/posix_timer.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+#include "pagespeed/kernel/util/platform.h"
+// clang-format off
+#include "benchmark/benchmark.h"
+// clang-format on
+
+namespace net_instaweb {
+
+namespace {
+
+const int kNumSequences = 256;
+const int kChainLength = 100;
+
+// State shared by all the functions of one benchmark run.
+class ChainRun {
+ public:
+  ChainRun(ThreadSystem* thread_system, QueuedWorkerPool* pool)
+      : mutex_(thread_system->NewMutex()),
+        done_(mutex_->NewCondvar()),
+        latencies_us_(kNumSequences),
+        remaining_(0) {
+    for (int i = 0; i < kNumSequences; ++i) {
+      sequences_.push_back(pool->NewSequence());
+    }
+  }
+
+  // Queues a function on sequence index.  It waits in the pool, records
+  // its wait, and queues the next link until hops_left runs out.
+  void Add(int index, int hops_left);
+
+  // Starts kNumSequences chains and waits for all of them to finish.
+  void RunChains() {
+    remaining_ = kNumSequences * kChainLength;
+    for (int i = 0; i < kNumSequences; ++i) {
+      Add(i, kChainLength - 1);
+    }
+    ScopedMutex lock(mutex_.get());
+    while (remaining_.load() != 0) {
+      done_->Wait();
+    }
+  }
+
+  void Finished(int index, int64 queued_us) {
+    // Functions on one sequence never run concurrently, so each sequence
+    // can append to its own vector without locking.
+    latencies_us_[index].push_back(timer_.NowUs() - queued_us);
+    if (--remaining_ == 0) {
+      ScopedMutex lock(mutex_.get());
+      done_->Signal();
+    }
+  }
+
+  void Report(const char* name, QueuedWorkerPool* pool) {
+    std::vector<int64> all;
+    for (int i = 0; i < kNumSequences; ++i) {
+      all.insert(all.end(), latencies_us_[i].begin(),
+                 latencies_us_[i].end());
+      pool->FreeSequence(sequences_[i]);
+    }
+    if (all.empty()) {
+      return;
+    }
+    std::sort(all.begin(), all.end());
+    fprintf(stdout, "%s: wait p50 %sus p99 %sus p99.9 %sus\n", name,
+            Integer64ToString(all[all.size() / 2]).c_str(),
+            Integer64ToString(all[all.size() * 99 / 100]).c_str(),
+            Integer64ToString(all[all.size() * 999 / 1000]).c_str());
+  }
+
+ private:
+  PosixTimer timer_;
+  std::unique_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  std::unique_ptr<ThreadSystem::Condvar> done_;
+  std::vector<QueuedWorkerPool::Sequence*> sequences_;
+  std::vector<std::vector<int64>> latencies_us_;
+  std::atomic<int> remaining_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChainRun);
+};
+
+class ChainFunction : public Function {
+ public:
+  ChainFunction(ChainRun* run, int index, int hops_left, int64 queued_us)
+      : run_(run),
+        index_(index),
+        hops_left_(hops_left),
+        queued_us_(queued_us) {}
+
+ protected:
+  void Run() override {
+    if (hops_left_ > 0) {
+      // Hop to another sequence, which may be running on another thread.
+      run_->Add((index_ * 7 + 1) % kNumSequences, hops_left_ - 1);
+    }
+    run_->Finished(index_, queued_us_);
+  }
+
+ private:
+  ChainRun* run_;
+  int index_;
+  int hops_left_;
+  int64 queued_us_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChainFunction);
+};
+
+void ChainRun::Add(int index, int hops_left) {
+  sequences_[index]->Add(
+      new ChainFunction(this, index, hops_left, timer_.NowUs()));
+}
+
+void RunPool(benchmark::State& state, const char* name, int num_threads,
+             bool work_stealing) {
+  StopBenchmarkTiming();
+  std::unique_ptr<ThreadSystem> thread_system(Platform::CreateThreadSystem());
+  QueuedWorkerPool pool(num_threads, "speed_test", thread_system.get());
+  if (work_stealing) {
+    pool.EnableWorkStealing();
+  }
+  ChainRun run(thread_system.get(), &pool);
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < state.iterations(); ++i) {
+    run.RunChains();
+  }
+  StopBenchmarkTiming();
+
+  state.SetItemsProcessed(static_cast<int64>(state.iterations()) *
+                          kNumSequences * kChainLength);
+  run.Report(name, &pool);
+  pool.ShutDown();
+}
+
+static void BM_SharedQueue1Thread(benchmark::State& state) {
+  RunPool(state, "SharedQueue1Thread", 1, false);
+}
+BENCHMARK(BM_SharedQueue1Thread);
+
+static void BM_WorkStealing1Thread(benchmark::State& state) {
+  RunPool(state, "WorkStealing1Thread", 1, true);
+}
+BENCHMARK(BM_WorkStealing1Thread);
+
+static void BM_SharedQueue8Threads(benchmark::State& state) {
+  RunPool(state, "SharedQueue8Threads", 8, false);
+}
+BENCHMARK(BM_SharedQueue8Threads);
+
+static void BM_WorkStealing8Threads(benchmark::State& state) {
+  RunPool(state, "WorkStealing8Threads", 8, true);
+}
+BENCHMARK(BM_WorkStealing8Threads);
+
+static void BM_SharedQueue64Threads(benchmark::State& state) {
+  RunPool(state, "SharedQueue64Threads", 64, false);
+}
+BENCHMARK(BM_SharedQueue64Threads);
+
+static void BM_WorkStealing64Threads(benchmark::State& state) {
+  RunPool(state, "WorkStealing64Threads", 64, true);
+}
+BENCHMARK(BM_WorkStealing64Threads);
+
+}  // namespace
+
+}  // namespace net_instaweb
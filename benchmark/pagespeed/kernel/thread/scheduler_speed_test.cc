@@ -0,0 +1,177 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//
+// Measures Scheduler alarm churn: adding an alarm and canceling it again,
+// the way RewriteDriver deadlines and fetch and cache timeouts use alarms,
+// with a population of other outstanding alarms (the benchmark range
+// argument) spread over the next 30 seconds.  Also runs the same churn
+// from 8 threads at once against one scheduler.
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/thread/scheduler.h"
+#include "pagespeed/kernel/util/platform.h"
+// clang-format off
+#include "benchmark/benchmark.h"
+// clang-format on
+
+namespace net_instaweb {
+
+namespace {
+
+const int kNumOffsets = 1024;
+const int64 kMaxOffsetUs = 30 * Timer::kSecondUs;
+
+class NoOpFunction : public Function {
+ public:
+  NoOpFunction() {}
+  void Run() override {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(NoOpFunction);
+};
+
+// Alarm offsets from now, so the random number generator isn't timed.
+std::vector<int64> AlarmOffsetsUs(int seed) {
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<int64> offset_us(Timer::kSecondUs,
+                                                 kMaxOffsetUs);
+  std::vector<int64> offsets;
+  for (int i = 0; i < kNumOffsets; ++i) {
+    offsets.push_back(offset_us(random));
+  }
+  return offsets;
+}
+
+// Adds and cancels an alarm iters times, as AddAlarmAtUs users do.
+void Churn(Scheduler* scheduler, int iters, int seed) {
+  std::vector<int64> offsets = AlarmOffsetsUs(seed);
+  Timer* timer = scheduler->timer();
+  for (int i = 0; i < iters; ++i) {
+    Scheduler::Alarm* alarm = scheduler->AddAlarmAtUs(
+        timer->NowUs() + offsets[i % kNumOffsets], new NoOpFunction);
+    ScopedMutex lock(scheduler->mutex());
+    scheduler->CancelAlarm(alarm);
+  }
+}
+
+class ChurnThread : public ThreadSystem::Thread {
+ public:
+  ChurnThread(ThreadSystem* thread_system, Scheduler* scheduler, int iters,
+              int seed)
+      : Thread(thread_system, "alarm_churn", ThreadSystem::kJoinable),
+        scheduler_(scheduler),
+        iters_(iters),
+        seed_(seed) {}
+
+  void Run() override { Churn(scheduler_, iters_, seed_); }
+
+ private:
+  Scheduler* scheduler_;
+  int iters_;
+  int seed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChurnThread);
+};
+
+// A scheduler with num_outstanding alarms that won't fire during the run.
+class ChurnScheduler {
+ public:
+  explicit ChurnScheduler(int num_outstanding)
+      : thread_system_(Platform::CreateThreadSystem()),
+        timer_(thread_system_->NewTimer()),
+        scheduler_(thread_system_.get(), timer_.get()) {
+    std::vector<int64> offsets = AlarmOffsetsUs(1);
+    ScopedMutex lock(scheduler_.mutex());
+    int64 now_us = timer_->NowUs();
+    for (int i = 0; i < num_outstanding; ++i) {
+      outstanding_.push_back(scheduler_.AddAlarmAtUsMutexHeld(
+          now_us + offsets[i % kNumOffsets], new NoOpFunction));
+    }
+  }
+
+  ~ChurnScheduler() {
+    ScopedMutex lock(scheduler_.mutex());
+    for (Scheduler::Alarm* alarm : outstanding_) {
+      scheduler_.CancelAlarm(alarm);
+    }
+  }
+
+  ThreadSystem* thread_system() { return thread_system_.get(); }
+  Scheduler* scheduler() { return &scheduler_; }
+
+ private:
+  std::unique_ptr<ThreadSystem> thread_system_;
+  std::unique_ptr<Timer> timer_;
+  Scheduler scheduler_;
+  std::vector<Scheduler::Alarm*> outstanding_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChurnScheduler);
+};
+
+static void BM_AddCancelAlarm(benchmark::State& state) {
+  StopBenchmarkTiming();
+  ChurnScheduler churn(state.range(0));
+  StartBenchmarkTiming();
+  Churn(churn.scheduler(), state.iterations(), 2);
+  StopBenchmarkTiming();
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_RANGE(BM_AddCancelAlarm, 1 << 4, 1 << 16);
+
+static void BM_AddCancelAlarm8Threads(benchmark::State& state) {
+  const int kNumThreads = 8;
+  StopBenchmarkTiming();
+  ChurnScheduler churn(state.range(0));
+  std::vector<std::unique_ptr<ChurnThread>> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back(new ChurnThread(
+        churn.thread_system(), churn.scheduler(), state.iterations(), t + 2));
+  }
+
+  StartBenchmarkTiming();
+  for (auto& thread : threads) {
+    CHECK(thread->Start());
+  }
+  for (auto& thread : threads) {
+    thread->Join();
+  }
+  StopBenchmarkTiming();
+  state.SetItemsProcessed(static_cast<int64>(state.iterations()) *
+                          kNumThreads);
+}
+BENCHMARK_RANGE(BM_AddCancelAlarm8Threads, 1 << 4, 1 << 16);
+
+}  // namespace
+
+}  // namespace net_instaweb
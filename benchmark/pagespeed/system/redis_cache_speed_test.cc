@@ -0,0 +1,209 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//
+// Measures RedisCache lookup throughput with 1, 8 and 64 threads, each
+// issuing lookups of kBatchSize keys either one Get() at a time or through
+// a single pipelined MultiGet().
+//
+// Needs a redis-server to talk to; set $REDIS_PORT to its port, e.g. by
+// running the benchmark under install/run_program_with_redis.sh.  Without it
+// the benchmarks log an error and do nothing.
+//
+// Each iteration is one kBatchSize lookup per thread, so the lookups/sec is
+// kBatchSize * threads * 1e9 / Time(ns).
+//
+// Disclaimer: comparing runs over time and across different machines
+// can be misleading.  When contemplating an algorithm change, always do
+// interleaved runs with the old & new algorithm.
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/posix_timer.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+#include "pagespeed/system/redis_cache.h"
+// clang-format off
+#include "benchmark/benchmark.h"
+// clang-format on
+
+namespace net_instaweb {
+
+namespace {
+
+const int kNumKeys = 1000;
+const int kBatchSize = 50;
+const int kPayloadSize = 1000;
+const int kReconnectionDelayMs = 10;
+const int kTimeoutUs = 500 * Timer::kMsUs;
+
+class CountingCallback : public CacheInterface::Callback {
+ public:
+  CountingCallback() : hits_(0) {}
+  void Done(CacheInterface::KeyState state) override {
+    if (state == CacheInterface::kAvailable) {
+      ++hits_;
+    }
+  }
+  int hits() const { return hits_; }
+
+ private:
+  int hits_;
+
+  DISALLOW_COPY_AND_ASSIGN(CountingCallback);
+};
+
+class LookupThread : public ThreadSystem::Thread {
+ public:
+  LookupThread(ThreadSystem* thread_system, RedisCache* cache,
+               const StringVector* keys, int offset, int iters,
+               bool use_multi_get)
+      : Thread(thread_system, "redis_lookup", ThreadSystem::kJoinable),
+        cache_(cache),
+        keys_(keys),
+        offset_(offset),
+        iters_(iters),
+        use_multi_get_(use_multi_get) {}
+
+  void Run() override {
+    for (int i = 0; i < iters_; ++i) {
+      int start = (offset_ + i * kBatchSize) % keys_->size();
+      if (use_multi_get_) {
+        CacheInterface::MultiGetRequest* request =
+            new CacheInterface::MultiGetRequest;
+        for (int k = 0; k < kBatchSize; ++k) {
+          request->push_back(CacheInterface::KeyCallback(
+              (*keys_)[(start + k) % keys_->size()], &callback_));
+        }
+        cache_->MultiGet(request);
+      } else {
+        for (int k = 0; k < kBatchSize; ++k) {
+          cache_->Get((*keys_)[(start + k) % keys_->size()], &callback_);
+        }
+      }
+    }
+    CHECK_EQ(iters_ * kBatchSize, callback_.hits());
+  }
+
+ private:
+  RedisCache* cache_;
+  const StringVector* keys_;
+  int offset_;
+  int iters_;
+  bool use_multi_get_;
+  CountingCallback callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(LookupThread);
+};
+
+void RunLookups(benchmark::State& state, int num_threads, bool use_multi_get) {
+  StopBenchmarkTiming();
+  const char* port_string = getenv("REDIS_PORT");
+  int port;
+  if (port_string == nullptr || !StringToInt(port_string, &port)) {
+    LOG(ERROR) << "RedisCache benchmarks are skipped because $REDIS_PORT is "
+               << "not set to an integer.";
+    return;
+  }
+
+  std::unique_ptr<ThreadSystem> thread_system(Platform::CreateThreadSystem());
+  SimpleStats stats(thread_system.get());
+  RedisCache::InitStats(&stats);
+  PosixTimer timer;
+  GoogleMessageHandler handler;
+  RedisCache cache("localhost", port, thread_system.get(), &handler, &timer,
+                   kReconnectionDelayMs, kTimeoutUs, &stats,
+                   0 /* database_index */, -1 /* ttl_sec */);
+  cache.StartUp();
+
+  StringVector keys;
+  GoogleString payload(kPayloadSize, 'v');
+  for (int k = 0; k < kNumKeys; ++k) {
+    keys.push_back(StrCat("redis_cache_speed_test_", IntegerToString(k)));
+    cache.Put(keys.back(), SharedString(payload));
+  }
+
+  std::vector<std::unique_ptr<LookupThread>> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back(new LookupThread(thread_system.get(), &cache, &keys,
+                                          t * kBatchSize, state.iterations(),
+                                          use_multi_get));
+  }
+
+  StartBenchmarkTiming();
+  for (auto& thread : threads) {
+    CHECK(thread->Start());
+  }
+  for (auto& thread : threads) {
+    thread->Join();
+  }
+  StopBenchmarkTiming();
+  state.SetItemsProcessed(static_cast<int64>(state.iterations()) *
+                          kBatchSize * num_threads);
+
+  for (const GoogleString& key : keys) {
+    cache.Delete(key);
+  }
+  cache.ShutDown();
+}
+
+static void BM_RedisGet1Thread(benchmark::State& state) {
+  RunLookups(state, 1, false);
+}
+BENCHMARK(BM_RedisGet1Thread);
+
+static void BM_RedisMultiGet1Thread(benchmark::State& state) {
+  RunLookups(state, 1, true);
+}
+BENCHMARK(BM_RedisMultiGet1Thread);
+
+static void BM_RedisGet8Threads(benchmark::State& state) {
+  RunLookups(state, 8, false);
+}
+BENCHMARK(BM_RedisGet8Threads);
+
+static void BM_RedisMultiGet8Threads(benchmark::State& state) {
+  RunLookups(state, 8, true);
+}
+BENCHMARK(BM_RedisMultiGet8Threads);
+
+static void BM_RedisGet64Threads(benchmark::State& state) {
+  RunLookups(state, 64, false);
+}
+BENCHMARK(BM_RedisGet64Threads);
+
+static void BM_RedisMultiGet64Threads(benchmark::State& state) {
+  RunLookups(state, 64, true);
+}
+BENCHMARK(BM_RedisMultiGet64Threads);
+
+}  // namespace
+
+}  // namespace net_instaweb
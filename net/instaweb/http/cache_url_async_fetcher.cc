@@ -104,6 +104,11 @@ class CachePutFetch : public SharedAsyncFetch {
       // Make a copy of the headers which we will send to the
       // cache_value_writer_ later.
       saved_headers_.CopyFrom(*headers);
+      if (!saved_headers_.Has(HttpAttributes::kEtag)) {
+        // HTTPCache will add an Etag from a hash of the contents, so hash
+        // them as they stream through.
+        cache_value_writer_.StartContentHash();
+      }
     }
 
     SharedAsyncFetch::HandleHeadersComplete();
@@ -145,6 +150,10 @@ class CachePutFetch : public SharedAsyncFetch {
           StringToInt64(orig_content_length, &ocl)) {
         saved_headers_.SetOriginalContentLength(ocl);
       }
+      GoogleString hash;
+      if (cache_value_writer_.FinishContentHash(&hash)) {
+        saved_headers_.Add(HttpAttributes::kEtag, HTTPCache::FormatEtag(hash));
+      }
       // Finalize the headers.
       cache_value_writer_.SetHeaders(&saved_headers_);
     } else {
@@ -20,6 +20,7 @@
 #include "net/instaweb/http/public/http_cache.h"
 
 #include <algorithm>
+#include <vector>
 
 #include "base/logging.h"
 #include "net/instaweb/http/public/http_cache_failure.h"
@@ -29,9 +30,11 @@
 #include "pagespeed/kernel/base/hasher.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/http/content_type.h"
@@ -64,6 +67,9 @@ const char HTTPCache::kCacheFallbacks[] = "cache_fallbacks";
 const char HTTPCache::kCacheExpirations[] = "cache_expirations";
 const char HTTPCache::kCacheInserts[] = "cache_inserts";
 const char HTTPCache::kCacheDeletes[] = "cache_deletes";
+const char HTTPCache::kBrotliInserts[] = "http_cache_brotli_inserts";
+const char HTTPCache::kBrotliHits[] = "http_cache_brotli_hits";
+const char HTTPCache::kCoalescedLookups[] = "http_cache_coalesced_lookups";
 
 // This used for doing prefix match for etag in fetcher code.
 const char HTTPCache::kEtagPrefix[] = "W/\"PSA-";
@@ -77,6 +83,7 @@ HTTPCache::HTTPCache(CacheInterface* cache, Timer* timer, Hasher* hasher,
       disable_html_caching_on_https_(false),
       cache_levels_(1),
       compression_level_(0),
+      brotli_quality_(0),
       cache_time_us_(stats->GetVariable(kCacheTimeUs)),
       cache_hits_(stats->GetVariable(kCacheHits)),
       cache_misses_(stats->GetVariable(kCacheMisses)),
@@ -86,6 +93,9 @@ HTTPCache::HTTPCache(CacheInterface* cache, Timer* timer, Hasher* hasher,
       cache_expirations_(stats->GetVariable(kCacheExpirations)),
       cache_inserts_(stats->GetVariable(kCacheInserts)),
       cache_deletes_(stats->GetVariable(kCacheDeletes)),
+      brotli_inserts_(stats->GetVariable(kBrotliInserts)),
+      brotli_hits_(stats->GetVariable(kBrotliHits)),
+      coalesced_lookups_(stats->GetVariable(kCoalescedLookups)),
       name_(FormatName(cache->Name())) {
   max_cacheable_response_content_length_ = kCacheSizeUnlimited;
   SetVersion(kHttpCacheVersion);
@@ -103,6 +113,10 @@ GoogleString HTTPCache::FormatName(StringPiece cache) {
 
 void HTTPCache::SetIgnoreFailurePuts() { ignore_failure_puts_.set_value(true); }
 
+void HTTPCache::EnableLookupCoalescing(ThreadSystem* thread_system) {
+  coalescing_mutex_.reset(thread_system->NewMutex());
+}
+
 bool HTTPCache::IsExpired(const ResponseHeaders& headers, int64 now_ms) {
   if (force_caching_) {
     return false;
@@ -120,16 +134,19 @@ bool HTTPCache::IsExpired(const ResponseHeaders& headers) {
 
 class HTTPCacheCallback : public CacheInterface::Callback {
  public:
+  // If brotli_variant is set, this is looking up the key PutBrotliVariant
+  // stores under, and falls back to a regular Find if it's not there.
   HTTPCacheCallback(const GoogleString& key, const GoogleString& fragment,
                     MessageHandler* handler, HTTPCache::Callback* callback,
-                    HTTPCache* http_cache)
+                    HTTPCache* http_cache, bool brotli_variant)
       : key_(key),
         fragment_(fragment),
         handler_(handler),
         callback_(callback),
         http_cache_(http_cache),
         result_(HTTPCache::kNotFound, kFetchStatusNotSet),
-        cache_level_(0) {
+        cache_level_(0),
+        brotli_variant_(brotli_variant) {
     start_us_ = http_cache_->timer()->NowUs();
     start_ms_ = start_us_ / 1000;
   }
@@ -247,11 +264,14 @@ class HTTPCacheCallback : public CacheInterface::Callback {
     int64 elapsed_us = std::max(static_cast<int64>(0), now_us - start_us_);
     http_cache_->cache_time_us()->Add(elapsed_us);
     callback_->ReportLatencyMs(elapsed_us / 1000);
-    if (cache_level_ == http_cache_->cache_levels() ||
-        result_.status == HTTPCache::kFound) {
+    if (result_.status == HTTPCache::kFound ||
+        (cache_level_ == http_cache_->cache_levels() && !brotli_variant_)) {
       http_cache_->UpdateStats(key_, fragment_, backend_state, result_,
                                !callback_->fallback_http_value()->Empty(),
                                is_expired, handler_);
+      if (brotli_variant_) {
+        http_cache_->brotli_hits()->Add(1);
+      }
     }
 
     if (result_.status != HTTPCache::kFound) {
@@ -271,8 +291,19 @@ class HTTPCacheCallback : public CacheInterface::Callback {
     return result_.status == HTTPCache::kFound;
   }
 
+  // Runs the candidates offered to a coalesced lookup through this callback,
+  // as if it had made the lookup itself, and then calls Done.
+  void Replay(const HTTPCache::CoalescedLookup& lookup);
+
   void Done(CacheInterface::KeyState backend_state) override {
-    callback_->Done(result_);
+    if (brotli_variant_ && result_.status != HTTPCache::kFound) {
+      // Any stale variant is no use as a fallback, since the regular entry
+      // will provide one.
+      callback_->fallback_http_value()->Clear();
+      http_cache_->Find(key_, fragment_, handler_, callback_);
+    } else {
+      callback_->Done(result_);
+    }
     delete this;
   }
 
@@ -287,15 +318,149 @@ class HTTPCacheCallback : public CacheInterface::Callback {
   int64 start_us_;
   int64 start_ms_;
   int cache_level_;
+  bool brotli_variant_;
 
   DISALLOW_COPY_AND_ASSIGN(HTTPCacheCallback);
 };
 
+// The backend lookup shared by concurrent Finds of the same key.  The first
+// Find makes the lookup through this, and the candidates the backend offers
+// are recorded as they are validated against the first Find's callback.
+// The callbacks of the Finds that joined later then have the same candidates
+// replayed to them, so each applies its own validity checks.
+class HTTPCache::CoalescedLookup : public CacheInterface::Callback {
+ public:
+  struct Candidate {
+    Candidate(const SharedString& v, CacheInterface::KeyState s)
+        : value(v), state(s) {}
+    SharedString value;
+    CacheInterface::KeyState state;
+  };
+
+  CoalescedLookup(const GoogleString& backend_key, HTTPCacheCallback* first,
+                  HTTPCache* http_cache)
+      : backend_key_(backend_key),
+        first_(first),
+        http_cache_(http_cache),
+        accepted_(false),
+        state_(CacheInterface::kNotFound) {}
+
+  // Must be called with http_cache->coalescing_mutex_ held.
+  void AddFollower(HTTPCacheCallback* follower) {
+    followers_.push_back(follower);
+  }
+
+  bool ValidateCandidate(const GoogleString& key,
+                         CacheInterface::KeyState state) override {
+    candidates_.push_back(Candidate(value(), state));
+    first_->set_value(value());
+    accepted_ = first_->DelegatedValidateCandidate(key, state);
+    return accepted_;
+  }
+
+  void Done(CacheInterface::KeyState state) override {
+    // Once this is out of the map no more followers can be added, so they
+    // can be read without the lock.
+    http_cache_->CoalescedLookupDone(backend_key_);
+    state_ = state;
+    first_->DelegatedDone(state);
+    for (HTTPCacheCallback* follower : followers_) {
+      follower->Replay(*this);
+    }
+    delete this;
+  }
+
+  const GoogleString& backend_key() const { return backend_key_; }
+  const std::vector<Candidate>& candidates() const { return candidates_; }
+
+  // True if the backend stopped at a candidate the first Find accepted, in
+  // which case any lower levels of a multi-level cache were not consulted.
+  bool accepted() const { return accepted_; }
+  CacheInterface::KeyState state() const { return state_; }
+
+ private:
+  GoogleString backend_key_;
+  HTTPCacheCallback* first_;
+  HTTPCache* http_cache_;
+  std::vector<HTTPCacheCallback*> followers_;
+  std::vector<Candidate> candidates_;
+  bool accepted_;
+  CacheInterface::KeyState state_;
+
+  DISALLOW_COPY_AND_ASSIGN(CoalescedLookup);
+};
+
+void HTTPCacheCallback::Replay(const HTTPCache::CoalescedLookup& lookup) {
+  for (const HTTPCache::CoalescedLookup::Candidate& candidate :
+       lookup.candidates()) {
+    set_value(candidate.value);
+    if (ValidateCandidate(lookup.backend_key(), candidate.state)) {
+      Done(CacheInterface::kAvailable);
+      return;
+    }
+  }
+  if (lookup.accepted() && cache_level_ < http_cache_->cache_levels()) {
+    // The first Find accepted an entry from an upper cache level that this
+    // one rejects, for instance because this one needs it to be fresher.  A
+    // lower level might have one it would accept, so look for it directly.
+    http_cache_->FindInternal(key_, fragment_, handler_, callback_, false);
+    delete this;
+    return;
+  }
+  Done(lookup.state());
+}
+
 void HTTPCache::Find(const GoogleString& key, const GoogleString& fragment,
                      MessageHandler* handler, Callback* callback) {
+  FindInternal(key, fragment, handler, callback, true);
+}
+
+void HTTPCache::FindInternal(const GoogleString& key,
+                             const GoogleString& fragment,
+                             MessageHandler* handler, Callback* callback,
+                             bool coalesce) {
+  HTTPCacheCallback* cb =
+      new HTTPCacheCallback(key, fragment, handler, callback, this, false);
+  GoogleString backend_key = CompositeKey(key, fragment);
+  if (!coalesce || coalescing_mutex_ == nullptr) {
+    cache_->Get(backend_key, cb);
+    return;
+  }
+
+  CoalescedLookup* lookup = nullptr;
+  {
+    ScopedMutex lock(coalescing_mutex_.get());
+    CoalescedLookupMap::iterator p = lookups_in_flight_.find(backend_key);
+    if (p != lookups_in_flight_.end()) {
+      p->second->AddFollower(cb);
+    } else {
+      lookup = new CoalescedLookup(backend_key, cb, this);
+      lookups_in_flight_[backend_key] = lookup;
+    }
+  }
+  if (lookup == nullptr) {
+    coalesced_lookups_->Add(1);
+  } else {
+    cache_->Get(backend_key, lookup);
+  }
+}
+
+void HTTPCache::CoalescedLookupDone(const GoogleString& backend_key) {
+  ScopedMutex lock(coalescing_mutex_.get());
+  lookups_in_flight_.erase(backend_key);
+}
+
+void HTTPCache::FindPreferringBrotli(const GoogleString& key,
+                                     const GoogleString& fragment,
+                                     MessageHandler* handler,
+                                     Callback* callback) {
+  if (brotli_quality_ == 0 || !callback->request_context()->accepts_brotli()) {
+    Find(key, fragment, handler, callback);
+    return;
+  }
   HTTPCacheCallback* cb =
-      new HTTPCacheCallback(key, fragment, handler, callback, this);
-  cache_->Get(CompositeKey(key, fragment), cb);
+      new HTTPCacheCallback(key, fragment, handler, callback, this, true);
+  cache_->Get(BrotliKey(key, fragment), cb);
 }
 
 void HTTPCache::UpdateStats(const GoogleString& key,
@@ -502,6 +667,49 @@ void HTTPCache::Put(const GoogleString& key, const GoogleString& fragment,
   }
 }
 
+void HTTPCache::PutBrotliVariant(const GoogleString& key,
+                                 const GoogleString& fragment,
+                                 const HttpOptions& http_options,
+                                 HTTPValue* value, MessageHandler* handler) {
+  if (brotli_quality_ == 0 || value->Empty()) {
+    return;
+  }
+  int64 start_us = timer_->NowUs();
+  ResponseHeaders headers(http_options);
+  if (!value->ExtractHeaders(&headers, handler) ||
+      !MayCacheUrl(key, headers) ||
+      headers.Has(HttpAttributes::kContentEncoding)) {
+    return;
+  }
+  const ContentType* type = headers.DetermineContentType();
+  if (type == nullptr || !type->IsCompressible()) {
+    return;
+  }
+
+  // Apply the same header changes as Put before compressing, so any Etag
+  // added is the hash of the identity body, the same as the regular
+  // entry's.
+  HTTPValue* new_value =
+      ApplyHeaderChangesForPut(start_us, nullptr, &headers, value, handler);
+  if (new_value == nullptr) {
+    return;
+  }
+  headers.ComputeCaching();
+  HTTPValue brotli_value;
+  if (InflatingFetch::BrotliValue(brotli_quality_, *new_value, &brotli_value,
+                                  &headers, handler) &&
+      brotli_value.contents_size() < new_value->contents_size()) {
+    cache_->Put(BrotliKey(key, fragment), brotli_value.share());
+    brotli_inserts_->Add(1);
+  }
+  if (new_value != value) {
+    delete new_value;
+  }
+  if (cache_time_us_ != nullptr) {
+    cache_time_us_->Add(timer_->NowUs() - start_us);
+  }
+}
+
 void HTTPCache::Put(const GoogleString& key, const GoogleString& fragment,
                     RequestHeaders::Properties req_properties,
                     ResponseHeaders::VaryOption respect_vary_on_resources,
@@ -562,6 +770,9 @@ bool HTTPCache::MayCacheUrl(const GoogleString& url,
 void HTTPCache::Delete(const GoogleString& key, const GoogleString& fragment) {
   cache_deletes_->Add(1);
   DeleteInternal(CompositeKey(key, fragment));
+  if (brotli_quality_ != 0) {
+    DeleteInternal(BrotliKey(key, fragment));
+  }
 }
 
 void HTTPCache::DeleteInternal(const GoogleString& key_fragment) {
@@ -578,6 +789,9 @@ void HTTPCache::InitStats(Statistics* statistics) {
   statistics->AddVariable(kCacheExpirations);
   statistics->AddVariable(kCacheInserts);
   statistics->AddVariable(kCacheDeletes);
+  statistics->AddVariable(kBrotliInserts);
+  statistics->AddVariable(kBrotliHits);
+  statistics->AddVariable(kCoalescedLookups);
 }
 
 GoogleString HTTPCache::FormatEtag(StringPiece hash) {
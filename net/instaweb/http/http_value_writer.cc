@@ -19,8 +19,10 @@
 
 #include "net/instaweb/http/public/http_value_writer.h"
 
+#include "base/logging.h"
 #include "net/instaweb/http/public/http_cache.h"
 #include "net/instaweb/http/public/http_value.h"
+#include "pagespeed/kernel/base/hasher.h"
 
 namespace net_instaweb {
 
@@ -28,8 +30,7 @@ void HTTPValueWriter::SetHeaders(ResponseHeaders* headers) {
   if (cache_->IsCacheableContentLength(headers)) {
     value_->SetHeaders(headers);
   } else {
-    has_buffered_ = false;
-    value_->Clear();
+    Clear();
   }
 }
 
@@ -40,17 +41,18 @@ bool HTTPValueWriter::Write(const StringPiece& str, MessageHandler* handler) {
     // of cacheable size when the response has content type header. If we
     // receive the response chunked, then we need to buffer up before
     // discovering if the response is uncacheable.
+    if (content_hash_ != nullptr) {
+      content_hash_->Update(str);
+    }
     return value_->Write(str, handler);
   }
-  has_buffered_ = false;
-  value_->Clear();
+  Clear();
   return false;
 }
 
 bool HTTPValueWriter::CheckCanCacheElseClear(ResponseHeaders* headers) {
   if (!cache_->IsCacheableContentLength(headers)) {
-    has_buffered_ = false;
-    value_->Clear();
+    Clear();
   }
   return has_buffered_;
 }
@@ -59,4 +61,29 @@ bool HTTPValueWriter::CanCacheContent(const StringPiece& str) const {
   return cache_->IsCacheableBodySize(str.size() + value_->contents_size());
 }
 
+void HTTPValueWriter::StartContentHash() {
+  DCHECK_EQ(0, value_->contents_size());
+  if (has_buffered_ && (cache_->hasher() != nullptr)) {
+    content_hash_.reset(cache_->hasher()->NewStream());
+  }
+}
+
+bool HTTPValueWriter::FinishContentHash(GoogleString* hash) {
+  if (content_hash_ == nullptr) {
+    return false;
+  }
+  if (has_buffered_) {
+    *hash = content_hash_->Finalize();
+  }
+  content_hash_.reset();
+  return has_buffered_;
+}
+
+void HTTPValueWriter::Clear() {
+  has_buffered_ = false;
+  value_->Clear();
+  // There's nothing left to hash.
+  content_hash_.reset();
+}
+
 }  // namespace net_instaweb
@@ -29,6 +29,7 @@
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/request_headers.h"
 #include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/util/brotli_deflater.h"
 
 namespace net_instaweb {
 
@@ -131,6 +132,32 @@ bool InflatingFetch::UnGzipValueIfCompressed(const HTTPValue& src,
   return false;
 }
 
+namespace {
+
+// Updates headers to describe content, which was compressed with encoding,
+// and writes both into compressed_value.
+void SetCompressedValue(StringPiece content, StringPiece compressed,
+                        const char* encoding, HTTPValue* compressed_value,
+                        ResponseHeaders* headers) {
+  int64 content_length;
+  if (!headers->HasValue(HttpAttributes::HttpAttributes::kVary,
+                         HttpAttributes::kAcceptEncoding)) {
+    headers->Add(HttpAttributes::HttpAttributes::kVary,
+                 HttpAttributes::kAcceptEncoding);
+  }
+  if (!headers->FindContentLength(&content_length)) {
+    content_length = content.size();
+  }
+  headers->RemoveAll(HttpAttributes::kTransferEncoding);
+  headers->SetOriginalContentLength(content_length);
+  headers->Add(HttpAttributes::kContentEncoding, encoding);
+  headers->SetContentLength(compressed.length());
+  compressed_value->SetHeaders(headers);
+  compressed_value->Write(compressed, nullptr);
+}
+
+}  // namespace
+
 bool InflatingFetch::GzipValue(int compression_level,
                                const HTTPValue& http_value,
                                HTTPValue* compressed_value,
@@ -138,26 +165,30 @@ bool InflatingFetch::GzipValue(int compression_level,
                                MessageHandler* handler) {
   StringPiece content;
   GoogleString deflated;
-  int64 content_length;
   http_value.ExtractContents(&content);
   StringWriter deflate_writer(&deflated);
   if (!headers->IsGzipped() &&
       GzipInflater::Deflate(content, GzipInflater::kGzip, compression_level,
                             &deflate_writer)) {
-    if (!headers->HasValue(HttpAttributes::HttpAttributes::kVary,
-                           HttpAttributes::kAcceptEncoding)) {
-      headers->Add(HttpAttributes::HttpAttributes::kVary,
-                   HttpAttributes::kAcceptEncoding);
-    }
-    if (!headers->FindContentLength(&content_length)) {
-      content_length = content.size();
-    }
-    headers->RemoveAll(HttpAttributes::kTransferEncoding);
-    headers->SetOriginalContentLength(content_length);
-    headers->Add(HttpAttributes::kContentEncoding, HttpAttributes::kGzip);
-    headers->SetContentLength(deflated.length());
-    compressed_value->SetHeaders(headers);
-    compressed_value->Write(deflated, nullptr);
+    SetCompressedValue(content, deflated, HttpAttributes::kGzip,
+                       compressed_value, headers);
+    return true;
+  }
+  return false;
+}
+
+bool InflatingFetch::BrotliValue(int quality, const HTTPValue& http_value,
+                                 HTTPValue* compressed_value,
+                                 ResponseHeaders* headers,
+                                 MessageHandler* handler) {
+  StringPiece content;
+  GoogleString compressed;
+  http_value.ExtractContents(&content);
+  StringWriter compress_writer(&compressed);
+  if (!headers->Has(HttpAttributes::kContentEncoding) &&
+      BrotliDeflater::Compress(content, quality, handler, &compress_writer)) {
+    SetCompressedValue(content, compressed, HttpAttributes::kBrotli,
+                       compressed_value, headers);
     return true;
   }
   return false;
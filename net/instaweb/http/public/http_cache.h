@@ -20,16 +20,21 @@
 #ifndef NET_INSTAWEB_HTTP_PUBLIC_HTTP_CACHE_H_
 #define NET_INSTAWEB_HTTP_PUBLIC_HTTP_CACHE_H_
 
+#include <map>
+
 #include "base/logging.h"
 #include "net/instaweb/http/public/http_cache_failure.h"
 #include "net/instaweb/http/public/http_value.h"
 #include "net/instaweb/http/public/request_context.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/atomic_bool.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/gtest_prod.h"
 #include "pagespeed/kernel/base/ref_counted_ptr.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/http_options.h"
@@ -41,6 +46,7 @@ namespace net_instaweb {
 class Hasher;
 class MessageHandler;
 class Statistics;
+class ThreadSystem;
 class Timer;
 class Variable;
 
@@ -77,6 +83,9 @@ class HTTPCache {
   static const char kCacheExpirations[];
   static const char kCacheInserts[];
   static const char kCacheDeletes[];
+  static const char kBrotliInserts[];
+  static const char kBrotliHits[];
+  static const char kCoalescedLookups[];
 
   // The prefix used for Etags.
   static const char kEtagPrefix[];
@@ -120,6 +129,7 @@ class HTTPCache {
   };
 
   void set_hasher(Hasher* hasher) { hasher_ = hasher; }
+  Hasher* hasher() const { return hasher_; }
 
   // Class to handle an asynchronous cache lookup response.
   //
@@ -250,11 +260,26 @@ class HTTPCache {
   // Makes the cache ignore put requests that do not record successes.
   void SetIgnoreFailurePuts();
 
+  // Makes concurrent Finds of the same key and fragment share one lookup
+  // in the backend cache, rather than each making its own.  This matters
+  // when a popular entry expires and many requests for it miss at once.
+  // Each Find still applies its own callback's validity and freshness
+  // checks to the shared result.
+  void EnableLookupCoalescing(ThreadSystem* thread_system);
+
   // Non-blocking Find.  Calls callback when done.  'handler' must all
   // stay valid until callback->Done() is called.
   void Find(const GoogleString& key, const GoogleString& fragment,
             MessageHandler* handler, Callback* callback);
 
+  // Like Find, but if brotli variants are enabled and the request accepts
+  // brotli, first looks for a variant stored by PutBrotliVariant, falling
+  // back to a regular Find if there is none.  A miss on the variant isn't
+  // counted in the hit/miss statistics.
+  void FindPreferringBrotli(const GoogleString& key,
+                            const GoogleString& fragment,
+                            MessageHandler* handler, Callback* callback);
+
   // Note that Put takes a non-const pointer for HTTPValue so it can
   // bump the reference count.
   void Put(const GoogleString& key, const GoogleString& fragment,
@@ -273,6 +298,15 @@ class HTTPCache {
            ResponseHeaders* headers, const StringPiece& content,
            MessageHandler* handler);
 
+  // If brotli variants are enabled, stores a brotli-compressed copy of value
+  // alongside the entry Put stores for key, so that FindPreferringBrotli can
+  // serve it without compressing per request.  Only compressible content
+  // that has no Content-Encoding is stored, and only if brotli makes it
+  // smaller.  The caller should already have called Put with the same value.
+  void PutBrotliVariant(const GoogleString& key, const GoogleString& fragment,
+                        const HttpOptions& http_options, HTTPValue* value,
+                        MessageHandler* handler);
+
   // Deletes an element in the cache.
   void Delete(const GoogleString& key, const GoogleString& fragment);
 
@@ -324,6 +358,9 @@ class HTTPCache {
   Variable* cache_expirations() { return cache_expirations_; }
   Variable* cache_inserts() { return cache_inserts_; }
   Variable* cache_deletes() { return cache_deletes_; }
+  Variable* brotli_inserts() { return brotli_inserts_; }
+  Variable* brotli_hits() { return brotli_hits_; }
+  Variable* coalesced_lookups() { return coalesced_lookups_; }
 
   int failure_caching_ttl_sec(FetchResponseStatus kind) const {
     return remember_failure_policy_.ttl_sec_for_status[kind];
@@ -356,6 +393,18 @@ class HTTPCache {
   }
   int compression_level() const { return compression_level_; }
 
+  // Sets the brotli quality, 1 to 11, at which PutBrotliVariant compresses.
+  // 0, the default, disables brotli variants.
+  void SetBrotliQuality(int quality) {
+    if (quality >= 0 && quality <= 11) {
+      brotli_quality_ = quality;
+    } else {
+      LOG(INFO) << "Invalid brotli quality specified, disabling brotli";
+      brotli_quality_ = 0;
+    }
+  }
+  int brotli_quality() const { return brotli_quality_; }
+
   GoogleString Name() const { return FormatName(cache_->Name()); }
   static GoogleString FormatName(StringPiece cache);
 
@@ -367,10 +416,29 @@ class HTTPCache {
     return StrCat(version_prefix_, fragment, fragment.empty() ? "" : "/", key);
   }
 
+  // The key PutBrotliVariant stores under.  CompositeKeys all start with the
+  // version prefix, so this can't collide with one.
+  GoogleString BrotliKey(StringPiece key, StringPiece fragment) const {
+    return StrCat("br!", CompositeKey(key, fragment));
+  }
+
  private:
+  class CoalescedLookup;
   friend class HTTPCacheCallback;
   FRIEND_TEST(HTTPCacheTest, UpdateVersion);
 
+  typedef std::map<GoogleString, CoalescedLookup*> CoalescedLookupMap;
+
+  // Find, but only joins a lookup already in flight for the key if coalesce
+  // is set.
+  void FindInternal(const GoogleString& key, const GoogleString& fragment,
+                    MessageHandler* handler, Callback* callback,
+                    bool coalesce);
+
+  // Called when the backend lookup for backend_key is done, to stop further
+  // Finds from joining it.
+  void CoalescedLookupDone(const GoogleString& backend_key);
+
   // If headers is passed as NULL, the response headers will be extracted from
   // the HTTPValue. Otherwise, the headers passed in will be used.
   void PutInternal(bool preserve_response_headers, const GoogleString& key,
@@ -413,6 +481,7 @@ class HTTPCache {
 
   int cache_levels_;
   int compression_level_;
+  int brotli_quality_;
 
   // Total cumulative time spent accessing backend cache.
   Variable* cache_time_us_;
@@ -429,6 +498,15 @@ class HTTPCache {
   Variable* cache_expirations_;
   Variable* cache_inserts_;
   Variable* cache_deletes_;
+  // # of brotli variants stored, and # of Find() requests served from them.
+  Variable* brotli_inserts_;
+  Variable* brotli_hits_;
+  // # of Find() requests that shared another Find's backend lookup.
+  Variable* coalesced_lookups_;
+
+  // nullptr unless EnableLookupCoalescing has been called.
+  std::unique_ptr<AbstractMutex> coalescing_mutex_;
+  CoalescedLookupMap lookups_in_flight_ GUARDED_BY(coalescing_mutex_);
 
   GoogleString name_;
   HttpCacheFailurePolicy remember_failure_policy_;
@@ -20,7 +20,11 @@
 #ifndef NET_INSTAWEB_HTTP_PUBLIC_HTTP_VALUE_WRITER_H_
 #define NET_INSTAWEB_HTTP_PUBLIC_HTTP_VALUE_WRITER_H_
 
+#include <memory>
+
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/hasher.h"
+#include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 
 namespace net_instaweb {
@@ -53,10 +57,23 @@ class HTTPValueWriter {
   // limits.
   bool CanCacheContent(const StringPiece& str) const;
 
+  // Hashes the contents with the cache's hasher as they are written, so the
+  // hash is ready as soon as the last write is, rather than needing another
+  // pass over the whole value.  Call before the first Write.
+  void StartContentHash();
+
+  // If the contents are still buffered, sets *hash to the cache hasher's
+  // Hash() of them and returns true.  Ends the hash started by
+  // StartContentHash.
+  bool FinishContentHash(GoogleString* hash);
+
  private:
+  void Clear();
+
   HTTPValue* value_;
   HTTPCache* cache_;
   bool has_buffered_;
+  std::unique_ptr<Hasher::Stream> content_hash_;
   DISALLOW_COPY_AND_ASSIGN(HTTPValueWriter);
 };
 
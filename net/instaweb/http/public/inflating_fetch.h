@@ -67,6 +67,11 @@ class InflatingFetch : public SharedAsyncFetch {
   static bool GzipValue(int compression_level, const HTTPValue& http_value,
                         HTTPValue* compressed_value, ResponseHeaders* headers,
                         MessageHandler* handler);
+  // Like GzipValue, but compresses with brotli at the given quality.  Values
+  // that already have a Content-Encoding are left alone.
+  static bool BrotliValue(int quality, const HTTPValue& http_value,
+                          HTTPValue* compressed_value, ResponseHeaders* headers,
+                          MessageHandler* handler);
 
  protected:
   // If inflation is required, inflates and passes bytes to the linked fetch,
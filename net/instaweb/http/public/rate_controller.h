@@ -24,7 +24,6 @@
 
 #include "pagespeed/kernel/base/atomic_bool.h"
 #include "pagespeed/kernel/base/basictypes.h"
-#include "pagespeed/kernel/base/ref_counted_ptr.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/thread_annotations.h"
@@ -37,6 +36,7 @@ class MessageHandler;
 class Statistics;
 class ThreadSystem;
 class TimedVariable;
+class Timer;
 class UpDownCounter;
 class UrlAsyncFetcher;
 
@@ -51,6 +51,22 @@ class UrlAsyncFetcher;
 // If a request is dropped, the response will have HttpAttributes::kXPsaLoadShed
 // set on the response headers.
 //
+// The global queue is shared fairly between hosts: when it is full, a fetch
+// for a host with fewer queued fetches than its fair share (the global limit
+// divided between the hosts with fetches queued) takes the place of the most
+// recently queued fetch for the host with the longest queue, which is dropped
+// instead.  That way one slow origin with lots of resources can't fill the
+// queue and starve the fetches for every other host.
+//
+// The per-domain limit on outgoing fetches adapts to the latency seen from
+// that domain.  Whenever fetches start taking several times longer than the
+// fastest seen recently, as they do from an overloaded origin, the limit is
+// cut back, and while they don't it grows back towards
+// per_host_outgoing_request_threshold.  A host's limit and latencies are kept
+// while it is idle, so that a slow origin with bursty traffic doesn't start
+// each burst at full concurrency, and forgotten once it has had no fetches
+// for kIdleHostTimeoutMs.
+//
 // Note: this requires working statistics to work.
 class RateController {
  public:
@@ -58,10 +74,14 @@ class RateController {
   static const char kDroppedFetchCount[];
   static const char kCurrentGlobalFetchQueueSize[];
 
+  // How long a host with no fetches outgoing or queued is remembered.
+  static const int64 kIdleHostTimeoutMs;
+
   RateController(int max_global_queue_size,
                  int per_host_outgoing_request_threshold,
                  int per_host_queued_request_threshold,
-                 ThreadSystem* thread_system, Statistics* statistics);
+                 ThreadSystem* thread_system, Timer* timer,
+                 Statistics* statistics);
 
   virtual ~RateController();
 
@@ -74,20 +94,40 @@ class RateController {
   void Fetch(UrlAsyncFetcher* fetcher, const GoogleString& url,
              MessageHandler* message_handler, AsyncFetch* fetch);
 
+  // Appends a table of the hosts fetched from recently by this process to
+  // *out, for the admin console.
+  void PrintHostStats(GoogleString* out) LOCKS_EXCLUDED(mutex_);
+
   // Initializes statistics variables associated with this class.
   static void InitStats(Statistics* statistics);
 
  private:
+  struct DeferredFetch;
   class HostFetchInfo;
   class CustomFetch;
   friend class CustomFetch;
 
-  typedef RefCountedPtr<HostFetchInfo> HostFetchInfoPtr;
+  typedef std::map<GoogleString, HostFetchInfo*> HostFetchInfoMap;
+
+  // Called by CustomFetch when a fetch started at start_ms completes.  Starts
+  // as many of the host's queued fetches as its limit now allows.
+  void FetchComplete(HostFetchInfo* fetch_info, int64 start_ms)
+      LOCKS_EXCLUDED(mutex_);
+
+  // If the global queue is full, tries to make room for a fetch for
+  // fetch_info's host by displacing a fetch from the host with the longest
+  // queue, which is returned so the caller can drop it once the lock is
+  // released.  Returns NULL if fetch_info's host has its fair share already.
+  DeferredFetch* DisplaceFetchForFairShare(const HostFetchInfo* fetch_info)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  typedef std::map<GoogleString, HostFetchInfoPtr*> HostFetchInfoMap;
+  // Fails fetch, marking it as dropped due to load.
+  void DropFetch(const GoogleString& url, MessageHandler* message_handler,
+                 AsyncFetch* fetch);
 
-  // Delete the fetch info from fetch_info_map_ if possible.
-  void DeleteFetchInfoIfPossible(const HostFetchInfoPtr& fetch_info);
+  // Deletes the fetch info of hosts which have been idle for
+  // kIdleHostTimeoutMs.  Only looks through the hosts once a minute.
+  void ExpireIdleHosts(int64 now_ms) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // The maximum permissible size of the global queue.
   const int max_global_queue_size_;
@@ -95,10 +135,11 @@ class RateController {
   const int per_host_outgoing_request_threshold_;
   // The maximum number of queued requests allowed per host.
   const int per_host_queued_request_threshold_;
-  ThreadSystem* thread_system_;
+  Timer* timer_;
 
   // Map containing per-host information tracking outgoing and queued fetches.
   HostFetchInfoMap fetch_info_map_ GUARDED_BY(mutex_);
+  int64 next_idle_host_check_ms_ GUARDED_BY(mutex_);
   std::unique_ptr<AbstractMutex> mutex_;
 
   TimedVariable* queued_fetch_count_;
@@ -32,6 +32,7 @@ class MessageHandler;
 class RateController;
 class Statistics;
 class ThreadSystem;
+class Timer;
 
 // Fetcher that uses RateController to limit amount of background fetches
 // we direct to a fetcher it wraps per domain. See RateController documentation
@@ -45,7 +46,7 @@ class RateControllingUrlAsyncFetcher : public UrlAsyncFetcher {
                                  int max_global_queue_size,
                                  int per_host_outgoing_request_threshold,
                                  int per_host_queued_request_threshold,
-                                 ThreadSystem* thread_system,
+                                 ThreadSystem* thread_system, Timer* timer,
                                  Statistics* statistics);
 
   ~RateControllingUrlAsyncFetcher() override;
@@ -57,6 +58,10 @@ class RateControllingUrlAsyncFetcher : public UrlAsyncFetcher {
 
   void ShutDown() override;
 
+  // Appends the per-host fetch queues to *out.  See
+  // RateController::PrintHostStats.
+  void PrintHostStats(GoogleString* out);
+
  private:
   UrlAsyncFetcher* base_fetcher_;
   std::unique_ptr<RateController> rate_controller_;
@@ -61,12 +61,20 @@ class SimulatedDelayFetcher : public UrlAsyncFetcher {
 
   ~SimulatedDelayFetcher() override;
 
+  // Makes subsequent replies deliver body_chunks instead of kPayload, writing
+  // the first chunk after the per-host delay and each following chunk
+  // chunk_delay_ms after the one before it.  This simulates an origin that
+  // sends the start of a page before it has generated the rest.  Must be
+  // called before any fetches are started.
+  void SetChunkedReply(const StringVector& body_chunks, int64 chunk_delay_ms);
+
   void Fetch(const GoogleString& url, MessageHandler* message_handler,
              AsyncFetch* fetch) override;
 
  private:
   typedef std::map<GoogleString, int> DelayMap;
   void ProduceReply(AsyncFetch* fetch);
+  void ProduceChunk(AsyncFetch* fetch, int index);
   void ParseDelayMap(StringPiece delay_map_path);
 
   Timer* timer_;
@@ -75,6 +83,8 @@ class SimulatedDelayFetcher : public UrlAsyncFetcher {
   FileSystem* file_system_;
   DelayMap delays_ms_;
   int request_log_flush_frequency_;
+  StringVector body_chunks_;
+  int64 chunk_delay_ms_;
 
   std::unique_ptr<AbstractMutex> mutex_;
   int request_log_outstanding_ GUARDED_BY(mutex_.get());
@@ -19,9 +19,10 @@
 
 #include "net/instaweb/http/public/rate_controller.h"
 
+#include <algorithm>
 #include <cstddef>
-#include <queue>
-#include <utility>
+#include <deque>
+#include <vector>
 
 #include "base/logging.h"
 #include "net/instaweb/http/public/async_fetch.h"
@@ -30,10 +31,12 @@
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/stl_util.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_annotations.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/response_headers.h"
@@ -42,8 +45,36 @@ namespace net_instaweb {
 
 namespace {
 
+// Latencies below this are counted as this when judging whether a fetch was
+// slow, so that a host which usually answers in a couple of milliseconds isn't
+// backed off over a few tens of milliseconds of jitter.
+const int64 kMinBaselineLatencyMs = 50;
+
+// A fetch which took this many times the host's baseline latency suggests the
+// host is overloaded, so its limit on outgoing fetches is cut back.
+const int kSlowFetchLatencyFactor = 3;
+
+// The factor the limit is cut back by.
+const double kOutgoingLimitBackoff = 0.75;
+
+// Each fetch moves the baseline latency up by this fraction of the difference,
+// if it took longer, so that a host which has become slower for good isn't
+// held at a limit of 1 forever.
+const int64 kBaselineLatencyDecay = 32;
+
+// How often to look for idle hosts to forget.
+const int64 kIdleHostCheckIntervalMs = Timer::kMinuteMs;
+
+}  // namespace
+
+const char RateController::kQueuedFetchCount[] = "queued-fetch-count";
+const char RateController::kDroppedFetchCount[] = "dropped-fetch-count";
+const char RateController::kCurrentGlobalFetchQueueSize[] =
+    "current-fetch-queue-size";
+const int64 RateController::kIdleHostTimeoutMs = 10 * Timer::kMinuteMs;
+
 // Keeps track of the objects required while deferring a fetch.
-struct DeferredFetch {
+struct RateController::DeferredFetch {
   DeferredFetch(const GoogleString& in_url, UrlAsyncFetcher* fetcher,
                 AsyncFetch* in_fetch, MessageHandler* in_handler)
       : url(in_url), fetcher(fetcher), fetch(in_fetch), handler(in_handler) {}
@@ -57,41 +88,46 @@ struct DeferredFetch {
   DISALLOW_COPY_AND_ASSIGN(DeferredFetch);
 };
 
-}  // namespace
-
-const char RateController::kQueuedFetchCount[] = "queued-fetch-count";
-const char RateController::kDroppedFetchCount[] = "dropped-fetch-count";
-const char RateController::kCurrentGlobalFetchQueueSize[] =
-    "current-fetch-queue-size";
-
-// Keeps track of all the pending and enqueued fetches for a given host.
-class RateController::HostFetchInfo
-    : public RefCounted<RateController::HostFetchInfo> {
+// Keeps track of all the pending and enqueued fetches for a given host, and of
+// the host's limit on outgoing fetches.  Guarded by the RateController's mutex,
+// since choosing which fetch to displace from the global queue needs a
+// consistent view of every host's queue.
+class RateController::HostFetchInfo {
  public:
-  // Takes ownership of the mutex passed in.
   HostFetchInfo(const GoogleString& host,
                 int per_host_outgoing_request_threshold,
-                int per_host_queued_request_threshold, AbstractMutex* mutex)
+                int per_host_queued_request_threshold)
       : host_(host),
         num_outbound_fetches_(0),
         per_host_outgoing_request_threshold_(
             per_host_outgoing_request_threshold),
         per_host_queued_request_threshold_(per_host_queued_request_threshold),
-        mutex_(mutex) {}
+        outgoing_limit_(per_host_outgoing_request_threshold),
+        baseline_latency_ms_(-1),
+        average_latency_ms_(-1),
+        last_backoff_ms_(-1),
+        last_active_ms_(-1) {}
 
-  ~HostFetchInfo() {}
+  ~HostFetchInfo() { DCHECK(fetch_queue_.empty()); }
 
   // Returns the number of outbound fetches for the given host.
-  int num_outbound_fetches() LOCKS_EXCLUDED(mutex_) {
-    ScopedMutex lock(mutex_.get());
-    return num_outbound_fetches_;
+  int num_outbound_fetches() const { return num_outbound_fetches_; }
+
+  int queue_size() const { return static_cast<int>(fetch_queue_.size()); }
+
+  // The number of background fetches which may be outgoing at once.  Never
+  // more than per_host_outgoing_request_threshold, and never less than 1
+  // unless that is 0.
+  int outgoing_limit() const {
+    return std::min(per_host_outgoing_request_threshold_,
+                    std::max(1, static_cast<int>(outgoing_limit_)));
   }
 
-  // Checks if the number of outbound fetches is less than the threshold. If so,
+  // Checks if the number of outbound fetches is less than the limit. If so,
   // increments the number of outbound fetches and returns true. Returns false
   // otherwise.
-  bool IncrementIfCanTriggerFetch() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
-    if (num_outbound_fetches_ < per_host_outgoing_request_threshold_) {
+  bool IncrementIfCanTriggerFetch() {
+    if (num_outbound_fetches_ < outgoing_limit()) {
       ++num_outbound_fetches_;
       return true;
     }
@@ -99,64 +135,110 @@ class RateController::HostFetchInfo
   }
 
   // Decreases the number of outbound fetches by 1.
-  void decrement_num_outbound_fetches() LOCKS_EXCLUDED(mutex_) {
-    ScopedMutex lock(mutex_.get());
+  void decrement_num_outbound_fetches() {
     DCHECK_GT(num_outbound_fetches_, 0);
     --num_outbound_fetches_;
   }
 
   // Increases the number of outbound fetches by 1.
-  void increment_num_outbound_fetches() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+  void increment_num_outbound_fetches() {
     DCHECK_GE(num_outbound_fetches_, 0);
     ++num_outbound_fetches_;
   }
+
   // Pushes the fetch to the back of the queue.
   bool EnqueueFetchIfWithinThreshold(const GoogleString& url,
                                      UrlAsyncFetcher* fetcher,
-                                     MessageHandler* handler, AsyncFetch* fetch)
-      EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+                                     MessageHandler* handler,
+                                     AsyncFetch* fetch) {
     if (fetch_queue_.size() <
         static_cast<size_t>(per_host_queued_request_threshold_)) {
-      fetch_queue_.push(new DeferredFetch(url, fetcher, fetch, handler));
+      fetch_queue_.push_back(new DeferredFetch(url, fetcher, fetch, handler));
       return true;
     }
     return false;
   }
 
-  // Gets the next fetch from the queue. Returns NULL if the queue is empty.
-  DeferredFetch* PopNextFetchAndIncrementCountIfWithinThreshold()
-      LOCKS_EXCLUDED(mutex_) {
-    ScopedMutex lock(mutex_.get());
-    if (fetch_queue_.empty() ||
-        num_outbound_fetches_ >= per_host_outgoing_request_threshold_) {
+  // Gets the next fetch from the queue. Returns NULL if the queue is empty or
+  // the host is at its limit.
+  DeferredFetch* PopNextFetchAndIncrementCountIfWithinThreshold() {
+    if (fetch_queue_.empty() || num_outbound_fetches_ >= outgoing_limit()) {
       return nullptr;
     }
     DeferredFetch* fetch = fetch_queue_.front();
-    fetch_queue_.pop();
+    fetch_queue_.pop_front();
     ++num_outbound_fetches_;
     return fetch;
   }
 
+  // Removes the most recently queued fetch, which has waited the least.
+  DeferredFetch* PopLastFetch() {
+    DCHECK(!fetch_queue_.empty());
+    DeferredFetch* fetch = fetch_queue_.back();
+    fetch_queue_.pop_back();
+    return fetch;
+  }
+
+  // Adjusts the limit on outgoing fetches given a fetch started at start_ms
+  // which finished at now_ms.  This is additive-increase, multiplicative-
+  // decrease, as in TCP: the limit grows by about one for every limit's worth
+  // of fetches at the usual latency, and is cut back by a fraction on a slow
+  // one, but only once for all the fetches that were outgoing together.
+  void RecordLatency(int64 start_ms, int64 now_ms) {
+    int64 latency_ms = std::max<int64>(0, now_ms - start_ms);
+    if (baseline_latency_ms_ < 0) {
+      baseline_latency_ms_ = latency_ms;
+      average_latency_ms_ = latency_ms;
+    } else if (latency_ms < baseline_latency_ms_) {
+      baseline_latency_ms_ = latency_ms;
+    } else {
+      baseline_latency_ms_ +=
+          (latency_ms - baseline_latency_ms_) / kBaselineLatencyDecay;
+    }
+    average_latency_ms_ += (latency_ms - average_latency_ms_) / 8;
+
+    int64 slow_ms = kSlowFetchLatencyFactor *
+                    std::max(kMinBaselineLatencyMs, baseline_latency_ms_);
+    if (latency_ms > slow_ms) {
+      if (start_ms > last_backoff_ms_) {
+        outgoing_limit_ =
+            std::max(1.0, outgoing_limit_ * kOutgoingLimitBackoff);
+        last_backoff_ms_ = now_ms;
+      }
+    } else if (outgoing_limit_ < per_host_outgoing_request_threshold_) {
+      outgoing_limit_ = std::min<double>(per_host_outgoing_request_threshold_,
+                                         outgoing_limit_ + 1 / outgoing_limit_);
+    }
+  }
+
   // Returns the host associated with this HostFetchInfo object.
-  const GoogleString& host() { return host_; }
+  const GoogleString& host() const { return host_; }
 
-  bool AnyInFlightOrQueuedFetches() const LOCKS_EXCLUDED(mutex_) {
-    ScopedMutex lock(mutex_.get());
+  int64 average_latency_ms() const { return average_latency_ms_; }
+
+  bool AnyInFlightOrQueuedFetches() const {
     DCHECK_GE(num_outbound_fetches_, 0);
     return num_outbound_fetches_ > 0 || !fetch_queue_.empty();
   }
 
-  void Lock() EXCLUSIVE_LOCK_FUNCTION(mutex_) { mutex_->Lock(); }
-
-  void Unlock() UNLOCK_FUNCTION(mutex_) { mutex_->Unlock(); }
+  // When a fetch for the host was last requested or completed.
+  int64 last_active_ms() const { return last_active_ms_; }
+  void set_last_active_ms(int64 now_ms) { last_active_ms_ = now_ms; }
 
  private:
   GoogleString host_;
-  int num_outbound_fetches_ GUARDED_BY(mutex_);
+  int num_outbound_fetches_;
   const int per_host_outgoing_request_threshold_;
   const int per_host_queued_request_threshold_;
-  std::unique_ptr<AbstractMutex> mutex_;
-  std::queue<DeferredFetch*> fetch_queue_ GUARDED_BY(mutex_);
+  std::deque<DeferredFetch*> fetch_queue_;
+
+  // Fractional, so that it can grow by less than one per fetch.
+  double outgoing_limit_;
+  // Latencies are -1 until the first fetch completes.
+  int64 baseline_latency_ms_;
+  int64 average_latency_ms_;
+  int64 last_backoff_ms_;
+  int64 last_active_ms_;
 
   DISALLOW_COPY_AND_ASSIGN(HostFetchInfo);
 };
@@ -166,57 +248,38 @@ class RateController::HostFetchInfo
 // domain.
 class RateController::CustomFetch : public SharedAsyncFetch {
  public:
-  CustomFetch(const HostFetchInfoPtr& fetch_info, AsyncFetch* fetch,
+  CustomFetch(HostFetchInfo* fetch_info, AsyncFetch* fetch,
               RateController* controller)
       : SharedAsyncFetch(fetch),
         fetch_info_(fetch_info),
-        controller_(controller) {}
+        controller_(controller),
+        start_ms_(controller->timer_->NowMs()) {}
 
   void HandleDone(bool success) override {
     SharedAsyncFetch::HandleDone(success);
-    fetch_info_->decrement_num_outbound_fetches();
-    // Check if there is any fetch queued up for this host and the number of
-    // outstanding fetches for the host is less than the threshold.
-    DeferredFetch* deferred_fetch =
-        fetch_info_->PopNextFetchAndIncrementCountIfWithinThreshold();
-    if (deferred_fetch != nullptr) {
-      DCHECK_GT(controller_->current_global_fetch_queue_size_->Get(), 0);
-      controller_->current_global_fetch_queue_size_->Add(-1);
-      // Trigger a fetch for the queued up request.
-      CustomFetch* wrapper_fetch =
-          new CustomFetch(fetch_info_, deferred_fetch->fetch, controller_);
-
-      if (controller_->is_shut_down()) {
-        deferred_fetch->handler->Message(
-            kWarning, "RateController: drop deferred fetch of %s on shutdown",
-            deferred_fetch->url.c_str());
-        wrapper_fetch->Done(false);
-      } else {
-        deferred_fetch->fetcher->Fetch(deferred_fetch->url,
-                                       deferred_fetch->handler, wrapper_fetch);
-      }
-      delete deferred_fetch;
-    } else {
-      controller_->DeleteFetchInfoIfPossible(fetch_info_);
-    }
+    controller_->FetchComplete(fetch_info_, start_ms_);
     delete this;
   }
 
  private:
-  HostFetchInfoPtr fetch_info_;
+  // Stays valid while this fetch is outstanding, since the map entry is only
+  // deleted once the host has been idle for a while.
+  HostFetchInfo* fetch_info_;
   RateController* controller_;
+  const int64 start_ms_;
   DISALLOW_COPY_AND_ASSIGN(CustomFetch);
 };
 
 RateController::RateController(int max_global_queue_size,
                                int per_host_outgoing_request_threshold,
                                int per_host_queued_request_threshold,
-                               ThreadSystem* thread_system,
+                               ThreadSystem* thread_system, Timer* timer,
                                Statistics* statistics)
     : max_global_queue_size_(max_global_queue_size),
       per_host_outgoing_request_threshold_(per_host_outgoing_request_threshold),
       per_host_queued_request_threshold_(per_host_queued_request_threshold),
-      thread_system_(thread_system),
+      timer_(timer),
+      next_idle_host_check_ms_(0),
       mutex_(thread_system->NewMutex()) {
   CHECK_GE(max_global_queue_size, 0);
   CHECK_GE(per_host_outgoing_request_threshold, 0);
@@ -228,7 +291,7 @@ RateController::RateController(int max_global_queue_size,
       statistics->GetUpDownCounter(kCurrentGlobalFetchQueueSize);
 }
 
-RateController::~RateController() {}
+RateController::~RateController() { STLDeleteValues(&fetch_info_map_); }
 
 void RateController::Fetch(UrlAsyncFetcher* fetcher, const GoogleString& url,
                            MessageHandler* message_handler, AsyncFetch* fetch) {
@@ -250,68 +313,163 @@ void RateController::Fetch(UrlAsyncFetcher* fetcher, const GoogleString& url,
     return fetcher->Fetch(url, message_handler, fetch);
   }
 
-  HostFetchInfoPtr fetch_info_ptr;
   // Lookup the map for the fetch info associated with the given host. Note that
   // it would have been nice to avoid acquiring the mutex for user-facing
   // requests, but we need to lookup the fetch info in order to update the
-  // number of outgoing requests. The mutex must also be held until we update
-  // the pending request counts, since otherwise we may race against deletion
-  // of the map entry and HostFetchInfo in a call to DeleteFetchInfoIfPossible
-  // from a completion of a queued fetch.
-  mutex_->Lock();
-
-  HostFetchInfoMap::iterator iter = fetch_info_map_.find(host);
-  if (iter != fetch_info_map_.end()) {
-    fetch_info_ptr = *iter->second;
-  } else {
-    // Insert a new entry if there wasn't one already.
-    HostFetchInfoPtr* new_fetch_info_ptr =
-        new HostFetchInfoPtr(new HostFetchInfo(
-            host, per_host_outgoing_request_threshold_,
-            per_host_queued_request_threshold_, thread_system_->NewMutex()));
-    fetch_info_ptr = *new_fetch_info_ptr;
-    fetch_info_map_[host] = new_fetch_info_ptr;
+  // number of outgoing requests.
+  DeferredFetch* displaced_fetch = nullptr;
+  {
+    ScopedMutex lock(mutex_.get());
+    int64 now_ms = timer_->NowMs();
+    ExpireIdleHosts(now_ms);
+    HostFetchInfo* fetch_info;
+    HostFetchInfoMap::iterator iter = fetch_info_map_.find(host);
+    if (iter != fetch_info_map_.end()) {
+      fetch_info = iter->second;
+    } else {
+      // Insert a new entry if there wasn't one already.
+      fetch_info = new HostFetchInfo(host, per_host_outgoing_request_threshold_,
+                                     per_host_queued_request_threshold_);
+      fetch_info_map_[host] = fetch_info;
+    }
+    fetch_info->set_last_active_ms(now_ms);
+
+    if (!fetch->IsBackgroundFetch() ||
+        fetch_info->IncrementIfCanTriggerFetch()) {
+      // If this is a user-facing fetch or the number of outgoing fetches is
+      // within the per-host limit, trigger the fetch immediately.
+      if (!fetch->IsBackgroundFetch()) {
+        // Increment the count if the request is not a background fetch.
+        fetch_info->increment_num_outbound_fetches();
+      }
+      CustomFetch* wrapper_fetch = new CustomFetch(fetch_info, fetch, this);
+      lock.Release();
+      return fetcher->Fetch(url, message_handler, wrapper_fetch);
+    }
+
+    if (current_global_fetch_queue_size_->Get() >= max_global_queue_size_) {
+      displaced_fetch = DisplaceFetchForFairShare(fetch_info);
+    }
+    if ((displaced_fetch != nullptr ||
+         current_global_fetch_queue_size_->Get() < max_global_queue_size_) &&
+        fetch_info->EnqueueFetchIfWithinThreshold(url, fetcher, message_handler,
+                                                  fetch)) {
+      // If the number of globally queued up fetches is within the threshold,
+      // or we made room by displacing another host's fetch, and the number of
+      // queued requests for this host is less than the threshold, push it to
+      // the back of the per-host queue.  A displaced fetch just swaps places
+      // with this one, so the size of the global queue is unchanged.
+      // Note that we want to increase the queue size while still holding the
+      // lock, since otherwise the entry may get dequeued with the size stat
+      // not yet updated, confusing us about it being 0.
+      if (displaced_fetch == nullptr) {
+        current_global_fetch_queue_size_->Add(1);
+      }
+      lock.Release();
+      queued_fetch_count_->IncBy(1);
+      if (displaced_fetch != nullptr) {
+        DropFetch(displaced_fetch->url, displaced_fetch->handler,
+                  displaced_fetch->fetch);
+        delete displaced_fetch;
+      }
+      return;
+    }
+    // A fetch is only displaced if this host has room in its queue.
+    DCHECK(displaced_fetch == nullptr);
   }
 
-  fetch_info_ptr->Lock();
+  DropFetch(url, message_handler, fetch);
+}
 
-  if (!fetch->IsBackgroundFetch() ||
-      fetch_info_ptr->IncrementIfCanTriggerFetch()) {
-    // If this is a user-facing fetch or the number of outgoing fetches is
-    // within the per-host threshold, trigger the fetch immediately.
-    if (!fetch->IsBackgroundFetch()) {
-      // Increment the count if the request is not a background fetch.
-      fetch_info_ptr->increment_num_outbound_fetches();
+RateController::DeferredFetch* RateController::DisplaceFetchForFairShare(
+    const HostFetchInfo* fetch_info) {
+  // Find the host with the longest queue, counting how many hosts share the
+  // queue, this one included.
+  HostFetchInfo* longest = nullptr;
+  int num_queueing_hosts = (fetch_info->queue_size() == 0) ? 1 : 0;
+  for (HostFetchInfoMap::iterator iter = fetch_info_map_.begin();
+       iter != fetch_info_map_.end(); ++iter) {
+    HostFetchInfo* info = iter->second;
+    if (info->queue_size() > 0) {
+      ++num_queueing_hosts;
+      if (longest == nullptr || info->queue_size() > longest->queue_size()) {
+        longest = info;
+      }
     }
-    fetch_info_ptr->Unlock();
-    mutex_->Unlock();
-    CustomFetch* wrapper_fetch = new CustomFetch(fetch_info_ptr, fetch, this);
-    return fetcher->Fetch(url, message_handler, wrapper_fetch);
-  } else if (current_global_fetch_queue_size_->Get() < max_global_queue_size_ &&
-             fetch_info_ptr->EnqueueFetchIfWithinThreshold(
-                 url, fetcher, message_handler, fetch)) {
-    // If the number of globally queued up fetches is within the threshold and
-    // the number of queued requests for this host is less than the threshold,
-    // push it to the back of the per-host queue.
-    // Note that we want to increase the queue size while still holding the
-    // fetch_info_ptr lock, since otherwise the entry may get dequeued
-    // with the size stat not yet updated, confusing us about it being 0.
-    current_global_fetch_queue_size_->Add(1);
-    fetch_info_ptr->Unlock();
-    mutex_->Unlock();
-    queued_fetch_count_->IncBy(1);
-    return;
   }
+  // A host can't be owed more than its own queue will hold, which also means
+  // a displaced fetch can always be replaced.
+  int fair_share = std::min(per_host_queued_request_threshold_,
+                            max_global_queue_size_ / num_queueing_hosts);
+  if (longest == nullptr || longest == fetch_info ||
+      fetch_info->queue_size() >= fair_share ||
+      longest->queue_size() <= fair_share) {
+    return nullptr;
+  }
+  return longest->PopLastFetch();
+}
 
-  fetch_info_ptr->Unlock();
-  mutex_->Unlock();
+void RateController::FetchComplete(HostFetchInfo* fetch_info,
+                                   int64 start_ms) {
+  std::vector<DeferredFetch*> deferred_fetches;
+  {
+    ScopedMutex lock(mutex_.get());
+    int64 now_ms = timer_->NowMs();
+    fetch_info->decrement_num_outbound_fetches();
+    fetch_info->RecordLatency(start_ms, now_ms);
+    fetch_info->set_last_active_ms(now_ms);
+    // Start as many queued fetches for this host as its limit allows, which
+    // may be none if it was just cut back, or two if it just grew.
+    DeferredFetch* deferred_fetch;
+    while ((deferred_fetch =
+                fetch_info->PopNextFetchAndIncrementCountIfWithinThreshold()) !=
+           nullptr) {
+      DCHECK_GT(current_global_fetch_queue_size_->Get(), 0);
+      current_global_fetch_queue_size_->Add(-1);
+      deferred_fetches.push_back(deferred_fetch);
+    }
+    ExpireIdleHosts(now_ms);
+  }
+
+  for (DeferredFetch* deferred_fetch : deferred_fetches) {
+    // Trigger a fetch for the queued up request.
+    CustomFetch* wrapper_fetch =
+        new CustomFetch(fetch_info, deferred_fetch->fetch, this);
+    if (is_shut_down()) {
+      deferred_fetch->handler->Message(
+          kWarning, "RateController: drop deferred fetch of %s on shutdown",
+          deferred_fetch->url.c_str());
+      wrapper_fetch->Done(false);
+    } else {
+      deferred_fetch->fetcher->Fetch(deferred_fetch->url,
+                                     deferred_fetch->handler, wrapper_fetch);
+    }
+    delete deferred_fetch;
+  }
+}
 
+void RateController::DropFetch(const GoogleString& url,
+                               MessageHandler* message_handler,
+                               AsyncFetch* fetch) {
   dropped_fetch_count_->IncBy(1);
   message_handler->Message(kInfo, "Dropping request for %s", url.c_str());
   fetch->response_headers()->Add(HttpAttributes::kXPsaLoadShed, "1");
   fetch->Done(false);
-  DeleteFetchInfoIfPossible(fetch_info_ptr);
-  return;
+}
+
+void RateController::PrintHostStats(GoogleString* out) {
+  ScopedMutex lock(mutex_.get());
+  StrAppend(out, absl::StrFormat("%-40s %8s %8s %8s %12s\n", "Host",
+                                 "Outgoing", "Queued", "Limit",
+                                 "Latency (ms)"));
+  for (HostFetchInfoMap::iterator iter = fetch_info_map_.begin();
+       iter != fetch_info_map_.end(); ++iter) {
+    const HostFetchInfo* info = iter->second;
+    StrAppend(out, absl::StrFormat("%-40s %8d %8d %8d %12d\n", info->host(),
+                                   info->num_outbound_fetches(),
+                                   info->queue_size(), info->outgoing_limit(),
+                                   info->average_latency_ms()));
+  }
 }
 
 void RateController::InitStats(Statistics* statistics) {
@@ -320,17 +478,21 @@ void RateController::InitStats(Statistics* statistics) {
   statistics->AddTimedVariable(kDroppedFetchCount, Statistics::kDefaultGroup);
 }
 
-void RateController::DeleteFetchInfoIfPossible(
-    const HostFetchInfoPtr& fetch_info) {
-  ScopedMutex lock(mutex_.get());
-  if (fetch_info->AnyInFlightOrQueuedFetches()) {
+void RateController::ExpireIdleHosts(int64 now_ms) {
+  if (now_ms < next_idle_host_check_ms_) {
     return;
   }
-
-  HostFetchInfoMap::iterator iter = fetch_info_map_.find(fetch_info->host());
-  if (iter != fetch_info_map_.end()) {
-    delete iter->second;
-    fetch_info_map_.erase(iter);
+  next_idle_host_check_ms_ = now_ms + kIdleHostCheckIntervalMs;
+  HostFetchInfoMap::iterator iter = fetch_info_map_.begin();
+  while (iter != fetch_info_map_.end()) {
+    HostFetchInfo* fetch_info = iter->second;
+    if (!fetch_info->AnyInFlightOrQueuedFetches() &&
+        (now_ms - fetch_info->last_active_ms() >= kIdleHostTimeoutMs)) {
+      delete fetch_info;
+      fetch_info_map_.erase(iter++);
+    } else {
+      ++iter;
+    }
   }
 }
 
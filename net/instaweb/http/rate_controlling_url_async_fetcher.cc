@@ -29,11 +29,12 @@ RateControllingUrlAsyncFetcher::RateControllingUrlAsyncFetcher(
     UrlAsyncFetcher* fetcher, int max_global_queue_size,
     int per_host_outgoing_request_threshold,
     int per_host_queued_request_threshold, ThreadSystem* thread_system,
-    Statistics* statistics)
+    Timer* timer, Statistics* statistics)
     : base_fetcher_(fetcher),
       rate_controller_(new RateController(
           max_global_queue_size, per_host_outgoing_request_threshold,
-          per_host_queued_request_threshold, thread_system, statistics)) {}
+          per_host_queued_request_threshold, thread_system, timer,
+          statistics)) {}
 
 RateControllingUrlAsyncFetcher::~RateControllingUrlAsyncFetcher() {}
 
@@ -56,4 +57,8 @@ void RateControllingUrlAsyncFetcher::ShutDown() {
   base_fetcher_->ShutDown();
 }
 
+void RateControllingUrlAsyncFetcher::PrintHostStats(GoogleString* out) {
+  rate_controller_->PrintHostStats(out);
+}
+
 }  // namespace net_instaweb
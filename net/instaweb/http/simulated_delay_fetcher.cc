@@ -53,6 +53,7 @@ SimulatedDelayFetcher::SimulatedDelayFetcher(ThreadSystem* thread_system,
       message_handler_(handler),
       file_system_(file_system),
       request_log_flush_frequency_(request_log_flush_frequency),
+      chunk_delay_ms_(0),
       mutex_(thread_system->NewMutex()),
       request_log_outstanding_(0),
       request_log_(file_system_->OpenOutputFile(
@@ -64,6 +65,12 @@ SimulatedDelayFetcher::~SimulatedDelayFetcher() {
   file_system_->Close(request_log_, message_handler_);
 }
 
+void SimulatedDelayFetcher::SetChunkedReply(const StringVector& body_chunks,
+                                            int64 chunk_delay_ms) {
+  body_chunks_ = body_chunks;
+  chunk_delay_ms_ = chunk_delay_ms;
+}
+
 void SimulatedDelayFetcher::Fetch(const GoogleString& url,
                                   MessageHandler* message_handler,
                                   AsyncFetch* fetch) {
@@ -114,8 +121,25 @@ void SimulatedDelayFetcher::ProduceReply(AsyncFetch* fetch) {
   fetch->response_headers()->SetDateAndCaching(timer_->NowMs(),
                                                0 /* uncacheable */);
   fetch->response_headers()->Add(HttpAttributes::kContentType, "text/html");
-  fetch->Write(kPayload, message_handler_);
-  fetch->Done(true);
+  if (body_chunks_.empty()) {
+    fetch->Write(kPayload, message_handler_);
+    fetch->Done(true);
+  } else {
+    ProduceChunk(fetch, 0);
+  }
+}
+
+void SimulatedDelayFetcher::ProduceChunk(AsyncFetch* fetch, int index) {
+  fetch->Write(body_chunks_[index], message_handler_);
+  ++index;
+  if (index == static_cast<int>(body_chunks_.size())) {
+    fetch->Done(true);
+  } else {
+    scheduler_->AddAlarmAtUs(
+        (timer_->NowMs() + chunk_delay_ms_) * Timer::kMsUs,
+        MakeFunction(this, &SimulatedDelayFetcher::ProduceChunk, fetch,
+                     index));
+  }
 }
 
 void SimulatedDelayFetcher::ParseDelayMap(StringPiece delay_map_path) {
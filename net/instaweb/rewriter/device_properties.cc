@@ -38,6 +38,8 @@ DeviceProperties::DeviceProperties(UserAgentMatcher* matcher)
       supports_lazyload_images_(kNotSet),
       requests_save_data_(kNotSet),
       accepts_webp_(kNotSet),
+      accepts_gzip_(kNotSet),
+      accepts_brotli_(kNotSet),
       supports_webp_rewritten_urls_(kNotSet),
       supports_webp_lossless_alpha_(kNotSet),
       supports_webp_animated_(kNotSet),
@@ -79,6 +81,10 @@ void DeviceProperties::ParseRequestHeaders(
                                            HttpAttributes::kGzip)
                       ? kTrue
                       : kFalse;
+  accepts_brotli_ = request_headers.HasValue(HttpAttributes::kAcceptEncoding,
+                                             HttpAttributes::kBrotli)
+                        ? kTrue
+                        : kFalse;
 
   const char* save_data_header =
       request_headers.Lookup1(HttpAttributes::kSaveData);
@@ -99,6 +105,14 @@ bool DeviceProperties::AcceptsGzip() const {
   return (accepts_gzip_ == kTrue);
 }
 
+bool DeviceProperties::AcceptsBrotli() const {
+  if (accepts_brotli_ == kNotSet) {
+    LOG(DFATAL) << "Check of AcceptsBrotli before value is set.";
+    accepts_brotli_ = kFalse;
+  }
+  return (accepts_brotli_ == kTrue);
+}
+
 bool DeviceProperties::SupportsImageInlining() const {
   if (supports_image_inlining_ == kNotSet) {
     supports_image_inlining_ =
@@ -1076,6 +1076,8 @@ inline bool ImageImpl::ComputeOutputContentsFromGifOrPng(
     if (!ok && fall_back_to_png) {
       ok = MayConvert() && PngOptimizer::OptimizePngBestCompression(
                                *png_reader, string_for_image, &output_contents_,
+                               options_->thread_system,
+                               options_->png_max_concurrent_encodes,
                                handler_.get());
       output_type = IMAGE_PNG;
     }
@@ -1163,7 +1165,9 @@ bool ImageImpl::OptimizePng(const PngReaderInterface& png_reader,
                             const GoogleString& image_data) {
   bool ok = MayConvert() &&
             PngOptimizer::OptimizePngBestCompression(
-                png_reader, image_data, &output_contents_, handler_.get());
+                png_reader, image_data, &output_contents_,
+                options_->thread_system, options_->png_max_concurrent_encodes,
+                handler_.get());
   if (ok) {
     image_type_ = IMAGE_PNG;
   }
@@ -882,10 +882,26 @@ Image::CompressionOptions* ImageRewriteFilter::ImageOptionsForLoadedResource(
   image_options->retain_color_sampling =
       !options->Enabled(RewriteOptions::kJpegSubsampling);
   image_options->webp_conversion_timeout_ms = options->image_webp_timeout_ms();
+  image_options->thread_system = server_context()->thread_system();
+  image_options->png_max_concurrent_encodes = PngConcurrentEncodes(*options);
 
   return image_options;
 }
 
+int ImageRewriteFilter::PngConcurrentEncodes(
+    const RewriteOptions& options) const {
+  int max_encodes = std::max(1, options.image_png_max_concurrent_encodes());
+  int bound = options.image_max_rewrites_at_once();
+  if (max_encodes == 1 || bound <= 0) {
+    return max_encodes;
+  }
+  // The image we are about to rewrite is not counted in
+  // image_ongoing_rewrites_ yet, but it already holds one slot.
+  int64 spare = bound - image_ongoing_rewrites_->Get() - 1;
+  return static_cast<int>(
+      std::min<int64>(max_encodes, 1 + std::max<int64>(0, spare)));
+}
+
 // Resize image if necessary, returning true if this resizing succeeds and false
 // if it's unnecessary or fails.
 bool ImageRewriteFilter::ResizeImageIfNecessary(
@@ -122,15 +122,18 @@ bool JavascriptCodeBlock::IsSanitarySourceMapUrl(StringPiece url) {
   return true;
 }
 
-void JavascriptCodeBlock::AppendSourceMapUrl(StringPiece url) {
-  DCHECK(rewritten_);
-  DCHECK(successfully_rewritten_);
+GoogleString JavascriptCodeBlock::SourceMapUrlComment(StringPiece url) {
   if (!IsSanitarySourceMapUrl(url)) {
     LOG(DFATAL) << "Unsanitary source map URL could not be added to JS " << url;
-    return;
+    return GoogleString();
   }
+  return StrCat("\n//# sourceMappingURL=", url, "\n");
+}
 
-  StrAppend(&rewritten_code_, "\n//# sourceMappingURL=", url, "\n");
+void JavascriptCodeBlock::AppendSourceMapUrl(StringPiece url) {
+  DCHECK(rewritten_);
+  DCHECK(successfully_rewritten_);
+  rewritten_code_ += SourceMapUrlComment(url);
 }
 
 StringPiece JavascriptCodeBlock::ComputeJavascriptLibrary() const {
@@ -143,13 +146,20 @@ StringPiece JavascriptCodeBlock::ComputeJavascriptLibrary() const {
   DCHECK(rewritten_);
   StringPiece result;
   if (rewritten_) {
-    const JavascriptLibraryIdentification* library_identification =
-        config_->library_identification();
-    if (library_identification != nullptr) {
-      result = library_identification->Find(rewritten_code_);
-      if (!result.empty()) {
-        config_->libraries_identified()->Add(1);
-      }
+    result = FindJavascriptLibrary(rewritten_code_, config_);
+  }
+  return result;
+}
+
+StringPiece JavascriptCodeBlock::FindJavascriptLibrary(
+    StringPiece minified_code, JavascriptRewriteConfig* config) {
+  StringPiece result;
+  const JavascriptLibraryIdentification* library_identification =
+      config->library_identification();
+  if (library_identification != nullptr) {
+    result = library_identification->Find(minified_code);
+    if (!result.empty()) {
+      config->libraries_identified()->Add(1);
     }
   }
   return result;
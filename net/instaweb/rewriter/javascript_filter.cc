@@ -37,6 +37,7 @@
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/single_rewrite_context.h"
 #include "pagespeed/kernel/base/charset_util.h"
+#include "pagespeed/kernel/base/counting_writer.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/source_map.h"
 #include "pagespeed/kernel/base/statistics.h"
@@ -44,6 +45,7 @@
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/html/html_node.h"
+#include "pagespeed/kernel/js/js_minify.h"
 #include "pagespeed/kernel/http/content_type.h"
 #include "pagespeed/kernel/http/data_url.h"
 #include "pagespeed/kernel/http/google_url.h"
@@ -59,6 +61,9 @@ namespace {
 const char kInlineCspMessage[] =
     "Avoiding modifying inline script with CSP present";
 
+// How much of a script StreamingRewriteJavascript minifies at a time.
+const size_t kStreamingChunkSize = 64 * 1024;
+
 void CleanupWhitespaceScriptBody(RewriteDriver* driver,
                                  HtmlCharactersNode* node) {
   // Note that an external script tag might contain body data.  We erase this
@@ -144,8 +149,18 @@ class JavascriptFilter::Context : public SingleRewriteContext {
 
     ServerContext* server_context = FindServerContext();
     MessageHandler* message_handler = server_context->message_handler();
-    JavascriptCodeBlock code_block(input->ExtractUncompressedContents(),
-                                   config_, input->url(), message_handler);
+    StringPiece contents = input->ExtractUncompressedContents();
+    const int64 streaming_min_bytes =
+        Options()->js_streaming_minify_min_bytes();
+    if (config_->minify() && config_->use_experimental_minifier() &&
+        Options()->Enabled(RewriteOptions::kRewriteJavascriptExternal) &&
+        streaming_min_bytes >= 0 &&
+        static_cast<int64>(contents.size()) >= streaming_min_bytes) {
+      return StreamingRewriteJavascript(input, contents, server_context,
+                                        rewritten, source_map);
+    }
+    JavascriptCodeBlock code_block(contents, config_, input->url(),
+                                   message_handler);
     code_block.Rewrite();
     // Check whether this code should, for various reasons, not be rewritten.
     if (PossiblyRewriteToLibrary(code_block, server_context, rewritten)) {
@@ -181,25 +196,13 @@ class JavascriptFilter::Context : public SingleRewriteContext {
     } else if (Options()->Enabled(RewriteOptions::kIncludeJsSourceMaps) ||
                output_source_map_) {
       // We produce a source map if they are enabled or requested.
-      GoogleUrl original_gurl(input->url());
-      std::unique_ptr<GoogleUrl> source_gurl;
-      if (server_context->IsPagespeedResource(original_gurl)) {
-        // Do not append Pagespeed=off if input is already a pagespeed resource.
-        source_gurl = std::make_unique<GoogleUrl>();
-        source_gurl->Reset(original_gurl);
-      } else {
-        // Note: We append PageSpeed=off query parameter to make sure that
-        // the source URL doesn't get rewritten with IPRO.
-        source_gurl.reset(original_gurl.CopyAndAddQueryParam(
-            RewriteQuery::kPageSpeed, "off"));
-      }
-
       GoogleString source_map_text;
       // Note: We omit rewritten URL because of a chicken-and-egg problem.
       // rewritten URL depends on rewritten content, which depends on
       // source map URL, which depends on source map contents.
       // (So source map contents can't depend on rewritten URL!)
-      source_map::Encode("" /* Omit rewritten URL */, source_gurl->Spec(),
+      source_map::Encode("" /* Omit rewritten URL */,
+                         SourceMapSourceUrl(input, server_context),
                          code_block.SourceMappings(), &source_map_text);
 
       // TODO(sligocki): Perhaps we should not insert source maps into the
@@ -232,6 +235,114 @@ class JavascriptFilter::Context : public SingleRewriteContext {
     return kRewriteOk;
   }
 
+  // Like RewriteJavascript, once the output resources have been created, but
+  // for scripts too big to want several copies of in memory.  Minifies the
+  // script a piece at a time straight into the rewritten output resource, and
+  // the source map into its own, abandoning them if we turn out not to want
+  // them.
+  RewriteResult StreamingRewriteJavascript(
+      const ResourcePtr& input, StringPiece contents,
+      ServerContext* server_context, const OutputResourcePtr& rewritten,
+      const OutputResourcePtr& source_map) {
+    MessageHandler* message_handler = server_context->message_handler();
+    Writer* script_writer =
+        StartWriteExternalScript(input, server_context, rewritten);
+    if (script_writer == nullptr) {
+      config_->failed_to_write()->Add(1);
+      return kRewriteFailed;
+    }
+    CountingWriter counting_writer(script_writer);
+    std::unique_ptr<source_map::StreamingEncoder> encoder;
+    if (Options()->Enabled(RewriteOptions::kIncludeJsSourceMaps) ||
+        output_source_map_) {
+      Writer* source_map_writer = StartWriteSourceMap(input, source_map);
+      if (source_map_writer != nullptr) {
+        // As in RewriteJavascript, we omit the rewritten URL.
+        encoder = std::make_unique<source_map::StreamingEncoder>(
+            "" /* Omit rewritten URL */,
+            SourceMapSourceUrl(input, server_context), source_map_writer,
+            message_handler);
+      }
+    }
+
+    pagespeed::js::StreamingJsMinifier minifier(
+        config_->js_tokenizer_patterns(), &counting_writer, encoder.get(),
+        message_handler);
+    bool write_ok = true;
+    for (size_t pos = 0; write_ok && pos < contents.size();
+         pos += kStreamingChunkSize) {
+      write_ok = minifier.Minify(contents.substr(pos, kStreamingChunkSize));
+    }
+    write_ok = write_ok && minifier.Finish();
+    if (minifier.has_error()) {
+      // As in JavascriptCodeBlock::Rewrite, we still look for a library.
+      message_handler->Message(kInfo,
+                               "%s: Javascript minification failed.  "
+                               "Preserving old code.",
+                               input->url().c_str());
+      config_->minification_failures()->Add(1);
+      StringPiece trimmed = contents;
+      TrimWhitespace(&trimmed);
+      if (PossiblyRewriteToLibrary(trimmed, input->url(), server_context,
+                                   rewritten)) {
+        return kRewriteFailed;
+      }
+      message_handler->Message(kInfo, "Script %s didn't shrink.",
+                               input->url().c_str());
+      config_->did_not_shrink()->Add(1);
+      return kRewriteFailed;
+    }
+    if (!write_ok) {
+      config_->failed_to_write()->Add(1);
+      return kRewriteFailed;
+    }
+
+    config_->blocks_minified()->Add(1);
+    const size_t rewritten_size = counting_writer.byte_count();
+    const bool shrank = rewritten_size < contents.size();
+    if (shrank) {
+      config_->num_reducing_uses()->Add(1);
+      config_->total_original_bytes()->Add(contents.size());
+      config_->total_bytes_saved()->Add(contents.size() - rewritten_size);
+    }
+    if (rewritten_size > 0 &&
+        PossiblyRewriteToLibrary(rewritten->raw_contents(), input->url(),
+                                 server_context, rewritten)) {
+      return kRewriteFailed;
+    }
+    if (!shrank) {
+      message_handler->Message(kInfo, "Script %s didn't shrink.",
+                               input->url().c_str());
+      config_->did_not_shrink()->Add(1);
+      return kRewriteFailed;
+    }
+
+    if (encoder.get() == nullptr || encoder->num_mappings() == 0) {
+      if (output_source_map_) {
+        return kRewriteFailed;
+      }
+    } else if (encoder->Finish()) {
+      Driver()->FinishWrite(source_map.get());
+      write_ok = counting_writer.Write(
+          JavascriptCodeBlock::SourceMapUrlComment(source_map->url()),
+          message_handler);
+    }
+    if (!write_ok) {
+      config_->failed_to_write()->Add(1);
+      return kRewriteFailed;
+    }
+    Driver()->FinishWrite(rewritten.get());
+    // See RewriteJavascript for why this comes after writing.
+    if (Options()->avoid_renaming_introspective_javascript() &&
+        JavascriptCodeBlock::UnsafeToRename(rewritten->raw_contents())) {
+      CachedResult* result = rewritten->EnsureCachedResultCreated();
+      result->set_url_relocatable(false);
+      message_handler->Message(kInfo, "Script %s is unsafe to replace.",
+                               input->url().c_str());
+    }
+    return kRewriteOk;
+  }
+
  protected:
   // Implements the asynchronous interface required by SingleRewriteContext.
   //
@@ -315,7 +426,21 @@ class JavascriptFilter::Context : public SingleRewriteContext {
                              StringPiece script_out,
                              ServerContext* server_context,
                              const OutputResourcePtr& script_dest) {
-    bool ok = false;
+    Writer* writer =
+        StartWriteExternalScript(script_resource, server_context, script_dest);
+    if (writer == nullptr) {
+      return false;
+    }
+    bool ok = writer->Write(script_out, server_context->message_handler());
+    Driver()->FinishWrite(script_dest.get());
+    return ok;
+  }
+
+  // The first half of WriteExternalScriptTo, returning the Writer to write
+  // the script to, or NULL on failure.
+  Writer* StartWriteExternalScript(const ResourcePtr& script_resource,
+                                   ServerContext* server_context,
+                                   const OutputResourcePtr& script_dest) {
     server_context->MergeNonCachingResponseHeaders(script_resource,
                                                    script_dest);
     // Try to preserve original content type to avoid breaking upstream proxies
@@ -324,23 +449,46 @@ class JavascriptFilter::Context : public SingleRewriteContext {
     if (content_type == nullptr || !content_type->IsJsLike()) {
       content_type = &kContentTypeJavascript;
     }
-    if (Driver()->Write(ResourceVector(1, script_resource), script_out,
-                        content_type, script_resource->charset(),
-                        script_dest.get())) {
-      ok = true;
-    }
-    return ok;
+    return Driver()->StartWrite(ResourceVector(1, script_resource),
+                                content_type, script_resource->charset(),
+                                script_dest.get());
   }
 
   bool WriteSourceMapTo(const ResourcePtr& input_resource, StringPiece contents,
                         const OutputResourcePtr& source_map) {
+    Writer* writer = StartWriteSourceMap(input_resource, source_map);
+    if (writer == nullptr) {
+      return false;
+    }
+    bool ok = writer->Write(contents, Driver()->message_handler());
+    Driver()->FinishWrite(source_map.get());
+    return ok;
+  }
+
+  Writer* StartWriteSourceMap(const ResourcePtr& input_resource,
+                              const OutputResourcePtr& source_map) {
     source_map->response_headers()->Add(HttpAttributes::kXContentTypeOptions,
                                         HttpAttributes::kNosniff);
     source_map->response_headers()->Add(HttpAttributes::kContentDisposition,
                                         HttpAttributes::kAttachment);
-    return Driver()->Write(ResourceVector(1, input_resource), contents,
-                           &kContentTypeSourceMap, kUtf8Charset,
-                           source_map.get());
+    return Driver()->StartWrite(ResourceVector(1, input_resource),
+                                &kContentTypeSourceMap, kUtf8Charset,
+                                source_map.get());
+  }
+
+  // The URL a source map for input should point back to.
+  GoogleString SourceMapSourceUrl(const ResourcePtr& input,
+                                  ServerContext* server_context) {
+    GoogleUrl original_gurl(input->url());
+    if (server_context->IsPagespeedResource(original_gurl)) {
+      // Do not append Pagespeed=off if input is already a pagespeed resource.
+      return original_gurl.Spec().as_string();
+    }
+    // Note: We append PageSpeed=off query parameter to make sure that
+    // the source URL doesn't get rewritten with IPRO.
+    std::unique_ptr<GoogleUrl> source_gurl(
+        original_gurl.CopyAndAddQueryParam(RewriteQuery::kPageSpeed, "off"));
+    return source_gurl->Spec().as_string();
   }
 
   // Decide if given code block is a JS library, and if so set up CachedResult
@@ -348,7 +496,24 @@ class JavascriptFilter::Context : public SingleRewriteContext {
   bool PossiblyRewriteToLibrary(const JavascriptCodeBlock& code_block,
                                 ServerContext* server_context,
                                 const OutputResourcePtr& output) {
-    StringPiece library_url = code_block.ComputeJavascriptLibrary();
+    return SetUpLibrary(code_block.ComputeJavascriptLibrary(),
+                        code_block.message_id(), server_context, output);
+  }
+
+  // As above, for minified code that didn't come from a JavascriptCodeBlock.
+  bool PossiblyRewriteToLibrary(StringPiece minified_code,
+                                StringPiece message_id,
+                                ServerContext* server_context,
+                                const OutputResourcePtr& output) {
+    return SetUpLibrary(
+        JavascriptCodeBlock::FindJavascriptLibrary(minified_code, config_),
+        message_id, server_context, output);
+  }
+
+  // If library_url is non-empty, set up the CachedResult to point to it.
+  bool SetUpLibrary(StringPiece library_url, StringPiece message_id,
+                    ServerContext* server_context,
+                    const OutputResourcePtr& output) {
     if (library_url.empty()) {
       return false;
     }
@@ -357,7 +522,7 @@ class JavascriptFilter::Context : public SingleRewriteContext {
     // absolute canonical urls when they are required).
     GoogleUrl library_gurl(Driver()->base_url(), library_url);
     server_context->message_handler()->Message(
-        kInfo, "Canonical script %s is %s", code_block.message_id().c_str(),
+        kInfo, "Canonical script %s is %s", message_id.as_string().c_str(),
         library_gurl.UncheckedSpec().as_string().c_str());
     if (!library_gurl.IsWebValid()) {
       return false;
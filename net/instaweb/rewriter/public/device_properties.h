@@ -63,6 +63,7 @@ class DeviceProperties {
   bool SupportsWebpAnimated() const;
   bool IsBot() const;
   bool AcceptsGzip() const;
+  bool AcceptsBrotli() const;
   UserAgentMatcher::DeviceType GetDeviceType() const;
   bool IsMobile() const { return GetDeviceType() == UserAgentMatcher::kMobile; }
   bool IsTablet() const { return GetDeviceType() == UserAgentMatcher::kTablet; }
@@ -99,6 +100,7 @@ class DeviceProperties {
   mutable LazyBool requests_save_data_;
   mutable LazyBool accepts_webp_;
   mutable LazyBool accepts_gzip_;
+  mutable LazyBool accepts_brotli_;
   mutable LazyBool supports_webp_rewritten_urls_;
   mutable LazyBool supports_webp_lossless_alpha_;
   mutable LazyBool supports_webp_animated_;
@@ -33,6 +33,7 @@
 namespace net_instaweb {
 class Histogram;
 class MessageHandler;
+class ThreadSystem;
 class Timer;
 class Variable;
 struct ContentType;
@@ -107,7 +108,9 @@ class Image {
           webp_conversion_timeout_ms(-1),
           conversions_attempted(0),
           preserve_lossless(false),
-          webp_conversion_variables(NULL) {}
+          webp_conversion_variables(NULL),
+          thread_system(NULL),
+          png_max_concurrent_encodes(1) {}
 
     // These options are set by the client to specify what type of
     // conversion to perform:
@@ -138,6 +141,11 @@ class Image {
     bool preserve_lossless;
 
     ConversionVariables* webp_conversion_variables;
+
+    // If thread_system is set and png_max_concurrent_encodes > 1, PNG
+    // compression settings are tried on up to that many threads at once.
+    ThreadSystem* thread_system;
+    int png_max_concurrent_encodes;
   };
 
   virtual ~Image();
@@ -206,6 +206,12 @@ class ImageRewriteFilter : public RewriteFilter {
   Image::CompressionOptions* ImageOptionsForLoadedResource(
       const ResourceContext& context, const ResourcePtr& input_resource);
 
+  // Returns the number of threads that may try PNG compression settings for
+  // the image about to be rewritten.  Threads beyond the first count against
+  // image_max_rewrites_at_once() just like whole images do, so they are only
+  // handed out while that bound has room to spare.
+  int PngConcurrentEncodes(const RewriteOptions& options) const;
+
   const RewriteOptions::Filter* RelatedFilters(int* num_filters) const override;
   const StringPieceVector* RelatedOptions() const override {
     return related_options_;
@@ -198,6 +198,15 @@ class JavascriptCodeBlock {
   // PRECONDITION: Rewrite() must have been called first.
   StringPiece ComputeJavascriptLibrary() const;
 
+  // As ComputeJavascriptLibrary(), for minified code that didn't come from a
+  // JavascriptCodeBlock.
+  static StringPiece FindJavascriptLibrary(StringPiece minified_code,
+                                           JavascriptRewriteConfig* config);
+
+  // Returns the comment that AppendSourceMapUrl() appends, or the empty
+  // string if url is unsanitary.
+  static GoogleString SourceMapUrlComment(StringPiece url);
+
   // Swaps rewritten_code_ into *other. Afterward the JavascriptCodeBlock will
   // be cleared and unusable.
   // PRECONDITION: Rewrite() must have been called first and
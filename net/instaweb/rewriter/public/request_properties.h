@@ -69,6 +69,7 @@ class RequestProperties {
   bool IsTablet() const;
   bool ForbidWebpInlining() const;
   bool AcceptsGzip() const;
+  bool AcceptsBrotli() const;
   void LogDeviceInfo(AbstractLogRecord* log_record,
                      bool enable_aggressive_rewriters_for_mobile);
   bool RequestsSaveData() const;
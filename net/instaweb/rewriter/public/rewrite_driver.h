@@ -58,6 +58,7 @@
 #include "pagespeed/kernel/base/thread_annotations.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/writer.h"
+#include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/html/html_filter.h"
 #include "pagespeed/kernel/html/html_node.h"
@@ -879,6 +880,16 @@ class RewriteDriver : public HtmlParse {
   void DeregisterForPartitionKey(const GoogleString& partition_key,
                                  RewriteContext* candidate);
 
+  // Looks up a RewriteContext's partition key in the metadata cache.
+  // Lookups made by the contexts initiated in a flush window are held back
+  // until they have all started, and are then issued as a single
+  // CacheInterface::MultiGet, so that a page with many resources costs one
+  // round-trip to an external cache rather than one per resource.  Lookups
+  // made at any other time go straight to the cache.
+  void LookupMetadata(const GoogleString& partition_key,
+                      CacheInterface::Callback* callback)
+      LOCKS_EXCLUDED(rewrite_mutex());
+
   // Indicates that a Flush through the HTML parser chain should happen
   // soon, e.g. once the network pauses its incoming byte stream.
   void RequestFlush() { flush_requested_ = true; }
@@ -1147,6 +1158,15 @@ class RewriteDriver : public HtmlParse {
              const ContentType* type, StringPiece charset,
              OutputResource* output);
 
+  // The two halves of Write(), for callers that produce the contents a piece
+  // at a time.  StartWrite() sets up the headers as Write() does and returns
+  // the Writer (owned by output) to write the contents to, or NULL on
+  // failure.  Once done, FinishWrite() marks the output optimized and caches
+  // it; to abandon the output instead, just don't call FinishWrite().
+  Writer* StartWrite(const ResourceVector& inputs, const ContentType* type,
+                     StringPiece charset, OutputResource* output);
+  void FinishWrite(OutputResource* output);
+
   void set_defer_instrumentation_script(bool x) {
     defer_instrumentation_script_ = x;
   }
@@ -1270,6 +1290,10 @@ class RewriteDriver : public HtmlParse {
   // Queues up invocation of FlushAsyncDone in our html_workers sequence.
   void QueueFlushAsyncDone(int num_rewrites, Function* callback);
 
+  // Runs in the rewrite thread after the Start() of every context initiated
+  // by FlushAsync, and issues the metadata lookups they batched up.
+  void IssueMetadataLookups() LOCKS_EXCLUDED(rewrite_mutex());
+
   // Called as part of implementation of FinishParseAsync, after the
   // flush is complete.
   void QueueFinishParseAfterFlush(Function* user_callback);
@@ -1558,6 +1582,11 @@ class RewriteDriver : public HtmlParse {
   // Number of total initiated rewrites for the request.
   int64 num_initiated_rewrites_ GUARDED_BY(rewrite_mutex());
 
+  // Metadata cache lookups collected by LookupMetadata, waiting for
+  // IssueMetadataLookups.  NULL when lookups are not being batched.
+  std::unique_ptr<CacheInterface::MultiGetRequest> metadata_lookups_
+      GUARDED_BY(rewrite_mutex());
+
   // Number of total detached rewrites for the request, i.e. rewrites whose
   // results did not make it to the response. This is different from
   // kRefDetachedRewrites (and detached_rewrites_.size(), which is equal to it)
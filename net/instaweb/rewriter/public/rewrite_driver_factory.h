@@ -133,6 +133,13 @@ class RewriteDriverFactory {
   // fecher to return cached versions.
   void set_force_caching(bool u) { force_caching_ = u; }
 
+  // Makes the worker pools created by WorkerPool() use per-thread deques
+  // with work stealing (see QueuedWorkerPool::EnableWorkStealing).  Must be
+  // called before the first ServerContext is created.
+  void set_use_work_stealing_worker_pools(bool x) {
+    use_work_stealing_worker_pools_ = x;
+  }
+
   // You can call set_base_url_async_fetcher to set up real async fetching
   // for real serving or for modeling of live traffic.
   //
@@ -452,6 +459,7 @@ class RewriteDriverFactory {
   bool force_caching_;
   bool slurp_read_only_;
   bool slurp_print_urls_;
+  bool use_work_stealing_worker_pools_;
 
   std::unique_ptr<ThreadSystem> thread_system_;
 
@@ -250,6 +250,8 @@ class RewriteOptions {
   // css_filter.cc.
   static const char kAcceptInvalidSignatures[];
   static const char kAccessControlAllowOrigins[];
+  static const char kAdaptiveFlushInitialBytes[];
+  static const char kAdaptiveFlushMaxDelayMs[];
   static const char kAddOptionsToUrls[];
   static const char kAllowLoggingUrlsInLogRecord[];
   static const char kAllowOptionsToBeSetByCookies[];
@@ -301,6 +303,7 @@ class RewriteOptions {
   static const char kGoogleFontCssInlineMaxBytes[];
   static const char kForbidAllDisabledFilters[];
   static const char kHideRefererUsingMeta[];
+  static const char kHttpCacheBrotliQuality[];
   static const char kHttpCacheCompressionLevel[];
   static const char kHonorCsp[];
   static const char kIdleFlushTimeMs[];
@@ -316,6 +319,7 @@ class RewriteOptions {
   static const char kImageLimitRenderedAreaPercent[];
   static const char kImageLimitResizeAreaPercent[];
   static const char kImageMaxRewritesAtOnce[];
+  static const char kImagePngMaxConcurrentEncodes[];
   static const char kImagePreserveURLs[];
   static const char kImageRecompressionQuality[];
   static const char kImageResolutionLimitBytes[];
@@ -338,6 +342,7 @@ class RewriteOptions {
   static const char kJsInlineMaxBytes[];
   static const char kJsOutlineMinBytes[];
   static const char kJsPreserveURLs[];
+  static const char kJsStreamingMinifyMinBytes[];
   static const char kLazyloadImagesAfterOnload[];
   static const char kLazyloadImagesBlankUrl[];
   static const char kLoadFromFileCacheTtlMs[];
@@ -809,6 +814,7 @@ class RewriteOptions {
   static const int64 kDefaultImageInlineMaxBytes;
   static const int64 kDefaultJsInlineMaxBytes;
   static const int64 kDefaultJsOutlineMinBytes;
+  static const int64 kDefaultJsStreamingMinifyMinBytes;
   static const int64 kDefaultProgressiveJpegMinBytes;
   static const int64 kDefaultMaxCacheableResponseContentLength;
   static const int64 kDefaultMaxHtmlCacheTimeMs;
@@ -821,6 +827,8 @@ class RewriteOptions {
   static const int64 kDefaultDownstreamCacheRewrittenPercentageThreshold;
   static const int64 kDefaultIdleFlushTimeMs;
   static const int64 kDefaultFlushBufferLimitBytes;
+  static const int64 kDefaultAdaptiveFlushInitialBytes;
+  static const int64 kDefaultAdaptiveFlushMaxDelayMs;
   static const int64 kDefaultImplicitCacheTtlMs;
   static const int64 kDefaultPrioritizeVisibleContentCacheTimeMs;
   static const char kDefaultBeaconUrl[];
@@ -848,6 +856,7 @@ class RewriteOptions {
   static const int kDefaultMaxUrlSize;
 
   static const int kDefaultImageMaxRewritesAtOnce;
+  static const int kDefaultImagePngMaxConcurrentEncodes;
 
   // See http://github.com/apache/incubator-pagespeed-mod/issues/9
   // Apache evidently limits each URL path segment (between /) to
@@ -1752,6 +1761,28 @@ class RewriteOptions {
     set_option(x, &flush_buffer_limit_bytes_);
   }
 
+  // How much HTML ProxyFetch accumulates before introducing the first flush
+  // of a response.  The window doubles after each flush, up to
+  // flush_buffer_limit_bytes, so that the start of a document can be
+  // rewritten and sent while the rest is still arriving from the origin.
+  // Values <= 0 disable adaptive flushing.
+  int64 adaptive_flush_initial_bytes() const {
+    return adaptive_flush_initial_bytes_.value();
+  }
+  void set_adaptive_flush_initial_bytes(int64 x) {
+    set_option(x, &adaptive_flush_initial_bytes_);
+  }
+
+  // When adaptive flushing is enabled, the longest HTML may wait after being
+  // parsed before ProxyFetch flushes it, however few bytes have arrived.
+  // Values <= 0 flush based on bytes alone.
+  int64 adaptive_flush_max_delay_ms() const {
+    return adaptive_flush_max_delay_ms_.value();
+  }
+  void set_adaptive_flush_max_delay_ms(int64 x) {
+    set_option(x, &adaptive_flush_max_delay_ms_);
+  }
+
   // The maximum length of a URL segment.
   // for http://a/b/c.d, this is == strlen("c.d")
   int max_url_segment_size() const { return max_url_segment_size_.value(); }
@@ -1766,6 +1797,16 @@ class RewriteOptions {
     set_option(x, &image_max_rewrites_at_once_);
   }
 
+  // The number of threads that may try PNG compression settings for a single
+  // image at once.  Threads beyond the first are only used while fewer than
+  // image_max_rewrites_at_once() images are being rewritten.
+  int image_png_max_concurrent_encodes() const {
+    return image_png_max_concurrent_encodes_.value();
+  }
+  void set_image_png_max_concurrent_encodes(int x) {
+    set_option(x, &image_png_max_concurrent_encodes_);
+  }
+
   // The maximum size of the entire URL.  If '0', this is left unlimited.
   int max_url_size() const { return max_url_size_.value(); }
   void set_max_url_size(int x) { set_option(x, &max_url_size_); }
@@ -2023,6 +2064,13 @@ class RewriteOptions {
     return http_cache_compression_level_.value();
   }
 
+  void set_http_cache_brotli_quality(int x) {
+    set_option(x, &http_cache_brotli_quality_);
+  }
+  int http_cache_brotli_quality() const {
+    return http_cache_brotli_quality_.value();
+  }
+
   void set_request_option_override(StringPiece p) {
     set_option(GoogleString(p.data(), p.size()), &request_option_override_);
   }
@@ -2456,6 +2504,13 @@ class RewriteOptions {
     set_option(x, &use_experimental_js_minifier_);
   }
 
+  int64 js_streaming_minify_min_bytes() const {
+    return js_streaming_minify_min_bytes_.value();
+  }
+  void set_js_streaming_minify_min_bytes(int64 x) {
+    set_option(x, &js_streaming_minify_min_bytes_);
+  }
+
   void set_max_combined_css_bytes(int64 x) {
     set_option(x, &max_combined_css_bytes_);
   }
@@ -3568,6 +3623,8 @@ class RewriteOptions {
   Option<int64> min_resource_cache_time_to_rewrite_ms_;
   Option<int64> idle_flush_time_ms_;
   Option<int64> flush_buffer_limit_bytes_;
+  Option<int64> adaptive_flush_initial_bytes_;
+  Option<int64> adaptive_flush_max_delay_ms_;
 
   // How long to wait in blocking fetches before timing out.
   // Applies to ResourceFetch::BlockingFetch() and class SyncFetcherAdapter.
@@ -3598,6 +3655,7 @@ class RewriteOptions {
   Option<int64> image_webp_timeout_ms_;
 
   Option<int> image_max_rewrites_at_once_;
+  Option<int> image_png_max_concurrent_encodes_;
   Option<int> max_url_segment_size_;  // For http://a/b/c.d, use strlen("c.d").
   Option<int> max_url_size_;          // This is strlen("http://a/b/c.d").
   // The interval to wait for async rewrites to complete before flushing
@@ -3905,6 +3963,11 @@ class RewriteOptions {
 
   Option<bool> use_experimental_js_minifier_;
 
+  // External scripts at least this big are minified a piece at a time,
+  // straight into the output resource, to bound peak memory use.  Negative
+  // disables streaming minification.
+  Option<int64> js_streaming_minify_min_bytes_;
+
   // Maximum size allowed for the combined CSS resource.
   // Negative value will bypass the size check.
   Option<int64> max_combined_css_bytes_;
@@ -3959,6 +4022,9 @@ class RewriteOptions {
 
   // The level to set the gzip compression of HTTPCache items.
   Option<int> http_cache_compression_level_;
+  // The brotli quality of the copies of rewritten resources HTTPCache keeps
+  // for clients that accept brotli.
+  Option<int> http_cache_brotli_quality_;
 
   // Pass this string in url to allow for pagespeed options.
   Option<GoogleString> request_option_override_;
@@ -70,6 +70,9 @@ class RewriteStats {
     return num_cache_control_not_rewritable_resources_;
   }
   Variable* num_flushes() { return num_flushes_; }
+  Variable* metadata_cache_batched_lookups() {
+    return metadata_cache_batched_lookups_;
+  }
   Variable* resource_404_count() { return resource_404_count_; }
   Variable* resource_url_domain_acceptances() {
     return resource_url_domain_acceptances_;
@@ -116,6 +119,11 @@ class RewriteStats {
   // HTML rewrite latency in ms.
   Histogram* rewrite_latency_histogram() { return rewrite_latency_histogram_; }
   Histogram* backend_latency_histogram() { return backend_latency_histogram_; }
+  // Number of metadata cache lookups issued together by a RewriteDriver in
+  // each flush window.
+  Histogram* metadata_cache_batch_size_histogram() {
+    return metadata_cache_batch_size_histogram_;
+  }
 
   // Number of .pagespeed. resources fetched.
   TimedVariable* total_fetch_count() { return total_fetch_count_; }
@@ -140,6 +148,7 @@ class RewriteStats {
   Variable* num_cache_control_rewritable_resources_;
   Variable* num_cache_control_not_rewritable_resources_;
   Variable* num_flushes_;
+  Variable* metadata_cache_batched_lookups_;
   Variable* page_load_count_;
   Variable* resource_404_count_;
   Variable* resource_url_domain_acceptances_;
@@ -161,6 +170,7 @@ class RewriteStats {
   Histogram* fetch_latency_histogram_;
   Histogram* rewrite_latency_histogram_;
   Histogram* backend_latency_histogram_;
+  Histogram* metadata_cache_batch_size_histogram_;
 
   TimedVariable* total_fetch_count_;
   TimedVariable* total_rewrite_count_;
@@ -82,6 +82,10 @@ bool RequestProperties::AcceptsGzip() const {
   return device_properties_->AcceptsGzip();
 }
 
+bool RequestProperties::AcceptsBrotli() const {
+  return device_properties_->AcceptsBrotli();
+}
+
 bool RequestProperties::SupportsCriticalCssBeacon() const {
   // For bots, we don't allow instrumentation, but we do allow bots to use
   // previous instrumentation results collected by non-bots to enable the
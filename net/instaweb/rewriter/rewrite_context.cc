@@ -1128,8 +1128,6 @@ void RewriteContext::Start() {
   //
   // Note that the output_key_name is not necessarily the same as the
   // name of the output.
-  // Write partition to metadata cache.
-  CacheInterface* metadata_cache = FindServerContext()->metadata_cache();
   SetPartitionKey();
 
   // See if some other handler already had to do an identical rewrite.
@@ -1142,7 +1140,9 @@ void RewriteContext::Start() {
       (new OutputCacheCallback(this, &RewriteContext::OutputCacheDone))
           ->Done(CacheInterface::kNotFound);
     } else {
-      metadata_cache->Get(
+      // The driver batches this lookup with those of the other contexts
+      // started in this flush window.
+      Driver()->LookupMetadata(
           partition_key_,
           new OutputCacheCallback(this, &RewriteContext::OutputCacheDone));
     }
@@ -298,6 +298,7 @@ void RewriteDriver::PopulateRequestContext() {
     request_context_->SetAcceptsWebp(
         request_properties_->SupportsWebpRewrittenUrls());
     request_context_->SetAcceptsGzip(request_properties_->AcceptsGzip());
+    request_context_->SetAcceptsBrotli(request_properties_->AcceptsBrotli());
     request_context_->Freeze();
   }
 }
@@ -431,6 +432,7 @@ void RewriteDriver::Clear() NO_THREAD_SAFETY_ANALYSIS {
     }
     DCHECK(primary_rewrite_context_map_.empty());
     DCHECK(initiated_rewrites_.empty());
+    DCHECK(metadata_lookups_ == nullptr);
     DCHECK(detached_rewrites_.empty());
     DCHECK(rewrites_.empty());
     DCHECK_EQ(0, possibly_quick_rewrites_);
@@ -693,6 +695,13 @@ void RewriteDriver::FlushAsync(Function* callback) {
     initiated_rewrites_.insert(rewrites_.begin(), rewrites_.end());
     num_initiated_rewrites_ += num_rewrites;
 
+    // Hold back the metadata lookups made by the contexts we are about to
+    // initiate.  Their Start() tasks all run ahead of IssueMetadataLookups
+    // in the rewrite sequence, so it sees every one of them.
+    if ((num_rewrites != 0) && (metadata_lookups_ == nullptr)) {
+      metadata_lookups_.reset(new CacheInterface::MultiGetRequest);
+    }
+
     // We must also start tasks while holding the lock, as otherwise a
     // successor task may complete and delete itself before we see if we
     // are the ones to start it.
@@ -702,6 +711,9 @@ void RewriteDriver::FlushAsync(Function* callback) {
         rewrite_context->Initiate();
       }
     }
+    if (num_rewrites != 0) {
+      AddRewriteTask(MakeFunction(this, &RewriteDriver::IssueMetadataLookups));
+    }
   }
   rewrites_.clear();
 
@@ -1730,7 +1742,8 @@ class CacheCallback : public OptionsAwareHTTPCacheCallback {
   void Find() {
     ServerContext* server_context = driver_->server_context();
     HTTPCache* http_cache = server_context->http_cache();
-    http_cache->Find(canonical_url_, driver_->CacheFragment(), handler_, this);
+    http_cache->FindPreferringBrotli(canonical_url_, driver_->CacheFragment(),
+                                     handler_, this);
   }
 
   bool IsCacheValid(const GoogleString& key,
@@ -1756,8 +1769,14 @@ class CacheCallback : public OptionsAwareHTTPCacheCallback {
       bool success = (value->ExtractContents(&content) &&
                       value->ExtractHeaders(response_headers, handler_));
       if (success) {
-        output_resource_->Link(value, handler_);
-        output_resource_->SetWritten(true);
+        // A brotli variant is only passed on to the client.  The
+        // OutputResource holds the contents as the filters wrote them, so
+        // it's only linked to the regular entry.
+        if (!response_headers->HasValue(HttpAttributes::kContentEncoding,
+                                        HttpAttributes::kBrotli)) {
+          output_resource_->Link(value, handler_);
+          output_resource_->SetWritten(true);
+        }
         async_fetch_->set_content_length(content.size());
         async_fetch_->FixCacheControlForGoogleCache();
         async_fetch_->HeadersComplete();
@@ -2307,6 +2326,40 @@ RewriteContext* RewriteDriver::RegisterForPartitionKey(
   }
 }
 
+void RewriteDriver::LookupMetadata(const GoogleString& partition_key,
+                                   CacheInterface::Callback* callback) {
+  {
+    ScopedMutex lock(rewrite_mutex());
+    if (metadata_lookups_ != nullptr) {
+      metadata_lookups_->push_back(
+          CacheInterface::KeyCallback(partition_key, callback));
+      return;
+    }
+  }
+  server_context_->metadata_cache()->Get(partition_key, callback);
+}
+
+void RewriteDriver::IssueMetadataLookups() {
+  CacheInterface::MultiGetRequest* request;
+  {
+    ScopedMutex lock(rewrite_mutex());
+    request = metadata_lookups_.release();
+  }
+  // If a previous flush window's task got here first, it has already
+  // issued our lookups.
+  if (request == nullptr) {
+    return;
+  }
+  if (request->empty()) {
+    delete request;
+    return;
+  }
+  RewriteStats* stats = server_context_->rewrite_stats();
+  stats->metadata_cache_batch_size_histogram()->Add(request->size());
+  stats->metadata_cache_batched_lookups()->Add(request->size());
+  server_context_->metadata_cache()->MultiGet(request);
+}
+
 void RewriteDriver::DeregisterForPartitionKey(const GoogleString& partition_key,
                                               RewriteContext* rewrite_context) {
   // If the context being deleted is the primary for some cache key,
@@ -3255,6 +3308,18 @@ bool RewriteDriver::is_critical_images_beacon_enabled() {
 bool RewriteDriver::Write(const ResourceVector& inputs,
                           const StringPiece& contents, const ContentType* type,
                           StringPiece charset, OutputResource* output) {
+  Writer* writer = StartWrite(inputs, type, charset, output);
+  bool ret = (writer != nullptr);
+  if (ret) {
+    ret = writer->Write(contents, message_handler());
+    FinishWrite(output);
+  }
+  return ret;
+}
+
+Writer* RewriteDriver::StartWrite(const ResourceVector& inputs,
+                                  const ContentType* type, StringPiece charset,
+                                  OutputResource* output) {
   output->SetType(type);
   output->set_charset(charset);
   ResponseHeaders* meta_data = output->response_headers();
@@ -3282,43 +3347,9 @@ bool RewriteDriver::Write(const ResourceVector& inputs,
   server_context_->ApplyInputCacheControl(inputs, meta_data);
   server_context_->AddOriginalContentLengthHeader(inputs, meta_data);
 
-  // The URL for any resource we will write includes the hash of contents,
-  // so it can can live, essentially, forever. So compute this hash,
-  // and cache the output using meta_data's default headers which are to cache
-  // forever.
   MessageHandler* handler = message_handler();
   Writer* writer = output->BeginWrite(handler);
-  bool ret = (writer != nullptr);
-  if (ret) {
-    ret = writer->Write(contents, handler);
-    output->EndWrite(handler);
-
-    HTTPCache* http_cache = server_context_->http_cache();
-    if (output->kind() != kOnTheFlyResource &&
-        output->kind() != kInlineResource &&
-        (http_cache->force_caching() || meta_data->IsProxyCacheable())) {
-      // This URL should already be mapped to the canonical rewrite domain,
-      // But we should store its unsharded form in the cache.
-      http_cache->Put(
-          output->HttpCacheKey(), CacheFragment(), RequestHeaders::Properties(),
-          options()->ComputeHttpOptions(), &output->value_, handler);
-    }
-
-    // If we're asked to, also save a debug dump
-    if (server_context_->store_outputs_in_file_system()) {
-      output->DumpToDisk(handler);
-    }
-
-    // If our URL is derived from some pre-existing URL (and not invented by
-    // us due to something like outlining), cache the mapping from original URL
-    // to the constructed one.
-    if (output->kind() == kRewrittenResource ||
-        output->kind() == kOnTheFlyResource) {
-      CachedResult* cached = output->EnsureCachedResultCreated();
-      cached->set_optimizable(true);
-      cached->set_url(output->url());  // Note: output->url() will be sharded.
-    }
-  } else {
+  if (writer == nullptr) {
     // Note that we've already gotten a "could not open file" message;
     // this just serves to explain why and suggest a remedy.
     handler->Message(kInfo,
@@ -3326,7 +3357,47 @@ bool RewriteDriver::Write(const ResourceVector& inputs,
                      " (bad filename prefix '%s'?)",
                      server_context_->filename_prefix().as_string().c_str());
   }
-  return ret;
+  return writer;
+}
+
+void RewriteDriver::FinishWrite(OutputResource* output) {
+  // The URL for any resource we will write includes the hash of contents,
+  // so it can can live, essentially, forever. So compute this hash,
+  // and cache the output using meta_data's default headers which are to cache
+  // forever.
+  MessageHandler* handler = message_handler();
+  output->EndWrite(handler);
+
+  HTTPCache* http_cache = server_context_->http_cache();
+  if (output->kind() != kOnTheFlyResource &&
+      output->kind() != kInlineResource &&
+      (http_cache->force_caching() ||
+       output->response_headers()->IsProxyCacheable())) {
+    // This URL should already be mapped to the canonical rewrite domain,
+    // But we should store its unsharded form in the cache.
+    http_cache->Put(output->HttpCacheKey(), CacheFragment(),
+                    RequestHeaders::Properties(),
+                    options()->ComputeHttpOptions(), &output->value_, handler);
+    // Compress the output once here, rather than on every fetch of it.
+    http_cache->PutBrotliVariant(output->HttpCacheKey(), CacheFragment(),
+                                 options()->ComputeHttpOptions(),
+                                 &output->value_, handler);
+  }
+
+  // If we're asked to, also save a debug dump
+  if (server_context_->store_outputs_in_file_system()) {
+    output->DumpToDisk(handler);
+  }
+
+  // If our URL is derived from some pre-existing URL (and not invented by
+  // us due to something like outlining), cache the mapping from original URL
+  // to the constructed one.
+  if (output->kind() == kRewrittenResource ||
+      output->kind() == kOnTheFlyResource) {
+    CachedResult* cached = output->EnsureCachedResultCreated();
+    cached->set_optimizable(true);
+    cached->set_url(output->url());  // Note: output->url() will be sharded.
+  }
 }
 
 void RewriteDriver::DetermineFiltersBehaviorImpl() {
@@ -78,6 +78,7 @@ RewriteDriverFactory::RewriteDriverFactory(
       force_caching_(false),
       slurp_read_only_(false),
       slurp_print_urls_(false),
+      use_work_stealing_worker_pools_(false),
 #ifdef NDEBUG
       // For release binaries, use the thread-system directly.
       thread_system_(thread_system),
@@ -406,6 +407,9 @@ QueuedWorkerPool* RewriteDriverFactory::WorkerPool(WorkerPoolCategory pool) {
     }
 
     worker_pools_[pool] = CreateWorkerPool(pool, name);
+    if (use_work_stealing_worker_pools_) {
+      worker_pools_[pool]->EnableWorkStealing();
+    }
     worker_pools_[pool]->set_queue_size_stat(
         rewrite_stats()->thread_queue_depth(pool));
     if (pool == kLowPriorityRewriteWorkers) {
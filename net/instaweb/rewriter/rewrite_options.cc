@@ -60,6 +60,10 @@ const char RewriteOptions::kAcceptInvalidSignatures[] =
     "AcceptInvalidSignatures";
 const char RewriteOptions::kAccessControlAllowOrigins[] =
     "AccessControlAllowOrigins";
+const char RewriteOptions::kAdaptiveFlushInitialBytes[] =
+    "AdaptiveFlushInitialBytes";
+const char RewriteOptions::kAdaptiveFlushMaxDelayMs[] =
+    "AdaptiveFlushMaxDelayMs";
 const char RewriteOptions::kAllowLoggingUrlsInLogRecord[] =
     "AllowLoggingUrlsInLogRecord";
 const char RewriteOptions::kAllowOptionsToBeSetByCookies[] =
@@ -133,6 +137,8 @@ const char RewriteOptions::kForbidAllDisabledFilters[] =
 const char RewriteOptions::kGoogleFontCssInlineMaxBytes[] =
     "GoogleFontCssInlineMaxBytes";
 const char RewriteOptions::kHideRefererUsingMeta[] = "HideRefererUsingMeta";
+const char RewriteOptions::kHttpCacheBrotliQuality[] =
+    "HttpCacheBrotliQuality";
 const char RewriteOptions::kHttpCacheCompressionLevel[] =
     "HttpCacheCompressionLevel";
 const char RewriteOptions::kHonorCsp[] = "HonorCsp";
@@ -155,6 +161,8 @@ const char RewriteOptions::kImageLimitRenderedAreaPercent[] =
 const char RewriteOptions::kImageLimitResizeAreaPercent[] =
     "ImageLimitResizeAreaPercent";
 const char RewriteOptions::kImageMaxRewritesAtOnce[] = "ImageMaxRewritesAtOnce";
+const char RewriteOptions::kImagePngMaxConcurrentEncodes[] =
+    "ImagePngMaxConcurrentEncodes";
 const char RewriteOptions::kImagePreserveURLs[] = "ImagePreserveURLs";
 const char RewriteOptions::kImageRecompressionQuality[] =
     "ImageRecompressionQuality";
@@ -191,6 +199,8 @@ const char RewriteOptions::kInlineOnlyCriticalImages[] =
 const char RewriteOptions::kJsInlineMaxBytes[] = "JsInlineMaxBytes";
 const char RewriteOptions::kJsOutlineMinBytes[] = "JsOutlineMinBytes";
 const char RewriteOptions::kJsPreserveURLs[] = "JsPreserveURLs";
+const char RewriteOptions::kJsStreamingMinifyMinBytes[] =
+    "JsStreamingMinifyMinBytes";
 const char RewriteOptions::kLazyloadImagesAfterOnload[] =
     "LazyloadImagesAfterOnload";
 const char RewriteOptions::kLazyloadImagesBlankUrl[] = "LazyloadImagesBlankUrl";
@@ -407,6 +417,7 @@ const int64 RewriteOptions::kDefaultGoogleFontCssInlineMaxBytes = 3 * 1024;
 const int64 RewriteOptions::kDefaultImageInlineMaxBytes = 3072;
 const int64 RewriteOptions::kDefaultJsInlineMaxBytes = 2048;
 const int64 RewriteOptions::kDefaultJsOutlineMinBytes = 3000;
+const int64 RewriteOptions::kDefaultJsStreamingMinifyMinBytes = 1024 * 1024;
 const int64 RewriteOptions::kDefaultProgressiveJpegMinBytes = 10240;
 
 const int64 RewriteOptions::kDefaultMaxHtmlCacheTimeMs = 0;
@@ -415,6 +426,8 @@ const int64 RewriteOptions::kDefaultMinResourceCacheTimeToRewriteMs = 0;
 
 const int64 RewriteOptions::kDefaultFlushBufferLimitBytes = 100 * 1024;
 const int64 RewriteOptions::kDefaultIdleFlushTimeMs = 10;
+const int64 RewriteOptions::kDefaultAdaptiveFlushInitialBytes = -1;
+const int64 RewriteOptions::kDefaultAdaptiveFlushMaxDelayMs = 50;
 const int64 RewriteOptions::kDefaultImplicitCacheTtlMs = 5 * Timer::kMinuteMs;
 const int64 RewriteOptions::kDefaultLoadFromFileCacheTtlMs =
     5 * Timer::kMinuteMs;
@@ -428,6 +441,10 @@ const int64 RewriteOptions::kDefaultPrioritizeVisibleContentCacheTimeMs =
 // TODO(jmaessen): Determine a sane default for this value.
 const int RewriteOptions::kDefaultImageMaxRewritesAtOnce = 8;
 
+// Trying PNG compression settings in parallel is off by default, since each
+// extra thread competes with the other image rewrites for CPU.
+const int RewriteOptions::kDefaultImagePngMaxConcurrentEncodes = 1;
+
 // IE limits URL size overall to about 2k characters.  See
 // http://support.microsoft.com/kb/208427/EN-US
 const int RewriteOptions::kDefaultMaxUrlSize = 2083;
@@ -1282,6 +1299,21 @@ void RewriteOptions::AddProperties() {
                   &RewriteOptions::flush_buffer_limit_bytes_, "fbl",
                   kFlushBufferLimitBytes, kDirectoryScope, nullptr,
                   true);  // TODO(jmarantz): implement for mod_pagespeed.
+  AddBaseProperty(
+      kDefaultAdaptiveFlushInitialBytes,
+      &RewriteOptions::adaptive_flush_initial_bytes_, "afib",
+      kAdaptiveFlushInitialBytes, kDirectoryScope,
+      "Size in bytes of the first HTML flush window in full proxy mode.  "
+      "The window doubles after each flush.  Negative values disable "
+      "adaptive flushing.",
+      true);
+  AddBaseProperty(
+      kDefaultAdaptiveFlushMaxDelayMs,
+      &RewriteOptions::adaptive_flush_max_delay_ms_, "afmd",
+      kAdaptiveFlushMaxDelayMs, kDirectoryScope,
+      "With adaptive flushing, the longest time in milliseconds that parsed "
+      "HTML is held before being flushed.",
+      true);
   AddBaseProperty(
       kDefaultImplicitCacheTtlMs, &RewriteOptions::implicit_cache_ttl_ms_,
       "ict", kImplicitCacheTtlMs, kDirectoryScope,
@@ -1302,6 +1334,13 @@ void RewriteOptions::AddProperties() {
                   "Set bound on number of images being rewritten at one time "
                   "(0 = unbounded).",
                   true);
+  AddBaseProperty(kDefaultImagePngMaxConcurrentEncodes,
+                  &RewriteOptions::image_png_max_concurrent_encodes_, "ipce",
+                  kImagePngMaxConcurrentEncodes, kProcessScopeStrict,
+                  "Maximum number of threads used to try PNG compression "
+                  "settings for one image, when the image rewrite bound "
+                  "leaves room for them.",
+                  true);
   AddBaseProperty(kDefaultMaxUrlSegmentSize,
                   &RewriteOptions::max_url_segment_size_, "uss",
                   kMaxUrlSegmentSize, kDirectoryScope,
@@ -1576,6 +1615,12 @@ void RewriteOptions::AddProperties() {
       "Compression level for HTTPCache. [-1-9] where 0 is off, 1 is minimum"
       "compression, and 9 (the default) is maximum compression.",
       true);
+  AddBaseProperty(
+      0, &RewriteOptions::http_cache_brotli_quality_, "hcbq",
+      kHttpCacheBrotliQuality, kServerScope,
+      "Brotli quality for the pre-compressed copies of rewritten resources "
+      "stored in HTTPCache. [0-11] where 0 (the default) stores none.",
+      true);
   AddBaseProperty(
       "", &RewriteOptions::lazyload_images_blank_url_, "llbu",
       kLazyloadImagesBlankUrl, kDirectoryScope,
@@ -1853,6 +1898,13 @@ void RewriteOptions::AddProperties() {
       "This option will be deprecated once we do a successful release with the "
       "new minifier.",
       true);
+  AddBaseProperty(
+      kDefaultJsStreamingMinifyMinBytes,
+      &RewriteOptions::js_streaming_minify_min_bytes_, "jsmb",
+      kJsStreamingMinifyMinBytes, kDirectoryScope,
+      "External scripts of at least this many bytes are minified "
+      "incrementally, to bound memory use.  Negative disables this.",
+      true);
   AddBaseProperty(kDefaultMaxCombinedCssBytes,
                   &RewriteOptions::max_combined_css_bytes_, "xcc",
                   kMaxCombinedCssBytes, kQueryScope,
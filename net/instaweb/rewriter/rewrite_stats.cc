@@ -40,6 +40,8 @@ const char kResourceFetchConstructSuccesses[] =
 const char kResourceFetchConstructFailures[] =
     "resource_fetch_construct_failures";
 const char kNumFlushes[] = "num_flushes";
+// Number of metadata cache lookups issued in batches by RewriteDriver.
+const char kMetadataCacheBatchedLookups[] = "metadata_cache_batched_lookups";
 const char kFallbackResponsesServed[] = "num_fallback_responses_served";
 const char kProactivelyFreshenUserFacingRequest[] =
     "num_proactively_freshen_user_facing_request";
@@ -72,6 +74,8 @@ const char kFetchLatencyHistogram[] = "Pagespeed Resource Latency Histogram";
 const char kRewriteLatencyHistogram[] = "Rewrite Latency Histogram";
 const char kBackendLatencyHistogram[] =
     "Backend Fetch First Byte Latency Histogram";
+const char kMetadataCacheBatchSizeHistogram[] =
+    "Metadata Cache Lookups Per Batch";
 
 // TimedVariable names.
 const char kTotalFetchCount[] = "total_fetch_count";
@@ -123,10 +127,12 @@ void RewriteStats::InitStats(Statistics* statistics) {
   statistics->AddVariable(kNumCacheControlRewritableResources);
   statistics->AddVariable(kNumCacheControlNotRewritableResources);
   statistics->AddVariable(kNumFlushes);
+  statistics->AddVariable(kMetadataCacheBatchedLookups);
   statistics->AddHistogram(kBeaconTimingsMsHistogram);
   statistics->AddHistogram(kFetchLatencyHistogram);
   statistics->AddHistogram(kRewriteLatencyHistogram);
   statistics->AddHistogram(kBackendLatencyHistogram);
+  statistics->AddHistogram(kMetadataCacheBatchSizeHistogram);
   statistics->AddVariable(kFallbackResponsesServed);
   statistics->AddVariable(kProactivelyFreshenUserFacingRequest);
   statistics->AddVariable(kFallbackResponsesServedWhileRevalidate);
@@ -167,6 +173,8 @@ RewriteStats::RewriteStats(bool has_waveforms, Statistics* stats,
       num_cache_control_not_rewritable_resources_(
           stats->GetVariable(kNumCacheControlNotRewritableResources)),
       num_flushes_(stats->GetVariable(kNumFlushes)),
+      metadata_cache_batched_lookups_(
+          stats->GetVariable(kMetadataCacheBatchedLookups)),
       page_load_count_(stats->GetVariable(kPageLoadCount)),
       resource_404_count_(stats->GetVariable(kInstawebResource404Count)),
       resource_url_domain_acceptances_(
@@ -195,6 +203,8 @@ RewriteStats::RewriteStats(bool has_waveforms, Statistics* stats,
       fetch_latency_histogram_(stats->GetHistogram(kFetchLatencyHistogram)),
       rewrite_latency_histogram_(stats->GetHistogram(kRewriteLatencyHistogram)),
       backend_latency_histogram_(stats->GetHistogram(kBackendLatencyHistogram)),
+      metadata_cache_batch_size_histogram_(
+          stats->GetHistogram(kMetadataCacheBatchSizeHistogram)),
       total_fetch_count_(stats->GetTimedVariable(kTotalFetchCount)),
       total_rewrite_count_(stats->GetTimedVariable(kTotalRewriteCount)),
       num_rewrites_executed_(stats->GetTimedVariable(kRewritesExecuted)),
@@ -115,6 +115,7 @@ const char kModPagespeedAllow[] = "ModPagespeedAllow";
 const char kModPagespeedBlockingRewriteRefererUrls[] =
     "ModPagespeedBlockingRewriteRefererUrls";
 const char kModPagespeedConsoleDomains[] = "ModPagespeedConsoleDomains";
+const char kModPagespeedContentHasher[] = "ModPagespeedContentHasher";
 const char kModPagespeedCreateSharedMemoryMetadataCache[] =
     "ModPagespeedCreateSharedMemoryMetadataCache";
 const char kModPagespeedAddResourceHeader[] = "ModPagespeedAddResourceHeader";
@@ -174,6 +175,8 @@ const char kModPagespeedTrackOriginalContentLength[] =
 const char kModPagespeedUrlValuedAttribute[] = "ModPagespeedUrlValuedAttribute";
 const char kModPagespeedUsePerVHostStatistics[] =
     "ModPagespeedUsePerVHostStatistics";
+const char kModPagespeedWorkStealingThreadPools[] =
+    "ModPagespeedWorkStealingThreadPools";
 
 // The following are deprecated due to spelling
 const char kModPagespeedImgInlineMaxBytes[] = "ModPagespeedImgInlineMaxBytes";
@@ -1752,6 +1755,9 @@ static const command_rec mod_pagespeed_filter_cmds[] = {
 
     // All one parameter options that can only be specified at the server level.
     // (Not in <Directory> blocks.)
+    APACHE_CONFIG_OPTION(
+        kModPagespeedContentHasher,
+        "Hash for resource URLs and cache keys: md5 (default) or xxh3"),
     APACHE_CONFIG_OPTION(kModPagespeedFetcherTimeoutMs,
                          "Set internal fetcher timeout in milliseconds"),
     APACHE_CONFIG_OPTION(kModPagespeedFetchProxy, "Set the fetch proxy"),
@@ -1780,6 +1786,9 @@ static const command_rec mod_pagespeed_filter_cmds[] = {
     APACHE_CONFIG_OPTION(
         kModPagespeedUsePerVHostStatistics,
         "If true, keep track of statistics per VHost and not just globally"),
+    APACHE_CONFIG_OPTION(
+        kModPagespeedWorkStealingThreadPools,
+        "If true, give each rewrite thread its own work queue"),
     APACHE_CONFIG_OPTION(
         kModPagespeedBlockingRewriteRefererUrls,
         "wildcard_spec for referer urls which trigger blocking "
@@ -43,6 +43,7 @@
 #include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/ref_counted_ptr.h"
 #include "pagespeed/kernel/base/request_trace.h"
+#include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/stl_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
@@ -74,10 +75,19 @@ const char ProxyFetch::kHeadersSetupRaceFlush[] = "HeadersSetupRace:Flush";
 const char ProxyFetch::kHeadersSetupRacePrefix[] = "HeadersSetupRace:";
 const char ProxyFetch::kHeadersSetupRaceWait[] = "HeadersSetupRace:Wait";
 
+const char ProxyFetchFactory::kHtmlFirstByteLatencyMsHistogram[] =
+    "proxy-fetch-html-first-byte-latency-ms";
+const char ProxyFetchFactory::kAdaptiveHtmlFlushes[] =
+    "proxy-fetch-adaptive-html-flushes";
+
 ProxyFetchFactory::ProxyFetchFactory(ServerContext* server_context)
     : server_context_(server_context),
       timer_(server_context->timer()),
       handler_(server_context->message_handler()),
+      html_first_byte_latency_ms_(server_context->statistics()->FindHistogram(
+          kHtmlFirstByteLatencyMsHistogram)),
+      adaptive_html_flushes_(
+          server_context->statistics()->FindVariable(kAdaptiveHtmlFlushes)),
       outstanding_proxy_fetches_mutex_(
           server_context->thread_system()->NewMutex()) {}
 
@@ -90,6 +100,11 @@ ProxyFetchFactory::~ProxyFetchFactory() {
             << outstanding_proxy_fetches_.size() << " outstanding requests.";
 }
 
+void ProxyFetchFactory::InitStats(Statistics* statistics) {
+  statistics->AddHistogram(kHtmlFirstByteLatencyMsHistogram);
+  statistics->AddVariable(kAdaptiveHtmlFlushes);
+}
+
 ProxyFetch* ProxyFetchFactory::CreateNewProxyFetch(
     const GoogleString& url_in, AsyncFetch* async_fetch, RewriteDriver* driver,
     ProxyFetchPropertyCallbackCollector* property_callback,
@@ -468,6 +483,34 @@ void ProxyFetchPropertyCallbackCollector::ExecuteAddPostLookupTask(
   post_lookup_task_vector_.push_back(func);
 }
 
+// Passes the driver's output through to the client, telling the ProxyFetch
+// when the first byte goes out.  The driver serializes its calls, so
+// first_byte_sent_ needs no lock.
+class ProxyFetch::DownstreamWriter : public Writer {
+ public:
+  DownstreamWriter(ProxyFetch* proxy_fetch, Writer* writer)
+      : proxy_fetch_(proxy_fetch), writer_(writer), first_byte_sent_(false) {}
+
+  bool Write(const StringPiece& str, MessageHandler* handler) override {
+    if (!first_byte_sent_ && !str.empty()) {
+      first_byte_sent_ = true;
+      proxy_fetch_->FirstByteSent();
+    }
+    return writer_->Write(str, handler);
+  }
+
+  bool Flush(MessageHandler* handler) override {
+    return writer_->Flush(handler);
+  }
+
+ private:
+  ProxyFetch* proxy_fetch_;
+  Writer* writer_;
+  bool first_byte_sent_;
+
+  DISALLOW_COPY_AND_ASSIGN(DownstreamWriter);
+};
+
 ProxyFetch::ProxyFetch(
     const GoogleString& url, bool cross_domain,
     ProxyFetchPropertyCallbackCollector* property_cache_callback,
@@ -486,6 +529,8 @@ ProxyFetch::ProxyFetch(
       property_cache_callback_(property_cache_callback),
       original_content_fetch_(original_content_fetch),
       driver_(driver),
+      downstream_writer_(new DownstreamWriter(this, async_fetch)),
+      start_time_ms_(timer->NowMs()),
       queue_run_job_created_(false),
       mutex_(server_context->thread_system()->NewMutex()),
       network_flush_outstanding_(false),
@@ -495,9 +540,12 @@ ProxyFetch::ProxyFetch(
       done_result_(false),
       waiting_for_flush_to_finish_(false),
       idle_alarm_(nullptr),
+      adaptive_flush_window_bytes_(0),
+      unflushed_bytes_(0),
+      unflushed_since_ms_(-1),
       factory_(factory),
       trusted_input_(false) {
-  driver_->SetWriter(async_fetch);
+  driver_->SetWriter(downstream_writer_.get());
   set_request_headers(async_fetch->request_headers());
   set_response_headers(async_fetch->response_headers());
 
@@ -509,6 +557,12 @@ ProxyFetch::ProxyFetch(
   response_headers()->set_implicit_cache_ttl_ms(
       Options()->implicit_cache_ttl_ms());
 
+  if (Options()->adaptive_flush_initial_bytes() > 0) {
+    adaptive_flush_window_bytes_ =
+        std::min(Options()->adaptive_flush_initial_bytes(),
+                 Options()->flush_buffer_limit_bytes());
+  }
+
   VLOG(1) << "Attaching RewriteDriver " << driver_ << " to HtmlRewriter "
           << this;
 }
@@ -891,8 +945,14 @@ bool ProxyFetch::HandleWrite(const StringPiece& str,
     // to run. Also split up HTML into manageable chunks if we get a burst,
     // as it will make it easier to insert flushes in between them in
     // ExecuteQueued(), which we want to do in order to limit memory use and
-    // latency.
+    // latency.  With adaptive flushing, use chunks no bigger than the initial
+    // window, so the first flush can be made as soon as it fills.
     size_t chunk_size = Options()->flush_buffer_limit_bytes();
+    if (Options()->adaptive_flush_initial_bytes() > 0) {
+      chunk_size = std::min(
+          chunk_size,
+          static_cast<size_t>(Options()->adaptive_flush_initial_bytes()));
+    }
     StringStarVector chunks;
     for (size_t pos = 0; pos < str.size(); pos += chunk_size) {
       GoogleString* buffer = new GoogleString(
@@ -999,6 +1059,7 @@ void ProxyFetch::ExecuteQueued() {
   bool do_finish = false;
   bool done_result = false;
   bool force_flush = false;
+  bool adaptive_flush = false;
 
   size_t buffer_limit = Options()->flush_buffer_limit_bytes();
   StringStarVector v;
@@ -1006,18 +1067,34 @@ void ProxyFetch::ExecuteQueued() {
     ScopedMutex lock(mutex_.get());
     DCHECK(!waiting_for_flush_to_finish_);
 
+    // With adaptive flushing, flush once the current window fills, counting
+    // what we've already parsed since the last flush.
+    size_t flush_limit = buffer_limit;
+    if (adaptive_flush_window_bytes_ > 0) {
+      if (!text_queue_.empty() && (unflushed_since_ms_ < 0)) {
+        unflushed_since_ms_ = timer_->NowMs();
+      }
+      flush_limit = std::max(static_cast<int64>(1),
+                             adaptive_flush_window_bytes_ - unflushed_bytes_);
+    }
+
     size_t total = 0;
     size_t force_flush_chunk_count = 0;  // set only if force_flush is true.
     if (network_flush_outstanding_ && Options()->follow_flushes()) {
       force_flush = true;
       force_flush_chunk_count = text_queue_.size();
+    } else if (AdaptiveFlushDeadlinePassed()) {
+      force_flush = true;
+      adaptive_flush = true;
+      force_flush_chunk_count = text_queue_.size();
     } else {
       // See if we should force a flush based on how much stuff has
       // accumulated.
       for (size_t c = 0, n = text_queue_.size(); c < n; ++c) {
         total += text_queue_[c]->length();
-        if (total >= buffer_limit) {
+        if (total >= flush_limit) {
           force_flush = true;
+          adaptive_flush = (flush_limit < buffer_limit);
           force_flush_chunk_count = c + 1;
           break;
         }
@@ -1068,6 +1145,7 @@ void ProxyFetch::ExecuteQueued() {
   for (int i = 0, n = v.size(); i < n; ++i) {
     GoogleString* str = v[i];
     driver_->ParseText(*str);
+    unflushed_bytes_ += str->size();
     delete str;
   }
   if (do_flush) {
@@ -1078,6 +1156,15 @@ void ProxyFetch::ExecuteQueued() {
       // A flush is about to happen, so we don't want to redundantly
       // flush due to idleness.
       CancelIdleAlarm();
+      if (adaptive_flush_window_bytes_ > 0) {
+        if (adaptive_flush && (factory_->adaptive_html_flushes_ != nullptr)) {
+          factory_->adaptive_html_flushes_->Add(1);
+        }
+        adaptive_flush_window_bytes_ = std::min(
+            2 * adaptive_flush_window_bytes_, static_cast<int64>(buffer_limit));
+        unflushed_bytes_ = 0;
+        unflushed_since_ms_ = -1;
+      }
     } else {
       // We will not actually flush, just run through the state-machine, so
       // we want to just advance the idleness timeout.
@@ -1168,14 +1255,30 @@ void ProxyFetch::CancelIdleAlarm() {
 
 void ProxyFetch::QueueIdleAlarm() {
   const RewriteOptions* options = Options();
-  if (!options->flush_html() || (options->idle_flush_time_ms() <= 0)) {
+  int64 wakeup_time_us = -1;
+  if (options->flush_html() && (options->idle_flush_time_ms() > 0)) {
+    wakeup_time_us =
+        timer_->NowUs() + options->idle_flush_time_ms() * Timer::kMsUs;
+  }
+
+  // Don't let the idle timeout push back the adaptive flush deadline.
+  if ((adaptive_flush_window_bytes_ > 0) &&
+      (options->adaptive_flush_max_delay_ms() > 0) &&
+      (unflushed_since_ms_ >= 0)) {
+    int64 deadline_us =
+        (unflushed_since_ms_ + options->adaptive_flush_max_delay_ms()) *
+        Timer::kMsUs;
+    if ((wakeup_time_us < 0) || (deadline_us < wakeup_time_us)) {
+      wakeup_time_us = deadline_us;
+    }
+  }
+  if (wakeup_time_us < 0) {
     return;
   }
 
   CancelIdleAlarm();
   idle_alarm_ = new QueuedAlarm(
-      driver_->scheduler(), sequence_,
-      timer_->NowUs() + Options()->idle_flush_time_ms() * Timer::kMsUs,
+      driver_->scheduler(), sequence_, wakeup_time_us,
       MakeFunction(this, &ProxyFetch::HandleIdleAlarm));
 
   // In ProxyInterfaceTest.HeadersSetupRace, raise a signal that
@@ -1193,12 +1296,42 @@ void ProxyFetch::HandleIdleAlarm() {
     return;
   }
 
+  if (AdaptiveFlushDeadlinePassed()) {
+    // ExecuteQueued will notice the deadline and flush whatever we have.
+    driver_->ShowProgress("- Flush injected due to adaptive flush delay -");
+    ScopedMutex lock(mutex_.get());
+    ScheduleQueueExecutionIfNeeded();
+    return;
+  }
+
+  const RewriteOptions* options = Options();
+  if (!options->flush_html() || (options->idle_flush_time_ms() <= 0)) {
+    // Only the adaptive flush deadline was set, and it hasn't passed yet.
+    QueueIdleAlarm();
+    return;
+  }
+
   // Inject an own flush, and queue up its dispatch.
   driver_->ShowProgress("- Flush injected due to input idleness -");
   driver_->RequestFlush();
   Flush(factory_->message_handler());
 }
 
+bool ProxyFetch::AdaptiveFlushDeadlinePassed() const {
+  int64 max_delay_ms = driver_->options()->adaptive_flush_max_delay_ms();
+  return ((adaptive_flush_window_bytes_ > 0) && (max_delay_ms > 0) &&
+          (unflushed_since_ms_ >= 0) &&
+          (timer_->NowMs() >= unflushed_since_ms_ + max_delay_ms));
+}
+
+void ProxyFetch::FirstByteSent() {
+  request_context()->mutable_timing_info()->FirstByteReturned();
+  Histogram* latency = factory_->html_first_byte_latency_ms_;
+  if (latency != nullptr) {
+    latency->Add(timer_->NowMs() - start_time_ms_);
+  }
+}
+
 namespace {
 
 bool UrlMightHavePropertyCacheEntry(const GoogleUrl& url) {
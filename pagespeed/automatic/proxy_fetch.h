@@ -41,6 +41,7 @@
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/writer.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/response_headers.h"
 #include "pagespeed/kernel/http/user_agent_matcher.h"
@@ -50,6 +51,7 @@ namespace net_instaweb {
 
 class CacheUrlAsyncFetcher;
 class GoogleUrl;
+class Histogram;
 class MessageHandler;
 class ProxyFetch;
 class ProxyFetchPropertyCallbackCollector;
@@ -57,15 +59,25 @@ class QueuedAlarm;
 class ServerContext;
 class RewriteDriver;
 class RewriteOptions;
+class Statistics;
 class Timer;
+class Variable;
 
 // Factory for creating and starting ProxyFetches. Must outlive all
 // ProxyFetches it creates.
 class ProxyFetchFactory {
  public:
+  // Names for Statistics variables.
+  static const char kHtmlFirstByteLatencyMsHistogram[];
+  static const char kAdaptiveHtmlFlushes[];
+
   explicit ProxyFetchFactory(ServerContext* server_context);
   ~ProxyFetchFactory();
 
+  // Initializes statistics variables associated with this class.  If they
+  // were not initialized, ProxyFetches simply don't record them.
+  static void InitStats(Statistics* statistics);
+
   // Convenience method that calls CreateNewProxyFetch and then StartFetch() on
   // the resulting fetch.
   void StartNewProxyFetch(
@@ -110,6 +122,13 @@ class ProxyFetchFactory {
   Timer* timer_;
   MessageHandler* handler_;
 
+  // Time from the start of a ProxyFetch until its first byte of rewritten
+  // HTML was sent downstream.  NULL if InitStats was not called.
+  Histogram* html_first_byte_latency_ms_;
+  // Number of flushes introduced by the adaptive flush window.  NULL if
+  // InitStats was not called.
+  Variable* adaptive_html_flushes_;
+
   std::unique_ptr<AbstractMutex> outstanding_proxy_fetches_mutex_;
   std::set<ProxyFetch*> outstanding_proxy_fetches_;
 
@@ -355,6 +374,8 @@ class ProxyFetch : public SharedAsyncFetch {
   FRIEND_TEST(ProxyFetchTest, TestInhibitParsing);
   FRIEND_TEST(ProxyFetchTest, TestFollowFlushes);
 
+  class DownstreamWriter;
+
   // Called by ProxyFetchPropertyCallbackCollector when all property-cache
   // fetches are complete.  This function takes ownership of collector.
   virtual void PropertyCacheComplete(
@@ -422,6 +443,13 @@ class ProxyFetch : public SharedAsyncFetch {
   // Handler for the alarm; run in sequence_.
   void HandleIdleAlarm();
 
+  // Whether HTML parsed since the last flush has been held for
+  // adaptive_flush_max_delay_ms.  Must only be called from within sequence_.
+  bool AdaptiveFlushDeadlinePassed() const;
+
+  // Called by downstream_writer_ when the driver first writes rewritten HTML.
+  void FirstByteSent();
+
   GoogleString url_;
   ServerContext* server_context_;
   Timer* timer_;
@@ -462,6 +490,11 @@ class ProxyFetch : public SharedAsyncFetch {
   // putting them back.
   RewriteDriver* driver_;
 
+  // Passes the driver's output through to base_fetch(), noting when the
+  // first byte is sent.
+  std::unique_ptr<DownstreamWriter> downstream_writer_;
+  int64 start_time_ms_;
+
   // True if we have queued up ExecuteQueued but did not
   // execute it yet.
   bool queue_run_job_created_;
@@ -503,6 +536,17 @@ class ProxyFetch : public SharedAsyncFetch {
   // flushes. Must only be accessed from the thread context of sequence_
   QueuedAlarm* idle_alarm_;
 
+  // Adaptive flushing state.  adaptive_flush_window_bytes_ is 0 if adaptive
+  // flushing is disabled; otherwise it is the number of bytes we parse
+  // before introducing a flush, and doubles after each flush up to
+  // flush_buffer_limit_bytes.  unflushed_bytes_ counts what has been queued
+  // for parsing since the last flush, and unflushed_since_ms_ is when the
+  // first of those bytes was queued, or -1 if there are none.  Must only be
+  // accessed from the thread context of sequence_.
+  int64 adaptive_flush_window_bytes_;
+  int64 unflushed_bytes_;
+  int64 unflushed_since_ms_;
+
   ProxyFetchFactory* factory_;
 
   // Set to true if this proxy_fetch is actually operating on trusted
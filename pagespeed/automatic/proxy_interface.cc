@@ -114,6 +114,7 @@ void ProxyInterface::InitStats(StringPiece stats_prefix,
   statistics->AddTimedVariable(
       StrCat(stats_prefix, kNoDomainConfigResourceRequestCount),
       Statistics::kDefaultGroup);
+  ProxyFetchFactory::InitStats(statistics);
 }
 
 bool ProxyInterface::IsWellFormedUrl(const GoogleUrl& url) {
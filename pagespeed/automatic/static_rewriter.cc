@@ -123,6 +123,8 @@ void FileRewriter::SetupCaches(ServerContext* server_context) {
   HTTPCache* http_cache = new HTTPCache(cache, timer(), hasher(), stats);
   http_cache->SetCompressionLevel(
       server_context->global_options()->http_cache_compression_level());
+  http_cache->SetBrotliQuality(
+      server_context->global_options()->http_cache_brotli_quality());
   server_context->set_http_cache(http_cache);
   server_context->set_metadata_cache(cache);
   server_context->MakePagePropertyCache(
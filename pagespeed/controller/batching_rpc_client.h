@@ -0,0 +1,345 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PAGESPEED_CONTROLLER_BATCHING_RPC_CLIENT_H_
+#define PAGESPEED_CONTROLLER_BATCHING_RPC_CLIENT_H_
+
+#include <memory>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/controller/controller.grpc.pb.h"
+#include "pagespeed/controller/request_result_rpc_client.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/ref_counted_ptr.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/util/grpc.h"
+
+// BatchingRpcClient manages the client side of a long-lived gRPC stream that
+// carries many operations at once. See class comments below.
+
+namespace net_instaweb {
+
+// Where RequestResultRpcClient makes one RPC per operation, BatchingRpcClient
+// keeps a single bi-directional stream open and lets the subclass multiplex
+// any number of operations over it. The subclass accumulates whatever it needs
+// to tell the server and calls MaybeWrite(). If no Write is in flight, that is
+// sent right away, otherwise it goes out, along with everything else that
+// accumulated, as soon as the in-flight Write completes. So, a lightly loaded
+// client sends each operation as soon as it arrives, and a busy one coalesces
+// them into fewer, larger messages without ever waiting on a timer.
+//
+// A Read is always outstanding, and every message from the server is passed to
+// HandleResponse(). Once anything goes wrong with the stream, HandleFailure()
+// is called and the stream is torn down; the owner must notice HasFailed() and
+// start a new one. Since everything is guarded by a single mutex, the
+// subclass must not invoke callbacks from the hooks, but instead add them to
+// the supplied vectors, which are run or cancelled once the lock is dropped.
+//
+// Instances are reference counted. Outstanding gRPC operations hold a
+// reference, as should any transaction contexts that need to call back in.
+template <typename RequestT, typename ResponseT>
+class BatchingRpcClient
+    : public RefCounted<BatchingRpcClient<RequestT, ResponseT>> {
+ public:
+  typedef ::grpc::ClientAsyncReaderWriterInterface<RequestT, ResponseT>
+      ReaderWriter;
+
+  // Actually start the RPC by having the client call RequestFoo on the stub.
+  // Operations may be queued up before the stream is ready, they will be sent
+  // once it is.
+  void Start(CentralControllerRpcService::StubInterface* stub)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Has the stream broken? Once this returns true, it always will.
+  bool HasFailed() LOCKS_EXCLUDED(mutex_);
+
+ protected:
+  typedef RefCountedPtr<BatchingRpcClient> RefPtr;
+  typedef std::vector<Function*> FunctionVector;
+
+  BatchingRpcClient(::grpc::CompletionQueue* queue,
+                    ThreadSystem* thread_system, MessageHandler* handler);
+  REFCOUNT_FRIEND_DECLARATION(BatchingRpcClient);
+  virtual ~BatchingRpcClient();
+
+  // Call this after accumulating something for the server.
+  void MaybeWrite() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  bool HasFailedLocked() const EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return state_ == FAILED;
+  }
+
+  MessageHandler* handler() { return handler_; }
+
+  const std::unique_ptr<AbstractMutex> mutex_;
+
+ private:
+  enum State {
+    STARTING,
+    RUNNING,
+    FAILED,
+  };
+
+  // Delegate for the client to call AsyncFoo for the appropriate RPC on the
+  // stub.
+  virtual std::unique_ptr<ReaderWriter> StartRpc(
+      CentralControllerRpcService::StubInterface* stub,
+      ::grpc::ClientContext* context, ::grpc::CompletionQueue* queue,
+      void* tag) = 0;
+
+  // Move everything that has accumulated for the server into request.
+  // Returns false if there is nothing to send.
+  virtual bool PopulateRequest(RequestT* request)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_) = 0;
+
+  // Process a message from the server, adding to to_run and to_cancel any
+  // callbacks that should now be run or cancelled.
+  virtual void HandleResponse(const ResponseT& response, FunctionVector* to_run,
+                              FunctionVector* to_cancel)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_) = 0;
+
+  // The stream is gone. Add every callback still waiting on the server to
+  // to_cancel and drop anything that has accumulated. The server has released
+  // all resources held on behalf of this stream, so later attempts to hand
+  // them back should be ignored.
+  virtual void HandleFailure(FunctionVector* to_cancel)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_) = 0;
+
+  // gRPC completion handlers. These all expect to be passed a RefPtr to
+  // ensure that "this" can't be deleted while gRPC operations are pending.
+  void StartDone(RefPtr ref) LOCKS_EXCLUDED(mutex_);
+  void StartFailed(RefPtr ref) LOCKS_EXCLUDED(mutex_);
+  void WriteDone(RefPtr ref) LOCKS_EXCLUDED(mutex_);
+  void WriteFailed(RefPtr ref) LOCKS_EXCLUDED(mutex_);
+  void ReadDone(RefPtr ref) LOCKS_EXCLUDED(mutex_);
+  void ReadFailed(RefPtr ref) LOCKS_EXCLUDED(mutex_);
+
+  // Common code for the *Failed handlers, which have already cleared the
+  // outstanding flag for their operation.
+  void OperationFailed(const char* message) LOCKS_EXCLUDED(mutex_);
+
+  void StartRead() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Mark the stream as broken and cancel any outstanding gRPC operations.
+  void Fail(FunctionVector* to_cancel) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Once the stream is broken and nothing is outstanding, detach the rpc and
+  // call Finish to get (log) the error code in the background.
+  void MaybeFinish() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  static void RunCallbacks(const FunctionVector& to_run,
+                           const FunctionVector& to_cancel);
+
+  ::grpc::CompletionQueue* queue_;
+  MessageHandler* handler_;
+  State state_ GUARDED_BY(mutex_);
+  bool read_outstanding_ GUARDED_BY(mutex_);
+  bool write_outstanding_ GUARDED_BY(mutex_);
+  std::unique_ptr<RpcHolder<ReaderWriter>> rpc_ GUARDED_BY(mutex_);
+  // gRPC requires both of these to stay put until the operation completes.
+  RequestT request_ GUARDED_BY(mutex_);
+  ResponseT response_ GUARDED_BY(mutex_);
+
+  DISALLOW_COPY_AND_ASSIGN(BatchingRpcClient);
+};
+
+template <typename RequestT, typename ResponseT>
+BatchingRpcClient<RequestT, ResponseT>::BatchingRpcClient(
+    ::grpc::CompletionQueue* queue, ThreadSystem* thread_system,
+    MessageHandler* handler)
+    : mutex_(thread_system->NewMutex()),
+      queue_(queue),
+      handler_(handler),
+      state_(STARTING),
+      read_outstanding_(false),
+      write_outstanding_(false),
+      rpc_(new RpcHolder<ReaderWriter>(handler)) {}
+
+template <typename RequestT, typename ResponseT>
+BatchingRpcClient<RequestT, ResponseT>::~BatchingRpcClient() {
+  // If Start() was called, the stream holds a reference to us until it has
+  // been torn down, so rpc_ should be gone unless we were never started.
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::Start(
+    CentralControllerRpcService::StubInterface* stub) {
+  ScopedMutex lock(mutex_.get());
+  DCHECK_EQ(state_, STARTING);
+  rpc_->SetReaderWriter(StartRpc(
+      stub, rpc_->context(), queue_,
+      MakeFunction(this, &BatchingRpcClient::StartDone,
+                   &BatchingRpcClient::StartFailed, RefPtr(this))));
+}
+
+template <typename RequestT, typename ResponseT>
+bool BatchingRpcClient<RequestT, ResponseT>::HasFailed() {
+  ScopedMutex lock(mutex_.get());
+  return HasFailedLocked();
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::StartDone(RefPtr ref) {
+  ScopedMutex lock(mutex_.get());
+  if (state_ != STARTING) {
+    return;
+  }
+  state_ = RUNNING;
+  StartRead();
+  // Send anything that was queued up while we were connecting.
+  MaybeWrite();
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::MaybeWrite() {
+  if (state_ != RUNNING || write_outstanding_) {
+    return;
+  }
+  request_.Clear();
+  if (!PopulateRequest(&request_)) {
+    return;
+  }
+  write_outstanding_ = true;
+  rpc_->rw()->Write(request_,
+                    MakeFunction(this, &BatchingRpcClient::WriteDone,
+                                 &BatchingRpcClient::WriteFailed,
+                                 RefPtr(this)));
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::WriteDone(RefPtr ref) {
+  ScopedMutex lock(mutex_.get());
+  write_outstanding_ = false;
+  if (state_ == FAILED) {
+    MaybeFinish();
+  } else {
+    // Anything that accumulated while that Write was in flight goes now.
+    MaybeWrite();
+  }
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::StartRead() {
+  read_outstanding_ = true;
+  rpc_->rw()->Read(&response_,
+                   MakeFunction(this, &BatchingRpcClient::ReadDone,
+                                &BatchingRpcClient::ReadFailed,
+                                RefPtr(this)));
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::ReadDone(RefPtr ref) {
+  FunctionVector to_run;
+  FunctionVector to_cancel;
+  {
+    ScopedMutex lock(mutex_.get());
+    read_outstanding_ = false;
+    if (state_ == FAILED) {
+      MaybeFinish();
+    } else {
+      HandleResponse(response_, &to_run, &to_cancel);
+      StartRead();
+    }
+    response_.Clear();
+  }
+  RunCallbacks(to_run, to_cancel);
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::StartFailed(RefPtr ref) {
+  OperationFailed("Couldn't connect to CentralController");
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::WriteFailed(RefPtr ref) {
+  {
+    ScopedMutex lock(mutex_.get());
+    write_outstanding_ = false;
+  }
+  OperationFailed("Couldn't send to CentralController");
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::ReadFailed(RefPtr ref) {
+  {
+    ScopedMutex lock(mutex_.get());
+    read_outstanding_ = false;
+  }
+  OperationFailed("Couldn't get response from CentralController");
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::OperationFailed(
+    const char* message) {
+  FunctionVector to_cancel;
+  {
+    ScopedMutex lock(mutex_.get());
+    // Only the first failure is interesting, the rest are the fallout from
+    // the TryCancel in Fail.
+    if (state_ != FAILED) {
+      PS_LOG_WARN(handler_, "%s", message);
+    }
+    Fail(&to_cancel);
+  }
+  RunCallbacks(FunctionVector(), to_cancel);
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::Fail(FunctionVector* to_cancel) {
+  if (state_ != FAILED) {
+    state_ = FAILED;
+    HandleFailure(to_cancel);
+    if (read_outstanding_ || write_outstanding_) {
+      // Make sure the other operation completes promptly. Its completion will
+      // call MaybeFinish again.
+      rpc_->context()->TryCancel();
+    }
+  }
+  MaybeFinish();
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::MaybeFinish() {
+  DCHECK_EQ(state_, FAILED);
+  if (rpc_ != nullptr && !read_outstanding_ && !write_outstanding_) {
+    // RpcHolder deletes itself once Finish completes, at which point the
+    // ClientContext leaves the registry.
+    rpc_.release()->Finish();
+  }
+}
+
+template <typename RequestT, typename ResponseT>
+void BatchingRpcClient<RequestT, ResponseT>::RunCallbacks(
+    const FunctionVector& to_run, const FunctionVector& to_cancel) {
+  for (Function* callback : to_run) {
+    callback->CallRun();
+  }
+  for (Function* callback : to_cancel) {
+    callback->CallCancel();
+  }
+}
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_CONTROLLER_BATCHING_RPC_CLIENT_H_
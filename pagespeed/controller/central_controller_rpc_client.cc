@@ -24,8 +24,6 @@
 #include "base/logging.h"
 #include "pagespeed/controller/central_controller_rpc_server.h"
 #include "pagespeed/controller/context_registry.h"
-#include "pagespeed/controller/expensive_operation_rpc_context.h"
-#include "pagespeed/controller/schedule_rewrite_rpc_context.h"
 #include "pagespeed/kernel/base/thread.h"
 
 namespace net_instaweb {
@@ -108,8 +106,8 @@ class CentralControllerRpcClient::ClientRegistry
 
 CentralControllerRpcClient::CentralControllerRpcClient(
     const GoogleString& server_address, int max_outstanding_requests,
-    ThreadSystem* thread_system, Timer* timer, Statistics* statistics,
-    MessageHandler* handler)
+    int idle_expensive_operation_tokens, ThreadSystem* thread_system,
+    Timer* timer, Statistics* statistics, MessageHandler* handler)
     : thread_system_(thread_system),
       timer_(timer),
       mutex_(thread_system_->NewMutex()),
@@ -119,6 +117,7 @@ CentralControllerRpcClient::CentralControllerRpcClient(
       // Fudge max_outstanding_requests a bit, just in case we're
       // single-process. We'd rather not panic unnecessarily.
       controller_panic_threshold_(max_outstanding_requests + 10),
+      idle_expensive_operation_tokens_(idle_expensive_operation_tokens),
       reconnect_time_ms_(0),
       reconnect_time_ms_statistic_(
           statistics->GetUpDownCounter(kControllerReconnectTimeStatistic)),
@@ -157,11 +156,19 @@ void CentralControllerRpcClient::ShutDown() {
 
     // This will reject all further requests.
     state_ = SHUTDOWN;
+    // Hand back idle tokens before the stream is cancelled below. The server
+    // reclaims them either way, but if the release gets there first other
+    // processes don't have to wait for it to notice the stream has gone.
+    if (expensive_operation_client_.get() != nullptr) {
+      expensive_operation_client_->ReturnIdleTokens();
+    }
   }
   clients_->CancelAllActiveAndWait();
   {
     ScopedMutex lock(mutex_.get());
     CHECK_EQ(state_, SHUTDOWN);
+    rewrite_client_.clear();
+    expensive_operation_client_.clear();
     client_thread_.reset();
   }
 }
@@ -219,8 +226,34 @@ void CentralControllerRpcClient::ConsiderConnecting(
   }
 }
 
-template <typename ContextT, typename CallbackT>
-void CentralControllerRpcClient::StartContext(CallbackT* callback) {
+int CentralControllerRpcClient::NumOutstandingOperations() {
+  int result = 0;
+  if (rewrite_client_.get() != nullptr) {
+    result += rewrite_client_->NumOutstanding();
+  }
+  if (expensive_operation_client_.get() != nullptr) {
+    result += expensive_operation_client_->NumOutstanding();
+  }
+  return result;
+}
+
+void CentralControllerRpcClient::ResetClient(
+    RefCountedPtr<ScheduleRewriteBatchRpcClient>* client) {
+  client->reset(new ScheduleRewriteBatchRpcClient(client_thread_->queue(),
+                                                  thread_system_, handler_));
+}
+
+void CentralControllerRpcClient::ResetClient(
+    RefCountedPtr<ExpensiveOperationLeaseRpcClient>* client) {
+  client->reset(new ExpensiveOperationLeaseRpcClient(
+      client_thread_->queue(), thread_system_, handler_,
+      idle_expensive_operation_tokens_));
+}
+
+template <typename ClientT, typename CallbackT>
+void CentralControllerRpcClient::StartOperation(
+    RefCountedPtr<ClientT>* client, bool (ClientT::*schedule)(CallbackT*),
+    CallbackT* callback) {
   bool shutdown_required = false;
   int64 now_ms = timer_->NowMs();
   {
@@ -232,8 +265,8 @@ void CentralControllerRpcClient::StartContext(CallbackT* callback) {
         // Someone else (another thread or process) detected that the
         // controller is not responding. Kill the client thread.
         shutdown_required = true;
-      } else if (clients_->Size() > controller_panic_threshold_) {
-        // We've accumulated a crazy number of gRPC clients in the registry.
+      } else if (NumOutstandingOperations() > controller_panic_threshold_) {
+        // We've accumulated a crazy number of requests to the controller.
         // It looks like the controller isn't responding and we're just piling
         // up detached RewriteDrivers.
         handler_->Message(
@@ -245,15 +278,22 @@ void CentralControllerRpcClient::StartContext(CallbackT* callback) {
         reconnect_time_ms_statistic_->Set(now_ms + kControllerReconnectDelayMs);
         shutdown_required = true;
       } else {
-        // Starts the transaction and deletes itself when done.
-        new ContextT(stub_.get(), client_thread_->queue(), thread_system_,
-                     handler_, callback);
-        return;  // Do not fall through, as callback will be canceled!
+        if (client->get() == nullptr || (*client)->HasFailed()) {
+          ResetClient(client);
+          (*client)->Start(stub_.get());
+        }
+        if (((*client).get()->*schedule)(callback)) {
+          return;  // Do not fall through, as callback will be canceled!
+        }
+        // The stream failed since we checked. Treat that like any other
+        // failure to reach the controller; the next request will reconnect.
       }
 
       if (shutdown_required) {
         // Stop further requests. We must do this before releasing the lock.
         state_ = DISCONNECTED;
+        rewrite_client_.clear();
+        expensive_operation_client_.clear();
       }
     }
   }
@@ -272,12 +312,15 @@ void CentralControllerRpcClient::StartContext(CallbackT* callback) {
 
 void CentralControllerRpcClient::ScheduleExpensiveOperation(
     ExpensiveOperationCallback* callback) {
-  StartContext<ExpensiveOperationRpcContext>(callback);
+  StartOperation(&expensive_operation_client_,
+                 &ExpensiveOperationLeaseRpcClient::ScheduleExpensiveOperation,
+                 callback);
 }
 
 void CentralControllerRpcClient::ScheduleRewrite(
     ScheduleRewriteCallback* callback) {
-  StartContext<ScheduleRewriteRpcContext>(callback);
+  StartOperation(&rewrite_client_,
+                 &ScheduleRewriteBatchRpcClient::ScheduleRewrite, callback);
 }
 
 }  // namespace net_instaweb
@@ -26,10 +26,13 @@
 #include "pagespeed/controller/central_controller.h"
 #include "pagespeed/controller/controller.grpc.pb.h"
 #include "pagespeed/controller/expensive_operation_callback.h"
+#include "pagespeed/controller/expensive_operation_lease_rpc_client.h"
+#include "pagespeed/controller/schedule_rewrite_batch_rpc_client.h"
 #include "pagespeed/controller/schedule_rewrite_callback.h"
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/ref_counted_ptr.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/thread_annotations.h"
@@ -40,11 +43,18 @@
 namespace net_instaweb {
 
 // CentralController implementation that forwards all requests to a gRPC server.
+// All rewrites are multiplexed over a single ScheduleRewriteBatch stream, and
+// expensive operations share tokens leased over a single
+// LeaseExpensiveOperations stream, so a page with dozens of resources doesn't
+// cost dozens of RPCs. If either stream breaks, the next request starts a new
+// one. Up to idle_expensive_operation_tokens tokens are kept on hand between
+// operations; see ExpensiveOperationLeaseRpcClient.
+//
 // RewriteDrivers wait for the controller response (possibly detaching) before
 // proceeding to rewrite. If the controller stops responding but requests keep
 // coming in, we could keep creating RewriteDrivers indefinitely and eat all
 // available memory. To guard against this we looks at the number of outstanding
-// gRPC requests. If that ever exceeds the max possible number, we declare the
+// requests. If that ever exceeds the max possible number, we declare the
 // controller to have hung, cancel all outstanding requests and stop talking to
 // it. We signal this via a statistic, so all processes can notice and do the
 // same.
@@ -55,9 +65,10 @@ class CentralControllerRpcClient : public CentralController {
   static const int kControllerReconnectDelayMs;
 
   CentralControllerRpcClient(const GoogleString& server_address,
-                             int panic_threshold, ThreadSystem* thread_system,
-                             Timer* timer, Statistics* statistics,
-                             MessageHandler* handler);
+                             int panic_threshold,
+                             int idle_expensive_operation_tokens,
+                             ThreadSystem* thread_system, Timer* timer,
+                             Statistics* statistics, MessageHandler* handler);
   ~CentralControllerRpcClient() override;
 
   // CentralController implementation.
@@ -79,9 +90,21 @@ class CentralControllerRpcClient : public CentralController {
   class GrpcClientThread;
   class ClientRegistry;
 
-  // Common code that checks shutdown status before creating a new ContextT.
-  template <typename ContextT, typename CallbackT>
-  void StartContext(CallbackT* callback) LOCKS_EXCLUDED(mutex_);
+  // Common code that checks shutdown status before passing callback to
+  // schedule on *client, starting a new ClientT if there is no usable one.
+  template <typename ClientT, typename CallbackT>
+  void StartOperation(RefCountedPtr<ClientT>* client,
+                      bool (ClientT::*schedule)(CallbackT*),
+                      CallbackT* callback) LOCKS_EXCLUDED(mutex_);
+
+  // Replace *client with a new, not yet started, one. Used by StartOperation.
+  void ResetClient(RefCountedPtr<ScheduleRewriteBatchRpcClient>* client)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void ResetClient(RefCountedPtr<ExpensiveOperationLeaseRpcClient>* client)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Number of operations waiting on the controller or running.
+  int NumOutstandingOperations() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // If we're not connected and kControllerReconnectDelay has passed, attempt
   // to reconnect.
@@ -102,6 +125,7 @@ class CentralControllerRpcClient : public CentralController {
 
   State state_ GUARDED_BY(mutex_);
   const int controller_panic_threshold_;
+  const int idle_expensive_operation_tokens_;
   int64 reconnect_time_ms_ GUARDED_BY(mutex_);
   UpDownCounter* reconnect_time_ms_statistic_;
 
@@ -109,6 +133,13 @@ class CentralControllerRpcClient : public CentralController {
   std::shared_ptr<::grpc::ChannelInterface> channel_;
   std::unique_ptr<CentralControllerRpcService::Stub> stub_;
 
+  // The streams requests are currently sent over. These are replaced whenever
+  // they fail, and dropped when we disconnect.
+  RefCountedPtr<ScheduleRewriteBatchRpcClient> rewrite_client_
+      GUARDED_BY(mutex_);
+  RefCountedPtr<ExpensiveOperationLeaseRpcClient> expensive_operation_client_
+      GUARDED_BY(mutex_);
+
   // This must be last so that it's destructed first.
   std::unique_ptr<GrpcClientThread> client_thread_ GUARDED_BY(mutex_);
 
@@ -22,7 +22,9 @@
 #include <memory>
 
 #include "pagespeed/controller/controller.grpc.pb.h"
+#include "pagespeed/controller/expensive_operation_lease_rpc_handler.h"
 #include "pagespeed/controller/expensive_operation_rpc_handler.h"
+#include "pagespeed/controller/schedule_rewrite_batch_rpc_handler.h"
 #include "pagespeed/controller/schedule_rewrite_rpc_handler.h"
 #include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/string.h"
@@ -58,6 +60,12 @@ int CentralControllerRpcServer::Setup() {
 
   ScheduleRewriteRpcHandler::CreateAndStart(&service_, queue_.get(),
                                             rewrite_controller_.get());
+
+  ExpensiveOperationLeaseRpcHandler::CreateAndStart(
+      &service_, queue_.get(), expensive_operation_controller_.get());
+
+  ScheduleRewriteBatchRpcHandler::CreateAndStart(&service_, queue_.get(),
+                                                 rewrite_controller_.get());
   return 0;
 }
 
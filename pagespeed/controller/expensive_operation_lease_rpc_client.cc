@@ -0,0 +1,223 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/controller/expensive_operation_lease_rpc_client.h"
+
+#include <memory>
+
+#include "base/logging.h"
+#include "pagespeed/controller/controller.grpc.pb.h"
+#include "pagespeed/controller/controller.pb.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/util/grpc.h"
+
+namespace net_instaweb {
+
+class ExpensiveOperationLeaseRpcClient::Context
+    : public ExpensiveOperationContext {
+ public:
+  explicit Context(ExpensiveOperationLeaseRpcClient* client)
+      : client_(client), done_(false) {}
+
+  ~Context() override { Done(); }
+
+  void Done() override {
+    if (!done_) {
+      done_ = true;
+      client_->ReleaseToken();
+    }
+  }
+
+ private:
+  RefPtr client_;
+  bool done_;
+
+  DISALLOW_COPY_AND_ASSIGN(Context);
+};
+
+ExpensiveOperationLeaseRpcClient::ExpensiveOperationLeaseRpcClient(
+    ::grpc::CompletionQueue* queue, ThreadSystem* thread_system,
+    MessageHandler* handler, int idle_tokens)
+    : BatchingRpcClient(queue, thread_system, handler),
+      // Fill the idle pool as soon as the stream is up.
+      requested_(idle_tokens),
+      held_(0),
+      idle_(0),
+      idle_target_(idle_tokens),
+      pending_acquire_(idle_tokens),
+      pending_release_(0) {}
+
+ExpensiveOperationLeaseRpcClient::~ExpensiveOperationLeaseRpcClient() {
+  DCHECK(waiters_.empty());
+}
+
+bool ExpensiveOperationLeaseRpcClient::ScheduleExpensiveOperation(
+    ExpensiveOperationCallback* callback) {
+  bool run_now = false;
+  {
+    ScopedMutex lock(mutex_.get());
+    if (HasFailedLocked()) {
+      return false;
+    }
+    if (idle_ > 0) {
+      DCHECK(waiters_.empty());
+      --idle_;
+      GrantToken(callback);
+      run_now = true;
+    } else {
+      waiters_.push_back(callback);
+    }
+    RequestTokens();
+  }
+  if (run_now) {
+    callback->CallRun();
+  }
+  return true;
+}
+
+void ExpensiveOperationLeaseRpcClient::ReturnIdleTokens() {
+  ScopedMutex lock(mutex_.get());
+  idle_target_ = 0;
+  if (idle_ > 0 && !HasFailedLocked()) {
+    pending_release_ += idle_;
+    MaybeWrite();
+  }
+  idle_ = 0;
+}
+
+int ExpensiveOperationLeaseRpcClient::NumOutstanding() {
+  ScopedMutex lock(mutex_.get());
+  return waiters_.size() + held_;
+}
+
+void ExpensiveOperationLeaseRpcClient::ReleaseToken() {
+  FunctionVector to_run;
+  {
+    ScopedMutex lock(mutex_.get());
+    --held_;
+    if (HasFailedLocked()) {
+      // The server took the token back when the stream went away.
+      return;
+    }
+    if (!waiters_.empty()) {
+      GrantTokenToWaiter(&to_run);
+    } else {
+      KeepOrReleaseToken();
+      MaybeWrite();
+    }
+  }
+  for (Function* callback : to_run) {
+    callback->CallRun();
+  }
+}
+
+void ExpensiveOperationLeaseRpcClient::GrantTokenToWaiter(
+    FunctionVector* to_run) {
+  ExpensiveOperationCallback* callback = waiters_.front();
+  waiters_.pop_front();
+  GrantToken(callback);
+  to_run->push_back(callback);
+}
+
+void ExpensiveOperationLeaseRpcClient::GrantToken(
+    ExpensiveOperationCallback* callback) {
+  ++held_;
+  // SetTransactionContext takes ownership of the context.
+  callback->SetTransactionContext(new Context(this));
+}
+
+void ExpensiveOperationLeaseRpcClient::KeepOrReleaseToken() {
+  if (idle_ < idle_target_) {
+    ++idle_;
+  } else {
+    ++pending_release_;
+  }
+}
+
+void ExpensiveOperationLeaseRpcClient::RequestTokens() {
+  int wanted = waiters_.size() + idle_target_ - idle_;
+  if (wanted > requested_) {
+    pending_acquire_ += wanted - requested_;
+    requested_ = wanted;
+    MaybeWrite();
+  }
+}
+
+std::unique_ptr<ExpensiveOperationLeaseRpcClient::ReaderWriter>
+ExpensiveOperationLeaseRpcClient::StartRpc(
+    CentralControllerRpcService::StubInterface* stub,
+    ::grpc::ClientContext* context, ::grpc::CompletionQueue* queue,
+    void* tag) {
+  return stub->AsyncLeaseExpensiveOperations(context, queue, tag);
+}
+
+bool ExpensiveOperationLeaseRpcClient::PopulateRequest(
+    ExpensiveOperationLeaseRequest* request) {
+  if (pending_acquire_ == 0 && pending_release_ == 0) {
+    return false;
+  }
+  request->set_acquire(pending_acquire_);
+  request->set_release(pending_release_);
+  pending_acquire_ = 0;
+  pending_release_ = 0;
+  return true;
+}
+
+void ExpensiveOperationLeaseRpcClient::HandleResponse(
+    const ExpensiveOperationLeaseResponse& response, FunctionVector* to_run,
+    FunctionVector* to_cancel) {
+  int decided = response.granted() + response.denied();
+  if (response.granted() < 0 || response.denied() < 0 ||
+      decided > requested_ - pending_acquire_) {
+    LOG(DFATAL) << "CentralController decided on " << decided
+                << " tokens, but only "
+                << (requested_ - pending_acquire_) << " were requested";
+    return;
+  }
+  requested_ -= decided;
+  for (int i = 0; i < response.granted(); ++i) {
+    if (!waiters_.empty()) {
+      GrantTokenToWaiter(to_run);
+    } else {
+      // Either it was asked for to fill the idle pool, or its waiter was
+      // handed a token by a finished operation.
+      KeepOrReleaseToken();
+    }
+  }
+  // Only cancel waiters that aren't covered by the requests that remain.
+  for (int i = 0; i < response.denied() &&
+                  static_cast<int>(waiters_.size()) > requested_;
+       ++i) {
+    to_cancel->push_back(waiters_.front());
+    waiters_.pop_front();
+  }
+  MaybeWrite();
+}
+
+void ExpensiveOperationLeaseRpcClient::HandleFailure(
+    FunctionVector* to_cancel) {
+  to_cancel->insert(to_cancel->end(), waiters_.begin(), waiters_.end());
+  waiters_.clear();
+  requested_ = 0;
+  idle_ = 0;
+  pending_acquire_ = 0;
+  pending_release_ = 0;
+}
+
+}  // namespace net_instaweb
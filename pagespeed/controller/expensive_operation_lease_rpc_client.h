@@ -0,0 +1,141 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PAGESPEED_CONTROLLER_EXPENSIVE_OPERATION_LEASE_RPC_CLIENT_H_
+#define PAGESPEED_CONTROLLER_EXPENSIVE_OPERATION_LEASE_RPC_CLIENT_H_
+
+#include <deque>
+#include <memory>
+
+#include "pagespeed/controller/batching_rpc_client.h"
+#include "pagespeed/controller/controller.grpc.pb.h"
+#include "pagespeed/controller/controller.pb.h"
+#include "pagespeed/controller/expensive_operation_callback.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/ref_counted_ptr.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/util/grpc.h"
+
+namespace net_instaweb {
+
+// Client for the LeaseExpensiveOperations RPC. Instead of a round trip per
+// operation, it asks the server for as many tokens as there are operations
+// waiting, in a single message, and runs one operation per granted token.
+// When an operation finishes and another is waiting locally, the token is
+// handed straight to it without talking to the server at all. Otherwise it is
+// released back, batched up with any other releases and acquires as described
+// in BatchingRpcClient.
+//
+// Handing a token over locally leaves an acquire outstanding at the server
+// that is no longer needed. If that is granted, the surplus token goes right
+// back, unless it can top up the idle pool.
+//
+// The client may also keep a pool of up to idle_tokens tokens that it holds
+// without an operation to run, so that an operation arriving at a quiet
+// moment starts at once instead of waiting on a round trip. The pool is
+// filled as soon as the stream is up, and whenever an operation takes a token
+// from it another is asked for in the background. Idle tokens are unavailable
+// to every other process, so this is a trade of throughput for latency and
+// is off by default. They are handed back by ReturnIdleTokens(), or when the
+// stream closes.
+
+class ExpensiveOperationLeaseRpcClient
+    : public BatchingRpcClient<ExpensiveOperationLeaseRequest,
+                               ExpensiveOperationLeaseResponse> {
+ public:
+  ExpensiveOperationLeaseRpcClient(::grpc::CompletionQueue* queue,
+                                   ThreadSystem* thread_system,
+                                   MessageHandler* handler, int idle_tokens);
+
+  // Run the callback with an idle token if there is one, otherwise queue it
+  // until a token is available for it. The callback will eventually be Run or
+  // Cancelled. Returns false, without touching the callback, if the stream
+  // has failed.
+  bool ScheduleExpensiveOperation(ExpensiveOperationCallback* callback)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Stop keeping tokens idle and hand back any that are. Call this before
+  // shutting down so they are available to other processes right away, rather
+  // than once the server notices the stream has gone.
+  void ReturnIdleTokens() LOCKS_EXCLUDED(mutex_);
+
+  // Number of operations waiting for a token or running.
+  int NumOutstanding() LOCKS_EXCLUDED(mutex_);
+
+ private:
+  class Context;
+  typedef RefCountedPtr<ExpensiveOperationLeaseRpcClient> RefPtr;
+
+  ~ExpensiveOperationLeaseRpcClient() override;
+
+  // Called by Context when an operation finishes with its token.
+  void ReleaseToken() LOCKS_EXCLUDED(mutex_);
+
+  // Give a token to the first waiter, adding it to to_run.
+  void GrantTokenToWaiter(FunctionVector* to_run)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Attach a context for a newly held token to callback.
+  void GrantToken(ExpensiveOperationCallback* callback)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Keep a token that no waiter wants in the idle pool if it has room,
+  // otherwise queue it to go back to the server.
+  void KeepOrReleaseToken() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Ask for enough tokens to cover every waiter and fill the idle pool.
+  void RequestTokens() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // BatchingRpcClient implementation.
+  std::unique_ptr<ReaderWriter> StartRpc(
+      CentralControllerRpcService::StubInterface* stub,
+      ::grpc::ClientContext* context, ::grpc::CompletionQueue* queue,
+      void* tag) override;
+  bool PopulateRequest(ExpensiveOperationLeaseRequest* request) override
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void HandleResponse(const ExpensiveOperationLeaseResponse& response,
+                      FunctionVector* to_run,
+                      FunctionVector* to_cancel) override
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void HandleFailure(FunctionVector* to_cancel) override
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Operations waiting for a token, in arrival order.
+  std::deque<ExpensiveOperationCallback*> waiters_ GUARDED_BY(mutex_);
+  // Tokens asked for that the server hasn't yet decided on, including those
+  // in pending_acquire_. This is never less than waiters_.size().
+  int requested_ GUARDED_BY(mutex_);
+  // Tokens held by running operations.
+  int held_ GUARDED_BY(mutex_);
+  // Tokens held with nothing to run. Only ever non-zero while waiters_ is
+  // empty, and never more than idle_target_.
+  int idle_ GUARDED_BY(mutex_);
+  int idle_target_ GUARDED_BY(mutex_);
+  // Counts accumulated for the next Write.
+  int pending_acquire_ GUARDED_BY(mutex_);
+  int pending_release_ GUARDED_BY(mutex_);
+
+  DISALLOW_COPY_AND_ASSIGN(ExpensiveOperationLeaseRpcClient);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_CONTROLLER_EXPENSIVE_OPERATION_LEASE_RPC_CLIENT_H_
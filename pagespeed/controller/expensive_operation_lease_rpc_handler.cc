@@ -0,0 +1,148 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/controller/expensive_operation_lease_rpc_handler.h"
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/util/grpc.h"
+
+namespace net_instaweb {
+
+const int ExpensiveOperationLeaseRpcHandler::kMaxTokensPerClient = 100000;
+
+ExpensiveOperationLeaseRpcHandler::ExpensiveOperationLeaseRpcHandler(
+    CentralControllerRpcService::AsyncService* service,
+    ::grpc::ServerCompletionQueue* cq, ExpensiveOperationController* controller)
+    : RpcHandler(service, cq),
+      controller_(controller),
+      waiting_(0),
+      held_(0),
+      write_outstanding_(false),
+      done_(false) {}
+
+ExpensiveOperationLeaseRpcHandler::~ExpensiveOperationLeaseRpcHandler() {
+  // Every DecisionCallback holds a reference, and every held token is released
+  // as soon as we're done, so nothing should be left.
+  DCHECK_EQ(waiting_, 0);
+  DCHECK_EQ(held_, 0);
+}
+
+void ExpensiveOperationLeaseRpcHandler::CreateAndStart(
+    CentralControllerRpcService::AsyncService* service,
+    ::grpc::ServerCompletionQueue* cq,
+    ExpensiveOperationController* controller) {
+  (new ExpensiveOperationLeaseRpcHandler(service, cq, controller))->Start();
+}
+
+void ExpensiveOperationLeaseRpcHandler::HandleRequest(
+    const ExpensiveOperationLeaseRequest& req) {
+  if (done_) {
+    return;
+  }
+  if (req.acquire() < 0 || req.release() < 0 || req.release() > held_ ||
+      req.acquire() > kMaxTokensPerClient - waiting_ - held_ + req.release()) {
+    LOG(ERROR) << "Malformed request to LeaseExpensiveOperations: acquire "
+               << req.acquire() << " release " << req.release() << " with "
+               << held_ << " held and " << waiting_ << " waiting";
+    Finish(::grpc::Status(::grpc::StatusCode::ABORTED,
+                          "Protocol error (LeaseExpensiveOperations)"));
+    // HandleError is not called after Finish, so clean up here.
+    ReleaseAllTokens();
+    return;
+  }
+
+  // Release first, so the tokens are available to the acquires below.
+  held_ -= req.release();
+  for (int i = 0; i < req.release(); ++i) {
+    controller_->NotifyExpensiveOperationComplete();
+  }
+  waiting_ += req.acquire();
+  for (int i = 0; i < req.acquire(); ++i) {
+    controller_->ScheduleExpensiveOperation(new DecisionCallback(this));
+  }
+}
+
+void ExpensiveOperationLeaseRpcHandler::NotifyClient(bool granted) {
+  DCHECK_GT(waiting_, 0);
+  --waiting_;
+
+  if (done_) {
+    // The client went away while the controller was deciding, so give back
+    // anything that it was granted.
+    if (granted) {
+      controller_->NotifyExpensiveOperationComplete();
+    }
+    return;
+  }
+
+  if (granted) {
+    ++held_;
+    pending_response_.set_granted(pending_response_.granted() + 1);
+  } else {
+    pending_response_.set_denied(pending_response_.denied() + 1);
+  }
+  MaybeSendDecisions();
+}
+
+void ExpensiveOperationLeaseRpcHandler::MaybeSendDecisions() {
+  if (write_outstanding_ ||
+      (pending_response_.granted() == 0 && pending_response_.denied() == 0)) {
+    return;
+  }
+  if (Write(pending_response_)) {
+    write_outstanding_ = true;
+    pending_response_.Clear();
+  }
+  // If the Write failed, the client is gone and HandleError will clean up.
+}
+
+void ExpensiveOperationLeaseRpcHandler::HandleWriteDone() {
+  write_outstanding_ = false;
+  MaybeSendDecisions();
+}
+
+void ExpensiveOperationLeaseRpcHandler::HandleError() { ReleaseAllTokens(); }
+
+void ExpensiveOperationLeaseRpcHandler::ReleaseAllTokens() {
+  if (done_) {
+    return;
+  }
+  done_ = true;
+  pending_response_.Clear();
+  for (; held_ > 0; --held_) {
+    controller_->NotifyExpensiveOperationComplete();
+  }
+}
+
+void ExpensiveOperationLeaseRpcHandler::InitResponder(
+    CentralControllerRpcService::AsyncService* service,
+    ::grpc::ServerContext* ctx, ReaderWriterT* responder,
+    ::grpc::ServerCompletionQueue* cq, void* callback) {
+  service->RequestLeaseExpensiveOperations(ctx, responder, cq, cq, callback);
+}
+
+ExpensiveOperationLeaseRpcHandler::RpcHandler*
+ExpensiveOperationLeaseRpcHandler::CreateHandler(
+    CentralControllerRpcService::AsyncService* service,
+    ::grpc::ServerCompletionQueue* cq) {
+  return new ExpensiveOperationLeaseRpcHandler(service, cq, controller_);
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,131 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PAGESPEED_CONTROLLER_EXPENSIVE_OPERATION_LEASE_RPC_HANDLER_H_
+#define PAGESPEED_CONTROLLER_EXPENSIVE_OPERATION_LEASE_RPC_HANDLER_H_
+
+#include "pagespeed/controller/controller.grpc.pb.h"
+#include "pagespeed/controller/controller.pb.h"
+#include "pagespeed/controller/expensive_operation_controller.h"
+#include "pagespeed/controller/rpc_handler.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/ref_counted_ptr.h"
+#include "pagespeed/kernel/util/grpc.h"
+
+namespace net_instaweb {
+
+// RpcHandler for ExpensiveOperationController that hands out tokens in bulk;
+// the server side of ExpensiveOperationLeaseRpcClient.
+//
+// Each token the client asks to acquire results in a call to
+// ScheduleExpensiveOperation() on the controller. The controller's decisions
+// are counted up and sent back to the client, with any that are made while a
+// Write is in flight going out together in the next response. The client then
+// holds each granted token until it sends it back with a release, which we
+// pass on to NotifyExpensiveOperationComplete().
+//
+// If the client disconnects, or violates the protocol, we call
+// NotifyExpensiveOperationComplete() for every token it still holds, so the
+// controller can release "locks". Tokens still waiting on the controller are
+// handled the same way once it grants them.
+
+class ExpensiveOperationLeaseRpcHandler
+    : public RpcHandler<CentralControllerRpcService::AsyncService,
+                        ExpensiveOperationLeaseRequest,
+                        ExpensiveOperationLeaseResponse> {
+ public:
+  // Most tokens a single client may hold or be waiting for at once. This is
+  // far beyond the point where the client would decide we're not responding
+  // and give up; it exists so that a broken one can't make us spin forever
+  // calling the controller.
+  static const int kMaxTokensPerClient;
+
+  ~ExpensiveOperationLeaseRpcHandler() override;
+
+  // Call this to create a handler and add it to the gRPC event loop. It will
+  // free itself.
+  static void CreateAndStart(CentralControllerRpcService::AsyncService* service,
+                             ::grpc::ServerCompletionQueue* cq,
+                             ExpensiveOperationController* controller);
+
+ protected:
+  ExpensiveOperationLeaseRpcHandler(
+      CentralControllerRpcService::AsyncService* service,
+      ::grpc::ServerCompletionQueue* cq,
+      ExpensiveOperationController* controller);
+
+ private:
+  typedef RefCountedPtr<ExpensiveOperationLeaseRpcHandler> RefPtr;
+
+  // Callback passed to ScheduleExpensiveOperation for each token, which the
+  // controller will use to signify "Go ahead" or not.
+  class DecisionCallback : public Function {
+   public:
+    explicit DecisionCallback(ExpensiveOperationLeaseRpcHandler* handler)
+        : handler_(handler) {}
+
+    void Run() override { handler_->NotifyClient(true /* granted */); }
+    void Cancel() override { handler_->NotifyClient(false /* granted */); }
+
+   private:
+    // The client may hangup before the Controller makes up its mind. We retain
+    // a RefPtr to the handler to ensure that it doesn't delete itself until we
+    // are done with it.
+    RefPtr handler_;
+  };
+
+  // RpcHandler implementation.
+  void HandleRequest(const ExpensiveOperationLeaseRequest& req) override;
+  void HandleError() override;
+  void HandleWriteDone() override;
+  void InitResponder(CentralControllerRpcService::AsyncService* service,
+                     ::grpc::ServerContext* ctx, ReaderWriterT* responder,
+                     ::grpc::ServerCompletionQueue* cq,
+                     void* callback) override;
+  RpcHandler* CreateHandler(CentralControllerRpcService::AsyncService* service,
+                            ::grpc::ServerCompletionQueue* cq) override;
+
+  // Count up the Controller's decision for the client. This is invoked by the
+  // controller via a DecisionCallback.
+  void NotifyClient(bool granted);
+
+  // Send any counted decisions to the client, unless a Write is already in
+  // flight, in which case HandleWriteDone will get to them.
+  void MaybeSendDecisions();
+
+  // Notify the controller that all held tokens are finished with. Tokens still
+  // waiting on the controller are released in NotifyClient once done_ is set.
+  void ReleaseAllTokens();
+
+  ExpensiveOperationController* controller_;
+  int waiting_;  // Tokens the controller is deciding on.
+  int held_;     // Tokens granted to the client and not yet released.
+  ExpensiveOperationLeaseResponse pending_response_;
+  bool write_outstanding_;
+  bool done_;
+
+  friend class ExpensiveOperationLeaseRpcHandlerTest;
+
+  DISALLOW_COPY_AND_ASSIGN(ExpensiveOperationLeaseRpcHandler);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_CONTROLLER_EXPENSIVE_OPERATION_LEASE_RPC_HANDLER_H_
@@ -0,0 +1,151 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/controller/schedule_rewrite_batch_rpc_client.h"
+
+#include <memory>
+
+#include "base/logging.h"
+#include "pagespeed/controller/controller.grpc.pb.h"
+#include "pagespeed/controller/controller.pb.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/util/grpc.h"
+
+namespace net_instaweb {
+
+class ScheduleRewriteBatchRpcClient::Context : public ScheduleRewriteContext {
+ public:
+  Context(ScheduleRewriteBatchRpcClient* client, uint64 id)
+      : client_(client), id_(id), done_(false) {}
+
+  ~Context() override { MarkSucceeded(); }
+
+  void MarkSucceeded() override { Done(ScheduleRewriteRequest::SUCCESS); }
+  void MarkFailed() override { Done(ScheduleRewriteRequest::FAILED); }
+
+ private:
+  void Done(ScheduleRewriteRequest::RewriteStatus status) {
+    if (!done_) {
+      done_ = true;
+      client_->SendResult(id_, status);
+    }
+  }
+
+  RefPtr client_;
+  const uint64 id_;
+  bool done_;
+
+  DISALLOW_COPY_AND_ASSIGN(Context);
+};
+
+ScheduleRewriteBatchRpcClient::ScheduleRewriteBatchRpcClient(
+    ::grpc::CompletionQueue* queue, ThreadSystem* thread_system,
+    MessageHandler* handler)
+    : BatchingRpcClient(queue, thread_system, handler),
+      next_id_(0),
+      running_(0) {}
+
+ScheduleRewriteBatchRpcClient::~ScheduleRewriteBatchRpcClient() {
+  DCHECK(waiting_.empty());
+}
+
+bool ScheduleRewriteBatchRpcClient::ScheduleRewrite(
+    ScheduleRewriteCallback* callback) {
+  ScopedMutex lock(mutex_.get());
+  if (HasFailedLocked()) {
+    return false;
+  }
+  uint64 id = next_id_++;
+  waiting_[id] = callback;
+  ScheduleRewriteBatchRequest::Rewrite* rewrite = pending_.add_rewrites();
+  rewrite->set_id(id);
+  rewrite->set_key(callback->key());
+  MaybeWrite();
+  return true;
+}
+
+int ScheduleRewriteBatchRpcClient::NumOutstanding() {
+  ScopedMutex lock(mutex_.get());
+  return waiting_.size() + running_;
+}
+
+void ScheduleRewriteBatchRpcClient::SendResult(
+    uint64 id, ScheduleRewriteRequest::RewriteStatus status) {
+  ScopedMutex lock(mutex_.get());
+  --running_;
+  if (HasFailedLocked()) {
+    // The server already failed the rewrite when the stream went away.
+    return;
+  }
+  ScheduleRewriteBatchRequest::Rewrite* rewrite = pending_.add_rewrites();
+  rewrite->set_id(id);
+  rewrite->set_status(status);
+  MaybeWrite();
+}
+
+std::unique_ptr<ScheduleRewriteBatchRpcClient::ReaderWriter>
+ScheduleRewriteBatchRpcClient::StartRpc(
+    CentralControllerRpcService::StubInterface* stub,
+    ::grpc::ClientContext* context, ::grpc::CompletionQueue* queue,
+    void* tag) {
+  return stub->AsyncScheduleRewriteBatch(context, queue, tag);
+}
+
+bool ScheduleRewriteBatchRpcClient::PopulateRequest(
+    ScheduleRewriteBatchRequest* request) {
+  if (pending_.rewrites_size() == 0) {
+    return false;
+  }
+  request->Swap(&pending_);
+  return true;
+}
+
+void ScheduleRewriteBatchRpcClient::HandleResponse(
+    const ScheduleRewriteBatchResponse& response, FunctionVector* to_run,
+    FunctionVector* to_cancel) {
+  for (const ScheduleRewriteBatchResponse::Decision& decision :
+       response.decisions()) {
+    CallbackMap::iterator iter = waiting_.find(decision.id());
+    if (iter == waiting_.end()) {
+      LOG(DFATAL) << "CentralController decided on unknown rewrite "
+                  << decision.id();
+      continue;
+    }
+    ScheduleRewriteCallback* callback = iter->second;
+    waiting_.erase(iter);
+    if (decision.ok_to_proceed()) {
+      ++running_;
+      // SetTransactionContext takes ownership of the context.
+      callback->SetTransactionContext(new Context(this, decision.id()));
+      to_run->push_back(callback);
+    } else {
+      to_cancel->push_back(callback);
+    }
+  }
+}
+
+void ScheduleRewriteBatchRpcClient::HandleFailure(FunctionVector* to_cancel) {
+  for (const auto& entry : waiting_) {
+    to_cancel->push_back(entry.second);
+  }
+  waiting_.clear();
+  pending_.Clear();
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,101 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PAGESPEED_CONTROLLER_SCHEDULE_REWRITE_BATCH_RPC_CLIENT_H_
+#define PAGESPEED_CONTROLLER_SCHEDULE_REWRITE_BATCH_RPC_CLIENT_H_
+
+#include <memory>
+#include <unordered_map>
+
+#include "pagespeed/controller/batching_rpc_client.h"
+#include "pagespeed/controller/controller.grpc.pb.h"
+#include "pagespeed/controller/controller.pb.h"
+#include "pagespeed/controller/schedule_rewrite_callback.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/ref_counted_ptr.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/util/grpc.h"
+
+namespace net_instaweb {
+
+// Client for the ScheduleRewriteBatch RPC, which carries every rewrite a
+// process schedules over a single stream rather than opening one per key. New
+// keys and the results of finished rewrites are batched up as described in
+// BatchingRpcClient. When the server allows a rewrite to proceed, the
+// callback is Run with a ScheduleRewriteContext that reports the result back
+// over the same stream.
+
+class ScheduleRewriteBatchRpcClient
+    : public BatchingRpcClient<ScheduleRewriteBatchRequest,
+                               ScheduleRewriteBatchResponse> {
+ public:
+  ScheduleRewriteBatchRpcClient(::grpc::CompletionQueue* queue,
+                                ThreadSystem* thread_system,
+                                MessageHandler* handler);
+
+  // Queue a request for callback's key to go out with the next batch. The
+  // callback will eventually be Run or Cancelled. Returns false, without
+  // touching the callback, if the stream has failed.
+  bool ScheduleRewrite(ScheduleRewriteCallback* callback)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Number of rewrites waiting for a decision or running.
+  int NumOutstanding() LOCKS_EXCLUDED(mutex_);
+
+ private:
+  class Context;
+  typedef RefCountedPtr<ScheduleRewriteBatchRpcClient> RefPtr;
+  typedef std::unordered_map<uint64, ScheduleRewriteCallback*> CallbackMap;
+
+  ~ScheduleRewriteBatchRpcClient() override;
+
+  // Called by Context when the rewrite with the given id finishes.
+  void SendResult(uint64 id, ScheduleRewriteRequest::RewriteStatus status)
+      LOCKS_EXCLUDED(mutex_);
+
+  // BatchingRpcClient implementation.
+  std::unique_ptr<ReaderWriter> StartRpc(
+      CentralControllerRpcService::StubInterface* stub,
+      ::grpc::ClientContext* context, ::grpc::CompletionQueue* queue,
+      void* tag) override;
+  bool PopulateRequest(ScheduleRewriteBatchRequest* request) override
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void HandleResponse(const ScheduleRewriteBatchResponse& response,
+                      FunctionVector* to_run,
+                      FunctionVector* to_cancel) override
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void HandleFailure(FunctionVector* to_cancel) override
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  uint64 next_id_ GUARDED_BY(mutex_);
+  // Rewrites sent (or about to be) that the server hasn't yet decided on.
+  CallbackMap waiting_ GUARDED_BY(mutex_);
+  // Rewrites allowed to proceed that haven't yet sent their result.
+  int running_ GUARDED_BY(mutex_);
+  // Everything accumulated for the next Write.
+  ScheduleRewriteBatchRequest pending_ GUARDED_BY(mutex_);
+
+  DISALLOW_COPY_AND_ASSIGN(ScheduleRewriteBatchRpcClient);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_CONTROLLER_SCHEDULE_REWRITE_BATCH_RPC_CLIENT_H_
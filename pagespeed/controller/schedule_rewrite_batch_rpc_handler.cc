@@ -0,0 +1,185 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/controller/schedule_rewrite_batch_rpc_handler.h"
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/util/grpc.h"
+
+namespace net_instaweb {
+
+ScheduleRewriteBatchRpcHandler::ScheduleRewriteBatchRpcHandler(
+    CentralControllerRpcService::AsyncService* service,
+    ::grpc::ServerCompletionQueue* cq, ScheduleRewriteController* controller)
+    : RpcHandler(service, cq),
+      controller_(controller),
+      write_outstanding_(false),
+      done_(false) {}
+
+ScheduleRewriteBatchRpcHandler::~ScheduleRewriteBatchRpcHandler() {
+  // Every DecisionCallback holds a reference, and every running rewrite is
+  // failed as soon as we're done, so nothing should be left.
+  DCHECK(rewrites_.empty());
+}
+
+void ScheduleRewriteBatchRpcHandler::CreateAndStart(
+    CentralControllerRpcService::AsyncService* service,
+    ::grpc::ServerCompletionQueue* cq, ScheduleRewriteController* controller) {
+  (new ScheduleRewriteBatchRpcHandler(service, cq, controller))->Start();
+}
+
+void ScheduleRewriteBatchRpcHandler::HandleRequest(
+    const ScheduleRewriteBatchRequest& req) {
+  if (done_) {
+    return;
+  }
+  for (const ScheduleRewriteBatchRequest::Rewrite& rewrite : req.rewrites()) {
+    if (!HandleRewrite(rewrite)) {
+      AbortForProtocolError("Protocol error (ScheduleRewriteBatch)");
+      return;
+    }
+  }
+}
+
+bool ScheduleRewriteBatchRpcHandler::HandleRewrite(
+    const ScheduleRewriteBatchRequest::Rewrite& rewrite) {
+  if (rewrite.status() == ScheduleRewriteRequest::PENDING) {
+    if (rewrite.key().empty()) {
+      LOG(ERROR) << "ScheduleRewriteBatch request with no key";
+      return false;
+    }
+    Rewrite& entry = rewrites_[rewrite.id()];
+    if (!entry.key.empty()) {
+      LOG(ERROR) << "ScheduleRewriteBatch request reuses id " << rewrite.id();
+      return false;
+    }
+    entry.key = rewrite.key();
+    entry.state = WAITING_FOR_CONTROLLER;
+    // The controller may decide immediately, which can erase entry, so don't
+    // pass it a reference into it.
+    controller_->ScheduleRewrite(rewrite.key(),
+                                 new DecisionCallback(this, rewrite.id()));
+    return true;
+  }
+
+  RewriteMap::iterator iter = rewrites_.find(rewrite.id());
+  if (iter == rewrites_.end() ||
+      iter->second.state != REWRITE_RUNNING ||
+      (!rewrite.key().empty() && rewrite.key() != iter->second.key)) {
+    LOG(ERROR) << "ScheduleRewriteBatch result for unknown rewrite "
+               << rewrite.id();
+    return false;
+  }
+  if (rewrite.status() == ScheduleRewriteRequest::SUCCESS) {
+    controller_->NotifyRewriteComplete(iter->second.key);
+  } else {
+    controller_->NotifyRewriteFailed(iter->second.key);
+  }
+  rewrites_.erase(iter);
+  return true;
+}
+
+void ScheduleRewriteBatchRpcHandler::NotifyClient(uint64 id,
+                                                  bool ok_to_rewrite) {
+  RewriteMap::iterator iter = rewrites_.find(id);
+  CHECK(iter != rewrites_.end());
+  DCHECK_EQ(iter->second.state, WAITING_FOR_CONTROLLER);
+
+  if (done_) {
+    // The client went away while the controller was deciding. If it was given
+    // the go-ahead, it must be told that the rewrite didn't happen.
+    if (ok_to_rewrite) {
+      controller_->NotifyRewriteFailed(iter->second.key);
+    }
+    rewrites_.erase(iter);
+    return;
+  }
+
+  if (ok_to_rewrite) {
+    iter->second.state = REWRITE_RUNNING;
+  } else {
+    rewrites_.erase(iter);
+  }
+  ScheduleRewriteBatchResponse::Decision* decision =
+      pending_response_.add_decisions();
+  decision->set_id(id);
+  decision->set_ok_to_proceed(ok_to_rewrite);
+  MaybeSendDecisions();
+}
+
+void ScheduleRewriteBatchRpcHandler::MaybeSendDecisions() {
+  if (write_outstanding_ || pending_response_.decisions_size() == 0) {
+    return;
+  }
+  if (Write(pending_response_)) {
+    write_outstanding_ = true;
+    pending_response_.Clear();
+  }
+  // If the Write failed, the client is gone and HandleError will clean up.
+}
+
+void ScheduleRewriteBatchRpcHandler::HandleWriteDone() {
+  write_outstanding_ = false;
+  MaybeSendDecisions();
+}
+
+void ScheduleRewriteBatchRpcHandler::HandleError() {
+  FailAllRewrites();
+}
+
+void ScheduleRewriteBatchRpcHandler::AbortForProtocolError(
+    const char* message) {
+  Finish(::grpc::Status(::grpc::StatusCode::ABORTED, message));
+  // HandleError is not called after Finish, so clean up here.
+  FailAllRewrites();
+}
+
+void ScheduleRewriteBatchRpcHandler::FailAllRewrites() {
+  if (done_) {
+    return;
+  }
+  done_ = true;
+  pending_response_.Clear();
+  for (RewriteMap::iterator iter = rewrites_.begin();
+       iter != rewrites_.end();) {
+    if (iter->second.state == REWRITE_RUNNING) {
+      controller_->NotifyRewriteFailed(iter->second.key);
+      iter = rewrites_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+}
+
+void ScheduleRewriteBatchRpcHandler::InitResponder(
+    CentralControllerRpcService::AsyncService* service,
+    ::grpc::ServerContext* ctx, ReaderWriterT* responder,
+    ::grpc::ServerCompletionQueue* cq, void* callback) {
+  service->RequestScheduleRewriteBatch(ctx, responder, cq, cq, callback);
+}
+
+ScheduleRewriteBatchRpcHandler::RpcHandler*
+ScheduleRewriteBatchRpcHandler::CreateHandler(
+    CentralControllerRpcService::AsyncService* service,
+    ::grpc::ServerCompletionQueue* cq) {
+  return new ScheduleRewriteBatchRpcHandler(service, cq, controller_);
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,150 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PAGESPEED_CONTROLLER_SCHEDULE_REWRITE_BATCH_RPC_HANDLER_H_
+#define PAGESPEED_CONTROLLER_SCHEDULE_REWRITE_BATCH_RPC_HANDLER_H_
+
+#include <unordered_map>
+
+#include "pagespeed/controller/controller.grpc.pb.h"
+#include "pagespeed/controller/controller.pb.h"
+#include "pagespeed/controller/rpc_handler.h"
+#include "pagespeed/controller/schedule_rewrite_controller.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/ref_counted_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/util/grpc.h"
+
+namespace net_instaweb {
+
+// RpcHandler for ScheduleRewriteController that multiplexes any number of
+// rewrites over a single stream; the server side of
+// ScheduleRewriteBatchRpcClient.
+//
+// Each Rewrite in a request with status PENDING results in a call to
+// ScheduleRewrite() on the controller. As the controller makes up its mind
+// about each one, the decision is queued up for the client. Since gRPC only
+// allows a single Write to be outstanding, any decisions made while one is in
+// flight are sent together in the next response. Rewrites with status SUCCESS
+// or FAILED are dispatched to NotifyRewriteComplete() or NotifyRewriteFailed()
+// for the key that was scheduled under the same id.
+//
+// If the client disconnects, or violates the protocol, we call
+// NotifyRewriteFailed() for every rewrite that it was allowed to start but
+// hadn't finished, so the controller can release "locks". Rewrites still
+// waiting on the controller are handled the same way once it decides.
+
+class ScheduleRewriteBatchRpcHandler
+    : public RpcHandler<CentralControllerRpcService::AsyncService,
+                        ScheduleRewriteBatchRequest,
+                        ScheduleRewriteBatchResponse> {
+ public:
+  ~ScheduleRewriteBatchRpcHandler() override;
+
+  // Call this to create a handler and add it to the gRPC event loop. It will
+  // free itself.
+  static void CreateAndStart(CentralControllerRpcService::AsyncService* service,
+                             ::grpc::ServerCompletionQueue* cq,
+                             ScheduleRewriteController* controller);
+
+ protected:
+  ScheduleRewriteBatchRpcHandler(
+      CentralControllerRpcService::AsyncService* service,
+      ::grpc::ServerCompletionQueue* cq, ScheduleRewriteController* controller);
+
+ private:
+  typedef RefCountedPtr<ScheduleRewriteBatchRpcHandler> RefPtr;
+
+  enum RewriteState {
+    WAITING_FOR_CONTROLLER,
+    REWRITE_RUNNING,
+  };
+
+  struct Rewrite {
+    GoogleString key;
+    RewriteState state;
+  };
+
+  typedef std::unordered_map<uint64, Rewrite> RewriteMap;
+
+  // Callback passed to ScheduleRewrite for each rewrite, which the controller
+  // will use to signify "Go ahead" or not.
+  class DecisionCallback : public Function {
+   public:
+    DecisionCallback(ScheduleRewriteBatchRpcHandler* handler, uint64 id)
+        : handler_(handler), id_(id) {}
+
+    void Run() override { handler_->NotifyClient(id_, true /* can_proceed */); }
+    void Cancel() override {
+      handler_->NotifyClient(id_, false /* can_proceed */);
+    }
+
+   private:
+    // The client may hangup before the Controller makes up its mind. We retain
+    // a RefPtr to the handler to ensure that it doesn't delete itself until we
+    // are done with it.
+    RefPtr handler_;
+    const uint64 id_;
+  };
+
+  // RpcHandler implementation.
+  void HandleRequest(const ScheduleRewriteBatchRequest& req) override;
+  void HandleError() override;
+  void HandleWriteDone() override;
+  void InitResponder(CentralControllerRpcService::AsyncService* service,
+                     ::grpc::ServerContext* ctx, ReaderWriterT* responder,
+                     ::grpc::ServerCompletionQueue* cq,
+                     void* callback) override;
+  RpcHandler* CreateHandler(CentralControllerRpcService::AsyncService* service,
+                            ::grpc::ServerCompletionQueue* cq) override;
+
+  // Handle a single Rewrite from a request. Returns false if it violates the
+  // protocol.
+  bool HandleRewrite(const ScheduleRewriteBatchRequest::Rewrite& rewrite);
+
+  // Queue up the Controller's decision for the client. This is invoked by the
+  // controller via a DecisionCallback.
+  void NotifyClient(uint64 id, bool ok_to_rewrite);
+
+  // Send any queued decisions to the client, unless a Write is already in
+  // flight, in which case HandleWriteDone will get to them.
+  void MaybeSendDecisions();
+
+  // Disconnect the client with an ABORTED status and clean up.
+  void AbortForProtocolError(const char* message);
+
+  // Notify the controller that all running rewrites failed. Rewrites still
+  // waiting on the controller are failed in NotifyClient once done_ is set.
+  void FailAllRewrites();
+
+  ScheduleRewriteController* controller_;
+  RewriteMap rewrites_;
+  ScheduleRewriteBatchResponse pending_response_;
+  bool write_outstanding_;
+  bool done_;
+
+  friend class ScheduleRewriteBatchRpcHandlerTest;
+
+  DISALLOW_COPY_AND_ASSIGN(ScheduleRewriteBatchRpcHandler);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_CONTROLLER_SCHEDULE_REWRITE_BATCH_RPC_HANDLER_H_
@@ -0,0 +1,207 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/envoy/envoy_html_rewriter.h"
+
+#include "base/logging.h"
+#include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/server_context.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/http/content_type.h"
+#include "pagespeed/kernel/http/request_headers.h"
+#include "pagespeed/kernel/http/response_headers.h"
+
+namespace net_instaweb {
+
+EnvoyHtmlRewriter::EnvoyHtmlRewriter(
+    RewriteDriver* driver, Envoy::Http::StreamEncoderFilterCallbacks* callbacks,
+    ResponseHeaders* response_headers)
+    : driver_(driver),
+      callbacks_(callbacks),
+      dispatcher_(callbacks->dispatcher()),
+      response_headers_(response_headers),
+      mutex_(driver->server_context()->thread_system()->NewMutex()),
+      pending_end_stream_(false),
+      trailers_pending_(false),
+      flush_in_progress_(false),
+      above_high_watermark_(false),
+      references_(1) {}
+
+EnvoyHtmlRewriter::~EnvoyHtmlRewriter() { DCHECK(driver_ == nullptr); }
+
+bool EnvoyHtmlRewriter::StartParse(StringPiece url,
+                                   const RequestHeaders& request_headers) {
+  driver_->SetWriter(this);
+  driver_->SetRequestHeaders(request_headers);
+  driver_->set_response_headers_ptr(response_headers_.get());
+  if (!driver_->StartParseWithType(url, kContentTypeHtml)) {
+    driver_->Cleanup();
+    driver_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void EnvoyHtmlRewriter::Parse(Envoy::Buffer::Instance& data,
+                              bool end_stream) {
+  DCHECK(callbacks_ != nullptr);
+  if (!flush_in_progress_) {
+    ParseAndFlush(data, end_stream);
+    return;
+  }
+
+  // The driver is busy with the previous chunk.  Hold on to this one, and
+  // once we are holding more than Envoy would buffer ask it to stop reading
+  // from the upstream.
+  pending_.move(data);
+  pending_end_stream_ = pending_end_stream_ || end_stream;
+  uint32 limit = callbacks_->encoderBufferLimit();
+  if (!above_high_watermark_ && limit > 0 && pending_.length() > limit) {
+    above_high_watermark_ = true;
+    callbacks_->onEncoderFilterAboveWriteBufferHighWatermark();
+  }
+}
+
+void EnvoyHtmlRewriter::FinishBeforeTrailers() {
+  trailers_pending_ = true;
+  Envoy::Buffer::OwnedImpl empty;
+  Parse(empty, true);
+}
+
+void EnvoyHtmlRewriter::ParseAndFlush(Envoy::Buffer::Instance& data,
+                                      bool end_stream) {
+  DCHECK(driver_ != nullptr);
+  DCHECK(!flush_in_progress_);
+  // The lexer copies whatever it needs to keep, so we can parse directly out
+  // of Envoy's slices rather than linearizing them into a string first.
+  for (const Envoy::Buffer::RawSlice& slice : data.getRawSlices()) {
+    driver_->ParseText(static_cast<const char*>(slice.mem_), slice.len_);
+  }
+  data.drain(data.length());
+
+  ++references_;
+  flush_in_progress_ = true;
+  if (end_stream) {
+    StartFinish();
+  } else {
+    driver_->FlushAsync(MakeFunction(this, &EnvoyHtmlRewriter::FlushDone));
+  }
+}
+
+void EnvoyHtmlRewriter::StartFinish() {
+  // FinishParseAsync releases the driver before running our callback.
+  RewriteDriver* driver = driver_;
+  driver_ = nullptr;
+  driver->FinishParseAsync(MakeFunction(this, &EnvoyHtmlRewriter::FinishDone));
+}
+
+void EnvoyHtmlRewriter::Detach() {
+  callbacks_ = nullptr;
+  pending_.drain(pending_.length());
+  pending_end_stream_ = false;
+  // If a flush is in progress, FlushComplete will finish the parse.
+  if (driver_ != nullptr && !flush_in_progress_) {
+    ++references_;
+    flush_in_progress_ = true;
+    StartFinish();
+  }
+  DropReference();
+}
+
+void EnvoyHtmlRewriter::FlushDone() {
+  dispatcher_.post([this]() { FlushComplete(false); });
+}
+
+void EnvoyHtmlRewriter::FinishDone() {
+  dispatcher_.post([this]() { FlushComplete(true); });
+}
+
+void EnvoyHtmlRewriter::FlushComplete(bool finished) {
+  flush_in_progress_ = false;
+  if (callbacks_ == nullptr) {
+    // The stream went away mid-flush; nobody wants the rest of the output.
+    if (driver_ != nullptr) {
+      ++references_;
+      flush_in_progress_ = true;
+      StartFinish();
+    }
+  } else if (finished) {
+    InjectOutput(!trailers_pending_);
+    if (trailers_pending_) {
+      callbacks_->continueEncoding();
+    }
+  } else {
+    InjectOutput(false);
+    if (pending_.length() > 0 || pending_end_stream_) {
+      bool end_stream = pending_end_stream_;
+      pending_end_stream_ = false;
+      ParseAndFlush(pending_, end_stream);
+    }
+    if (above_high_watermark_) {
+      above_high_watermark_ = false;
+      callbacks_->onEncoderFilterBelowWriteBufferLowWatermark();
+    }
+  }
+  DropReference();
+}
+
+void EnvoyHtmlRewriter::InjectOutput(bool end_stream) {
+  // Hand the rendered bytes to Envoy without copying them: the fragment
+  // owns the string and frees it once Envoy has written it out.
+  GoogleString* chunk = new GoogleString;
+  {
+    ScopedMutex lock(mutex_.get());
+    chunk->swap(output_);
+  }
+  if (chunk->empty() && !end_stream) {
+    delete chunk;
+    return;
+  }
+  Envoy::Buffer::OwnedImpl out;
+  if (chunk->empty()) {
+    delete chunk;
+  } else {
+    out.addBufferFragment(*new Envoy::Buffer::BufferFragmentImpl(
+        chunk->data(), chunk->size(),
+        [chunk](const void*, size_t,
+                const Envoy::Buffer::BufferFragmentImpl* fragment) {
+          delete chunk;
+          delete fragment;
+        }));
+  }
+  callbacks_->injectEncodedDataToFilterChain(out, end_stream);
+}
+
+void EnvoyHtmlRewriter::DropReference() {
+  DCHECK_LT(0, references_);
+  if (--references_ == 0) {
+    delete this;
+  }
+}
+
+bool EnvoyHtmlRewriter::Write(const StringPiece& str, MessageHandler*) {
+  ScopedMutex lock(mutex_.get());
+  output_.append(str.data(), str.size());
+  return true;
+}
+
+bool EnvoyHtmlRewriter::Flush(MessageHandler*) { return true; }
+
+}  // namespace net_instaweb
@@ -0,0 +1,124 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "common/buffer/buffer_impl.h"
+#include "envoy/http/filter.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/writer.h"
+
+namespace net_instaweb {
+
+class MessageHandler;
+class RequestHeaders;
+class ResponseHeaders;
+class RewriteDriver;
+
+// Streams an upstream HTML response through a RewriteDriver on Envoy's
+// encode path.
+//
+// Body chunks arrive on the Envoy worker thread and are parsed straight out
+// of the Buffer::Instance slices.  Each chunk then starts a FlushAsync; the
+// driver renders into this Writer from the rewrite threads, and when the
+// flush completes the collected output is posted back to the worker thread
+// and injected into the encoder filter chain.
+//
+// Only one flush may be outstanding at a time, so chunks that arrive while
+// one is in progress are moved into pending_.  Once pending_ exceeds the
+// encoder buffer limit we raise the encoder's high watermark, which makes
+// Envoy stop reading from the upstream until the flush catches up.
+//
+// The object is reference counted: the filter holds one reference, dropped
+// by Detach(), and each outstanding flush holds another.  All methods other
+// than Write() and Flush() must be called on the worker thread.
+class EnvoyHtmlRewriter : public Writer {
+ public:
+  // Takes ownership of response_headers, which the driver can consult while
+  // rewriting.  Changes it makes to them are not propagated, since Envoy
+  // has already sent the headers on by the time we see any body.
+  EnvoyHtmlRewriter(RewriteDriver* driver,
+                    Envoy::Http::StreamEncoderFilterCallbacks* callbacks,
+                    ResponseHeaders* response_headers);
+
+  // Starts parsing the response for url.  Returns false, having released
+  // the driver, if the driver refuses to parse it; the caller must still
+  // call Detach().
+  bool StartParse(StringPiece url, const RequestHeaders& request_headers);
+
+  // Parses and drains data.  If end_stream is set this is the last chunk,
+  // and the rewritten output will be injected with end_stream set once the
+  // driver has finished.
+  void Parse(Envoy::Buffer::Instance& data, bool end_stream);
+
+  // Like Parse(empty, true), but for responses with trailers: the final
+  // output is injected without end_stream, and the filter chain is then
+  // continued so the trailers follow it.
+  void FinishBeforeTrailers();
+
+  // Called when the filter is destroyed.  Any output not yet injected is
+  // dropped; the parse is finished in the background to release the driver.
+  void Detach();
+
+  // Writer interface, called from the rewrite threads.
+  bool Write(const StringPiece& str, MessageHandler* handler) override;
+  bool Flush(MessageHandler* handler) override;
+
+ private:
+  ~EnvoyHtmlRewriter() override;
+
+  void ParseAndFlush(Envoy::Buffer::Instance& data, bool end_stream);
+  void StartFinish();
+
+  // Called on a rewrite thread; post to the worker thread.
+  void FlushDone();
+  void FinishDone();
+
+  void InjectOutput(bool end_stream);
+  void FlushComplete(bool finished);
+  void DropReference();
+
+  // nullptr once FinishParseAsync has been called.
+  RewriteDriver* driver_;
+  // nullptr once detached.
+  Envoy::Http::StreamEncoderFilterCallbacks* callbacks_;
+  Envoy::Event::Dispatcher& dispatcher_;
+  std::unique_ptr<ResponseHeaders> response_headers_;
+
+  std::unique_ptr<AbstractMutex> mutex_;
+  GoogleString output_ GUARDED_BY(mutex_);
+
+  // The remaining members are only touched on the worker thread.
+  Envoy::Buffer::OwnedImpl pending_;
+  bool pending_end_stream_;
+  bool trailers_pending_;
+  bool flush_in_progress_;
+  bool above_high_watermark_;
+  int references_;
+
+  DISALLOW_COPY_AND_ASSIGN(EnvoyHtmlRewriter);
+};
+
+}  // namespace net_instaweb
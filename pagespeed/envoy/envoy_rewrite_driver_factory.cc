@@ -28,6 +28,7 @@
 #include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/util/public/property_cache.h"
+#include "pagespeed/automatic/proxy_fetch.h"
 #include "pagespeed/envoy/envoy_message_handler.h"
 #include "pagespeed/envoy/envoy_rewrite_options.h"
 #include "pagespeed/envoy/envoy_server_context.h"
@@ -256,6 +257,7 @@ void EnvoyRewriteDriverFactory::InitStats(Statistics* statistics) {
   SystemRewriteDriverFactory::InitStats(statistics);
   RewriteDriverFactory::InitStats(statistics);
   RateController::InitStats(statistics);
+  ProxyFetchFactory::InitStats(statistics);
 
   // Init Envoy-specific stats.
   EnvoyServerContext::InitStats(statistics);
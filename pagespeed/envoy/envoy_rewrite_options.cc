@@ -56,7 +56,8 @@ const char* const server_only_options[] = {
     "BlockingRewriteRefererUrls", "CreateSharedMemoryMetadataCache",
     "LoadFromFile", "LoadFromFileMatch", "LoadFromFileRule",
     "LoadFromFileRuleMatch", "UseNativeFetcher",
-    "NativeFetcherMaxKeepaliveRequests"};
+    "NativeFetcherMaxKeepaliveRequests", "WorkStealingThreadPools",
+    "ContentHasher"};
 
 // Options that can only be used in the main (http) option scope.
 const char* const main_only_options[] = {"UseNativeFetcher",
@@ -30,7 +30,9 @@
 #include "pagespeed/kernel/html/html_keywords.h"
 #include "pagespeed/kernel/http/content_type.h"
 #include "pagespeed/kernel/http/google_url.h"
+#include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/query_params.h"
+#include "pagespeed/kernel/http/response_headers.h"
 #include "pagespeed/kernel/thread/pthread_shared_mem.h"
 #include "pagespeed/kernel/util/gzip_inflater.h"
 #include "pagespeed/kernel/util/statistics_logger.h"
@@ -54,6 +56,10 @@ HttpPageSpeedDecoderFilter::HttpPageSpeedDecoderFilter(
     : config_(config), server_context_(server_context) {}
 
 HttpPageSpeedDecoderFilter::~HttpPageSpeedDecoderFilter() {
+  if (html_rewriter_ != nullptr) {
+    html_rewriter_->Detach();
+    html_rewriter_ = nullptr;
+  }
   if (rewrite_driver_ != nullptr) {
     rewrite_driver_->Cleanup();
     rewrite_driver_ = nullptr;
@@ -68,7 +74,14 @@ HttpPageSpeedDecoderFilter::~HttpPageSpeedDecoderFilter() {
   }
 }
 
-void HttpPageSpeedDecoderFilter::onDestroy() {}
+void HttpPageSpeedDecoderFilter::onDestroy() {
+  // The encoder callbacks are invalid from here on, so any rewrite still in
+  // flight must stop using them.
+  if (html_rewriter_ != nullptr) {
+    html_rewriter_->Detach();
+    html_rewriter_ = nullptr;
+  }
+}
 
 const LowerCaseString HttpPageSpeedDecoderFilter::headerKey() const {
   return LowerCaseString(config_->key());
@@ -170,20 +183,54 @@ void HttpPageSpeedDecoderFilter::sendReply(
       modify_headers, absl::nullopt, "details");
 }
 
+// We only rewrite identity-encoded HTML.  Compressed responses go through
+// untouched, as does anything the options disallow.
+bool HttpPageSpeedDecoderFilter::shouldRewriteHtml() const {
+  return base_fetch_ != nullptr && options_ != nullptr &&
+         options_->enabled() && options_->IsAllowed(pristine_url_->Spec()) &&
+         response_headers_->IsHtmlLike() &&
+         !response_headers_->Has(net_instaweb::HttpAttributes::kContentEncoding);
+}
+
+void HttpPageSpeedDecoderFilter::startHtmlRewrite(ResponseHeaderMap& headers) {
+  net_instaweb::RequestContextPtr request_context(
+      server_context_->NewRequestContext());
+  request_context->set_options(options_->ComputeHttpOptions());
+  net_instaweb::RewriteDriver* driver =
+      server_context_->NewRewriteDriver(request_context);
+  // response_headers_ stays with us for the recorder; the rewriter gets its
+  // own copy.
+  net_instaweb::ResponseHeaders* rewriter_headers =
+      new net_instaweb::ResponseHeaders;
+  rewriter_headers->CopyFrom(*response_headers_);
+  html_rewriter_ = new net_instaweb::EnvoyHtmlRewriter(
+      driver, encoder_callbacks_, rewriter_headers);
+  if (!html_rewriter_->StartParse(pristine_url_->Spec(),
+                                  *base_fetch_->request_headers())) {
+    html_rewriter_->Detach();
+    html_rewriter_ = nullptr;
+    return;
+  }
+  // The rewritten body will be a different length, so let Envoy chunk it.
+  headers.removeContentLength();
+}
+
 FilterHeadersStatus HttpPageSpeedDecoderFilter::encodeHeaders(
     ResponseHeaderMap& headers, bool end_stream) {
-  if (end_stream || !recorder_) {
+  if (end_stream) {
     return FilterHeadersStatus::Continue;
   }
 
+  response_headers_ =
+      net_instaweb::HeaderUtils::toPageSpeedResponseHeaders(headers);
   if (recorder_ != nullptr) {
-    response_headers_ =
-        net_instaweb::HeaderUtils::toPageSpeedResponseHeaders(headers);
-    // std::cerr << response_headers_->ToString() << std::endl;
     recorder_->ConsiderResponseHeaders(
         net_instaweb::InPlaceResourceRecorder::kPreliminaryHeaders,
         response_headers_.get());
   }
+  if (shouldRewriteHtml()) {
+    startHtmlRewrite(headers);
+  }
   return FilterHeadersStatus::Continue;
 };
 
@@ -194,16 +241,40 @@ FilterDataStatus HttpPageSpeedDecoderFilter::encodeData(Buffer::Instance& data,
     // ResponseHeaders::ApplySMaxAge(s_maxage_sec,
     //                            existing_cache_control,
     //                            &updated_cache_control)
-    // XXX(oschaaf): can we get a string view?
-    recorder_->Write(data.toString(), recorder_->handler());
+    for (const Buffer::RawSlice& slice : data.getRawSlices()) {
+      recorder_->Write(
+          StringPiece(static_cast<const char*>(slice.mem_), slice.len_),
+          recorder_->handler());
+    }
     if (end_stream) {
       recorder_->DoneAndSetHeaders(response_headers_.get(), true);
       recorder_ = nullptr;
     }
   }
 
+  if (html_rewriter_ != nullptr) {
+    // The rewriter drains data and injects its output back into the filter
+    // chain as each flush window completes.
+    html_rewriter_->Parse(data, end_stream);
+    return FilterDataStatus::StopIterationNoBuffer;
+  }
   return FilterDataStatus::Continue;
 };
 
+FilterTrailersStatus HttpPageSpeedDecoderFilter::encodeTrailers(
+    ResponseTrailerMap&) {
+  if (recorder_ != nullptr) {
+    recorder_->DoneAndSetHeaders(response_headers_.get(), true);
+    recorder_ = nullptr;
+  }
+  if (html_rewriter_ != nullptr) {
+    // The trailers are released by continueEncoding() once the last of the
+    // rewritten body has been injected.
+    html_rewriter_->FinishBeforeTrailers();
+    return FilterTrailersStatus::StopIteration;
+  }
+  return FilterTrailersStatus::Continue;
+}
+
 }  // namespace Http
 }  // namespace Envoy
@@ -6,6 +6,7 @@
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "pagespeed/envoy/envoy_base_fetch.h"
+#include "pagespeed/envoy/envoy_html_rewriter.h"
 #include "pagespeed/envoy/envoy_server_context.h"
 #include "pagespeed/envoy/header_utils.h"
 #include "pagespeed/envoy/http_filter.pb.h"
@@ -57,9 +58,7 @@ class HttpPageSpeedDecoderFilter : public StreamFilter {
 
   FilterDataStatus encodeData(Buffer::Instance& data, bool end_stream) override;
 
-  FilterTrailersStatus encodeTrailers(ResponseTrailerMap& trailers) override {
-    return FilterTrailersStatus::Continue;
-  };
+  FilterTrailersStatus encodeTrailers(ResponseTrailerMap& trailers) override;
   FilterMetadataStatus encodeMetadata(MetadataMap& metadata_map) override {
     return FilterMetadataStatus::Continue;
   };
@@ -90,10 +89,13 @@ class HttpPageSpeedDecoderFilter : public StreamFilter {
 
   const LowerCaseString headerKey() const;
   const std::string headerValue() const;
+  bool shouldRewriteHtml() const;
+  void startHtmlRewrite(ResponseHeaderMap& headers);
   net_instaweb::EnvoyBaseFetch* base_fetch_{nullptr};
   net_instaweb::RewriteOptions* options_{nullptr};
   net_instaweb::RewriteDriver* rewrite_driver_{nullptr};
   net_instaweb::InPlaceResourceRecorder* recorder_{nullptr};
+  net_instaweb::EnvoyHtmlRewriter* html_rewriter_{nullptr};
   net_instaweb::GoogleMessageHandler message_handler_;
   std::unique_ptr<net_instaweb::ResponseHeaders> response_headers_;
   std::unique_ptr<net_instaweb::GoogleUrl> pristine_url_;
@@ -1,3 +1,6 @@
+#include <string>
+#include <vector>
+
 #include "test/integration/http_integration.h"
 
 namespace Envoy {
@@ -53,4 +56,88 @@ TEST_P(HttpFilterPageSpeedIntegrationTest, Test1) {
 
   codec_client->close();
 }
+
+// The fake upstream serves an HTML page in several chunks, split mid-tag, as
+// an origin behind the edge would.  The page has to come back whole through
+// the RewriteDriver, re-chunked since the rewritten length is unknown.
+TEST_P(HttpFilterPageSpeedIntegrationTest, RewritesChunkedHtmlResponse) {
+  Envoy::Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"}, {":path", "/index.html"}, {":authority", "host"}};
+  const std::vector<std::string> chunks = {
+      "<html><head><title>chunked</title></head><bo",
+      "dy><p>Hello, ",
+      "world</p><a href=\"/next.html\">next</a></body></html>\n"};
+  std::string html;
+  for (const std::string& chunk : chunks) {
+    html += chunk;
+  }
+
+  IntegrationCodecClientPtr codec_client;
+  FakeHttpConnectionPtr fake_upstream_connection;
+  FakeStreamPtr request_stream;
+
+  codec_client = makeHttpConnection(lookupPort("http"));
+  auto response = codec_client->makeHeaderOnlyRequest(headers);
+  ASSERT_TRUE(fake_upstreams_[0]->waitForHttpConnection(
+      *dispatcher_, fake_upstream_connection, std::chrono::milliseconds(1000)));
+  ASSERT_TRUE(
+      fake_upstream_connection->waitForNewStream(*dispatcher_, request_stream));
+  ASSERT_TRUE(request_stream->waitForEndStream(*dispatcher_));
+
+  request_stream->encodeHeaders(
+      Envoy::Http::TestResponseHeaderMapImpl{
+          {":status", "200"},
+          {"content-type", "text/html"},
+          {"content-length", std::to_string(html.size())}},
+      false);
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    request_stream->encodeData(chunks[i], i + 1 == chunks.size());
+  }
+  response->waitForEndStream();
+
+  ASSERT_TRUE(response->complete());
+  EXPECT_EQ("200", response->headers().Status()->value().getStringView());
+  EXPECT_EQ(nullptr, response->headers().ContentLength());
+  // With the default pass-through configuration the parser must reproduce
+  // the page exactly.
+  EXPECT_EQ(html, response->body());
+
+  codec_client->close();
+}
+
+// Non-HTML responses are left alone, Content-Length included.
+TEST_P(HttpFilterPageSpeedIntegrationTest, PassesThroughNonHtmlResponse) {
+  Envoy::Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"}, {":path", "/data.txt"}, {":authority", "host"}};
+  const std::string body = "<p>not html</p>";
+
+  IntegrationCodecClientPtr codec_client;
+  FakeHttpConnectionPtr fake_upstream_connection;
+  FakeStreamPtr request_stream;
+
+  codec_client = makeHttpConnection(lookupPort("http"));
+  auto response = codec_client->makeHeaderOnlyRequest(headers);
+  ASSERT_TRUE(fake_upstreams_[0]->waitForHttpConnection(
+      *dispatcher_, fake_upstream_connection, std::chrono::milliseconds(1000)));
+  ASSERT_TRUE(
+      fake_upstream_connection->waitForNewStream(*dispatcher_, request_stream));
+  ASSERT_TRUE(request_stream->waitForEndStream(*dispatcher_));
+
+  request_stream->encodeHeaders(
+      Envoy::Http::TestResponseHeaderMapImpl{
+          {":status", "200"},
+          {"content-type", "text/plain"},
+          {"content-length", std::to_string(body.size())}},
+      false);
+  request_stream->encodeData(body, true);
+  response->waitForEndStream();
+
+  ASSERT_TRUE(response->complete());
+  ASSERT_NE(nullptr, response->headers().ContentLength());
+  EXPECT_EQ(std::to_string(body.size()),
+            response->headers().ContentLength()->value().getStringView());
+  EXPECT_EQ(body, response->body());
+
+  codec_client->close();
+}
 }  // namespace Envoy
@@ -24,6 +24,7 @@
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/stack_buffer.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -85,6 +86,18 @@ bool FileSystem::ReadFile(InputFile* input_file, int64 max_file_size,
   return ret;
 }
 
+bool FileSystem::ReadFileToSharedString(const char* filename,
+                                        int64 max_file_size,
+                                        SharedString* buffer,
+                                        MessageHandler* message_handler) {
+  GoogleString contents;
+  if (!ReadFile(filename, max_file_size, &contents, message_handler)) {
+    return false;
+  }
+  buffer->SwapWithString(&contents);
+  return true;
+}
+
 bool FileSystem::ReadFile(InputFile* input_file, int64 max_file_size,
                           Writer* writer, MessageHandler* message_handler) {
   bool ret = false;
@@ -60,6 +60,7 @@ class BoolOrError {
 };
 
 class MessageHandler;
+class SharedString;
 class Timer;
 class Writer;
 
@@ -181,6 +182,16 @@ class FileSystem {
                         MessageHandler* handler);
   virtual bool ReadFile(InputFile* input_file, Writer* writer,
                         MessageHandler* handler);
+  // Reads a whole file into *buffer, replacing its previous contents.  The
+  // default implementation reads into a string and swaps it in, but file
+  // systems may instead map large files into memory, leaving *buffer
+  // referencing the kernel's page cache with no copy at all.  The mapping
+  // lasts as long as any SharedString linked to *buffer, so callers must
+  // only use this on files that are replaced by rename, as
+  // WriteFileAtomic does, and never truncated or rewritten in place.
+  virtual bool ReadFileToSharedString(const char* filename,
+                                      int64 max_file_size, SharedString* buffer,
+                                      MessageHandler* handler);
   // Non-atomic. Use WriteFileAtomic() for atomic version.
   virtual bool WriteFile(const char* filename, const StringPiece& buffer,
                          MessageHandler* handler);
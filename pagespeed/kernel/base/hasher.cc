@@ -28,14 +28,50 @@
 
 namespace net_instaweb {
 
+namespace {
+
+class BufferingStream : public Hasher::Stream {
+ public:
+  explicit BufferingStream(const Hasher* hasher) : Hasher::Stream(hasher) {}
+  ~BufferingStream() override {}
+
+  void Update(const StringPiece& content) override {
+    content.AppendToString(&content_);
+  }
+
+  GoogleString RawFinalize() override {
+    GoogleString raw_hash = hasher()->RawHash(content_);
+    content_.clear();
+    return raw_hash;
+  }
+
+ private:
+  GoogleString content_;
+
+  DISALLOW_COPY_AND_ASSIGN(BufferingStream);
+};
+
+}  // namespace
+
+Hasher::Stream::~Stream() {}
+
+GoogleString Hasher::Stream::Finalize() {
+  return hasher_->EncodeRawHash(RawFinalize());
+}
+
 Hasher::Hasher(int max_chars) : max_chars_(max_chars) {
   CHECK_LE(0, max_chars);
 }
 
 Hasher::~Hasher() {}
 
+Hasher::Stream* Hasher::NewStream() const { return new BufferingStream(this); }
+
 GoogleString Hasher::Hash(const StringPiece& content) const {
-  GoogleString raw_hash = RawHash(content);
+  return EncodeRawHash(RawHash(content));
+}
+
+GoogleString Hasher::EncodeRawHash(const GoogleString& raw_hash) const {
   GoogleString out;
   Web64Encode(raw_hash, &out);
 
@@ -31,6 +31,35 @@ namespace net_instaweb {
 
 class Hasher {
  public:
+  // Computes a hash of content that arrives in pieces, such as a response
+  // body as it is fetched.  The result is the same as hashing all the
+  // pieces concatenated with the Hasher that made the Stream.  A Stream is
+  // not thread-safe, and must not outlive its Hasher.
+  class Stream {
+   public:
+    virtual ~Stream();
+
+    virtual void Update(const StringPiece& content) = 0;
+
+    // Returns the binary hash of everything passed to Update, as RawHash
+    // would.  This ends the stream; Update must not be called afterwards.
+    virtual GoogleString RawFinalize() = 0;
+
+    // Returns the web64-encoded hash of everything passed to Update, as
+    // Hash would.  This ends the stream, like RawFinalize.
+    GoogleString Finalize();
+
+   protected:
+    explicit Stream(const Hasher* hasher) : hasher_(hasher) {}
+
+    const Hasher* hasher() const { return hasher_; }
+
+   private:
+    const Hasher* hasher_;
+
+    DISALLOW_COPY_AND_ASSIGN(Stream);
+  };
+
   // The passed in max_chars will be used to limit the length of
   // Hash() and HashSizeInChars()
   explicit Hasher(int max_chars);
@@ -61,7 +90,18 @@ class Hasher {
   // The number of bytes RawHash will produce.
   virtual int RawHashSizeInBytes() const = 0;
 
+  // Returns a new Stream, owned by the caller.  This operation is
+  // thread-safe.
+  //
+  // The default implementation collects all the content and calls RawHash
+  // on it when finalized.  Hashers that can work incrementally override it
+  // so the content needn't be kept.
+  virtual Stream* NewStream() const;
+
  private:
+  // Web64-encodes raw_hash and truncates it to HashSizeInChars().
+  GoogleString EncodeRawHash(const GoogleString& raw_hash) const;
+
   int max_chars_;  // limit on length of Hash/HashSizeInChars set by subclass.
 
   DISALLOW_COPY_AND_ASSIGN(Hasher);
@@ -33,6 +33,29 @@ namespace {
 
 // const int kMD5NumBytes = sizeof(MD5Digest);
 
+class MD5Stream : public Hasher::Stream {
+ public:
+  explicit MD5Stream(const Hasher* hasher) : Hasher::Stream(hasher) {
+    MD5_Init(&context_);
+  }
+  ~MD5Stream() override {}
+
+  void Update(const StringPiece& content) override {
+    MD5_Update(&context_, content.data(), content.size());
+  }
+
+  GoogleString RawFinalize() override {
+    unsigned char result[MD5_DIGEST_LENGTH];
+    MD5_Final(result, &context_);
+    return GoogleString(reinterpret_cast<char*>(result), MD5_DIGEST_LENGTH);
+  }
+
+ private:
+  MD5_CTX context_;
+
+  DISALLOW_COPY_AND_ASSIGN(MD5Stream);
+};
+
 }  // namespace
 
 MD5Hasher::~MD5Hasher() {}
@@ -56,4 +79,6 @@ GoogleString MD5Hasher::RawHash(const StringPiece& content) const {
 
 int MD5Hasher::RawHashSizeInBytes() const { return MD5_DIGEST_LENGTH; }
 
+Hasher::Stream* MD5Hasher::NewStream() const { return new MD5Stream(this); }
+
 }  // namespace net_instaweb
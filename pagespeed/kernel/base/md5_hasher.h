@@ -37,6 +37,7 @@ class MD5Hasher : public Hasher {
 
   GoogleString RawHash(const StringPiece& content) const override;
   int RawHashSizeInBytes() const override;
+  Stream* NewStream() const override;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(MD5Hasher);
@@ -35,6 +35,8 @@
 
 namespace net_instaweb {
 
+SharedString::ExternalStorage::~ExternalStorage() {}
+
 SharedString::SharedString() : skip_(0), size_(0) {}
 
 SharedString::SharedString(const StringPiece& str)
@@ -60,11 +62,15 @@ SharedString::SharedString(const char* str) : skip_(0) {
 }
 
 SharedString::SharedString(const SharedString& src)
-    : ref_string_(src.ref_string_), skip_(src.skip_), size_(src.size_) {}
+    : ref_string_(src.ref_string_),
+      external_(src.external_),
+      skip_(src.skip_),
+      size_(src.size_) {}
 
 SharedString& SharedString::operator=(const SharedString& src) {
   if (&src != this) {
     ref_string_ = src.ref_string_;
+    external_ = src.external_;
     skip_ = src.skip_;
     size_ = src.size_;
   }
@@ -72,9 +78,8 @@ SharedString& SharedString::operator=(const SharedString& src) {
 }
 
 StringPiece SharedString::Value() const {
-  const GoogleString* storage = ref_string_.get();
-  DCHECK_LE(size_ + skip_, static_cast<int>(storage->size()));
-  return StringPiece(storage->data() + skip_, size_);
+  DCHECK_LE(size_ + skip_, storage_size());
+  return StringPiece(storage_data() + skip_, size_);
 }
 
 void SharedString::Assign(const char* data, int size) {
@@ -82,11 +87,18 @@ void SharedString::Assign(const char* data, int size) {
   // avoid bugs by copying to a temp and swapping.
   GoogleString temp(data, size);
   ClearIfShared();
+  external_.clear();
   GoogleString* storage = ref_string_.get();
   temp.swap(*storage);
   size_ = storage->size();
 }
 
+void SharedString::CopyExternalStorage() {
+  if (has_external_storage()) {
+    *this = SharedString(Value());
+  }
+}
+
 void SharedString::UniquifyIfTruncated() {
   if (size_ != (static_cast<int>(ref_string_->size()) - skip_)) {
     if (unique()) {
@@ -101,6 +113,7 @@ void SharedString::UniquifyIfTruncated() {
 void SharedString::Append(const char* new_data, size_t new_size) {
   DCHECK((new_data + new_size) <= data() || (data() + size() < new_data))
       << "Append must be given non-overlapping strings";
+  CopyExternalStorage();
   UniquifyIfTruncated();
   ref_string_->append(new_data, new_size);
   size_ += new_size;
@@ -108,6 +121,7 @@ void SharedString::Append(const char* new_data, size_t new_size) {
 
 void SharedString::Extend(int new_size) {
   if (size_ < new_size) {
+    CopyExternalStorage();
     UniquifyIfTruncated();
     size_ = new_size;
     ref_string_.get()->resize(size_ + skip_);
@@ -120,10 +134,12 @@ void SharedString::WriteAt(int dest_offset, const char* source, int count) {
   if (count > size() - dest_offset) {
     count = std::max(0, size() - dest_offset);
   }
+  CopyExternalStorage();
   memcpy(mutable_data() + dest_offset, source, count);
 }
 
 void SharedString::SwapWithString(GoogleString* str) {
+  CopyExternalStorage();
   ClearIfShared();
   GoogleString* storage = ref_string_.get();
   storage->swap(*str);
@@ -131,6 +147,14 @@ void SharedString::SwapWithString(GoogleString* str) {
   size_ = storage->size();
 }
 
+void SharedString::AdoptExternalStorage(ExternalStorage* storage) {
+  // Don't share the old ref_string_, or SharesStorage would consider this
+  // linked with its former copies.
+  DetachAndClear();
+  external_.reset(storage);
+  size_ = storage->size();
+}
+
 void SharedString::DetachAndClear() {
   SharedString empty_string;
   *this = empty_string;  // Detaches other strings sharing this value.
@@ -41,6 +41,25 @@ namespace net_instaweb {
 // SharedString instance's view of it via RemoveSuffix() and RemovePrefix().
 class SharedString {
  public:
+  // Read-only memory owned outside of any GoogleString, such as a
+  // memory-mapped file, which a SharedString can reference without copying.
+  // Subclasses release the memory in their destructor, which runs once the
+  // last SharedString referencing it is destroyed or detached.
+  class ExternalStorage : public RefCounted<ExternalStorage> {
+   public:
+    ExternalStorage(const char* data, int size) : data_(data), size_(size) {}
+    virtual ~ExternalStorage();
+
+    const char* data() const { return data_; }
+    int size() const { return size_; }
+
+   private:
+    const char* data_;
+    int size_;
+
+    DISALLOW_COPY_AND_ASSIGN(ExternalStorage);
+  };
+
   SharedString();
 
   explicit SharedString(const StringPiece& str);
@@ -109,6 +128,16 @@ class SharedString {
   // previously-linked SharedStrings.
   void SwapWithString(GoogleString* str);
 
+  // Makes this reference the contents of storage, which it takes ownership
+  // of, detaching from any previously-linked SharedStrings.  Copies share
+  // the external storage as they would a string.  Since it is read-only,
+  // any mutation (Append, Extend, WriteAt, ...) first copies the visible
+  // bytes to ordinary string storage, detaching this from the other copies.
+  void AdoptExternalStorage(ExternalStorage* storage);
+
+  // Determines whether this references ExternalStorage.
+  bool has_external_storage() const { return external_.get() != nullptr; }
+
   // Clears the contents of the string, and erases any removed prefix
   // or suffix, detaching from any other previously-linked SharedStrings.
   void DetachAndClear();
@@ -126,12 +155,12 @@ class SharedString {
   // Computes the size, taking into account any removed prefix or suffix.
   int size() const { return size_; }
   bool empty() const { return size_ == 0; }
-  const char* data() const { return ref_string_->data() + skip_; }
+  const char* data() const { return storage_data() + skip_; }
 
   // WriteAt allows mutation of the underlying string data.  The
   // string must already be sized as needed via previous Append() or
   // Extend() calls.  Mutations done via this method will affect all
-  // references to the underlying storage.
+  // references to the underlying storage, unless it is ExternalStorage.
   void WriteAt(int dest_offset, const char* source, int count);
 
   // Disassociates this SharedString with any others that have linked
@@ -150,9 +179,7 @@ class SharedString {
   // Determines whether RemovePrefix or RemoveSuffix has every been called
   // on this SharedString.  Note that other SharedStrings sharing the
   // same storage as this may be trimmed differently.
-  bool trimmed() const {
-    return size_ != static_cast<int>(ref_string_->size());
-  }
+  bool trimmed() const { return size_ != storage_size(); }
 
   // Returns back a GoogleString* representation for the contained value.
   //
@@ -164,15 +191,28 @@ class SharedString {
   // the data via the StringPiece returned from Value().
   //
   // This routine is, however, useful to call from tests to determine
-  // storage uniqueness.
-  const GoogleString* StringValue() const { return ref_string_.get(); }
+  // storage uniqueness.  It must not be called with ExternalStorage.
+  const GoogleString* StringValue() const {
+    DCHECK(!has_external_storage());
+    return ref_string_.get();
+  }
 
-  // Determines whether this and that share the same storage.
+  // Determines whether this and that share the same storage.  Copies of a
+  // SharedString with ExternalStorage share both it and ref_string_, so
+  // comparing the latter suffices.
   bool SharesStorage(const SharedString& that) const {
     return ref_string_.get() == that.ref_string_.get();
   }
 
  private:
+  const char* storage_data() const {
+    return has_external_storage() ? external_->data() : ref_string_->data();
+  }
+  int storage_size() const {
+    return has_external_storage() ? external_->size()
+                                  : static_cast<int>(ref_string_->size());
+  }
+  void CopyExternalStorage();
   void UniquifyIfTruncated();
   char* mutable_data() { return &(*ref_string_.get())[0] + skip_; }
   void ClearIfShared() {
@@ -183,6 +223,9 @@ class SharedString {
 
   RefCountedObj<GoogleString> ref_string_;
 
+  // If set, the value lives here rather than in ref_string_, which is empty.
+  RefCountedPtr<ExternalStorage> external_;
+
   int skip_;  // Number of bytes to skip at the beginning of the string.
   int size_;  // Number of bytes visible in the current view.
 };
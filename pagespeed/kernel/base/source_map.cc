@@ -22,12 +22,107 @@
 #include "base/logging.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/json.h"
+#include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/writer.h"
 
 namespace net_instaweb {
 
 namespace source_map {
 
+namespace {
+
+// StreamingEncoder writes out its buffered mappings once they reach this size.
+const size_t kStreamingBufferSize = 32 * 1024;
+
+// Appends the encoding of mapping to result, given the mapping before it (or
+// NULL if it's the first) and the generated line that result has reached.
+bool AppendMapping(const Mapping* prev, const Mapping& mapping,
+                   int* current_gen_line, GoogleString* result) {
+  if (mapping.gen_line < *current_gen_line) {
+    LOG(DFATAL) << "Mappings are not sorted.";
+    return false;
+  }
+
+  // Segments are comma-separated, but there's no comma after the last segment
+  // on a line.
+  bool first_segment_in_line = true;
+  if (prev != nullptr && mapping.gen_line == *current_gen_line) {
+    *result += ",";
+    first_segment_in_line = false;
+  }
+
+  // gen_line is not encoded into the fields, instead each line in the
+  // generated file is ; delineated in the VLQ.
+  while (mapping.gen_line > *current_gen_line) {
+    *result += ";";
+    ++*current_gen_line;
+  }
+
+  // Fields to encode in base64 VLQ.
+  // 1) Generated column number
+  if (first_segment_in_line) {
+    // First segment for each line must list absolute column number.
+    *result += EncodeVlq(mapping.gen_col);
+  } else {
+    // Subsequent ones will list column number as a diff from previous one
+    // as a space saving measure.
+    *result += EncodeVlq(mapping.gen_col - prev->gen_col);
+  }
+
+  // 2) Source file number, 3) Source line number, 4) Source column number.
+  // The first segment of the file must list absolute numbers; subsequent ones
+  // list diffs.
+  if (prev == nullptr) {
+    *result += EncodeVlq(mapping.src_file);
+    *result += EncodeVlq(mapping.src_line);
+    *result += EncodeVlq(mapping.src_col);
+  } else {
+    *result += EncodeVlq(mapping.src_file - prev->src_file);
+    *result += EncodeVlq(mapping.src_line - prev->src_line);
+    *result += EncodeVlq(mapping.src_col - prev->src_col);
+  }
+
+  // Note: We do not add (5) Names.
+  return true;
+}
+
+// Splits the JSON source map for the given URLs around its (empty) mappings
+// string, so the mappings can be encoded separately.
+void EncodeJsonAroundMappings(StringPiece generated_url, StringPiece source_url,
+                              GoogleString* prefix, GoogleString* suffix) {
+  Json::Value json;
+  json["version"] = 3;
+  if (!generated_url.empty()) {
+    json["file"] = PercentEncode(generated_url).c_str();
+  }
+  // Sources array with one value.
+  json["sources"][0] = PercentEncode(source_url).c_str();
+  // Note: We do not provide names functionality.
+  json["names"] = Json::arrayValue;  // Empty array.
+  json["mappings"] = "";
+
+  // Standard XSSI protection.
+  // http://www.html5rocks.com/en/tutorials/developertools/sourcemaps/#toc-xssi
+  GoogleString encoded = ")]}'\n";
+  Json::StreamWriterBuilder builder;
+  builder["commentStyle"] = "None";
+  builder["indentation"] = "";
+  encoded += Json::writeString(builder, json);
+
+  // Any quote inside the file URL is escaped, so this can only match the
+  // mappings field itself.
+  static const char kEmptyMappings[] = "\"mappings\":\"\"";
+  const size_t pos = encoded.find(kEmptyMappings);
+  CHECK_NE(GoogleString::npos, pos) << encoded;
+  const size_t split = pos + STATIC_STRLEN(kEmptyMappings) - 1;
+  prefix->assign(encoded, 0, split);
+  suffix->assign(encoded, split, GoogleString::npos);
+}
+
+}  // namespace
+
 char EncodeBase64(int val) {
   // Note: This constant also exists in
   // third_party/instaweb/src/third_party/base64/base64.cc
@@ -93,66 +188,12 @@ GoogleString EncodeVlq(const int32 input_val) {
 // ,-separated lists of base64 VLQ values.
 bool EncodeMappings(const MappingVector& mappings, GoogleString* result) {
   int current_gen_line = 0;
-  bool first_segment_in_line = true;
   for (int i = 0, mappings_size = mappings.size(); i < mappings_size; ++i) {
-    if (mappings[i].gen_line < current_gen_line) {
-      LOG(DFATAL) << "Mappings are not sorted.";
+    if (!AppendMapping(i == 0 ? nullptr : &mappings[i - 1], mappings[i],
+                       &current_gen_line, result)) {
       return false;
     }
-
-    // gen_line is not encoded into the fields, instead each line in the
-    // generated file is ; delineated in the VLQ.
-    while (mappings[i].gen_line > current_gen_line) {
-      *result += ";";
-      first_segment_in_line = true;
-      ++current_gen_line;
-    }
-
-    // Fields to encode in base64 VLQ.
-    // 1) Generated column number
-    if (first_segment_in_line) {
-      // First segment for each line must list absolute column number.
-      *result += EncodeVlq(mappings[i].gen_col);
-    } else {
-      // Subsequent ones will list column number as a diff from previous one
-      // as a space saving measure.
-      *result += EncodeVlq(mappings[i].gen_col - mappings[i - 1].gen_col);
-    }
-
-    // 2) Source file number
-    if (i == 0) {
-      // First segment of the file must list absolute numbers.
-      *result += EncodeVlq(mappings[i].src_file);
-    } else {
-      // Subsequent ones list diffs.
-      *result += EncodeVlq(mappings[i].src_file - mappings[i - 1].src_file);
-    }
-
-    // 3) Source line number
-    if (i == 0) {
-      *result += EncodeVlq(mappings[i].src_line);
-    } else {
-      *result += EncodeVlq(mappings[i].src_line - mappings[i - 1].src_line);
-    }
-
-    // 4) Source column number
-    if (i == 0) {
-      *result += EncodeVlq(mappings[i].src_col);
-    } else {
-      *result += EncodeVlq(mappings[i].src_col - mappings[i - 1].src_col);
-    }
-
-    // Note: We do not add (5) Names.
-
-    first_segment_in_line = false;
-
-    // Segments are comma-separated, but don't add a trailing comma nor a comma
-    // if a semicolon (line change) will be added.
-    if (i + 1 < mappings_size && mappings[i + 1].gen_line == current_gen_line) {
-      *result += ",";
-    }
   }
-
   return true;
 }
 
@@ -179,29 +220,49 @@ bool Encode(StringPiece generated_url, StringPiece source_url,
   GoogleString encoded_mappings;
   bool success = EncodeMappings(mappings, &encoded_mappings);
   if (success) {
-    Json::Value json;
-    json["version"] = 3;
-    if (!generated_url.empty()) {
-      json["file"] = PercentEncode(generated_url).c_str();
-    }
-    // Sources array with one value.
-    json["sources"][0] = PercentEncode(source_url).c_str();
-    // Note: We do not provide names functionality.
-    json["names"] = Json::arrayValue;  // Empty array.
-    json["mappings"] = encoded_mappings.c_str();
-
-    // Standard XSSI protection.
-    // http://www.html5rocks.com/en/tutorials/developertools/sourcemaps/#toc-xssi
-    *encoded_source_map += ")]}'\n";
-    Json::StreamWriterBuilder builder;
-    builder["commentStyle"] = "None";
-    builder["indentation"] = "";
-    *encoded_source_map +=
-        Json::writeString(builder, json);  //xriter.write(json);
+    GoogleString prefix, suffix;
+    EncodeJsonAroundMappings(generated_url, source_url, &prefix, &suffix);
+    StrAppend(encoded_source_map, prefix, encoded_mappings, suffix);
   }
   return success;
 }
 
+StreamingEncoder::StreamingEncoder(StringPiece generated_url,
+                                   StringPiece source_url, Writer* writer,
+                                   MessageHandler* handler)
+    : writer_(writer),
+      handler_(handler),
+      current_gen_line_(0),
+      num_mappings_(0),
+      ok_(true) {
+  EncodeJsonAroundMappings(generated_url, source_url, &buffer_, &suffix_);
+}
+
+StreamingEncoder::~StreamingEncoder() {}
+
+bool StreamingEncoder::AddMapping(const Mapping& mapping) {
+  ok_ = ok_ && AppendMapping(num_mappings_ == 0 ? nullptr : &prev_, mapping,
+                             &current_gen_line_, &buffer_);
+  prev_ = mapping;
+  ++num_mappings_;
+  if (ok_ && buffer_.size() >= kStreamingBufferSize) {
+    ok_ = WriteBuffer();
+  }
+  return ok_;
+}
+
+bool StreamingEncoder::Finish() {
+  buffer_ += suffix_;
+  ok_ = ok_ && WriteBuffer();
+  return ok_;
+}
+
+bool StreamingEncoder::WriteBuffer() {
+  const bool ret = writer_->Write(buffer_, handler_);
+  buffer_.clear();
+  return ret;
+}
+
 }  // namespace source_map
 
 }  // namespace net_instaweb
@@ -33,6 +33,9 @@
 
 namespace net_instaweb {
 
+class MessageHandler;
+class Writer;
+
 namespace source_map {
 
 // Declares a mapping between a line # and column # in generated file
@@ -65,6 +68,44 @@ bool Encode(StringPiece generated_url,  // optional: "" to ignore.
             // mappings MUST already be sorted by gen_line and then gen_col.
             const MappingVector& mappings, GoogleString* encoded_source_map);
 
+// Streams the same bytes Encode() would produce out to a Writer, one mapping
+// at a time, so that the caller doesn't need to hold every mapping (nor the
+// whole encoded map) in memory.  Mappings MUST be added in order of gen_line
+// and then gen_col.
+class StreamingEncoder {
+ public:
+  // Neither URL need outlive the encoder.  Does not take ownership of writer
+  // or handler.
+  StreamingEncoder(StringPiece generated_url,  // optional: "" to ignore.
+                   StringPiece source_url, Writer* writer,
+                   MessageHandler* handler);
+  ~StreamingEncoder();
+
+  // Encodes mapping, writing it out along with any others that have
+  // accumulated once there are enough of them.  Returns false if mapping is
+  // out of order or the write failed, after which all calls fail.
+  bool AddMapping(const Mapping& mapping);
+
+  // Writes out any remaining mappings and the end of the source map.
+  bool Finish();
+
+  int num_mappings() const { return num_mappings_; }
+
+ private:
+  bool WriteBuffer();
+
+  Writer* writer_;
+  MessageHandler* handler_;
+  GoogleString buffer_;  // Starts out holding everything before the mappings.
+  GoogleString suffix_;  // Everything after the mappings.
+  Mapping prev_;
+  int current_gen_line_;
+  int num_mappings_;
+  bool ok_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamingEncoder);
+};
+
 // TODO(sligocki)-maybe: Do we want a decoder as well? Might be nice for
 // testing purposes, then we could throw a lot of random examples at it and
 // make sure they Encode -> Decode back to the original.
@@ -50,7 +50,9 @@ class Variable {
   // implementation has some sensible way of doing so.
   virtual StringPiece GetName() const = 0;
 
-  // Adds 'delta' to the variable's value, returning the result.
+  // Adds 'delta' to the variable's value, returning the result.  Sharded
+  // implementations may return only the result for the caller's shard; use
+  // Get() when the total is needed.
   int64 Add(int64 non_negative_delta) {
     DCHECK_LE(0, non_negative_delta);
     return AddHelper(non_negative_delta);
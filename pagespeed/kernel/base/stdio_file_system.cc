@@ -31,6 +31,8 @@
 #include <windows.h>
 #else
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #endif  // WIN32
 
@@ -45,6 +47,7 @@
 #include "pagespeed/kernel/base/file_system.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/timer.h"
@@ -207,6 +210,24 @@ class StdioOutputFile : public FileSystem::OutputFile {
   DISALLOW_COPY_AND_ASSIGN(StdioOutputFile);
 };
 
+#ifndef WIN32
+
+// Read-only mapping of a whole file, unmapped when the last SharedString
+// referencing it goes away.
+class StdioMappedFile : public SharedString::ExternalStorage {
+ public:
+  StdioMappedFile(void* addr, int size)
+      : ExternalStorage(static_cast<const char*>(addr), size) {}
+  ~StdioMappedFile() override {
+    munmap(const_cast<char*>(data()), size());
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(StdioMappedFile);
+};
+
+#endif  // WIN32
+
 StdioFileSystem::StdioFileSystem()
     : slow_file_latency_threshold_us_(0),
       timer_(nullptr),
@@ -301,6 +322,70 @@ FileSystem::InputFile* StdioFileSystem::OpenInputFile(
   return input_file;
 }
 
+bool StdioFileSystem::ReadFileToSharedString(const char* filename,
+                                             int64 max_file_size,
+                                             SharedString* buffer,
+                                             MessageHandler* message_handler) {
+#ifdef WIN32
+  return FileSystem::ReadFileToSharedString(filename, max_file_size, buffer,
+                                            message_handler);
+#else
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    message_handler->Error(filename, 0, "opening input file: %s",
+                           strerror(errno));
+    return false;
+  }
+  bool ret = false;
+  const char* error = nullptr;
+  struct stat statbuf;
+  int64 start_us = StartTimer();
+  if (fstat(fd, &statbuf) < 0) {
+    error = "stating file";
+  } else if (max_file_size != FileSystem::kUnlimitedSize &&
+             statbuf.st_size > max_file_size) {
+    // Too big; fail quietly, like ReadFile.
+  } else if (statbuf.st_size > std::numeric_limits<int>::max()) {
+    errno = EFBIG;  // SharedString sizes are ints.
+    error = "reading file";
+  } else if (statbuf.st_size < kMinMappedFileSize) {
+    // Small files are cheaper to copy than to map and later unmap.
+    GoogleString contents(statbuf.st_size, '\0');
+    ssize_t nread = 0;
+    while (nread < statbuf.st_size) {
+      ssize_t n = read(fd, &contents[nread], statbuf.st_size - nread);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      } else if (n <= 0) {
+        break;
+      }
+      nread += n;
+    }
+    if (nread != statbuf.st_size) {
+      error = "reading file";
+    } else {
+      buffer->SwapWithString(&contents);
+      ret = true;
+    }
+  } else {
+    void* addr = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      error = "mapping file";
+    } else {
+      buffer->AdoptExternalStorage(new StdioMappedFile(addr, statbuf.st_size));
+      ret = true;
+    }
+  }
+  if (error != nullptr) {
+    message_handler->Message(kError, "%s: %s %d(%s)", filename, error, errno,
+                             strerror(errno));
+  }
+  EndTimer(filename, "ReadFileToSharedString", start_us);
+  close(fd);
+  return ret;
+#endif  // WIN32
+}
+
 FileSystem::OutputFile* StdioFileSystem::OpenOutputFileHelper(
     const char* filename, bool append, MessageHandler* message_handler) {
   FileSystem::OutputFile* output_file = nullptr;
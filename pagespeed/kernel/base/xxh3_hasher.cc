@@ -0,0 +1,492 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// This follows the reference implementation of XXH3 in xxHash 0.8
+// (https://github.com/Cyan4973/xxHash, BSD licensed), specialized to the
+// default secret and a seed of zero, and without the hand-written SIMD
+// variants: the stripe loops below work on eight independent 64-bit lanes,
+// which compilers vectorize by themselves.
+
+#include "pagespeed/kernel/base/xxh3_hasher.h"
+
+#include <cstddef>
+#include <cstring>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const uint64 kPrime32_1 = 0x9E3779B1ULL;
+const uint64 kPrime32_2 = 0x85EBCA77ULL;
+const uint64 kPrime32_3 = 0xC2B2AE3DULL;
+const uint64 kPrime64_1 = 0x9E3779B185EBCA87ULL;
+const uint64 kPrime64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64 kPrime64_3 = 0x165667B19E3779F9ULL;
+const uint64 kPrime64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64 kPrime64_5 = 0x27D4EB2F165667C5ULL;
+
+const size_t kRawHashBytes = 16;
+const size_t kStripeLen = 64;
+const size_t kSecretConsumeRate = 8;
+const size_t kAccNb = kStripeLen / sizeof(uint64);
+const size_t kMidSizeMax = 240;
+const size_t kSecretSizeMin = 136;
+const size_t kSecretMergeAccsStart = 11;
+const size_t kSecretLastAccStart = 7;
+const size_t kSecretSize = 192;
+const size_t kStripesPerBlock = (kSecretSize - kStripeLen) / kSecretConsumeRate;
+const size_t kBlockLen = kStripeLen * kStripesPerBlock;
+const size_t kStreamBufferSize = 256;
+const size_t kStreamBufferStripes = kStreamBufferSize / kStripeLen;
+
+const unsigned char kSecret[kSecretSize] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+    0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+    0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+    0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+    0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+    0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+    0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+    0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+    0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+    0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+    0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+    0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+    0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+struct Hash128 {
+  uint64 low;
+  uint64 high;
+};
+
+// XXH3 is defined on little-endian words.  Compilers turn these into plain
+// loads on little-endian machines.
+inline uint32 Read32(const unsigned char* p) {
+  return static_cast<uint32>(p[0]) | (static_cast<uint32>(p[1]) << 8) |
+         (static_cast<uint32>(p[2]) << 16) | (static_cast<uint32>(p[3]) << 24);
+}
+
+inline uint64 Read64(const unsigned char* p) {
+  return static_cast<uint64>(Read32(p)) |
+         (static_cast<uint64>(Read32(p + 4)) << 32);
+}
+
+inline uint32 Swap32(uint32 x) {
+  return ((x << 24) & 0xff000000U) | ((x << 8) & 0x00ff0000U) |
+         ((x >> 8) & 0x0000ff00U) | ((x >> 24) & 0x000000ffU);
+}
+
+inline uint64 Swap64(uint64 x) {
+  return (static_cast<uint64>(Swap32(static_cast<uint32>(x))) << 32) |
+         Swap32(static_cast<uint32>(x >> 32));
+}
+
+inline uint32 Rotl32(uint32 x, int r) { return (x << r) | (x >> (32 - r)); }
+
+inline Hash128 Mult64To128(uint64 lhs, uint64 rhs) {
+  unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+  Hash128 result = {static_cast<uint64>(product),
+                    static_cast<uint64>(product >> 64)};
+  return result;
+}
+
+inline uint64 Mul128Fold64(uint64 lhs, uint64 rhs) {
+  Hash128 product = Mult64To128(lhs, rhs);
+  return product.low ^ product.high;
+}
+
+inline uint64 XorShift64(uint64 v, int shift) { return v ^ (v >> shift); }
+
+inline uint64 XXH64Avalanche(uint64 h) {
+  h ^= h >> 33;
+  h *= kPrime64_2;
+  h ^= h >> 29;
+  h *= kPrime64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+inline uint64 Avalanche(uint64 h) {
+  h = XorShift64(h, 37);
+  h *= 0x165667919E3779F9ULL;
+  h = XorShift64(h, 32);
+  return h;
+}
+
+Hash128 Len1To3(const unsigned char* input, size_t len) {
+  uint32 c1 = input[0];
+  uint32 c2 = input[len >> 1];
+  uint32 c3 = input[len - 1];
+  uint32 combined_low = (c1 << 16) | (c2 << 24) | c3 |
+                        (static_cast<uint32>(len) << 8);
+  uint32 combined_high = Rotl32(Swap32(combined_low), 13);
+  uint64 bitflip_low = Read32(kSecret) ^ Read32(kSecret + 4);
+  uint64 bitflip_high = Read32(kSecret + 8) ^ Read32(kSecret + 12);
+  Hash128 h = {XXH64Avalanche(combined_low ^ bitflip_low),
+               XXH64Avalanche(combined_high ^ bitflip_high)};
+  return h;
+}
+
+Hash128 Len4To8(const unsigned char* input, size_t len) {
+  uint64 input_low = Read32(input);
+  uint64 input_high = Read32(input + len - 4);
+  uint64 input64 = input_low + (input_high << 32);
+  uint64 bitflip = Read64(kSecret + 16) ^ Read64(kSecret + 24);
+  uint64 keyed = input64 ^ bitflip;
+
+  Hash128 m = Mult64To128(keyed, kPrime64_1 + (len << 2));
+  m.high += m.low << 1;
+  m.low ^= m.high >> 3;
+  m.low = XorShift64(m.low, 35);
+  m.low *= 0x9FB21C651E98DF25ULL;
+  m.low = XorShift64(m.low, 28);
+  m.high = Avalanche(m.high);
+  return m;
+}
+
+Hash128 Len9To16(const unsigned char* input, size_t len) {
+  uint64 bitflip_low = Read64(kSecret + 32) ^ Read64(kSecret + 40);
+  uint64 bitflip_high = Read64(kSecret + 48) ^ Read64(kSecret + 56);
+  uint64 input_low = Read64(input);
+  uint64 input_high = Read64(input + len - 8);
+
+  Hash128 m = Mult64To128(input_low ^ input_high ^ bitflip_low, kPrime64_1);
+  m.low += static_cast<uint64>(len - 1) << 54;
+  input_high ^= bitflip_high;
+  m.high += input_high + (input_high & 0xffffffffULL) * (kPrime32_2 - 1);
+  m.low ^= Swap64(m.high);
+
+  Hash128 h = Mult64To128(m.low, kPrime64_2);
+  h.high += m.high * kPrime64_2;
+  h.low = Avalanche(h.low);
+  h.high = Avalanche(h.high);
+  return h;
+}
+
+Hash128 Len0To16(const unsigned char* input, size_t len) {
+  if (len > 8) {
+    return Len9To16(input, len);
+  } else if (len >= 4) {
+    return Len4To8(input, len);
+  } else if (len > 0) {
+    return Len1To3(input, len);
+  }
+  Hash128 h = {XXH64Avalanche(Read64(kSecret + 64) ^ Read64(kSecret + 72)),
+               XXH64Avalanche(Read64(kSecret + 80) ^ Read64(kSecret + 88))};
+  return h;
+}
+
+inline uint64 Mix16(const unsigned char* input, const unsigned char* secret) {
+  return Mul128Fold64(Read64(input) ^ Read64(secret),
+                      Read64(input + 8) ^ Read64(secret + 8));
+}
+
+inline void Mix32(Hash128* acc, const unsigned char* input1,
+                  const unsigned char* input2, const unsigned char* secret) {
+  acc->low += Mix16(input1, secret);
+  acc->low ^= Read64(input2) + Read64(input2 + 8);
+  acc->high += Mix16(input2, secret + 16);
+  acc->high ^= Read64(input1) + Read64(input1 + 8);
+}
+
+Hash128 FinishShort(const Hash128& acc, size_t len) {
+  uint64 low = acc.low + acc.high;
+  uint64 high = acc.low * kPrime64_1 + acc.high * kPrime64_4 +
+                static_cast<uint64>(len) * kPrime64_2;
+  Hash128 h = {Avalanche(low), 0 - Avalanche(high)};
+  return h;
+}
+
+Hash128 Len17To128(const unsigned char* input, size_t len) {
+  Hash128 acc = {len * kPrime64_1, 0};
+  if (len > 32) {
+    if (len > 64) {
+      if (len > 96) {
+        Mix32(&acc, input + 48, input + len - 64, kSecret + 96);
+      }
+      Mix32(&acc, input + 32, input + len - 48, kSecret + 64);
+    }
+    Mix32(&acc, input + 16, input + len - 32, kSecret + 32);
+  }
+  Mix32(&acc, input, input + len - 16, kSecret);
+  return FinishShort(acc, len);
+}
+
+Hash128 Len129To240(const unsigned char* input, size_t len) {
+  Hash128 acc = {len * kPrime64_1, 0};
+  size_t rounds = len / 32;
+  for (size_t i = 0; i < 4; ++i) {
+    Mix32(&acc, input + 32 * i, input + 32 * i + 16, kSecret + 32 * i);
+  }
+  acc.low = Avalanche(acc.low);
+  acc.high = Avalanche(acc.high);
+  for (size_t i = 4; i < rounds; ++i) {
+    Mix32(&acc, input + 32 * i, input + 32 * i + 16,
+          kSecret + 3 + 32 * (i - 4));
+  }
+  // The last 32 bytes, with the halves swapped.
+  Mix32(&acc, input + len - 16, input + len - 32,
+        kSecret + kSecretSizeMin - 17 - 16);
+  return FinishShort(acc, len);
+}
+
+// The long-input path works on 64-byte stripes, each folded into eight
+// 64-bit accumulators.  Keep these as simple loops over the lanes.
+inline void Accumulate512(uint64* acc, const unsigned char* input,
+                          const unsigned char* secret) {
+  for (size_t i = 0; i < kAccNb; ++i) {
+    uint64 data = Read64(input + 8 * i);
+    uint64 key = data ^ Read64(secret + 8 * i);
+    acc[i ^ 1] += data;
+    acc[i] += (key & 0xffffffffULL) * (key >> 32);
+  }
+}
+
+inline void Scramble(uint64* acc, const unsigned char* secret) {
+  for (size_t i = 0; i < kAccNb; ++i) {
+    uint64 a = XorShift64(acc[i], 47);
+    a ^= Read64(secret + 8 * i);
+    acc[i] = a * kPrime32_1;
+  }
+}
+
+inline void Accumulate(uint64* acc, const unsigned char* input,
+                       const unsigned char* secret, size_t num_stripes) {
+  for (size_t n = 0; n < num_stripes; ++n) {
+    Accumulate512(acc, input + n * kStripeLen,
+                  secret + n * kSecretConsumeRate);
+  }
+}
+
+void InitAccumulators(uint64* acc) {
+  acc[0] = kPrime32_3;
+  acc[1] = kPrime64_1;
+  acc[2] = kPrime64_2;
+  acc[3] = kPrime64_3;
+  acc[4] = kPrime64_4;
+  acc[5] = kPrime32_2;
+  acc[6] = kPrime64_5;
+  acc[7] = kPrime32_1;
+}
+
+uint64 MergeAccumulators(const uint64* acc, const unsigned char* secret,
+                         uint64 start) {
+  uint64 result = start;
+  for (size_t i = 0; i < 4; ++i) {
+    result += Mul128Fold64(acc[2 * i] ^ Read64(secret + 16 * i),
+                           acc[2 * i + 1] ^ Read64(secret + 16 * i + 8));
+  }
+  return Avalanche(result);
+}
+
+Hash128 FinishLong(const uint64* acc, uint64 len) {
+  Hash128 h = {
+      MergeAccumulators(acc, kSecret + kSecretMergeAccsStart,
+                        len * kPrime64_1),
+      MergeAccumulators(acc, kSecret + kSecretSize - kStripeLen -
+                                 kSecretMergeAccsStart,
+                        ~(len * kPrime64_2))};
+  return h;
+}
+
+Hash128 HashLong(const unsigned char* input, size_t len) {
+  uint64 acc[kAccNb];
+  InitAccumulators(acc);
+
+  size_t num_blocks = (len - 1) / kBlockLen;
+  for (size_t n = 0; n < num_blocks; ++n) {
+    Accumulate(acc, input + n * kBlockLen, kSecret, kStripesPerBlock);
+    Scramble(acc, kSecret + kSecretSize - kStripeLen);
+  }
+
+  // The last partial block, and then the last stripe, which may overlap
+  // the stripes before it.
+  size_t num_stripes = ((len - 1) - kBlockLen * num_blocks) / kStripeLen;
+  Accumulate(acc, input + num_blocks * kBlockLen, kSecret, num_stripes);
+  Accumulate512(acc, input + len - kStripeLen,
+                kSecret + kSecretSize - kStripeLen - kSecretLastAccStart);
+  return FinishLong(acc, len);
+}
+
+Hash128 HashBytes(const unsigned char* input, size_t len) {
+  if (len <= 16) {
+    return Len0To16(input, len);
+  } else if (len <= 128) {
+    return Len17To128(input, len);
+  } else if (len <= kMidSizeMax) {
+    return Len129To240(input, len);
+  }
+  return HashLong(input, len);
+}
+
+// The canonical form of the hash is big-endian, high half first.
+GoogleString Canonical(const Hash128& h) {
+  char bytes[kRawHashBytes];
+  for (int i = 0; i < 8; ++i) {
+    bytes[i] = static_cast<char>(h.high >> (56 - 8 * i));
+    bytes[8 + i] = static_cast<char>(h.low >> (56 - 8 * i));
+  }
+  return GoogleString(bytes, sizeof(bytes));
+}
+
+// Hashes a stream in constant space.  Input is buffered until there's more
+// than kStreamBufferSize, so that the last stripe, which the one-shot hash
+// treats differently, is never consumed early.
+class XXH3Stream : public Hasher::Stream {
+ public:
+  explicit XXH3Stream(const Hasher* hasher) : Hasher::Stream(hasher) {
+    Reset();
+  }
+  ~XXH3Stream() override {}
+
+  void Update(const StringPiece& content) override {
+    const unsigned char* input =
+        reinterpret_cast<const unsigned char*>(content.data());
+    size_t len = content.size();
+    total_len_ += len;
+
+    if (buffered_ + len <= kStreamBufferSize) {
+      memcpy(buffer_ + buffered_, input, len);
+      buffered_ += len;
+      return;
+    }
+
+    // Top up the buffer and consume it whole; there's more input to come
+    // after it, so none of it is the last stripe.
+    if (buffered_ > 0) {
+      size_t fill = kStreamBufferSize - buffered_;
+      memcpy(buffer_ + buffered_, input, fill);
+      input += fill;
+      len -= fill;
+      ConsumeStripes(buffer_, kStreamBufferStripes);
+      buffered_ = 0;
+    }
+
+    // Consume all but the last (possibly partial) stripe straight from the
+    // input, remembering that stripe in the tail of the buffer in case
+    // Finalize needs it for the overlapping last stripe.
+    if (len > kStreamBufferSize) {
+      size_t num_stripes = (len - 1) / kStripeLen;
+      ConsumeStripes(input, num_stripes);
+      input += num_stripes * kStripeLen;
+      len -= num_stripes * kStripeLen;
+      memcpy(buffer_ + kStreamBufferSize - kStripeLen, input - kStripeLen,
+             kStripeLen);
+    }
+
+    memcpy(buffer_, input, len);
+    buffered_ = len;
+  }
+
+  GoogleString RawFinalize() override {
+    Hash128 h;
+    if (total_len_ <= kMidSizeMax) {
+      // Everything is still in the buffer.
+      h = HashBytes(buffer_, total_len_);
+    } else {
+      uint64 acc[kAccNb];
+      memcpy(acc, acc_, sizeof(acc));
+      size_t stripes_so_far = stripes_so_far_;
+      if (buffered_ >= kStripeLen) {
+        size_t num_stripes = (buffered_ - 1) / kStripeLen;
+        ConsumeStripesInto(acc, &stripes_so_far, buffer_, num_stripes);
+        Accumulate512(acc, buffer_ + buffered_ - kStripeLen,
+                      kSecret + kSecretSize - kStripeLen - kSecretLastAccStart);
+      } else {
+        // The last stripe starts in the bytes consumed before the ones
+        // still buffered, which were kept at the end of the buffer.
+        unsigned char last_stripe[kStripeLen];
+        size_t catch_up = kStripeLen - buffered_;
+        memcpy(last_stripe, buffer_ + kStreamBufferSize - catch_up, catch_up);
+        memcpy(last_stripe + catch_up, buffer_, buffered_);
+        Accumulate512(acc, last_stripe,
+                      kSecret + kSecretSize - kStripeLen - kSecretLastAccStart);
+      }
+      h = FinishLong(acc, total_len_);
+    }
+    Reset();
+    return Canonical(h);
+  }
+
+ private:
+  void Reset() {
+    InitAccumulators(acc_);
+    buffered_ = 0;
+    stripes_so_far_ = 0;
+    total_len_ = 0;
+  }
+
+  void ConsumeStripes(const unsigned char* input, size_t num_stripes) {
+    ConsumeStripesInto(acc_, &stripes_so_far_, input, num_stripes);
+  }
+
+  // Accumulates num_stripes stripes, scrambling at each block boundary.
+  // *stripes_so_far counts the stripes already in the current block.
+  static void ConsumeStripesInto(uint64* acc, size_t* stripes_so_far,
+                                 const unsigned char* input,
+                                 size_t num_stripes) {
+    while (num_stripes > 0) {
+      size_t in_block = kStripesPerBlock - *stripes_so_far;
+      if (num_stripes < in_block) {
+        Accumulate(acc, input, kSecret + *stripes_so_far * kSecretConsumeRate,
+                   num_stripes);
+        *stripes_so_far += num_stripes;
+        return;
+      }
+      Accumulate(acc, input, kSecret + *stripes_so_far * kSecretConsumeRate,
+                 in_block);
+      Scramble(acc, kSecret + kSecretSize - kStripeLen);
+      *stripes_so_far = 0;
+      input += in_block * kStripeLen;
+      num_stripes -= in_block;
+    }
+  }
+
+  uint64 acc_[kAccNb];
+  unsigned char buffer_[kStreamBufferSize];
+  size_t buffered_;
+  size_t stripes_so_far_;
+  uint64 total_len_;
+
+  DISALLOW_COPY_AND_ASSIGN(XXH3Stream);
+};
+
+}  // namespace
+
+XXH3Hasher::~XXH3Hasher() {}
+
+GoogleString XXH3Hasher::RawHash(const StringPiece& content) const {
+  return Canonical(
+      HashBytes(reinterpret_cast<const unsigned char*>(content.data()),
+                content.size()));
+}
+
+int XXH3Hasher::RawHashSizeInBytes() const { return kRawHashBytes; }
+
+Hasher::Stream* XXH3Hasher::NewStream() const { return new XXH3Stream(this); }
+
+}  // namespace net_instaweb
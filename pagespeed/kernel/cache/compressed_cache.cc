@@ -21,21 +21,57 @@
 
 #include "base/logging.h"
 ////#include "strings/stringpiece_utils.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
 #include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
+#include "pagespeed/kernel/util/brotli_deflater.h"
+#include "pagespeed/kernel/util/brotli_inflater.h"
 #include "pagespeed/kernel/util/gzip_inflater.h"
 
 namespace net_instaweb {
 
 namespace {
 
+// The physical payload of an entry is
+//   tag, payload, checksum, kTrailer
+// where the one-byte tag says how the payload is encoded, and the checksum
+// is the 4-byte big-endian Adler-32 of the payload.  Entries written before
+// tags were introduced are just a zlib stream followed by kTrailer.  Every
+// zlib stream starts with a byte whose low nibble is 8, the deflate method,
+// and no tag has that, so the two formats can't be confused.
+enum Tag {
+  kStoredTag = 1,
+  kDeflateTag = 2,
+  kBrotliTag = 3,
+};
+const int kTagSize = 1;
+const int kChecksumSize = 4;
+
 // A few bytes to put at the end of the physical payload we can track
 // corruption.  Note that CompressedCacheTest.CrapAtEnd fails without this.
 const char kTrailer[] = "[[]]";
 
+// Values smaller than this are stored uncompressed: the codecs' framing eats
+// most of what compressing them might save.
+const int kMinCompressibleSize = 64;
+
+// Before compressing a large value we compress a sample of it with fast
+// deflate, and store the value uncompressed if the sample doesn't shrink.
+// The sample is taken from the end of the value, since cached HTTPValues
+// start with their headers, which compress well even when the body is an
+// image that doesn't.
+const int kSampleSize = 4 * 1024;
+const int kMinSampledSize = 4 * kSampleSize;
+
+// Compression that saves less than 1/kMinSavingsDivisor of the size isn't
+// worth the cost of decompressing on every Get.
+const int kMinSavingsDivisor = 8;
+
+const int kDefaultBrotliQuality = 5;
+
 // TODO(jmarantz): Evaluate the impact of histogramming the size reduction of
 // each entry.  The compressed_cache_speed_test.cc side-steps this because
 // SimpleStats doesn't implement histograms.  See split_statistics_test.cc:93
@@ -50,6 +86,83 @@ const char kCompressedCacheCompressedSize[] =
     "compressed_cache_compressed_size";
 const char kCompressedCacheCorruptPayloads[] =
     "compressed_cache_corrupt_payloads";
+const char kCompressedCacheIncompressiblePayloads[] =
+    "compressed_cache_incompressible_payloads";
+
+bool WorthCompressing(int64 original_size, int64 compressed_size) {
+  return compressed_size <=
+         original_size - original_size / kMinSavingsDivisor;
+}
+
+void AppendChecksum(uint32 checksum, GoogleString* buf) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    buf->push_back(static_cast<char>((checksum >> shift) & 0xff));
+  }
+}
+
+uint32 ReadChecksum(StringPiece bytes) {
+  uint32 checksum = 0;
+  for (int i = 0; i < kChecksumSize; ++i) {
+    checksum = (checksum << 8) | static_cast<uint8>(bytes[i]);
+  }
+  return checksum;
+}
+
+// Decodes the physical payload of an entry into *value, returning false if
+// it is corrupt.
+bool Decode(const SharedString& physical, SharedString* value) {
+  StringPiece stored = physical.Value();
+  StringPiece trailer(kTrailer, STATIC_STRLEN(kTrailer));
+  if (!strings::EndsWith(stored, trailer) || stored.size() == trailer.size()) {
+    return false;
+  }
+  stored.remove_suffix(trailer.size());
+
+  GoogleString uncompressed;
+  StringWriter writer(&uncompressed);
+  uint8 tag = static_cast<uint8>(stored[0]);
+  if ((tag & 0x0f) == 8) {
+    // Written before entries were tagged.
+    if (!GzipInflater::Inflate(stored, GzipInflater::kDeflate, &writer)) {
+      return false;
+    }
+    value->SwapWithString(&uncompressed);
+    return true;
+  }
+
+  if (stored.size() < kTagSize + kChecksumSize) {
+    return false;
+  }
+  StringPiece payload =
+      stored.substr(kTagSize, stored.size() - kTagSize - kChecksumSize);
+  if (GzipInflater::Adler32(payload) !=
+      ReadChecksum(stored.substr(stored.size() - kChecksumSize))) {
+    return false;
+  }
+  NullMessageHandler handler;
+  switch (tag) {
+    case kStoredTag:
+      // Share the storage rather than copying the value out.
+      *value = physical;
+      value->RemovePrefix(kTagSize);
+      value->RemoveSuffix(kChecksumSize + trailer.size());
+      return true;
+    case kDeflateTag:
+      if (!GzipInflater::Inflate(payload, GzipInflater::kDeflate, &writer)) {
+        return false;
+      }
+      break;
+    case kBrotliTag:
+      if (!BrotliInflater::Decompress(payload, &handler, &writer)) {
+        return false;
+      }
+      break;
+    default:
+      return false;
+  }
+  value->SwapWithString(&uncompressed);
+  return true;
+}
 
 class CompressedCallback : public CacheInterface::Callback {
  public:
@@ -66,17 +179,9 @@ class CompressedCallback : public CacheInterface::Callback {
     validate_candidate_called_ = true;
     bool ret = false;
     if (state == CacheInterface::kAvailable) {
-      GoogleString uncompressed;
-      StringWriter writer(&uncompressed);
-      StringPiece compressed = value().Value();
-      if (strings::EndsWith(compressed,
-                            StringPiece(kTrailer, STATIC_STRLEN(kTrailer))) &&
-          GzipInflater::Inflate(
-              compressed.substr(0, compressed.size() - STATIC_STRLEN(kTrailer)),
-              GzipInflater::kDeflate, &writer)) {
-        SharedString uncompressed_shared;
-        uncompressed_shared.SwapWithString(&uncompressed);
-        callback_->set_value(uncompressed_shared);
+      SharedString uncompressed;
+      if (Decode(value(), &uncompressed)) {
+        callback_->set_value(uncompressed);
         ret = true;
       } else {
         state = CacheInterface::kNotFound;
@@ -101,13 +206,15 @@ class CompressedCallback : public CacheInterface::Callback {
 }  // namespace
 
 CompressedCache::CompressedCache(CacheInterface* cache, Statistics* stats)
-    : cache_(cache) {
+    : cache_(cache), codec_(kDeflate), level_(kDefaultLevel) {
 #if INCLUDE_HISTOGRAMS
   compressed_cache_savings_ = stats->GetHistogram(kCompressedCacheSavings);
 #endif
   corrupt_payloads_ = stats->GetVariable(kCompressedCacheCorruptPayloads);
   original_size_ = stats->GetVariable(kCompressedCacheOriginalSize);
   compressed_size_ = stats->GetVariable(kCompressedCacheCompressedSize);
+  incompressible_payloads_ =
+      stats->GetVariable(kCompressedCacheIncompressiblePayloads);
 }
 
 CompressedCache::~CompressedCache() {}
@@ -123,6 +230,25 @@ void CompressedCache::InitStats(Statistics* statistics) {
   statistics->AddVariable(kCompressedCacheCorruptPayloads);
   statistics->AddVariable(kCompressedCacheOriginalSize);
   statistics->AddVariable(kCompressedCacheCompressedSize);
+  statistics->AddVariable(kCompressedCacheIncompressiblePayloads);
+}
+
+void CompressedCache::SetCodec(Codec codec, int level) {
+  codec_ = codec;
+  level_ = level;
+}
+
+bool CompressedCache::ParseCodec(StringPiece name, Codec* codec) {
+  if (StringCaseEqual(name, "none")) {
+    *codec = kNone;
+  } else if (StringCaseEqual(name, "deflate")) {
+    *codec = kDeflate;
+  } else if (StringCaseEqual(name, "brotli")) {
+    *codec = kBrotli;
+  } else {
+    return false;
+  }
+  return true;
 }
 
 void CompressedCache::Get(const GoogleString& key, Callback* callback) {
@@ -130,20 +256,75 @@ void CompressedCache::Get(const GoogleString& key, Callback* callback) {
   cache_->Get(key, cb);
 }
 
+void CompressedCache::MultiGet(MultiGetRequest* request) {
+  for (KeyCallback& key_callback : *request) {
+    key_callback.callback =
+        new CompressedCallback(key_callback.callback, corrupt_payloads_);
+  }
+  cache_->MultiGet(request);
+}
+
+bool CompressedCache::LooksCompressible(StringPiece value) const {
+  if (value.size() < kMinCompressibleSize) {
+    return false;
+  }
+  if (value.size() < kMinSampledSize) {
+    return true;
+  }
+  GoogleString compressed_sample;
+  StringWriter writer(&compressed_sample);
+  return (GzipInflater::Deflate(value.substr(value.size() - kSampleSize),
+                                GzipInflater::kDeflate, 1, &writer) &&
+          WorthCompressing(kSampleSize, compressed_sample.size()));
+}
+
+bool CompressedCache::Compress(StringPiece value, GoogleString* buf) const {
+  StringWriter writer(buf);
+  switch (codec_) {
+    case kNone:
+      break;
+    case kDeflate:
+      buf->push_back(kDeflateTag);
+      return GzipInflater::Deflate(value, GzipInflater::kDeflate, level_,
+                                   &writer);
+    case kBrotli: {
+      buf->push_back(kBrotliTag);
+      NullMessageHandler handler;
+      return BrotliDeflater::Compress(
+          value, level_ == kDefaultLevel ? kDefaultBrotliQuality : level_,
+          &handler, &writer);
+    }
+  }
+  return false;
+}
+
 void CompressedCache::Put(const GoogleString& key, const SharedString& value) {
-  int64 old_size = value.size();
-  GoogleString buf;
-  buf.reserve(old_size + STATIC_STRLEN(kTrailer));
-  StringWriter writer(&buf);
+  StringPiece uncompressed = value.Value();
+  int64 old_size = uncompressed.size();
   original_size_->Add(old_size);
-  if (GzipInflater::Deflate(value.Value(), GzipInflater::kDeflate, &writer)) {
-    buf.append(kTrailer, STATIC_STRLEN(kTrailer));
+
+  GoogleString buf;
+  if (codec_ != kNone) {
+    if (LooksCompressible(uncompressed) && Compress(uncompressed, &buf) &&
+        WorthCompressing(old_size, buf.size() - kTagSize)) {
 #if INCLUDE_HISTOGRAMS
-    compressed_cache_savings_->Add(old_size - static_cast<int64>(buf.size()));
+      compressed_cache_savings_->Add(old_size - static_cast<int64>(buf.size()));
 #endif
-    compressed_size_->Add(buf.size());
-    cache_->PutSwappingString(key, &buf);
+    } else {
+      buf.clear();
+      incompressible_payloads_->Add(1);
+    }
   }
+  if (buf.empty()) {
+    buf.reserve(kTagSize + old_size + kChecksumSize + STATIC_STRLEN(kTrailer));
+    buf.push_back(kStoredTag);
+    buf.append(uncompressed.data(), uncompressed.size());
+  }
+  AppendChecksum(GzipInflater::Adler32(StringPiece(buf).substr(kTagSize)),
+                 &buf);
+  buf.append(kTrailer, STATIC_STRLEN(kTrailer));
+  compressed_size_->Add(buf.size());
+  cache_->PutSwappingString(key, &buf);
 }
 
 void CompressedCache::Delete(const GoogleString& key) { cache_->Delete(key); }
@@ -162,4 +343,8 @@ int64 CompressedCache::CompressedSize() const {
   return compressed_size_->Get();
 }
 
+int64 CompressedCache::IncompressiblePayloads() const {
+  return incompressible_payloads_->Get();
+}
+
 }  // namespace net_instaweb
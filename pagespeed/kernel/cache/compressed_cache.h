@@ -33,15 +33,41 @@ class Statistics;
 class Variable;
 
 // Compressed cache adapter.
+//
+// Each entry records the codec it was written with, so entries can always be
+// read back whatever codec is currently configured, including entries
+// written before the codec was recorded, which are all deflate.  Values that
+// don't compress are stored as they are, saving the cost of inflating them
+// on every Get.
 class CompressedCache : public CacheInterface {
  public:
-  // Does not takes ownership of cache or stats.
+  enum Codec {
+    kNone,     // Store values uncompressed.
+    kDeflate,  // zlib; levels 1-9.
+    kBrotli,   // Brotli; qualities 0-11.
+  };
+
+  // Passed to SetCodec to select the codec's default level.
+  static const int kDefaultLevel = -1;
+
+  // Does not takes ownership of cache or stats.  Compresses with deflate at
+  // its default level until SetCodec is called.
   CompressedCache(CacheInterface* cache, Statistics* stats);
   ~CompressedCache() override;
 
   static void InitStats(Statistics* stats);
 
+  // Selects the codec and level used by subsequent Puts.
+  void SetCodec(Codec codec, int level);
+  Codec codec() const { return codec_; }
+  int level() const { return level_; }
+
+  // Parses "none", "deflate" or "brotli" into *codec, returning false if
+  // name is none of those.
+  static bool ParseCodec(StringPiece name, Codec* codec);
+
   void Get(const GoogleString& key, Callback* callback) override;
+  void MultiGet(MultiGetRequest* request) override;
   void Put(const GoogleString& key, const SharedString& value) override;
   void Delete(const GoogleString& key) override;
   GoogleString Name() const override { return FormatName(cache_->Name()); }
@@ -63,12 +89,25 @@ class CompressedCache : public CacheInterface {
   // started.
   int64 CompressedSize() const;
 
+  // Total number of values stored uncompressed because compressing them
+  // would not have saved enough space to be worth it.
+  int64 IncompressiblePayloads() const;
+
  private:
+  // Returns true if value looks like it is worth compressing.
+  bool LooksCompressible(StringPiece value) const;
+
+  // Compresses value with codec_, appending it to *buf.
+  bool Compress(StringPiece value, GoogleString* buf) const;
+
   CacheInterface* cache_;
+  Codec codec_;
+  int level_;
   Histogram* compressed_cache_savings_;
   Variable* corrupt_payloads_;
   Variable* original_size_;
   Variable* compressed_size_;
+  Variable* incompressible_payloads_;
 
   DISALLOW_COPY_AND_ASSIGN(CompressedCache);
 };
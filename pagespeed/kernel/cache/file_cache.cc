@@ -179,10 +179,14 @@ void FileCache::Get(const GoogleString& key, Callback* callback) {
     // as they likely indicate a permissions or disk-space problem
     // which is best not eaten.  It's cheap enough to construct
     // a NullMessageHandler on the stack when we want one.
+    //
+    // Cache files are only ever replaced by rename, so the file system is
+    // free to hand back a mapping of a large file rather than a copy.
     NullMessageHandler null_handler;
-    GoogleString buf;
-    ret = file_system_->ReadFile(filename.c_str(), &buf, &null_handler);
-    callback->set_value(SharedString(buf));
+    SharedString value;
+    ret = file_system_->ReadFileToSharedString(
+        filename.c_str(), FileSystem::kUnlimitedSize, &value, &null_handler);
+    callback->set_value(value);
   }
   ValidateAndReportResult(key, ret ? kAvailable : kNotFound, callback);
 }
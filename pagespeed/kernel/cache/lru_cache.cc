@@ -24,11 +24,14 @@
 #include "pagespeed/kernel/base/cache_interface.h"
 #include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/cache/lru_cache_snapshot.h"
 
 namespace net_instaweb {
 
 LRUCache::LRUCache(size_t max_size)
-    : base_(max_size, &value_helper_), is_healthy_(true) {
+    : base_(max_size, &value_helper_),
+      is_healthy_(true),
+      snapshot_loaded_(false) {
   ClearStats();
 }
 
@@ -39,11 +42,23 @@ void LRUCache::Get(const GoogleString& key, Callback* callback) {
     ValidateAndReportResult(key, kNotFound, callback);
     return;
   }
+  LoadSnapshotIfNecessary();
   KeyState key_state = kNotFound;
   SharedString* value = base_.GetFreshen(key);
   if (value != nullptr) {
     key_state = kAvailable;
     callback->set_value(*value);
+  } else if (warm_start_ != nullptr) {
+    SharedString restored;
+    if (warm_start_->Take(key, &restored)) {
+      base_.Put(key, restored);
+      ++num_warm_start_hits_;
+      key_state = kAvailable;
+      callback->set_value(restored);
+    }
+    if (warm_start_->num_remaining() == 0) {
+      warm_start_.reset();
+    }
   }
   ValidateAndReportResult(key, key_state, callback);
 }
@@ -53,7 +68,22 @@ void LRUCache::Put(const GoogleString& key, const SharedString& new_value) {
     return;
   }
 
+  LoadSnapshotIfNecessary();
+  ForgetSnapshotEntry(key);
   base_.Put(key, new_value);
+
+  if (snapshotter_ != nullptr) {
+    // We're called under whatever lock protects us, and collecting an entry
+    // copies its key, so a due snapshot is collected a few entries per Put
+    // rather than all at once.  Encoding is left to the snapshotter's worker.
+    if ((pending_snapshot_ == nullptr) && snapshotter_->SnapshotDue()) {
+      pending_snapshot_.reset(new LRUCacheSnapshot::Writer);
+      base_.StartWalk();
+    }
+    if (pending_snapshot_ != nullptr) {
+      ContinueSnapshot();
+    }
+  }
 }
 
 void LRUCache::Delete(const GoogleString& key) {
@@ -61,6 +91,8 @@ void LRUCache::Delete(const GoogleString& key) {
     return;
   }
 
+  LoadSnapshotIfNecessary();
+  ForgetSnapshotEntry(key);
   base_.Delete(key);
 }
 
@@ -69,7 +101,87 @@ void LRUCache::DeleteWithPrefixForTesting(StringPiece prefix) {
     return;
   }
 
+  warm_start_.reset();
   base_.DeleteWithPrefixForTesting(prefix);
 }
 
+void LRUCache::Clear() {
+  warm_start_.reset();
+  pending_snapshot_.reset();
+  base_.Clear();
+}
+
+void LRUCache::ShutDown() {
+  // If the cache was never used there's nothing new to store, and writing
+  // would replace the last snapshot with an empty one.
+  if (is_healthy_ && (snapshotter_ != nullptr) && snapshot_loaded_) {
+    pending_snapshot_.reset();
+    LRUCacheSnapshot::Writer writer;
+    AddToSnapshot(&writer);
+    snapshotter_->Write(writer);
+  }
+  set_is_healthy(false);
+}
+
+void LRUCache::set_snapshotter(LRUCacheSnapshotter* snapshotter) {
+  snapshotter_.reset(snapshotter);
+  snapshot_loaded_ = false;
+}
+
+void LRUCache::WarmStart(LRUCacheSnapshot* snapshot) {
+  warm_start_.reset(snapshot);
+  if (warm_start_->num_remaining() == 0) {
+    warm_start_.reset();
+  }
+}
+
+void LRUCache::AddToSnapshot(LRUCacheSnapshot::Writer* writer) const {
+  for (Base::Iterator p = base_.Begin(), e = base_.End(); p != e; ++p) {
+    writer->Add(p.Key(), p.Value());
+  }
+  if (warm_start_ != nullptr) {
+    writer->AddRemaining(*warm_start_, writer->size_bytes() +
+                                           base_.max_bytes_in_cache() -
+                                           base_.size_bytes());
+  }
+}
+
+void LRUCache::ContinueSnapshot() {
+  const GoogleString* key;
+  const SharedString* value;
+  for (int i = 0; i < LRUCacheSnapshotter::kEntriesPerPut; ++i) {
+    if (!base_.WalkNext(&key, &value)) {
+      if (warm_start_ != nullptr) {
+        pending_snapshot_->AddRemaining(
+            *warm_start_, pending_snapshot_->size_bytes() +
+                              base_.max_bytes_in_cache() - base_.size_bytes());
+      }
+      snapshotter_->WriteInBackground(pending_snapshot_.release());
+      return;
+    }
+    pending_snapshot_->Add(*key, *value);
+  }
+}
+
+void LRUCache::LoadSnapshotIfNecessary() {
+  if (!snapshot_loaded_ && (snapshotter_ != nullptr)) {
+    snapshot_loaded_ = true;
+    LRUCacheSnapshot* snapshot = new LRUCacheSnapshot;
+    if (snapshotter_->Load(snapshot)) {
+      WarmStart(snapshot);
+    } else {
+      delete snapshot;
+    }
+  }
+}
+
+void LRUCache::ForgetSnapshotEntry(const GoogleString& key) {
+  if (warm_start_ != nullptr) {
+    warm_start_->Forget(key);
+    if (warm_start_->num_remaining() == 0) {
+      warm_start_.reset();
+    }
+  }
+}
+
 }  // namespace net_instaweb
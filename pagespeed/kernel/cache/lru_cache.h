@@ -21,6 +21,7 @@
 #define PAGESPEED_KERNEL_CACHE_LRU_CACHE_H_
 
 #include <cstddef>
+#include <memory>
 
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/cache_interface.h"
@@ -28,6 +29,7 @@
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/cache/lru_cache_base.h"
+#include "pagespeed/kernel/cache/lru_cache_snapshot.h"
 
 namespace net_instaweb {
 
@@ -81,25 +83,63 @@ class LRUCache : public CacheInterface {
   }
   size_t num_deletes() const { return base_.num_deletes(); }
 
+  // Number of Gets that missed in the cache but were served from the
+  // warm-start snapshot.  These are also counted in num_misses().
+  size_t num_warm_start_hits() const { return num_warm_start_hits_; }
+
   // Sanity check the cache data structures.
   void SanityCheck() { base_.SanityCheck(); }
 
   // Clear the entire cache.  Used primarily for testing.  Note that this
   // will not clear the stats, however it will update current_bytes_in_cache_.
-  void Clear() { base_.Clear(); }
+  // Any warm-start snapshot is dropped too.
+  void Clear();
 
   // Clear the stats -- note that this will not clear the content.
-  void ClearStats() { base_.ClearStats(); }
+  void ClearStats() {
+    base_.ClearStats();
+    num_warm_start_hits_ = 0;
+  }
 
   static GoogleString FormatName() { return "LRUCache"; }
   GoogleString Name() const override { return FormatName(); }
   bool IsBlocking() const override { return true; }
   bool IsHealthy() const override { return is_healthy_; }
-  void ShutDown() override { set_is_healthy(false); }
+
+  // Writes a final snapshot, if there is a snapshotter, and stops serving.
+  void ShutDown() override;
 
   void set_is_healthy(bool x) { is_healthy_ = x; }
 
+  // Warms the cache up from the last snapshot stored by snapshotter, and
+  // stores new ones periodically and at ShutDown.  The snapshot is read
+  // when the cache is first used, and its entries are pulled into the
+  // cache as Gets miss on them.  Takes ownership.  Must be called before
+  // the cache is used.
+  void set_snapshotter(LRUCacheSnapshotter* snapshotter);
+
+  // Serves Get misses from snapshot, until each of its entries has been
+  // used or overwritten.  Takes ownership.
+  void WarmStart(LRUCacheSnapshot* snapshot);
+
+  // Adds the cache contents to *writer, followed by any entries of the
+  // warm-start snapshot that haven't been used yet, up to the capacity of
+  // the cache.
+  void AddToSnapshot(LRUCacheSnapshot::Writer* writer) const;
+
  private:
+  // Adds up to LRUCacheSnapshotter::kEntriesPerPut more entries to
+  // pending_snapshot_, and hands it to the snapshotter once every entry has
+  // been added.
+  void ContinueSnapshot();
+
+  // Loads the warm-start snapshot, the first time the cache is used.
+  void LoadSnapshotIfNecessary();
+
+  // Makes sure key isn't restored from the warm-start snapshot over a value
+  // written or deleted since.
+  void ForgetSnapshotEntry(const GoogleString& key);
+
   struct SharedStringHelper {
     size_t size(const SharedString& ss) const { return ss.size(); }
     bool Equal(const SharedString& a, const SharedString& b) const {
@@ -116,6 +156,12 @@ class LRUCache : public CacheInterface {
   Base base_;
   bool is_healthy_;
   SharedStringHelper value_helper_;
+  std::unique_ptr<LRUCacheSnapshotter> snapshotter_;
+  bool snapshot_loaded_;
+  std::unique_ptr<LRUCacheSnapshot> warm_start_;
+  // The periodic snapshot being collected, if any.
+  std::unique_ptr<LRUCacheSnapshot::Writer> pending_snapshot_;
+  size_t num_warm_start_hits_;
 
   DISALLOW_COPY_AND_ASSIGN(LRUCache);
 };
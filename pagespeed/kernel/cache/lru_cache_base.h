@@ -21,6 +21,7 @@
 #define PAGESPEED_KERNEL_CACHE_LRU_CACHE_BASE_H_
 
 #include <cstddef>
+#include <iterator>
 #include <list>
 #include <utility>  // for pair
 
@@ -58,7 +59,12 @@ namespace net_instaweb {
 // ValueType must support copy-construction and assign-by-value.
 template <class ValueType, class ValueHelper>
 class LRUCacheBase {
-  typedef std::pair<GoogleString, ValueType> KeyValuePair;
+  // An entry, stamped with the id of the last walk that visited it.
+  struct KeyValuePair : public std::pair<GoogleString, ValueType> {
+    KeyValuePair(const GoogleString& key, const ValueType& value)
+        : std::pair<GoogleString, ValueType>(key, value), walk_id(0) {}
+    int64 walk_id;
+  };
   typedef std::list<KeyValuePair*> EntryList;
   // STL guarantees lifetime of list iterators as long as the node is in list.
   typedef typename EntryList::iterator ListNode;
@@ -94,7 +100,9 @@ class LRUCacheBase {
   LRUCacheBase(size_t max_size, ValueHelper* value_helper)
       : max_bytes_in_cache_(max_size),
         current_bytes_in_cache_(0),
-        value_helper_(value_helper) {
+        value_helper_(value_helper),
+        walk_id_(0),
+        walking_(false) {
     ClearStats();
   }
   ~LRUCacheBase() { Clear(); }
@@ -177,6 +185,7 @@ class LRUCacheBase {
           CHECK_GE(current_bytes_in_cache_, EntrySize(key_value));
           current_bytes_in_cache_ -= EntrySize(key_value);
           delete key_value;
+          StepWalkPast(cell);
           lru_ordered_list_.erase(cell);
         }
       }
@@ -297,6 +306,7 @@ class LRUCacheBase {
     }
     lru_ordered_list_.clear();
     map_.clear();
+    walking_ = false;
   }
 
   // Clear the stats -- note that this will not clear the content.
@@ -313,6 +323,38 @@ class LRUCacheBase {
   Iterator Begin() const { return Iterator(lru_ordered_list_.rbegin()); }
   Iterator End() const { return Iterator(lru_ordered_list_.rend()); }
 
+  // Starts a walk over the entries from oldest to youngest which, unlike
+  // Begin() and End(), can be taken a few entries at a time with the cache
+  // changing in between.  Entries removed before the walk reaches them are
+  // skipped, and entries inserted meanwhile are visited, so an entry
+  // replaced after it was visited is visited again with its new value.
+  // Freshening an entry doesn't make the walk visit it twice.  Starting a
+  // walk abandons any walk in progress.
+  void StartWalk() {
+    ++walk_id_;
+    walking_ = !lru_ordered_list_.empty();
+    if (walking_) {
+      walk_next_ = std::prev(lru_ordered_list_.end());
+    }
+  }
+
+  // Points *key and *value at the next entry of the walk, and returns true,
+  // or returns false once the walk is complete.  The pointers are valid
+  // until the cache is next modified.
+  bool WalkNext(const GoogleString** key, const ValueType** value) {
+    while (walking_) {
+      KeyValuePair* key_value = *walk_next_;
+      StepWalkPast(walk_next_);
+      if (key_value->walk_id != walk_id_) {
+        key_value->walk_id = walk_id_;
+        *key = &key_value->first;
+        *value = &key_value->second;
+        return true;
+      }
+    }
+    return false;
+  }
+
  private:
   // TODO(jmarantz): consider accounting for overhead for list cells, map
   // cells.
@@ -322,6 +364,7 @@ class LRUCacheBase {
 
   ListNode Freshen(ListNode cell) {
     if (cell != lru_ordered_list_.begin()) {
+      StepWalkPast(cell);
       lru_ordered_list_.splice(lru_ordered_list_.begin(), lru_ordered_list_,
                                cell);
     }
@@ -332,6 +375,7 @@ class LRUCacheBase {
   void DeleteAt(typename Map::iterator p) {
     ListNode cell = p->second;
     KeyValuePair* key_value = *cell;
+    StepWalkPast(cell);
     lru_ordered_list_.erase(cell);
     CHECK_GE(current_bytes_in_cache_, EntrySize(key_value));
     current_bytes_in_cache_ -= EntrySize(key_value);
@@ -345,6 +389,7 @@ class LRUCacheBase {
     if (bytes_needed < max_bytes_in_cache_) {
       while (bytes_needed + current_bytes_in_cache_ > max_bytes_in_cache_) {
         KeyValuePair* key_value = lru_ordered_list_.back();
+        StepWalkPast(std::prev(lru_ordered_list_.end()));
         lru_ordered_list_.pop_back();
         CHECK_GE(current_bytes_in_cache_, EntrySize(key_value));
         current_bytes_in_cache_ -= EntrySize(key_value);
@@ -359,6 +404,18 @@ class LRUCacheBase {
     return ret;
   }
 
+  // Moves the walk on to the next younger entry if it is about to visit
+  // cell, so that cell can be moved or erased.
+  void StepWalkPast(ListNode cell) {
+    if (walking_ && (cell == walk_next_)) {
+      if (walk_next_ == lru_ordered_list_.begin()) {
+        walking_ = false;
+      } else {
+        --walk_next_;
+      }
+    }
+  }
+
   // TODO(jmarantz): convert most of these to 'int'.
   size_t max_bytes_in_cache_;
   size_t current_bytes_in_cache_;
@@ -372,6 +429,12 @@ class LRUCacheBase {
   Map map_;
   ValueHelper* value_helper_;
 
+  // State of the walk started by StartWalk.  walk_next_ is the next entry
+  // to visit, when walking_.
+  int64 walk_id_;
+  bool walking_;
+  ListNode walk_next_;
+
   DISALLOW_COPY_AND_ASSIGN(LRUCacheBase);
 };
 
@@ -0,0 +1,391 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/kernel/cache/lru_cache_snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/string_hash.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/file_cache.h"
+#include "pagespeed/kernel/thread/slow_worker.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kMagic[8] = {'P', 'S', 'L', 'R', 'U', 'S', 'N', 'P'};
+
+// Bump this whenever the layout changes.
+const uint32 kVersion = 1;
+
+struct Header {
+  char magic[8];
+  uint32 version;
+  uint32 num_entries;
+  uint64 total_size;
+};
+
+}  // namespace
+
+struct LRUCacheSnapshot::Record {
+  uint32 key_hash;
+  uint32 key_size;
+  uint32 value_size;
+  uint32 offset;
+};
+
+LRUCacheSnapshot::Writer::Writer() : size_bytes_(0) {}
+
+LRUCacheSnapshot::Writer::~Writer() {}
+
+void LRUCacheSnapshot::Writer::Add(const GoogleString& key,
+                                   const SharedString& value) {
+  entries_.push_back(Entry{key, value});
+  size_bytes_ += key.size() + value.size();
+}
+
+void LRUCacheSnapshot::Writer::AddRemaining(const LRUCacheSnapshot& snapshot,
+                                            size_t max_bytes) {
+  for (int i = 0, n = snapshot.num_entries();
+       i < n && size_bytes_ < max_bytes; ++i) {
+    if (!snapshot.taken_[i]) {
+      Record record = snapshot.RecordAt(i);
+      SharedString value(snapshot.encoded_);
+      value.RemovePrefix(record.offset + record.key_size);
+      value.RemoveSuffix(value.size() - record.value_size);
+      GoogleString key;
+      snapshot.key(i).CopyToString(&key);
+      Add(key, value);
+    }
+  }
+}
+
+void LRUCacheSnapshot::Writer::Encode(GoogleString* out) const {
+  // A cache that collects its entries a few at a time can add a key again
+  // after replacing its value.  Find the entries superseded that way by
+  // grouping the entries by hash, latest first.
+  int num_entries = entries_.size();
+  std::vector<uint32> hashes(num_entries);
+  std::vector<int> by_hash(num_entries);
+  for (int i = 0; i < num_entries; ++i) {
+    hashes[i] = HashKey(entries_[i].key);
+    by_hash[i] = i;
+  }
+  std::sort(by_hash.begin(), by_hash.end(), [&hashes](int a, int b) {
+    return (hashes[a] != hashes[b]) ? (hashes[a] < hashes[b]) : (a > b);
+  });
+  std::vector<bool> superseded(num_entries, false);
+  for (int i = 0; i < num_entries; ++i) {
+    const Entry& latest = entries_[by_hash[i]];
+    for (int j = i + 1;
+         (j < num_entries) && (hashes[by_hash[j]] == hashes[by_hash[i]]);
+         ++j) {
+      if (entries_[by_hash[j]].key == latest.key) {
+        superseded[by_hash[j]] = true;
+      }
+    }
+  }
+
+  // Work out which entries fit before laying anything out, so the index
+  // only covers entries whose bytes are written.
+  size_t index_end = sizeof(Header);
+  size_t data_size = 0;
+  std::vector<int> fitting;
+  for (int i = 0; i < num_entries; ++i) {
+    if (superseded[i]) {
+      continue;
+    }
+    const Entry& entry = entries_[i];
+    size_t entry_size = entry.key.size() + entry.value.size();
+    if (index_end + sizeof(Record) + data_size + entry_size >
+        kMaxSnapshotBytes) {
+      break;
+    }
+    index_end += sizeof(Record);
+    data_size += entry_size;
+    fitting.push_back(i);
+  }
+  int num_fitting = fitting.size();
+
+  std::vector<Record> records(num_fitting);
+  uint32 offset = index_end;
+  for (int i = 0; i < num_fitting; ++i) {
+    const Entry& entry = entries_[fitting[i]];
+    Record& record = records[i];
+    record.key_hash = hashes[fitting[i]];
+    record.key_size = entry.key.size();
+    record.value_size = entry.value.size();
+    record.offset = offset;
+    offset += record.key_size + record.value_size;
+  }
+  // The data stays in insertion order; only the index is sorted.
+  std::stable_sort(records.begin(), records.end(),
+                   [](const Record& a, const Record& b) {
+                     return a.key_hash < b.key_hash;
+                   });
+
+  Header header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_entries = num_fitting;
+  header.total_size = index_end + data_size;
+
+  out->clear();
+  out->reserve(header.total_size);
+  out->append(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (num_fitting != 0) {
+    out->append(reinterpret_cast<const char*>(records.data()),
+                num_fitting * sizeof(Record));
+  }
+  for (int index : fitting) {
+    const Entry& entry = entries_[index];
+    out->append(entry.key);
+    out->append(entry.value.data(), entry.value.size());
+  }
+  DCHECK_EQ(header.total_size, out->size());
+}
+
+LRUCacheSnapshot::LRUCacheSnapshot() : num_remaining_(0) {}
+
+LRUCacheSnapshot::~LRUCacheSnapshot() {}
+
+uint32 LRUCacheSnapshot::HashKey(StringPiece key) {
+  return HashString<CasePreserve, uint32>(key.data(), key.size());
+}
+
+bool LRUCacheSnapshot::Parse(const SharedString& encoded) {
+  encoded_.DetachAndClear();
+  slots_.clear();
+  taken_.clear();
+  num_remaining_ = 0;
+
+  size_t size = encoded.size();
+  Header header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, encoded.data(), sizeof(header));
+  if ((memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) ||
+      (header.version != kVersion) || (header.total_size != size) ||
+      (header.num_entries > (size - sizeof(header)) / sizeof(Record))) {
+    return false;
+  }
+
+  // Check every record lies within the data, and that the index is in
+  // order, so lookups can trust it.  This reads the index, but none of the
+  // keys and values.
+  encoded_ = encoded;
+  size_t index_end = sizeof(header) + header.num_entries * sizeof(Record);
+  uint32 last_hash = 0;
+  slots_.reserve(header.num_entries);
+  for (uint32 i = 0; i < header.num_entries; ++i) {
+    slots_.push_back(i);
+    Record record = RecordAt(i);
+    uint64 end = static_cast<uint64>(record.offset) + record.key_size +
+                 record.value_size;
+    if ((record.offset < index_end) || (end > size) ||
+        (record.key_hash < last_hash)) {
+      encoded_.DetachAndClear();
+      slots_.clear();
+      return false;
+    }
+    last_hash = record.key_hash;
+  }
+  taken_.assign(slots_.size(), false);
+  num_remaining_ = slots_.size();
+  return true;
+}
+
+void LRUCacheSnapshot::Subset(const std::vector<int>& indices,
+                              LRUCacheSnapshot* dest) const {
+  dest->encoded_ = encoded_;
+  dest->slots_.clear();
+  dest->slots_.reserve(indices.size());
+  for (int index : indices) {
+    DCHECK(dest->slots_.empty() || dest->slots_.back() < slots_[index]);
+    // Entries already taken or forgotten here are left out entirely.
+    if (!taken_[index]) {
+      dest->slots_.push_back(slots_[index]);
+    }
+  }
+  dest->taken_.assign(dest->slots_.size(), false);
+  dest->num_remaining_ = dest->slots_.size();
+  if (dest->num_remaining_ == 0) {
+    dest->encoded_.DetachAndClear();
+  }
+}
+
+LRUCacheSnapshot::Record LRUCacheSnapshot::RecordAt(int index) const {
+  // The encoded bytes may not be aligned for a Record, so copy it out.
+  Record record;
+  memcpy(&record,
+         encoded_.data() + sizeof(Header) + slots_[index] * sizeof(Record),
+         sizeof(record));
+  return record;
+}
+
+StringPiece LRUCacheSnapshot::key(int index) const {
+  Record record = RecordAt(index);
+  return StringPiece(encoded_.data() + record.offset, record.key_size);
+}
+
+StringPiece LRUCacheSnapshot::Value(const Record& record) const {
+  return StringPiece(encoded_.data() + record.offset + record.key_size,
+                     record.value_size);
+}
+
+int LRUCacheSnapshot::Find(StringPiece key) const {
+  if (num_remaining_ == 0) {
+    return -1;
+  }
+  uint32 hash = HashKey(key);
+
+  // Binary search for the first record with this hash, then check the
+  // keys of any that collide.
+  int low = 0;
+  int high = slots_.size();
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (RecordAt(mid).key_hash < hash) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  for (int i = low, n = slots_.size(); i < n; ++i) {
+    Record record = RecordAt(i);
+    if (record.key_hash != hash) {
+      break;
+    }
+    if (!taken_[i] &&
+        (StringPiece(encoded_.data() + record.offset, record.key_size) ==
+         key)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void LRUCacheSnapshot::MarkTaken(int index) {
+  DCHECK(!taken_[index]);
+  taken_[index] = true;
+  --num_remaining_;
+  if (num_remaining_ == 0) {
+    // Let go of the storage as soon as it's of no further use.
+    encoded_.DetachAndClear();
+    slots_.clear();
+    taken_.clear();
+  }
+}
+
+bool LRUCacheSnapshot::Take(StringPiece key, SharedString* value) {
+  int index = Find(key);
+  if (index < 0) {
+    return false;
+  }
+  // Copy the value, so the cache doesn't pin the whole snapshot.
+  value->Assign(Value(RecordAt(index)));
+  MarkTaken(index);
+  return true;
+}
+
+void LRUCacheSnapshot::Forget(StringPiece key) {
+  int index = Find(key);
+  if (index >= 0) {
+    MarkTaken(index);
+  }
+}
+
+class LRUCacheSnapshotter::WriteFunction : public Function {
+ public:
+  WriteFunction(LRUCacheSnapshotter* snapshotter,
+                LRUCacheSnapshot::Writer* writer)
+      : snapshotter_(snapshotter), writer_(writer) {}
+  ~WriteFunction() override {}
+
+  void Run() override { snapshotter_->Write(*writer_); }
+
+ private:
+  LRUCacheSnapshotter* snapshotter_;
+  std::unique_ptr<LRUCacheSnapshot::Writer> writer_;
+
+  DISALLOW_COPY_AND_ASSIGN(WriteFunction);
+};
+
+LRUCacheSnapshotter::LRUCacheSnapshotter(FileCache* file_cache,
+                                         StringPiece key, int64 interval_ms,
+                                         Timer* timer)
+    : file_cache_(file_cache),
+      key_(key.data(), key.size()),
+      interval_ms_(interval_ms),
+      timer_(timer),
+      next_snapshot_ms_(timer->NowMs() + interval_ms) {}
+
+LRUCacheSnapshotter::~LRUCacheSnapshotter() {}
+
+bool LRUCacheSnapshotter::Load(LRUCacheSnapshot* snapshot) {
+  // We rely on the file cache being synchronous, as SharedMemCache does
+  // when it restores its checkpoints.
+  CHECK(file_cache_->IsBlocking());
+  CacheInterface::SynchronousCallback callback;
+  file_cache_->Get(key_, &callback);
+  CHECK(callback.called());
+  return ((callback.state() == CacheInterface::kAvailable) &&
+          snapshot->Parse(callback.value()));
+}
+
+bool LRUCacheSnapshotter::SnapshotDue() {
+  if (interval_ms_ <= 0) {
+    return false;
+  }
+  int64 now_ms = timer_->NowMs();
+  int64 next_ms = next_snapshot_ms_.load(std::memory_order_relaxed);
+  return ((now_ms >= next_ms) &&
+          next_snapshot_ms_.compare_exchange_strong(next_ms,
+                                                    now_ms + interval_ms_));
+}
+
+void LRUCacheSnapshotter::WriteInBackground(LRUCacheSnapshot::Writer* writer) {
+  WriteFunction* function = new WriteFunction(this, writer);
+  SlowWorker* worker = file_cache_->worker();
+  if (worker == nullptr) {
+    // Only tests run caches without a worker.
+    delete function;
+    return;
+  }
+  worker->Start();
+  // If the worker is busy, we'll try again next interval.
+  worker->RunIfNotBusy(function);
+}
+
+void LRUCacheSnapshotter::Write(const LRUCacheSnapshot::Writer& writer) {
+  GoogleString encoded;
+  writer.Encode(&encoded);
+  SharedString value;
+  value.SwapWithString(&encoded);
+  file_cache_->Put(key_, value);
+}
+
+}  // namespace net_instaweb
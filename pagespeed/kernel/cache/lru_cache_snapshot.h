@@ -0,0 +1,205 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_CACHE_LRU_CACHE_SNAPSHOT_H_
+#define PAGESPEED_KERNEL_CACHE_LRU_CACHE_SNAPSHOT_H_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+class FileCache;
+class Timer;
+
+// A point-in-time copy of the contents of an in-process LRU cache, used to
+// warm up a new process's cache from the one it replaces.
+//
+// The encoding is flat, so a snapshot is used in place, straight from the
+// bytes read back from disk: parsing only checks the header and index, and
+// a value is touched when it is first looked up.  FileCache maps large
+// files rather than reading them, so restoring a big snapshot costs page
+// faults for the entries actually used rather than a read of the whole
+// file at startup.
+//
+//   Header  { char magic[8]; uint32 version; uint32 num_entries;
+//             uint64 total_size; }
+//   Index   { uint32 key_hash; uint32 key_size; uint32 value_size;
+//             uint32 offset; } x num_entries, ordered by key_hash
+//   Data    key bytes immediately followed by value bytes, for each entry,
+//           at 'offset' from the start of the snapshot.
+//
+// Integers are in native byte order; a snapshot read on a machine of the
+// other endianness fails the version check and is ignored.
+//
+// The entries in a snapshot are "taken" as the new cache pulls them in, or
+// "forgotten" when the cache writes or deletes their keys, so that no
+// entry is restored twice or over a newer value.  Not thread-safe.
+class LRUCacheSnapshot {
+ public:
+  // Collects the entries of a cache and encodes them.  Adding copies the
+  // key but only takes a reference to the value, and the encoding can be
+  // done outside the cache's lock.
+  class Writer {
+   public:
+    Writer();
+    ~Writer();
+
+    // Adds an entry.  If key was added before, the entry added last wins.
+    void Add(const GoogleString& key, const SharedString& value);
+
+    // Adds the entries of snapshot that have been neither taken nor
+    // forgotten, while the total size of keys and values added so far is
+    // below max_bytes.  Shares the snapshot's storage.
+    void AddRemaining(const LRUCacheSnapshot& snapshot, size_t max_bytes);
+
+    int num_entries() const { return entries_.size(); }
+
+    // Total size of the keys and values added.
+    size_t size_bytes() const { return size_bytes_; }
+
+    // Encodes the entries into *out.  Entries that would take the snapshot
+    // past kMaxSnapshotBytes are dropped, as are entries superseded by a
+    // later one with the same key.
+    void Encode(GoogleString* out) const;
+
+   private:
+    struct Entry {
+      GoogleString key;
+      SharedString value;
+    };
+
+    std::vector<Entry> entries_;
+    size_t size_bytes_;
+
+    DISALLOW_COPY_AND_ASSIGN(Writer);
+  };
+
+  // Snapshots are held in SharedStrings, which are limited to int sizes.
+  static const size_t kMaxSnapshotBytes = 0x7fffffff;
+
+  // Constructs an empty snapshot.
+  LRUCacheSnapshot();
+  ~LRUCacheSnapshot();
+
+  // Checks the header and index of encoded, and makes this snapshot refer
+  // to it, sharing its storage.  Returns false, leaving the snapshot empty,
+  // if encoded is not a complete snapshot of the current version.
+  bool Parse(const SharedString& encoded);
+
+  // Makes *dest a snapshot of the entries at the given indices of this
+  // one, sharing its storage.  Indices must be increasing.  This is used to
+  // split one snapshot over the shards of a cache.
+  void Subset(const std::vector<int>& indices, LRUCacheSnapshot* dest) const;
+
+  // Number of entries in the snapshot, and the key of each.
+  int num_entries() const { return slots_.size(); }
+  StringPiece key(int index) const;
+
+  // Number of entries that have been neither taken nor forgotten.
+  int num_remaining() const { return num_remaining_; }
+
+  // If key is in the snapshot and has been neither taken nor forgotten,
+  // copies its value into *value, marks it taken, and returns true.
+  bool Take(StringPiece key, SharedString* value);
+
+  // Ensures key won't be taken from this snapshot.
+  void Forget(StringPiece key);
+
+  // Computes the hash used to order the index.
+  static uint32 HashKey(StringPiece key);
+
+ private:
+  struct Record;
+
+  Record RecordAt(int index) const;
+  StringPiece Value(const Record& record) const;
+
+  // Returns the index of the live entry for key, or -1.
+  int Find(StringPiece key) const;
+  void MarkTaken(int index);
+
+  SharedString encoded_;
+  // Positions in the encoded index of the entries in this snapshot.
+  std::vector<uint32> slots_;
+  std::vector<bool> taken_;
+  int num_remaining_;
+
+  DISALLOW_COPY_AND_ASSIGN(LRUCacheSnapshot);
+};
+
+// Stores and loads the snapshots of an LRU cache through a FileCache, and
+// decides when the next periodic snapshot is due.  This mirrors the way
+// SharedMemCache checkpoints its sectors: the cache starts collecting its
+// entries when a Put finds a snapshot due, and the encoding and writing are
+// done on the file cache's worker thread.
+//
+// Thread-safe.
+class LRUCacheSnapshotter {
+ public:
+  // Caches collect a periodic snapshot over successive Puts, adding this
+  // many entries in each, so that no one Put holds a cache lock for long.
+  static const int kEntriesPerPut = 100;
+
+  // Snapshots are stored under key in file_cache.  A non-positive
+  // interval_ms disables periodic snapshots, though the cache still writes
+  // one when it is shut down.  Does not take ownership of file_cache or
+  // timer.
+  LRUCacheSnapshotter(FileCache* file_cache, StringPiece key,
+                      int64 interval_ms, Timer* timer);
+  ~LRUCacheSnapshotter();
+
+  // Reads back the last snapshot written.  Returns false if there is none,
+  // or it could not be parsed.
+  bool Load(LRUCacheSnapshot* snapshot);
+
+  // Returns whether a periodic snapshot should be taken now.  Once this
+  // returns true, it returns false to all callers until the next interval
+  // has passed.
+  bool SnapshotDue();
+
+  // Encodes and stores *writer on the file cache's worker, unless the
+  // worker is busy, in which case the snapshot is skipped.  Takes ownership
+  // of writer.
+  void WriteInBackground(LRUCacheSnapshot::Writer* writer);
+
+  // Encodes and stores writer in the calling thread.
+  void Write(const LRUCacheSnapshot::Writer& writer);
+
+ private:
+  class WriteFunction;
+
+  FileCache* file_cache_;
+  const GoogleString key_;
+  const int64 interval_ms_;
+  Timer* timer_;
+  std::atomic<int64> next_snapshot_ms_;
+
+  DISALLOW_COPY_AND_ASSIGN(LRUCacheSnapshotter);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_CACHE_LRU_CACHE_SNAPSHOT_H_
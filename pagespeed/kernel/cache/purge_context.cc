@@ -46,6 +46,31 @@ const int64 kStealLockAfterMs = 2 * Timer::kSecondMs;
 const int64 kTimeoutMs = 3 * Timer::kSecondMs;
 const int kMaxContentionRetries = 2;
 
+// The journal is compacted once it is this many times the size the purge
+// set is bounded to.
+const int kJournalCompactionFactor = 4;
+
+// How long appends may keep writing to a journal after it has been renamed
+// for compaction.  Appends open, write and close the journal in one go, so
+// this is generous.
+const int64 kJournalCompactionGraceMs = 1 * Timer::kSecondMs;
+
+// Journal records are flushed in writes of at most this many bytes, each
+// holding only whole records.  Writes this small to a file opened for
+// append land in one piece, so records appended by different processes at
+// the same time can't interleave.
+const size_t kMaxJournalWriteBytes = 4096;
+
+// Serializes purges in the purge file format.
+void AppendPurgeFile(const PurgeSet& purges, GoogleString* buffer) {
+  StrAppend(buffer,
+            Integer64ToString(purges.global_invalidation_timestamp_ms()),
+            "\n");
+  for (PurgeSet::Iterator p = purges.Begin(), e = purges.End(); p != e; ++p) {
+    StrAppend(buffer, Integer64ToString(p.Value()), " ", p.Key(), "\n");
+  }
+}
+
 }  // namespace
 
 const char PurgeContext::kCancellations[] = "purge_cancellations";
@@ -54,6 +79,8 @@ const char PurgeContext::kFileParseFailures[] = "purge_file_parse_failures";
 const char PurgeContext::kFileStats[] = "purge_file_stats";
 const char PurgeContext::kFileWriteFailures[] = "purge_file_write_failures";
 const char PurgeContext::kFileWrites[] = "purge_file_writes";
+const char PurgeContext::kJournalAppends[] = "purge_journal_appends";
+const char PurgeContext::kJournalCompactions[] = "purge_journal_compactions";
 const char PurgeContext::kPurgeIndex[] = "purge_index";
 
 // TODO(jmarantz): make it possible to avoid showing this implementation detail
@@ -124,7 +151,9 @@ PurgeContext::PurgeContext(StringPiece filename, FileSystem* file_system,
       num_consecutive_failures_(0),
       waiting_for_interprocess_lock_(false),
       reading_(false),
+      compacting_(false),
       enable_purge_(true),
+      enable_journal_(false),
       max_bytes_in_cache_(max_bytes_in_cache),
       request_batching_delay_ms_(0),
       cancellations_(statistics->GetVariable(kCancellations)),
@@ -133,6 +162,8 @@ PurgeContext::PurgeContext(StringPiece filename, FileSystem* file_system,
       file_stats_(statistics->GetVariable(kFileStats)),
       file_write_failures_(statistics->GetVariable(kFileWriteFailures)),
       file_writes_(statistics->GetVariable(kFileWrites)),
+      journal_appends_(statistics->GetVariable(kJournalAppends)),
+      journal_compactions_(statistics->GetVariable(kJournalCompactions)),
       purge_index_(statistics->GetVariable(kPurgeIndex)),
       purge_poll_timestamp_ms_(new BackupUpDownCounter(
           statistics->GetUpDownCounter(kPurgePollTimestampMs),
@@ -151,6 +182,8 @@ void PurgeContext::InitStats(Statistics* statistics) {
   statistics->AddVariable(kFileStats);
   statistics->AddVariable(kFileWrites);
   statistics->AddVariable(kFileWriteFailures);
+  statistics->AddVariable(kJournalAppends);
+  statistics->AddVariable(kJournalCompactions);
   statistics->AddVariable(kPurgeIndex);
   statistics->AddUpDownCounter(kPurgePollTimestampMs);
 }
@@ -176,10 +209,8 @@ bool PurgeContext::ParseAndValidateTimestamp(StringPiece time_string,
   return true;
 }
 
-// Parses the cache purge file.
+// Parses the cache purge file, and the journal.
 void PurgeContext::ReadPurgeFile(PurgeSet* purges_from_file) {
-  GoogleString buffer;
-
   file_stats_->Add(1);
   NullMessageHandler null_handler;
 
@@ -196,6 +227,28 @@ void PurgeContext::ReadPurgeFile(PurgeSet* purges_from_file) {
     return;
   }
 
+  if (!enable_journal_) {
+    ReadSnapshot(purges_from_file);
+    return;
+  }
+
+  // Compaction moves records from the journal to the compacting journal to
+  // the purge file, so reading them in the opposite order can't miss a
+  // record that is moved while we read.  Each file is read into a set of
+  // its own, as PurgeSet wants its records in time order, and Merge
+  // interleaves them.
+  PurgeSet journal_purges(max_bytes_in_cache_);
+  PurgeSet compacting_purges(max_bytes_in_cache_);
+  ReadJournal(JournalName(), &journal_purges);
+  ReadJournal(CompactingJournalName(), &compacting_purges);
+  ReadSnapshot(purges_from_file);
+  purges_from_file->Merge(compacting_purges);
+  purges_from_file->Merge(journal_purges);
+}
+
+void PurgeContext::ReadSnapshot(PurgeSet* purges_from_file) {
+  GoogleString buffer;
+  NullMessageHandler null_handler;
   if (!file_system_->ReadFile(filename_.c_str(), &buffer, &null_handler)) {
     // If the file simply doesn't exist, that's a 'successful' read.  It's
     // fine for there to be no cache file and no invalidation data, and thus
@@ -237,6 +290,37 @@ void PurgeContext::ReadPurgeFile(PurgeSet* purges_from_file) {
   }
 }
 
+void PurgeContext::ReadJournal(const GoogleString& filename,
+                               PurgeSet* purges) {
+  GoogleString buffer;
+  NullMessageHandler null_handler;
+  if (!file_system_->ReadFile(filename.c_str(), &buffer, &null_handler)) {
+    return;  // As with the purge file, a missing journal is empty.
+  }
+  size_t end = buffer.rfind('\n');
+  if (end == GoogleString::npos) {
+    return;
+  }
+  StringPieceVector lines;
+  SplitStringPieceToVector(StringPiece(buffer.data(), end), "\n", &lines,
+                           true);
+  int64 now_ms = timer_->NowMs();
+  for (StringPiece line : lines) {
+    // Each record is either "TIMESTAMP_MS URL", as in the purge file, or a
+    // bare "TIMESTAMP_MS" setting the global invalidation timestamp.
+    stringpiece_ssize_type pos = line.find(' ');
+    int64 timestamp_ms;
+    if (!ParseAndValidateTimestamp(line.substr(0, pos), now_ms,
+                                   &timestamp_ms)) {
+      file_parse_failures_->Add(1);
+    } else if (pos == StringPiece::npos) {
+      purges->UpdateGlobalInvalidationTimestampMs(timestamp_ms);
+    } else {
+      purges->Put(line.substr(pos + 1).as_string(), timestamp_ms);
+    }
+  }
+}
+
 // While still holding the interprocess lock, verify that the bytes in
 // the file are the ones we wrote.  If another process stole the lock
 // and overwrote our bytes, we'll simply schedule another try, which will
@@ -372,15 +456,7 @@ void PurgeContext::ModifyPurgeSet(PurgeSet* purges_from_file,
 
   // Collect the write-buffer from the aggregated PurgeSet while we
   // have mutex_ held.
-  StrAppend(
-      buffer,
-      Integer64ToString(purges_from_file->global_invalidation_timestamp_ms()),
-      "\n");
-  for (PurgeSet::Iterator p = purges_from_file->Begin(),
-                          e = purges_from_file->End();
-       p != e; ++p) {
-    StrAppend(buffer, Integer64ToString(p.Value()), " ", p.Key(), "\n");
-  }
+  AppendPurgeFile(*purges_from_file, buffer);
 
   // We must also collect up and return callbacks for the requests we have
   // now merged, since once the lock is released more Purge requests may
@@ -429,16 +505,170 @@ void PurgeContext::CancelCachePurgeFile() {
 
 void PurgeContext::WaitForTimerAndGrabLock() {
   if (request_batching_delay_ms_ == 0) {
-    GrabLockAndUpdate();
+    WritePendingPurges();
   } else {
     int64 alarm_time_us =
         timer_->NowUs() + request_batching_delay_ms_ * Timer::kMsUs;
     scheduler_->AddAlarmAtUs(
-        alarm_time_us, MakeFunction(this, &PurgeContext::GrabLockAndUpdate,
+        alarm_time_us, MakeFunction(this, &PurgeContext::WritePendingPurges,
                                     &PurgeContext::CancelCachePurgeFile));
   }
 }
 
+void PurgeContext::WritePendingPurges() {
+  if (enable_journal_ && enable_purge_) {
+    AppendToJournal();
+  } else {
+    GrabLockAndUpdate();
+  }
+}
+
+void PurgeContext::AppendToJournal() {
+  GoogleString buffer;
+  PurgeCallbackVector callbacks;
+  {
+    ScopedMutex lock(mutex_.get());
+    if (pending_purges_.has_global_invalidation_timestamp_ms()) {
+      StrAppend(&buffer,
+                Integer64ToString(
+                    pending_purges_.global_invalidation_timestamp_ms()),
+                "\n");
+    }
+    for (PurgeSet::Iterator p = pending_purges_.Begin(),
+                            e = pending_purges_.End();
+         p != e; ++p) {
+      StrAppend(&buffer, Integer64ToString(p.Value()), " ", p.Key(), "\n");
+    }
+    pending_purges_.Clear();
+    callbacks.swap(pending_callbacks_);
+    waiting_for_interprocess_lock_ = false;
+  }
+
+  bool success = WriteJournal(buffer);
+  if (success) {
+    journal_appends_->Add(1);
+
+    // Induce a file-read in every process the next time PollFileSystem()
+    // is called.
+    purge_index_->Add(1);
+  } else {
+    file_write_failures_->Add(callbacks.size());
+  }
+  for (int i = 0, n = callbacks.size(); i < n; ++i) {
+    callbacks[i]->Run(success, success ? "" : "journal write failed");
+  }
+  if (success) {
+    MaybeCompactJournal();
+  }
+}
+
+bool PurgeContext::WriteJournal(const GoogleString& buffer) {
+  GoogleString journal = JournalName();
+  FileSystem::OutputFile* file =
+      file_system_->OpenOutputFileForAppend(journal.c_str(), message_handler_);
+  if (file == nullptr) {
+    return false;
+  }
+  bool ok = true;
+  StringPiece remaining(buffer);
+  while (ok && !remaining.empty()) {
+    size_t size = remaining.size();
+    if (size > kMaxJournalWriteBytes) {
+      // A single record longer than the limit goes out on its own.
+      size = remaining.rfind('\n', kMaxJournalWriteBytes - 1);
+      if (size == StringPiece::npos) {
+        size = remaining.find('\n');
+      }
+      ++size;
+    }
+    ok = (file->Write(remaining.substr(0, size), message_handler_) &&
+          file->Flush(message_handler_));
+    remaining.remove_prefix(size);
+  }
+  return file_system_->Close(file, message_handler_) && ok;
+}
+
+void PurgeContext::MaybeCompactJournal() {
+  NullMessageHandler null_handler;
+  int64 size;
+  if (!file_system_->Size(JournalName(), &size, &null_handler) ||
+      (size < kJournalCompactionFactor * max_bytes_in_cache_)) {
+    return;
+  }
+  {
+    ScopedMutex lock(mutex_.get());
+    if (compacting_) {
+      return;
+    }
+    compacting_ = true;
+  }
+  interprocess_lock_->LockTimedWaitStealOld(
+      kTimeoutMs, kStealLockAfterMs,
+      MakeFunction(this, &PurgeContext::RotateJournal,
+                   &PurgeContext::EndCompaction));
+}
+
+void PurgeContext::RotateJournal() {
+  DCHECK(interprocess_lock_->Held());
+  NullMessageHandler null_handler;
+  GoogleString compacting = CompactingJournalName();
+
+  // If another compaction was interrupted after renaming its journal, we
+  // finish that one, and leave the current journal for the next.
+  bool renamed =
+      file_system_->Exists(compacting.c_str(), &null_handler).is_true() ||
+      file_system_->RenameFile(JournalName().c_str(), compacting.c_str(),
+                               message_handler_);
+  interprocess_lock_->Unlock();
+  if (!renamed) {
+    EndCompaction();
+    return;
+  }
+  int64 alarm_time_us =
+      timer_->NowUs() + kJournalCompactionGraceMs * Timer::kMsUs;
+  scheduler_->AddAlarmAtUs(
+      alarm_time_us, MakeFunction(this, &PurgeContext::GrabLockAndCompact,
+                                  &PurgeContext::EndCompaction));
+}
+
+void PurgeContext::GrabLockAndCompact() {
+  interprocess_lock_->LockTimedWaitStealOld(
+      kTimeoutMs, kStealLockAfterMs,
+      MakeFunction(this, &PurgeContext::CompactJournal,
+                   &PurgeContext::EndCompaction));
+}
+
+void PurgeContext::CompactJournal() {
+  DCHECK(interprocess_lock_->Held());
+  GoogleString compacting = CompactingJournalName();
+  PurgeSet purges(max_bytes_in_cache_);
+  PurgeSet compacting_purges(max_bytes_in_cache_);
+  ReadJournal(compacting, &compacting_purges);
+  ReadSnapshot(&purges);
+  purges.Merge(compacting_purges);
+
+  GoogleString buffer;
+  AppendPurgeFile(purges, &buffer);
+  bool success = (WritePurgeFile(buffer) &&
+                  file_system_->RemoveFile(compacting.c_str(),
+                                           message_handler_));
+  interprocess_lock_->Unlock();
+  if (success) {
+    journal_compactions_->Add(1);
+    purge_index_->Add(1);
+  } else {
+    // The compacting journal is left in place, and is read by everyone
+    // until the next compaction finishes the job.
+    file_write_failures_->Add(1);
+  }
+  EndCompaction();
+}
+
+void PurgeContext::EndCompaction() {
+  ScopedMutex lock(mutex_.get());
+  compacting_ = false;
+}
+
 void PurgeContext::GrabLockAndUpdate() {
   interprocess_lock_->LockTimedWaitStealOld(
       kTimeoutMs, kStealLockAfterMs,
@@ -52,6 +52,22 @@ class Variable;
 //
 // This class depends on Statistics being functional.  If statistics are off,
 // then cache purging may be slower, but it will still work.
+//
+// With the journal enabled, purge requests are appended to a journal file
+// next to the purge file instead of rewriting the purge file under the
+// interprocess lock.  Appends take no lock, and the shared purge_index
+// statistic tells the other processes to re-read right away.  Once the
+// journal grows to several times the size of the purge set, it is folded
+// back into the purge file in the background:
+//   1. Under the lock, the journal is renamed to FILE.journal.compacting,
+//      so new appends start a fresh journal.
+//   2. After a grace period, long enough for any append that opened the
+//      old journal to finish, the lock is taken again and the compacting
+//      journal is merged into FILE, which is written atomically, and is
+//      then removed.
+// Readers read the journal, then the compacting journal, then the purge
+// file, so that a record moved along by a concurrent compaction is always
+// found in one of them.
 class PurgeContext {
  public:
   typedef Callback2<bool, StringPiece> PurgeCallback;
@@ -70,6 +86,8 @@ class PurgeContext {
   static const char kFileStats[];
   static const char kFileWriteFailures[];
   static const char kFileWrites[];
+  static const char kJournalAppends[];
+  static const char kJournalCompactions[];
   static const char kPurgeIndex[];
   static const char kPurgePollTimestampMs[];
   static const char kStatCalls[];
@@ -131,6 +149,13 @@ class PurgeContext {
   // the individual entries.
   void set_enable_purge(bool x) { enable_purge_ = x; }
 
+  // Indicates whether purges are appended to a journal rather than written
+  // by rewriting the whole purge file under the interprocess lock.  The
+  // journal is only consulted when individual URL purging is enabled.
+  // Every process sharing the purge file must agree on this setting, since
+  // a process without the journal doesn't read it.
+  void set_enable_journal(bool x) { enable_journal_ = x; }
+
  private:
   friend class PurgeContextTest;
 
@@ -151,6 +176,36 @@ class PurgeContext {
   void ReadPurgeFile(PurgeSet* purges_from_file);
   void ReadFileAndCallCallbackIfChanged(bool needs_update);
 
+  // Reads the purge file itself, without any journal, into *purges.
+  void ReadSnapshot(PurgeSet* purges);
+
+  // Reads the records in a journal file into *purges.  A record that is
+  // not yet terminated by a newline is still being appended and is skipped.
+  void ReadJournal(const GoogleString& filename, PurgeSet* purges);
+
+  // Appends pending_purges_ to the journal and runs their callbacks, then
+  // starts a compaction if the journal has grown large enough.
+  void AppendToJournal();
+
+  // Appends buffer, made up of complete records, to the journal.
+  bool WriteJournal(const GoogleString& buffer);
+
+  // Starts compacting the journal if it has outgrown the purge file and no
+  // compaction is already underway in this process.
+  void MaybeCompactJournal();
+
+  // The steps of a compaction, described above.  RotateJournal and
+  // CompactJournal are called with interprocess_lock_ held, and release it.
+  void RotateJournal();
+  void GrabLockAndCompact();
+  void CompactJournal();
+  void EndCompaction();
+
+  GoogleString JournalName() const { return StrCat(filename_, ".journal"); }
+  GoogleString CompactingJournalName() const {
+    return StrCat(filename_, ".journal.compacting");
+  }
+
   // Combines the purges_from_file with pending_purges_ and purge_set_,
   // serializes the result into *buffer for writing back to the file.
   //
@@ -196,11 +251,15 @@ class PurgeContext {
   // to aid in testing lock contention.
   GoogleString LockName() const { return StrCat(filename_, "-lock"); }
 
-  // Initiates a scheduler-alarm to call GrabLockAndUpdate after a
+  // Initiates a scheduler-alarm to call WritePendingPurges after a
   // small delay.  The delay is used to batch bursts of cache-purge
   // file updates, thereby rate-limiting disk-writes.
   void WaitForTimerAndGrabLock();
 
+  // Writes out pending_purges_, either by appending them to the journal or
+  // by calling GrabLockAndUpdate.
+  void WritePendingPurges();
+
   // Attempts to grab a lock for the cache-purge file, calling
   // UpdateCachePurgeFile if successful, and CancelCachePurgeFile
   // if we failed to grab the lock.
@@ -233,8 +292,10 @@ class PurgeContext {
   int num_consecutive_failures_;           // protected_by mutex_
   bool waiting_for_interprocess_lock_;     // protected_by mutex_
   bool reading_;                           // protected_by mutex_
+  bool compacting_;                        // protected_by mutex_
 
   bool enable_purge_;  // When false, can only flush entire cache.
+  bool enable_journal_;
   int max_bytes_in_cache_;
 
   int64 request_batching_delay_ms_;
@@ -245,6 +306,8 @@ class PurgeContext {
   Variable* file_stats_;
   Variable* file_write_failures_;
   Variable* file_writes_;
+  Variable* journal_appends_;
+  Variable* journal_compactions_;
   Variable* purge_index_;
   std::unique_ptr<UpDownCounter> purge_poll_timestamp_ms_;
 
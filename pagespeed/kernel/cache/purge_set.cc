@@ -19,6 +19,7 @@
 
 #include "pagespeed/kernel/cache/purge_set.h"
 
+#include <memory>
 #include <vector>
 
 #include "base/logging.h"
@@ -31,20 +32,22 @@ PurgeSet::PurgeSet()
     : global_invalidation_timestamp_ms_(kInitialTimestampMs),
       last_invalidation_timestamp_ms_(0),
       helper_(this),
-      lru_(new Lru(1, &helper_)) {  // 1 byte max size till someone sets it.
-}
+      lru_(new Lru(1, &helper_)),  // 1 byte max size till someone sets it.
+      prefixes_(new PrefixTrie) {}
 
 PurgeSet::PurgeSet(size_t max_size)
     : global_invalidation_timestamp_ms_(kInitialTimestampMs),
       last_invalidation_timestamp_ms_(0),
       helper_(this),
-      lru_(new Lru(max_size, &helper_)) {}
+      lru_(new Lru(max_size, &helper_)),
+      prefixes_(new PrefixTrie) {}
 
 PurgeSet::PurgeSet(const PurgeSet& src)
     : global_invalidation_timestamp_ms_(kInitialTimestampMs),
       last_invalidation_timestamp_ms_(0),
       helper_(this),
-      lru_(new Lru(src.lru_->max_bytes_in_cache(), &helper_)) {
+      lru_(new Lru(src.lru_->max_bytes_in_cache(), &helper_)),
+      prefixes_(new PrefixTrie) {
   Merge(src);
 }
 
@@ -61,6 +64,7 @@ PurgeSet& PurgeSet::operator=(const PurgeSet& src) {
 
 void PurgeSet::Clear() {
   lru_->Clear();
+  prefixes_->Clear();
   global_invalidation_timestamp_ms_ = kInitialTimestampMs;
 }
 
@@ -165,6 +169,7 @@ void PurgeSet::Merge(const PurgeSet& src) {
 
   lru_->Clear();
   lru_->ClearStats();
+  prefixes_->Clear();
   last_invalidation_timestamp_ms_ = global_invalidation_timestamp_ms_;
   for (int i = 0, n = merge_context.size(); i < n; ++i) {
     CHECK(Put(merge_context.key(i), merge_context.value(i)));
@@ -197,6 +202,9 @@ bool PurgeSet::Put(const GoogleString& key, int64 timestamp_ms) {
   // invalidation timestamp.
   if (timestamp_ms > global_invalidation_timestamp_ms_) {
     lru_->Put(key, timestamp_ms);
+    if (IsPrefixKey(key)) {
+      prefixes_->Put(StringPiece(key.data(), key.size() - 1), timestamp_ms);
+    }
   }
   return true;
 }
@@ -225,12 +233,16 @@ bool PurgeSet::IsValid(const GoogleString& key, int64 timestamp_ms) const {
     return false;
   }
   int64* purge_timestamp_ms = lru_->GetNoFreshen(key);
-  return ((purge_timestamp_ms == nullptr) ||
-          (timestamp_ms > *purge_timestamp_ms));
+  if ((purge_timestamp_ms != nullptr) &&
+      (timestamp_ms <= *purge_timestamp_ms)) {
+    return false;
+  }
+  return prefixes_->empty() || (timestamp_ms > prefixes_->Lookup(key));
 }
 
 void PurgeSet::Swap(PurgeSet* that) {
   lru_.swap(that->lru_);  // scoped_ptr::swap
+  prefixes_.swap(that->prefixes_);
   std::swap(global_invalidation_timestamp_ms_,
             that->global_invalidation_timestamp_ms_);
   helper_.Swap(&that->helper_);
@@ -288,4 +300,39 @@ GoogleString PurgeSet::ToString() const {
   return str;
 }
 
+PurgeSet::PrefixTrie::PrefixTrie() {}
+
+PurgeSet::PrefixTrie::~PrefixTrie() {}
+
+void PurgeSet::PrefixTrie::Put(StringPiece prefix, int64 timestamp_ms) {
+  Node* node = &root_;
+  for (char c : prefix) {
+    std::unique_ptr<Node>& child = node->children[c];
+    if (child == nullptr) {
+      child = std::make_unique<Node>();
+    }
+    node = child.get();
+  }
+  node->timestamp_ms = std::max(node->timestamp_ms, timestamp_ms);
+}
+
+int64 PurgeSet::PrefixTrie::Lookup(StringPiece key) const {
+  const Node* node = &root_;
+  int64 timestamp_ms = node->timestamp_ms;
+  for (char c : key) {
+    auto p = node->children.find(c);
+    if (p == node->children.end()) {
+      break;
+    }
+    node = p->second.get();
+    timestamp_ms = std::max(timestamp_ms, node->timestamp_ms);
+  }
+  return timestamp_ms;
+}
+
+void PurgeSet::PrefixTrie::Clear() {
+  root_.children.clear();
+  root_.timestamp_ms = kInitialTimestampMs;
+}
+
 }  // namespace net_instaweb
@@ -22,10 +22,13 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <map>
+#include <memory>
 
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/cache/lru_cache_base.h"
 
@@ -40,6 +43,12 @@ namespace net_instaweb {
 // We bound the cache-purge data to a certain number of bytes.  When
 // we exceed that, we discard old invalidation records, and bump up
 // the global invalidation timestamp to cover the evicted purges.
+//
+// A key ending in '*' purges every key that starts with the rest of it, so
+// "http://example.com/images/*" purges all the images under that path.
+// Prefix purges are stored, bounded and serialized like any other key, and
+// are also indexed in a trie so IsValid can find all the prefixes of a key
+// in one walk along it.
 class PurgeSet {
   class InvalidationTimestampHelper;
   typedef LRUCacheBase<int64, InvalidationTimestampHelper> Lru;
@@ -91,7 +100,8 @@ class PurgeSet {
   void Merge(const PurgeSet& src);
 
   // Validates a key against specific invalidation records for that
-  // key, and against the overall invalidation timestamp/
+  // key, any prefix purges covering it, and against the overall
+  // invalidation timestamp.
   bool IsValid(const GoogleString& key, int64 timestamp_ms) const;
 
   int64 global_invalidation_timestamp_ms() const {
@@ -114,7 +124,48 @@ class PurgeSet {
 
   GoogleString ToString() const;
 
+  // The character which, at the end of a key, makes it a prefix purge.
+  static const char kPrefixWildcard = '*';
+
+  static bool IsPrefixKey(StringPiece key) {
+    return !key.empty() && (key[key.size() - 1] == kPrefixWildcard);
+  }
+
  private:
+  // Maps the prefix purges to their timestamps.  Entries are only ever
+  // added; when the LRU evicts a prefix purge its entry here stays behind,
+  // which is harmless as the eviction raised the global invalidation
+  // timestamp past it.  The trie is rebuilt from the LRU on Merge.
+  class PrefixTrie {
+   public:
+    PrefixTrie();
+    ~PrefixTrie();
+
+    // Records a purge of everything starting with prefix, keeping the
+    // later timestamp if the prefix is already present.
+    void Put(StringPiece prefix, int64 timestamp_ms);
+
+    // Returns the latest timestamp of any prefix of key, or
+    // kInitialTimestampMs if there is none.
+    int64 Lookup(StringPiece key) const;
+
+    void Clear();
+    bool empty() const { return root_.children.empty() && !root_.purged(); }
+
+   private:
+    struct Node {
+      Node() : timestamp_ms(kInitialTimestampMs) {}
+      bool purged() const { return timestamp_ms != kInitialTimestampMs; }
+
+      int64 timestamp_ms;
+      std::map<char, std::unique_ptr<Node>> children;
+    };
+
+    Node root_;
+
+    DISALLOW_COPY_AND_ASSIGN(PrefixTrie);
+  };
+
   class InvalidationTimestampHelper {
    public:
     explicit InvalidationTimestampHelper(PurgeSet* purge_set)
@@ -178,6 +229,7 @@ class PurgeSet {
 
   InvalidationTimestampHelper helper_;
   std::unique_ptr<Lru> lru_;
+  std::unique_ptr<PrefixTrie> prefixes_;
 
   // Explicit copy-constructor and assign-operator are provided so
   // this class can be used for CopyOnWrite.
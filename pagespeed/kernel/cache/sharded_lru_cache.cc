@@ -0,0 +1,341 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_hash.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/lru_cache_snapshot.h"
+
+namespace net_instaweb {
+
+ShardedLRUCache::ShardedLRUCache(size_t max_bytes, int num_shards,
+                                 ThreadSystem* thread_system)
+    : snapshot_mutex_(thread_system->NewMutex()),
+      collect_mutex_(thread_system->NewMutex()),
+      pending_shard_(0),
+      pending_shard_started_(false) {
+  CHECK_LT(0, num_shards);
+  size_t shard_bytes = max_bytes / num_shards;
+  size_t extra_bytes = max_bytes % num_shards;
+  for (int i = 0; i < num_shards; ++i) {
+    size_t bytes = shard_bytes + (static_cast<size_t>(i) < extra_bytes);
+    shards_.emplace_back(
+        new Shard(bytes, &value_helper_, thread_system->NewMutex()));
+  }
+  is_healthy_.set_value(true);
+  snapshot_loaded_.set_value(false);
+  collecting_snapshot_.set_value(false);
+}
+
+ShardedLRUCache::~ShardedLRUCache() { Clear(); }
+
+int ShardedLRUCache::ShardIndex(StringPiece key) const {
+  // The shards' hash maps use CasePreserveStringHash too, so take the shard
+  // from the high bits of a scrambled hash, leaving the low bits that the
+  // maps probe with evenly distributed within each shard.
+  uint32 hash = HashString<CasePreserve, uint32>(key.data(), key.size());
+  uint64 scrambled = static_cast<uint32>(hash * 0x9e3779b9U);
+  return (scrambled * shards_.size()) >> 32;
+}
+
+void ShardedLRUCache::Get(const GoogleString& key, Callback* callback) {
+  KeyState key_state = kNotFound;
+  if (is_healthy_.value()) {
+    LoadSnapshotIfNecessary();
+    Shard* shard = ShardFor(key);
+    ScopedMutex lock(shard->mutex.get());
+    SharedString* value = shard->base.GetFreshen(key);
+    if (value != nullptr) {
+      key_state = kAvailable;
+      // This only takes a reference, so it is cheap to do under the lock,
+      // and the value stays valid after we drop it.
+      callback->set_value(*value);
+    } else if (shard->warm_start != nullptr) {
+      SharedString restored;
+      if (shard->warm_start->Take(key, &restored)) {
+        shard->base.Put(key, restored);
+        ++shard->num_warm_start_hits;
+        key_state = kAvailable;
+        callback->set_value(restored);
+      }
+      if (shard->warm_start->num_remaining() == 0) {
+        shard->warm_start.reset();
+      }
+    }
+  }
+  ValidateAndReportResult(key, key_state, callback);
+}
+
+void ShardedLRUCache::Put(const GoogleString& key,
+                          const SharedString& new_value) {
+  if (!is_healthy_.value()) {
+    return;
+  }
+  LoadSnapshotIfNecessary();
+  {
+    Shard* shard = ShardFor(key);
+    ScopedMutex lock(shard->mutex.get());
+    ForgetSnapshotEntry(key, shard);
+    shard->base.Put(key, new_value);
+  }
+
+  // ContinueSnapshot takes shard locks, so this must be done after
+  // dropping ours.
+  if (snapshotter_ != nullptr) {
+    if (!collecting_snapshot_.value() && snapshotter_->SnapshotDue()) {
+      collecting_snapshot_.set_value(true);
+    }
+    if (collecting_snapshot_.value()) {
+      ContinueSnapshot();
+    }
+  }
+}
+
+void ShardedLRUCache::Delete(const GoogleString& key) {
+  if (!is_healthy_.value()) {
+    return;
+  }
+  LoadSnapshotIfNecessary();
+  Shard* shard = ShardFor(key);
+  ScopedMutex lock(shard->mutex.get());
+  ForgetSnapshotEntry(key, shard);
+  shard->base.Delete(key);
+}
+
+void ShardedLRUCache::DeleteWithPrefixForTesting(StringPiece prefix) {
+  if (!is_healthy_.value()) {
+    return;
+  }
+  for (const std::unique_ptr<Shard>& shard : shards_) {
+    ScopedMutex lock(shard->mutex.get());
+    shard->warm_start.reset();
+    shard->base.DeleteWithPrefixForTesting(prefix);
+  }
+}
+
+size_t ShardedLRUCache::Sum(size_t (Base::*getter)() const) const {
+  size_t sum = 0;
+  for (const std::unique_ptr<Shard>& shard : shards_) {
+    ScopedMutex lock(shard->mutex.get());
+    sum += (shard->base.*getter)();
+  }
+  return sum;
+}
+
+size_t ShardedLRUCache::size_bytes() const { return Sum(&Base::size_bytes); }
+
+size_t ShardedLRUCache::max_bytes_in_cache() const {
+  return Sum(&Base::max_bytes_in_cache);
+}
+
+size_t ShardedLRUCache::num_elements() const {
+  return Sum(&Base::num_elements);
+}
+
+size_t ShardedLRUCache::num_evictions() const {
+  return Sum(&Base::num_evictions);
+}
+
+size_t ShardedLRUCache::num_hits() const { return Sum(&Base::num_hits); }
+
+size_t ShardedLRUCache::num_misses() const { return Sum(&Base::num_misses); }
+
+size_t ShardedLRUCache::num_inserts() const { return Sum(&Base::num_inserts); }
+
+size_t ShardedLRUCache::num_identical_reinserts() const {
+  return Sum(&Base::num_identical_reinserts);
+}
+
+size_t ShardedLRUCache::num_deletes() const { return Sum(&Base::num_deletes); }
+
+size_t ShardedLRUCache::num_warm_start_hits() const {
+  size_t sum = 0;
+  for (const std::unique_ptr<Shard>& shard : shards_) {
+    ScopedMutex lock(shard->mutex.get());
+    sum += shard->num_warm_start_hits;
+  }
+  return sum;
+}
+
+void ShardedLRUCache::SanityCheck() {
+  for (const std::unique_ptr<Shard>& shard : shards_) {
+    ScopedMutex lock(shard->mutex.get());
+    shard->base.SanityCheck();
+  }
+}
+
+void ShardedLRUCache::Clear() {
+  {
+    ScopedMutex lock(collect_mutex_.get());
+    pending_snapshot_.reset();
+    collecting_snapshot_.set_value(false);
+  }
+  for (const std::unique_ptr<Shard>& shard : shards_) {
+    ScopedMutex lock(shard->mutex.get());
+    shard->warm_start.reset();
+    shard->base.Clear();
+  }
+}
+
+void ShardedLRUCache::ClearStats() {
+  for (const std::unique_ptr<Shard>& shard : shards_) {
+    ScopedMutex lock(shard->mutex.get());
+    shard->base.ClearStats();
+    shard->num_warm_start_hits = 0;
+  }
+}
+
+void ShardedLRUCache::ShutDown() {
+  // If the cache was never used there's nothing new to store, and writing
+  // would replace the last snapshot with an empty one.
+  if (is_healthy_.value() && (snapshotter_ != nullptr) &&
+      snapshot_loaded_.value()) {
+    {
+      ScopedMutex lock(collect_mutex_.get());
+      pending_snapshot_.reset();
+      collecting_snapshot_.set_value(false);
+    }
+    LRUCacheSnapshot::Writer writer;
+    AddToSnapshot(&writer);
+    snapshotter_->Write(writer);
+  }
+  set_is_healthy(false);
+}
+
+void ShardedLRUCache::set_snapshotter(LRUCacheSnapshotter* snapshotter) {
+  snapshotter_.reset(snapshotter);
+  snapshot_loaded_.set_value(false);
+}
+
+void ShardedLRUCache::WarmStart(const LRUCacheSnapshot& snapshot) {
+  std::vector<std::vector<int>> indices(shards_.size());
+  for (int i = 0, n = snapshot.num_entries(); i < n; ++i) {
+    indices[ShardIndex(snapshot.key(i))].push_back(i);
+  }
+  for (int i = 0, n = shards_.size(); i < n; ++i) {
+    std::unique_ptr<LRUCacheSnapshot> part(new LRUCacheSnapshot);
+    snapshot.Subset(indices[i], part.get());
+    Shard* shard = shards_[i].get();
+    ScopedMutex lock(shard->mutex.get());
+    if (part->num_remaining() == 0) {
+      shard->warm_start.reset();
+    } else {
+      shard->warm_start = std::move(part);
+    }
+  }
+}
+
+void ShardedLRUCache::AddToSnapshot(LRUCacheSnapshot::Writer* writer) const {
+  for (const std::unique_ptr<Shard>& shard : shards_) {
+    ScopedMutex lock(shard->mutex.get());
+    for (Base::Iterator p = shard->base.Begin(), e = shard->base.End(); p != e;
+         ++p) {
+      writer->Add(p.Key(), p.Value());
+    }
+    if (shard->warm_start != nullptr) {
+      writer->AddRemaining(*shard->warm_start,
+                           writer->size_bytes() +
+                               shard->base.max_bytes_in_cache() -
+                               shard->base.size_bytes());
+    }
+  }
+}
+
+void ShardedLRUCache::ContinueSnapshot() {
+  if (!collect_mutex_->TryLock()) {
+    return;
+  }
+  // The thread that held the lock may have finished the snapshot.
+  if (collecting_snapshot_.value()) {
+    if (pending_snapshot_ == nullptr) {
+      pending_snapshot_ = std::make_unique<LRUCacheSnapshot::Writer>();
+      pending_shard_ = 0;
+      pending_shard_started_ = false;
+    }
+    const GoogleString* key;
+    const SharedString* value;
+    int remaining = LRUCacheSnapshotter::kEntriesPerPut;
+    while ((remaining > 0) && (pending_shard_ < num_shards())) {
+      Shard* shard = shards_[pending_shard_].get();
+      ScopedMutex lock(shard->mutex.get());
+      if (!pending_shard_started_) {
+        shard->base.StartWalk();
+        pending_shard_started_ = true;
+      }
+      for (; remaining > 0; --remaining) {
+        if (!shard->base.WalkNext(&key, &value)) {
+          break;
+        }
+        pending_snapshot_->Add(*key, *value);
+      }
+      if (remaining > 0) {
+        if (shard->warm_start != nullptr) {
+          pending_snapshot_->AddRemaining(
+              *shard->warm_start, pending_snapshot_->size_bytes() +
+                                      shard->base.max_bytes_in_cache() -
+                                      shard->base.size_bytes());
+        }
+        ++pending_shard_;
+        pending_shard_started_ = false;
+      }
+    }
+    if (pending_shard_ == num_shards()) {
+      snapshotter_->WriteInBackground(pending_snapshot_.release());
+      collecting_snapshot_.set_value(false);
+    }
+  }
+  collect_mutex_->Unlock();
+}
+
+void ShardedLRUCache::LoadSnapshotIfNecessary() {
+  if ((snapshotter_ == nullptr) || snapshot_loaded_.value()) {
+    return;
+  }
+  ScopedMutex lock(snapshot_mutex_.get());
+  if (!snapshot_loaded_.value()) {
+    LRUCacheSnapshot snapshot;
+    if (snapshotter_->Load(&snapshot)) {
+      WarmStart(snapshot);
+    }
+    snapshot_loaded_.set_value(true);
+  }
+}
+
+void ShardedLRUCache::ForgetSnapshotEntry(const GoogleString& key,
+                                          Shard* shard) {
+  if (shard->warm_start != nullptr) {
+    shard->warm_start->Forget(key);
+    if (shard->warm_start->num_remaining() == 0) {
+      shard->warm_start.reset();
+    }
+  }
+}
+
+}  // namespace net_instaweb
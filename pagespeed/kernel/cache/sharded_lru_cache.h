@@ -0,0 +1,193 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_CACHE_SHARDED_LRU_CACHE_H_
+#define PAGESPEED_KERNEL_CACHE_SHARDED_LRU_CACHE_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/atomic_bool.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/cache/lru_cache_base.h"
+#include "pagespeed/kernel/cache/lru_cache_snapshot.h"
+
+namespace net_instaweb {
+
+class ThreadSystem;
+
+// Thread-safe in-memory LRU cache, for use in place of
+// ThreadsafeCache(LRUCache) when many threads hit the cache at once.
+//
+// Keys are partitioned by hash over a fixed number of shards, each an
+// LRUCacheBase with its own mutex, so threads only contend when their keys
+// land in the same shard.  Unlike ThreadsafeCache, the lock is not held
+// across the validator: Get copies the (reference-counted) value out of the
+// shard and releases the lock before calling back.
+//
+// The byte budget is split evenly over the shards, and each shard evicts
+// independently, as in LevelDB's sharded cache.  Since keys are spread
+// uniformly the shards fill at the same rate, so in steady state this
+// behaves like one LRU of the full size; the sum of the shard sizes never
+// exceeds max_bytes.  An individual value can be at most max_bytes /
+// num_shards, though, so don't over-shard a small cache.
+class ShardedLRUCache : public CacheInterface {
+ public:
+  ShardedLRUCache(size_t max_bytes, int num_shards,
+                  ThreadSystem* thread_system);
+  ~ShardedLRUCache() override;
+
+  void Get(const GoogleString& key, Callback* callback) override;
+  void Put(const GoogleString& key, const SharedString& new_value) override;
+  void Delete(const GoogleString& key) override;
+
+  // Deletes all objects whose key starts with prefix.
+  // Not part of cache interface. Exported for testing only.
+  void DeleteWithPrefixForTesting(StringPiece prefix);
+
+  int num_shards() const { return shards_.size(); }
+
+  // These are summed over all the shards.  Each shard is locked in turn,
+  // so the totals are not a consistent snapshot while other threads are
+  // using the cache.
+  size_t size_bytes() const;
+  size_t max_bytes_in_cache() const;
+  size_t num_elements() const;
+  size_t num_evictions() const;
+  size_t num_hits() const;
+  size_t num_misses() const;
+  size_t num_inserts() const;
+  size_t num_identical_reinserts() const;
+  size_t num_deletes() const;
+  size_t num_warm_start_hits() const;
+
+  // Sanity check the data structures of every shard.
+  void SanityCheck();
+
+  // Clear the entire cache.  As with LRUCache, this does not clear the stats.
+  void Clear();
+
+  // Clear the stats -- note that this will not clear the content.
+  void ClearStats();
+
+  static GoogleString FormatName() { return "ShardedLRUCache"; }
+  GoogleString Name() const override { return FormatName(); }
+  bool IsBlocking() const override { return true; }
+  bool IsHealthy() const override { return is_healthy_.value(); }
+
+  // Writes a final snapshot, if there is a snapshotter, and stops serving.
+  void ShutDown() override;
+
+  void set_is_healthy(bool x) { is_healthy_.set_value(x); }
+
+  // As in LRUCache, warms the cache from the last snapshot stored by
+  // snapshotter when it's first used, and stores new ones periodically and
+  // at ShutDown.  Takes ownership.  Must be called before the cache is used.
+  void set_snapshotter(LRUCacheSnapshotter* snapshotter);
+
+  // Serves Get misses from snapshot, which is split over the shards.
+  void WarmStart(const LRUCacheSnapshot& snapshot);
+
+  // Adds the contents of each shard in turn to *writer, followed by any of
+  // the shard's warm-start entries that haven't been used yet.
+  void AddToSnapshot(LRUCacheSnapshot::Writer* writer) const;
+
+ private:
+  struct SharedStringHelper {
+    size_t size(const SharedString& ss) const { return ss.size(); }
+    bool Equal(const SharedString& a, const SharedString& b) const {
+      return a.Value() == b.Value();
+    }
+    void EvictNotify(const SharedString& a) {}
+    bool ShouldReplace(const SharedString& old_value,
+                       const SharedString& new_value) const {
+      return true;
+    }
+  };
+  typedef LRUCacheBase<SharedString, SharedStringHelper> Base;
+
+  struct Shard {
+    Shard(size_t max_bytes, SharedStringHelper* helper, AbstractMutex* mutex)
+        : mutex(mutex), base(max_bytes, helper), num_warm_start_hits(0) {}
+
+    std::unique_ptr<AbstractMutex> mutex;
+    Base base GUARDED_BY(mutex);
+    // The part of the warm-start snapshot for keys in this shard.
+    std::unique_ptr<LRUCacheSnapshot> warm_start GUARDED_BY(mutex);
+    size_t num_warm_start_hits GUARDED_BY(mutex);
+  };
+
+  int ShardIndex(StringPiece key) const;
+  Shard* ShardFor(const GoogleString& key) const {
+    return shards_[ShardIndex(key)].get();
+  }
+
+  // Adds up to LRUCacheSnapshotter::kEntriesPerPut more entries to the
+  // periodic snapshot being collected, a shard at a time, and hands it to
+  // the snapshotter once every shard is done.  If another thread is already
+  // doing this, returns without waiting for it.
+  void ContinueSnapshot();
+
+  // Loads the warm-start snapshot, the first time the cache is used.
+  void LoadSnapshotIfNecessary();
+
+  // Makes sure key isn't restored from the shard's warm-start snapshot over
+  // a value written or deleted since.
+  static void ForgetSnapshotEntry(const GoogleString& key, Shard* shard)
+      EXCLUSIVE_LOCKS_REQUIRED(shard->mutex);
+
+  // Calls (base.*getter)() on each shard, under its lock, and returns the
+  // sum.
+  size_t Sum(size_t (Base::*getter)() const) const;
+
+  // Stateless, so it can be shared by all the shards without locking.
+  SharedStringHelper value_helper_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  AtomicBool is_healthy_;
+
+  std::unique_ptr<LRUCacheSnapshotter> snapshotter_;
+  // Serializes loading the snapshot; once snapshot_loaded_ is set, only
+  // the shard locks are needed.
+  std::unique_ptr<AbstractMutex> snapshot_mutex_;
+  AtomicBool snapshot_loaded_;
+
+  // Serializes collecting periodic snapshots.  It's taken before any shard
+  // lock.
+  std::unique_ptr<AbstractMutex> collect_mutex_;
+  // Set from when a periodic snapshot is due until it has been collected.
+  AtomicBool collecting_snapshot_;
+  std::unique_ptr<LRUCacheSnapshot::Writer> pending_snapshot_
+      GUARDED_BY(collect_mutex_);
+  // The shard being collected, and whether its walk has been started.
+  int pending_shard_ GUARDED_BY(collect_mutex_);
+  bool pending_shard_started_ GUARDED_BY(collect_mutex_);
+
+  DISALLOW_COPY_AND_ASSIGN(ShardedLRUCache);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_CACHE_SHARDED_LRU_CACHE_H_
@@ -41,11 +41,15 @@ void WriteThroughCache::PutInCache1(const GoogleString& key,
 
 class WriteThroughCallback : public CacheInterface::Callback {
  public:
+  // If cache2_request is non-null, a cache1 miss is added to it rather than
+  // looked up in cache2 right away.
   WriteThroughCallback(WriteThroughCache* wtc, const GoogleString& key,
-                       CacheInterface::Callback* callback)
+                       CacheInterface::Callback* callback,
+                       CacheInterface::MultiGetRequest* cache2_request)
       : write_through_cache_(wtc),
         key_(key),
         callback_(callback),
+        cache2_request_(cache2_request),
         trying_cache2_(false) {}
 
   bool ValidateCandidate(const GoogleString& key,
@@ -66,13 +70,18 @@ class WriteThroughCallback : public CacheInterface::Callback {
       delete this;
     } else {
       trying_cache2_ = true;
-      write_through_cache_->cache2()->Get(key_, this);
+      if (cache2_request_ != nullptr) {
+        cache2_request_->push_back(CacheInterface::KeyCallback(key_, this));
+      } else {
+        write_through_cache_->cache2()->Get(key_, this);
+      }
     }
   }
 
   WriteThroughCache* write_through_cache_;
   GoogleString key_;
   CacheInterface::Callback* callback_;
+  CacheInterface::MultiGetRequest* cache2_request_;
   bool trying_cache2_;
 };
 
@@ -82,7 +91,27 @@ GoogleString WriteThroughCache::FormatName(StringPiece cache1,
 }
 
 void WriteThroughCache::Get(const GoogleString& key, Callback* callback) {
-  cache1_->Get(key, new WriteThroughCallback(this, key, callback));
+  cache1_->Get(key, new WriteThroughCallback(this, key, callback, nullptr));
+}
+
+void WriteThroughCache::MultiGet(MultiGetRequest* request) {
+  if (!cache1_->IsBlocking()) {
+    CacheInterface::MultiGet(request);
+    return;
+  }
+  MultiGetRequest* cache2_request = new MultiGetRequest;
+  for (KeyCallback& key_callback : *request) {
+    key_callback.callback = new WriteThroughCallback(
+        this, key_callback.key, key_callback.callback, cache2_request);
+  }
+  // cache1 calls back before returning, so every miss is in cache2_request
+  // once this returns.
+  cache1_->MultiGet(request);
+  if (cache2_request->empty()) {
+    delete cache2_request;
+  } else {
+    cache2_->MultiGet(cache2_request);
+  }
 }
 
 void WriteThroughCache::Put(const GoogleString& key,
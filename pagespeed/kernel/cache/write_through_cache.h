@@ -42,6 +42,11 @@ class WriteThroughCache : public CacheInterface {
   ~WriteThroughCache() override;
 
   void Get(const GoogleString& key, Callback* callback) override;
+
+  // When cache1 is blocking, looks up all the keys in cache1 and then
+  // issues a single MultiGet to cache2 for those it missed.  Otherwise
+  // falls back to a Get per key.
+  void MultiGet(MultiGetRequest* request) override;
   void Put(const GoogleString& key, const SharedString& value) override;
   void Delete(const GoogleString& key) override;
 
@@ -60,11 +60,14 @@ void HtmlElement::MarkAsDead(const HtmlEventListIterator& end) {
 }
 
 void HtmlElement::SynthesizeEvents(const HtmlEventListIterator& iter,
-                                   HtmlEventList* queue) {
+                                   HtmlEventList* queue,
+                                   HtmlEventArena* arena) {
   // We use -1 as a bogus line number, since these events are synthetic.
-  HtmlEvent* start_tag = new HtmlStartElementEvent(this, Data::kMaxLineNumber);
+  HtmlEvent* start_tag =
+      new (arena) HtmlStartElementEvent(this, Data::kMaxLineNumber);
   set_begin(queue->insert(iter, start_tag));
-  HtmlEvent* end_tag = new HtmlEndElementEvent(this, Data::kMaxLineNumber);
+  HtmlEvent* end_tag =
+      new (arena) HtmlEndElementEvent(this, Data::kMaxLineNumber);
   set_end(queue->insert(iter, end_tag));
 }
 
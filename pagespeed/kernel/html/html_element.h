@@ -343,7 +343,7 @@ class HtmlElement : public HtmlNode {
 
  protected:
   void SynthesizeEvents(const HtmlEventListIterator& iter,
-                        HtmlEventList* queue) override;
+                        HtmlEventList* queue, HtmlEventArena* arena) override;
 
   HtmlEventListIterator begin() const override { return data_->begin_; }
   HtmlEventListIterator end() const override { return data_->end_; }
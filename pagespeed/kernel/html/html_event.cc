@@ -25,6 +25,27 @@
 
 namespace net_instaweb {
 
+namespace {
+
+// Every HtmlEvent subclass must fit in an HtmlEventArena slot.
+template <class Event>
+constexpr bool FitsInArena() {
+  return sizeof(Event) <= HtmlEventArena::kMaxEventSize;
+}
+
+static_assert(FitsInArena<HtmlStartDocumentEvent>() &&
+                  FitsInArena<HtmlEndDocumentEvent>() &&
+                  FitsInArena<HtmlStartElementEvent>() &&
+                  FitsInArena<HtmlEndElementEvent>() &&
+                  FitsInArena<HtmlIEDirectiveEvent>() &&
+                  FitsInArena<HtmlCdataEvent>() &&
+                  FitsInArena<HtmlCommentEvent>() &&
+                  FitsInArena<HtmlCharactersEvent>() &&
+                  FitsInArena<HtmlDirectiveEvent>(),
+              "HtmlEventArena::kMaxEventSize is too small");
+
+}  // namespace
+
 HtmlEvent::~HtmlEvent() {}
 
 void HtmlEvent::DebugPrint() { puts(ToString().c_str()); }
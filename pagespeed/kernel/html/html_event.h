@@ -24,15 +24,30 @@
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/html/html_element.h"
+#include "pagespeed/kernel/html/html_event_list.h"
 #include "pagespeed/kernel/html/html_filter.h"
 #include "pagespeed/kernel/html/html_node.h"
 
 namespace net_instaweb {
 
-class HtmlEvent {
+class HtmlEvent : public HtmlEventListLink {
  public:
   explicit HtmlEvent(int line_number) : line_number_(line_number) {}
   virtual ~HtmlEvent();
+
+  // HtmlParse allocates its events from an HtmlEventArena.  Events created
+  // with plain 'new' come from the heap.  Either kind is freed with 'delete'.
+  void* operator new(size_t size, HtmlEventArena* arena) {
+    return arena->Allocate(size);
+  }
+  void* operator new(size_t size) {
+    return HtmlEventArena::AllocateFromHeap(size);
+  }
+  void operator delete(void* ptr, HtmlEventArena* arena) {
+    HtmlEventArena::Free(ptr);
+  }
+  void operator delete(void* ptr) { HtmlEventArena::Free(ptr); }
+
   virtual void Run(HtmlFilter* filter) = 0;
   virtual GoogleString ToString() const = 0;
 
@@ -201,6 +216,10 @@ class HtmlDirectiveEvent : public HtmlLeafNodeEvent {
   DISALLOW_COPY_AND_ASSIGN(HtmlDirectiveEvent);
 };
 
+inline HtmlEvent* HtmlEventListIterator::operator*() const {
+  return static_cast<HtmlEvent*>(link_);
+}
+
 }  // namespace net_instaweb
 
 #endif  // PAGESPEED_KERNEL_HTML_HTML_EVENT_H_
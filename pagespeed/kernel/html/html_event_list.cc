@@ -0,0 +1,180 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/kernel/html/html_event_list.h"
+
+#include <cstddef>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/html/html_event.h"
+
+namespace net_instaweb {
+
+HtmlEventListLink* HtmlEventList::ToLink(HtmlEvent* event) {
+  return static_cast<HtmlEventListLink*>(event);
+}
+
+HtmlEventList::iterator HtmlEventList::insert(const iterator& pos,
+                                              HtmlEvent* event) {
+  HtmlEventListLink* link = ToLink(event);
+  HtmlEventListLink* next = pos.link_;
+  HtmlEventListLink* prev = next->prev_;
+  link->prev_ = prev;
+  link->next_ = next;
+  prev->next_ = link;
+  next->prev_ = link;
+  ++size_;
+  return iterator(link);
+}
+
+HtmlEventList::iterator HtmlEventList::erase(const iterator& pos) {
+  HtmlEventListLink* link = pos.link_;
+  DCHECK(link != &sentinel_);
+  HtmlEventListLink* next = link->next_;
+  link->prev_->next_ = next;
+  next->prev_ = link->prev_;
+  link->prev_ = link->next_ = nullptr;
+  --size_;
+  return iterator(next);
+}
+
+void HtmlEventList::splice(const iterator& pos, HtmlEventList& other,
+                           const iterator& first, const iterator& last) {
+  if (first == last) {
+    return;
+  }
+  if (&other != this) {
+    size_t count = 0;
+    for (iterator p = first; p != last; ++p) {
+      ++count;
+    }
+    other.size_ -= count;
+    size_ += count;
+  }
+
+  // Unlink [first, last) from other...
+  HtmlEventListLink* head = first.link_;
+  HtmlEventListLink* tail = last.link_->prev_;
+  head->prev_->next_ = last.link_;
+  last.link_->prev_ = head->prev_;
+
+  // ...and link it back in before pos.
+  HtmlEventListLink* next = pos.link_;
+  HtmlEventListLink* prev = next->prev_;
+  prev->next_ = head;
+  head->prev_ = prev;
+  tail->next_ = next;
+  next->prev_ = tail;
+}
+
+HtmlEventArena::HtmlEventArena()
+    : current_chunk_(-1),
+      next_slot_(nullptr),
+      chunk_end_(nullptr),
+      free_list_(nullptr),
+      live_events_(0) {}
+
+HtmlEventArena::~HtmlEventArena() {
+  DCHECK_EQ(0, live_events_);
+  Release();
+}
+
+void* HtmlEventArena::Allocate(size_t size) {
+  if (size > kMaxEventSize) {
+    LOG(DFATAL) << "HtmlEvent of size " << size << " does not fit in arena";
+    return AllocateFromHeap(size);
+  }
+  Slot* slot = free_list_;
+  if (slot != nullptr) {
+    free_list_ = slot->header.next_free;
+  } else {
+    if (next_slot_ == chunk_end_) {
+      NextChunk();
+    }
+    slot = next_slot_++;
+  }
+  slot->header.owner = this;
+  ++live_events_;
+  return slot->payload;
+}
+
+void* HtmlEventArena::AllocateFromHeap(size_t size) {
+  Slot* slot = static_cast<Slot*>(
+      ::operator new(offsetof(Slot, payload) + size));
+  slot->header.owner = nullptr;
+  return slot->payload;
+}
+
+void HtmlEventArena::Free(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  Slot* slot = SlotFor(ptr);
+  HtmlEventArena* owner = slot->header.owner;
+  if (owner == nullptr) {
+    ::operator delete(slot);
+  } else {
+    owner->FreeSlot(slot);
+  }
+}
+
+HtmlEventArena::Slot* HtmlEventArena::SlotFor(void* ptr) {
+  return reinterpret_cast<Slot*>(static_cast<char*>(ptr) -
+                                 offsetof(Slot, payload));
+}
+
+void HtmlEventArena::FreeSlot(Slot* slot) {
+  DCHECK_LT(0, live_events_);
+  slot->header.next_free = free_list_;
+  free_list_ = slot;
+  --live_events_;
+}
+
+void HtmlEventArena::NextChunk() {
+  ++current_chunk_;
+  if (current_chunk_ == static_cast<int>(chunks_.size())) {
+    chunks_.push_back(new Slot[kSlotsPerChunk]);
+  }
+  next_slot_ = chunks_[current_chunk_];
+  chunk_end_ = next_slot_ + kSlotsPerChunk;
+}
+
+bool HtmlEventArena::Rewind() {
+  if (live_events_ != 0) {
+    return false;
+  }
+  current_chunk_ = -1;
+  next_slot_ = nullptr;
+  chunk_end_ = nullptr;
+  free_list_ = nullptr;
+  return true;
+}
+
+bool HtmlEventArena::Release() {
+  if (!Rewind()) {
+    return false;
+  }
+  for (int i = 0, n = chunks_.size(); i < n; ++i) {
+    delete[] chunks_[i];
+  }
+  chunks_.clear();
+  return true;
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,217 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_HTML_HTML_EVENT_LIST_H_
+#define PAGESPEED_KERNEL_HTML_HTML_EVENT_LIST_H_
+
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+
+namespace net_instaweb {
+
+class HtmlEvent;
+class HtmlEventList;
+
+// Links embedded in every HtmlEvent so that HtmlEventList needs no per-entry
+// allocation.  An event is in at most one list at a time.
+class HtmlEventListLink {
+ protected:
+  HtmlEventListLink() : prev_(nullptr), next_(nullptr) {}
+
+ private:
+  friend class HtmlEventList;
+  friend class HtmlEventListIterator;
+
+  HtmlEventListLink* prev_;
+  HtmlEventListLink* next_;
+
+  DISALLOW_COPY_AND_ASSIGN(HtmlEventListLink);
+};
+
+// Bidirectional iterator over an HtmlEventList.  As with std::list, an
+// iterator stays valid until the event it refers to is erased, and it
+// follows the event when the event is spliced into another list.
+class HtmlEventListIterator {
+ public:
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef HtmlEvent* value_type;
+  typedef ptrdiff_t difference_type;
+  typedef HtmlEvent** pointer;
+  typedef HtmlEvent* reference;
+
+  HtmlEventListIterator() : link_(nullptr) {}
+
+  // Defined in html_event.h, where HtmlEvent is a complete type.
+  inline HtmlEvent* operator*() const;
+
+  HtmlEventListIterator& operator++() {
+    link_ = link_->next_;
+    return *this;
+  }
+  HtmlEventListIterator operator++(int) {
+    HtmlEventListIterator old = *this;
+    link_ = link_->next_;
+    return old;
+  }
+  HtmlEventListIterator& operator--() {
+    link_ = link_->prev_;
+    return *this;
+  }
+  HtmlEventListIterator operator--(int) {
+    HtmlEventListIterator old = *this;
+    link_ = link_->prev_;
+    return old;
+  }
+
+  bool operator==(const HtmlEventListIterator& other) const {
+    return link_ == other.link_;
+  }
+  bool operator!=(const HtmlEventListIterator& other) const {
+    return link_ != other.link_;
+  }
+
+ private:
+  friend class HtmlEventList;
+
+  explicit HtmlEventListIterator(HtmlEventListLink* link) : link_(link) {}
+
+  HtmlEventListLink* link_;
+};
+
+// Intrusive doubly-linked list of HtmlEvent*, with the subset of the
+// std::list interface used by HtmlParse.  The list never owns its events:
+// erase() and clear() only unlink them, and it is up to the caller to delete
+// them, exactly as with the std::list<HtmlEvent*> this replaces.
+class HtmlEventList {
+ public:
+  typedef HtmlEventListIterator iterator;
+
+  HtmlEventList() { clear(); }
+  ~HtmlEventList() {}
+
+  iterator begin() const { return iterator(sentinel_.next_); }
+  iterator end() const {
+    return iterator(const_cast<HtmlEventListLink*>(&sentinel_));
+  }
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  void push_back(HtmlEvent* event) { insert(end(), event); }
+  void push_front(HtmlEvent* event) { insert(begin(), event); }
+
+  // Links event in just before pos, returning an iterator to it.
+  iterator insert(const iterator& pos, HtmlEvent* event);
+
+  // Unlinks the event at pos, returning an iterator to the event after it.
+  iterator erase(const iterator& pos);
+
+  // Moves [first, last) from other to just before pos.  other may be this
+  // list, as long as pos is not within [first, last).  This is constant time
+  // within a list and linear in the length of the range across lists.
+  void splice(const iterator& pos, HtmlEventList& other,  // NOLINT
+              const iterator& first, const iterator& last);
+
+  // Unlinks all events without touching them, so it is safe to call after
+  // the events have been deleted.
+  void clear() {
+    sentinel_.prev_ = sentinel_.next_ = &sentinel_;
+    size_ = 0;
+  }
+
+ private:
+  // Defined in html_event_list.cc, where HtmlEvent is a complete type.
+  static HtmlEventListLink* ToLink(HtmlEvent* event);
+
+  // end(); its next_ is the first event and its prev_ the last.
+  HtmlEventListLink sentinel_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(HtmlEventList);
+};
+
+// Slab allocator for HtmlEvents, all of which are small and roughly the same
+// size.  Events are carved out of 8k chunks in the order they are lexed;
+// deleted events go on a free-list and are reused.  Once every event from a
+// flush window has been deleted, Rewind() lets the next window start again at
+// the beginning of the first chunk, so steady-state parsing does no heap
+// allocation for events at all.
+//
+// Each slot is preceded by a pointer to the owning arena, so plain 'delete'
+// works on an arena-allocated HtmlEvent (see HtmlEvent::operator delete).
+class HtmlEventArena {
+ public:
+  // Every HtmlEvent subclass must fit in this; see html_event.cc.
+  static const size_t kMaxEventSize = 5 * sizeof(void*);
+
+  HtmlEventArena();
+  ~HtmlEventArena();
+
+  void* Allocate(size_t size);
+
+  // Used by plain 'new HtmlEvent', e.g. in tests.  Such events are freed
+  // back to the heap when deleted.
+  static void* AllocateFromHeap(size_t size);
+
+  // Frees an event allocated by either Allocate or AllocateFromHeap.
+  static void Free(void* ptr);
+
+  // If no events allocated from this arena are still live, restarts
+  // allocation at the beginning of the first chunk and returns true.
+  // Returns false, and does nothing, if any event is live, e.g. because a
+  // filter deferred a node across the flush window.
+  bool Rewind();
+
+  // Like Rewind(), but also returns all the chunks to the heap.
+  bool Release();
+
+  int live_events() const { return live_events_; }
+  int num_chunks() const { return chunks_.size(); }
+
+ private:
+  struct Slot;
+  union SlotHeader {
+    HtmlEventArena* owner;  // While allocated; nullptr if from the heap.
+    Slot* next_free;        // While on the free-list.
+  };
+  struct Slot {
+    SlotHeader header;
+    void* payload[kMaxEventSize / sizeof(void*)];
+  };
+  static const int kSlotsPerChunk = 8192 / sizeof(Slot);
+
+  static Slot* SlotFor(void* ptr);
+  void FreeSlot(Slot* slot);
+  void NextChunk();
+
+  std::vector<Slot*> chunks_;
+  int current_chunk_;  // Index into chunks_ of the chunk we are carving.
+  Slot* next_slot_;    // Next unused slot in the current chunk.
+  Slot* chunk_end_;    // One past the last slot in the current chunk.
+  Slot* free_list_;
+  int live_events_;
+
+  DISALLOW_COPY_AND_ASSIGN(HtmlEventArena);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_HTML_HTML_EVENT_LIST_H_
@@ -32,6 +32,7 @@
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/html/html_event.h"
 #include "pagespeed/kernel/html/html_keywords.h"
+#include "pagespeed/kernel/html/html_lexer_scanner.h"
 #include "pagespeed/kernel/html/html_name.h"
 #include "pagespeed/kernel/html/html_node.h"
 #include "pagespeed/kernel/html/html_parse.h"
@@ -617,7 +618,7 @@ void HtmlLexer::EvalScriptTag(char c) {
 // Emits raw uninterpreted characters.
 void HtmlLexer::EmitLiteral() {
   if (!literal_.empty()) {
-    html_parse_->AddEvent(new HtmlCharactersEvent(
+    html_parse_->AddEvent(new (html_parse_->event_arena()) HtmlCharactersEvent(
         html_parse_->NewCharactersNode(Parent(), literal_), tag_start_line_));
     literal_.clear();
   }
@@ -634,10 +635,12 @@ void HtmlLexer::EmitComment() {
       (token_.find("[endif]") != GoogleString::npos)) {
     HtmlIEDirectiveNode* node =
         html_parse_->NewIEDirectiveNode(Parent(), token_);
-    html_parse_->AddEvent(new HtmlIEDirectiveEvent(node, tag_start_line_));
+    html_parse_->AddEvent(new (html_parse_->event_arena())
+                              HtmlIEDirectiveEvent(node, tag_start_line_));
   } else {
     HtmlCommentNode* node = html_parse_->NewCommentNode(Parent(), token_);
-    html_parse_->AddEvent(new HtmlCommentEvent(node, tag_start_line_));
+    html_parse_->AddEvent(new (html_parse_->event_arena())
+                              HtmlCommentEvent(node, tag_start_line_));
   }
   token_.clear();
   state_ = START;
@@ -645,7 +648,7 @@ void HtmlLexer::EmitComment() {
 
 void HtmlLexer::EmitCdata() {
   literal_.clear();
-  html_parse_->AddEvent(new HtmlCdataEvent(
+  html_parse_->AddEvent(new (html_parse_->event_arena()) HtmlCdataEvent(
       html_parse_->NewCdataNode(Parent(), token_), tag_start_line_));
   token_.clear();
   state_ = START;
@@ -993,7 +996,7 @@ void HtmlLexer::EmitTagClose(HtmlElement::Style style) {
 
 void HtmlLexer::EmitDirective() {
   literal_.clear();
-  html_parse_->AddEvent(new HtmlDirectiveEvent(
+  html_parse_->AddEvent(new (html_parse_->event_arena()) HtmlDirectiveEvent(
       html_parse_->NewDirectiveNode(Parent(), token_), line_));
   // Update the doctype; note that if this is not a doctype directive, Parse()
   // will return false and not alter doctype_.
@@ -1125,6 +1128,49 @@ void HtmlLexer::Parse(const char* text, int size) {
         EvalBogusComment(c);
         break;
     }
+
+    // Text, comments, CDATA, quoted attribute values and the contents of
+    // literal tags tend to come in long runs that the state machine above
+    // would just append one byte at a time.  Take them in one go instead.
+    if (HasInertRuns(state_) && !skip_parsing_) {
+      const char* run = text + i + 1;
+      int run_length = InertRunLength(run, size - i - 1);
+      if (run_length > 0) {
+        line_ += std::count(run, run + run_length, '\n');
+        literal_.append(run, run_length);
+        if ((state_ == COMMENT_BODY) || (state_ == CDATA_BODY)) {
+          token_.append(run, run_length);
+        } else if ((state_ == TAG_ATTR_VALDQ) || (state_ == TAG_ATTR_VALSQ)) {
+          attr_value_.append(run, run_length);
+        }
+        i += run_length;
+      }
+    }
+  }
+}
+
+int HtmlLexer::InertRunLength(const char* text, int size) const {
+  DCHECK(HasInertRuns(state_));
+  if (size <= 0) {
+    return 0;
+  }
+  switch (state_) {
+    case START:
+      return html_lexer_scanner::SkipToByte(text, size, '<');
+    case COMMENT_BODY:
+      return html_lexer_scanner::SkipToByte(text, size, '-');
+    case CDATA_BODY:
+      return html_lexer_scanner::SkipToByte(text, size, ']');
+    case TAG_ATTR_VALDQ:
+      return html_lexer_scanner::SkipToByte(text, size, '"');
+    case TAG_ATTR_VALSQ:
+      return html_lexer_scanner::SkipToByte(text, size, '\'');
+    case LITERAL_TAG:
+      return html_lexer_scanner::SkipToByte(text, size, '>');
+    case SCRIPT_TAG:
+      return html_lexer_scanner::SkipScriptBody(text, size);
+    default:
+      return 0;
   }
 }
 
@@ -146,6 +146,12 @@ class HtmlLexer {
   void EmitDirective();
   void Restart(char c);
 
+  // Returns how many of the size bytes at text can be appended to literal_
+  // (and token_ for comment and CDATA bodies, or attr_value_ for quoted
+  // attribute values) without any other effect on the current state.
+  // text[-1] must be the byte just parsed.
+  int InertRunLength(const char* text, int size) const;
+
   // Emits a syntax error message.
   void SyntaxError(const char* format, ...) INSTAWEB_PRINTF_FORMAT(2, 3);
 
@@ -218,6 +224,14 @@ class HtmlLexer {
     BOGUS_COMMENT,        // "<?foo>" or "</?foo>"
   };
 
+  // Whether state has long runs of bytes that InertRunLength can skip.
+  static bool HasInertRuns(State state) {
+    return ((state == START) || (state == COMMENT_BODY) ||
+            (state == CDATA_BODY) || (state == TAG_ATTR_VALDQ) ||
+            (state == TAG_ATTR_VALSQ) || (state == LITERAL_TAG) ||
+            (state == SCRIPT_TAG));
+  }
+
   HtmlParse* html_parse_;
   State state_;
   GoogleString token_;                  // accumulates tag names and comments
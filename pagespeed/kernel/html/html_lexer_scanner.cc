@@ -0,0 +1,101 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/kernel/html/html_lexer_scanner.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace net_instaweb {
+
+namespace html_lexer_scanner {
+
+namespace {
+
+// Must agree with CanEndTag in html_lexer.cc.
+inline bool CanEndTag(char c) {
+  return (c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == ' ' ||
+          c == '/' || c == '>');
+}
+
+inline bool IsScriptStop(char prev, char c) {
+  return (c == '-' || c == '>' ||
+          (CanEndTag(c) && (prev == 't' || prev == 'T')));
+}
+
+}  // namespace
+
+int SkipToByte(const char* text, int size, char c) {
+  const void* found = memchr(text, c, size);
+  return (found == nullptr) ? size : static_cast<const char*>(found) - text;
+}
+
+int SkipScriptBodyScalar(const char* text, int size) {
+  for (int i = 0; i < size; ++i) {
+    if (IsScriptStop(text[i - 1], text[i])) {
+      return i;
+    }
+  }
+  return size;
+}
+
+int SkipScriptBody(const char* text, int size) {
+  int i = 0;
+#ifdef __SSE2__
+  const __m128i dash = _mm_set1_epi8('-');
+  const __m128i gt = _mm_set1_epi8('>');
+  const __m128i slash = _mm_set1_epi8('/');
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i form_feed = _mm_set1_epi8('\f');
+  const __m128i lower_case_bit = _mm_set1_epi8(0x20);
+  const __m128i t = _mm_set1_epi8('t');
+  for (; i + 16 <= size; i += 16) {
+    __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+    __m128i prev =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i - 1));
+    // Only 'T' and 't' become 't' when the 0x20 bit is set.
+    __m128i prev_is_t = _mm_cmpeq_epi8(_mm_or_si128(prev, lower_case_bit), t);
+    __m128i can_end = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(cur, space), _mm_cmpeq_epi8(cur, slash)),
+        _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(cur, tab), _mm_cmpeq_epi8(cur, newline)),
+            _mm_or_si128(_mm_cmpeq_epi8(cur, cr),
+                         _mm_cmpeq_epi8(cur, form_feed))));
+    __m128i stop =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(cur, dash),
+                                  _mm_cmpeq_epi8(cur, gt)),
+                     _mm_and_si128(can_end, prev_is_t));
+    int mask = _mm_movemask_epi8(stop);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+  return i + SkipScriptBodyScalar(text + i, size - i);
+}
+
+}  // namespace html_lexer_scanner
+
+}  // namespace net_instaweb
@@ -0,0 +1,55 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_HTML_HTML_LEXER_SCANNER_H_
+#define PAGESPEED_KERNEL_HTML_HTML_LEXER_SCANNER_H_
+
+namespace net_instaweb {
+
+namespace html_lexer_scanner {
+
+// Block scanners that let HtmlLexer::Parse skip over runs of bytes that
+// cannot change its state, rather than dispatching on each one.  Each
+// returns the length of the leading run of text[0, size) that the lexer
+// may consume in bulk, i.e. the index of the first byte it must look at,
+// or size if there is none.
+
+// For text, comment and CDATA bodies, quoted attribute values and literal
+// tags like <style>, the lexer only cares about a single byte: '<', '-',
+// ']', the quote, and '>' respectively.  This is memchr, which the C
+// library vectorizes.
+int SkipToByte(const char* text, int size, char c);
+
+// For <script> bodies the lexer looks at '-' and '>', and at whitespace or
+// '/' when it might be terminating "</script" or "<script".  Those both end
+// in 't' or 'T', so a whitespace or '/' byte can only matter if the byte
+// before it is one.  text[-1] must therefore be readable.
+//
+// Uses SSE2 where the compiler targets it, 16 bytes at a time.
+int SkipScriptBody(const char* text, int size);
+
+// Byte-at-a-time version of SkipScriptBody, used for the tail of the buffer
+// and where SSE2 is not available.  Exposed for testing.
+int SkipScriptBodyScalar(const char* text, int size);
+
+}  // namespace html_lexer_scanner
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_HTML_HTML_LEXER_SCANNER_H_
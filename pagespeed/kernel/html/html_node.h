@@ -21,7 +21,6 @@
 #define PAGESPEED_KERNEL_HTML_HTML_NODE_H_
 
 #include <cstddef>
-#include <list>
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/arena.h"
@@ -29,14 +28,11 @@
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/html/html_event_list.h"
 
 namespace net_instaweb {
 
 class HtmlElement;
-class HtmlEvent;
-
-typedef std::list<HtmlEvent*> HtmlEventList;
-typedef HtmlEventList::iterator HtmlEventListIterator;
 
 // Base class for HtmlElement and HtmlLeafNode.  Generally represents all
 // lexical tokens in HTML, except that for subclass HtmlElement, which
@@ -74,9 +70,11 @@ class HtmlNode {
   // Create new event object(s) representing this node, and insert them into
   // the queue just before the given iterator; also, update this node object as
   // necessary so that begin() and end() will return iterators pointing to
-  // the new event(s).  The line number for each event should probably be -1.
+  // the new event(s).  The events are allocated from arena.  The line number
+  // for each event should probably be -1.
   virtual void SynthesizeEvents(const HtmlEventListIterator& iter,
-                                HtmlEventList* queue) = 0;
+                                HtmlEventList* queue,
+                                HtmlEventArena* arena) = 0;
 
   // Return an iterator pointing to the first event associated with this node.
   virtual HtmlEventListIterator begin() const = 0;
@@ -147,7 +145,7 @@ class HtmlCdataNode : public HtmlLeafNode {
 
  protected:
   void SynthesizeEvents(const HtmlEventListIterator& iter,
-                        HtmlEventList* queue) override;
+                        HtmlEventList* queue, HtmlEventArena* arena) override;
 
  private:
   HtmlCdataNode(HtmlElement* parent, const StringPiece& contents,
@@ -171,7 +169,7 @@ class HtmlCharactersNode : public HtmlLeafNode {
 
  protected:
   void SynthesizeEvents(const HtmlEventListIterator& iter,
-                        HtmlEventList* queue) override;
+                        HtmlEventList* queue, HtmlEventArena* arena) override;
 
  private:
   HtmlCharactersNode(HtmlElement* parent, const StringPiece& contents,
@@ -189,7 +187,7 @@ class HtmlCommentNode : public HtmlLeafNode {
 
  protected:
   void SynthesizeEvents(const HtmlEventListIterator& iter,
-                        HtmlEventList* queue) override;
+                        HtmlEventList* queue, HtmlEventArena* arena) override;
 
  private:
   HtmlCommentNode(HtmlElement* parent, const StringPiece& contents,
@@ -207,7 +205,7 @@ class HtmlIEDirectiveNode : public HtmlLeafNode {
 
  protected:
   void SynthesizeEvents(const HtmlEventListIterator& iter,
-                        HtmlEventList* queue) override;
+                        HtmlEventList* queue, HtmlEventArena* arena) override;
 
  private:
   HtmlIEDirectiveNode(HtmlElement* parent, const StringPiece& contents,
@@ -225,7 +223,7 @@ class HtmlDirectiveNode : public HtmlLeafNode {
 
  protected:
   void SynthesizeEvents(const HtmlEventListIterator& iter,
-                        HtmlEventList* queue) override;
+                        HtmlEventList* queue, HtmlEventArena* arena) override;
 
  private:
   HtmlDirectiveNode(HtmlElement* parent, const StringPiece& contents,
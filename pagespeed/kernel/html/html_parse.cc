@@ -234,7 +234,7 @@ HtmlElement* HtmlParse::NewElement(HtmlElement* parent, const HtmlName& name) {
 
 void HtmlParse::AddElement(HtmlElement* element, int line_number) {
   HtmlStartElementEvent* event =
-      new HtmlStartElementEvent(element, line_number);
+      new (&event_arena_) HtmlStartElementEvent(element, line_number);
   AddEvent(event);
   element->set_begin(Last());
   element->set_begin_line_number(line_number);
@@ -278,7 +278,7 @@ bool HtmlParse::StartParseId(const StringPiece& url, const StringPiece& id,
       parse_start_time_us_ = timer_->NowUs();
       InfoHere("HtmlParse::StartParse");
     }
-    AddEvent(new HtmlStartDocumentEvent(line_number_));
+    AddEvent(new (&event_arena_) HtmlStartDocumentEvent(line_number_));
     lexer_->StartParse(id, content_type);
   }
   return url_valid_;
@@ -309,7 +309,7 @@ void HtmlParse::BeginFinishParse() {
     lexer_->FinishParse();
     DCHECK(delayed_start_literal_.get() == nullptr);
     delayed_start_literal_.reset();
-    AddEvent(new HtmlEndDocumentEvent(line_number_));
+    AddEvent(new (&event_arena_) HtmlEndDocumentEvent(line_number_));
   }
 }
 
@@ -576,8 +576,9 @@ void HtmlParse::ClearEvents() {
   // the events and deleting the contents of Closed elements, though we are
   // leaving the HtmlElement* and other HtmlNodes allocated until EndFinishParse
   // is called.
-  for (current_ = queue_.begin(); current_ != queue_.end(); ++current_) {
-    HtmlEvent* event = *current_;
+  for (current_ = queue_.begin(); current_ != queue_.end();) {
+    // Advance before deleting the event, as its list links go with it.
+    HtmlEvent* event = *current_++;
     line_number_ = event->line_number();
     HtmlElement* element = event->GetElementIfStartEvent();
     if (element != nullptr) {
@@ -598,6 +599,9 @@ void HtmlParse::ClearEvents() {
     delete event;
   }
   queue_.clear();
+  // Unless a filter is holding on to events across the flush window, let the
+  // next window's events reuse the arena from the start.
+  event_arena_.Rewind();
   need_sanity_check_ = false;
   need_coalesce_characters_ = false;
 }
@@ -676,7 +680,7 @@ void HtmlParse::InsertNodeBeforeEvent(const HtmlEventListIterator& event,
                                       HtmlNode* new_node) {
   need_sanity_check_ = true;
   need_coalesce_characters_ = true;
-  new_node->SynthesizeEvents(event, &queue_);
+  new_node->SynthesizeEvents(event, &queue_, &event_arena_);
 }
 
 void HtmlParse::InsertNodeAfterEvent(const HtmlEventListIterator& event,
@@ -1022,6 +1026,7 @@ bool HtmlParse::IsInEventWindow(const HtmlEventListIterator& iter) const {
 void HtmlParse::ClearElements() {
   ClearDeferredNodes();
   nodes_.DestroyObjects();
+  event_arena_.Release();
   DCHECK(!running_filters_);
 }
 
@@ -1187,7 +1192,7 @@ void HtmlParse::CloseElement(HtmlElement* element, HtmlElement::Style style,
   }
 
   HtmlEndElementEvent* end_event =
-      new HtmlEndElementEvent(element, line_number);
+      new (&event_arena_) HtmlEndElementEvent(element, line_number);
   if (element->style() != HtmlElement::INVISIBLE) {
     element->set_style(style);
   }
@@ -1277,8 +1282,8 @@ bool HtmlParse::InsertComment(StringPiece unescaped) {
     if (parent != nullptr && IsLiteralTag(parent->keyword())) {
       return false;
     }
-    AddEvent(
-        new HtmlCommentEvent(NewCommentNode(lexer_->Parent(), escaped), 0));
+    AddEvent(new (&event_arena_) HtmlCommentEvent(
+        NewCommentNode(lexer_->Parent(), escaped), 0));
   }
   return true;
 }
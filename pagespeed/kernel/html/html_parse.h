@@ -36,6 +36,7 @@
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/symbol_table.h"
 #include "pagespeed/kernel/html/html_element.h"
+#include "pagespeed/kernel/html/html_event_list.h"
 #include "pagespeed/kernel/html/html_name.h"
 #include "pagespeed/kernel/html/html_node.h"
 #include "pagespeed/kernel/http/content_type.h"
@@ -350,6 +351,9 @@ class HtmlParse {
   // Implementation helper with detailed knowledge of html parsing libraries
   friend class HtmlLexer;
 
+  // The lexer allocates the events it adds from here.
+  HtmlEventArena* event_arena() { return &event_arena_; }
+
   // Determines whether a tag should be terminated in HTML, e.g. <meta ..>.
   // We do not expect to see a close-tag for meta and should never insert one.
   bool IsImplicitlyClosedTag(HtmlName::Keyword keyword) const;
@@ -635,6 +639,9 @@ class HtmlParse {
   FilterList filters_;
   HtmlLexer* lexer_;
   Arena<HtmlNode> nodes_;
+  // Must be declared before anything that holds events, so it is destroyed
+  // after them.
+  HtmlEventArena event_arena_;
   HtmlEventList queue_;
   HtmlEventListIterator current_;
   // Have we deleted current? Then we shouldn't do certain manipulations to it.
@@ -39,6 +39,7 @@ const char HttpAttributes::kAltSvc[] = "Alt-Svc";
 const char HttpAttributes::kAlternateProtocol[] = "Alternate-Protocol";
 const char HttpAttributes::kAttachment[] = "attachment";
 const char HttpAttributes::kAuthorization[] = "Authorization";
+const char HttpAttributes::kBrotli[] = "br";
 const char HttpAttributes::kCacheControl[] = "Cache-Control";
 const char HttpAttributes::kConnection[] = "Connection";
 const char HttpAttributes::kContentDisposition[] = "Content-Disposition";
@@ -709,8 +709,8 @@ bool ScanlineResizer::Initialize(ScanlineReaderInterface* reader,
     return false;
   }
 
-  const int input_width = static_cast<int>(reader->GetImageWidth());
-  const int input_height = static_cast<int>(reader->GetImageHeight());
+  int input_width = static_cast<int>(reader->GetImageWidth());
+  int input_height = static_cast<int>(reader->GetImageHeight());
 
   // TODO(huibao): Truncate the requested image size if it is larger than the
   // input in 'image_rewrite_filter.cc'. Report an error and return 'false'
@@ -737,6 +737,19 @@ bool ScanlineResizer::Initialize(ScanlineReaderInterface* reader,
                           output_height, &resized_width, &resized_height,
                           &ratio_x, &ratio_y, message_handler_);
 
+  // Let the reader do some of the shrinking while decoding, e.g., in the DCT
+  // domain for JPEG, and area-average what is left.  Leaving at least 2x for
+  // the area-averaging keeps the output close to what we get from the full
+  // size image; going all the way down to the output size can leave ratios
+  // just above 1, which area-averaging handles poorly.
+  if (reader->SetMinimumDecodeSize(2 * resized_width, 2 * resized_height)) {
+    input_width = static_cast<int>(reader->GetImageWidth());
+    input_height = static_cast<int>(reader->GetImageHeight());
+    ComputeResizedSizeRatio(input_width, input_height, resized_width,
+                            resized_height, &resized_width, &resized_height,
+                            &ratio_x, &ratio_y, message_handler_);
+  }
+
   reader_ = reader;
   height_ = resized_height;
   width_ = resized_width;
@@ -236,6 +236,42 @@ ScanlineStatus JpegScanlineReader::InitializeWithStatus(const void* image_data,
   return ScanlineStatus(SCANLINE_STATUS_SUCCESS);
 }
 
+bool JpegScanlineReader::SetMinimumDecodeSize(size_t min_width,
+                                              size_t min_height) {
+  if (!was_initialized_ || row_ != 0 || min_width == 0 || min_height == 0) {
+    return false;
+  }
+
+  // Scale from the full size, so that calling this again is harmless.
+  // libjpeg rounds scaled dimensions up.
+  jpeg_decompress_struct* jpeg_decompress = &(jpeg_env_->jpeg_decompress_);
+  const size_t image_width = jpeg_decompress->image_width;
+  const size_t image_height = jpeg_decompress->image_height;
+  size_t scale_denom = 8;
+  while (scale_denom > 1 &&
+         ((image_width + scale_denom - 1) / scale_denom < min_width ||
+          (image_height + scale_denom - 1) / scale_denom < min_height)) {
+    scale_denom /= 2;
+  }
+  if (scale_denom == 1 && width_ == image_width) {
+    return false;
+  }
+
+  if (setjmp(jpeg_env_->jmp_buf_env_)) {
+    Reset();
+    return false;
+  }
+
+  jpeg_decompress->scale_num = 1;
+  jpeg_decompress->scale_denom = scale_denom;
+  jpeg_calc_output_dimensions(jpeg_decompress);
+
+  width_ = jpeg_decompress->output_width;
+  height_ = jpeg_decompress->output_height;
+  bytes_per_row_ = (pixel_format_ == GRAY_8 ? 1 : 3) * width_;
+  return scale_denom > 1;
+}
+
 ScanlineStatus JpegScanlineReader::ReadNextScanlineWithStatus(
     void** out_scanline_bytes) {
   if (!was_initialized_ || !HasMoreScanLines()) {
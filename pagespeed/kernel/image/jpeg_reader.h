@@ -99,6 +99,12 @@ class JpegScanlineReader : public ScanlineReaderInterface {
   size_t GetImageWidth() override { return width_; }
   bool IsProgressive() override { return is_progressive_; }
 
+  // Has libjpeg scale the image by the smallest of 1/8, 1/4 or 1/2 that
+  // keeps it at least min_width by min_height.  The scaling is done in the
+  // IDCT, so it saves most of the decoding work and memory as well as the
+  // work of resizing the full-sized image afterwards.
+  bool SetMinimumDecodeSize(size_t min_width, size_t min_height) override;
+
  private:
   JpegEnv* jpeg_env_;              // State of libjpeg
   unsigned char* row_pointer_[1];  // Pointer for a row buffer
@@ -19,12 +19,18 @@
 
 #include "pagespeed/kernel/image/png_optimizer.h"
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include "base/logging.h"
+#include "pagespeed/kernel/base/atomic_int32.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/stl_util.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/image/scanline_utils.h"
 
 #ifdef __native_client__
@@ -47,7 +53,9 @@ extern "C" {
 #include "external/optipng/src/opngreduc/opngreduc.h"
 }
 
+using net_instaweb::AtomicInt32;
 using net_instaweb::MessageHandler;
+using net_instaweb::ThreadSystem;
 using pagespeed::image_compression::PngCompressParams;
 
 namespace {
@@ -83,6 +91,24 @@ const PngCompressParams kPngCompressionParams[] = {
 
 const size_t kParamCount = arraysize(kPngCompressionParams);
 
+// Aborts the libpng call in progress on png_ptr.
+void PngLongjmp(png_structp png_ptr) {
+#if PNG_LIBPNG_VER >= 10400
+#ifndef __native_client__
+  png_longjmp(png_ptr, 1);
+#else
+  // On native client, invoking png_longjmp as above causes a
+  // crash. Invoking longjmp directly, however, works fine.  For the
+  // time being we use this workaround for native client builds. See
+  // http://code.google.com/p/page-speed/issues/detail?id=644 for
+  // more information.
+  longjmp(png_ptr->longjmp_buffer, 1);
+#endif
+#else
+  longjmp(png_ptr->jmpbuf, 1);
+#endif
+}
+
 void ReadPngFromStream(png_structp read_ptr, png_bytep data,
                        png_size_t length) {
   pagespeed::image_compression::ScanlineStreamInput* input =
@@ -97,20 +123,7 @@ void ReadPngFromStream(png_structp read_ptr, png_bytep data,
     PS_DLOG_INFO(input->message_handler(), "Unexpected EOF.");
 
     // We weren't able to satisfy the read, so abort.
-#if PNG_LIBPNG_VER >= 10400
-#ifndef __native_client__
-    png_longjmp(read_ptr, 1);
-#else
-    // On native client, invoking png_longjmp as above causes a
-    // crash. Invoking longjmp directly, however, works fine.  For the
-    // time being we use this workaround for native client builds. See
-    // http://code.google.com/p/page-speed/issues/detail?id=644 for
-    // more information.
-    longjmp(read_ptr->longjmp_buffer, 1);
-#endif
-#else
-    longjmp(read_ptr->jmpbuf, 1);
-#endif
+    PngLongjmp(read_ptr);
   }
 }
 
@@ -121,27 +134,32 @@ void WritePngToString(png_structp write_ptr, png_bytep data,
   buffer.append(reinterpret_cast<char*>(data), length);
 }
 
+// The output of one of the trial encodes run for best compression.  There is
+// no point finishing a trial once it is bigger than the smallest output any
+// trial has finished with, so we abandon it as soon as it gets there.
+struct TrialOutput {
+  GoogleString buffer;
+  const AtomicInt32* best_size;
+};
+
+void WriteTrialToString(png_structp write_ptr, png_bytep data,
+                        png_size_t length) {
+  TrialOutput* output =
+      reinterpret_cast<TrialOutput*>(png_get_io_ptr(write_ptr));
+  output->buffer.append(reinterpret_cast<char*>(data), length);
+  if (output->buffer.size() >
+      static_cast<size_t>(output->best_size->value())) {
+    PngLongjmp(write_ptr);
+  }
+}
+
 void PngErrorFn(png_structp png_ptr, png_const_charp msg) {
   PS_DLOG_INFO(static_cast<MessageHandler*>(png_get_error_ptr(png_ptr)),
                "libpng error: %s", msg);
 
   // Invoking the error function indicates a terminal failure, which
   // means we must longjmp to abort the libpng invocation.
-#if PNG_LIBPNG_VER >= 10400
-#ifndef __native_client__
-  png_longjmp(png_ptr, 1);
-#else
-  // On native client, invoking png_longjmp as above causes a
-  // crash. Invoking longjmp directly, however, works fine.  For the
-  // time being we use this workaround for native client builds. See
-  // http://code.google.com/p/page-speed/issues/detail?id=644 for
-  // more information.
-  longjmp(png_ptr->longjmp_buffer, 1);
-#endif
-
-#else
-  longjmp(png_ptr->jmpbuf, 1);
-#endif
+  PngLongjmp(png_ptr);
 }
 
 void PngWarningFn(png_structp png_ptr, png_const_charp msg) {
@@ -250,10 +268,47 @@ PngReaderInterface::PngReaderInterface() {}
 
 PngReaderInterface::~PngReaderInterface() {}
 
+struct PngOptimizer::TrialEncode {
+  TrialEncode(const PngCompressParams* params_in, MessageHandler* handler)
+      : write(ScopedPngStruct::WRITE, handler),
+        params(params_in),
+        success(false) {}
+
+  ScopedPngStruct write;
+  const PngCompressParams* params;
+  TrialOutput output;
+  bool success;
+};
+
+class PngOptimizer::TrialEncodeThread : public ThreadSystem::Thread {
+ public:
+  TrialEncodeThread(PngOptimizer* optimizer, std::vector<TrialEncode*>* trials,
+                    AtomicInt32* next_trial, AtomicInt32* best_size)
+      : Thread(optimizer->thread_system_, "png_trial", ThreadSystem::kJoinable),
+        optimizer_(optimizer),
+        trials_(trials),
+        next_trial_(next_trial),
+        best_size_(best_size) {}
+
+  void Run() override {
+    optimizer_->RunTrialEncodes(trials_, next_trial_, best_size_);
+  }
+
+ private:
+  PngOptimizer* optimizer_;
+  std::vector<TrialEncode*>* trials_;
+  AtomicInt32* next_trial_;
+  AtomicInt32* best_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(TrialEncodeThread);
+};
+
 PngOptimizer::PngOptimizer(MessageHandler* handler)
     : read_(ScopedPngStruct::READ, handler),
       write_(ScopedPngStruct::WRITE, handler),
       best_compression_(false),
+      thread_system_(nullptr),
+      max_concurrent_encodes_(1),
       message_handler_(handler) {}
 
 PngOptimizer::~PngOptimizer() {}
@@ -310,27 +365,94 @@ bool PngOptimizer::CreateOptimizedPng(const PngReaderInterface& reader,
 bool PngOptimizer::CreateBestOptimizedPngForParams(
     const PngCompressParams* param_list, size_t param_list_size,
     GoogleString* out) {
-  bool success = false;
+  // libpng doesn't allow for reuse of the write structs, so each trial gets
+  // its own copy.  Make them all up front, since copying sets write_'s jmpbuf
+  // and so must not be done from more than one thread.
+  AtomicInt32 best_size(kint32max);
+  std::vector<TrialEncode*> trials;
   for (size_t idx = 0; idx < param_list_size; ++idx) {
-    ScopedPngStruct write(ScopedPngStruct::WRITE, message_handler_);
-    GoogleString temp_output;
-    // libpng doesn't allow for reuse of the write structs, so we must copy on
-    // each iteration of the loop.
-    CopyPngStructs(write_, &write);
-    if (CreateOptimizedPngWithParams(&write, param_list[idx], &temp_output)) {
-      // If this gives better compression update the output.
-      if (out->empty() || out->size() > temp_output.size()) {
-        out->swap(temp_output);
+    TrialEncode* trial = new TrialEncode(&param_list[idx], message_handler_);
+    trial->output.best_size = &best_size;
+    CopyPngStructs(write_, &trial->write);
+    trials.push_back(trial);
+  }
+
+  // Run the trials on up to max_concurrent_encodes_ threads, including this
+  // one.
+  AtomicInt32 next_trial(0);
+  std::vector<TrialEncodeThread*> threads;
+  if (thread_system_ != nullptr) {
+    const int num_threads =
+        std::min(max_concurrent_encodes_, static_cast<int>(trials.size()));
+    for (int i = 1; i < num_threads; ++i) {
+      TrialEncodeThread* thread =
+          new TrialEncodeThread(this, &trials, &next_trial, &best_size);
+      if (!thread->Start()) {
+        delete thread;
+        break;
       }
-      success |= true;
+      threads.push_back(thread);
     }
   }
+  RunTrialEncodes(&trials, &next_trial, &best_size);
+  for (TrialEncodeThread* thread : threads) {
+    thread->Join();
+  }
+  STLDeleteElements(&threads);
+
+  // Keep the smallest output, preferring earlier trials on a tie so that the
+  // result does not depend on how the trials were scheduled.
+  bool success = false;
+  for (TrialEncode* trial : trials) {
+    if (trial->success) {
+      if (!success || out->size() > trial->output.buffer.size()) {
+        out->swap(trial->output.buffer);
+      }
+      success = true;
+    }
+  }
+  STLDeleteElements(&trials);
   return success;
 }
 
+void PngOptimizer::RunTrialEncodes(std::vector<TrialEncode*>* trials,
+                                   AtomicInt32* next_trial,
+                                   AtomicInt32* best_size) {
+  for (;;) {
+    const int idx = next_trial->BarrierIncrement(1) - 1;
+    if (idx >= static_cast<int>(trials->size())) {
+      break;
+    }
+    TrialEncode* trial = (*trials)[idx];
+    ConfigureWrite(&trial->write, *trial->params);
+    trial->success = WriteTrial(trial);
+    if (trial->success) {
+      // Lower best_size to our size, unless another trial beat us to it.
+      const int32 size = static_cast<int32>(trial->output.buffer.size());
+      int32 best = best_size->value();
+      while (size < best) {
+        const int32 previous = best_size->CompareAndSwap(best, size);
+        if (previous == best) {
+          break;
+        }
+        best = previous;
+      }
+    }
+  }
+}
+
 bool PngOptimizer::CreateOptimizedPngWithParams(ScopedPngStruct* write,
                                                 const PngCompressParams& params,
                                                 GoogleString* out) {
+  ConfigureWrite(write, params);
+  if (!WritePng(write, out)) {
+    return false;
+  }
+  return true;
+}
+
+void PngOptimizer::ConfigureWrite(ScopedPngStruct* write,
+                                  const PngCompressParams& params) {
   int compression_level =
       best_compression_ ? Z_BEST_COMPRESSION : Z_DEFAULT_COMPRESSION;
   png_set_compression_level(write->png_ptr(), compression_level);
@@ -338,10 +460,6 @@ bool PngOptimizer::CreateOptimizedPngWithParams(ScopedPngStruct* write,
   png_set_compression_strategy(write->png_ptr(), params.compression_strategy);
   png_set_filter(write->png_ptr(), PNG_FILTER_TYPE_BASE, params.filter_level);
   png_set_compression_window_bits(write->png_ptr(), 15);
-  if (!WritePng(write, out)) {
-    return false;
-  }
-  return true;
 }
 
 bool PngOptimizer::OptimizePng(const PngReaderInterface& reader,
@@ -360,6 +478,18 @@ bool PngOptimizer::OptimizePngBestCompression(const PngReaderInterface& reader,
   return o.CreateOptimizedPng(reader, in, out, handler);
 }
 
+bool PngOptimizer::OptimizePngBestCompression(const PngReaderInterface& reader,
+                                              const GoogleString& in,
+                                              GoogleString* out,
+                                              ThreadSystem* thread_system,
+                                              int max_concurrent_encodes,
+                                              MessageHandler* handler) {
+  PngOptimizer o(handler);
+  o.EnableBestCompression();
+  o.SetConcurrentEncodes(thread_system, max_concurrent_encodes);
+  return o.CreateOptimizedPng(reader, in, out, handler);
+}
+
 PngReader::PngReader(MessageHandler* handler) : message_handler_(handler) {}
 
 PngReader::~PngReader() {}
@@ -487,6 +617,19 @@ bool PngOptimizer::WritePng(ScopedPngStruct* write, GoogleString* buffer) {
   return true;
 }
 
+bool PngOptimizer::WriteTrial(TrialEncode* trial) {
+  ScopedPngStruct* write = &trial->write;
+  if (setjmp(png_jmpbuf(write->png_ptr()))) {
+    return false;
+  }
+  png_set_write_fn(write->png_ptr(), &trial->output, &WriteTrialToString,
+                   &PngFlush);
+  png_write_png(write->png_ptr(), write->info_ptr(), PNG_TRANSFORM_IDENTITY,
+                nullptr);
+
+  return true;
+}
+
 bool PngOptimizer::CopyReadToWrite() { return CopyPngStructs(read_, &write_); }
 
 bool PngOptimizer::CopyPngStructs(const ScopedPngStruct& from,
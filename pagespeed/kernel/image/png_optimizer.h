@@ -34,6 +34,7 @@ extern "C" {
 #include <setjmp.h>
 
 #include <cstddef>
+#include <vector>
 
 #include "external/optipng/src/opngreduc/opngreduc.h"
 #include "pagespeed/kernel/base/basictypes.h"
@@ -44,7 +45,9 @@ extern "C" {
 #include "pagespeed/kernel/image/scanline_status.h"
 
 namespace net_instaweb {
+class AtomicInt32;
 class MessageHandler;
+class ThreadSystem;
 }
 
 namespace pagespeed {
@@ -52,6 +55,7 @@ namespace pagespeed {
 namespace image_compression {
 
 using net_instaweb::MessageHandler;
+using net_instaweb::ThreadSystem;
 
 class ScanlineStreamInput;
 
@@ -228,9 +232,22 @@ class PngOptimizer {
                                          GoogleString* out,
                                          MessageHandler* handler);
 
+  // Like the above, but runs up to max_concurrent_encodes of the trial
+  // encodes at once, on threads from thread_system.  The output is the same
+  // as with a single thread.
+  static bool OptimizePngBestCompression(const PngReaderInterface& reader,
+                                         const GoogleString& in,
+                                         GoogleString* out,
+                                         ThreadSystem* thread_system,
+                                         int max_concurrent_encodes,
+                                         MessageHandler* handler);
+
   static bool CopyPngStructs(const ScopedPngStruct& from, ScopedPngStruct* to);
 
  private:
+  struct TrialEncode;
+  class TrialEncodeThread;
+
   explicit PngOptimizer(MessageHandler* handler);
   ~PngOptimizer();
 
@@ -245,6 +262,13 @@ class PngOptimizer {
   // smaller files.
   void EnableBestCompression() { best_compression_ = true; }
 
+  // Lets best compression run its trial encodes concurrently.
+  void SetConcurrentEncodes(ThreadSystem* thread_system,
+                            int max_concurrent_encodes) {
+    thread_system_ = thread_system;
+    max_concurrent_encodes_ = max_concurrent_encodes;
+  }
+
   bool WritePng(ScopedPngStruct* write, GoogleString* buffer);
   bool CopyReadToWrite();
   bool CreateBestOptimizedPngForParams(const PngCompressParams* param_list,
@@ -253,9 +277,22 @@ class PngOptimizer {
   bool CreateOptimizedPngWithParams(ScopedPngStruct* write,
                                     const PngCompressParams& params,
                                     GoogleString* out);
+
+  void ConfigureWrite(ScopedPngStruct* write, const PngCompressParams& params);
+  bool WriteTrial(TrialEncode* trial);
+
+  // Runs trials, taking the index of the next one to run from next_trial,
+  // until there are none left, and lowers best_size to the size of each
+  // successful one.  Called on each of the encoding threads.
+  void RunTrialEncodes(std::vector<TrialEncode*>* trials,
+                       net_instaweb::AtomicInt32* next_trial,
+                       net_instaweb::AtomicInt32* best_size);
+
   ScopedPngStruct read_;
   ScopedPngStruct write_;
   bool best_compression_;
+  ThreadSystem* thread_system_;
+  int max_concurrent_encodes_;
   MessageHandler* message_handler_;
 
   DISALLOW_COPY_AND_ASSIGN(PngOptimizer);
@@ -78,6 +78,15 @@ class ScanlineReaderInterface {
   // were being transferred
   virtual bool IsProgressive() = 0;
 
+  // Asks the reader to decode the image at a reduced size that is at least
+  // min_width by min_height, for readers that can do that more cheaply than
+  // decoding at full size.  Must be called after Initialize() and before the
+  // first ReadNextScanline().  Returns true if the size was reduced, in which
+  // case GetImageWidth() and GetImageHeight() return the reduced size.
+  virtual bool SetMinimumDecodeSize(size_t min_width, size_t min_height) {
+    return false;
+  }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ScanlineReaderInterface);
 };
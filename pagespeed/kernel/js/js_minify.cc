@@ -19,11 +19,14 @@
 
 #include "pagespeed/kernel/js/js_minify.h"
 
+#include <vector>
+
 #include "base/logging.h"
 //#include "strings/stringpiece_utils.h"
 #include "pagespeed/kernel/base/source_map.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/writer.h"
 #include "pagespeed/kernel/js/js_keywords.h"
 #include "pagespeed/kernel/js/js_tokenizer.h"
 
@@ -587,6 +590,18 @@ bool ShouldRecordStep(const net_instaweb::source_map::MappingVector& mapping,
   return true;
 }
 
+// JsTokenizer never looks further than this past the end of the token it's
+// consuming (the longest case is checking for "instanceof" after a linebreak),
+// so StreamingJsMinifier only trusts tokens that end at least this far from
+// the end of its input.
+const size_t kMaxLookahead = 16;
+
+// Within this distance of the end of its input, StreamingJsMinifier saves the
+// tokenizer's state before every token, so it can back up over a token that
+// turns out to be cut off.  Only a longer token than this can make it start
+// over from the beginning of the input it was given.
+const size_t kSaveStateWindow = 4096;
+
 }  // namespace
 
 JsMinifyingTokenizer::JsMinifyingTokenizer(const JsTokenizerPatterns* patterns,
@@ -766,6 +781,164 @@ bool MinifyUtf8JsWithSourceMap(
   }
 }
 
+StreamingJsMinifier::StreamingJsMinifier(
+    const JsTokenizerPatterns* patterns, net_instaweb::Writer* writer,
+    net_instaweb::source_map::StreamingEncoder* source_map,
+    net_instaweb::MessageHandler* handler)
+    : writer_(writer),
+      source_map_(source_map),
+      handler_(handler),
+      first_mapping_written_(false),
+      tokenizer_(patterns, StringPiece(),
+                 source_map == nullptr ? nullptr : &mappings_),
+      saved_tokenizer_(patterns, StringPiece()),
+      saved_num_tokens_(0),
+      saved_output_size_(0),
+      saved_mappings_size_(0),
+      num_tokens_(0),
+      retry_size_(0),
+      write_ok_(true) {}
+
+StreamingJsMinifier::~StreamingJsMinifier() {}
+
+bool StreamingJsMinifier::Minify(StringPiece input) {
+  Buffer(input);
+  if (unconsumed_size() < retry_size_) {
+    // We backed up over a cut-off token last time; wait for substantially
+    // more input before trying it again, so that a long token arriving in
+    // small pieces takes linear rather than quadratic time.
+    return write_ok_;
+  }
+  retry_size_ = 0;
+  // Save the state at the start, in case the first token we look at is
+  // longer than kSaveStateWindow and turns out to be cut off.
+  SaveState();
+  while (unconsumed_size() >= kMaxLookahead) {
+    const int64 num_tokens_before = num_tokens_;
+    if (unconsumed_size() < kSaveStateWindow) {
+      SaveState();
+    }
+    tokenizer_.tokenizer_.string_backtracked_ = false;
+    AppendNextToken();
+    if (unconsumed_size() < kMaxLookahead ||
+        tokenizer_.tokenizer_.string_backtracked_) {
+      // The token we just consumed (or an error) may be an artifact of where
+      // the input stops, so back up to just before it, replaying any tokens
+      // since we last saved the state.  Syntax errors consume the rest of the
+      // input, so they always end up here.
+      tokenizer_ = saved_tokenizer_;
+      num_tokens_ = saved_num_tokens_;
+      output_.resize(saved_output_size_);
+      mappings_.resize(saved_mappings_size_);
+      while (num_tokens_ < num_tokens_before) {
+        AppendNextToken();
+      }
+      retry_size_ = 2 * unconsumed_size();
+      break;
+    }
+  }
+  const bool ret = WriteOutput();
+  Compact();
+  return ret;
+}
+
+bool StreamingJsMinifier::Finish() {
+  while (true) {
+    const JsKeywords::Type type = AppendNextToken();
+    if (type == JsKeywords::kEndOfInput || type == JsKeywords::kError) {
+      break;
+    }
+  }
+  const bool ret = WriteOutput();
+  buffer_.clear();
+  return ret && !has_error();
+}
+
+void StreamingJsMinifier::SaveState() {
+  saved_tokenizer_ = tokenizer_;
+  saved_num_tokens_ = num_tokens_;
+  saved_output_size_ = output_.size();
+  saved_mappings_size_ = mappings_.size();
+}
+
+JsKeywords::Type StreamingJsMinifier::AppendNextToken() {
+  StringPiece token;
+  const JsKeywords::Type type = tokenizer_.NextToken(&token);
+  token.AppendToString(&output_);
+  ++num_tokens_;
+  return type;
+}
+
+bool StreamingJsMinifier::WriteOutput() {
+  if (!output_.empty()) {
+    write_ok_ = writer_->Write(output_, handler_) && write_ok_;
+    output_.clear();
+  }
+  if (source_map_ != nullptr && !mappings_.empty()) {
+    for (int i = first_mapping_written_ ? 1 : 0, n = mappings_.size(); i < n;
+         ++i) {
+      write_ok_ = source_map_->AddMapping(mappings_[i]) && write_ok_;
+    }
+    mappings_.erase(mappings_.begin(), mappings_.end() - 1);
+    first_mapping_written_ = true;
+  }
+  return write_ok_;
+}
+
+void StreamingJsMinifier::Buffer(StringPiece input) {
+  const char* old_begin = buffer_.data();
+  const char* old_end = old_begin + buffer_.size();
+  const size_t unconsumed_offset = buffer_.size() - unconsumed_size();
+  buffer_.append(input.data(), input.size());
+  MoveInput(old_begin, old_end, buffer_.data() - old_begin);
+  tokenizer_.tokenizer_.input_ = StringPiece(buffer_).substr(unconsumed_offset);
+}
+
+void StreamingJsMinifier::Compact() {
+  // Find the earliest input the tokenizer still refers to: the input it has
+  // yet to consume, or a token it's holding onto.
+  const char* begin = buffer_.data();
+  const char* end = begin + buffer_.size();
+  const char* keep = end - unconsumed_size();
+  std::vector<StringPiece> pieces;
+  pieces.push_back(tokenizer_.prev_token_);
+  pieces.push_back(tokenizer_.next_token_);
+  for (const auto& lookahead : tokenizer_.tokenizer_.lookahead_queue_) {
+    pieces.push_back(lookahead.second);
+  }
+  for (StringPiece piece : pieces) {
+    if (piece.data() >= begin && piece.data() < keep) {
+      keep = piece.data();
+    }
+  }
+  if (keep != begin) {
+    MoveInput(begin, end, begin - keep);
+    buffer_.erase(0, keep - begin);
+  }
+}
+
+void StreamingJsMinifier::MoveInput(const char* old_begin, const char* old_end,
+                                    ptrdiff_t delta) {
+  if (delta == 0) {
+    return;
+  }
+  std::vector<StringPiece*> pieces;
+  pieces.push_back(&tokenizer_.prev_token_);
+  pieces.push_back(&tokenizer_.next_token_);
+  pieces.push_back(&tokenizer_.tokenizer_.input_);
+  for (auto& lookahead : tokenizer_.tokenizer_.lookahead_queue_) {
+    pieces.push_back(&lookahead.second);
+  }
+  for (StringPiece* piece : pieces) {
+    // Leave alone anything outside the buffer, e.g. the "\n" that the
+    // minifier uses for semicolon insertion.
+    if (piece->data() != nullptr && piece->data() >= old_begin &&
+        piece->data() <= old_end) {
+      *piece = StringPiece(piece->data() + delta, piece->size());
+    }
+  }
+}
+
 bool MinifyJs(const StringPiece& input, GoogleString* out) {
   return legacy::MinifyJs(input, out);
 }
@@ -20,6 +20,8 @@
 #ifndef PAGESPEED_KERNEL_JS_JS_MINIFY_H_
 #define PAGESPEED_KERNEL_JS_JS_MINIFY_H_
 
+#include <cstddef>
+
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/source_map.h"
 #include "pagespeed/kernel/base/string.h"
@@ -27,6 +29,11 @@
 #include "pagespeed/kernel/js/js_keywords.h"
 #include "pagespeed/kernel/js/js_tokenizer.h"
 
+namespace net_instaweb {
+class MessageHandler;
+class Writer;
+}  // namespace net_instaweb
+
 namespace pagespeed {
 
 namespace js {
@@ -84,7 +91,97 @@ class JsMinifyingTokenizer {
   net_instaweb::source_map::Mapping current_position_;
   net_instaweb::source_map::Mapping next_position_;
 
-  DISALLOW_COPY_AND_ASSIGN(JsMinifyingTokenizer);
+  // Copyable for StreamingJsMinifier, as with JsTokenizer.
+  friend class StreamingJsMinifier;
+};
+
+// Minifies JavaScript that arrives in pieces, writing out the minified code,
+// and optionally a source map, as it goes.  The output is exactly what
+// MinifyUtf8JsWithSourceMap() would produce for all the pieces concatenated,
+// but neither the whole input nor the whole output need ever be in memory.
+//
+// A token that might continue past the end of the input so far is held back
+// until more input arrives, so memory use is bounded by the size of the
+// pieces plus twice that of the longest token.  The exception is a syntax
+// error: since everything after it is passed through unmodified, the rest of
+// the input is held back until Finish().
+class StreamingJsMinifier {
+ public:
+  // source_map may be NULL if no source map is wanted; if not, the caller
+  // must call source_map->Finish() after Finish().  Does not take ownership of
+  // anything.
+  StreamingJsMinifier(const JsTokenizerPatterns* patterns,
+                      net_instaweb::Writer* writer,
+                      net_instaweb::source_map::StreamingEncoder* source_map,
+                      net_instaweb::MessageHandler* handler);
+  ~StreamingJsMinifier();
+
+  // Minifies as much as possible of the input so far, which continues with
+  // input (which need not outlive the call).  Returns false if writing
+  // failed.
+  bool Minify(StringPiece input);
+
+  // Minifies the rest of the input, which ends here.  Returns true if all the
+  // input parsed successfully and everything was written out.  As with
+  // MinifyUtf8Js(), the output is complete even after a parse error.
+  bool Finish();
+
+  // True if a syntax error has been found so far.
+  bool has_error() const { return tokenizer_.has_error(); }
+
+ private:
+  // Records the current state in saved_tokenizer_ and friends.
+  void SaveState();
+
+  // Appends the next token to output_, and its mapping (if any) to
+  // mappings_.
+  JsKeywords::Type AppendNextToken();
+
+  // Writes out and clears output_ and all but the last of mappings_.
+  bool WriteOutput();
+
+  // Appends input to buffer_, and moves the tokenizer's view of the input
+  // along with it.
+  void Buffer(StringPiece input);
+
+  // Drops the part of buffer_ that the tokenizer no longer refers to.
+  void Compact();
+
+  // Moves every piece of input that the tokenizer refers to by delta bytes.
+  void MoveInput(const char* old_begin, const char* old_end,
+                 ptrdiff_t delta);
+
+  size_t unconsumed_size() const {
+    return tokenizer_.tokenizer_.input_.size();
+  }
+
+  net_instaweb::Writer* writer_;
+  net_instaweb::source_map::StreamingEncoder* source_map_;
+  net_instaweb::MessageHandler* handler_;
+  // The input the tokenizer has yet to consume, plus any it has consumed but
+  // still refers to.
+  GoogleString buffer_;
+  // Minified output and mappings not yet written.  mappings_ keeps the last
+  // mapping written, since JsMinifyingTokenizer looks at it; this is true iff
+  // there is such a mapping at its front.
+  GoogleString output_;
+  net_instaweb::source_map::MappingVector mappings_;
+  bool first_mapping_written_;
+  JsMinifyingTokenizer tokenizer_;
+  // Copy of tokenizer_ from earlier in the current call to Minify(), along
+  // with how many tokens it had returned and the sizes of output_ and
+  // mappings_ at the time.
+  JsMinifyingTokenizer saved_tokenizer_;
+  int64 saved_num_tokens_;
+  size_t saved_output_size_;
+  size_t saved_mappings_size_;
+  int64 num_tokens_;  // Returned by tokenizer_ so far.
+  // Don't look at the input again until there's at least this much of it
+  // unconsumed.
+  size_t retry_size_;
+  bool write_ok_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamingJsMinifier);
 };
 
 // Minifies the given UTF8-encoded JavaScript code; returns true if the code
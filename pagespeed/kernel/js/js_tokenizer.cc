@@ -147,6 +147,7 @@
 
 #include "pagespeed/kernel/js/js_tokenizer.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <vector>
 
@@ -301,6 +302,304 @@ const char* const kLineContinuationRegex =
     "(in|instanceof)($|[^$_\\p{Lu}\\p{Ll}\\p{Lt}\\p{Lm}\\p{Lo}\\p{Nl}\\p{Mn}"
     "\\p{Mc}\\p{Nd}\\p{Pc}\xE2\x80\x8C\xE2\x80\x8D\\\\])";
 
+// Byte classes for the ASCII fast paths below, which replace the RE2 patterns
+// above for all but the most unusual input.  No byte >= 0x80 is in any class;
+// whenever a non-ASCII byte could change the outcome, we fall back to RE2.
+enum ByteClass {
+  kIdentifierStart = 1 << 0,  // $ _ \ A-Z a-z
+  kIdentifierPart = 1 << 1,   // The above, plus 0-9.
+  kDecimalDigit = 1 << 2,
+  kOctalDigit = 1 << 3,
+  kHexDigit = 1 << 4,
+  kLinebreak = 1 << 5,        // \n \r
+  kHorizontalSpace = 1 << 6,  // space \f \t \v
+  kLineContinues = 1 << 7,    // = ( * / % ^ & | < > ? : , .
+};
+
+struct ByteClassTable {
+  constexpr ByteClassTable() : classes() {
+    for (int ch = 'a'; ch <= 'z'; ++ch) {
+      classes[ch] |= kIdentifierStart | kIdentifierPart;
+      classes[ch - 'a' + 'A'] |= kIdentifierStart | kIdentifierPart;
+    }
+    for (const char ch : {'$', '_', '\\'}) {
+      classes[static_cast<int>(ch)] |= kIdentifierStart | kIdentifierPart;
+    }
+    for (int ch = '0'; ch <= '9'; ++ch) {
+      classes[ch] |= kIdentifierPart | kDecimalDigit | kHexDigit |
+                     (ch <= '7' ? kOctalDigit : 0);
+    }
+    for (int ch = 'a'; ch <= 'f'; ++ch) {
+      classes[ch] |= kHexDigit;
+      classes[ch - 'a' + 'A'] |= kHexDigit;
+    }
+    classes[static_cast<int>('\n')] |= kLinebreak;
+    classes[static_cast<int>('\r')] |= kLinebreak;
+    for (const char ch : {' ', '\f', '\t', '\v'}) {
+      classes[static_cast<int>(ch)] |= kHorizontalSpace;
+    }
+    for (const char ch : {'=', '(', '*', '/', '%', '^', '&', '|', '<', '>',
+                          '?', ':', ',', '.'}) {
+      classes[static_cast<int>(ch)] |= kLineContinues;
+    }
+  }
+
+  unsigned char classes[256];
+};
+
+constexpr ByteClassTable kByteClasses;
+
+inline bool InClass(char ch, int byte_class) {
+  return (kByteClasses.classes[static_cast<unsigned char>(ch)] &
+          byte_class) != 0;
+}
+
+inline bool IsNonAscii(char ch) {
+  return static_cast<unsigned char>(ch) >= 0x80;
+}
+
+// Returns the index of the first byte at or after pos that is not in
+// byte_class.
+int SkipClass(StringPiece input, int pos, int byte_class) {
+  const int size = input.size();
+  while (pos < size && InClass(input[pos], byte_class)) {
+    ++pos;
+  }
+  return pos;
+}
+
+// True if input has U+2028 LINE SEPARATOR or U+2029 PARAGRAPH SEPARATOR (the
+// only members of the Zl and Zp categories) at pos.  Like the RE2 patterns,
+// this looks at every byte position, even within other multibyte characters.
+inline bool IsUnicodeLinebreakAt(StringPiece input, int pos) {
+  return (input[pos] == '\xE2' && pos + 2 < static_cast<int>(input.size()) &&
+          input[pos + 1] == '\x80' &&
+          (input[pos + 2] == '\xA8' || input[pos + 2] == '\xA9'));
+}
+
+inline bool IsLinebreakAt(StringPiece input, int pos) {
+  return InClass(input[pos], kLinebreak) || IsUnicodeLinebreakAt(input, pos);
+}
+
+// Returns the length of the line comment at the start of input, excluding the
+// linebreak that ends it.  Equivalent to kLineCommentRegex.
+int LineCommentLength(StringPiece input) {
+  const int size = input.size();
+  for (int pos = 0; pos < size; ++pos) {
+    if (IsLinebreakAt(input, pos)) {
+      return pos;
+    }
+  }
+  return size;
+}
+
+// Returns the length of the numeric literal at the start of input, which
+// must begin with a digit, or with a period followed by a digit.  Equivalent
+// to kNumericLiteralPosixRegex, including its leftmost-longest choice between
+// the octal and decimal forms (so "019.5" is one decimal literal but "017.5"
+// is the octal literal "017" followed by ".5").
+int NumericLiteralLength(StringPiece input) {
+  const int size = input.size();
+  int longest = 0;
+  if (input[0] == '0' && size >= 2) {
+    if (input[1] == 'x' || input[1] == 'X') {
+      const int end = SkipClass(input, 2, kHexDigit);
+      if (end > 2) {
+        longest = end;
+      }
+    } else {
+      longest = SkipClass(input, 1, kOctalDigit);
+    }
+  }
+  int pos;
+  if (input[0] == '.') {
+    pos = SkipClass(input, 1, kDecimalDigit);
+  } else {
+    pos = SkipClass(input, 1, kDecimalDigit);
+    // After a leading zero, more digits are only decimal if there's an 8 or 9
+    // among them.
+    if (input[0] == '0' && input.substr(1, pos - 1).find_first_of("89") ==
+                               StringPiece::npos) {
+      pos = 1;
+    }
+    if (pos < size && input[pos] == '.') {
+      pos = SkipClass(input, pos + 1, kDecimalDigit);
+    }
+  }
+  if (pos < size && (input[pos] == 'e' || input[pos] == 'E')) {
+    int exponent = pos + 1;
+    if (exponent < size && (input[exponent] == '+' || input[exponent] == '-')) {
+      ++exponent;
+    }
+    const int end = SkipClass(input, exponent, kDecimalDigit);
+    if (end > exponent) {
+      pos = end;
+    }
+  }
+  return std::max(longest, pos);
+}
+
+// Returns the length of the operator at the start of input, or 0 if there is
+// none.  Equivalent to kOperatorRegex.
+int OperatorLength(StringPiece input) {
+  const int size = input.size();
+  const char ch = input[0];
+  const char next = size >= 2 ? input[1] : '\0';
+  switch (ch) {
+    case '&':
+    case '|':
+    case '+':
+    case '-':
+      return (next == ch || next == '=') ? 2 : 1;
+    case '*':
+    case '/':
+    case '%':
+    case '^':
+      return next == '=' ? 2 : 1;
+    case '~':
+      return 1;
+    case '!':
+    case '=':
+      return next != '=' ? 1 : (size >= 3 && input[2] == '=') ? 3 : 2;
+    case '<':
+    case '>': {
+      int pos = 1;
+      const int max_repeat = ch == '<' ? 2 : 3;
+      while (pos < max_repeat && pos < size && input[pos] == ch) {
+        ++pos;
+      }
+      return (pos < size && input[pos] == '=') ? pos + 1 : pos;
+    }
+    default:
+      return 0;
+  }
+}
+
+// Returns the index just past a \uXXXX escape at pos, or pos if there isn't
+// one.
+int SkipUnicodeEscape(StringPiece input, int pos) {
+  if (pos + 6 <= static_cast<int>(input.size()) && input[pos] == '\\' &&
+      input[pos + 1] == 'u' && SkipClass(input, pos + 2, kHexDigit) >= pos + 6) {
+    return pos + 6;
+  }
+  return pos;
+}
+
+// Returns the length of the regex literal at the start of input, which must
+// begin with a slash; 0 if there is none; or -1 if we hit a non-ASCII byte and
+// must ask kRegexLiteralRegex instead.
+int RegexLiteralLength(StringPiece input) {
+  const int size = input.size();
+  bool in_class = false;
+  int pos = 1;
+  for (;; ++pos) {
+    if (pos >= size || InClass(input[pos], kLinebreak)) {
+      return 0;
+    }
+    const char ch = input[pos];
+    if (IsNonAscii(ch)) {
+      return -1;
+    } else if (ch == '\\') {
+      ++pos;
+      if (pos >= size || InClass(input[pos], kLinebreak)) {
+        return 0;
+      } else if (IsNonAscii(input[pos])) {
+        return -1;
+      }
+    } else if (in_class) {
+      in_class = (ch != ']');
+    } else if (ch == '[') {
+      in_class = true;
+    } else if (ch == '/') {
+      break;
+    }
+  }
+  // The body can't be empty, but "//" would have been a line comment anyway.
+  DCHECK_GT(pos, 1);
+  // Skip the closing slash and any flags.
+  ++pos;
+  while (pos < size) {
+    const char ch = input[pos];
+    if (IsNonAscii(ch)) {
+      return -1;
+    } else if (ch == '\\') {
+      const int end = SkipUnicodeEscape(input, pos);
+      if (end == pos) {
+        break;
+      }
+      pos = end;
+    } else if (InClass(ch, kIdentifierPart)) {
+      ++pos;
+    } else {
+      break;
+    }
+  }
+  return pos;
+}
+
+// Returns the length of the string literal at the start of input, which must
+// begin with a quote, through the first unescaped quote or linebreak.  As for
+// kStringLiteralRegex, the caller must check which of those it ended with.
+// Returns -1 if we run out of input first, in which case kStringLiteralRegex
+// may still find a match by backtracking, and must be asked instead.
+int StringLiteralLength(StringPiece input) {
+  const int size = input.size();
+  const char quote = input[0];
+  for (int pos = 1; pos < size; ++pos) {
+    const char ch = input[pos];
+    if (ch == quote || IsLinebreakAt(input, pos)) {
+      return pos + 1 + (IsUnicodeLinebreakAt(input, pos) ? 2 : 0);
+    } else if (ch == '\\' && pos + 1 < size) {
+      // Skip the escaped character; \r\n and \n\r count as one character for
+      // this purpose.
+      ++pos;
+      if (pos + 1 < size && InClass(input[pos], kLinebreak) &&
+          InClass(input[pos + 1], kLinebreak) && input[pos] != input[pos + 1]) {
+        ++pos;
+      }
+    }
+  }
+  return -1;
+}
+
+// Returns 1 if the start of input matches kLineContinuationRegex, 0 if it
+// doesn't, or -1 if we'd need to decode a non-ASCII character to tell.
+int MatchLineContinuation(StringPiece input) {
+  const int size = input.size();
+  const char ch = input[0];
+  if (InClass(ch, kLineContinues)) {
+    return 1;
+  }
+  switch (ch) {
+    case '!':
+      return (size >= 2 && input[1] == '=') ? 1 : 0;
+    case '+':
+    case '-':
+      if (size == 1) {
+        return 1;
+      }
+      return IsNonAscii(input[1]) ? -1 : (input[1] != ch ? 1 : 0);
+    case 'i':
+      for (StringPiece keyword : {StringPiece("in"),
+                                  StringPiece("instanceof")}) {
+        if (strings::StartsWith(input, keyword)) {
+          if (input.size() == keyword.size()) {
+            return 1;
+          }
+          const char next = input[keyword.size()];
+          if (IsNonAscii(next)) {
+            return -1;
+          } else if (!InClass(next, kIdentifierPart)) {
+            return 1;
+          }
+        }
+      }
+      return 0;
+    default:
+      return 0;
+  }
+}
+
 }  // namespace
 
 JsTokenizer::JsTokenizer(const JsTokenizerPatterns* patterns, StringPiece input)
@@ -308,7 +607,9 @@ JsTokenizer::JsTokenizer(const JsTokenizerPatterns* patterns, StringPiece input)
       input_(input),
       json_step_(kJsonStart),
       start_of_line_(true),
-      error_(false) {
+      error_(false),
+      use_fast_paths_(true),
+      string_backtracked_(false) {
   parse_stack_.push_back(kStartOfInput);
 }
 
@@ -616,6 +917,9 @@ JsKeywords::Type JsTokenizer::ConsumeBlockComment(StringPiece* token_out) {
 }
 
 JsKeywords::Type JsTokenizer::ConsumeLineComment(StringPiece* token_out) {
+  if (use_fast_paths_) {
+    return Emit(JsKeywords::kComment, LineCommentLength(input_), token_out);
+  }
   Re2StringPiece unconsumed = StringPieceToRe2(input_);
   Re2StringPiece linebreak;
   if (!RE2::Consume(&unconsumed, patterns_->line_comment_pattern, &linebreak)) {
@@ -749,17 +1053,14 @@ bool JsTokenizer::TryConsumeIdentifierOrKeyword(JsKeywords::Type* type_out,
     const unsigned char first = input_[0];
     if (first >= 0x80) {
       use_regex = true;
-    } else if (('a' <= first && first <= 'z') || first == '_' ||
-               ('A' <= first && first <= 'Z') || first == '$' ||
-               first == '\\') {
+    } else if (InClass(first, kIdentifierStart)) {
       int size = input_.size();
       for (index = 1; index < size; ++index) {
         const unsigned char ch = input_[index];
         if (ch >= 0x80) {
           use_regex = true;
           break;
-        } else if (!net_instaweb::IsAsciiAlphaNumeric(ch) && ch != '_' &&
-                   ch != '$' && ch != '\\') {
+        } else if (!InClass(ch, kIdentifierPart)) {
           break;
         }
       }
@@ -899,6 +1200,10 @@ bool JsTokenizer::TryConsumeIdentifierOrKeyword(JsKeywords::Type* type_out,
 
 JsKeywords::Type JsTokenizer::ConsumeNumber(StringPiece* token_out) {
   DCHECK(!input_.empty());
+  if (use_fast_paths_) {
+    PushExpression();
+    return Emit(JsKeywords::kNumber, NumericLiteralLength(input_), token_out);
+  }
   Re2StringPiece unconsumed = StringPieceToRe2(input_);
   if (!RE2::Consume(&unconsumed, patterns_->numeric_literal_pattern)) {
     // We only call ConsumeNumber when we're sure we're looking at a numeric
@@ -913,13 +1218,20 @@ JsKeywords::Type JsTokenizer::ConsumeNumber(StringPiece* token_out) {
 
 JsKeywords::Type JsTokenizer::ConsumeOperator(StringPiece* token_out) {
   DCHECK(!input_.empty());
-  Re2StringPiece unconsumed = StringPieceToRe2(input_);
-  if (!RE2::Consume(&unconsumed, patterns_->operator_pattern)) {
+  int length;
+  if (use_fast_paths_) {
+    length = OperatorLength(input_);
+  } else {
+    Re2StringPiece unconsumed = StringPieceToRe2(input_);
+    length = RE2::Consume(&unconsumed, patterns_->operator_pattern)
+                 ? input_.size() - unconsumed.size()
+                 : 0;
+  }
+  if (length == 0) {
     // Unrecognized character:
     return Error(token_out);
   }
-  const JsKeywords::Type type =
-      Emit(JsKeywords::kOperator, input_.size() - unconsumed.size(), token_out);
+  const JsKeywords::Type type = Emit(JsKeywords::kOperator, length, token_out);
   const StringPiece token = *token_out;
   // Is this a postfix operator?  We treat those differently than prefix or
   // unary operators.
@@ -960,13 +1272,19 @@ JsKeywords::Type JsTokenizer::ConsumeQuestionMark(StringPiece* token_out) {
 JsKeywords::Type JsTokenizer::ConsumeRegex(StringPiece* token_out) {
   DCHECK(!input_.empty());
   DCHECK_EQ('/', input_[0]);
-  Re2StringPiece unconsumed = StringPieceToRe2(input_);
-  if (!RE2::Consume(&unconsumed, patterns_->regex_literal_pattern)) {
+  int length = use_fast_paths_ ? RegexLiteralLength(input_) : -1;
+  if (length < 0) {
+    Re2StringPiece unconsumed = StringPieceToRe2(input_);
+    length = RE2::Consume(&unconsumed, patterns_->regex_literal_pattern)
+                 ? input_.size() - unconsumed.size()
+                 : 0;
+  }
+  if (length == 0) {
     // EOF or a linebreak in the regex will cause an error.
     return Error(token_out);
   }
   PushExpression();
-  return Emit(JsKeywords::kRegex, input_.size() - unconsumed.size(), token_out);
+  return Emit(JsKeywords::kRegex, length, token_out);
 }
 
 JsKeywords::Type JsTokenizer::ConsumeSemicolon(StringPiece* token_out) {
@@ -1043,15 +1361,22 @@ JsKeywords::Type JsTokenizer::ConsumeSlash(StringPiece* token_out) {
 JsKeywords::Type JsTokenizer::ConsumeString(StringPiece* token_out) {
   DCHECK(!input_.empty());
   DCHECK(input_[0] == '"' || input_[0] == '\'');
-  Re2StringPiece unconsumed = StringPieceToRe2(input_);
-  if (!RE2::Consume(&unconsumed, patterns_->string_literal_pattern) ||
-      input_[input_.size() - unconsumed.size() - 1] != input_[0]) {
+  int length = use_fast_paths_ ? StringLiteralLength(input_) : -1;
+  if (length < 0) {
+    Re2StringPiece unconsumed = StringPieceToRe2(input_);
+    length = RE2::Consume(&unconsumed, patterns_->string_literal_pattern)
+                 ? input_.size() - unconsumed.size()
+                 : 0;
+    if (use_fast_paths_ && length > 0) {
+      string_backtracked_ = true;
+    }
+  }
+  if (length == 0 || input_[length - 1] != input_[0]) {
     // EOF or an unescaped linebreak in the string will cause an error.
     return Error(token_out);
   }
   PushExpression();
-  return Emit(JsKeywords::kStringLiteral, input_.size() - unconsumed.size(),
-              token_out);
+  return Emit(JsKeywords::kStringLiteral, length, token_out);
 }
 
 bool JsTokenizer::TryConsumeWhitespace(bool allow_semicolon_insertion,
@@ -1070,9 +1395,9 @@ bool JsTokenizer::TryConsumeWhitespace(bool allow_semicolon_insertion,
     if (ch >= 0x80) {
       use_regex = true;
       break;
-    } else if (ch == '\n' || ch == '\r') {
+    } else if (InClass(ch, kLinebreak)) {
       has_linebreak = true;
-    } else if (ch != ' ' && ch != '\t' && ch != '\f' && ch != '\v') {
+    } else if (!InClass(ch, kHorizontalSpace)) {
       break;
     }
   }
@@ -1260,8 +1585,13 @@ bool JsTokenizer::TryInsertLinebreakSemicolon() {
       // Semicolon insertion will not happen after an expression if the next
       // token could continue the statement.
       {
-        Re2StringPiece unconsumed = StringPieceToRe2(input_);
-        if (RE2::Consume(&unconsumed, patterns_->line_continuation_pattern)) {
+        int continues = use_fast_paths_ ? MatchLineContinuation(input_) : -1;
+        if (continues < 0) {
+          Re2StringPiece unconsumed = StringPieceToRe2(input_);
+          continues = RE2::Consume(&unconsumed,
+                                   patterns_->line_continuation_pattern);
+        }
+        if (continues) {
           return false;
         }
       }
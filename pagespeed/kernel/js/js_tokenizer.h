@@ -86,6 +86,11 @@ class JsTokenizer {
   // Return a string representing the current parse stack, for testing only.
   GoogleString ParseStackForTest() const;
 
+  // Makes this tokenizer match comments, numbers, operators, and string and
+  // regex literals with the RE2 patterns alone, skipping the byte-class fast
+  // paths, so tests can check that the two agree.
+  void DisableFastPathsForTest() { use_fast_paths_ = false; }
+
  private:
   // An entry in the parse stack.  This does not fully capture the grammar of
   // JavaScript -- far from it -- rather, it is just barely nuanced enough to
@@ -183,8 +188,15 @@ class JsTokenizer {
   JsonStep json_step_;
   bool start_of_line_;  // No non-whitespace/comment tokens on this line yet.
   bool error_;
-
-  DISALLOW_COPY_AND_ASSIGN(JsTokenizer);
+  bool use_fast_paths_;
+  // Set (and never cleared) once a string literal runs past the end of
+  // input_ and is only matched by backtracking to an escaped quote; given
+  // more input, that literal would have been longer.
+  bool string_backtracked_;
+
+  // JsTokenizer is copyable, so that StreamingJsMinifier can back up to an
+  // earlier state; it also moves the input around underneath us.
+  friend class StreamingJsMinifier;
 };
 
 // Structure to store RE2 patterns that can be shared by instances of
@@ -115,12 +115,30 @@
 //
 // For now, writers wait in sleep loop, while readers simply fail/miss.
 //
+// version is a sequence number that lets Get avoid the sector lock
+// altogether, which matters since reads vastly outnumber writes. Writers
+// make it odd (with the sector lock held) before changing an entry's key,
+// size, or blocks, including when stealing its blocks for another entry,
+// and make it even again once done; for a Put, it stays odd while the
+// payload is copied in, just like creating is set. A lock-free reader loads
+// the version, and if it's even, copies out the key and, on a match, the
+// payload, and then checks the version is unchanged. If it isn't, what it
+// read may be torn, so it retries, and after a few attempts falls back to
+// taking the lock and using open_count as above. Since block numbers read
+// this way may be garbage, they are range-checked before use.
+//
+// Lock-free readers can't relink the LRU, so a Get of an entry that hasn't
+// been touched for SharedMemCache::kTouchIntervalMs takes the lock instead.
+// This keeps frequently used entries out of the LRU tail, while leaving the
+// vast majority of reads lock-free.
+//
 // TODO(morlovich): Evaluate using chaining and one more layer of indirection
 // instead, as it should hopefully produce much better utilization and avoid
 // conflict misses entirely.
 
 #include "pagespeed/kernel/sharedmem/shared_mem_cache.h"
 
+#include <atomic>
 #include <cstddef>  // for size_t
 #include <cstring>
 #include <map>
@@ -165,6 +183,16 @@ namespace {
 // format.
 const int kSnapshotVersion = 1;
 
+// How many times a Get tries to read an entry that is changing underneath it,
+// before it gives up and takes the sector lock.
+const int kLockFreeAttempts = 3;
+
+// Counters bumped outside the sector lock.
+void IncrementStat(int64* stat) {
+  reinterpret_cast<std::atomic<int64>*>(stat)->fetch_add(
+      1, std::memory_order_relaxed);
+}
+
 bool IsAllNil(const StringPiece& raw_hash) {
   bool all_nil = true;
   for (size_t c = 0; c < raw_hash.length(); ++c) {
@@ -199,6 +227,7 @@ SharedMemCache<kBlockSize>::SharedMemCache(AbstractSharedMem* shm_runtime,
       entries_per_sector_(entries_per_sector),
       blocks_per_sector_(blocks_per_sector),
       checkpoint_interval_sec_(-1),
+      lock_free_reads_(true),
       handler_(handler),
       snapshot_path_(""),
       file_cache_(nullptr) {}
@@ -640,6 +669,7 @@ void SharedMemCache<kBlockSize>::PutIntoEntry(Sector<kBlockSize>* sector,
       sector->ReturnBlocksToFreeList(blocks);
       entry->creating = false;
       MarkEntryFree(sector, entry_num);
+      FinishEntryWrite(entry);
       return;
     }
   }
@@ -678,6 +708,7 @@ void SharedMemCache<kBlockSize>::PutIntoEntry(Sector<kBlockSize>* sector,
 
   // We're done, clear creating bit.
   entry->creating = false;
+  FinishEntryWrite(entry);
 }
 
 template <size_t kBlockSize>
@@ -687,24 +718,123 @@ void SharedMemCache<kBlockSize>::Get(const GoogleString& key,
   Position pos;
   ExtractPosition(raw_hash, &pos);
   CacheInterface::KeyState key_state = kNotFound;
-  Sector<kBlockSize>* sector = sectors_[pos.sector];
-  {
-    ScopedMutex lock(sector->mutex());
-    SectorStats* stats = sector->sector_stats();
-    ++stats->num_get;
-
-    for (int p = 0; p < kAssociativity; ++p) {
-      EntryNum cand_key = pos.keys[p];
-      CacheEntry* cand = sector->EntryAt(cand_key);
-      if (KeyMatch(cand, raw_hash)) {
-        ++stats->num_get_hit;
-        key_state = GetFromEntry(key, sector, cand_key, callback);
+  if (!lock_free_reads_ ||
+      !TryGetWithoutLock(raw_hash, pos, callback, &key_state)) {
+    key_state = GetWithLock(raw_hash, pos, callback);
+  }
+  ValidateAndReportResult(key, key_state, callback);
+}
+
+template <size_t kBlockSize>
+bool SharedMemCache<kBlockSize>::TryGetWithoutLock(
+    const GoogleString& raw_hash, const Position& pos, Callback* callback,
+    CacheInterface::KeyState* key_state) {
+  for (int attempt = 0; attempt < kLockFreeAttempts; ++attempt) {
+    switch (GetWithoutLock(raw_hash, pos, callback, key_state)) {
+      case kLockFreeDone:
+        return true;
+      case kLockFreeNeedsLock:
+        return false;
+      case kLockFreeRetry:
         break;
+    }
+  }
+  return false;
+}
+
+template <size_t kBlockSize>
+typename SharedMemCache<kBlockSize>::LockFreeResult
+SharedMemCache<kBlockSize>::GetWithoutLock(const GoogleString& raw_hash,
+                                           const Position& pos,
+                                           Callback* callback,
+                                           CacheInterface::KeyState* key_state) {
+  Sector<kBlockSize>* sector = sectors_[pos.sector];
+  SectorStats* stats = sector->sector_stats();
+
+  for (int p = 0; p < kAssociativity; ++p) {
+    CacheEntry* cand = sector->EntryAt(pos.keys[p]);
+    std::atomic<uint32>* version = Sector<kBlockSize>::Version(cand);
+    uint32 start_version = version->load(std::memory_order_acquire);
+    if ((start_version & 1) != 0) {
+      // Being written. If it's being written with our key, the lock-taking
+      // path would report a miss as well, and otherwise it's of no interest.
+      continue;
+    }
+
+    char hash_bytes[kHashSize];
+    std::memcpy(hash_bytes, cand->hash_bytes, kHashSize);
+    bool match = (std::memcmp(hash_bytes, raw_hash.data(), kHashSize) == 0);
+    int64 last_use_timestamp_ms = cand->last_use_timestamp_ms;
+    int32 byte_size = cand->byte_size;
+    BlockNum block = cand->first_block;
+    if (!match) {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (version->load(std::memory_order_relaxed) != start_version) {
+        return kLockFreeRetry;
+      }
+      continue;
+    }
+
+    if (timer_->NowMs() - last_use_timestamp_ms > kTouchIntervalMs) {
+      return kLockFreeNeedsLock;
+    }
+
+    // Nothing we've read can be trusted until we re-check the version, so
+    // make sure it at least doesn't send us outside the sector.
+    if ((byte_size < 0) || (static_cast<size_t>(byte_size) > MaxValueSize())) {
+      return kLockFreeRetry;
+    }
+    SharedString str;
+    str.Extend(byte_size);
+    size_t total_blocks = sector->DataBlocksForSize(byte_size);
+    int data_blocks = sector->data_blocks();
+    int str_pos = 0;
+    for (size_t b = 0; b < total_blocks; ++b) {
+      if ((block < 0) || (block >= data_blocks)) {
+        return kLockFreeRetry;
       }
+      int bytes = sector->BytesInPortion(byte_size, b, total_blocks);
+      str.WriteAt(str_pos, sector->BlockBytes(block), bytes);
+      str_pos += bytes;
+      block = sector->GetBlockSuccessorUnlocked(block);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (version->load(std::memory_order_relaxed) != start_version) {
+      return kLockFreeRetry;
     }
+
+    IncrementStat(&stats->num_get);
+    IncrementStat(&stats->num_get_hit);
+    callback->set_value(str);
+    *key_state = kAvailable;
+    return kLockFreeDone;
   }
 
-  ValidateAndReportResult(key, key_state, callback);
+  IncrementStat(&stats->num_get);
+  *key_state = kNotFound;
+  return kLockFreeDone;
+}
+
+template <size_t kBlockSize>
+CacheInterface::KeyState SharedMemCache<kBlockSize>::GetWithLock(
+    const GoogleString& raw_hash, const Position& pos, Callback* callback) {
+  CacheInterface::KeyState key_state = kNotFound;
+  Sector<kBlockSize>* sector = sectors_[pos.sector];
+  ScopedMutex lock(sector->mutex());
+  SectorStats* stats = sector->sector_stats();
+  IncrementStat(&stats->num_get);
+
+  for (int p = 0; p < kAssociativity; ++p) {
+    EntryNum cand_key = pos.keys[p];
+    CacheEntry* cand = sector->EntryAt(cand_key);
+    if (KeyMatch(cand, raw_hash)) {
+      IncrementStat(&stats->num_get_hit);
+      key_state = GetFromEntry(raw_hash, sector, cand_key, callback);
+      break;
+    }
+  }
+  return key_state;
 }
 
 // Expects sector->mutex() held on entry, leaves it held on exit.
@@ -783,6 +913,7 @@ void SharedMemCache<kBlockSize>::DeleteEntry(Sector<kBlockSize>* sector,
   sector->ReturnBlocksToFreeList(blocks);
   entry->creating = false;
   MarkEntryFree(sector, entry_num);
+  FinishEntryWrite(entry);
 }
 
 template <size_t kBlockSize>
@@ -858,8 +989,10 @@ bool SharedMemCache<kBlockSize>::TryAllocateBlocks(Sector<kBlockSize>* sector,
   while ((entry_num != kInvalidEntry) && (got < goal)) {
     CacheEntry* entry = sector->EntryAt(entry_num);
     if (Writeable(entry)) {
+      StartEntryWrite(entry);
       got += sector->BlockListForEntry(entry, blocks);
       MarkEntryFree(sector, entry_num);
+      FinishEntryWrite(entry);
       entry_num = sector->OldestEntryNum();
     } else {
       entry_num = entry->lru_prev;
@@ -869,6 +1002,25 @@ bool SharedMemCache<kBlockSize>::TryAllocateBlocks(Sector<kBlockSize>* sector,
   return (got >= goal);
 }
 
+template <size_t kBlockSize>
+void SharedMemCache<kBlockSize>::StartEntryWrite(CacheEntry* entry) {
+  std::atomic<uint32>* version = Sector<kBlockSize>::Version(entry);
+  uint32 old_version = version->load(std::memory_order_relaxed);
+  DCHECK_EQ(0u, old_version & 1);
+  version->store(old_version + 1, std::memory_order_relaxed);
+  // Make sure the odd version is visible before any of the changes to the
+  // entry are.
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <size_t kBlockSize>
+void SharedMemCache<kBlockSize>::FinishEntryWrite(CacheEntry* entry) {
+  std::atomic<uint32>* version = Sector<kBlockSize>::Version(entry);
+  uint32 old_version = version->load(std::memory_order_relaxed);
+  DCHECK_EQ(1u, old_version & 1);
+  version->store(old_version + 1, std::memory_order_release);
+}
+
 template <size_t kBlockSize>
 void SharedMemCache<kBlockSize>::MarkEntryFree(Sector<kBlockSize>* sector,
                                                EntryNum entry_num) {
@@ -963,7 +1115,10 @@ void SharedMemCache<kBlockSize>::EnsureReadyForWriting(
   // to true they will both avoid this entry. (And there are no other writers
   // as if there were, we would have given up ourselves).
   //
+  // Readers that don't take the lock will see the entry is being written
+  // from its version.
   entry->creating = true;
+  StartEntryWrite(entry);
 
   // Now just wait for previous readers to leave.
   while (entry->open_count > 0) {
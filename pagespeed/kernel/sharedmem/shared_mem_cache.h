@@ -49,6 +49,11 @@ class SharedMemCache : public CacheInterface {
   static const int kAssociativity = 4;  // Note: changing this requires changing
                                         // code of ExtractPosition as well.
 
+  // Gets normally don't take the sector lock, and so don't move the entry
+  // to the front of the LRU. Instead, a Get of an entry that was last
+  // touched longer than this ago takes the lock and touches it.
+  static const int64 kTouchIntervalMs = 1000;
+
   // Initializes the cache's settings, but does not actually touch the shared
   // memory --- you must call Initialize or Attach (and handle them potentially
   // returning false) to do so. The filename parameter will be used to identify
@@ -156,6 +161,10 @@ class SharedMemCache : public CacheInterface {
     WriteOutSnapshotFromWorkerThread(sector_num, last_checkpoint_ms);
   }
 
+  // Lock-free reads are on by default. Turning them off makes every Get take
+  // the sector lock; this is for tests, and for comparison in benchmarks.
+  void SetLockFreeReadsForTesting(bool enabled) { lock_free_reads_ = enabled; }
+
  private:
   class WriteOutSnapshotFunction;
 
@@ -165,6 +174,13 @@ class SharedMemCache : public CacheInterface {
     SharedMemCacheData::EntryNum keys[kAssociativity];
   };
 
+  // Outcomes of an attempt to read an entry without the sector lock.
+  enum LockFreeResult {
+    kLockFreeDone,       // Found the entry, or that there is none.
+    kLockFreeRetry,      // An entry changed while we were reading it.
+    kLockFreeNeedsLock,  // Found the entry, but it needs to be touched.
+  };
+
   bool InitCache(bool parent);
 
   // PutRawHash can be used in either realtime mode or in restore mode.  In
@@ -176,6 +192,23 @@ class SharedMemCache : public CacheInterface {
   void PutRawHash(const GoogleString& raw_hash, int64 last_use_timestamp_ms,
                   const SharedString& value, bool checkpoint_ok);
 
+  // Tries to look up the key without taking the sector lock, retrying a
+  // few times if the entry changes while we read it. Returns false if that
+  // didn't produce a consistent answer, or the entry needs to be touched,
+  // in which case the caller should fall back to GetWithLock.
+  bool TryGetWithoutLock(const GoogleString& raw_hash, const Position& pos,
+                         Callback* callback,
+                         CacheInterface::KeyState* key_state);
+
+  // A single attempt of TryGetWithoutLock.
+  LockFreeResult GetWithoutLock(const GoogleString& raw_hash,
+                                const Position& pos, Callback* callback,
+                                CacheInterface::KeyState* key_state);
+
+  // Looks up the key with the sector lock held, touching the entry if found.
+  CacheInterface::KeyState GetWithLock(const GoogleString& raw_hash,
+                                       const Position& pos, Callback* callback);
+
   // Finish a get, with the entry matching and sector lock held.  Releases lock
   // while performing the read, but takes it again before returning.
   CacheInterface::KeyState GetFromEntry(
@@ -206,6 +239,12 @@ class SharedMemCache : public CacheInterface {
                          int goal, SharedMemCacheData::BlockVector* blocks)
       EXCLUSIVE_LOCKS_REQUIRED(sector->mutex());
 
+  // Bump the version of an entry before and after changing its key, size or
+  // blocks, so that readers not holding the sector lock can tell. Must be
+  // called with the sector lock held.
+  static void StartEntryWrite(SharedMemCacheData::CacheEntry* entry);
+  static void FinishEntryWrite(SharedMemCacheData::CacheEntry* entry);
+
   // Marks the given entry free in the directory, and unlinks it from the LRU.
   // Note that this does not touch the entry's blocks.
   void MarkEntryFree(SharedMemCacheData::Sector<kBlockSize>* sector,
@@ -265,6 +304,7 @@ class SharedMemCache : public CacheInterface {
   int entries_per_sector_;
   int blocks_per_sector_;
   int checkpoint_interval_sec_;
+  bool lock_free_reads_;
   MessageHandler* handler_;
   GoogleString snapshot_path_;
   FileCache* file_cache_;
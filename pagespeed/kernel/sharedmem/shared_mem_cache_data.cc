@@ -113,6 +113,7 @@ bool Sector<kBlockSize>::Initialize(MessageHandler* handler)
     entry->lru_prev = kInvalidEntry;
     entry->lru_next = kInvalidEntry;
     entry->first_block = kInvalidBlock;
+    entry->version = 0;
   }
 
   // Initialize the freelist and block successor list.
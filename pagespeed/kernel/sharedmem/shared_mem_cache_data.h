@@ -23,6 +23,7 @@
 #ifndef PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_CACHE_DATA_H_
 #define PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_CACHE_DATA_H_
 
+#include <atomic>
 #include <cstddef>  // for size_t
 #include <vector>
 
@@ -110,7 +111,11 @@ struct CacheEntry {
   // Number of readers currently accessing the data.
   uint32 open_count : 31;
 
-  uint32 padding;  // ensures we're 8-aligned.
+  // Sequence number for readers that don't take the sector lock. It is odd
+  // while the entry's key, size or blocks are being changed, and is bumped
+  // again once they're consistent. Only accessed through Sector::Version().
+  // (This also ensures we're 8-aligned).
+  uint32 version;
 };
 
 // Helper for operating on a given sector's data structures; helping
@@ -176,6 +181,17 @@ class Sector {
     block_successors_[block] = next;
   }
 
+  // Reads the successor of a block without the sector lock. The result may
+  // be stale, or out of range, so callers must validate it, and must check
+  // the version of the entry they are reading afterwards.
+  BlockNum GetBlockSuccessorUnlocked(BlockNum block) const
+      NO_THREAD_SAFETY_ANALYSIS {
+    DCHECK_GE(block, 0);
+    DCHECK_LT(block, static_cast<BlockNum>(data_blocks_));
+    return reinterpret_cast<std::atomic<BlockNum>*>(block_successors_ + block)
+        ->load(std::memory_order_relaxed);
+  }
+
   // Links blocks in the vector in order, with later blocks being
   // marked as successors of later ones.
   void LinkBlockSuccessors(const BlockVector& blocks)
@@ -215,6 +231,11 @@ class Sector {
     return reinterpret_cast<CacheEntry*>(directory_base_) + slot;
   }
 
+  // Returns the sequence number of the given entry.
+  static std::atomic<uint32>* Version(CacheEntry* entry) {
+    return reinterpret_cast<std::atomic<uint32>*>(&entry->version);
+  }
+
   // Inserts the given entry into the LRU, at front.
   // Precondition: must not be in LRU.
   void InsertEntryIntoLRU(EntryNum entry_num);
@@ -227,6 +248,8 @@ class Sector {
   // Block ops.
   // ------------------------------------------------------------
 
+  size_t data_blocks() const { return data_blocks_; }
+
   char* BlockBytes(BlockNum block_num) {
     return blocks_base_ + kBlockSize * block_num;
   }
@@ -19,7 +19,10 @@
 
 #include "pagespeed/kernel/sharedmem/shared_mem_statistics.h"
 
+#include <sched.h>
+
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstddef>
 #include <limits>
@@ -56,11 +59,33 @@ const char kStatisticsObjName[] = "statistics";
 // statistics.
 const char kTimestampVariable[] = "timestamp_";
 
+// The shards must be usable by several processes at once, which requires
+// atomic<int64> to be a plain lock-free int64.
+static_assert(sizeof(std::atomic<int64>) == sizeof(int64),
+              "atomic<int64> must have the same layout as int64");
+static_assert(SharedMemVariable::kShardSize >= sizeof(std::atomic<int64>),
+              "shards must be large enough to hold an int64");
+
+size_t RoundUpToShardSize(size_t size) {
+  return (size + SharedMemVariable::kShardSize - 1) /
+         SharedMemVariable::kShardSize * SharedMemVariable::kShardSize;
+}
+
 }  // namespace
 
-// Our shared memory storage format is an array of (mutex, int64).
+const int SharedMemVariable::kNumShards;
+const size_t SharedMemVariable::kShardSize;
+
+// Our shared memory storage format is an array of (mutex, shards), with the
+// mutex padded to the shard size, and each shard holding an int64 at its start.
 SharedMemVariable::SharedMemVariable(StringPiece name, Statistics* stats)
-    : name_(name.as_string()), value_ptr_(nullptr) {}
+    : name_(name.as_string()), shards_(nullptr), num_shards_(0) {}
+
+size_t SharedMemVariable::AllocationSize(AbstractSharedMem* shm_runtime,
+                                         int num_shards) {
+  return RoundUpToShardSize(shm_runtime->SharedMutexSize()) +
+         num_shards * kShardSize;
+}
 
 SharedMemStatistics::Var* SharedMemStatistics::NewVariable(StringPiece name) {
   if (frozen_) {
@@ -90,29 +115,91 @@ SharedMemStatistics::Hist* SharedMemStatistics::NewHistogram(StringPiece name) {
   return new Hist(name, this);
 }
 
-int64 SharedMemVariable::GetLockHeld() const { return *value_ptr_; }
+int SharedMemVariable::CurrentShard() const {
+  if (num_shards_ == 1) {
+    return 0;
+  }
+  // Threads running on the same CPU can't increment concurrently, so that's
+  // what we shard on.  If the CPU is unknown, spread threads round-robin.
+  int cpu = sched_getcpu();
+  if (cpu < 0) {
+    static std::atomic<int> next_shard(0);
+    static thread_local int thread_shard = next_shard.fetch_add(1);
+    cpu = thread_shard;
+  }
+  return cpu % num_shards_;
+}
+
+int64 SharedMemVariable::Get() const {
+  if (shards_ == nullptr) {
+    return -1;
+  }
+  return GetLockHeld();
+}
+
+void SharedMemVariable::Set(int64 value) {
+  if (shards_ != nullptr) {
+    SetReturningPreviousValueLockHeld(value);
+  }
+}
+
+int64 SharedMemVariable::SetReturningPreviousValue(int64 value) {
+  if (shards_ == nullptr) {
+    return -1;
+  }
+  return SetReturningPreviousValueLockHeld(value);
+}
+
+int64 SharedMemVariable::AddHelper(int64 delta) {
+  if (shards_ == nullptr) {
+    return -1;
+  }
+  // With several shards this is only the caller's shard; see the header.
+  return shard(CurrentShard())->fetch_add(delta, std::memory_order_relaxed) +
+         delta;
+}
+
+// Despite the name, neither of these needs the mutex: they are also used
+// for the lock-free accessors above.
+int64 SharedMemVariable::GetLockHeld() const {
+  int64 value = 0;
+  for (int i = 0; i < num_shards_; ++i) {
+    value += shard(i)->load(std::memory_order_relaxed);
+  }
+  return value;
+}
 
 int64 SharedMemVariable::SetReturningPreviousValueLockHeld(int64 new_value) {
-  int64 previous_value = *value_ptr_;
-  *value_ptr_ = new_value;
+  int64 previous_value = 0;
+  for (int i = 1; i < num_shards_; ++i) {
+    previous_value += shard(i)->exchange(0, std::memory_order_relaxed);
+  }
+  previous_value += shard(0)->exchange(new_value, std::memory_order_relaxed);
   return previous_value;
 }
 
 void SharedMemVariable::AttachTo(AbstractSharedMemSegment* segment,
-                                 size_t offset,
+                                 size_t offset, int num_shards,
                                  MessageHandler* message_handler) {
   mutex_.reset(segment->AttachToSharedMutex(offset));
   if (mutex_.get() == nullptr) {
     message_handler->Message(
         kError, "Unable to attach to mutex for statistics variable %s",
         name_.c_str());
+    Reset();
+    return;
   }
 
-  value_ptr_ = reinterpret_cast<volatile int64*>(segment->Base() + offset +
-                                                 segment->SharedMutexSize());
+  shards_ = const_cast<char*>(segment->Base()) + offset +
+            RoundUpToShardSize(segment->SharedMutexSize());
+  num_shards_ = num_shards;
 }
 
-void SharedMemVariable::Reset() { mutex_.reset(); }
+void SharedMemVariable::Reset() {
+  mutex_.reset();
+  shards_ = nullptr;
+  num_shards_ = 0;
+}
 
 AbstractMutex* SharedMemVariable::mutex() const { return mutex_.get(); }
 
@@ -451,8 +538,9 @@ SharedMemStatistics::SharedMemStatistics(
       frozen_(false) {
   if (logging) {
     if (logging_file.size() > 0) {
-      SharedMemVariable* timestamp_impl =
-          AddVariable(kTimestampVariable)->impl();
+      // MutexedScalar is a private base of SharedMemVariable, so this
+      // conversion must be done here rather than in make_unique.
+      MutexedScalar* timestamp_impl = AddVariable(kTimestampVariable)->impl();
       console_logger_ = std::make_unique<StatisticsLogger>(
           logging_interval_ms, max_logfile_size_kb, logging_file,
           timestamp_impl, message_handler, this, file_system, timer);
@@ -467,7 +555,7 @@ SharedMemStatistics::SharedMemStatistics(
 
 SharedMemStatistics::~SharedMemStatistics() {}
 
-bool SharedMemStatistics::InitMutexes(size_t per_var,
+bool SharedMemStatistics::InitMutexes(size_t per_var, size_t per_up_down,
                                       MessageHandler* message_handler) {
   size_t pos = 0;
   for (size_t i = 0; i < variables_size(); ++i, pos += per_var) {
@@ -479,7 +567,7 @@ bool SharedMemStatistics::InitMutexes(size_t per_var,
       return false;
     }
   }
-  for (size_t i = 0; i < up_down_size(); ++i, pos += per_var) {
+  for (size_t i = 0; i < up_down_size(); ++i, pos += per_up_down) {
     UpDownCounter* var = up_downs(i);
     if (!segment_->InitializeSharedMutex(pos, message_handler)) {
       message_handler->Message(
@@ -506,8 +594,10 @@ bool SharedMemStatistics::Init(bool parent, MessageHandler* message_handler) {
   frozen_ = true;
 
   // Compute size of shared memory
-  size_t per_var = shm_runtime_->SharedMutexSize() + sizeof(int64);
-  size_t total = (variables_size() + up_down_size()) * per_var;
+  size_t per_var = SharedMemVariable::AllocationSize(
+      shm_runtime_, SharedMemVariable::kNumShards);
+  size_t per_up_down = SharedMemVariable::AllocationSize(shm_runtime_, 1);
+  size_t total = variables_size() * per_var + up_down_size() * per_up_down;
   for (size_t i = 0; i < histograms_size(); ++i) {
     SharedMemHistogram* hist = histograms(i);
     total += hist->AllocationSize(shm_runtime_);
@@ -521,7 +611,7 @@ bool SharedMemStatistics::Init(bool parent, MessageHandler* message_handler) {
 
     // Init the locks
     if (ok) {
-      if (!InitMutexes(per_var, message_handler)) {
+      if (!InitMutexes(per_var, per_up_down, message_handler)) {
         // We had a segment but could not make some mutex. In this case,
         // we can't predict what would happen if the child process tried
         // to touch messed up mutexes. Accordingly, we blow away the
@@ -547,15 +637,17 @@ bool SharedMemStatistics::Init(bool parent, MessageHandler* message_handler) {
   size_t pos = 0;
   for (size_t i = 0; i < variables_size(); ++i, pos += per_var) {
     if (ok) {
-      variables(i)->impl()->AttachTo(segment_.get(), pos, message_handler);
+      variables(i)->impl()->AttachTo(segment_.get(), pos,
+                                     SharedMemVariable::kNumShards,
+                                     message_handler);
     } else {
       variables(i)->impl()->Reset();
     }
   }
   // Now make the up_down_counter objects actually point to the right things.
-  for (size_t i = 0; i < up_down_size(); ++i, pos += per_var) {
+  for (size_t i = 0; i < up_down_size(); ++i, pos += per_up_down) {
     if (ok) {
-      up_downs(i)->impl()->AttachTo(segment_.get(), pos, message_handler);
+      up_downs(i)->impl()->AttachTo(segment_.get(), pos, 1, message_handler);
     } else {
       up_downs(i)->impl()->Reset();
     }
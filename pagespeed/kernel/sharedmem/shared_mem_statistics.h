@@ -20,6 +20,7 @@
 #ifndef PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_STATISTICS_H_
 #define PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_STATISTICS_H_
 
+#include <atomic>
 #include <cstddef>
 
 #include "pagespeed/kernel/base/abstract_mutex.h"
@@ -40,10 +41,20 @@ class Timer;
 
 // An implementation of Statistics using our shared memory infrastructure.
 // These statistics will be shared amongst all processes and threads
-// spawned by our host.  Note that we will be obtaining a per-variable mutex for
-// every read and write to these variables.  Since this may be expensive,
-// we may need each thread to keep a local cache and infrequently write
-// through to this Statistics object.  TODO(abliss): actually do this.
+// spawned by our host.
+//
+// Variables and UpDownCounters are updated with atomic operations directly in
+// shared memory, without taking any lock.  Variables, which are typically hot
+// counters bumped on every request, are additionally split into kNumShards
+// cache-line sized shards, selected by the CPU the caller runs on, so that
+// concurrent increments from different processes don't bounce the same cache
+// line around; the shards are only summed up when the value is read.
+// UpDownCounters keep a single slot, so that SetReturningPreviousValue() stays
+// atomic.  Each value still has a cross-process mutex next to it, which is
+// only used by StatisticsLogger to serialize its own read-modify-write cycles
+// through the MutexedScalar interface.  That interface is a private base, so
+// that nothing else can reach its mutexed accessors.  Histograms are
+// mutex-protected.
 //
 // Because we must allocate shared memory segments and mutexes before any child
 // processes and threads are created, all AddVariable calls must be done in
@@ -56,16 +67,30 @@ class Timer;
 // warning message will be logged).  If the variable fails to initialize in the
 // process that happens to serve a statistics page, then the variable will show
 // up with value -1.
-class SharedMemVariable : public MutexedScalar {
+class SharedMemVariable : private MutexedScalar {
  public:
+  // Number of shards a Variable is split into.  UpDownCounters use one.
+  static const int kNumShards = 16;
+  // Each shard gets a cache line of its own to avoid false sharing.
+  static const size_t kShardSize = 64;
+
   SharedMemVariable(StringPiece name, Statistics* stats);
   ~SharedMemVariable() override {}
   virtual StringPiece GetName() const { return name_; }
 
- protected:
-  AbstractMutex* mutex() const override;
-  int64 GetLockHeld() const override;
-  int64 SetReturningPreviousValueLockHeld(int64 value) override;
+  // Lock-free accessors, called by VarTemplate and UpDownTemplate.  With
+  // more than one shard, Set() and SetReturningPreviousValue() are not
+  // atomic with respect to concurrent Add()s, and AddHelper() returns the
+  // new value of the caller's shard only, not of the whole variable, so
+  // that an increment doesn't touch the cache lines other CPUs write.
+  int64 Get() const;
+  void Set(int64 value);
+  int64 SetReturningPreviousValue(int64 value);
+  int64 AddHelper(int64 delta);
+
+  // Amount of shared memory needed by a variable with num_shards shards,
+  // including its mutex.
+  static size_t AllocationSize(AbstractSharedMem* shm_runtime, int num_shards);
 
  private:
   friend class SharedMemStatistics;
@@ -73,21 +98,36 @@ class SharedMemVariable : public MutexedScalar {
 
   explicit SharedMemVariable(const StringPiece& name);
 
+  // MutexedScalar implementation, for StatisticsLogger.
+  AbstractMutex* mutex() const override;
+  int64 GetLockHeld() const override;
+  int64 SetReturningPreviousValueLockHeld(int64 value) override;
+
   void AttachTo(AbstractSharedMemSegment* segment_, size_t offset,
-                MessageHandler* message_handler);
+                int num_shards, MessageHandler* message_handler);
 
   // Called on initialization failure, to make sure it's clear if we
   // share some state with parent.
   void Reset();
 
+  std::atomic<int64>* shard(int index) const {
+    return reinterpret_cast<std::atomic<int64>*>(shards_ + index * kShardSize);
+  }
+
+  // Picks the shard the calling thread should update.
+  int CurrentShard() const;
+
   // The name of this variable.
   const GoogleString name_;
 
-  // Lock protecting us. NULL if for some reason initialization failed.
+  // Lock used by StatisticsLogger. NULL if for some reason initialization
+  // failed.
   std::unique_ptr<AbstractMutex> mutex_;
 
-  // The data...
-  volatile int64* value_ptr_;
+  // The data: num_shards_ slots, kShardSize bytes apart. NULL if
+  // initialization failed.
+  char* shards_;
+  int num_shards_;
 
   DISALLOW_COPY_AND_ASSIGN(SharedMemVariable);
 };
@@ -225,9 +265,11 @@ class SharedMemStatistics
   Hist* NewHistogram(StringPiece name) override;
 
  private:
-  // Create mutexes in the segment, with per_var bytes being used,
-  // counting the mutex, for each variable.
-  bool InitMutexes(size_t per_var, MessageHandler* message_handler);
+  // Create mutexes in the segment, with per_var bytes being used, counting
+  // the mutex, for each variable, and per_up_down bytes for each
+  // UpDownCounter.
+  bool InitMutexes(size_t per_var, size_t per_up_down,
+                   MessageHandler* message_handler);
 
   friend class SharedMemStatisticsTestBase;
 
@@ -27,6 +27,7 @@
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/condvar.h"
 #include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/thread.h"
 #include "pagespeed/kernel/base/thread_annotations.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
@@ -47,6 +48,31 @@ const size_t kUnboundedQueue = 0;
 
 }  // namespace
 
+// A worker thread in work-stealing mode, together with its deque of
+// runnable sequences.
+class QueuedWorkerPool::StealingWorker : public ThreadSystem::Thread {
+ public:
+  StealingWorker(QueuedWorkerPool* pool, int index, StringPiece name,
+                 ThreadSystem* thread_system)
+      : Thread(thread_system, name, ThreadSystem::kJoinable),
+        pool(pool),
+        index(index),
+        mutex(thread_system->NewMutex()) {}
+
+  void Run() override { pool->RunStealingWorker(this); }
+
+  QueuedWorkerPool* const pool;
+  const int index;
+  const std::unique_ptr<AbstractMutex> mutex;
+  std::deque<Sequence*> sequences GUARDED_BY(mutex);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(StealingWorker);
+};
+
+thread_local QueuedWorkerPool::StealingWorker*
+    QueuedWorkerPool::current_stealing_worker_ = nullptr;
+
 QueuedWorkerPool::QueuedWorkerPool(int max_workers,
                                    StringPiece thread_name_base,
                                    ThreadSystem* thread_system)
@@ -55,7 +81,13 @@ QueuedWorkerPool::QueuedWorkerPool(int max_workers,
       max_workers_(max_workers),
       shutdown_(false),
       queue_size_(nullptr),
-      load_shedding_threshold_(kNoLoadShedding) {
+      load_shedding_threshold_(kNoLoadShedding),
+      work_stealing_(false),
+      work_available_(mutex_->NewCondvar()),
+      stealing_workers_started_(false),
+      num_idle_workers_(0),
+      num_stealable_sequences_(0),
+      next_stealing_worker_(0) {
   thread_name_base.CopyToString(&thread_name_base_);
 }
 
@@ -69,6 +101,27 @@ QueuedWorkerPool::~QueuedWorkerPool() {
     sequence->WaitForShutDown();
     delete sequence;
   }
+
+  // The stealing threads were joined by WaitForShutDownComplete.
+  for (int i = 0, n = stealing_workers_.size(); i < n; ++i) {
+    delete stealing_workers_[i];
+  }
+}
+
+void QueuedWorkerPool::EnableWorkStealing() {
+  ScopedMutex lock(mutex_.get());
+  DCHECK(all_sequences_.empty())
+      << "EnableWorkStealing must be called before creating sequences";
+  DCHECK(!shutdown_);
+  if (work_stealing_) {
+    return;
+  }
+  work_stealing_ = true;
+  for (size_t i = 0; i < max_workers_; ++i) {
+    stealing_workers_.push_back(new StealingWorker(
+        this, i, StrCat(thread_name_base_, "-", IntegerToString(i)),
+        thread_system_));
+  }
 }
 
 void QueuedWorkerPool::ShutDown() {
@@ -90,6 +143,9 @@ void QueuedWorkerPool::InitiateShutDown() {
       return;
     }
     shutdown_ = true;
+
+    // Wake any idle work-stealing threads so they can exit.
+    work_available_->Broadcast();
   }
 
   // Clear out all the sequences, so that no one adds any more runnable
@@ -116,6 +172,15 @@ void QueuedWorkerPool::WaitForShutDownComplete() {
     // further tasks will be started in the thread.
   }
 
+  // Work-stealing threads exit once they find shutdown_ set with nothing
+  // left to steal.  The StealingWorker objects are deleted with the pool,
+  // in case a late QueueSequence is still pushing onto their deques.
+  if (stealing_workers_started_.exchange(false)) {
+    for (int i = 0, n = stealing_workers_.size(); i < n; ++i) {
+      stealing_workers_[i]->Join();
+    }
+  }
+
   // Wait for all workers to complete whatever they were doing.
   //
   // TODO(jmarantz): attempt to cancel in-progress functions via
@@ -184,6 +249,11 @@ QueuedWorkerPool::Sequence* QueuedWorkerPool::AssignWorkerToNextSequence(
 }
 
 void QueuedWorkerPool::QueueSequence(Sequence* sequence) {
+  if (work_stealing_) {
+    QueueStealableSequence(sequence);
+    return;
+  }
+
   QueuedWorker* worker = nullptr;
   Sequence* drop_sequence = nullptr;
   {
@@ -232,6 +302,118 @@ void QueuedWorkerPool::QueueSequence(Sequence* sequence) {
   }
 }
 
+void QueuedWorkerPool::StartStealingWorkers() {
+  ScopedMutex lock(mutex_.get());
+  if (!stealing_workers_started_.load() && !shutdown_) {
+    for (int i = 0, n = stealing_workers_.size(); i < n; ++i) {
+      stealing_workers_[i]->Start();
+    }
+    stealing_workers_started_ = true;
+  }
+}
+
+void QueuedWorkerPool::QueueStealableSequence(Sequence* sequence) {
+  DCHECK(!stealing_workers_.empty());
+  if (!stealing_workers_started_.load()) {
+    StartStealingWorkers();
+  }
+
+  // A sequence made runnable by one of our own threads is likely to touch
+  // the same data as the function that woke it, so keep it local.
+  StealingWorker* worker = current_stealing_worker_;
+  if ((worker == nullptr) || (worker->pool != this)) {
+    worker = stealing_workers_[next_stealing_worker_.fetch_add(1) %
+                               stealing_workers_.size()];
+  }
+
+  Sequence* drop_sequence = nullptr;
+  {
+    ScopedMutex lock(worker->mutex.get());
+    worker->sequences.push_back(sequence);
+    int num_queued = num_stealable_sequences_.fetch_add(1) + 1;
+
+    // Load shedding is applied per deque: the total decides whether to
+    // drop, and the oldest sequence in this deque is the one dropped.
+    if ((load_shedding_threshold_ != kNoLoadShedding) &&
+        (num_queued > load_shedding_threshold_)) {
+      drop_sequence = worker->sequences.front();
+      worker->sequences.pop_front();
+      --num_stealable_sequences_;
+    }
+  }
+
+  if (drop_sequence != nullptr) {
+    drop_sequence->Cancel();
+  }
+
+  // An idle thread increments num_idle_workers_ before its final look at
+  // the deques, so either it sees the sequence we just pushed or we see it
+  // and wake it.  The fence keeps our read from moving ahead of the push.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (num_idle_workers_.load() > 0) {
+    ScopedMutex lock(mutex_.get());
+    work_available_->Signal();
+  }
+}
+
+void QueuedWorkerPool::RunStealingWorker(StealingWorker* worker) {
+  current_stealing_worker_ = worker;
+  while (Sequence* sequence = NextStealableSequence(worker)) {
+    // As in Run, drain the whole sequence before looking for another.
+    while (Function* function = sequence->NextFunction()) {
+      function->CallRun();
+    }
+  }
+  current_stealing_worker_ = nullptr;
+}
+
+QueuedWorkerPool::Sequence* QueuedWorkerPool::NextStealableSequence(
+    StealingWorker* worker) {
+  Sequence* sequence = PopStealableSequence(worker);
+  if (sequence == nullptr) {
+    ScopedMutex lock(mutex_.get());
+    ++num_idle_workers_;
+    while (!shutdown_) {
+      sequence = PopStealableSequence(worker);
+      if (sequence != nullptr) {
+        break;
+      }
+      work_available_->Wait();
+    }
+    --num_idle_workers_;
+  }
+  return sequence;
+}
+
+QueuedWorkerPool::Sequence* QueuedWorkerPool::PopStealableSequence(
+    StealingWorker* worker) {
+  Sequence* sequence = nullptr;
+  {
+    ScopedMutex lock(worker->mutex.get());
+    if (!worker->sequences.empty()) {
+      sequence = worker->sequences.front();
+      worker->sequences.pop_front();
+    }
+  }
+
+  // Our own deque is empty, so steal the oldest sequence from the next
+  // non-empty one, starting with our neighbor so thieves spread out.
+  for (int i = 1, n = stealing_workers_.size();
+       (sequence == nullptr) && (i < n); ++i) {
+    StealingWorker* victim = stealing_workers_[(worker->index + i) % n];
+    ScopedMutex lock(victim->mutex.get());
+    if (!victim->sequences.empty()) {
+      sequence = victim->sequences.front();
+      victim->sequences.pop_front();
+    }
+  }
+
+  if (sequence != nullptr) {
+    --num_stealable_sequences_;
+  }
+  return sequence;
+}
+
 bool QueuedWorkerPool::AreBusy(const SequenceSet& sequences)
     NO_THREAD_SAFETY_ANALYSIS {
   // This is the only operation that accesses multiple workers at once.
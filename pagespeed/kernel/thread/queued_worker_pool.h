@@ -23,10 +23,19 @@
 //
 // This differs from QueuedWorker, which always uses exactly one thread.
 // In this interface, any task can be assigned to any thread.
+//
+// By default runnable sequences wait in a single queue guarded by the pool
+// mutex.  With EnableWorkStealing() each worker thread instead owns a deque
+// of runnable sequences: a sequence made runnable on a worker thread goes on
+// that worker's deque, others are spread round-robin, and a worker whose
+// deque is empty steals the oldest sequence from another worker.  This keeps
+// the pool mutex off the path of every Sequence::Add when there are many
+// short functions and many threads.
 
 #ifndef PAGESPEED_KERNEL_THREAD_QUEUED_WORKER_POOL_H_
 #define PAGESPEED_KERNEL_THREAD_QUEUED_WORKER_POOL_H_
 
+#include <atomic>
 #include <cstddef>  // for size_t
 #include <deque>
 #include <set>
@@ -57,6 +66,15 @@ class QueuedWorkerPool {
                    ThreadSystem* thread_system);
   ~QueuedWorkerPool();
 
+  // Switches the pool to per-worker deques with work stealing.  All
+  // max_workers threads are started when the first sequence becomes
+  // runnable, and each idles on the pool condvar when there is nothing to
+  // steal.  Functions within a Sequence still run in order, one at a time.
+  //
+  // Must be called before any sequences are created.
+  void EnableWorkStealing();
+  bool work_stealing() const { return work_stealing_; }
+
   // Functions added to a Sequence will be run sequentially, though not
   // necessarily always from the same worker thread.  The scheduler will
   // continue to schedule new work added to the sequence until
@@ -222,14 +240,22 @@ class QueuedWorkerPool {
   void set_queue_size_stat(Waveform* x) { queue_size_ = x; }
 
  private:
+  class StealingWorker;
   friend class Sequence;
   void Run(Sequence* sequence, QueuedWorker* worker);
   void QueueSequence(Sequence* sequence);
   Sequence* AssignWorkerToNextSequence(QueuedWorker* worker);
   void SequenceNoLongerActive(Sequence* sequence);
 
+  // Work-stealing counterparts of the above.
+  void StartStealingWorkers();
+  void QueueStealableSequence(Sequence* sequence);
+  void RunStealingWorker(StealingWorker* worker);
+  Sequence* NextStealableSequence(StealingWorker* worker);
+  Sequence* PopStealableSequence(StealingWorker* worker);
+
   ThreadSystem* thread_system_;
-  std::unique_ptr<AbstractMutex> mutex_;
+  std::unique_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
 
   // active_workers_ and available_workers_ are mutually exclusive.
   std::set<QueuedWorker*> active_workers_;
@@ -249,6 +275,21 @@ class QueuedWorkerPool {
   Waveform* queue_size_;
   int load_shedding_threshold_;
 
+  // Work-stealing state.  stealing_workers_ is fixed by EnableWorkStealing,
+  // and each worker's deque has its own mutex.  Idle workers wait on
+  // work_available_, which is signaled with mutex_ held.
+  bool work_stealing_;
+  std::vector<StealingWorker*> stealing_workers_;
+  std::unique_ptr<ThreadSystem::Condvar> work_available_;
+  std::atomic<bool> stealing_workers_started_;
+  std::atomic<int> num_idle_workers_;
+  std::atomic<int> num_stealable_sequences_;
+  std::atomic<unsigned int> next_stealing_worker_;
+
+  // The StealingWorker whose thread is running, if any, so sequences made
+  // runnable from a pool thread stay on that thread's deque.
+  static thread_local StealingWorker* current_stealing_worker_;
+
   DISALLOW_COPY_AND_ASSIGN(QueuedWorkerPool);
 };
 
@@ -38,6 +38,10 @@ namespace {
 
 const int kIndexNotSet = 0;
 
+// Values of Alarm::wheel_slot_ other than a slot number in the wheel.
+const int kAlarmNotQueued = -1;
+const int kAlarmReady = -2;
+
 }  // namespace
 
 // Basic Alarm type (forward declared in the .h file).  Note that Alarms are
@@ -76,14 +80,26 @@ class Scheduler::Alarm {
 
  protected:
   Alarm()
-      : wakeup_time_us_(0), index_(kIndexNotSet), in_wait_dispatch_(false) {}
+      : wakeup_time_us_(0),
+        index_(kIndexNotSet),
+        wheel_next_(nullptr),
+        wheel_prev_(nullptr),
+        wheel_slot_(kAlarmNotQueued),
+        in_wait_dispatch_(false) {}
   virtual ~Alarm() {}
 
  private:
   friend class Scheduler;
+  friend class AlarmWheel;
   int64 wakeup_time_us_;
   uint32 index_;  // Set by scheduler to disambiguate equal wakeup times.
 
+  // Links for the AlarmWheel slot holding this alarm, and which slot that
+  // is, or kAlarmReady or kAlarmNotQueued.
+  Alarm* wheel_next_;
+  Alarm* wheel_prev_;
+  int wheel_slot_;
+
   // This is used to mark a wait alarm that's being considered by ::Signal
   // as owned by it for purposes of cleanup, so any concurrent timeout will
   // know not to delete it.
@@ -91,6 +107,202 @@ class Scheduler::Alarm {
   DISALLOW_COPY_AND_ASSIGN(Alarm);
 };
 
+// Outstanding alarms are kept in a hierarchical timing wheel, along the
+// lines of the Linux kernel's timer wheel.  Time is divided into ticks of
+// about a millisecond, and each level of the wheel has kSlots slots, each
+// kSlots times as long as a slot on the level below.  An alarm is linked
+// into the lowest level on which it falls within the cursor's current
+// cycle, so adding and canceling an alarm are constant-time list
+// operations.  As the cursor advances into a slot on a higher level, the
+// alarms there are cascaded down to lower levels, so each alarm moves at
+// most once per level.
+//
+// Alarms whose tick the cursor has reached are moved to ready_, which is
+// ordered by wakeup time and then insertion index, so alarms still run in
+// exactly that order.  ready_ only ever holds the alarms that are due about
+// now, so it stays small.
+class Scheduler::AlarmWheel {
+ public:
+  AlarmWheel() : cursor_(0), size_(0) {
+    for (int level = 0; level < kNumLevels; ++level) {
+      occupied_[level] = 0;
+      for (int index = 0; index < kSlots; ++index) {
+        slots_[level][index] = nullptr;
+      }
+    }
+  }
+
+  bool empty() const { return size_ == 0; }
+
+  void Insert(Alarm* alarm) {
+    DCHECK_EQ(kAlarmNotQueued, alarm->wheel_slot_);
+    ++size_;
+    Place(alarm);
+  }
+
+  // Removes alarm, returning false if it is not in the wheel.
+  bool Erase(Alarm* alarm) {
+    int slot = alarm->wheel_slot_;
+    if (slot == kAlarmNotQueued) {
+      return false;
+    }
+    if (slot == kAlarmReady) {
+      ready_.erase(alarm);
+    } else {
+      Unlink(alarm, slot / kSlots, slot % kSlots);
+    }
+    alarm->wheel_slot_ = kAlarmNotQueued;
+    --size_;
+    return true;
+  }
+
+  // Removes and returns the earliest alarm if it is due at now_us, or
+  // returns nullptr.
+  Alarm* PopDue(int64 now_us) {
+    Advance(Tick(now_us));
+    if (ready_.empty()) {
+      return nullptr;
+    }
+    AlarmSet::iterator first = ready_.begin();
+    Alarm* alarm = *first;
+    if (alarm->wakeup_time_us_ > now_us) {
+      return nullptr;
+    }
+    ready_.erase(first);
+    alarm->wheel_slot_ = kAlarmNotQueued;
+    --size_;
+    return alarm;
+  }
+
+  // Returns the wakeup time of the earliest alarm, or 0 if there are none.
+  // If that alarm is still on a higher level of the wheel, returns the start
+  // of its slot instead; this is a lower bound, and once the cursor reaches
+  // it the slot is cascaded down and the answer becomes exact.
+  int64 NextWakeupUs() const {
+    if (!ready_.empty()) {
+      return (*ready_.begin())->wakeup_time_us_;
+    }
+    int level, index;
+    if (!NextOccupiedSlot(&level, &index)) {
+      return 0;
+    }
+    if (level > 0) {
+      return SlotStartTick(level, index) << kTickBits;
+    }
+    const Alarm* earliest = slots_[0][index];
+    for (const Alarm* alarm = earliest->wheel_next_; alarm != nullptr;
+         alarm = alarm->wheel_next_) {
+      if (alarm->wakeup_time_us_ < earliest->wakeup_time_us_) {
+        earliest = alarm;
+      }
+    }
+    return earliest->wakeup_time_us_;
+  }
+
+ private:
+  static const int kTickBits = 10;  // 1024us ticks.
+  static const int kLevelBits = 6;
+  static const int kSlots = 1 << kLevelBits;
+  static const int kSlotMask = kSlots - 1;
+  // Enough levels to cover any non-negative time in microseconds.
+  static const int kNumLevels = (64 - kTickBits + kLevelBits - 1) / kLevelBits;
+
+  static int64 Tick(int64 time_us) { return time_us >> kTickBits; }
+
+  // The first tick of slot index on level, in the cursor's current cycle.
+  int64 SlotStartTick(int level, int index) const {
+    int cycle_bits = kLevelBits * (level + 1);
+    return ((cursor_ >> cycle_bits) << cycle_bits) |
+           (static_cast<int64>(index) << (kLevelBits * level));
+  }
+
+  void Place(Alarm* alarm) {
+    int64 tick = Tick(alarm->wakeup_time_us_);
+    if (tick <= cursor_) {
+      alarm->wheel_slot_ = kAlarmReady;
+      ready_.insert(alarm);
+      return;
+    }
+    int level = 0;
+    while ((level < kNumLevels - 1) &&
+           ((tick >> (kLevelBits * (level + 1))) !=
+            (cursor_ >> (kLevelBits * (level + 1))))) {
+      ++level;
+    }
+    int index = (tick >> (kLevelBits * level)) & kSlotMask;
+    Alarm*& head = slots_[level][index];
+    alarm->wheel_prev_ = nullptr;
+    alarm->wheel_next_ = head;
+    if (head != nullptr) {
+      head->wheel_prev_ = alarm;
+    }
+    head = alarm;
+    occupied_[level] |= uint64{1} << index;
+    alarm->wheel_slot_ = level * kSlots + index;
+  }
+
+  void Unlink(Alarm* alarm, int level, int index) {
+    if (alarm->wheel_prev_ == nullptr) {
+      slots_[level][index] = alarm->wheel_next_;
+    } else {
+      alarm->wheel_prev_->wheel_next_ = alarm->wheel_next_;
+    }
+    if (alarm->wheel_next_ != nullptr) {
+      alarm->wheel_next_->wheel_prev_ = alarm->wheel_prev_;
+    }
+    if (slots_[level][index] == nullptr) {
+      occupied_[level] &= ~(uint64{1} << index);
+    }
+  }
+
+  // Finds the earliest non-empty slot.  Everything on a level lies within
+  // the cursor's current cycle of that level and after the cursor's slot,
+  // and a higher level only holds alarms in later cycles, so the first
+  // level with anything on it holds the earliest slot.
+  bool NextOccupiedSlot(int* level, int* index) const {
+    for (int l = 0; l < kNumLevels; ++l) {
+      int current = (cursor_ >> (kLevelBits * l)) & kSlotMask;
+      uint64 later = occupied_[l] & ~((uint64{2} << current) - 1);
+      if (later != 0) {
+        *level = l;
+        *index = __builtin_ctzll(later);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Moves the cursor forward to target_tick, jumping from one non-empty
+  // slot to the next rather than visiting every tick.
+  void Advance(int64 target_tick) {
+    while (cursor_ < target_tick) {
+      int level, index;
+      if (!NextOccupiedSlot(&level, &index) ||
+          (SlotStartTick(level, index) > target_tick)) {
+        cursor_ = target_tick;
+        return;
+      }
+      cursor_ = SlotStartTick(level, index);
+      Alarm* alarm = slots_[level][index];
+      slots_[level][index] = nullptr;
+      occupied_[level] &= ~(uint64{1} << index);
+      while (alarm != nullptr) {
+        Alarm* next = alarm->wheel_next_;
+        Place(alarm);
+        alarm = next;
+      }
+    }
+  }
+
+  int64 cursor_;  // The current tick.
+  int size_;
+  AlarmSet ready_;
+  Alarm* slots_[kNumLevels][kSlots];
+  uint64 occupied_[kNumLevels];  // Bit i is set iff slots_[level][i].
+
+  DISALLOW_COPY_AND_ASSIGN(AlarmWheel);
+};
+
 namespace {
 
 // private class to encapsulate a function being
@@ -202,16 +414,15 @@ Scheduler::Scheduler(ThreadSystem* thread_system, Timer* timer)
       mutex_(thread_system->NewMutex()),
       condvar_(mutex_->NewCondvar()),
       index_(kIndexNotSet),
+      outstanding_alarms_(new AlarmWheel),
       signal_count_(0),
       running_waiting_alarms_(false) {}
 
 Scheduler::~Scheduler() {
 #if SCHEDULER_CANCEL_OUTSTANDING_ALARMS_ON_DESTRUCTION
   ScopedMutex lock(mutex_.get());
-  while (!outstanding_alarms_.empty()) {
-    AlarmSet::iterator p = outstanding_alarms_.begin();
-    Alarm* alarm = *p;
-    outstanding_alarms_.erase(p);
+  while (!outstanding_alarms_->empty()) {
+    Alarm* alarm = outstanding_alarms_->PopDue(kint64max);
     alarm->CancelAlarm();
   }
 #endif
@@ -306,15 +517,17 @@ void Scheduler::InsertAlarmAtUsMutexHeld(int64 wakeup_time_us,
   alarm->index_ = ++index_;
 
   if (broadcast_on_wakeup_change) {
+    // NextWakeupUs may be earlier than the first alarm, but never later, and
+    // it is what waiters sleep until, so this still wakes them when needed.
     bool wakeup_time_changed =
-        outstanding_alarms_.empty() ||
-        (wakeup_time_us < (*outstanding_alarms_.begin())->wakeup_time_us_);
+        outstanding_alarms_->empty() ||
+        (wakeup_time_us < outstanding_alarms_->NextWakeupUs());
     if (wakeup_time_changed) {
       condvar_->Broadcast();
     }
   }
 
-  outstanding_alarms_.insert(alarm);
+  outstanding_alarms_->Insert(alarm);
 }
 
 Scheduler::Alarm* Scheduler::AddAlarmAtUs(int64 wakeup_time_us,
@@ -335,7 +548,7 @@ Scheduler::Alarm* Scheduler::AddAlarmAtUsMutexHeld(int64 wakeup_time_us,
 
 bool Scheduler::CancelAlarm(Alarm* alarm) {
   mutex_->DCheckLocked();
-  if (outstanding_alarms_.erase(alarm) != 0) {
+  if (outstanding_alarms_->Erase(alarm)) {
     // Note: the following call may drop and re-lock the scheduler mutex.
     alarm->CancelAlarm();
     return true;
@@ -345,20 +558,18 @@ bool Scheduler::CancelAlarm(Alarm* alarm) {
 }
 
 int64 Scheduler::RunAlarms(bool* ran_alarms) {
-  while (!outstanding_alarms_.empty()) {
+  while (!outstanding_alarms_->empty()) {
     mutex_->DCheckLocked();
-    // We don't use the iterator to go through the set, because we're dropping
-    // the lock in mid-loop thus permitting new insertions and cancellations.
-    AlarmSet::iterator first_alarm_iterator = outstanding_alarms_.begin();
-    Alarm* first_alarm = *first_alarm_iterator;
+    // We take one alarm at a time, because we're dropping the lock in
+    // mid-loop thus permitting new insertions and cancellations.
     int64 now_us = timer_->NowUs();
-    if (now_us < first_alarm->wakeup_time_us_) {
+    Alarm* first_alarm = outstanding_alarms_->PopDue(now_us);
+    if (first_alarm == nullptr) {
       // The next deadline lies in the future.
-      return first_alarm->wakeup_time_us_;
+      return outstanding_alarms_->NextWakeupUs();
     }
-    // first_alarm should be run.  It can't have been cancelled as we've held
-    // the lock since we found it.
-    outstanding_alarms_.erase(first_alarm_iterator);  // Prevent cancellation.
+    // first_alarm should be run.  Removing it from outstanding_alarms_
+    // under the lock prevents its cancellation.
     if (ran_alarms != nullptr) {
       *ran_alarms = true;
     }
@@ -396,13 +607,13 @@ bool Scheduler::ProcessAlarmsOrWaitUs(int64 timeout_us) {
 
     next_wakeup_us = RunAlarms(nullptr);
   }
-  return !outstanding_alarms_.empty();
+  return !outstanding_alarms_->empty();
 }
 
 // For testing purposes, let a tester know when the scheduler has quiesced.
 bool Scheduler::NoPendingAlarms() {
   mutex_->DCheckLocked();
-  return (outstanding_alarms_.empty());
+  return outstanding_alarms_->empty();
 }
 
 SchedulerBlockingFunction::SchedulerBlockingFunction(Scheduler* scheduler)
@@ -0,0 +1,108 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/kernel/util/brotli_deflater.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "external/brotli/c/include/brotli/encode.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/stack_buffer.h"
+#include "pagespeed/kernel/base/writer.h"
+
+namespace net_instaweb {
+
+BrotliDeflater::BrotliDeflater(int quality)
+    : brotli_state_(BrotliEncoderCreateInstance(nullptr, nullptr, nullptr),
+                    &BrotliEncoderDestroyInstance),
+      finished_(false) {
+  if (brotli_state_.get() != nullptr) {
+    if (quality < kMinQuality) {
+      quality = kMinQuality;
+    } else if (quality > kMaxQuality) {
+      quality = kMaxQuality;
+    }
+    BrotliEncoderSetParameter(brotli_state_.get(), BROTLI_PARAM_QUALITY,
+                              quality);
+  }
+}
+
+BrotliDeflater::~BrotliDeflater() {}
+
+void BrotliDeflater::SetSizeHint(int64 size) {
+  if (brotli_state_.get() != nullptr) {
+    // The hint is advisory, so clamp rather than reject huge sizes.
+    BrotliEncoderSetParameter(
+        brotli_state_.get(), BROTLI_PARAM_SIZE_HINT,
+        static_cast<uint32_t>(std::min<int64>(size, 1 << 30)));
+  }
+}
+
+bool BrotliDeflater::Write(StringPiece in, MessageHandler* handler,
+                           Writer* writer) {
+  return Process(BROTLI_OPERATION_PROCESS, in, handler, writer);
+}
+
+bool BrotliDeflater::Finish(MessageHandler* handler, Writer* writer) {
+  bool ret = Process(BROTLI_OPERATION_FINISH, StringPiece(), handler, writer);
+  finished_ = true;
+  return ret;
+}
+
+bool BrotliDeflater::Process(int op, StringPiece in, MessageHandler* handler,
+                             Writer* writer) {
+  if (brotli_state_.get() == nullptr || finished_) {
+    return false;  // Memory allocation failed, or already finished.
+  }
+  BrotliEncoderOperation operation = static_cast<BrotliEncoderOperation>(op);
+  uint8_t output[kStackBufferSize];
+  size_t available_in = in.size();
+  const uint8_t* next_in = reinterpret_cast<const uint8_t*>(in.data());
+  do {
+    size_t available_out = sizeof(output);
+    uint8_t* next_out = output;
+    if (!BrotliEncoderCompressStream(brotli_state_.get(), operation,
+                                     &available_in, &next_in, &available_out,
+                                     &next_out, nullptr)) {
+      handler->Message(kError, "BrotliEncoderCompressStream failed");
+      return false;
+    }
+    StringPiece chunk(reinterpret_cast<char*>(output),
+                      sizeof(output) - available_out);
+    if (!chunk.empty() && !writer->Write(chunk, handler)) {
+      return false;
+    }
+  } while (available_in != 0 ||
+           BrotliEncoderHasMoreOutput(brotli_state_.get()) ||
+           (operation == BROTLI_OPERATION_FINISH &&
+            !BrotliEncoderIsFinished(brotli_state_.get())));
+  return true;
+}
+
+bool BrotliDeflater::Compress(StringPiece in, int quality,
+                              MessageHandler* handler, Writer* writer) {
+  BrotliDeflater deflater(quality);
+  deflater.SetSizeHint(in.size());
+  return (deflater.Write(in, handler, writer) &&
+          deflater.Finish(handler, writer));
+}
+
+}  // namespace net_instaweb
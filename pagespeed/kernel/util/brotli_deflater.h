@@ -0,0 +1,79 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_UTIL_BROTLI_DEFLATER_H_
+#define PAGESPEED_KERNEL_UTIL_BROTLI_DEFLATER_H_
+
+#include <memory>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+struct BrotliEncoderStateStruct;
+
+namespace net_instaweb {
+
+class MessageHandler;
+class Writer;
+
+// Brotli compressor, the counterpart of BrotliInflater.  Input can be
+// streamed through Write() in as many pieces as convenient, with Finish()
+// completing the stream; output is passed to the Writer as it is produced,
+// so no buffer sized for the worst case is needed.
+class BrotliDeflater {
+ public:
+  // Brotli's quality ranges from 0 (fastest) to 11 (densest).
+  static const int kMinQuality = 0;
+  static const int kMaxQuality = 11;
+
+  // Qualities outside [kMinQuality, kMaxQuality] are clamped.
+  explicit BrotliDeflater(int quality);
+  ~BrotliDeflater();
+
+  // Hints the total input size, which lets the encoder pick a smaller
+  // window for small inputs.  Must be called before the first Write().
+  void SetSizeHint(int64 size);
+
+  // Compresses in, writing any output the encoder is ready to emit.
+  // Returns false if the encoder or the writer fails.
+  bool Write(StringPiece in, MessageHandler* handler, Writer* writer);
+
+  // Completes the stream, writing all remaining output.  Write() and
+  // Finish() return false if called again afterwards.
+  bool Finish(MessageHandler* handler, Writer* writer);
+
+  // Compresses in in one shot.
+  static bool Compress(StringPiece in, int quality, MessageHandler* handler,
+                       Writer* writer);
+
+ private:
+  // Runs the encoder with op over in, passing output to writer.
+  bool Process(int op, StringPiece in, MessageHandler* handler,
+               Writer* writer);
+
+  std::unique_ptr<BrotliEncoderStateStruct, void (*)(BrotliEncoderStateStruct*)>
+      brotli_state_;
+  bool finished_;
+
+  DISALLOW_COPY_AND_ASSIGN(BrotliDeflater);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_UTIL_BROTLI_DEFLATER_H_
@@ -23,10 +23,10 @@
 
 #include "base/logging.h"
 #include "external/brotli/c/include/brotli/decode.h"
-#include "external/brotli/c/include/brotli/encode.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/stack_buffer.h"
 #include "pagespeed/kernel/base/writer.h"
+#include "pagespeed/kernel/util/brotli_deflater.h"
 
 namespace net_instaweb {
 
@@ -46,25 +46,14 @@ void BrotliInflater::ResetState() {
 
 bool BrotliInflater::Compress(StringPiece in, int compression_level,
                               MessageHandler* handler, Writer* writer) {
-  size_t compressed_size = BrotliEncoderMaxCompressedSize(in.length());
-  uint8_t* compressed = new uint8_t[compressed_size];
-  // Compress in one shot with BrotliCompress.
-  bool result = false;
-  if (BrotliEncoderCompress(compression_level, BROTLI_DEFAULT_WINDOW,
-                            BROTLI_DEFAULT_MODE, in.length(),
-                            reinterpret_cast<const uint8_t*>(in.data()),
-                            &compressed_size, compressed)) {
-    StringPiece chunk(reinterpret_cast<char*>(compressed), compressed_size);
-    result = writer->Write(chunk, handler);
-  }
-  delete[] compressed;
-  return result;
+  return BrotliDeflater::Compress(in, compression_level, handler, writer);
 }
 
 bool BrotliInflater::Compress(StringPiece in, MessageHandler* handler,
                               Writer* writer) {
   // Default quality is 11 for brotli.
-  return BrotliInflater::Compress(in, 11, handler, writer);
+  return BrotliInflater::Compress(in, BrotliDeflater::kMaxQuality, handler,
+                                  writer);
 }
 
 bool BrotliInflater::DecompressHelper(StringPiece in, MessageHandler* handler,
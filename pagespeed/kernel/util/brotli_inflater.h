@@ -42,9 +42,8 @@ class BrotliInflater {
   // Compresses a StringPiece, writing output to Writer.  Returns false
   // if there was some kind of failure, though none are expected.
   // If no compression level is specified, the default of 11 (maximum
-  // compression/highest quality) is used.
-  // TODO(jcrowell): add api that takes in &out_string as an argument, to remove
-  // string copy.
+  // compression/highest quality) is used.  These are wrappers around
+  // BrotliDeflater::Compress, kept for existing callers.
   static bool Compress(StringPiece in, MessageHandler* handler, Writer* writer);
   static bool Compress(StringPiece in, int compression_level,
                        MessageHandler* handler, Writer* writer);
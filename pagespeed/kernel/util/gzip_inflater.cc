@@ -360,6 +360,12 @@ bool GzipInflater::Deflate(StringPiece in, InflateType format,
   return true;
 }
 
+uint32 GzipInflater::Adler32(StringPiece in) {
+  uLong checksum = adler32(0L, Z_NULL, 0);
+  return adler32(checksum, reinterpret_cast<const Bytef*>(in.data()),
+                 static_cast<uInt>(in.size()));
+}
+
 bool GzipInflater::Deflate(StringPiece in, InflateType format, Writer* writer) {
   return GzipInflater::Deflate(in, format, Z_DEFAULT_COMPRESSION, writer);
 }
@@ -81,6 +81,9 @@ class GzipInflater {
   // Checks whether in starts with the gzip file signature.
   static bool HasGzipMagicBytes(StringPiece in);
 
+  // Returns the Adler-32 checksum of in, as used by the zlib format.
+  static uint32 Adler32(StringPiece in);
+
  private:
   friend class GzipInflaterTestPeer;
 
@@ -66,6 +66,7 @@ void RequestContext::Init() {
   using_http2_ = false;
   accepts_webp_ = false;
   accepts_gzip_ = false;
+  accepts_brotli_ = false;
   frozen_ = false;
 }
 
@@ -124,6 +125,13 @@ void RequestContext::SetAcceptsGzip(bool x) {
   }
 }
 
+void RequestContext::SetAcceptsBrotli(bool x) {
+  if (x != accepts_brotli_) {
+    DCHECK(!frozen_);
+    accepts_brotli_ = x;
+  }
+}
+
 void RequestContext::SetAcceptsWebp(bool x) {
   if (x != accepts_webp_) {
     DCHECK(!frozen_);
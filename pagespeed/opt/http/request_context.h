@@ -157,6 +157,11 @@ class RequestContext : public RefCounted<RequestContext> {
   void SetAcceptsGzip(bool x);
   bool accepts_gzip() const { return accepts_gzip_; }
 
+  // Indicates whether the request-headers tell us that a browser can extract
+  // brotli compressed data.
+  void SetAcceptsBrotli(bool x);
+  bool accepts_brotli() const { return accepts_brotli_; }
+
   int64 request_id() const { return request_id_; }
   void set_request_id(int64 x) { request_id_ = x; }
 
@@ -252,6 +257,7 @@ class RequestContext : public RefCounted<RequestContext> {
   bool using_http2_;
   bool accepts_webp_;
   bool accepts_gzip_;
+  bool accepts_brotli_;
   bool frozen_;
   GoogleString minimal_private_suffix_;
 
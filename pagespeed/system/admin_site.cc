@@ -26,6 +26,7 @@
 
 #include "net/instaweb/http/public/async_fetch.h"
 #include "net/instaweb/http/public/http_cache.h"
+#include "net/instaweb/http/public/rate_controlling_url_async_fetcher.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_query.h"
 #include "net/instaweb/rewriter/public/server_context.h"
@@ -92,6 +93,7 @@ const Tab kTabs[] = {
     {"Configuration", "Configuration", "config", "?config", kShortBreak},
     {"Histograms", "Histograms", "histograms", "?histograms", kLongBreak},
     {"Caches", "Caches", "cache", "?cache", kLongBreak},
+    {"Fetch Queues", "Fetch Queues", "fetch_queues", nullptr, kLongBreak},
     {"Console", "Console", "console", nullptr, kLongBreak},
     {"Message History", "Message History", "message_history", nullptr,
      kLongBreak},
@@ -389,6 +391,25 @@ void AdminSite::PrintHistograms(AdminSource source, AsyncFetch* fetch,
   stats->RenderHistograms(fetch, message_handler_);
 }
 
+void AdminSite::PrintFetchQueues(
+    AdminSource source, AsyncFetch* fetch,
+    RateControllingUrlAsyncFetcher* rate_controlling_fetcher) {
+  AdminHtml admin_html("fetch_queues", "", source, timer_, fetch,
+                       message_handler_);
+  if (rate_controlling_fetcher == nullptr) {
+    fetch->Write("Background fetches are not rate-limited.", message_handler_);
+    return;
+  }
+  fetch->Write(
+      "<p>Background fetches outgoing to and queued for each host in this "
+      "process.  Limit is the number of outgoing fetches allowed, which "
+      "backs off when a host's latency (a recent average) climbs.</p>\n",
+      message_handler_);
+  GoogleString host_stats;
+  rate_controlling_fetcher->PrintHostStats(&host_stats);
+  HtmlKeywords::WritePre(host_stats, "", fetch, message_handler_);
+}
+
 namespace {
 
 static const char kTableStart[] =
@@ -706,7 +727,9 @@ void AdminSite::AdminPage(
     SystemCachePath* cache_path, AsyncFetch* fetch, SystemCaches* system_caches,
     CacheInterface* filesystem_metadata_cache, HTTPCache* http_cache,
     CacheInterface* metadata_cache, PropertyCache* page_property_cache,
-    ServerContext* server_context, Statistics* statistics, Statistics* stats,
+    ServerContext* server_context,
+    RateControllingUrlAsyncFetcher* rate_controlling_fetcher,
+    Statistics* statistics, Statistics* stats,
     SystemRewriteOptions* global_system_rewrite_options) {
   // The handler is "pagespeed_admin", so we must dispatch off of
   // the remainder of the URL.  For
@@ -766,6 +789,8 @@ void AdminSite::AdminPage(
                   options, cache_path, fetch, system_caches,
                   filesystem_metadata_cache, http_cache, metadata_cache,
                   page_property_cache, server_context);
+    } else if (leaf == "fetch_queues") {
+      PrintFetchQueues(kPageSpeedAdmin, fetch, rate_controlling_fetcher);
     } else if (leaf == "histograms") {
       PrintHistograms(kPageSpeedAdmin, fetch, stats);
     } else {
@@ -866,12 +891,14 @@ void AdminSite::PurgeHandler(StringPiece url, SystemCachePath* cache_path,
       new PurgeFetchCallbackGasket(fetch, message_handler_);
   PurgeContext::PurgeCallback* callback =
       NewCallback(gasket, &PurgeFetchCallbackGasket::Done);
-  if (strings::EndsWith(url, "*")) {
-    // If the url is "*" we'll just purge everything.  Note that we will
-    // ignore any sub-paths in the expression.  We can only purge the
-    // entire cache, or specific URLs, not general wildcards.
+  GoogleUrl gurl(url);
+  if ((url == "*") || (gurl.IsWebValid() && (gurl.PathAndLeaf() == "/*"))) {
+    // If the url is "*", or "*" at the root of a site, we'll just purge
+    // everything.
     purge_context->SetCachePurgeGlobalTimestampMs(now_ms, callback);
   } else {
+    // Any other url ending in "*" purges every URL starting with the rest
+    // of it; see PurgeSet.
     purge_context->AddPurgeUrl(url, now_ms, callback);
   }
 }
@@ -32,6 +32,7 @@ class HTTPCache;
 class MessageHandler;
 class PropertyCache;
 class QueryParams;
+class RateControllingUrlAsyncFetcher;
 class RewriteOptions;
 class ServerContext;
 class StaticAssetManager;
@@ -83,8 +84,9 @@ class AdminSite {
                  CacheInterface* filesystem_metadata_cache,
                  HTTPCache* http_cache, CacheInterface* metadata_cache,
                  PropertyCache* page_property_cache,
-                 ServerContext* server_context, Statistics* statistics,
-                 Statistics* stats,
+                 ServerContext* server_context,
+                 RateControllingUrlAsyncFetcher* rate_controlling_fetcher,
+                 Statistics* statistics, Statistics* stats,
                  SystemRewriteOptions* global_system_rewrite_options);
 
   // Handle a request for the legacy /*_pagespeed_statistics page, which also
@@ -140,6 +142,13 @@ class AdminSite {
                    PropertyCache* page_property_cache,
                    ServerContext* server_context);
 
+  // Print the background fetches outgoing to and queued for each host in
+  // this process.  rate_controlling_fetcher is NULL if background fetches
+  // aren't rate-limited.
+  void PrintFetchQueues(
+      AdminSource source, AsyncFetch* fetch,
+      RateControllingUrlAsyncFetcher* rate_controlling_fetcher);
+
   // Print histograms showing the dynamics of server activity.
   void PrintHistograms(AdminSource source, AsyncFetch* fetch,
                        Statistics* stats);
@@ -23,8 +23,10 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <map>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "base/logging.h"
 #include "third_party/redis-crc/redis_crc.h"
@@ -86,6 +88,8 @@ static const int kRedisTTLNotSet = -1;
 
 const char kRedisClusterRedirections[] = "redis_cluster_redirections";
 const char kRedisClusterSlotsFetches[] = "redis_cluster_slots_fetches";
+const char kRedisMultiGetCommands[] = "redis_multi_get_commands";
+const char kRedisMultiGetBatches[] = "redis_multi_get_batches";
 
 RedisCache::RedisCache(StringPiece host, int port, ThreadSystem* thread_system,
                        MessageHandler* message_handler, Timer* timer,
@@ -106,6 +110,8 @@ RedisCache::RedisCache(StringPiece host, int port, ThreadSystem* thread_system,
       ttl_sec_(ttl_sec) {
   redirections_ = stats->GetVariable(kRedisClusterRedirections);
   cluster_slots_fetches_ = stats->GetVariable(kRedisClusterSlotsFetches);
+  multi_get_commands_ = stats->GetVariable(kRedisMultiGetCommands);
+  multi_get_batches_ = stats->GetVariable(kRedisMultiGetBatches);
 }
 
 GoogleString RedisCache::ServerDescription() const {
@@ -116,6 +122,8 @@ GoogleString RedisCache::ServerDescription() const {
 void RedisCache::InitStats(Statistics* stats) {
   stats->AddVariable(kRedisClusterRedirections);
   stats->AddVariable(kRedisClusterSlotsFetches);
+  stats->AddVariable(kRedisMultiGetCommands);
+  stats->AddVariable(kRedisMultiGetBatches);
 }
 
 void RedisCache::StartUp(bool connect_now) {
@@ -178,6 +186,97 @@ void RedisCache::Get(const GoogleString& key, Callback* callback) {
   ValidateAndReportResult(key, keyState, callback);
 }
 
+void RedisCache::MultiGet(MultiGetRequest* request) {
+  // Redis Cluster only accepts MGET when all of its keys hash to the same
+  // slot, so we bucket the keys by server and then by slot.  In a
+  // non-clustered setup everything goes to main_connection_ and the slots
+  // just split the batch into several MGETs in the same pipeline.
+  typedef std::map<int, std::vector<int>> SlotToKeyIndices;
+  std::map<Connection*, SlotToKeyIndices> batches;
+  const int num_keys = request->size();
+  for (int i = 0; i < num_keys; ++i) {
+    const GoogleString& key = (*request)[i].key;
+    batches[LookupConnection(key)][HashSlot(key)].push_back(i);
+  }
+
+  std::vector<KeyState> key_states(num_keys, CacheInterface::kNotFound);
+  std::vector<bool> needs_retry(num_keys, false);
+  for (auto& batch : batches) {
+    Connection* conn = batch.first;
+    if (conn == nullptr) {
+      continue;  // Not started up yet, report everything as not found.
+    }
+
+    std::vector<StringPieceVector> commands;
+    std::vector<const std::vector<int>*> command_key_indices;
+    for (const auto& slot_keys : batch.second) {
+      StringPieceVector command;
+      command.push_back("MGET");
+      for (int index : slot_keys.second) {
+        command.push_back((*request)[index].key);
+      }
+      commands.push_back(command);
+      command_key_indices.push_back(&slot_keys.second);
+    }
+    multi_get_batches_->Add(1);
+    multi_get_commands_->Add(commands.size());
+
+    ScopedMutex lock(conn->GetOperationMutex());
+    std::vector<RedisReply> replies;
+    conn->PipelinedRedisCommands(commands, &replies);
+    for (int i = 0, n = replies.size(); i < n; ++i) {
+      const RedisReply& reply = replies[i];
+      const std::vector<int>& key_indices = *command_key_indices[i];
+      if (reply && reply->type == REDIS_REPLY_ERROR) {
+        StringPiece error(reply->str, reply->len);
+        if (strings::StartsWith(error, "MOVED ") ||
+            strings::StartsWith(error, "ASK ")) {
+          // Our slot mapping is out of date for these keys.  Get() knows how
+          // to follow redirections and refresh the mapping, so let it handle
+          // them once the lock is released.
+          conn->ValidateRedisReply(reply, {REDIS_REPLY_ERROR}, "MGET");
+          for (int index : key_indices) {
+            needs_retry[index] = true;
+          }
+          continue;
+        }
+      }
+      if (!conn->ValidateRedisReply(reply, {REDIS_REPLY_ARRAY}, "MGET")) {
+        continue;
+      }
+      if (reply->elements != key_indices.size()) {
+        message_handler_->Message(
+            kError, "MGET: expected %d values from redis, got %d",
+            static_cast<int>(key_indices.size()),
+            static_cast<int>(reply->elements));
+        continue;
+      }
+      for (int j = 0, m = key_indices.size(); j < m; ++j) {
+        const redisReply* element = reply->element[j];
+        if (element->type == REDIS_REPLY_STRING) {
+          // REDIS_REPLY_NIL means 'key not found', as in Get().
+          int index = key_indices[j];
+          (*request)[index].callback->set_value(
+              SharedString(StringPiece(element->str, element->len)));
+          key_states[index] = CacheInterface::kAvailable;
+        }
+      }
+    }
+  }
+
+  // All locks are released by now, so callbacks are free to use the cache.
+  for (int i = 0; i < num_keys; ++i) {
+    KeyCallback* key_callback = &(*request)[i];
+    if (needs_retry[i]) {
+      Get(key_callback->key, key_callback->callback);
+    } else {
+      ValidateAndReportResult(key_callback->key, key_states[i],
+                              key_callback->callback);
+    }
+  }
+  delete request;
+}
+
 void RedisCache::Put(const GoogleString& key, const SharedString& value) {
   RedisReply reply;
 
@@ -712,6 +811,62 @@ RedisCache::RedisReply RedisCache::Connection::RedisCommand(const char* format,
   return reply;
 }
 
+void RedisCache::Connection::PipelinedRedisCommands(
+    const std::vector<StringPieceVector>& commands,
+    std::vector<RedisReply>* replies) {
+  replies->clear();
+  replies->resize(commands.size());
+  if (!EnsureConnectionAndDatabaseSelection()) {
+    return;
+  }
+
+  // hiredis only buffers appended commands; they are flushed to the socket
+  // by the first redisGetReply() call below.
+  bool ok = true;
+  std::vector<const char*> argv;
+  std::vector<size_t> argv_len;
+  for (const StringPieceVector& command : commands) {
+    argv.clear();
+    argv_len.clear();
+    for (StringPiece arg : command) {
+      argv.push_back(arg.data());
+      argv_len.push_back(arg.size());
+    }
+    if (redisAppendCommandArgv(redis_.get(), argv.size(), argv.data(),
+                               argv_len.data()) != REDIS_OK) {
+      ok = false;
+      break;
+    }
+  }
+
+  if (ok) {
+    for (RedisReply& reply : *replies) {
+      void* result = nullptr;
+      if (redisGetReply(redis_.get(), &result) != REDIS_OK) {
+        ok = false;
+        break;
+      }
+      reply.reset(static_cast<redisReply*>(result));
+    }
+  }
+  redis_cache_->thread_synchronizer_->Signal("RedisCommand.After.Signal");
+  redis_cache_->thread_synchronizer_->Wait("RedisCommand.After.Wait");
+
+  if (!ok) {
+    // Part of the batch may still be sitting in the context's output buffer,
+    // or its replies still be on their way, and the next command on this
+    // connection would take them for its own.  So drop the context rather
+    // than reuse it, along with any replies we got; it is re-established by
+    // the next request.
+    LogRedisContextError(redis_.get(), "Pipelined redis commands");
+    replies->clear();
+    replies->resize(commands.size());
+    ScopedMutex lock(state_mutex_.get());
+    state_ = kDisconnected;
+    redis_.reset();
+  }
+}
+
 void RedisCache::Connection::LogRedisContextError(redisContext* context,
                                                   const char* cause) {
   if (context == nullptr) {
@@ -70,6 +70,12 @@ namespace net_instaweb {
 //
 // http://redis.io/topics/cluster-spec explains this all.
 //
+// MultiGet() groups the requested keys by server and then by hash slot, and
+// sends one MGET per slot.  All the MGETs for a server are pipelined: they are
+// written out together and their replies read back afterwards, so a batch
+// costs a single network round trip per server instead of one per key.  Keys
+// that get redirected are retried one by one through Get().
+//
 // TODO(yeputons): consider extracting a common interface with AprMemCache.
 // TODO(yeputons): consider making Redis-reported errors treated as failures.
 // TODO(yeputons): add redis AUTH command support.
@@ -100,6 +106,7 @@ class RedisCache : public CacheInterface {
 
   // CacheInterface implementations.
   void Get(const GoogleString& key, Callback* callback) override;
+  void MultiGet(MultiGetRequest* request) override;
   void Put(const GoogleString& key, const SharedString& value) override;
   void Delete(const GoogleString& key) override;
 
@@ -118,6 +125,13 @@ class RedisCache : public CacheInterface {
   // redirections.
   int64 ClusterSlotsFetches() { return cluster_slots_fetches_->Get(); }
 
+  // Total number of MGET commands issued by MultiGet().
+  int64 MultiGetCommands() { return multi_get_commands_->Get(); }
+
+  // Total number of pipelined batches sent by MultiGet(); at most one per
+  // server per MultiGet() call.
+  int64 MultiGetBatches() { return multi_get_batches_->Get(); }
+
  private:
   struct RedisReplyDeleter {
     void operator()(redisReply* ptr) {
@@ -161,6 +175,17 @@ class RedisCache : public CacheInterface {
     RedisReply RedisCommand(const char* format, ...)
         EXCLUSIVE_LOCKS_REQUIRED(redis_mutex_) LOCKS_EXCLUDED(state_mutex_);
 
+    // Writes all of the commands to the server before reading any reply, and
+    // then reads the replies in order.  Each command is given as a vector of
+    // its arguments, the first one being the command name.  'replies' is
+    // resized to match 'commands'.  If any command can't be sent or any
+    // reply can't be read, the connection is dropped and all of the replies
+    // are nullptr.  Each reply must be followed by ValidateRedisReply() under
+    // the same lock.
+    void PipelinedRedisCommands(const std::vector<StringPieceVector>& commands,
+                                std::vector<RedisReply>* replies)
+        EXCLUSIVE_LOCKS_REQUIRED(redis_mutex_) LOCKS_EXCLUDED(state_mutex_);
+
     bool ValidateRedisReply(const RedisReply& reply,
                             std::initializer_list<int> valid_types,
                             const char* command_executed)
@@ -260,6 +285,8 @@ class RedisCache : public CacheInterface {
   const std::unique_ptr<ThreadSystem::RWLock> cluster_map_lock_;
   Variable* redirections_;
   Variable* cluster_slots_fetches_;
+  Variable* multi_get_commands_;
+  Variable* multi_get_batches_;
 
   // It's expected that connections are only added to the map. That way we can
   // safely use raw pointers to them during RedisCache lifetime.
@@ -46,6 +46,7 @@
 #include "pagespeed/kernel/base/pool.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/stl_util.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
@@ -104,6 +105,12 @@ const char SerfStats::kSerfFetchTimeoutCount[] = "serf_fetch_timeout_count";
 const char SerfStats::kSerfFetchFailureCount[] = "serf_fetch_failure_count";
 const char SerfStats::kSerfFetchCertErrors[] = "serf_fetch_cert_errors";
 const char SerfStats::kSerfFetchReadCalls[] = "serf_fetch_num_calls_to_read";
+const char SerfStats::kSerfFetchConnectionsCreated[] =
+    "serf_fetch_connections_created";
+const char SerfStats::kSerfFetchConnectionsReused[] =
+    "serf_fetch_connections_reused";
+const char SerfStats::kSerfFetchRequestsPipelined[] =
+    "serf_fetch_requests_pipelined";
 const char SerfStats::kSerfFetchUltimateSuccess[] =
     "serf_fetch_ultimate_success";
 const char SerfStats::kSerfFetchUltimateFailure[] =
@@ -117,6 +124,123 @@ GoogleString GetAprErrorString(apr_status_t status) {
   return error_str;
 }
 
+// A keep-alive connection to an origin, shared by the plain HTTP fetches
+// to it.  Serf queues the requests on a connection and reads their responses
+// in order, and reconnects and resends the unwritten requests if the server
+// closes the connection between responses.  The fetcher's mutex_ must be
+// held to use this.
+class SerfConnection {
+ public:
+  SerfConnection(apr_pool_t* parent_pool, MessageHandler* message_handler)
+      : message_handler_(message_handler),
+        pool_(nullptr),
+        bucket_alloc_(nullptr),
+        connection_(nullptr),
+        num_fetches_(0),
+        idle_since_ms_(0),
+        retired_(false) {
+    apr_pool_create(&pool_, parent_pool);
+    bucket_alloc_ = serf_bucket_allocator_create(pool_, nullptr, nullptr);
+  }
+
+  ~SerfConnection() {
+    Close();
+    apr_pool_destroy(pool_);
+  }
+
+  bool Open(serf_context_t* context, const apr_uri_t& url,
+            int max_pipelined_requests) {
+    apr_status_t status =
+        serf_connection_create2(&connection_, context, url, ConnectionSetup,
+                                this, ClosedConnection, this, pool_);
+    if (status != APR_SUCCESS) {
+      message_handler_->Error(url.hostinfo, 0,
+                              "Error status=%d (%s) serf_connection_create2",
+                              status, GetAprErrorString(status).c_str());
+      connection_ = nullptr;
+      return false;
+    }
+    serf_connection_set_max_outstanding_requests(connection_,
+                                                 max_pipelined_requests);
+    return true;
+  }
+
+  // Closes the connection.  Serf drops any requests still queued on it
+  // without calling their handlers.  Returns false if it was already closed.
+  bool Close() {
+    if (connection_ == nullptr) {
+      return false;
+    }
+    retired_ = true;
+    serf_connection_close(connection_);
+    connection_ = nullptr;
+    return true;
+  }
+
+  serf_connection_t* connection() const { return connection_; }
+
+  bool InErrorState() const {
+    return ((connection_ != nullptr) &&
+            serf_connection_is_in_error_state(connection_));
+  }
+
+  // Whether new requests can be sent on this connection.
+  bool usable() const {
+    return (connection_ != nullptr) && !retired_ && !InErrorState();
+  }
+
+  // Retired connections take no new requests, and are closed once the
+  // serf event loop returns.
+  bool retired() const { return retired_; }
+  void Retire() { retired_ = true; }
+
+  void AddFetch() { ++num_fetches_; }
+  void RemoveFetch(int64 now_ms) {
+    DCHECK_LT(0, num_fetches_);
+    if (--num_fetches_ == 0) {
+      idle_since_ms_ = now_ms;
+    }
+  }
+
+  // Number of fetches with requests on this connection.
+  int num_fetches() const { return num_fetches_; }
+  int64 idle_since_ms() const { return idle_since_ms_; }
+
+ private:
+  static apr_status_t ConnectionSetup(apr_socket_t* socket,
+                                      serf_bucket_t** read_bkt,
+                                      serf_bucket_t** write_bkt,
+                                      void* setup_baton, apr_pool_t* pool) {
+    SerfConnection* connection = static_cast<SerfConnection*>(setup_baton);
+    *read_bkt = serf_bucket_socket_create(socket, connection->bucket_alloc_);
+    return APR_SUCCESS;
+  }
+
+  // Serf calls this both when we close the connection and when the server
+  // does.  In the latter case serf opens a new socket for the next request,
+  // so the connection is only given up on an error.
+  static void ClosedConnection(serf_connection_t* conn, void* closed_baton,
+                               apr_status_t why, apr_pool_t* pool) {
+    SerfConnection* connection = static_cast<SerfConnection*>(closed_baton);
+    if (why != APR_SUCCESS) {
+      connection->message_handler_->Warning(
+          "serf connection", 0, "Connection close (code=%d %s).", why,
+          GetAprErrorString(why).c_str());
+      connection->Retire();
+    }
+  }
+
+  MessageHandler* message_handler_;
+  apr_pool_t* pool_;
+  serf_bucket_alloc_t* bucket_alloc_;
+  serf_connection_t* connection_;
+  int num_fetches_;
+  int64 idle_since_ms_;
+  bool retired_;
+
+  DISALLOW_COPY_AND_ASSIGN(SerfConnection);
+};
+
 SerfFetch::SerfFetch(const GoogleString& url, AsyncFetch* async_fetch,
                      MessageHandler* message_handler, Timer* timer)
     : fetcher_(nullptr),
@@ -131,6 +255,8 @@ SerfFetch::SerfFetch(const GoogleString& url, AsyncFetch* async_fetch,
       host_header_(nullptr),
       sni_host_(nullptr),
       connection_(nullptr),
+      pooled_connection_(nullptr),
+      request_finished_(false),
       bytes_received_(0),
       fetch_start_ms_(0),
       fetch_end_ms_(0),
@@ -142,6 +268,7 @@ SerfFetch::SerfFetch(const GoogleString& url, AsyncFetch* async_fetch,
 
 SerfFetch::~SerfFetch() {
   DCHECK(async_fetch_ == nullptr);
+  DCHECK(pooled_connection_ == nullptr);
   if (connection_ != nullptr) {
     serf_connection_close(connection_);
   }
@@ -172,7 +299,16 @@ GoogleString SerfFetch::DebugInfo() {
 }
 
 void SerfFetch::Cancel(CancelCause cause) {
-  if (connection_ != nullptr) {
+  if (pooled_connection_ != nullptr) {
+    // We can't take just our request off a shared connection once it has
+    // been written, so close the connection, canceling the fetches pipelined
+    // behind us too.  Those would have waited on our response anyway.  We
+    // detach from the connection first, so that our own callback runs just
+    // once, below.
+    SerfConnection* connection = pooled_connection_;
+    fetcher_->ReleaseConnection(this);
+    fetcher_->ClosePooledConnection(connection, cause);
+  } else if (connection_ != nullptr) {
     // We can get here either because we're canceling the connection ourselves
     // or because Serf detected an error.
     //
@@ -235,8 +371,12 @@ void SerfFetch::CallbackDone(SerfCompletionResult result) {
 }
 
 void SerfFetch::CleanupIfError() {
-  if ((connection_ != nullptr) &&
-      serf_connection_is_in_error_state(connection_)) {
+  bool in_error_state =
+      (pooled_connection_ != nullptr)
+          ? pooled_connection_->InErrorState()
+          : ((connection_ != nullptr) &&
+             serf_connection_is_in_error_state(connection_));
+  if (in_error_state) {
     message_handler_->Message(kInfo, "Serf cleanup for error'd fetch of: %s",
                               DebugInfo().c_str());
     Cancel(CancelCause::kSerfError);
@@ -464,6 +604,8 @@ apr_status_t SerfFetch::HandleResponse(serf_bucket_t* response) {
     message_handler_->Message(
         kInfo, "serf HandleResponse called with NULL response for %s",
         DebugInfo().c_str());
+    // Serf has already dropped the request.
+    request_finished_ = true;
     CallCallback(SerfCompletionResult::kFailure);
     return APR_EGENERAL;
   }
@@ -512,6 +654,9 @@ apr_status_t SerfFetch::HandleResponse(serf_bucket_t* response) {
     }
     bool successful_completion =
         APR_STATUS_IS_EOF(status) && parser_.headers_complete();
+    // On EOF serf takes the request off the connection, leaving it ready for
+    // the next response; on an error the connection must not be reused.
+    request_finished_ = APR_STATUS_IS_EOF(status);
     // Zeros async_fetch_.
     CallCallback(successful_completion ? SerfCompletionResult::kSuccess
                                        : SerfCompletionResult::kFailure);
@@ -992,20 +1137,33 @@ bool SerfFetch::Start(SerfUrlAsyncFetcher* fetcher,
   using_https_ = StringCaseEqual("https", url_.scheme);
   DCHECK(fetcher->allow_https() || !using_https_);
 
-  apr_status_t status =
-      serf_connection_create2(&connection_, serf_context, url_, ConnectionSetup,
-                              this, ClosedConnection, this, pool_);
-  if (status != APR_SUCCESS) {
-    message_handler_->Error(DebugInfo().c_str(), 0,
-                            "Error status=%d (%s) serf_connection_create2",
-                            status, GetAprErrorString(status).c_str());
-    return false;
+  // HTTPS connections carry certificate-validation callbacks bound to the
+  // fetch that opened them, and an SNI host taken from that fetch's Host
+  // header, so they aren't pooled.
+  serf_connection_t* connection;
+  if (!using_https_ && (fetcher_->max_connections_per_host() > 0)) {
+    pooled_connection_ = fetcher_->AcquireConnection(url_, message_handler_);
+    if (pooled_connection_ == nullptr) {
+      return false;
+    }
+    connection = pooled_connection_->connection();
+  } else {
+    apr_status_t status = serf_connection_create2(
+        &connection_, serf_context, url_, ConnectionSetup, this,
+        ClosedConnection, this, pool_);
+    if (status != APR_SUCCESS) {
+      message_handler_->Error(DebugInfo().c_str(), 0,
+                              "Error status=%d (%s) serf_connection_create2",
+                              status, GetAprErrorString(status).c_str());
+      return false;
+    }
+    connection = connection_;
   }
-  serf_connection_request_create(connection_, SetupRequest, this);
+  serf_connection_request_create(connection, SetupRequest, this);
 
   // Start the fetch. It will connect to the remote host, send the request,
   // and accept the response, without blocking.
-  status =
+  apr_status_t status =
       serf_context_run(serf_context, SERF_DURATION_NOBLOCK, fetcher_->pool());
 
   if (status == APR_SUCCESS || APR_STATUS_IS_TIMEUP(status)) {
@@ -1075,6 +1233,9 @@ SerfUrlAsyncFetcher::SerfUrlAsyncFetcher(const char* proxy, apr_pool_t* pool,
       failure_count_(nullptr),
       cert_errors_(nullptr),
       read_calls_count_(nullptr),
+      connections_created_(nullptr),
+      connections_reused_(nullptr),
+      requests_pipelined_(nullptr),
       ultimate_success_(nullptr),
       ultimate_failure_(nullptr),
       last_check_timestamp_ms_(nullptr),
@@ -1083,6 +1244,8 @@ SerfUrlAsyncFetcher::SerfUrlAsyncFetcher(const char* proxy, apr_pool_t* pool,
       list_outstanding_urls_on_error_(false),
       track_original_content_length_(false),
       https_options_(0),
+      max_connections_per_host_(kDefaultMaxConnectionsPerHost),
+      max_pipelined_requests_(kDefaultMaxPipelinedRequests),
       message_handler_(message_handler) {
   CHECK(statistics != nullptr);
   request_count_ = statistics->GetVariable(SerfStats::kSerfFetchRequestCount);
@@ -1097,6 +1260,12 @@ SerfUrlAsyncFetcher::SerfUrlAsyncFetcher(const char* proxy, apr_pool_t* pool,
   cert_errors_ = statistics->GetVariable(SerfStats::kSerfFetchCertErrors);
   // Using FindVariable for this one since it's only set in debug builds.
   read_calls_count_ = statistics->FindVariable(SerfStats::kSerfFetchReadCalls);
+  connections_created_ =
+      statistics->GetVariable(SerfStats::kSerfFetchConnectionsCreated);
+  connections_reused_ =
+      statistics->GetVariable(SerfStats::kSerfFetchConnectionsReused);
+  requests_pipelined_ =
+      statistics->GetVariable(SerfStats::kSerfFetchRequestsPipelined);
   ultimate_success_ =
       statistics->GetVariable(SerfStats::kSerfFetchUltimateSuccess);
   ultimate_failure_ =
@@ -1124,6 +1293,9 @@ SerfUrlAsyncFetcher::SerfUrlAsyncFetcher(SerfUrlAsyncFetcher* parent,
       failure_count_(parent->failure_count_),
       cert_errors_(parent->cert_errors_),
       read_calls_count_(parent->read_calls_count_),
+      connections_created_(parent->connections_created_),
+      connections_reused_(parent->connections_reused_),
+      requests_pipelined_(parent->requests_pipelined_),
       ultimate_success_(parent->ultimate_success_),
       ultimate_failure_(parent->ultimate_failure_),
       last_check_timestamp_ms_(parent->last_check_timestamp_ms_),
@@ -1132,6 +1304,8 @@ SerfUrlAsyncFetcher::SerfUrlAsyncFetcher(SerfUrlAsyncFetcher* parent,
       list_outstanding_urls_on_error_(parent->list_outstanding_urls_on_error_),
       track_original_content_length_(parent->track_original_content_length_),
       https_options_(parent->https_options_),
+      max_connections_per_host_(parent->max_connections_per_host_),
+      max_pipelined_requests_(parent->max_pipelined_requests_),
       message_handler_(parent->message_handler_) {
   Init(parent->pool(), proxy);
 }
@@ -1156,6 +1330,10 @@ SerfUrlAsyncFetcher::~SerfUrlAsyncFetcher() {
   if (threaded_fetcher_ != nullptr) {
     delete threaded_fetcher_;
   }
+  {
+    ScopedMutex lock(mutex_);
+    DeleteAllConnections();
+  }
   delete mutex_;
   apr_pool_destroy(pool_);  // also calls apr_allocator_destroy on the allocator
 }
@@ -1190,8 +1368,10 @@ void SerfUrlAsyncFetcher::CancelActiveFetches() {
 }
 
 void SerfUrlAsyncFetcher::CancelActiveFetchesMutexHeld() {
-  // If there are still active requests, cancel them.
-  int num_canceled = 0;
+  // If there are still active requests, cancel them.  Canceling a fetch on
+  // a pooled connection also fails those queued behind it, so count them up
+  // front.
+  int num_canceled = active_fetches_.size();
   while (!active_fetches_.empty()) {
     // Canceling a fetch requires that the fetch reside in active_fetches_,
     // but can invalidate iterators pointing to the affected fetch.  To avoid
@@ -1199,7 +1379,6 @@ void SerfUrlAsyncFetcher::CancelActiveFetchesMutexHeld() {
     SerfFetch* fetch = active_fetches_.oldest();
     LOG(WARNING) << "Aborting fetch of " << fetch->DebugInfo();
     fetch->Cancel(SerfFetch::CancelCause::kClientDecision);
-    ++num_canceled;
   }
 
   if (num_canceled != 0) {
@@ -1218,10 +1397,19 @@ bool SerfUrlAsyncFetcher::StartFetch(SerfFetch* fetch) {
                                       fetch->DebugInfo().c_str());
     active_fetches_.Remove(fetch);
     active_count_->Add(-1);
+    SerfConnection* connection = fetch->pooled_connection();
+    if (connection != nullptr) {
+      // Our request may still be queued on the connection.
+      ReleaseConnection(fetch);
+      ClosePooledConnection(connection, SerfCancelCause::kSerfError);
+    }
     fetch->CallbackDone(shutdown_ ? SerfCompletionResult::kClientCancel
                                   : SerfCompletionResult::kFailure);
     delete fetch;
   }
+  // Starting the fetch ran the serf event loop, which may have left
+  // connections to be closed before it runs again.
+  CloseRetiredConnections();
   return started;
 }
 
@@ -1255,6 +1443,9 @@ int SerfUrlAsyncFetcher::Poll(int64 max_wait_ms) {
   if (!active_fetches_.empty()) {
     apr_status_t status =
         serf_context_run(serf_context_, 1000 * max_wait_ms, pool_);
+    // Close the connections left mid-response before deleting the fetches
+    // whose requests are still queued on them.
+    CloseRetiredConnections();
     completed_fetches_.DeleteAll();
     if (APR_STATUS_IS_TIMEUP(status)) {
       // Remove expired fetches from the front of the queue.
@@ -1336,10 +1527,142 @@ void SerfUrlAsyncFetcher::FetchComplete(SerfFetch* fetch)
   // poked via Poll or CancelActiveFetches, both of which do lock mutex_.
   // Note that SerfFetch::Cancel is currently not exposed from outside this
   // class.
+  ReleaseConnection(fetch);
   active_fetches_.Remove(fetch);
   completed_fetches_.Add(fetch);
 }
 
+SerfConnection* SerfUrlAsyncFetcher::AcquireConnection(
+    const apr_uri_t& url, MessageHandler* message_handler)
+    NO_THREAD_SAFETY_ANALYSIS {
+  // As with FetchComplete, this is called through SerfFetch, from Start,
+  // with mutex_ held.
+  GoogleString key = StrCat(url.scheme, "://", url.hostname, ":",
+                            IntegerToString(url.port));
+  ConnectionVector& connections = connections_[key];
+  int64 now_ms = timer_->NowMs();
+
+  // Drop the connections that can no longer be used, and find the most
+  // recently used idle connection and the least busy one.
+  SerfConnection* idle = nullptr;
+  SerfConnection* least_busy = nullptr;
+  for (int i = connections.size() - 1; i >= 0; --i) {
+    SerfConnection* connection = connections[i];
+    if (connection->num_fetches() == 0 &&
+        (!connection->usable() ||
+         (now_ms - connection->idle_since_ms() > kIdleConnectionTimeoutMs))) {
+      delete connection;
+      connections.erase(connections.begin() + i);
+    } else if (!connection->usable()) {
+      continue;
+    } else if (connection->num_fetches() == 0) {
+      if ((idle == nullptr) ||
+          (connection->idle_since_ms() > idle->idle_since_ms())) {
+        idle = connection;
+      }
+    } else if ((least_busy == nullptr) ||
+               (connection->num_fetches() < least_busy->num_fetches())) {
+      least_busy = connection;
+    }
+  }
+
+  SerfConnection* connection = idle;
+  if ((connection == nullptr) &&
+      ((static_cast<int>(connections.size()) < max_connections_per_host_) ||
+       (least_busy == nullptr))) {
+    // Note that if every open connection has been retired, we go over the
+    // limit until they drain rather than fail the fetch.
+    connection = new SerfConnection(pool_, message_handler);
+    if (!connection->Open(serf_context_, url, max_pipelined_requests_)) {
+      delete connection;
+      if (connections.empty()) {
+        connections_.erase(key);
+      }
+      return nullptr;
+    }
+    connections.push_back(connection);
+    connections_created_->Add(1);
+  } else {
+    if (connection == nullptr) {
+      connection = least_busy;
+      requests_pipelined_->Add(1);
+    }
+    connections_reused_->Add(1);
+  }
+  connection->AddFetch();
+  return connection;
+}
+
+void SerfUrlAsyncFetcher::ReleaseConnection(SerfFetch* fetch)
+    NO_THREAD_SAFETY_ANALYSIS {
+  SerfConnection* connection = fetch->pooled_connection();
+  if (connection != nullptr) {
+    fetch->clear_pooled_connection();
+    connection->RemoveFetch(timer_->NowMs());
+    if (!fetch->request_finished()) {
+      // The response was abandoned part way, so what serf reads next from
+      // this connection isn't the start of a response.  We may be inside the
+      // serf event loop here, so leave closing it to CloseRetiredConnections.
+      connection->Retire();
+    }
+  }
+}
+
+void SerfUrlAsyncFetcher::ClosePooledConnection(SerfConnection* connection,
+                                                SerfCancelCause cause)
+    NO_THREAD_SAFETY_ANALYSIS {
+  if (!connection->Close()) {
+    return;
+  }
+  // Serf dropped the requests queued on the connection without calling back,
+  // so cancel their fetches here, for the same reason the connection was
+  // closed: a shutdown must not count them as failures.  Canceling a fetch
+  // removes it from active_fetches_, so work from a copy.
+  std::vector<SerfFetch*> fetches;
+  for (SerfFetchPool::iterator i = active_fetches_.begin();
+       i != active_fetches_.end(); ++i) {
+    if ((*i)->pooled_connection() == connection) {
+      fetches.push_back(*i);
+    }
+  }
+  for (int i = 0, n = fetches.size(); i < n; ++i) {
+    fetches[i]->Cancel(cause);
+  }
+}
+
+void SerfUrlAsyncFetcher::CloseRetiredConnections() {
+  int64 now_ms = timer_->NowMs();
+  for (ConnectionMap::iterator p = connections_.begin();
+       p != connections_.end();) {
+    ConnectionVector& connections = p->second;
+    for (int i = connections.size() - 1; i >= 0; --i) {
+      SerfConnection* connection = connections[i];
+      if (connection->retired()) {
+        ClosePooledConnection(connection, SerfCancelCause::kSerfError);
+      }
+      if ((connection->num_fetches() == 0) &&
+          ((connection->connection() == nullptr) ||
+           (now_ms - connection->idle_since_ms() > kIdleConnectionTimeoutMs))) {
+        delete connection;
+        connections.erase(connections.begin() + i);
+      }
+    }
+    if (connections.empty()) {
+      connections_.erase(p++);
+    } else {
+      ++p;
+    }
+  }
+}
+
+void SerfUrlAsyncFetcher::DeleteAllConnections() {
+  for (ConnectionMap::iterator p = connections_.begin();
+       p != connections_.end(); ++p) {
+    STLDeleteElements(&p->second);
+  }
+  connections_.clear();
+}
+
 void SerfUrlAsyncFetcher::ReportCompletedFetchStats(const SerfFetch* fetch) {
   if (time_duration_ms_) {
     time_duration_ms_->Add(fetch->TimeDuration());
@@ -1470,6 +1793,9 @@ void SerfUrlAsyncFetcher::InitStats(Statistics* statistics) {
 #ifndef NDEBUG
   statistics->AddVariable(SerfStats::kSerfFetchReadCalls);
 #endif
+  statistics->AddVariable(SerfStats::kSerfFetchConnectionsCreated);
+  statistics->AddVariable(SerfStats::kSerfFetchConnectionsReused);
+  statistics->AddVariable(SerfStats::kSerfFetchRequestsPipelined);
   statistics->AddVariable(SerfStats::kSerfFetchUltimateSuccess);
   statistics->AddVariable(SerfStats::kSerfFetchUltimateFailure);
   statistics->AddUpDownCounter(SerfStats::kSerfFetchLastCheckTimestampMs);
@@ -1489,6 +1815,20 @@ void SerfUrlAsyncFetcher::set_track_original_content_length(bool x) {
   }
 }
 
+void SerfUrlAsyncFetcher::set_max_connections_per_host(int x) {
+  max_connections_per_host_ = x;
+  if (threaded_fetcher_ != nullptr) {
+    threaded_fetcher_->set_max_connections_per_host(x);
+  }
+}
+
+void SerfUrlAsyncFetcher::set_max_pipelined_requests(int x) {
+  max_pipelined_requests_ = x;
+  if (threaded_fetcher_ != nullptr) {
+    threaded_fetcher_->set_max_pipelined_requests(x);
+  }
+}
+
 bool SerfUrlAsyncFetcher::ParseHttpsOptions(StringPiece directive,
                                             uint32* options,
                                             GoogleString* error_message) {
@@ -21,6 +21,7 @@
 #define PAGESPEED_SYSTEM_SERF_URL_ASYNC_FETCHER_H_
 
 #include <cstddef>
+#include <map>
 #include <vector>
 
 #include "apr_network_io.h"
@@ -59,6 +60,7 @@ namespace net_instaweb {
 class AsyncFetch;
 class MessageHandler;
 class Statistics;
+class SerfConnection;
 class SerfFetch;
 class SerfThreadedFetcher;
 class Timer;
@@ -76,6 +78,14 @@ struct SerfStats {
   static const char kSerfFetchCertErrors[];
   static const char kSerfFetchReadCalls[];
 
+  // Connections opened to origins, and requests that were sent on an
+  // already-open keep-alive connection instead.  The reuse rate is
+  // reused / (created + reused).  Pipelined counts the reused requests that
+  // were queued behind another request still in flight on their connection.
+  static const char kSerfFetchConnectionsCreated[];
+  static const char kSerfFetchConnectionsReused[];
+  static const char kSerfFetchRequestsPipelined[];
+
   // A fetch that finished with a 2xx or a 3xx code --- and not just a
   // mechanically successful one that's a 4xx or such.
   static const char kSerfFetchUltimateSuccess[];
@@ -91,6 +101,9 @@ struct SerfStats {
 
 enum class SerfCompletionResult { kClientCancel, kSuccess, kFailure };
 
+// Why a fetch was canceled; see SerfFetch::Cancel.
+enum class SerfCancelCause { kClientDecision, kSerfError, kFetchTimeout };
+
 // Identifies the set of HTML keywords.  This is used in error messages emitted
 // both from the config parser in this module, and in the directives table in
 // mod_instaweb.cc which must be statically constructed using a compile-time
@@ -109,6 +122,16 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
  public:
   enum WaitChoice { kThreadedOnly, kMainlineOnly, kThreadedAndMainline };
 
+  // Limits on the keep-alive connections kept to each origin; see
+  // set_max_connections_per_host() and set_max_pipelined_requests().
+  static const int kDefaultMaxConnectionsPerHost = 8;
+  static const int kDefaultMaxPipelinedRequests = 4;
+
+  // How long an idle connection is kept for reuse.  This is below the
+  // 5 second keep-alive timeout Apache and nginx default to, so that we
+  // don't often send a request just as the server closes the connection.
+  static const int64 kIdleConnectionTimeoutMs = 4000;
+
   SerfUrlAsyncFetcher(const char* proxy, apr_pool_t* pool,
                       ThreadSystem* thread_system, Statistics* statistics,
                       Timer* timer, int64 timeout_ms, MessageHandler* handler);
@@ -161,6 +184,18 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
   }
   void set_track_original_content_length(bool x);
 
+  // Plain HTTP fetches to the same origin share a pool of keep-alive
+  // connections.  A fetch takes an idle connection if there is one, or opens
+  // a new one if fewer than max_connections_per_host are open to the origin.
+  // Otherwise its request is pipelined on the least busy connection, which
+  // has at most max_pipelined_requests written ahead of their responses; any
+  // more wait in that connection's queue.  A max_connections_per_host of 0
+  // disables pooling, giving each fetch its own connection.
+  int max_connections_per_host() const { return max_connections_per_host_; }
+  void set_max_connections_per_host(int x);
+  int max_pipelined_requests() const { return max_pipelined_requests_; }
+  void set_max_pipelined_requests(int x);
+
   // Indicates that direct HTTPS fetching should be allowed, and how picky
   // to be about certificates.  The directive is a comma separated list of
   // these keywords:
@@ -229,6 +264,29 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
   // Must be called only immediately after running the serf event loop.
   void CleanupFetchesWithErrors() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Returns a pooled connection to url's origin for a fetch to send its
+  // request on, or NULL if a new connection could not be created.  Like
+  // the two methods below, this must be called with mutex_ held.
+  SerfConnection* AcquireConnection(const apr_uri_t& url,
+                                    MessageHandler* message_handler);
+
+  // Called when fetch completes, to return its pooled connection (if any).
+  // If the fetch's response was not read to the end, the connection can't
+  // be reused; it is closed by CloseRetiredConnections.
+  void ReleaseConnection(SerfFetch* fetch);
+
+  // Closes connection, canceling the fetches whose requests are queued on it
+  // for cause.  A fetch canceling itself must detach with ReleaseConnection
+  // first, so that it is not canceled here as well.  Must not be called from
+  // within the serf event loop.
+  void ClosePooledConnection(SerfConnection* connection,
+                             SerfCancelCause cause);
+
+  // Closes the connections retired while running the serf event loop, and
+  // deletes those that are closed or have been idle for too long.
+  void CloseRetiredConnections() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void DeleteAllConnections() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   bool shutdown() const EXCLUSIVE_LOCKS_REQUIRED(mutex_) { return shutdown_; }
   void set_shutdown(bool s) EXCLUSIVE_LOCKS_REQUIRED(mutex_) { shutdown_ = s; }
 
@@ -266,6 +324,11 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
   serf_context_t* serf_context_ GUARDED_BY(mutex_);
   SerfFetchPool active_fetches_ GUARDED_BY(mutex_);
 
+  // Pooled connections, keyed by scheme://host:port.
+  typedef std::vector<SerfConnection*> ConnectionVector;
+  typedef std::map<GoogleString, ConnectionVector> ConnectionMap;
+  ConnectionMap connections_ GUARDED_BY(mutex_);
+
   Variable* request_count_;
   Variable* byte_count_;
   Variable* time_duration_ms_;
@@ -274,6 +337,9 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
   Variable* failure_count_;
   Variable* cert_errors_;
   Variable* read_calls_count_;  // Non-NULL only on debug builds.
+  Variable* connections_created_;
+  Variable* connections_reused_;
+  Variable* requests_pipelined_;
   Variable* ultimate_success_;
   Variable* ultimate_failure_;
   UpDownCounter* last_check_timestamp_ms_;
@@ -282,6 +348,8 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
   bool list_outstanding_urls_on_error_;
   bool track_original_content_length_;
   uint32 https_options_;  // Composed of HttpsOptions ORed together.
+  int max_connections_per_host_;
+  int max_pipelined_requests_;
   MessageHandler* message_handler_;
   GoogleString ssl_certificates_dir_;
   GoogleString ssl_certificates_file_;
@@ -292,11 +360,7 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
 // TODO(lsong): Move this to a separate file. Necessary?
 class SerfFetch : public PoolElement<SerfFetch> {
  public:
-  enum class CancelCause {
-    kClientDecision,
-    kSerfError,
-    kFetchTimeout,
-  };
+  typedef SerfCancelCause CancelCause;
 
   // TODO(lsong): make use of request_headers.
   SerfFetch(const GoogleString& url, AsyncFetch* async_fetch,
@@ -341,6 +405,15 @@ class SerfFetch : public PoolElement<SerfFetch> {
   size_t bytes_received() const { return bytes_received_; }
   MessageHandler* message_handler() { return message_handler_; }
 
+  // The pooled connection this fetch's request was sent on, or NULL if the
+  // fetch has its own connection or has completed.
+  SerfConnection* pooled_connection() const { return pooled_connection_; }
+  void clear_pooled_connection() { pooled_connection_ = nullptr; }
+
+  // Whether serf is finished with this fetch's request, so that the
+  // connection it was sent on is ready for the next response.
+  bool request_finished() const { return request_finished_; }
+
  private:
   // Static functions used in callbacks.
 
@@ -430,7 +503,9 @@ class SerfFetch : public PoolElement<SerfFetch> {
   apr_uri_t url_;
   const char* host_header_;  // in pool_
   const char* sni_host_;     // in pool_
-  serf_connection_t* connection_;
+  serf_connection_t* connection_;  // NULL when using pooled_connection_.
+  SerfConnection* pooled_connection_;
+  bool request_finished_;
   size_t bytes_received_;
   int64 fetch_start_ms_;
   int64 fetch_end_ms_;
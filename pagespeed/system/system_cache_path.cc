@@ -30,12 +30,15 @@
 #include "pagespeed/kernel/base/callback.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/cache/cache_stats.h"
 #include "pagespeed/kernel/cache/file_cache.h"
 #include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/cache/lru_cache_snapshot.h"
 #include "pagespeed/kernel/cache/purge_context.h"
 #include "pagespeed/kernel/cache/purge_set.h"
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
 #include "pagespeed/kernel/cache/threadsafe_cache.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_lock_manager.h"
 #include "pagespeed/kernel/util/file_system_lock_manager.h"
@@ -47,6 +50,15 @@ namespace net_instaweb {
 const char SystemCachePath::kFileCache[] = "file_cache";
 const char SystemCachePath::kLruCache[] = "lru_cache";
 
+namespace {
+
+// Key under which the per-process LRU cache is snapshotted in the file cache.
+// Every process sharing the path writes here; whichever wrote last warms up
+// the next generation.
+const char kLruCacheSnapshotKey[] = "lru_cache/snapshot";
+
+}  // namespace
+
 // The SystemCachePath encapsulates a cache-sharing model where a user specifies
 // a file-cache path per virtual-host.  With each file-cache object we keep
 // a locking mechanism and an optional per-process LRUCache.
@@ -124,16 +136,41 @@ SystemCachePath::SystemCachePath(const StringPiece& path,
   factory->TakeOwnership(file_cache_);
 
   if (config->lru_cache_kb_per_process() != 0) {
-    LRUCache* lru_cache =
-        new LRUCache(config->lru_cache_kb_per_process() * 1024);
-    factory->TakeOwnership(lru_cache);
+    // Snapshots go to the file cache, so there's nowhere to put them if we're
+    // unplugged.
+    int64 snapshot_interval_ms =
+        config->lru_cache_snapshot_interval_sec() * Timer::kSecondMs;
+    bool snapshot = !unplugged_ && (snapshot_interval_ms > 0);
+    CacheInterface* ts_cache;
+    if (config->lru_cache_shards() > 1) {
+      // The sharded cache does its own locking, one mutex per shard.
+      ShardedLRUCache* sharded_cache =
+          new ShardedLRUCache(config->lru_cache_kb_per_process() * 1024,
+                              config->lru_cache_shards(),
+                              factory->thread_system());
+      if (snapshot) {
+        sharded_cache->set_snapshotter(new LRUCacheSnapshotter(
+            file_cache_backend_, kLruCacheSnapshotKey, snapshot_interval_ms,
+            factory->timer()));
+      }
+      ts_cache = sharded_cache;
+    } else {
+      LRUCache* lru_cache =
+          new LRUCache(config->lru_cache_kb_per_process() * 1024);
+      factory->TakeOwnership(lru_cache);
+      if (snapshot) {
+        lru_cache->set_snapshotter(new LRUCacheSnapshotter(
+            file_cache_backend_, kLruCacheSnapshotKey, snapshot_interval_ms,
+            factory->timer()));
+      }
 
-    // We only add the threadsafe-wrapper to the LRUCache.  The FileCache
-    // is naturally thread-safe because it's got no writable member variables.
-    // And surrounding that slower-running class with a mutex would likely
-    // cause contention.
-    ThreadsafeCache* ts_cache =
-        new ThreadsafeCache(lru_cache, factory->thread_system()->NewMutex());
+      // We only add the threadsafe-wrapper to the LRUCache.  The FileCache
+      // is naturally thread-safe because it's got no writable member
+      // variables.  And surrounding that slower-running class with a mutex
+      // would likely cause contention.
+      ts_cache =
+          new ThreadsafeCache(lru_cache, factory->thread_system()->NewMutex());
+    }
     factory->TakeOwnership(ts_cache);
     lru_cache_ = new CacheStats(kLruCache, ts_cache, factory->timer(),
                                 factory->statistics());
@@ -232,6 +269,7 @@ void SystemCachePath::ChildInit(SlowWorker* cache_clean_worker) {
       lock_manager_, factory_->scheduler(), factory_->statistics(),
       factory_->message_handler());
   purge_context_->set_enable_purge(enable_cache_purge_);
+  purge_context_->set_enable_journal(true);
   purge_context_->SetUpdateCallback(
       NewPermanentCallback(this, &SystemCachePath::UpdateCachePurgeSet));
 }
@@ -504,6 +504,10 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
     http_cache->set_cache_levels(2);
     http_cache->SetCompressionLevel(config->http_cache_compression_level());
   }
+  http_cache->SetBrotliQuality(config->http_cache_brotli_quality());
+  // Memcached and Redis lookups are slow enough that a popular resource
+  // expiring can send many identical lookups to them at once.
+  http_cache->EnableLookupCoalescing(factory_->thread_system());
 
   http_cache->set_max_cacheable_response_content_length(max_content_length);
   server_context->set_http_cache(http_cache);
@@ -588,9 +592,23 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
     property_store_cache = metadata_l2;
   }
   if (config->compress_metadata_cache()) {
-    metadata_cache = new CompressedCache(metadata_cache, stats);
+    CompressedCache::Codec codec = CompressedCache::kDeflate;
+    if (!CompressedCache::ParseCodec(config->metadata_cache_codec(), &codec)) {
+      factory_->message_handler()->Message(
+          kWarning, "Unknown %s \"%s\", using deflate",
+          SystemRewriteOptions::kMetadataCacheCodec,
+          config->metadata_cache_codec().c_str());
+    }
+    int level = config->metadata_cache_compression_level();
+    CompressedCache* compressed_metadata_cache =
+        new CompressedCache(metadata_cache, stats);
+    compressed_metadata_cache->SetCodec(codec, level);
+    metadata_cache = compressed_metadata_cache;
     server_context->DeleteCacheOnDestruction(metadata_cache);
-    property_store_cache = new CompressedCache(property_store_cache, stats);
+    CompressedCache* compressed_property_store_cache =
+        new CompressedCache(property_store_cache, stats);
+    compressed_property_store_cache->SetCodec(codec, level);
+    property_store_cache = compressed_property_store_cache;
     server_context->DeleteCacheOnDestruction(property_store_cache);
   }
   DCHECK(property_store_cache->IsBlocking());
@@ -737,6 +755,17 @@ void SystemCaches::StopCacheActivity() {
     cache.async->ShutDown();
   }
 
+  // Shutting down the per-process LRU caches has them write out their final
+  // snapshots, if snapshotting is on, while the file cache is still usable.
+  for (PathCacheMap::iterator p = path_cache_map_.begin(),
+                              e = path_cache_map_.end();
+       p != e; ++p) {
+    CacheInterface* lru_cache = p->second->lru_cache();
+    if (lru_cache != nullptr) {
+      lru_cache->ShutDown();
+    }
+  }
+
   // TODO(morlovich): Also shutdown shm caches
 }
 
@@ -59,6 +59,7 @@
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/base/xxh3_hasher.h"
 #include "pagespeed/kernel/sharedmem/shared_circular_buffer.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_statistics.h"
 #include "pagespeed/kernel/thread/pthread_shared_mem.h"
@@ -87,6 +88,8 @@ const char kUsePerVHostStatistics[] = "UsePerVHostStatistics";
 const char kInstallCrashHandler[] = "InstallCrashHandler";
 const char kNumRewriteThreads[] = "NumRewriteThreads";
 const char kNumExpensiveRewriteThreads[] = "NumExpensiveRewriteThreads";
+const char kWorkStealingThreadPools[] = "WorkStealingThreadPools";
+const char kContentHasher[] = "ContentHasher";
 const char kForceCaching[] = "ForceCaching";
 const char kListOutstandingUrlsOnError[] = "ListOutstandingUrlsOnError";
 const char kMessageBufferSize[] = "MessageBufferSize";
@@ -107,6 +110,8 @@ SystemRewriteDriverFactory::SystemRewriteDriverFactory(
       message_buffer_size_(0),
       track_original_content_length_(false),
       list_outstanding_urls_on_error_(false),
+      content_hasher_(kMD5ContentHasher),
+      hasher_created_(false),
       static_asset_prefix_("/pagespeed_static/"),
       system_thread_system_(thread_system),
       use_per_vhost_statistics_(true),
@@ -379,7 +384,8 @@ SystemRewriteDriverFactory::GetCentralController(
         conf->controller_port(),
         conf->popularity_contest_max_queue_size() +
             conf->popularity_contest_max_inflight_requests(),
-        thread_system(), timer(), statistics(), message_handler());
+        conf->controller_idle_image_tokens(), thread_system(), timer(),
+        statistics(), message_handler());
   }
   return central_controller_;
 }
@@ -411,7 +417,9 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
       StringCaseEqual(option, kUsePerVHostStatistics) ||
       StringCaseEqual(option, kInstallCrashHandler) ||
       StringCaseEqual(option, kNumRewriteThreads) ||
-      StringCaseEqual(option, kNumExpensiveRewriteThreads)) {
+      StringCaseEqual(option, kNumExpensiveRewriteThreads) ||
+      StringCaseEqual(option, kWorkStealingThreadPools) ||
+      StringCaseEqual(option, kContentHasher)) {
     if (!process_scope) {
       *msg = StrCat("'", option, "' is global and can't be set at this scope.");
       return RewriteOptions::kOptionValueInvalid;
@@ -438,6 +446,26 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
     return RewriteOptions::kOptionOk;
   }
 
+  if (StringCaseEqual(option, kContentHasher)) {
+    ContentHasher content_hasher;
+    if (StringCaseEqual(arg, "md5")) {
+      content_hasher = kMD5ContentHasher;
+    } else if (StringCaseEqual(arg, "xxh3")) {
+      content_hasher = kXXH3ContentHasher;
+    } else {
+      *msg = "must be md5 or xxh3";
+      return RewriteOptions::kOptionValueInvalid;
+    }
+    // Shared memory caches hold on to the hasher from when they're created.
+    if (hasher_created_ && (content_hasher != content_hasher_)) {
+      *msg = StrCat("'", option,
+                    "' must be set before any shared memory cache is created.");
+      return RewriteOptions::kOptionValueInvalid;
+    }
+    set_content_hasher(content_hasher);
+    return RewriteOptions::kOptionOk;
+  }
+
   // Most of our options take booleans, so just parse once.
   bool is_on = false;
   RewriteOptions::OptionSettingResult parsed_as_bool =
@@ -459,6 +487,9 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
   } else if (StringCaseEqual(option, kTrackOriginalContentLength)) {
     set_track_original_content_length(is_on);
     return parsed_as_bool;
+  } else if (StringCaseEqual(option, kWorkStealingThreadPools)) {
+    set_use_work_stealing_worker_pools(is_on);
+    return parsed_as_bool;
   }
 
   // Others take an integer >= 0.
@@ -571,6 +602,7 @@ void SystemRewriteDriverFactory::ShutDown() {
     defer_cleanup(new Deleter<UrlAsyncFetcher>(fetcher));
   }
   fetcher_map_.clear();
+  rate_controlling_fetcher_map_.clear();
   ShutDownFetchers();
 
   RewriteDriverFactory::ShutDown();
@@ -665,9 +697,12 @@ UrlAsyncFetcher* SystemRewriteDriverFactory::GetFetcher(
         // Unfortunately, we need stats for load-shedding.
         if (config->statistics_enabled()) {
           TakeOwnership(fetcher);
-          fetcher = new RateControllingUrlAsyncFetcher(
-              fetcher, max_queue_size(), requests_per_host(), queued_per_host(),
-              thread_system(), statistics());
+          RateControllingUrlAsyncFetcher* rate_controlling_fetcher =
+              new RateControllingUrlAsyncFetcher(
+                  fetcher, max_queue_size(), requests_per_host(),
+                  queued_per_host(), thread_system(), timer(), statistics());
+          rate_controlling_fetcher_map_[key] = rate_controlling_fetcher;
+          fetcher = rate_controlling_fetcher;
         } else {
           message_handler()->Message(
               kError, "Can't enable fetch rate-limiting without statistics");
@@ -679,6 +714,15 @@ UrlAsyncFetcher* SystemRewriteDriverFactory::GetFetcher(
   return iter->second;
 }
 
+RateControllingUrlAsyncFetcher*
+SystemRewriteDriverFactory::GetRateControllingFetcher(
+    SystemRewriteOptions* config) {
+  std::map<GoogleString, RateControllingUrlAsyncFetcher*>::iterator iter =
+      rate_controlling_fetcher_map_.find(GetFetcherKey(true, config));
+  return (iter == rate_controlling_fetcher_map_.end()) ? nullptr
+                                                       : iter->second;
+}
+
 UrlAsyncFetcher* SystemRewriteDriverFactory::AllocateFetcher(
     SystemRewriteOptions* config) {
   SerfUrlAsyncFetcher* serf = new SerfUrlAsyncFetcher(
@@ -716,7 +760,13 @@ FileSystem* SystemRewriteDriverFactory::DefaultFileSystem() {
   return new StdioFileSystem();
 }
 
-Hasher* SystemRewriteDriverFactory::NewHasher() { return new MD5Hasher(); }
+Hasher* SystemRewriteDriverFactory::NewHasher() {
+  hasher_created_ = true;
+  if (content_hasher_ == kXXH3ContentHasher) {
+    return new XXH3Hasher();
+  }
+  return new MD5Hasher();
+}
 
 Timer* SystemRewriteDriverFactory::DefaultTimer() { return new PosixTimer(); }
 
@@ -45,6 +45,7 @@ class MessageHandler;
 class NamedLockManager;
 class NonceGenerator;
 class ProcessContext;
+class RateControllingUrlAsyncFetcher;
 class ServerContext;
 class SharedCircularBuffer;
 class SharedMemStatistics;
@@ -183,6 +184,12 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   // its required thread).
   UrlAsyncFetcher* GetFetcher(SystemRewriteOptions* config);
 
+  // Returns the rate-controlling fetcher GetFetcher(config) wraps, or NULL if
+  // the settings in config don't rate-limit fetches.  Must be called after
+  // GetFetcher.
+  RateControllingUrlAsyncFetcher* GetRateControllingFetcher(
+      SystemRewriteOptions* config);
+
   // Tracks the size of resources fetched from origin and populates the
   // X-Original-Content-Length header for resources derived from them.
   void set_track_original_content_length(bool x) {
@@ -225,6 +232,17 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   bool install_crash_handler() const { return install_crash_handler_; }
   void set_install_crash_handler(bool x) { install_crash_handler_ = x; }
 
+  // Which Hasher computes the hashes in .pagespeed. URLs and in cache keys.
+  // Changing it changes every such hash, so existing caches go cold, and
+  // URLs rewritten under the old hasher are served from a short-lived
+  // fallback until pages are rewritten again.
+  enum ContentHasher {
+    kMD5ContentHasher,
+    kXXH3ContentHasher,
+  };
+  ContentHasher content_hasher() const { return content_hasher_; }
+  void set_content_hasher(ContentHasher x) { content_hasher_ = x; }
+
   // mod_pagespeed uses a beacon handler to collect data for critical images,
   // css, etc., so filters should be configured accordingly.
   bool UseBeaconResultsInFilters() const override { return true; }
@@ -356,6 +374,11 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   bool track_original_content_length_;
   bool list_outstanding_urls_on_error_;
 
+  ContentHasher content_hasher_;
+  // Set once NewHasher has been called, after which the content hasher
+  // can't be changed.
+  bool hasher_created_;
+
   // Fetchers are expensive--they each cost a thread.  Instead of allocating one
   // for every server context we keep a cache of defined fetchers with various
   // configurations.  There are two caches depending on whether the underlying
@@ -371,6 +394,10 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   typedef std::map<GoogleString, UrlAsyncFetcher*> FetcherMap;
   FetcherMap base_fetcher_map_;
   FetcherMap fetcher_map_;
+  // The entries of fetcher_map_ that are rate-limiting, under the same keys,
+  // so the admin console can show their queues.
+  std::map<GoogleString, RateControllingUrlAsyncFetcher*>
+      rate_controlling_fetcher_map_;
 
   // URL prefix for support files required by pagespeed.
   GoogleString static_asset_prefix_;
@@ -46,6 +46,8 @@ const char SystemRewriteOptions::kPopularityContestMaxInFlight[] =
     "ExperimentalPopularityContestMaxInFlight";
 const char SystemRewriteOptions::kPopularityContestMaxQueueSize[] =
     "ExperimentalPopularityContestMaxQueueSize";
+const char SystemRewriteOptions::kControllerIdleImageTokens[] =
+    "ExperimentalCentralControllerIdleImageTokens";
 const char SystemRewriteOptions::kStaticAssetCDN[] = "StaticAssetCDN";
 const char SystemRewriteOptions::kRedisServer[] = "RedisServer";
 const char SystemRewriteOptions::kRedisReconnectionDelayMs[] =
@@ -53,6 +55,12 @@ const char SystemRewriteOptions::kRedisReconnectionDelayMs[] =
 const char SystemRewriteOptions::kRedisTimeoutUs[] = "RedisTimeoutUs";
 const char SystemRewriteOptions::kRedisDatabaseIndex[] = "RedisDatabaseIndex";
 const char SystemRewriteOptions::kRedisTTLSec[] = "RedisTTLSec";
+const char SystemRewriteOptions::kMetadataCacheCodec[] = "MetadataCacheCodec";
+const char SystemRewriteOptions::kMetadataCacheCompressionLevel[] =
+    "MetadataCacheCompressionLevel";
+const char SystemRewriteOptions::kLruCacheShards[] = "LRUCacheShards";
+const char SystemRewriteOptions::kLruCacheSnapshotIntervalSec[] =
+    "LRUCacheSnapshotIntervalSec";
 
 RewriteOptions::Properties* SystemRewriteOptions::system_properties_ = nullptr;
 
@@ -202,6 +210,17 @@ void SystemRewriteOptions::AddProperties() {
                     "Set the total size, in KB, of the per-process in-memory "
                     "LRU cache",
                     true);
+  AddSystemProperty(0, &SystemRewriteOptions::lru_cache_shards_, "alcs",
+                    SystemRewriteOptions::kLruCacheShards,
+                    "Split the per-process in-memory LRU cache into this many "
+                    "independently-locked shards; 0 or 1 means a single lock",
+                    true);
+  AddSystemProperty(0, &SystemRewriteOptions::lru_cache_snapshot_interval_sec_,
+                    "alsi", SystemRewriteOptions::kLruCacheSnapshotIntervalSec,
+                    "How often to snapshot the per-process in-memory LRU "
+                    "cache to the file cache, so a restarted process can "
+                    "start warm.  Set to 0 to turn off snapshots.",
+                    true);
   AddSystemProperty("", &SystemRewriteOptions::cache_flush_filename_, "acff",
                     RewriteOptions::kCacheFlushFilename,
                     "Name of file to check for timestamp updates used to flush "
@@ -220,6 +239,18 @@ void SystemRewriteOptions::AddProperties() {
                     "Whether to compress cache entries before writing them to "
                     "memory or disk.",
                     true);
+  AddSystemProperty("deflate", &SystemRewriteOptions::metadata_cache_codec_,
+                    "mccd", SystemRewriteOptions::kMetadataCacheCodec,
+                    "Codec used to compress cache entries when "
+                    "CompressMetadataCache is on: none, deflate or brotli.",
+                    true);
+  AddSystemProperty(-1,
+                    &SystemRewriteOptions::metadata_cache_compression_level_,
+                    "mccl",
+                    SystemRewriteOptions::kMetadataCacheCompressionLevel,
+                    "Compression level for MetadataCacheCodec: 1-9 for "
+                    "deflate, 0-11 for brotli, or -1 for the codec's default.",
+                    true);
   AddSystemProperty(
       "enable", &SystemRewriteOptions::https_options_, "fhs", kFetchHttps,
       "Controls direct fetching of HTTPS resources."
@@ -274,6 +305,12 @@ void SystemRewriteOptions::AddProperties() {
       1000, &SystemRewriteOptions::popularity_contest_max_queue_size_, "pcq",
       SystemRewriteOptions::kPopularityContestMaxQueueSize, kProcessScopeStrict,
       "Max number of queued rewrites allowed in the popularity contest", false);
+  AddSystemProperty(
+      0, &SystemRewriteOptions::controller_idle_image_tokens_, "ccit",
+      SystemRewriteOptions::kControllerIdleImageTokens, kProcessScopeStrict,
+      "Number of image rewrite tokens each process keeps on hand so image "
+      "rewrites don't wait on the central controller",
+      false);
   AddSystemProperty(false, &SystemRewriteOptions::disable_loopback_routing_,
                     "adlr", "DangerPermitFetchFromUnknownHosts",
                     kProcessScopeStrict,
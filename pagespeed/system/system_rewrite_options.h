@@ -47,12 +47,17 @@ class SystemRewriteOptions : public RewriteOptions {
   static const char kCentralControllerPort[];
   static const char kPopularityContestMaxInFlight[];
   static const char kPopularityContestMaxQueueSize[];
+  static const char kControllerIdleImageTokens[];
   static const char kStaticAssetCDN[];
   static const char kRedisServer[];
   static const char kRedisReconnectionDelayMs[];
   static const char kRedisTimeoutUs[];
   static const char kRedisDatabaseIndex[];
   static const char kRedisTTLSec[];
+  static const char kMetadataCacheCodec[];
+  static const char kMetadataCacheCompressionLevel[];
+  static const char kLruCacheShards[];
+  static const char kLruCacheSnapshotIntervalSec[];
 
   static constexpr int kMemcachedDefaultPort = 11211;
   static constexpr int kRedisDefaultPort = 6379;
@@ -110,6 +115,14 @@ class SystemRewriteOptions : public RewriteOptions {
   void set_lru_cache_kb_per_process(int64 x) {
     set_option(x, &lru_cache_kb_per_process_);
   }
+  int lru_cache_shards() const { return lru_cache_shards_.value(); }
+  void set_lru_cache_shards(int x) { set_option(x, &lru_cache_shards_); }
+  int lru_cache_snapshot_interval_sec() const {
+    return lru_cache_snapshot_interval_sec_.value();
+  }
+  void set_lru_cache_snapshot_interval_sec(int x) {
+    set_option(x, &lru_cache_snapshot_interval_sec_);
+  }
   bool use_shared_mem_locking() const {
     return use_shared_mem_locking_.value();
   }
@@ -122,6 +135,18 @@ class SystemRewriteOptions : public RewriteOptions {
   void set_compress_metadata_cache(bool x) {
     set_option(x, &compress_metadata_cache_);
   }
+  const GoogleString& metadata_cache_codec() const {
+    return metadata_cache_codec_.value();
+  }
+  void set_metadata_cache_codec(const StringPiece& x) {
+    set_option(x.as_string(), &metadata_cache_codec_);
+  }
+  int metadata_cache_compression_level() const {
+    return metadata_cache_compression_level_.value();
+  }
+  void set_metadata_cache_compression_level(int x) {
+    set_option(x, &metadata_cache_compression_level_);
+  }
   bool statistics_enabled() const { return statistics_enabled_.value(); }
   void set_statistics_enabled(bool x) { set_option(x, &statistics_enabled_); }
   bool statistics_logging_enabled() const {
@@ -207,6 +232,9 @@ class SystemRewriteOptions : public RewriteOptions {
   int popularity_contest_max_queue_size() const {
     return popularity_contest_max_queue_size_.value();
   }
+  int controller_idle_image_tokens() const {
+    return controller_idle_image_tokens_.value();
+  }
 
   // Cache flushing configuration.
   void set_cache_flush_poll_interval_sec(int64 num_seconds) {
@@ -436,6 +464,7 @@ class SystemRewriteOptions : public RewriteOptions {
   HttpsOptions https_options_;
 
   Option<GoogleString> slurp_directory_;
+  Option<GoogleString> metadata_cache_codec_;
   Option<GoogleString> test_proxy_slurp_;
 
   Option<bool> statistics_enabled_;
@@ -459,6 +488,7 @@ class SystemRewriteOptions : public RewriteOptions {
   ControllerPortOption controller_port_;
   Option<int> popularity_contest_max_inflight_requests_;
   Option<int> popularity_contest_max_queue_size_;
+  Option<int> controller_idle_image_tokens_;
 
   Option<int> memcached_threads_;
   Option<int> memcached_timeout_us_;
@@ -466,6 +496,9 @@ class SystemRewriteOptions : public RewriteOptions {
   Option<int64> redis_timeout_us_;
   Option<int> redis_database_index_;
   Option<int> redis_ttl_sec_;
+  Option<int> metadata_cache_compression_level_;
+  Option<int> lru_cache_shards_;
+  Option<int> lru_cache_snapshot_interval_sec_;
 
   Option<int64> slow_file_latency_threshold_us_;
   Option<int64> file_cache_clean_inode_limit_;
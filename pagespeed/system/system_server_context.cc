@@ -74,6 +74,7 @@ SystemServerContext::SystemServerContext(RewriteDriverFactory* factory,
       local_statistics_(nullptr),
       hostname_identifier_(StrCat(hostname, ":", IntegerToString(port))),
       system_caches_(nullptr),
+      rate_controlling_fetcher_(nullptr),
       cache_path_(nullptr) {
   global_system_rewrite_options()->set_description(hostname_identifier_);
 }
@@ -156,7 +157,8 @@ void SystemServerContext::CheckLegacyGlobalCacheFlushFile() {
         if (flushed && (timestamp_ms !=
                         cache_flush_timestamp_ms_->SetReturningPreviousValue(
                             timestamp_ms))) {
-          int count = cache_flush_count_->Add(1);
+          cache_flush_count_->Add(1);
+          int count = cache_flush_count_->Get();
           message_handler()->Message(kWarning, "Cache Flush %d", count);
         }
       }
@@ -249,6 +251,8 @@ void SystemServerContext::ChildInit(SystemRewriteDriverFactory* factory) {
     UrlAsyncFetcher* fetcher =
         factory->GetFetcher(global_system_rewrite_options());
     set_default_system_fetcher(fetcher);
+    rate_controlling_fetcher_ =
+        factory->GetRateControllingFetcher(global_system_rewrite_options());
 
     if (split_statistics_.get() != nullptr) {
       // Readjust the SHM stuff for the new process
@@ -397,7 +401,8 @@ void SystemServerContext::AdminPage(bool is_global,
                          cache_path(), fetch, system_caches_,
                          filesystem_metadata_cache(), http_cache(),
                          metadata_cache(), page_property_cache(), this,
-                         statistics(), stats, global_system_rewrite_options());
+                         rate_controlling_fetcher_, statistics(), stats,
+                         global_system_rewrite_options());
 }
 
 void SystemServerContext::StatisticsPage(bool is_global,
@@ -38,6 +38,7 @@ class GoogleUrl;
 class Histogram;
 class QueryParams;
 class PurgeSet;
+class RateControllingUrlAsyncFetcher;
 class RewriteDriver;
 class RewriteDriverFactory;
 class RewriteOptions;
@@ -240,6 +241,9 @@ class SystemServerContext : public ServerContext {
 
   SystemCaches* system_caches_;
 
+  // NULL unless background fetches are rate-limited.  Owned by the factory.
+  RateControllingUrlAsyncFetcher* rate_controlling_fetcher_;
+
   SystemCachePath* cache_path_;
 
   DISALLOW_COPY_AND_ASSIGN(SystemServerContext);
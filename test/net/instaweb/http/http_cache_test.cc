@@ -28,17 +28,21 @@
 #include "net/instaweb/http/public/inflating_fetch.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/delay_cache.h"
 #include "pagespeed/kernel/cache/lru_cache.h"
 #include "pagespeed/kernel/cache/write_through_cache.h"
 #include "pagespeed/kernel/http/content_type.h"
 #include "pagespeed/kernel/http/http_names.h"
+#include "pagespeed/kernel/http/http_options.h"
 #include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/util/brotli_inflater.h"
 #include "pagespeed/kernel/util/gzip_inflater.h"
 #include "pagespeed/kernel/util/platform.h"
 #include "pagespeed/kernel/util/simple_stats.h"
@@ -178,6 +182,40 @@ class HTTPCacheTest : public testing::Test {
     return FindWithCallback(key, fragment, value, headers, callback.get());
   }
 
+  HTTPCache::FindResult FindPreferringBrotli(const GoogleString& key,
+                                             const GoogleString& fragment,
+                                             bool accepts_brotli,
+                                             HTTPValue* value,
+                                             ResponseHeaders* headers) {
+    std::unique_ptr<Callback> callback(NewCallback());
+    callback->request_context()->SetAcceptsBrotli(accepts_brotli);
+    http_cache_->FindPreferringBrotli(key, fragment, &message_handler_,
+                                      callback.get());
+    EXPECT_TRUE(callback->called_);
+    if (callback->result_.status == HTTPCache::kFound) {
+      value->Link(callback->http_value());
+    }
+    headers->CopyFrom(*callback->response_headers());
+    return callback->result_;
+  }
+
+  // Puts content, and a brotli variant of it, as a cacheable response of the
+  // given type.
+  void PutWithBrotliVariant(const ContentType& type, StringPiece content) {
+    ResponseHeaders headers;
+    InitHeaders(&headers, "max-age=300");
+    headers.Replace(HttpAttributes::kContentType, type.mime_type());
+    headers.ComputeCaching();
+    HTTPValue value;
+    value.SetHeaders(&headers);
+    value.Write(content, &message_handler_);
+    HttpOptions options = kDefaultHttpOptionsForTests;
+    http_cache_->Put(kUrl, kFragment, RequestHeaders::Properties(), options,
+                     &value, &message_handler_);
+    http_cache_->PutBrotliVariant(kUrl, kFragment, options, &value,
+                                  &message_handler_);
+  }
+
   HTTPCache::FindResult Find(const GoogleString& key,
                              const GoogleString& fragment, HTTPValue* value,
                              ResponseHeaders* headers, bool cache_valid) {
@@ -422,6 +460,126 @@ TEST_F(HTTPCacheTest, PutGetCompressedJpg) {
   http_cache_->SetCompressionLevel(0);  // Return cache to uncompressed.
 }
 
+TEST_F(HTTPCacheTest, PutGetBrotliVariant) {
+  http_cache_->SetBrotliQuality(11);
+  simple_stats_.Clear();
+  PutWithBrotliVariant(kContentTypeCss, kCssText);
+  EXPECT_EQ(1, GetStat(HTTPCache::kCacheInserts));
+  EXPECT_EQ(1, GetStat(HTTPCache::kBrotliInserts));
+
+  // A request that accepts brotli gets the pre-compressed variant.
+  HTTPValue value;
+  ResponseHeaders headers;
+  ASSERT_EQ(kFoundResult,
+            FindPreferringBrotli(kUrl, kFragment, true, &value, &headers));
+  EXPECT_TRUE(headers.HasValue(HttpAttributes::kContentEncoding, "br"));
+  EXPECT_TRUE(headers.HasValue(HttpAttributes::kVary,
+                               HttpAttributes::kAcceptEncoding));
+  StringPiece contents;
+  ASSERT_TRUE(value.ExtractContents(&contents));
+  EXPECT_GT(STATIC_STRLEN(kCssText), contents.size());
+  GoogleString decompressed;
+  StringWriter writer(&decompressed);
+  ASSERT_TRUE(
+      BrotliInflater::Decompress(contents, &message_handler_, &writer));
+  EXPECT_EQ(kCssText, decompressed);
+  EXPECT_EQ(1, GetStat(HTTPCache::kCacheHits));
+  EXPECT_EQ(1, GetStat(HTTPCache::kBrotliHits));
+
+  // One that doesn't gets the regular entry.
+  HTTPValue plain_value;
+  headers.Clear();
+  ASSERT_EQ(kFoundResult, FindPreferringBrotli(kUrl, kFragment, false,
+                                               &plain_value, &headers));
+  EXPECT_FALSE(headers.Has(HttpAttributes::kContentEncoding));
+  ASSERT_TRUE(plain_value.ExtractContents(&contents));
+  EXPECT_EQ(kCssText, contents);
+  EXPECT_EQ(2, GetStat(HTTPCache::kCacheHits));
+  EXPECT_EQ(1, GetStat(HTTPCache::kBrotliHits));
+
+  // Plain Find never looks at the variant.
+  headers.Clear();
+  ASSERT_EQ(kFoundResult, Find(kUrl, kFragment, &plain_value, &headers));
+  EXPECT_FALSE(headers.Has(HttpAttributes::kContentEncoding));
+  EXPECT_EQ(0, GetStat(HTTPCache::kCacheMisses));
+
+  // Deleting the entry deletes the variant too.
+  http_cache_->Delete(kUrl, kFragment);
+  headers.Clear();
+  EXPECT_EQ(kNotFoundResult,
+            FindPreferringBrotli(kUrl, kFragment, true, &value, &headers));
+  EXPECT_EQ(1, GetStat(HTTPCache::kCacheMisses));
+}
+
+TEST_F(HTTPCacheTest, BrotliVariantEtagIsHashOfIdentityBody) {
+  // MockHasher hashes everything alike, so use a real one.
+  MD5Hasher md5_hasher;
+  http_cache_ = std::make_unique<HTTPCache>(&lru_cache_, &mock_timer_,
+                                            &md5_hasher, &simple_stats_);
+  http_cache_->SetBrotliQuality(11);
+  PutWithBrotliVariant(kContentTypeCss, kCssText);
+
+  HTTPValue value;
+  ResponseHeaders brotli_headers;
+  ASSERT_EQ(kFoundResult, FindPreferringBrotli(kUrl, kFragment, true, &value,
+                                               &brotli_headers));
+  ASSERT_TRUE(brotli_headers.HasValue(HttpAttributes::kContentEncoding,
+                                      HttpAttributes::kBrotli));
+  ResponseHeaders headers;
+  ASSERT_EQ(kFoundResult, Find(kUrl, kFragment, &value, &headers));
+  GoogleString etag = HTTPCache::FormatEtag(md5_hasher.Hash(kCssText));
+  EXPECT_STREQ(etag, headers.Lookup1(HttpAttributes::kEtag));
+  EXPECT_STREQ(etag, brotli_headers.Lookup1(HttpAttributes::kEtag));
+  http_cache_.reset();
+}
+
+TEST_F(HTTPCacheTest, FindPreferringBrotliFallsBack) {
+  // Without a variant, a request that accepts brotli gets the regular entry,
+  // and the miss on the variant isn't counted.
+  http_cache_->SetBrotliQuality(11);
+  simple_stats_.Clear();
+  ResponseHeaders headers;
+  InitHeaders(&headers, "max-age=300");
+  headers.Replace(HttpAttributes::kContentType, kContentTypeCss.mime_type());
+  headers.ComputeCaching();
+  Put(kUrl, kFragment, &headers, kCssText);
+  HTTPValue value;
+  headers.Clear();
+  ASSERT_EQ(kFoundResult,
+            FindPreferringBrotli(kUrl, kFragment, true, &value, &headers));
+  EXPECT_FALSE(headers.Has(HttpAttributes::kContentEncoding));
+  EXPECT_EQ(1, GetStat(HTTPCache::kCacheHits));
+  EXPECT_EQ(0, GetStat(HTTPCache::kCacheMisses));
+  EXPECT_EQ(1, GetStat(HTTPCache::kCacheBackendHits));
+  EXPECT_EQ(0, GetStat(HTTPCache::kCacheBackendMisses));
+  EXPECT_EQ(0, GetStat(HTTPCache::kBrotliHits));
+
+  headers.Clear();
+  EXPECT_EQ(kNotFoundResult,
+            FindPreferringBrotli(kUrl2, kFragment, true, &value, &headers));
+  EXPECT_EQ(1, GetStat(HTTPCache::kCacheMisses));
+  EXPECT_EQ(1, GetStat(HTTPCache::kCacheBackendMisses));
+}
+
+TEST_F(HTTPCacheTest, NoBrotliVariantForIncompressibleOrDisabled) {
+  // Jpegs aren't compressible, so get no variant.
+  http_cache_->SetBrotliQuality(11);
+  simple_stats_.Clear();
+  PutWithBrotliVariant(kContentTypeJpeg, "content");
+  EXPECT_EQ(1, GetStat(HTTPCache::kCacheInserts));
+  EXPECT_EQ(0, GetStat(HTTPCache::kBrotliInserts));
+
+  // Nor does anything when brotli is off.
+  http_cache_->SetBrotliQuality(0);
+  PutWithBrotliVariant(kContentTypeCss, kCssText);
+  EXPECT_EQ(0, GetStat(HTTPCache::kBrotliInserts));
+  HTTPValue value;
+  ResponseHeaders headers;
+  ASSERT_EQ(kFoundResult,
+            FindPreferringBrotli(kUrl, kFragment, true, &value, &headers));
+  EXPECT_FALSE(headers.Has(HttpAttributes::kContentEncoding));
+}
+
 TEST_F(HTTPCacheTest, PutGetForInvalidUrl) {
   simple_stats_.Clear();
   ResponseHeaders meta_data_in, meta_data_out;
@@ -981,6 +1139,84 @@ TEST_F(HTTPCacheTest, PutUncompressedWithCompressionOn) {
   EXPECT_GT(kPayloadSizeWithoutHeaders, cache_size);
 }
 
+TEST_F(HTTPCacheTest, CoalesceConcurrentFinds) {
+  ResponseHeaders headers;
+  InitHeaders(&headers, "max-age=300");
+  Put(kUrl, kFragment, &headers, "content");
+
+  DelayCache delay_cache(&lru_cache_, thread_system_.get());
+  HTTPCache coalescing_cache(&delay_cache, &mock_timer_, &mock_hasher_,
+                             &simple_stats_);
+  coalescing_cache.EnableLookupCoalescing(thread_system_.get());
+  GoogleString backend_key = coalescing_cache.CompositeKey(kUrl, kFragment);
+  delay_cache.DelayKey(backend_key);
+  lru_cache_.ClearStats();
+
+  // The second Find rejects the entry; it must not affect the others.
+  std::unique_ptr<Callback> callback1(NewCallback());
+  std::unique_ptr<Callback> callback2(NewCallback());
+  std::unique_ptr<Callback> callback3(NewCallback());
+  callback2->cache_valid_ = false;
+  coalescing_cache.Find(kUrl, kFragment, &message_handler_, callback1.get());
+  coalescing_cache.Find(kUrl, kFragment, &message_handler_, callback2.get());
+  coalescing_cache.Find(kUrl, kFragment, &message_handler_, callback3.get());
+  EXPECT_FALSE(callback1->called_);
+  EXPECT_FALSE(callback2->called_);
+  EXPECT_FALSE(callback3->called_);
+  EXPECT_EQ(1, lru_cache_.num_hits());
+  EXPECT_EQ(2, GetStat(HTTPCache::kCoalescedLookups));
+
+  delay_cache.ReleaseKey(backend_key);
+  ASSERT_TRUE(callback1->called_);
+  ASSERT_TRUE(callback2->called_);
+  ASSERT_TRUE(callback3->called_);
+  EXPECT_EQ(kFoundResult, callback1->result_);
+  EXPECT_EQ(kNotFoundResult, callback2->result_);
+  EXPECT_EQ(kFoundResult, callback3->result_);
+  StringPiece contents;
+  ASSERT_TRUE(callback3->http_value()->ExtractContents(&contents));
+  EXPECT_EQ("content", contents);
+  EXPECT_STREQ("value", callback3->response_headers()->Lookup1("name"));
+
+  EXPECT_EQ(1, lru_cache_.num_hits());
+  EXPECT_EQ(2, GetStat(HTTPCache::kCacheHits));
+  EXPECT_EQ(1, GetStat(HTTPCache::kCacheMisses));
+
+  // Once the lookup is done, the next Find makes a new one.
+  std::unique_ptr<Callback> callback4(NewCallback());
+  coalescing_cache.Find(kUrl, kFragment, &message_handler_, callback4.get());
+  EXPECT_EQ(kFoundResult, callback4->result_);
+  EXPECT_EQ(2, lru_cache_.num_hits());
+  EXPECT_EQ(2, GetStat(HTTPCache::kCoalescedLookups));
+}
+
+TEST_F(HTTPCacheTest, CoalesceConcurrentMisses) {
+  DelayCache delay_cache(&lru_cache_, thread_system_.get());
+  HTTPCache coalescing_cache(&delay_cache, &mock_timer_, &mock_hasher_,
+                             &simple_stats_);
+  coalescing_cache.EnableLookupCoalescing(thread_system_.get());
+  GoogleString backend_key = coalescing_cache.CompositeKey(kUrl, kFragment);
+  delay_cache.DelayKey(backend_key);
+
+  // A Find of another fragment is a different key, so is not coalesced.
+  std::unique_ptr<Callback> callback1(NewCallback());
+  std::unique_ptr<Callback> callback2(NewCallback());
+  std::unique_ptr<Callback> other(NewCallback());
+  coalescing_cache.Find(kUrl, kFragment, &message_handler_, callback1.get());
+  coalescing_cache.Find(kUrl, kFragment, &message_handler_, callback2.get());
+  coalescing_cache.Find(kUrl, kFragment2, &message_handler_, other.get());
+  EXPECT_TRUE(other->called_);
+  EXPECT_EQ(1, GetStat(HTTPCache::kCoalescedLookups));
+
+  delay_cache.ReleaseKey(backend_key);
+  ASSERT_TRUE(callback1->called_);
+  ASSERT_TRUE(callback2->called_);
+  EXPECT_EQ(kNotFoundResult, callback1->result_);
+  EXPECT_EQ(kNotFoundResult, callback2->result_);
+  EXPECT_EQ(2, lru_cache_.num_misses());
+  EXPECT_EQ(3, GetStat(HTTPCache::kCacheMisses));
+}
+
 class HTTPCacheWriteThroughTest : public HTTPCacheTest {
  protected:
   // Unlike HTTPCacheTest::Callback this can produce different validity for
@@ -1527,6 +1763,46 @@ TEST_F(HTTPCacheWriteThroughTest, CacheInvalidation) {
   EXPECT_EQ(kFoundResult, callback4.result_);
 }
 
+TEST_F(HTTPCacheWriteThroughTest, CoalescedFindRejectingL1) {
+  ResponseHeaders headers;
+  InitHeaders(&headers, "max-age=300");
+  http_cache_->Put(key_, fragment_, RequestHeaders::Properties(),
+                   ResponseHeaders::kRespectVaryOnResources, &headers,
+                   content_, &message_handler_);
+
+  // DelayCache accepts every candidate, so it has to go under the
+  // WriteThroughCache for L2 to be consulted.
+  DelayCache delay_cache(&cache1_, thread_system_.get());
+  WriteThroughCache write_through_cache(&delay_cache, &cache2_);
+  HTTPCache coalescing_cache(&write_through_cache, &mock_timer_, &mock_hasher_,
+                             &simple_stats_);
+  coalescing_cache.set_cache_levels(2);
+  coalescing_cache.EnableLookupCoalescing(thread_system_.get());
+  GoogleString backend_key = coalescing_cache.CompositeKey(key_, fragment_);
+  delay_cache.DelayKey(backend_key);
+  ClearStats();
+
+  FakeHttpCacheCallback callback1(thread_system_.get());
+  FakeHttpCacheCallback callback2(thread_system_.get());
+  callback2.first_cache_valid_ = false;
+  callback2.second_cache_valid_ = false;
+  coalescing_cache.Find(key_, fragment_, &message_handler_, &callback1);
+  coalescing_cache.Find(key_, fragment_, &message_handler_, &callback2);
+  delay_cache.ReleaseKey(backend_key);
+  EXPECT_TRUE(callback1.called_);
+  EXPECT_TRUE(callback2.called_);
+  EXPECT_EQ(kFoundResult, callback1.result_);
+  EXPECT_EQ(kNotFoundResult, callback2.result_);
+
+  // The shared lookup stopped at the L1 entry callback1 accepted, so
+  // callback2, having rejected it, looked in L2 itself.
+  EXPECT_EQ(1, GetStat(HTTPCache::kCoalescedLookups));
+  EXPECT_EQ(2, cache1_.num_hits());
+  EXPECT_EQ(1, cache2_.num_hits());
+  EXPECT_EQ(1, GetStat(HTTPCache::kCacheHits));
+  EXPECT_EQ(1, GetStat(HTTPCache::kCacheMisses));
+}
+
 // Unit testing cache freshness.
 TEST_F(HTTPCacheWriteThroughTest, CacheFreshness) {
   ClearStats();
@@ -0,0 +1,227 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Simulates background fetches from one slow origin with lots of resources
+// and a few fast ones, through a RateControllingUrlAsyncFetcher, to check
+// that the slow origin can't starve the others of room in the fetch queue.
+
+#include <algorithm>
+#include <memory>
+
+#include "net/instaweb/http/public/async_fetch.h"
+#include "net/instaweb/http/public/rate_controller.h"
+#include "net/instaweb/http/public/rate_controlling_url_async_fetcher.h"
+#include "net/instaweb/http/public/request_context.h"
+#include "net/instaweb/http/public/simulated_delay_fetcher.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/http/http_names.h"
+#include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+#include "test/pagespeed/kernel/base/mem_file_system.h"
+#include "test/pagespeed/kernel/base/mock_timer.h"
+#include "test/pagespeed/kernel/thread/mock_scheduler.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kConfigPath[] = "hosts.txt";
+const char kLogPath[] = "request_log.txt";
+
+const int kMaxGlobalQueueSize = 20;
+const int kPerHostOutgoingRequestThreshold = 4;
+const int kPerHostQueuedRequestThreshold = 20;
+
+// Pages are requested every kTickMs, each one needing kSlowFetchesPerTick
+// resources from the slow origin and kFastFetchesPerTick from each fast one.
+const int64 kTickMs = 100;
+const int kNumTicks = 100;
+const int kSlowFetchesPerTick = 10;
+const int kFastFetchesPerTick = 8;
+
+struct Origin {
+  const char* host;
+  int delay_ms;
+};
+
+const Origin kSlowOrigin = {"slow.com", 2000};
+const Origin kFastOrigins[] = {
+    {"fast1.com", 20},
+    {"fast2.com", 30},
+    {"fast3.com", 40},
+};
+const int kNumFastOrigins = arraysize(kFastOrigins);
+
+// Tallies what became of the fetches for one origin.
+struct OriginResults {
+  OriginResults() : succeeded(0), dropped(0), failed(0), max_latency_ms(0) {}
+
+  int succeeded;
+  int dropped;
+  int failed;
+  int64 max_latency_ms;
+};
+
+// A background fetch which records its outcome in an OriginResults, and
+// deletes itself when done.
+class SimulatedFetch : public AsyncFetch {
+ public:
+  SimulatedFetch(const RequestContextPtr& ctx, Timer* timer,
+                 OriginResults* results)
+      : AsyncFetch(ctx),
+        timer_(timer),
+        results_(results),
+        start_ms_(timer->NowMs()) {}
+
+  bool IsBackgroundFetch() const override { return true; }
+
+ protected:
+  void HandleHeadersComplete() override {}
+  bool HandleWrite(const StringPiece& content,
+                   MessageHandler* handler) override {
+    return true;
+  }
+  bool HandleFlush(MessageHandler* handler) override { return true; }
+  void HandleDone(bool success) override {
+    if (success) {
+      ++results_->succeeded;
+      results_->max_latency_ms =
+          std::max(results_->max_latency_ms, timer_->NowMs() - start_ms_);
+    } else if (response_headers()->Has(HttpAttributes::kXPsaLoadShed)) {
+      ++results_->dropped;
+    } else {
+      ++results_->failed;
+    }
+    delete this;
+  }
+
+ private:
+  Timer* timer_;
+  OriginResults* results_;
+  const int64 start_ms_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimulatedFetch);
+};
+
+class RateControllerSimulationTest : public ::testing::Test {
+ protected:
+  RateControllerSimulationTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        stats_(thread_system_.get()),
+        timer_(thread_system_->NewMutex(), MockTimer::kApr_5_2010_ms),
+        scheduler_(thread_system_.get(), &timer_),
+        file_system_(thread_system_.get(), &timer_) {
+    RateController::InitStats(&stats_);
+    GoogleString config;
+    StrAppend(&config, kSlowOrigin.host, "=",
+              IntegerToString(kSlowOrigin.delay_ms), ";\n");
+    for (const Origin& origin : kFastOrigins) {
+      StrAppend(&config, origin.host, "=", IntegerToString(origin.delay_ms),
+                ";\n");
+    }
+    file_system_.WriteFile(kConfigPath, config, &handler_);
+    delay_fetcher_ = std::make_unique<SimulatedDelayFetcher>(
+        thread_system_.get(), &timer_, &scheduler_, &handler_, &file_system_,
+        kConfigPath, kLogPath, 100 /* flush after 100 requests */);
+    rate_controlling_fetcher_ =
+        std::make_unique<RateControllingUrlAsyncFetcher>(
+            delay_fetcher_.get(), kMaxGlobalQueueSize,
+            kPerHostOutgoingRequestThreshold, kPerHostQueuedRequestThreshold,
+            thread_system_.get(), &timer_, &stats_);
+  }
+
+  void StartFetches(const Origin& origin, int num_fetches,
+                    OriginResults* results) {
+    for (int i = 0; i < num_fetches; ++i) {
+      rate_controlling_fetcher_->Fetch(
+          StrCat("http://", origin.host, "/", IntegerToString(i), ".css"),
+          &handler_,
+          new SimulatedFetch(
+              RequestContext::NewTestRequestContext(thread_system_.get()),
+              &timer_, results));
+    }
+  }
+
+  int64 global_fetch_queue_size() {
+    return stats_
+        .GetUpDownCounter(RateController::kCurrentGlobalFetchQueueSize)
+        ->Get();
+  }
+
+  std::unique_ptr<ThreadSystem> thread_system_;
+  SimpleStats stats_;
+  MockTimer timer_;
+  MockScheduler scheduler_;
+  MemFileSystem file_system_;
+  NullMessageHandler handler_;
+  std::unique_ptr<SimulatedDelayFetcher> delay_fetcher_;
+  std::unique_ptr<RateControllingUrlAsyncFetcher> rate_controlling_fetcher_;
+};
+
+TEST_F(RateControllerSimulationTest, SlowOriginDoesNotStarveFastOnes) {
+  OriginResults slow_results;
+  OriginResults fast_results[kNumFastOrigins];
+  for (int tick = 0; tick < kNumTicks; ++tick) {
+    // The slow origin's fetches arrive first, so that it has the global queue
+    // to itself each time the fast origins need room.
+    StartFetches(kSlowOrigin, kSlowFetchesPerTick, &slow_results);
+    for (int i = 0; i < kNumFastOrigins; ++i) {
+      StartFetches(kFastOrigins[i], kFastFetchesPerTick, &fast_results[i]);
+    }
+    EXPECT_LE(global_fetch_queue_size(), kMaxGlobalQueueSize);
+    scheduler_.AdvanceTimeMs(kTickMs);
+  }
+  // Let everything still outgoing or queued finish.
+  scheduler_.AdvanceTimeMs(
+      (kMaxGlobalQueueSize / kPerHostOutgoingRequestThreshold + 1) *
+      kSlowOrigin.delay_ms);
+  EXPECT_EQ(0, global_fetch_queue_size());
+
+  // The slow origin can only manage 2 fetches a second, so most of its fetches
+  // are dropped.
+  EXPECT_EQ(kNumTicks * kSlowFetchesPerTick,
+            slow_results.succeeded + slow_results.dropped);
+  EXPECT_EQ(0, slow_results.failed);
+  EXPECT_LT(0, slow_results.succeeded);
+  EXPECT_LT(kNumTicks * kSlowFetchesPerTick * 9 / 10, slow_results.dropped);
+
+  // But every one of the fast origins' fetches gets queued in its place, and
+  // completes before the next page comes along: half are sent straight away,
+  // and the other half as soon as those complete.
+  for (int i = 0; i < kNumFastOrigins; ++i) {
+    EXPECT_EQ(kNumTicks * kFastFetchesPerTick, fast_results[i].succeeded)
+        << kFastOrigins[i].host;
+    EXPECT_EQ(0, fast_results[i].dropped) << kFastOrigins[i].host;
+    EXPECT_EQ(0, fast_results[i].failed) << kFastOrigins[i].host;
+    EXPECT_EQ(2 * kFastOrigins[i].delay_ms, fast_results[i].max_latency_ms)
+        << kFastOrigins[i].host;
+  }
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -103,7 +103,8 @@ class RateControllingUrlAsyncFetcherTest : public ::testing::Test {
     // requests for a particular domain.
     rate_controlling_fetcher_ =
         std::make_unique<RateControllingUrlAsyncFetcher>(
-            counting_fetcher_.get(), 10, 2, 4, thread_system_.get(), &stats_);
+            counting_fetcher_.get(), 10, 2, 4, thread_system_.get(), &timer_,
+            &stats_);
 
     SetupResponse(domain1_url1_, body1_);
     SetupResponse(domain2_url1_, body2_);
@@ -312,8 +313,10 @@ TEST_F(RateControllingUrlAsyncFetcherTest,
     rate_controlling_fetcher_->Fetch(domain2_url1_, &handler_, fetch);
   }
 
-  // Send another 10 requests for domain3. 2 fetches get triggered, 2 get
-  // enqueued and 6 get dropped.
+  // Send another 10 requests for domain3. 2 fetches get triggered and 2 get
+  // enqueued, filling the global queue. The global queue is shared fairly
+  // between the 3 domains, so the next one displaces the last fetch queued
+  // for domain1, which was over its share of 3, and the last 5 get dropped.
   for (int i = 0; i < 10; ++i) {
     MockFetch* fetch = new MockFetch(
         RequestContext::NewTestRequestContext(thread_system_.get()), true);
@@ -321,25 +324,28 @@ TEST_F(RateControllingUrlAsyncFetcherTest,
     rate_controlling_fetcher_->Fetch(domain3_url1_, &handler_, fetch);
   }
 
-  // 6 fetches get triggered, while 10 get queued up. None of these are done
-  // yet.
+  // 6 fetches get triggered, while 10 are left queued up. None of these are
+  // done yet.
   for (int i = 0; i < 12; ++i) {
-    EXPECT_FALSE(fetch_vector[i]->done());
+    EXPECT_EQ(i == 10, fetch_vector[i]->done());
   }
-  for (int i = 100; i < 104; ++i) {
+  for (int i = 100; i < 105; ++i) {
     EXPECT_FALSE(fetch_vector[i]->done());
   }
   EXPECT_EQ(10, global_fetch_queue_size());
 
-  // 94 fetches get shedded due to load.
-  for (int i = 12; i < 100; ++i) {
+  // 94 fetches get shedded due to load, including the displaced one.
+  for (int i = 10; i < 100; ++i) {
+    if (i == 11) {
+      continue;
+    }
     EXPECT_TRUE(fetch_vector[i]->done());
     EXPECT_FALSE(fetch_vector[i]->success());
     EXPECT_EQ("", fetch_vector[i]->content());
     EXPECT_TRUE(fetch_vector[i]->response_headers()->Has(
         HttpAttributes::kXPsaLoadShed));
   }
-  for (int i = 104; i < 110; ++i) {
+  for (int i = 105; i < 110; ++i) {
     EXPECT_TRUE(fetch_vector[i]->done());
     EXPECT_FALSE(fetch_vector[i]->success());
     EXPECT_EQ("", fetch_vector[i]->content());
@@ -352,6 +358,9 @@ TEST_F(RateControllingUrlAsyncFetcherTest,
   for (int i = 0; i < 3; ++i) {
     wait_fetcher_->CallCallbacks();
     for (int j = 0; j < 12; ++j) {
+      if (j == 10) {
+        continue;  // Displaced.
+      }
       MockFetch* fetch = fetch_vector[j];
       if (j < 4 * (i + 1)) {
         EXPECT_TRUE(fetch->done());
@@ -365,7 +374,7 @@ TEST_F(RateControllingUrlAsyncFetcherTest,
         EXPECT_FALSE(fetch->success());
       }
     }
-    for (int j = 100; j < 104; ++j) {
+    for (int j = 100; j < 105; ++j) {
       MockFetch* fetch = fetch_vector[j];
       if (j < 100 + 2 * (i + 1)) {
         EXPECT_TRUE(fetch->done());
@@ -389,7 +398,7 @@ TEST_F(RateControllingUrlAsyncFetcherTest,
   EXPECT_STREQ(body3_, fetch->content());
   EXPECT_FALSE(fetch->response_headers()->Has(HttpAttributes::kXPsaLoadShed));
 
-  EXPECT_EQ(10, stats_.GetTimedVariable(RateController::kQueuedFetchCount)
+  EXPECT_EQ(11, stats_.GetTimedVariable(RateController::kQueuedFetchCount)
                     ->Get(TimedVariable::START));
   EXPECT_EQ(94, stats_.GetTimedVariable(RateController::kDroppedFetchCount)
                     ->Get(TimedVariable::START));
@@ -398,6 +407,109 @@ TEST_F(RateControllingUrlAsyncFetcherTest,
   STLDeleteContainerPointers(fetch_vector.begin(), fetch_vector.end());
 }
 
+TEST_F(RateControllingUrlAsyncFetcherTest, OutgoingLimitAdaptsToLatency) {
+  std::vector<MockFetch*> fetch_vector;
+
+  // 2 fetches get triggered, while 4 get queued up.
+  for (int i = 0; i < 6; ++i) {
+    MockFetch* fetch = new MockFetch(
+        RequestContext::NewTestRequestContext(thread_system_.get()), true);
+    fetch_vector.push_back(fetch);
+    rate_controlling_fetcher_->Fetch(domain1_url1_, &handler_, fetch);
+  }
+  EXPECT_EQ(2, counting_fetcher_->fetch_start_count());
+
+  // Both complete quickly, so the next 2 get triggered.
+  timer_.AdvanceMs(10);
+  wait_fetcher_->CallCallbacks();
+  EXPECT_EQ(4, counting_fetcher_->fetch_start_count());
+  EXPECT_EQ(2, global_fetch_queue_size());
+
+  // Those take far longer, as if the host were overloaded, so its limit is
+  // cut back to 1 (just once, since they were outgoing together), and only
+  // one of the last 2 gets triggered.
+  timer_.AdvanceMs(Timer::kSecondMs);
+  wait_fetcher_->CallCallbacks();
+  EXPECT_EQ(5, counting_fetcher_->fetch_start_count());
+  EXPECT_EQ(1, global_fetch_queue_size());
+  GoogleString host_stats;
+  rate_controlling_fetcher_->PrintHostStats(&host_stats);
+  EXPECT_EQ(
+      "Host                                     "
+      "Outgoing   Queued    Limit Latency (ms)\n"
+      "www.d1.com                               "
+      "       1        1        1          241\n",
+      host_stats);
+
+  // Once fetches are quick again the limit grows back.
+  timer_.AdvanceMs(10);
+  wait_fetcher_->CallCallbacks();
+  EXPECT_EQ(6, counting_fetcher_->fetch_start_count());
+  EXPECT_EQ(0, global_fetch_queue_size());
+  host_stats.clear();
+  rate_controlling_fetcher_->PrintHostStats(&host_stats);
+  EXPECT_NE(GoogleString::npos, host_stats.find("www.d1.com"));
+
+  wait_fetcher_->CallCallbacks();
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_TRUE(fetch_vector[i]->done());
+    EXPECT_TRUE(fetch_vector[i]->success());
+  }
+
+  // With nothing outgoing or queued, the host is still listed.
+  host_stats.clear();
+  rate_controlling_fetcher_->PrintHostStats(&host_stats);
+  EXPECT_NE(GoogleString::npos, host_stats.find("www.d1.com"));
+
+  STLDeleteContainerPointers(fetch_vector.begin(), fetch_vector.end());
+}
+
+TEST_F(RateControllingUrlAsyncFetcherTest, OutgoingLimitSurvivesIdleHost) {
+  std::vector<MockFetch*> fetch_vector;
+  auto start_fetches = [&](const GoogleString& url, int num_fetches) {
+    for (int i = 0; i < num_fetches; ++i) {
+      MockFetch* fetch = new MockFetch(
+          RequestContext::NewTestRequestContext(thread_system_.get()), true);
+      fetch_vector.push_back(fetch);
+      rate_controlling_fetcher_->Fetch(url, &handler_, fetch);
+    }
+  };
+
+  // A quick pair of fetches, then a slow pair, which cuts the limit to 1.
+  start_fetches(domain1_url1_, 2);
+  timer_.AdvanceMs(10);
+  wait_fetcher_->CallCallbacks();
+  start_fetches(domain1_url1_, 2);
+  timer_.AdvanceMs(Timer::kSecondMs);
+  wait_fetcher_->CallCallbacks();
+  EXPECT_EQ(4, counting_fetcher_->fetch_start_count());
+
+  // After a lull, the next burst still starts at the reduced limit.
+  timer_.AdvanceMs(Timer::kMinuteMs);
+  start_fetches(domain1_url1_, 2);
+  EXPECT_EQ(5, counting_fetcher_->fetch_start_count());
+  EXPECT_EQ(1, global_fetch_queue_size());
+  timer_.AdvanceMs(10);
+  wait_fetcher_->CallCallbacks();
+  EXPECT_EQ(6, counting_fetcher_->fetch_start_count());
+  wait_fetcher_->CallCallbacks();
+
+  // A host that has been idle for long enough is forgotten.
+  timer_.AdvanceMs(RateController::kIdleHostTimeoutMs);
+  start_fetches(domain2_url1_, 1);
+  GoogleString host_stats;
+  rate_controlling_fetcher_->PrintHostStats(&host_stats);
+  EXPECT_EQ(GoogleString::npos, host_stats.find("www.d1.com"));
+  EXPECT_NE(GoogleString::npos, host_stats.find("www.d2.com"));
+
+  wait_fetcher_->CallCallbacks();
+  for (MockFetch* fetch : fetch_vector) {
+    EXPECT_TRUE(fetch->done());
+    EXPECT_TRUE(fetch->success());
+  }
+  STLDeleteContainerPointers(fetch_vector.begin(), fetch_vector.end());
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
@@ -120,6 +120,34 @@ TEST_F(SimulatedDelayFetcherTest, BasicOperation) {
   EXPECT_EQ(SimulatedDelayFetcher::kPayload, result_a);
 }
 
+TEST_F(SimulatedDelayFetcherTest, ChunkedReply) {
+  StringVector chunks;
+  chunks.push_back("<html><head>");
+  chunks.push_back("</head><body>");
+  chunks.push_back("</body></html>");
+  const int kChunkDelayMs = 30;
+  fetcher_->SetChunkedReply(chunks, kChunkDelayMs);
+
+  GoogleString result;
+  StringAsyncFetch fetch(
+      RequestContext::NewTestRequestContext(thread_system_.get()), &result);
+  fetcher_->Fetch(StrCat("http://", kHostB), &handler_, &fetch);
+
+  scheduler_.AdvanceTimeMs(kDelayMsB);
+  EXPECT_TRUE(fetch.response_headers()->headers_complete());
+  EXPECT_EQ("<html><head>", result);
+  EXPECT_FALSE(fetch.done());
+
+  scheduler_.AdvanceTimeMs(kChunkDelayMs);
+  EXPECT_EQ("<html><head></head><body>", result);
+  EXPECT_FALSE(fetch.done());
+
+  scheduler_.AdvanceTimeMs(kChunkDelayMs);
+  EXPECT_TRUE(fetch.done());
+  EXPECT_TRUE(fetch.success());
+  EXPECT_EQ("<html><head></head><body></body></html>", result);
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
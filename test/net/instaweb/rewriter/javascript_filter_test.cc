@@ -1170,6 +1170,61 @@ TEST_P(JavascriptFilterTest, SourceMapsMedium) {
   SourceMapTest(input_js, expected_output_js, vlq);
 }
 
+// With the threshold at 0, every external script is minified incrementally,
+// which should make no difference to the results.
+TEST_P(JavascriptFilterTest, StreamingDoRewrite) {
+  options()->set_js_streaming_minify_min_bytes(0);
+  InitFiltersAndTest(100);
+  ValidateExpected("streaming_do_rewrite", GenerateHtml(kOrigJsName),
+                   GenerateHtml(expected_rewritten_path_.c_str()));
+
+  EXPECT_EQ(1, blocks_minified_->Get());
+  EXPECT_EQ(0, minification_failures_->Get());
+  EXPECT_EQ(STATIC_STRLEN(kJsData) - STATIC_STRLEN(kJsMinData),
+            total_bytes_saved_->Get());
+  EXPECT_EQ(STATIC_STRLEN(kJsData), total_original_bytes_->Get());
+  EXPECT_EQ(1, num_uses_->Get());
+}
+
+TEST_P(JavascriptFilterTest, StreamingIdentifyLibrary) {
+  options()->set_js_streaming_minify_min_bytes(0);
+  RegisterLibrary();
+  InitFiltersAndTest(100);
+  ValidateExpected("streaming_identify_library", GenerateHtml(kOrigJsName),
+                   GenerateHtml(kLibraryUrl));
+
+  EXPECT_EQ(1, libraries_identified_->Get());
+  EXPECT_EQ(1, blocks_minified_->Get());
+  EXPECT_EQ(0, minification_failures_->Get());
+}
+
+TEST_P(JavascriptFilterTest, StreamingMinificationFailure) {
+  options()->set_js_streaming_minify_min_bytes(0);
+  InitFilters();
+  SetResponseWithDefaultHeaders("foo.js", kContentTypeJavascript,
+                                "/* truncated comment", 100);
+  ValidateNoChanges("streaming_fail", "<script src=foo.js></script>");
+
+  EXPECT_EQ(0, blocks_minified_->Get());
+  EXPECT_EQ(1, minification_failures_->Get());
+  EXPECT_EQ(0, num_uses_->Get());
+  EXPECT_EQ(1, did_not_shrink_->Get());
+}
+
+TEST_P(JavascriptFilterTest, StreamingSourceMaps) {
+  options()->set_js_streaming_minify_min_bytes(0);
+  const char input_js[] =
+      "alert     (    'hello, world!'    ) \n"
+      " /* removed */ <!-- removed --> \n"
+      " // single-line-comment\n"
+      "document.write( \"<!-- comment -->\" );";
+  const char expected_output_js[] =
+      "alert('hello, world!')\n"
+      "document.write(\"<!-- comment -->\");";
+  const char vlq[] = "AAAA,KAAU,CAAK,eAAmB;AAGlC,eAAgB,kBAAmB";
+  SourceMapTest(input_js, expected_output_js, vlq);
+}
+
 TEST_P(JavascriptFilterTest, NoSourceMapJsCombine) {
   options()->EnableFilter(RewriteOptions::kCombineJavascript);
   options()->EnableFilter(RewriteOptions::kIncludeJsSourceMaps);
@@ -506,6 +506,28 @@ TEST_F(RewriteContextTest, TrimOnTheFlyNonOptimizable) {
   EXPECT_EQ(0, counting_url_async_fetcher()->fetch_count());
 }
 
+TEST_F(RewriteContextTest, MetadataLookupsBatchedPerFlushWindow) {
+  InitTrimFilters(kOnTheFlyResource);
+  InitResources();
+  RewriteStats* stats = server_context()->rewrite_stats();
+  GoogleString html = StrCat(CssLinkHref("b.css"), CssLinkHref("d.css"));
+
+  // Both partition lookups go to the metadata cache together.
+  ValidateNoChanges("batched", html);
+  EXPECT_EQ(1, stats->metadata_cache_batch_size_histogram()->Count());
+  EXPECT_EQ(2, stats->metadata_cache_batched_lookups()->Get());
+  EXPECT_EQ(2, counting_url_async_fetcher()->fetch_count());
+  ClearStats();
+
+  // And again when they both hit.
+  ValidateNoChanges("batched", html);
+  EXPECT_EQ(1, stats->metadata_cache_batch_size_histogram()->Count());
+  EXPECT_EQ(2, stats->metadata_cache_batched_lookups()->Get());
+  EXPECT_EQ(2, lru_cache()->num_hits());
+  EXPECT_EQ(0, lru_cache()->num_misses());
+  EXPECT_EQ(0, counting_url_async_fetcher()->fetch_count());
+}
+
 TEST_F(RewriteContextTest, TrimOnTheFlyNonOptimizableCacheInvalidation) {
   InitTrimFilters(kOnTheFlyResource);
   InitResources();
@@ -864,6 +864,8 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
   const char* const option_names[] = {
       RewriteOptions::kAcceptInvalidSignatures,
       RewriteOptions::kAccessControlAllowOrigins,
+      RewriteOptions::kAdaptiveFlushInitialBytes,
+      RewriteOptions::kAdaptiveFlushMaxDelayMs,
       RewriteOptions::kAddOptionsToUrls,
       RewriteOptions::kAllowLoggingUrlsInLogRecord,
       RewriteOptions::kAllowOptionsToBeSetByCookies,
@@ -915,6 +917,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
       RewriteOptions::kForbidAllDisabledFilters,
       RewriteOptions::kGoogleFontCssInlineMaxBytes,
       RewriteOptions::kHideRefererUsingMeta,
+      RewriteOptions::kHttpCacheBrotliQuality,
       RewriteOptions::kHttpCacheCompressionLevel,
       RewriteOptions::kHonorCsp,
       RewriteOptions::kIdleFlushTimeMs,
@@ -928,6 +931,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
       RewriteOptions::kImageLimitRenderedAreaPercent,
       RewriteOptions::kImageLimitResizeAreaPercent,
       RewriteOptions::kImageMaxRewritesAtOnce,
+      RewriteOptions::kImagePngMaxConcurrentEncodes,
       RewriteOptions::kImagePreserveURLs,
       RewriteOptions::kImageRecompressionQuality,
       RewriteOptions::kImageResolutionLimitBytes,
@@ -951,6 +955,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
       RewriteOptions::kJsInlineMaxBytes,
       RewriteOptions::kJsOutlineMinBytes,
       RewriteOptions::kJsPreserveURLs,
+      RewriteOptions::kJsStreamingMinifyMinBytes,
       RewriteOptions::kLazyloadImagesAfterOnload,
       RewriteOptions::kLazyloadImagesBlankUrl,
       RewriteOptions::kLoadFromFileCacheTtlMs,
@@ -177,9 +177,12 @@ RewriteTestBase::~RewriteTestBase() { RewriteDriverFactory::Terminate(); }
 void RewriteTestBase::SetUp() {
   HtmlParseTestBaseNoAlloc::SetUp();
   http_cache()->SetCompressionLevel(options_->http_cache_compression_level());
+  http_cache()->SetBrotliQuality(options_->http_cache_brotli_quality());
   rewrite_driver_ = MakeDriver(server_context_, options_);
   other_server_context()->http_cache()->SetCompressionLevel(
       options_->http_cache_compression_level());
+  other_server_context()->http_cache()->SetBrotliQuality(
+      options_->http_cache_brotli_quality());
   other_rewrite_driver_ = MakeDriver(other_server_context_, other_options_);
 }
 
@@ -155,7 +155,8 @@ UrlAsyncFetcher* TestRewriteDriverFactory::DefaultAsyncUrlFetcher() {
   rate_controlling_url_async_fetcher_ = new RateControllingUrlAsyncFetcher(
       counting_url_async_fetcher_.get(), kMaxFetchGlobalQueueSize,
       kFetchesPerHostOutgoingRequestThreshold,
-      kFetchesPerHostQueuedRequestThreshold, thread_system(), statistics());
+      kFetchesPerHostQueuedRequestThreshold, thread_system(), timer(),
+      statistics());
   return rate_controlling_url_async_fetcher_;
 }
 
@@ -26,6 +26,7 @@
 #include "base/logging.h"
 #include "net/instaweb/http/public/logging_proto_impl.h"
 #include "net/instaweb/http/public/request_context.h"
+#include "net/instaweb/http/public/simulated_delay_fetcher.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/server_context.h"
@@ -34,6 +35,8 @@
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/null_message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/request_headers.h"
@@ -60,9 +63,7 @@ class MockProxyFetch : public ProxyFetch {
                    async_fetch,
                    nullptr,  // no original content fetch
                    GetNewRewriteDriver(server_context, async_fetch),
-                   server_context,
-                   nullptr,  // timer
-                   factory),
+                   server_context, server_context->timer(), factory),
         complete_(false) {
     response_headers()->set_status_code(HttpStatus::kOK);
   }
@@ -707,4 +708,152 @@ TEST_F(ProxyFetchTest, TestStickyPageSpeedOptions) {
   }
 }
 
+namespace {
+
+const char kDelayMapPath[] = "/simulated_delays.txt";
+const char kRequestLogPath[] = "/simulated_requests.txt";
+const char kOriginUrl[] = "http://origin.example.com/page.html";
+const int kOriginDelayMs = 100;
+const int kChunkDelayMs = 200;
+
+const char kHead[] = "<html><head><title>A page</title></head>";
+const char kBody1[] = "<body><p>Some text</p>";
+const char kBody2[] = "<p>More text</p></body></html>";
+
+}  // namespace
+
+// Serves a page from a SimulatedDelayFetcher origin that sends the <head>
+// first and the body a piece at a time, to check how much of the page
+// ProxyFetch sends on before the origin is done.
+class ProxyFetchAdaptiveFlushTest : public ProxyFetchTest {
+ protected:
+  void SetUp() override {
+    ProxyFetchTest::SetUp();
+    ProxyFetchFactory::InitStats(statistics());
+    WriteFile(kDelayMapPath,
+              StrCat("origin.example.com=", IntegerToString(kOriginDelayMs)));
+    origin_ = std::make_unique<SimulatedDelayFetcher>(
+        server_context()->thread_system(), timer(), mock_scheduler(),
+        message_handler(), file_system(), kDelayMapPath, kRequestLogPath, 1);
+    StringVector chunks;
+    chunks.push_back(kHead);
+    chunks.push_back(kBody1);
+    chunks.push_back(kBody2);
+    origin_->SetChunkedReply(chunks, kChunkDelayMs);
+    factory_ = std::make_unique<ProxyFetchFactory>(server_context());
+  }
+
+  void SetAdaptiveFlush(int64 initial_bytes, int64 max_delay_ms) {
+    RewriteOptions* options = server_context()->global_options();
+    options->ClearSignatureForTesting();
+    options->DisableFilter(RewriteOptions::kAddHead);
+    options->set_adaptive_flush_initial_bytes(initial_bytes);
+    options->set_adaptive_flush_max_delay_ms(max_delay_ms);
+    options->ComputeSignature();
+  }
+
+  // Starts fetching kOriginUrl through a ProxyFetch that writes to fetch.
+  void StartFetch(StringAsyncFetch* fetch) {
+    MockProxyFetch* mock_proxy_fetch =
+        new MockProxyFetch(fetch, factory_.get(), server_context());
+    origin_->Fetch(kOriginUrl, message_handler(), mock_proxy_fetch);
+  }
+
+  // Advances time, then lets the rewrite threads catch up.
+  void AdvanceTimeAndWait(int64 delay_ms) {
+    AdvanceTimeMs(delay_ms);
+    mock_scheduler()->AwaitQuiescence();
+  }
+
+  Histogram* FirstByteLatency() {
+    return statistics()->GetHistogram(
+        ProxyFetchFactory::kHtmlFirstByteLatencyMsHistogram);
+  }
+
+  int64 AdaptiveFlushes() {
+    return statistics()
+        ->GetVariable(ProxyFetchFactory::kAdaptiveHtmlFlushes)
+        ->Get();
+  }
+
+  std::unique_ptr<SimulatedDelayFetcher> origin_;
+  std::unique_ptr<ProxyFetchFactory> factory_;
+};
+
+TEST_F(ProxyFetchAdaptiveFlushTest, NoAdaptiveFlush) {
+  SetAdaptiveFlush(-1, 0);
+  StringAsyncFetch fetch(
+      RequestContext::NewTestRequestContext(server_context()->thread_system()));
+  StartFetch(&fetch);
+
+  // Without adaptive flushing, nothing is sent until the origin is done.
+  AdvanceTimeAndWait(kOriginDelayMs);
+  EXPECT_EQ("", fetch.buffer());
+  AdvanceTimeAndWait(kChunkDelayMs);
+  EXPECT_EQ("", fetch.buffer());
+  AdvanceTimeAndWait(kChunkDelayMs);
+  EXPECT_TRUE(fetch.done());
+  EXPECT_EQ(StrCat(kHead, kBody1, kBody2), fetch.buffer());
+  EXPECT_EQ(0, server_context()->num_active_rewrite_drivers());
+
+  EXPECT_EQ(1, FirstByteLatency()->Count());
+  EXPECT_EQ(kOriginDelayMs + 2 * kChunkDelayMs, FirstByteLatency()->Maximum());
+  EXPECT_EQ(0, AdaptiveFlushes());
+}
+
+TEST_F(ProxyFetchAdaptiveFlushTest, FlushWhenWindowFills) {
+  // The <head> alone fills the first window, so it is flushed as soon as it
+  // arrives.
+  SetAdaptiveFlush(STATIC_STRLEN(kHead), 0);
+  StringAsyncFetch fetch(
+      RequestContext::NewTestRequestContext(server_context()->thread_system()));
+  StartFetch(&fetch);
+
+  AdvanceTimeAndWait(kOriginDelayMs);
+  EXPECT_EQ(kHead, fetch.buffer());
+  EXPECT_FALSE(fetch.done());
+  EXPECT_EQ(1, AdaptiveFlushes());
+
+  // The window has doubled, so the first part of the body is held back.
+  AdvanceTimeAndWait(kChunkDelayMs);
+  EXPECT_EQ(kHead, fetch.buffer());
+
+  AdvanceTimeAndWait(kChunkDelayMs);
+  EXPECT_TRUE(fetch.done());
+  EXPECT_EQ(StrCat(kHead, kBody1, kBody2), fetch.buffer());
+  EXPECT_EQ(0, server_context()->num_active_rewrite_drivers());
+
+  EXPECT_EQ(1, FirstByteLatency()->Count());
+  EXPECT_EQ(kOriginDelayMs, FirstByteLatency()->Maximum());
+}
+
+TEST_F(ProxyFetchAdaptiveFlushTest, FlushAfterMaxDelay) {
+  // The window is bigger than the page, so only the delay causes flushes.
+  const int kMaxDelayMs = 50;
+  SetAdaptiveFlush(10000, kMaxDelayMs);
+  StringAsyncFetch fetch(
+      RequestContext::NewTestRequestContext(server_context()->thread_system()));
+  StartFetch(&fetch);
+
+  AdvanceTimeAndWait(kOriginDelayMs);
+  EXPECT_EQ("", fetch.buffer());
+  AdvanceTimeAndWait(kMaxDelayMs);
+  EXPECT_EQ(kHead, fetch.buffer());
+  EXPECT_EQ(1, AdaptiveFlushes());
+
+  AdvanceTimeAndWait(kChunkDelayMs - kMaxDelayMs);
+  EXPECT_EQ(kHead, fetch.buffer());
+  AdvanceTimeAndWait(kMaxDelayMs);
+  EXPECT_EQ(StrCat(kHead, kBody1), fetch.buffer());
+  EXPECT_EQ(2, AdaptiveFlushes());
+
+  AdvanceTimeAndWait(kChunkDelayMs - kMaxDelayMs);
+  EXPECT_TRUE(fetch.done());
+  EXPECT_EQ(StrCat(kHead, kBody1, kBody2), fetch.buffer());
+  EXPECT_EQ(0, server_context()->num_active_rewrite_drivers());
+
+  EXPECT_EQ(1, FirstByteLatency()->Count());
+  EXPECT_EQ(kOriginDelayMs + kMaxDelayMs, FirstByteLatency()->Maximum());
+}
+
 }  // namespace net_instaweb
@@ -0,0 +1,351 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Load test for the batched controller protocol: thousands of
+// ScheduleRewriteBatch and LeaseExpensiveOperations streams, spread over a
+// handful of connections as if from many worker processes, all talking to one
+// controller at once. Checks that every request is answered and that the
+// controller ends up with nothing running, both after the clients report their
+// results and after they all disconnect.
+
+#include <memory>
+#include <vector>
+
+#include "pagespeed/controller/central_controller_rpc_server.h"
+#include "pagespeed/controller/context_registry.h"
+#include "pagespeed/controller/controller.grpc.pb.h"
+#include "pagespeed/controller/expensive_operation_callback.h"
+#include "pagespeed/controller/expensive_operation_lease_rpc_client.h"
+#include "pagespeed/controller/expensive_operation_lease_rpc_handler.h"
+#include "pagespeed/controller/popularity_contest_schedule_rewrite_controller.h"
+#include "pagespeed/controller/schedule_rewrite_batch_rpc_client.h"
+#include "pagespeed/controller/schedule_rewrite_batch_rpc_handler.h"
+#include "pagespeed/controller/schedule_rewrite_callback.h"
+#include "pagespeed/controller/work_bound_expensive_operation_controller.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/ref_counted_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+#include "pagespeed/kernel/util/grpc.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+#include "test/pagespeed/controller/grpc_server_test.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+#include "test/pagespeed/kernel/base/message_handler_test_base.h"
+#include "test/pagespeed/kernel/base/mock_timer.h"
+#include "test/pagespeed/kernel/thread/worker_test_base.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kNumChannels = 16;
+const int kNumStreams = 2000;  // Of each kind.
+const int kOperationsPerStream = 5;
+const int kNumKeys = 1000;
+const int kMaxRunningRewrites = 100;
+const int kMaxQueuedRewrites = 2000;
+const int kMaxExpensiveOperations = 100;
+
+// Counts callbacks as they complete, and notifies once all have.
+class CompletionCounter {
+ public:
+  CompletionCounter(ThreadSystem* thread_system, int expected)
+      : mutex_(thread_system->NewMutex()),
+        sync_(thread_system),
+        expected_(expected),
+        ran_(0),
+        cancelled_(0) {}
+
+  void Ran() { Done(&ran_); }
+  void Cancelled() { Done(&cancelled_); }
+  void Wait() { sync_.Wait(); }
+
+  int ran() {
+    ScopedMutex lock(mutex_.get());
+    return ran_;
+  }
+
+ private:
+  void Done(int* count) {
+    bool all_done;
+    {
+      ScopedMutex lock(mutex_.get());
+      ++*count;
+      all_done = (ran_ + cancelled_ == expected_);
+    }
+    if (all_done) {
+      sync_.Notify();
+    }
+  }
+
+  std::unique_ptr<AbstractMutex> mutex_;
+  WorkerTestBase::SyncPoint sync_;
+  const int expected_;
+  int ran_;
+  int cancelled_;
+};
+
+// Both callbacks finish their operation as soon as they are run, by letting
+// the context go.
+class CountingRewriteCallback : public ScheduleRewriteCallback {
+ public:
+  CountingRewriteCallback(const GoogleString& key, Sequence* sequence,
+                          CompletionCounter* counter)
+      : ScheduleRewriteCallback(key, sequence), counter_(counter) {}
+
+ private:
+  void RunImpl(std::unique_ptr<ScheduleRewriteContext>* context) override {
+    counter_->Ran();
+  }
+  void CancelImpl() override { counter_->Cancelled(); }
+
+  CompletionCounter* counter_;
+};
+
+class CountingExpensiveOperationCallback : public ExpensiveOperationCallback {
+ public:
+  CountingExpensiveOperationCallback(Sequence* sequence,
+                                     CompletionCounter* counter)
+      : ExpensiveOperationCallback(sequence), counter_(counter) {}
+
+ private:
+  void RunImpl(std::unique_ptr<ExpensiveOperationContext>* context) override {
+    counter_->Ran();
+  }
+  void CancelImpl() override { counter_->Cancelled(); }
+
+  CompletionCounter* counter_;
+};
+
+// Hooks every ClientContext up to a ContextRegistry, so that all the streams
+// can be cancelled at the end of the test, which is exactly how
+// CentralControllerRpcClient shuts down. gRPC only allows this to be set once
+// per process, which is why this test has a binary to itself.
+class ClientRegistry : public ::grpc::ClientContext::GlobalCallbacks {
+ public:
+  explicit ClientRegistry(ThreadSystem* thread_system)
+      : registry_(thread_system) {}
+
+  void DefaultConstructor(::grpc::ClientContext* context) override {
+    CHECK(registry_.TryRegisterContext(context));
+  }
+
+  void Destructor(::grpc::ClientContext* context) override {
+    registry_.RemoveContext(context);
+  }
+
+  void CancelAllActiveAndWait() { registry_.CancelAllActiveAndWait(); }
+
+ private:
+  ContextRegistry<::grpc::ClientContext> registry_;
+};
+
+class ClientThread : public ThreadSystem::Thread {
+ public:
+  explicit ClientThread(ThreadSystem* thread_system)
+      : Thread(thread_system, "controller_load_test_client",
+               ThreadSystem::kJoinable) {}
+
+  ~ClientThread() override {
+    queue_.Shutdown();
+    if (this->Started()) {
+      this->Join();
+    }
+  }
+
+  ::grpc::CompletionQueue* queue() { return &queue_; }
+
+ private:
+  void Run() override { CentralControllerRpcServer::MainLoop(&queue_); }
+
+  ::grpc::CompletionQueue queue_;
+};
+
+}  // namespace
+
+class CentralControllerLoadTest : public GrpcServerTest {
+ public:
+  CentralControllerLoadTest()
+      : stats_(thread_system_.get()),
+        mock_timer_(thread_system_->NewMutex(), MockTimer::kApr_5_2010_ms),
+        timer_(Platform::CreateTimer()),
+        worker_(4 /* max_workers */, "controller_load_test",
+                thread_system_.get()),
+        sequence_(worker_.NewSequence()) {
+    PopularityContestScheduleRewriteController::InitStats(&stats_);
+    WorkBoundExpensiveOperationController::InitStats(&stats_);
+    rewrite_controller_ =
+        std::make_unique<PopularityContestScheduleRewriteController>(
+            thread_system_.get(), &stats_, &mock_timer_, kMaxRunningRewrites,
+            kMaxQueuedRewrites);
+    expensive_operation_controller_ =
+        std::make_unique<WorkBoundExpensiveOperationController>(
+            kMaxExpensiveOperations, &stats_);
+  }
+
+  ~CentralControllerLoadTest() override {
+    StopServer();
+    worker_.FreeSequence(sequence_);
+  }
+
+  static void SetUpTestCase() {
+    thread_system_for_registry_ = Platform::CreateThreadSystem();
+    registry_ = new ClientRegistry(thread_system_for_registry_);
+    ::grpc::ClientContext::SetGlobalCallbacks(registry_);
+  }
+
+  void RegisterServices(::grpc::ServerBuilder* builder) override {
+    builder->RegisterService(&service_);
+  }
+
+  // gRPC functions can only safely be called from the server thread, so
+  // start the handlers from there.
+  void StartHandlers() {
+    ScheduleRewriteBatchRpcHandler::CreateAndStart(&service_, queue_.get(),
+                                                   rewrite_controller_.get());
+    ExpensiveOperationLeaseRpcHandler::CreateAndStart(
+        &service_, queue_.get(), expensive_operation_controller_.get());
+  }
+
+ protected:
+  int64 CounterValue(const char* name) {
+    return stats_.GetUpDownCounter(name)->Get();
+  }
+
+  // The controller is updated asynchronously, as the clients' messages
+  // arrive, so give it a while to settle.
+  void WaitForControllerToDrain() {
+    for (int i = 0; i < 3000 && !ControllerIsIdle(); ++i) {
+      timer_->SleepMs(10);
+    }
+  }
+
+  bool ControllerIsIdle() {
+    typedef PopularityContestScheduleRewriteController RewriteController;
+    typedef WorkBoundExpensiveOperationController ExpensiveController;
+    return CounterValue(RewriteController::kNumRewritesRunning) == 0 &&
+           CounterValue(RewriteController::kRewriteQueueSize) == 0 &&
+           CounterValue(ExpensiveController::kCurrentExpensiveOperations) == 0;
+  }
+
+  static ThreadSystem* thread_system_for_registry_;
+  static ClientRegistry* registry_;
+
+  CentralControllerRpcService::AsyncService service_;
+  SimpleStats stats_;
+  MockTimer mock_timer_;
+  std::unique_ptr<Timer> timer_;
+  QueuedWorkerPool worker_;
+  QueuedWorkerPool::Sequence* sequence_;
+  TestMessageHandler handler_;
+  std::unique_ptr<ScheduleRewriteController> rewrite_controller_;
+  std::unique_ptr<ExpensiveOperationController> expensive_operation_controller_;
+};
+
+ThreadSystem* CentralControllerLoadTest::thread_system_for_registry_ = nullptr;
+ClientRegistry* CentralControllerLoadTest::registry_ = nullptr;
+
+namespace {
+
+TEST_F(CentralControllerLoadTest, ThousandsOfStreams) {
+  QueueFunctionForServerThread(
+      MakeFunction<CentralControllerLoadTest>(
+          this, &CentralControllerLoadTest::StartHandlers));
+
+  ClientThread client_thread(thread_system_.get());
+  ASSERT_TRUE(client_thread.Start());
+
+  // Separate subchannels, so that each channel gets a connection of its own
+  // like a separate worker process would.
+  std::vector<std::unique_ptr<CentralControllerRpcService::Stub>> stubs;
+  for (int i = 0; i < kNumChannels; ++i) {
+    ::grpc::ChannelArguments args;
+    args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+    stubs.push_back(CentralControllerRpcService::NewStub(
+        ::grpc::CreateCustomChannel(ServerAddress(),
+                                    ::grpc::InsecureChannelCredentials(),
+                                    args)));
+  }
+
+  const int kNumOperations = kNumStreams * kOperationsPerStream;
+  CompletionCounter rewrites(thread_system_.get(), kNumOperations);
+  CompletionCounter expensive_operations(thread_system_.get(), kNumOperations);
+  {
+    std::vector<RefCountedPtr<ScheduleRewriteBatchRpcClient>> rewrite_clients;
+    std::vector<RefCountedPtr<ExpensiveOperationLeaseRpcClient>>
+        expensive_operation_clients;
+    for (int i = 0; i < kNumStreams; ++i) {
+      CentralControllerRpcService::Stub* stub = stubs[i % kNumChannels].get();
+      rewrite_clients.emplace_back(new ScheduleRewriteBatchRpcClient(
+          client_thread.queue(), thread_system_.get(), &handler_));
+      rewrite_clients.back()->Start(stub);
+      expensive_operation_clients.emplace_back(
+          new ExpensiveOperationLeaseRpcClient(
+              client_thread.queue(), thread_system_.get(), &handler_,
+              0 /* idle_tokens */));
+      expensive_operation_clients.back()->Start(stub);
+    }
+
+    // Queue up everything at once, so lots of it is batched and lots of the
+    // keys are being fought over by several streams.
+    for (int op = 0; op < kOperationsPerStream; ++op) {
+      for (int i = 0; i < kNumStreams; ++i) {
+        GoogleString key =
+            IntegerToString((i * kOperationsPerStream + op) % kNumKeys);
+        EXPECT_TRUE(rewrite_clients[i]->ScheduleRewrite(
+            new CountingRewriteCallback(key, sequence_, &rewrites)));
+        EXPECT_TRUE(
+            expensive_operation_clients[i]->ScheduleExpensiveOperation(
+                new CountingExpensiveOperationCallback(
+                    sequence_, &expensive_operations)));
+      }
+    }
+
+    rewrites.Wait();
+    expensive_operations.Wait();
+    EXPECT_GT(rewrites.ran(), 0);
+    EXPECT_GT(expensive_operations.ran(), 0);
+
+    // Every callback has finished with its context, so the results should all
+    // make their way back to the controller.
+    WaitForControllerToDrain();
+    EXPECT_TRUE(ControllerIsIdle());
+    for (int i = 0; i < kNumStreams; ++i) {
+      EXPECT_FALSE(rewrite_clients[i]->HasFailed());
+      EXPECT_EQ(0, rewrite_clients[i]->NumOutstanding());
+      EXPECT_FALSE(expensive_operation_clients[i]->HasFailed());
+      EXPECT_EQ(0, expensive_operation_clients[i]->NumOutstanding());
+    }
+  }
+
+  // Now hang up all the streams at once, as a worker shutting down does.
+  registry_->CancelAllActiveAndWait();
+  WaitForControllerToDrain();
+  EXPECT_TRUE(ControllerIsIdle());
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -20,11 +20,18 @@
 #ifndef PAGESPEED_CONTROLLER_CONTROLLER_GRPC_MOCKS_H_
 #define PAGESPEED_CONTROLLER_CONTROLLER_GRPC_MOCKS_H_
 
+#include <deque>
+#include <memory>
+
+#include "base/logging.h"
 #include "pagespeed/controller/controller.grpc.pb.h"
 #include "pagespeed/controller/controller.pb.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/proto_util.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/thread/sequence.h"
 #include "pagespeed/kernel/util/grpc.h"
 #include "test/pagespeed/kernel/base/gmock.h"
@@ -173,6 +180,89 @@ class MockReaderWriterT
   Sequence* sequence_;
 };
 
+// Server half of a long-lived stream, for clients that always keep a Read
+// outstanding. Install Read() as the action for a MockReaderWriterT's Read and
+// each one completes, via the Sequence, with the next message passed to
+// Respond(), waiting for it if need be. Unlike MockReaderWriterT::ExpectRead,
+// the response isn't filled in until the Read completes, since the client is
+// free to touch it until then.
+
+template <typename ResponseT>
+class ServerResponseQueue {
+ public:
+  ServerResponseQueue(Sequence* sequence, ThreadSystem* thread_system)
+      : sequence_(sequence),
+        mutex_(thread_system->NewMutex()),
+        response_(nullptr),
+        tag_(nullptr) {}
+
+  void Read(ResponseT* response, void* tag) {
+    ScopedMutex lock(mutex_.get());
+    CHECK(tag_ == nullptr) << "Two Reads outstanding";
+    response_ = response;
+    tag_ = static_cast<Function*>(tag);
+    MaybeDeliver();
+  }
+
+  // Send the message described by asciiProto to the client.
+  void Respond(const GoogleString& asciiProto) {
+    std::unique_ptr<ResponseT> resp(new ResponseT);
+    ASSERT_THAT(ParseTextFormatProtoFromString(asciiProto, resp.get()),
+                Eq(true));
+    ScopedMutex lock(mutex_.get());
+    queued_.push_back(std::move(resp));
+    MaybeDeliver();
+  }
+
+  // Break the stream once the client has read everything sent so far.
+  void Fail() {
+    ScopedMutex lock(mutex_.get());
+    queued_.push_back(nullptr);
+    MaybeDeliver();
+  }
+
+ private:
+  class DeliverFunction : public Function {
+   public:
+    DeliverFunction(std::unique_ptr<ResponseT> resp, ResponseT* dest,
+                    Function* tag)
+        : resp_(std::move(resp)), dest_(dest), tag_(tag) {}
+
+    void Run() override {
+      if (resp_ == nullptr) {
+        tag_->CallCancel();
+      } else {
+        *dest_ = *resp_;
+        tag_->CallRun();
+      }
+    }
+
+    void Cancel() override { tag_->CallCancel(); }
+
+   private:
+    std::unique_ptr<ResponseT> resp_;
+    ResponseT* dest_;
+    Function* tag_;
+  };
+
+  void MaybeDeliver() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    if (tag_ != nullptr && !queued_.empty()) {
+      sequence_->Add(
+          new DeliverFunction(std::move(queued_.front()), response_, tag_));
+      queued_.pop_front();
+      response_ = nullptr;
+      tag_ = nullptr;
+    }
+  }
+
+  Sequence* sequence_;
+  std::unique_ptr<AbstractMutex> mutex_;
+  ResponseT* response_ GUARDED_BY(mutex_);
+  Function* tag_ GUARDED_BY(mutex_);
+  // nullptr entries are failures.
+  std::deque<std::unique_ptr<ResponseT>> queued_ GUARDED_BY(mutex_);
+};
+
 // Mock for CentralControllerRpcServiceStub. Mostly used just to bootstrap
 // a MockReaderWriterT, this also features deferred execution to mimic gRPC.
 
@@ -185,6 +275,10 @@ class MockCentralControllerRpcServiceStub
     EXPECT_CALL(*this, ScheduleRewriteRaw(_)).Times(0);
     EXPECT_CALL(*this, AsyncScheduleExpensiveOperationRaw(_, _, _)).Times(0);
     EXPECT_CALL(*this, AsyncScheduleRewriteRaw(_, _, _)).Times(0);
+    EXPECT_CALL(*this, ScheduleRewriteBatchRaw(_)).Times(0);
+    EXPECT_CALL(*this, LeaseExpensiveOperationsRaw(_)).Times(0);
+    EXPECT_CALL(*this, AsyncScheduleRewriteBatchRaw(_, _, _)).Times(0);
+    EXPECT_CALL(*this, AsyncLeaseExpensiveOperationsRaw(_, _, _)).Times(0);
   }
 
   MOCK_METHOD1(ScheduleExpensiveOperationRaw,
@@ -225,6 +319,44 @@ class MockCentralControllerRpcServiceStub
                    ::grpc::ClientContext* context,
                    ::grpc::CompletionQueue* cq));
 
+  MOCK_METHOD1(ScheduleRewriteBatchRaw,
+               ::grpc::ClientReaderWriterInterface<
+                   ::net_instaweb::ScheduleRewriteBatchRequest,
+                   ::net_instaweb::ScheduleRewriteBatchResponse>*(
+                   ::grpc::ClientContext*));
+
+  MOCK_METHOD1(LeaseExpensiveOperationsRaw,
+               ::grpc::ClientReaderWriterInterface<
+                   ::net_instaweb::ExpensiveOperationLeaseRequest,
+                   ::net_instaweb::ExpensiveOperationLeaseResponse>*(
+                   ::grpc::ClientContext*));
+
+  MOCK_METHOD3(AsyncScheduleRewriteBatchRaw,
+               ::grpc::ClientAsyncReaderWriterInterface<
+                   ::net_instaweb::ScheduleRewriteBatchRequest,
+                   ::net_instaweb::ScheduleRewriteBatchResponse>*(
+                   ::grpc::ClientContext*, ::grpc::CompletionQueue*, void*));
+
+  MOCK_METHOD3(AsyncLeaseExpensiveOperationsRaw,
+               ::grpc::ClientAsyncReaderWriterInterface<
+                   ::net_instaweb::ExpensiveOperationLeaseRequest,
+                   ::net_instaweb::ExpensiveOperationLeaseResponse>*(
+                   ::grpc::ClientContext*, ::grpc::CompletionQueue*, void*));
+
+  MOCK_METHOD2(PrepareAsyncScheduleRewriteBatchRaw,
+               ::grpc::ClientAsyncReaderWriterInterface<
+                   ::net_instaweb::ScheduleRewriteBatchRequest,
+                   ::net_instaweb::ScheduleRewriteBatchResponse>*(
+                   ::grpc::ClientContext* context,
+                   ::grpc::CompletionQueue* cq));
+
+  MOCK_METHOD2(PrepareAsyncLeaseExpensiveOperationsRaw,
+               ::grpc::ClientAsyncReaderWriterInterface<
+                   ::net_instaweb::ExpensiveOperationLeaseRequest,
+                   ::net_instaweb::ExpensiveOperationLeaseResponse>*(
+                   ::grpc::ClientContext* context,
+                   ::grpc::CompletionQueue* cq));
+
   void ExpectAsyncScheduleExpensiveOperation(
       ::grpc::ClientAsyncReaderWriterInterface<
           ::net_instaweb::ScheduleExpensiveOperationRequest,
@@ -283,6 +415,33 @@ class MockCentralControllerRpcServiceStub
                         Return(rw)));
   }
 
+  void ExpectAsyncScheduleRewriteBatch(
+      ::grpc::ClientAsyncReaderWriterInterface<
+          ::net_instaweb::ScheduleRewriteBatchRequest,
+          ::net_instaweb::ScheduleRewriteBatchResponse>* rw) {
+    // Configure the stub to invoke the callback and return rw in response to
+    // a client initiating a request.
+    EXPECT_CALL(*this, AsyncScheduleRewriteBatchRaw(_, nullptr /* queue */, _))
+        .WillOnce(DoAll(WithArgs<2>(Invoke([this](void* fv) {
+                          sequence_->Add(static_cast<Function*>(fv));
+                        })),
+                        Return(rw)));
+  }
+
+  void ExpectAsyncLeaseExpensiveOperations(
+      ::grpc::ClientAsyncReaderWriterInterface<
+          ::net_instaweb::ExpensiveOperationLeaseRequest,
+          ::net_instaweb::ExpensiveOperationLeaseResponse>* rw) {
+    // Configure the stub to invoke the callback and return rw in response to
+    // a client initiating a request.
+    EXPECT_CALL(*this,
+                AsyncLeaseExpensiveOperationsRaw(_, nullptr /* queue */, _))
+        .WillOnce(DoAll(WithArgs<2>(Invoke([this](void* fv) {
+                          sequence_->Add(static_cast<Function*>(fv));
+                        })),
+                        Return(rw)));
+  }
+
  private:
   Sequence* sequence_;
 };
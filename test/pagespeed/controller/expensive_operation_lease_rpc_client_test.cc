@@ -0,0 +1,390 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/controller/expensive_operation_lease_rpc_client.h"
+
+#include <memory>
+
+#include "pagespeed/controller/controller.pb.h"
+#include "pagespeed/controller/expensive_operation_callback.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/proto_matcher.h"
+#include "pagespeed/kernel/base/ref_counted_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+#include "pagespeed/kernel/thread/sequence.h"
+#include "pagespeed/kernel/util/grpc.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "test/pagespeed/controller/controller_grpc_mocks.h"
+#include "test/pagespeed/kernel/base/gmock.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+#include "test/pagespeed/kernel/base/message_handler_test_base.h"
+#include "test/pagespeed/kernel/thread/worker_test_base.h"
+
+using testing::_;
+using testing::HasSubstr;
+using testing::Invoke;
+using testing::InvokeWithoutArgs;
+using testing::IsEmpty;
+using testing::Not;
+using testing::WithArgs;
+
+namespace net_instaweb {
+
+namespace {
+
+typedef MockReaderWriterT<ExpensiveOperationLeaseRequest,
+                          ExpensiveOperationLeaseResponse>
+    MockReaderWriter;
+typedef ServerResponseQueue<ExpensiveOperationLeaseResponse> ResponseQueue;
+
+class MockExpensiveOperationCallback : public ExpensiveOperationCallback {
+ public:
+  MockExpensiveOperationCallback(Sequence* s) : ExpensiveOperationCallback(s) {
+    EXPECT_CALL(*this, RunImpl(_)).Times(0);
+    EXPECT_CALL(*this, CancelImpl()).Times(0);
+  }
+
+  MOCK_METHOD1(RunImpl,
+               void(std::unique_ptr<ExpensiveOperationContext>* context));
+  MOCK_METHOD0(CancelImpl, void());
+};
+
+class ExpensiveOperationLeaseRpcClientTest : public testing::Test {
+ public:
+  ExpensiveOperationLeaseRpcClientTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        worker_(2 /* max_workers */, "expensive_operation_lease_test",
+                thread_system_.get()),
+        sequence_(worker_.NewSequence()),
+        stub_(sequence_) {}
+
+  ~ExpensiveOperationLeaseRpcClientTest() override {
+    worker_.FreeSequence(sequence_);
+  }
+
+  void CreateClient(int idle_tokens) {
+    client_.reset(new ExpensiveOperationLeaseRpcClient(
+        nullptr /* queue */, thread_system_.get(), &handler_, idle_tokens));
+  }
+
+  // Start client_ on rw, with the server's messages coming from responses.
+  void StartClient(MockReaderWriter* rw, ResponseQueue* responses) {
+    EXPECT_CALL(*rw, Read(_, _))
+        .WillRepeatedly(Invoke(responses, &ResponseQueue::Read));
+    stub_.ExpectAsyncLeaseExpensiveOperations(rw);
+    client_->Start(&stub_);
+  }
+
+  // Expect the client to send request. Unless they are null, the server then
+  // answers with response and sync is notified.
+  void ExpectWrite(MockReaderWriter* rw, const char* request,
+                   ResponseQueue* responses, const char* response,
+                   WorkerTestBase::SyncPoint* sync) {
+    EXPECT_CALL(*rw, Write(EqualsProto(request), _))
+        .WillOnce(WithArgs<1>(
+            Invoke([this, responses, response, sync](void* tag) {
+              sequence_->Add(static_cast<Function*>(tag));
+              if (response != nullptr) {
+                responses->Respond(response);
+              }
+              if (sync != nullptr) {
+                sync->Notify();
+              }
+            })));
+  }
+
+  // Wait for everything already queued on sequence_ to run.
+  void DrainSequence() {
+    WorkerTestBase::SyncPoint sync(thread_system_.get());
+    sequence_->Add(new WorkerTestBase::NotifyRunFunction(&sync));
+    sync.Wait();
+  }
+
+  void HoldContext(std::unique_ptr<ExpensiveOperationContext>* ctx) {
+    held_context_.reset(ctx->release());
+  }
+
+ protected:
+  std::unique_ptr<ThreadSystem> thread_system_;
+  QueuedWorkerPool worker_;
+  QueuedWorkerPool::Sequence* sequence_;
+  MockCentralControllerRpcServiceStub stub_;
+  TestMessageHandler handler_;
+  RefCountedPtr<ExpensiveOperationLeaseRpcClient> client_;
+  std::unique_ptr<ExpensiveOperationContext> held_context_;
+};
+
+TEST_F(ExpensiveOperationLeaseRpcClientTest, LeasesTokensInOneRequest) {
+  WorkerTestBase::SyncPoint done(thread_system_.get());
+  WorkerTestBase::SyncPoint finished(thread_system_.get());
+  ResponseQueue responses(sequence_, thread_system_.get());
+  MockExpensiveOperationCallback* cb1 =
+      new MockExpensiveOperationCallback(sequence_);
+  MockExpensiveOperationCallback* cb2 =
+      new MockExpensiveOperationCallback(sequence_);
+  MockReaderWriter* rw = new MockReaderWriter(sequence_);
+  {
+    ::testing::InSequence s;
+
+    // Both operations were queued before the stream was up, so they are
+    // asked for together, and granted together.
+    ExpectWrite(rw, "acquire: 2", &responses, "granted: 2", nullptr);
+    EXPECT_CALL(*cb1, RunImpl(_));
+
+    // The first token is handed back as soon as its operation is done.
+    ExpectWrite(rw, "release: 1", &responses, nullptr, nullptr);
+    EXPECT_CALL(*cb2, RunImpl(_));
+
+    // The second waits for that Write to complete.
+    ExpectWrite(rw, "release: 1", &responses, nullptr, &done);
+
+    rw->ExpectFinishAndNotify(::grpc::Status(), &finished);
+  }
+
+  CreateClient(0 /* idle_tokens */);
+  EXPECT_TRUE(client_->ScheduleExpensiveOperation(cb1));
+  EXPECT_TRUE(client_->ScheduleExpensiveOperation(cb2));
+  StartClient(rw, &responses);
+  done.Wait();
+  DrainSequence();
+  EXPECT_EQ(0, client_->NumOutstanding());
+
+  responses.Fail();
+  finished.Wait();
+}
+
+TEST_F(ExpensiveOperationLeaseRpcClientTest, SurplusGrantIsReturned) {
+  WorkerTestBase::SyncPoint done(thread_system_.get());
+  WorkerTestBase::SyncPoint finished(thread_system_.get());
+  ResponseQueue responses(sequence_, thread_system_.get());
+  MockExpensiveOperationCallback* cb1 =
+      new MockExpensiveOperationCallback(sequence_);
+  MockExpensiveOperationCallback* cb2 =
+      new MockExpensiveOperationCallback(sequence_);
+  MockReaderWriter* rw = new MockReaderWriter(sequence_);
+  {
+    ::testing::InSequence s;
+
+    ExpectWrite(rw, "acquire: 1", &responses, "granted: 1", nullptr);
+
+    // While the first operation runs, a second comes along and a token is
+    // asked for it.
+    EXPECT_CALL(*cb1, RunImpl(_)).WillOnce(InvokeWithoutArgs([this, cb2]() {
+      EXPECT_TRUE(client_->ScheduleExpensiveOperation(cb2));
+    }));
+    ExpectWrite(rw, "acquire: 1", &responses, "granted: 1", nullptr);
+
+    // The first operation's token goes straight to the second, so the one
+    // granted for it isn't needed and goes back.
+    ExpectWrite(rw, "release: 1", &responses, nullptr, nullptr);
+    EXPECT_CALL(*cb2, RunImpl(_));
+    ExpectWrite(rw, "release: 1", &responses, nullptr, &done);
+
+    rw->ExpectFinishAndNotify(::grpc::Status(), &finished);
+  }
+
+  CreateClient(0 /* idle_tokens */);
+  EXPECT_TRUE(client_->ScheduleExpensiveOperation(cb1));
+  StartClient(rw, &responses);
+  done.Wait();
+  DrainSequence();
+  EXPECT_EQ(0, client_->NumOutstanding());
+
+  responses.Fail();
+  finished.Wait();
+}
+
+TEST_F(ExpensiveOperationLeaseRpcClientTest, PartialDenial) {
+  WorkerTestBase::SyncPoint done(thread_system_.get());
+  WorkerTestBase::SyncPoint finished(thread_system_.get());
+  ResponseQueue responses(sequence_, thread_system_.get());
+  MockExpensiveOperationCallback* cb1 =
+      new MockExpensiveOperationCallback(sequence_);
+  MockExpensiveOperationCallback* cb2 =
+      new MockExpensiveOperationCallback(sequence_);
+  MockExpensiveOperationCallback* cb3 =
+      new MockExpensiveOperationCallback(sequence_);
+  MockReaderWriter* rw = new MockReaderWriter(sequence_);
+  {
+    ::testing::InSequence s;
+
+    // Of three tokens, one is granted, one denied, and the server is still
+    // thinking about the last.
+    ExpectWrite(rw, "acquire: 3", &responses, "granted: 1 denied: 1",
+                nullptr);
+
+    // The first operation runs and the second is cancelled. The third
+    // remains covered by the outstanding request, so it waits, and gets the
+    // first operation's token when that is done.
+    EXPECT_CALL(*cb1, RunImpl(_));
+    EXPECT_CALL(*cb2, CancelImpl());
+    EXPECT_CALL(*cb3, RunImpl(_));
+
+    // Now the server denies the last token, which nobody is waiting for.
+    ExpectWrite(rw, "release: 1", &responses, "denied: 1", &done);
+
+    rw->ExpectFinishAndNotify(::grpc::Status(), &finished);
+  }
+
+  CreateClient(0 /* idle_tokens */);
+  EXPECT_TRUE(client_->ScheduleExpensiveOperation(cb1));
+  EXPECT_TRUE(client_->ScheduleExpensiveOperation(cb2));
+  EXPECT_TRUE(client_->ScheduleExpensiveOperation(cb3));
+  StartClient(rw, &responses);
+  done.Wait();
+  DrainSequence();
+  EXPECT_EQ(0, client_->NumOutstanding());
+
+  responses.Fail();
+  finished.Wait();
+}
+
+TEST_F(ExpensiveOperationLeaseRpcClientTest, IdleTokensRunOperationsAtOnce) {
+  WorkerTestBase::SyncPoint filled(thread_system_.get());
+  WorkerTestBase::SyncPoint ran(thread_system_.get());
+  WorkerTestBase::SyncPoint surplus(thread_system_.get());
+  WorkerTestBase::SyncPoint returned(thread_system_.get());
+  WorkerTestBase::SyncPoint finished(thread_system_.get());
+  ResponseQueue responses(sequence_, thread_system_.get());
+  MockExpensiveOperationCallback* cb =
+      new MockExpensiveOperationCallback(sequence_);
+  MockReaderWriter* rw = new MockReaderWriter(sequence_);
+  {
+    ::testing::InSequence s;
+
+    // The pool is filled as soon as the stream is up.
+    ExpectWrite(rw, "acquire: 2", &responses, "granted: 2", &filled);
+
+    // Taking a token from the pool asks for another, but the operation
+    // doesn't wait for it.
+    ExpectWrite(rw, "acquire: 1", &responses, nullptr, nullptr);
+    EXPECT_CALL(*cb, RunImpl(_))
+        .WillOnce(InvokeWithoutArgs(&ran, &WorkerTestBase::SyncPoint::Notify));
+
+    // The operation's token went back into the pool, so the one granted to
+    // refill it is surplus.
+    ExpectWrite(rw, "release: 1", &responses, nullptr, &surplus);
+
+    // Everything in the pool goes back at shutdown.
+    ExpectWrite(rw, "release: 2", &responses, nullptr, &returned);
+
+    rw->ExpectFinishAndNotify(::grpc::Status(), &finished);
+  }
+
+  CreateClient(2 /* idle_tokens */);
+  StartClient(rw, &responses);
+  filled.Wait();
+  DrainSequence();
+  EXPECT_EQ(0, client_->NumOutstanding());
+
+  EXPECT_TRUE(client_->ScheduleExpensiveOperation(cb));
+  ran.Wait();
+  DrainSequence();
+  EXPECT_EQ(0, client_->NumOutstanding());
+
+  responses.Respond("granted: 1");
+  surplus.Wait();
+
+  client_->ReturnIdleTokens();
+  returned.Wait();
+
+  responses.Fail();
+  finished.Wait();
+}
+
+TEST_F(ExpensiveOperationLeaseRpcClientTest, FailureCancelsWaitersAndRestart) {
+  WorkerTestBase::SyncPoint ran(thread_system_.get());
+  WorkerTestBase::SyncPoint cancelled(thread_system_.get());
+  WorkerTestBase::SyncPoint finished(thread_system_.get());
+  ResponseQueue responses(sequence_, thread_system_.get());
+  MockExpensiveOperationCallback* cb1 =
+      new MockExpensiveOperationCallback(sequence_);
+  MockExpensiveOperationCallback* cb2 =
+      new MockExpensiveOperationCallback(sequence_);
+  MockReaderWriter* rw = new MockReaderWriter(sequence_);
+  {
+    ::testing::InSequence s;
+
+    ExpectWrite(rw, "acquire: 2", &responses, "granted: 1", nullptr);
+
+    // The first operation runs, but holds on to its token.
+    EXPECT_CALL(*cb1, RunImpl(_))
+        .WillOnce(DoAll(
+            Invoke(this, &ExpensiveOperationLeaseRpcClientTest::HoldContext),
+            InvokeWithoutArgs(&ran, &WorkerTestBase::SyncPoint::Notify)));
+
+    // Then the stream breaks, which cancels the second.
+    rw->ExpectFinishAndNotify(::grpc::Status(), &finished);
+    EXPECT_CALL(*cb2, CancelImpl())
+        .WillOnce(Invoke(&cancelled, &WorkerTestBase::SyncPoint::Notify));
+  }
+
+  CreateClient(0 /* idle_tokens */);
+  EXPECT_TRUE(client_->ScheduleExpensiveOperation(cb1));
+  EXPECT_TRUE(client_->ScheduleExpensiveOperation(cb2));
+  StartClient(rw, &responses);
+  ran.Wait();
+
+  responses.Fail();
+  finished.Wait();
+  cancelled.Wait();
+  ASSERT_THAT(handler_.messages(), Not(IsEmpty()));
+  EXPECT_THAT(handler_.messages().back(),
+              HasSubstr("Couldn't get response from CentralController"));
+
+  // The broken stream refuses new operations, and doesn't try to hand back
+  // the token, since the server took it back when the stream went away.
+  EXPECT_TRUE(client_->HasFailed());
+  std::unique_ptr<MockExpensiveOperationCallback> refused(
+      new MockExpensiveOperationCallback(sequence_));
+  EXPECT_FALSE(client_->ScheduleExpensiveOperation(refused.get()));
+  held_context_.reset();
+  EXPECT_EQ(0, client_->NumOutstanding());
+
+  // A new stream, as CentralControllerRpcClient would start, works as usual.
+  WorkerTestBase::SyncPoint done(thread_system_.get());
+  WorkerTestBase::SyncPoint finished2(thread_system_.get());
+  ResponseQueue responses2(sequence_, thread_system_.get());
+  MockExpensiveOperationCallback* cb3 =
+      new MockExpensiveOperationCallback(sequence_);
+  MockReaderWriter* rw2 = new MockReaderWriter(sequence_);
+  {
+    ::testing::InSequence s;
+
+    ExpectWrite(rw2, "acquire: 1", &responses2, "granted: 1", nullptr);
+    EXPECT_CALL(*cb3, RunImpl(_));
+    ExpectWrite(rw2, "release: 1", &responses2, nullptr, &done);
+    rw2->ExpectFinishAndNotify(::grpc::Status(), &finished2);
+  }
+
+  CreateClient(0 /* idle_tokens */);
+  StartClient(rw2, &responses2);
+  EXPECT_TRUE(client_->ScheduleExpensiveOperation(cb3));
+  done.Wait();
+  DrainSequence();
+  EXPECT_EQ(0, client_->NumOutstanding());
+
+  responses2.Fail();
+  finished2.Wait();
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
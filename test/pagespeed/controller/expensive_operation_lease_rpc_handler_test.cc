@@ -0,0 +1,268 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/controller/expensive_operation_lease_rpc_handler.h"
+
+#include <memory>
+
+#include "pagespeed/controller/controller.grpc.pb.h"
+#include "pagespeed/controller/controller.pb.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/proto_matcher.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/util/grpc.h"
+#include "test/pagespeed/controller/grpc_server_test.h"
+#include "test/pagespeed/kernel/base/gmock.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+#include "test/pagespeed/kernel/thread/worker_test_base.h"
+
+using testing::_;
+using testing::DoAll;
+using testing::Eq;
+using testing::Invoke;
+using testing::InvokeWithoutArgs;
+using testing::WithArgs;
+
+namespace net_instaweb {
+
+namespace {
+
+// Free functions to allow use of WithArgs<N>(Invoke(, because gMock doesn't
+// understand our Functions.
+void RunFunction(Function* f) { f->CallRun(); }
+
+void CancelFunction(Function* f) { f->CallCancel(); }
+
+class MockExpensiveOperationController : public ExpensiveOperationController {
+ public:
+  MockExpensiveOperationController() {
+    EXPECT_CALL(*this, ScheduleExpensiveOperation(_)).Times(0);
+    EXPECT_CALL(*this, NotifyExpensiveOperationComplete()).Times(0);
+  }
+  ~MockExpensiveOperationController() override {}
+
+  MOCK_METHOD1(ScheduleExpensiveOperation, void(Function* cb));
+  MOCK_METHOD0(NotifyExpensiveOperationComplete, void());
+
+  void SaveFunction(Function* f) { saved_function_ = f; }
+
+  Function* saved_function_;
+};
+
+}  // namespace
+
+class ExpensiveOperationLeaseRpcHandlerTest : public GrpcServerTest {
+ public:
+  void SetUp() override {
+    GrpcServerTest::SetUp();
+    client_ = std::make_unique<ClientConnection>(ServerAddress());
+  }
+
+  void RegisterServices(::grpc::ServerBuilder* builder) override {
+    builder->RegisterService(&service_);
+  }
+
+  // gRPC functions can only safely be called from the server thread. Since
+  // Start() is one of those, provide a wrapper for that.
+  void StartOnServerThread(ExpensiveOperationLeaseRpcHandler* handler) {
+    QueueFunctionForServerThread(
+        MakeFunction<ExpensiveOperationLeaseRpcHandler>(
+            handler, &ExpensiveOperationLeaseRpcHandler::Start));
+  }
+
+  void StartHandler() {
+    StartOnServerThread(new ExpensiveOperationLeaseRpcHandler(
+        &service_, queue_.get(), &mock_controller_));
+  }
+
+ protected:
+  class ClientConnection : public BaseClientConnection {
+   public:
+    explicit ClientConnection(const GoogleString& address)
+        : BaseClientConnection(address),
+          stub_(CentralControllerRpcService::NewStub(channel_)),
+          reader_writer_(stub_->LeaseExpensiveOperations(&client_ctx_)) {}
+
+    std::unique_ptr<CentralControllerRpcService::Stub> stub_;
+    std::unique_ptr<::grpc::ClientReaderWriter<
+        ExpensiveOperationLeaseRequest, ExpensiveOperationLeaseResponse>>
+        reader_writer_;
+  };
+
+  void SendRequest(int acquire, int release) {
+    ExpensiveOperationLeaseRequest req;
+    req.set_acquire(acquire);
+    req.set_release(release);
+    ASSERT_THAT(client_->reader_writer_->Write(req), Eq(true));
+  }
+
+  void ExpectResponse(const GoogleString& ascii_proto) {
+    ExpensiveOperationLeaseResponse resp;
+    ASSERT_THAT(client_->reader_writer_->Read(&resp), Eq(true));
+    EXPECT_THAT(resp, EqualsProto(ascii_proto));
+  }
+
+  void ExpectFinalStatus(const ::grpc::StatusCode& expected_code) {
+    ::grpc::Status status = client_->reader_writer_->Finish();
+    EXPECT_THAT(status.error_code(), Eq(expected_code));
+  }
+
+  CentralControllerRpcService::AsyncService service_;
+  std::unique_ptr<ClientConnection> client_;
+  MockExpensiveOperationController mock_controller_;
+};
+
+namespace {
+
+TEST_F(ExpensiveOperationLeaseRpcHandlerTest, DecisionsAreBatched) {
+  WorkerTestBase::SyncPoint sync(thread_system_.get());
+  EXPECT_CALL(mock_controller_, ScheduleExpensiveOperation(_))
+      .WillOnce(WithArgs<0>(Invoke(&RunFunction)))
+      .WillOnce(WithArgs<0>(Invoke(&CancelFunction)))
+      .WillOnce(WithArgs<0>(Invoke(&RunFunction)));
+  EXPECT_CALL(mock_controller_, NotifyExpensiveOperationComplete())
+      .WillOnce(testing::Return())
+      .WillOnce(InvokeWithoutArgs(&sync, &WorkerTestBase::SyncPoint::Notify));
+  StartHandler();
+
+  SendRequest(3 /* acquire */, 0 /* release */);
+  // The first grant goes out right away, the other two decisions are made
+  // while that Write is in flight and so are sent together.
+  ExpectResponse("granted: 1");
+  ExpectResponse("granted: 1 denied: 1");
+
+  SendRequest(0 /* acquire */, 2 /* release */);
+  sync.Wait();
+}
+
+TEST_F(ExpensiveOperationLeaseRpcHandlerTest, ReleaseAndAcquireTogether) {
+  WorkerTestBase::SyncPoint sync(thread_system_.get());
+  {
+    ::testing::InSequence s;
+    EXPECT_CALL(mock_controller_, ScheduleExpensiveOperation(_))
+        .WillOnce(WithArgs<0>(Invoke(&RunFunction)));
+    // The release is processed before the acquire, so the controller can hand
+    // the same token straight back.
+    EXPECT_CALL(mock_controller_, NotifyExpensiveOperationComplete())
+        .Times(1);
+    EXPECT_CALL(mock_controller_, ScheduleExpensiveOperation(_))
+        .WillOnce(WithArgs<0>(Invoke(&RunFunction)));
+    EXPECT_CALL(mock_controller_, NotifyExpensiveOperationComplete())
+        .WillOnce(
+            InvokeWithoutArgs(&sync, &WorkerTestBase::SyncPoint::Notify));
+  }
+  StartHandler();
+
+  SendRequest(1 /* acquire */, 0 /* release */);
+  ExpectResponse("granted: 1");
+  SendRequest(1 /* acquire */, 1 /* release */);
+  ExpectResponse("granted: 1");
+  SendRequest(0 /* acquire */, 1 /* release */);
+  sync.Wait();
+}
+
+TEST_F(ExpensiveOperationLeaseRpcHandlerTest, ClientDisconnectReleasesTokens) {
+  WorkerTestBase::SyncPoint func_saved(thread_system_.get());
+  WorkerTestBase::SyncPoint all_released(thread_system_.get());
+  int released = 0;
+  EXPECT_CALL(mock_controller_, ScheduleExpensiveOperation(_))
+      .WillOnce(WithArgs<0>(Invoke(&RunFunction)))
+      .WillOnce(DoAll(
+          WithArgs<0>(Invoke(&mock_controller_,
+                             &MockExpensiveOperationController::SaveFunction)),
+          InvokeWithoutArgs(&func_saved, &WorkerTestBase::SyncPoint::Notify)));
+  // Both tokens must come back: the held one as soon as the server notices the
+  // client is gone, the other once the controller grants it.
+  EXPECT_CALL(mock_controller_, NotifyExpensiveOperationComplete())
+      .Times(2)
+      .WillRepeatedly(InvokeWithoutArgs([&released, &all_released]() {
+        if (++released == 2) {
+          all_released.Notify();
+        }
+      }));
+  StartHandler();
+
+  SendRequest(2 /* acquire */, 0 /* release */);
+  ExpectResponse("granted: 1");
+  func_saved.Wait();
+  client_.reset();
+
+  // Now "wake up" the server and have it grant the second token.
+  QueueFunctionForServerThread(mock_controller_.saved_function_);
+  all_released.Wait();
+}
+
+TEST_F(ExpensiveOperationLeaseRpcHandlerTest, DisconnectWhileWaitingForDeny) {
+  WorkerTestBase::SyncPoint func_saved(thread_system_.get());
+  WorkerTestBase::SyncPoint func_run(thread_system_.get());
+  EXPECT_CALL(mock_controller_, ScheduleExpensiveOperation(_))
+      .WillOnce(DoAll(
+          WithArgs<0>(Invoke(&mock_controller_,
+                             &MockExpensiveOperationController::SaveFunction)),
+          InvokeWithoutArgs(&func_saved, &WorkerTestBase::SyncPoint::Notify)));
+  EXPECT_CALL(mock_controller_, NotifyExpensiveOperationComplete()).Times(0);
+  StartHandler();
+
+  SendRequest(1 /* acquire */, 0 /* release */);
+  func_saved.Wait();
+  client_.reset();
+
+  // Deny the token, which must not call NotifyExpensiveOperationComplete.
+  QueueFunctionForServerThread(
+      MakeFunction(mock_controller_.saved_function_, &Function::CallCancel));
+  // Queue another event to notify once that has been processed.
+  QueueFunctionForServerThread(
+      MakeFunction(&func_run, &WorkerTestBase::SyncPoint::Notify));
+  func_run.Wait();
+}
+
+TEST_F(ExpensiveOperationLeaseRpcHandlerTest, ReleaseMoreThanHeld) {
+  WorkerTestBase::SyncPoint sync(thread_system_.get());
+  EXPECT_CALL(mock_controller_, ScheduleExpensiveOperation(_))
+      .WillOnce(WithArgs<0>(Invoke(&RunFunction)));
+  // The one token we did hold is released when the client is cut off.
+  EXPECT_CALL(mock_controller_, NotifyExpensiveOperationComplete())
+      .WillOnce(InvokeWithoutArgs(&sync, &WorkerTestBase::SyncPoint::Notify));
+  StartHandler();
+
+  SendRequest(1 /* acquire */, 0 /* release */);
+  ExpectResponse("granted: 1");
+  SendRequest(0 /* acquire */, 2 /* release */);
+  ExpectFinalStatus(::grpc::StatusCode::ABORTED);
+  sync.Wait();
+}
+
+TEST_F(ExpensiveOperationLeaseRpcHandlerTest, NegativeAcquire) {
+  StartHandler();
+
+  SendRequest(-1 /* acquire */, 0 /* release */);
+  ExpectFinalStatus(::grpc::StatusCode::ABORTED);
+}
+
+TEST_F(ExpensiveOperationLeaseRpcHandlerTest, TooManyTokens) {
+  StartHandler();
+
+  SendRequest(ExpensiveOperationLeaseRpcHandler::kMaxTokensPerClient + 1,
+              0 /* release */);
+  ExpectFinalStatus(::grpc::StatusCode::ABORTED);
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
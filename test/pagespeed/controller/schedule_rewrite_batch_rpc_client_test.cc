@@ -0,0 +1,313 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/controller/schedule_rewrite_batch_rpc_client.h"
+
+#include <memory>
+
+#include "pagespeed/controller/controller.pb.h"
+#include "pagespeed/controller/schedule_rewrite_callback.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/proto_matcher.h"
+#include "pagespeed/kernel/base/ref_counted_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+#include "pagespeed/kernel/thread/sequence.h"
+#include "pagespeed/kernel/util/grpc.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "test/pagespeed/controller/controller_grpc_mocks.h"
+#include "test/pagespeed/kernel/base/gmock.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+#include "test/pagespeed/kernel/base/message_handler_test_base.h"
+#include "test/pagespeed/kernel/thread/worker_test_base.h"
+
+using testing::_;
+using testing::HasSubstr;
+using testing::Invoke;
+using testing::InvokeWithoutArgs;
+using testing::IsEmpty;
+using testing::Not;
+using testing::WithArgs;
+
+namespace net_instaweb {
+
+namespace {
+
+typedef MockReaderWriterT<ScheduleRewriteBatchRequest,
+                          ScheduleRewriteBatchResponse>
+    MockReaderWriter;
+typedef ServerResponseQueue<ScheduleRewriteBatchResponse> ResponseQueue;
+
+class MockScheduleRewriteCallback : public ScheduleRewriteCallback {
+ public:
+  MockScheduleRewriteCallback(const GoogleString& key, Sequence* s)
+      : ScheduleRewriteCallback(key, s) {
+    EXPECT_CALL(*this, RunImpl(_)).Times(0);
+    EXPECT_CALL(*this, CancelImpl()).Times(0);
+  }
+
+  MOCK_METHOD1(RunImpl, void(std::unique_ptr<ScheduleRewriteContext>* context));
+  MOCK_METHOD0(CancelImpl, void());
+};
+
+class ScheduleRewriteBatchRpcClientTest : public testing::Test {
+ public:
+  ScheduleRewriteBatchRpcClientTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        worker_(2 /* max_workers */, "schedule_rewrite_batch_test",
+                thread_system_.get()),
+        sequence_(worker_.NewSequence()),
+        stub_(sequence_) {}
+
+  ~ScheduleRewriteBatchRpcClientTest() override {
+    worker_.FreeSequence(sequence_);
+  }
+
+  void CreateClient() {
+    client_.reset(new ScheduleRewriteBatchRpcClient(
+        nullptr /* queue */, thread_system_.get(), &handler_));
+  }
+
+  // Start client_ on rw, with the server's messages coming from responses.
+  void StartClient(MockReaderWriter* rw, ResponseQueue* responses) {
+    EXPECT_CALL(*rw, Read(_, _))
+        .WillRepeatedly(Invoke(responses, &ResponseQueue::Read));
+    stub_.ExpectAsyncScheduleRewriteBatch(rw);
+    client_->Start(&stub_);
+  }
+
+  // Expect the client to send request. Unless they are null, the server then
+  // answers with response and sync is notified.
+  void ExpectWrite(MockReaderWriter* rw, const char* request,
+                   ResponseQueue* responses, const char* response,
+                   WorkerTestBase::SyncPoint* sync) {
+    EXPECT_CALL(*rw, Write(EqualsProto(request), _))
+        .WillOnce(WithArgs<1>(
+            Invoke([this, responses, response, sync](void* tag) {
+              sequence_->Add(static_cast<Function*>(tag));
+              if (response != nullptr) {
+                responses->Respond(response);
+              }
+              if (sync != nullptr) {
+                sync->Notify();
+              }
+            })));
+  }
+
+  // Wait for everything already queued on sequence_ to run.
+  void DrainSequence() {
+    WorkerTestBase::SyncPoint sync(thread_system_.get());
+    sequence_->Add(new WorkerTestBase::NotifyRunFunction(&sync));
+    sync.Wait();
+  }
+
+  static void MarkFailed(std::unique_ptr<ScheduleRewriteContext>* ctx) {
+    (*ctx)->MarkFailed();
+  }
+
+  void HoldContext(std::unique_ptr<ScheduleRewriteContext>* ctx) {
+    held_context_.reset(ctx->release());
+  }
+
+ protected:
+  std::unique_ptr<ThreadSystem> thread_system_;
+  QueuedWorkerPool worker_;
+  QueuedWorkerPool::Sequence* sequence_;
+  MockCentralControllerRpcServiceStub stub_;
+  TestMessageHandler handler_;
+  RefCountedPtr<ScheduleRewriteBatchRpcClient> client_;
+  std::unique_ptr<ScheduleRewriteContext> held_context_;
+};
+
+TEST_F(ScheduleRewriteBatchRpcClientTest, BatchesKeysAndReportsResults) {
+  WorkerTestBase::SyncPoint done(thread_system_.get());
+  WorkerTestBase::SyncPoint finished(thread_system_.get());
+  ResponseQueue responses(sequence_, thread_system_.get());
+  MockScheduleRewriteCallback* cb_a =
+      new MockScheduleRewriteCallback("a", sequence_);
+  MockScheduleRewriteCallback* cb_b =
+      new MockScheduleRewriteCallback("b", sequence_);
+  MockScheduleRewriteCallback* cb_c =
+      new MockScheduleRewriteCallback("c", sequence_);
+  MockReaderWriter* rw = new MockReaderWriter(sequence_);
+  {
+    ::testing::InSequence s;
+
+    // All three keys were queued before the stream was up, so they go out
+    // in a single message.
+    ExpectWrite(rw,
+                "rewrites { id: 0 key: 'a' } "
+                "rewrites { id: 1 key: 'b' } "
+                "rewrites { id: 2 key: 'c' }",
+                &responses,
+                "decisions { id: 0 ok_to_proceed: true } "
+                "decisions { id: 1 ok_to_proceed: true } "
+                "decisions { id: 2 ok_to_proceed: false }",
+                nullptr);
+
+    // The first rewrite succeeds, which is reported right away.
+    EXPECT_CALL(*cb_a, RunImpl(_));
+    ExpectWrite(rw, "rewrites { id: 0 status: SUCCESS }", &responses, nullptr,
+                nullptr);
+
+    // The second fails, which is reported once that Write completes.
+    EXPECT_CALL(*cb_b, RunImpl(_))
+        .WillOnce(Invoke(&ScheduleRewriteBatchRpcClientTest::MarkFailed));
+    EXPECT_CALL(*cb_c, CancelImpl());
+    ExpectWrite(rw, "rewrites { id: 1 status: FAILED }", &responses, nullptr,
+                &done);
+
+    rw->ExpectFinishAndNotify(::grpc::Status(), &finished);
+  }
+
+  CreateClient();
+  EXPECT_TRUE(client_->ScheduleRewrite(cb_a));
+  EXPECT_TRUE(client_->ScheduleRewrite(cb_b));
+  EXPECT_TRUE(client_->ScheduleRewrite(cb_c));
+  StartClient(rw, &responses);
+  done.Wait();
+  DrainSequence();
+  EXPECT_EQ(0, client_->NumOutstanding());
+
+  responses.Fail();
+  finished.Wait();
+}
+
+TEST_F(ScheduleRewriteBatchRpcClientTest, DecisionsArriveSeparately) {
+  WorkerTestBase::SyncPoint done(thread_system_.get());
+  WorkerTestBase::SyncPoint finished(thread_system_.get());
+  ResponseQueue responses(sequence_, thread_system_.get());
+  MockScheduleRewriteCallback* cb_a =
+      new MockScheduleRewriteCallback("a", sequence_);
+  MockScheduleRewriteCallback* cb_b =
+      new MockScheduleRewriteCallback("b", sequence_);
+  MockReaderWriter* rw = new MockReaderWriter(sequence_);
+  {
+    ::testing::InSequence s;
+
+    // The server only lets one rewrite run at a time, so it holds back its
+    // decision on the second key until the first is done.
+    ExpectWrite(rw, "rewrites { id: 0 key: 'a' } rewrites { id: 1 key: 'b' }",
+                &responses, "decisions { id: 0 ok_to_proceed: true }",
+                nullptr);
+    EXPECT_CALL(*cb_a, RunImpl(_));
+    ExpectWrite(rw, "rewrites { id: 0 status: SUCCESS }", &responses,
+                "decisions { id: 1 ok_to_proceed: true }", nullptr);
+    EXPECT_CALL(*cb_b, RunImpl(_));
+    ExpectWrite(rw, "rewrites { id: 1 status: SUCCESS }", &responses, nullptr,
+                &done);
+
+    rw->ExpectFinishAndNotify(::grpc::Status(), &finished);
+  }
+
+  CreateClient();
+  EXPECT_TRUE(client_->ScheduleRewrite(cb_a));
+  EXPECT_TRUE(client_->ScheduleRewrite(cb_b));
+  StartClient(rw, &responses);
+  done.Wait();
+  DrainSequence();
+  EXPECT_EQ(0, client_->NumOutstanding());
+
+  responses.Fail();
+  finished.Wait();
+}
+
+TEST_F(ScheduleRewriteBatchRpcClientTest, FailureCancelsWaitersAndRestart) {
+  WorkerTestBase::SyncPoint ran(thread_system_.get());
+  WorkerTestBase::SyncPoint cancelled(thread_system_.get());
+  WorkerTestBase::SyncPoint finished(thread_system_.get());
+  ResponseQueue responses(sequence_, thread_system_.get());
+  MockScheduleRewriteCallback* cb_a =
+      new MockScheduleRewriteCallback("a", sequence_);
+  MockScheduleRewriteCallback* cb_b =
+      new MockScheduleRewriteCallback("b", sequence_);
+  MockReaderWriter* rw = new MockReaderWriter(sequence_);
+  {
+    ::testing::InSequence s;
+
+    ExpectWrite(rw, "rewrites { id: 0 key: 'a' } rewrites { id: 1 key: 'b' }",
+                &responses, "decisions { id: 0 ok_to_proceed: true }",
+                nullptr);
+
+    // The first rewrite runs, but doesn't finish before the stream breaks.
+    EXPECT_CALL(*cb_a, RunImpl(_))
+        .WillOnce(DoAll(
+            Invoke(this, &ScheduleRewriteBatchRpcClientTest::HoldContext),
+            InvokeWithoutArgs(&ran, &WorkerTestBase::SyncPoint::Notify)));
+
+    // When it does, the second is cancelled.
+    rw->ExpectFinishAndNotify(::grpc::Status(), &finished);
+    EXPECT_CALL(*cb_b, CancelImpl())
+        .WillOnce(Invoke(&cancelled, &WorkerTestBase::SyncPoint::Notify));
+  }
+
+  CreateClient();
+  EXPECT_TRUE(client_->ScheduleRewrite(cb_a));
+  EXPECT_TRUE(client_->ScheduleRewrite(cb_b));
+  StartClient(rw, &responses);
+  ran.Wait();
+
+  responses.Fail();
+  finished.Wait();
+  cancelled.Wait();
+  ASSERT_THAT(handler_.messages(), Not(IsEmpty()));
+  EXPECT_THAT(handler_.messages().back(),
+              HasSubstr("Couldn't get response from CentralController"));
+
+  // The broken stream refuses new rewrites, and doesn't try to report the
+  // result, since the server failed the rewrite when the stream went away.
+  EXPECT_TRUE(client_->HasFailed());
+  std::unique_ptr<MockScheduleRewriteCallback> refused(
+      new MockScheduleRewriteCallback("c", sequence_));
+  EXPECT_FALSE(client_->ScheduleRewrite(refused.get()));
+  held_context_.reset();
+  EXPECT_EQ(0, client_->NumOutstanding());
+
+  // A new stream, as CentralControllerRpcClient would start, works as usual.
+  WorkerTestBase::SyncPoint done(thread_system_.get());
+  WorkerTestBase::SyncPoint finished2(thread_system_.get());
+  ResponseQueue responses2(sequence_, thread_system_.get());
+  MockScheduleRewriteCallback* cb_c =
+      new MockScheduleRewriteCallback("c", sequence_);
+  MockReaderWriter* rw2 = new MockReaderWriter(sequence_);
+  {
+    ::testing::InSequence s;
+
+    ExpectWrite(rw2, "rewrites { id: 0 key: 'c' }", &responses2,
+                "decisions { id: 0 ok_to_proceed: true }", nullptr);
+    EXPECT_CALL(*cb_c, RunImpl(_));
+    ExpectWrite(rw2, "rewrites { id: 0 status: SUCCESS }", &responses2,
+                nullptr, &done);
+    rw2->ExpectFinishAndNotify(::grpc::Status(), &finished2);
+  }
+
+  CreateClient();
+  StartClient(rw2, &responses2);
+  EXPECT_TRUE(client_->ScheduleRewrite(cb_c));
+  done.Wait();
+  DrainSequence();
+  EXPECT_EQ(0, client_->NumOutstanding());
+
+  responses2.Fail();
+  finished2.Wait();
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -0,0 +1,291 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/controller/schedule_rewrite_batch_rpc_handler.h"
+
+#include <memory>
+
+#include "pagespeed/controller/controller.grpc.pb.h"
+#include "pagespeed/controller/controller.pb.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/proto_matcher.h"
+#include "pagespeed/kernel/base/proto_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/util/grpc.h"
+#include "test/pagespeed/controller/grpc_server_test.h"
+#include "test/pagespeed/kernel/base/gmock.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+#include "test/pagespeed/kernel/thread/worker_test_base.h"
+
+using testing::_;
+using testing::DoAll;
+using testing::Eq;
+using testing::Invoke;
+using testing::InvokeWithoutArgs;
+using testing::WithArgs;
+
+namespace net_instaweb {
+
+namespace {
+
+// Free functions to allow use of WithArgs<N>(Invoke(, because gMock doesn't
+// understand our Functions.
+void RunFunction(Function* f) { f->CallRun(); }
+
+void CancelFunction(Function* f) { f->CallCancel(); }
+
+class MockScheduleRewriteController : public ScheduleRewriteController {
+ public:
+  MockScheduleRewriteController() {
+    EXPECT_CALL(*this, ScheduleRewrite(_, _)).Times(0);
+    EXPECT_CALL(*this, NotifyRewriteComplete(_)).Times(0);
+    EXPECT_CALL(*this, NotifyRewriteFailed(_)).Times(0);
+  }
+  ~MockScheduleRewriteController() override {}
+
+  MOCK_METHOD2(ScheduleRewrite, void(const GoogleString& key, Function* cb));
+  MOCK_METHOD1(NotifyRewriteComplete, void(const GoogleString& key));
+  MOCK_METHOD1(NotifyRewriteFailed, void(const GoogleString& key));
+
+  void SaveFunction(Function* f) { saved_function_ = f; }
+
+  Function* saved_function_;
+};
+
+}  // namespace
+
+class ScheduleRewriteBatchRpcHandlerTest : public GrpcServerTest {
+ public:
+  void SetUp() override {
+    GrpcServerTest::SetUp();
+    client_ = std::make_unique<ClientConnection>(ServerAddress());
+  }
+
+  void RegisterServices(::grpc::ServerBuilder* builder) override {
+    builder->RegisterService(&service_);
+  }
+
+  // gRPC functions can only safely be called from the server thread. Since
+  // Start() is one of those, provide a wrapper for that.
+  void StartOnServerThread(ScheduleRewriteBatchRpcHandler* handler) {
+    QueueFunctionForServerThread(MakeFunction<ScheduleRewriteBatchRpcHandler>(
+        handler, &ScheduleRewriteBatchRpcHandler::Start));
+  }
+
+  void StartHandler() {
+    StartOnServerThread(new ScheduleRewriteBatchRpcHandler(
+        &service_, queue_.get(), &mock_controller_));
+  }
+
+ protected:
+  class ClientConnection : public BaseClientConnection {
+   public:
+    explicit ClientConnection(const GoogleString& address)
+        : BaseClientConnection(address),
+          stub_(CentralControllerRpcService::NewStub(channel_)),
+          reader_writer_(stub_->ScheduleRewriteBatch(&client_ctx_)) {}
+
+    std::unique_ptr<CentralControllerRpcService::Stub> stub_;
+    std::unique_ptr<::grpc::ClientReaderWriter<ScheduleRewriteBatchRequest,
+                                               ScheduleRewriteBatchResponse>>
+        reader_writer_;
+  };
+
+  void SendRequest(const GoogleString& ascii_proto) {
+    ScheduleRewriteBatchRequest req;
+    ASSERT_THAT(ParseTextFormatProtoFromString(ascii_proto, &req), Eq(true));
+    ASSERT_THAT(client_->reader_writer_->Write(req), Eq(true));
+  }
+
+  void ExpectResponse(const GoogleString& ascii_proto) {
+    ScheduleRewriteBatchResponse resp;
+    ASSERT_THAT(client_->reader_writer_->Read(&resp), Eq(true));
+    EXPECT_THAT(resp, EqualsProto(ascii_proto));
+  }
+
+  void ExpectFinalStatus(const ::grpc::StatusCode& expected_code) {
+    ::grpc::Status status = client_->reader_writer_->Finish();
+    EXPECT_THAT(status.error_code(), Eq(expected_code));
+  }
+
+  CentralControllerRpcService::AsyncService service_;
+  std::unique_ptr<ClientConnection> client_;
+  MockScheduleRewriteController mock_controller_;
+};
+
+namespace {
+
+TEST_F(ScheduleRewriteBatchRpcHandlerTest, DecisionsAreBatched) {
+  WorkerTestBase::SyncPoint sync(thread_system_.get());
+  EXPECT_CALL(mock_controller_, ScheduleRewrite("a", _))
+      .WillOnce(WithArgs<1>(Invoke(&RunFunction)));
+  EXPECT_CALL(mock_controller_, ScheduleRewrite("b", _))
+      .WillOnce(WithArgs<1>(Invoke(&CancelFunction)));
+  EXPECT_CALL(mock_controller_, ScheduleRewrite("c", _))
+      .WillOnce(WithArgs<1>(Invoke(&RunFunction)));
+  EXPECT_CALL(mock_controller_, NotifyRewriteComplete("a")).Times(1);
+  EXPECT_CALL(mock_controller_, NotifyRewriteFailed("c"))
+      .WillOnce(InvokeWithoutArgs(&sync, &WorkerTestBase::SyncPoint::Notify));
+  StartHandler();
+
+  SendRequest(
+      "rewrites { id: 1 key: \"a\" } "
+      "rewrites { id: 2 key: \"b\" } "
+      "rewrites { id: 3 key: \"c\" }");
+  // The first decision goes out right away, the other two are made while
+  // that Write is in flight and so are sent together.
+  ExpectResponse("decisions { id: 1 ok_to_proceed: true }");
+  ExpectResponse(
+      "decisions { id: 2 ok_to_proceed: false } "
+      "decisions { id: 3 ok_to_proceed: true }");
+
+  SendRequest(
+      "rewrites { id: 1 status: SUCCESS } "
+      "rewrites { id: 3 status: FAILED }");
+  sync.Wait();
+}
+
+TEST_F(ScheduleRewriteBatchRpcHandlerTest, NewKeysAlongsideResults) {
+  WorkerTestBase::SyncPoint sync(thread_system_.get());
+  EXPECT_CALL(mock_controller_, ScheduleRewrite("a", _))
+      .WillOnce(WithArgs<1>(Invoke(&RunFunction)));
+  EXPECT_CALL(mock_controller_, NotifyRewriteComplete("a")).Times(1);
+  EXPECT_CALL(mock_controller_, ScheduleRewrite("b", _))
+      .WillOnce(WithArgs<1>(Invoke(&RunFunction)));
+  EXPECT_CALL(mock_controller_, NotifyRewriteComplete("b"))
+      .WillOnce(InvokeWithoutArgs(&sync, &WorkerTestBase::SyncPoint::Notify));
+  StartHandler();
+
+  SendRequest("rewrites { id: 7 key: \"a\" }");
+  ExpectResponse("decisions { id: 7 ok_to_proceed: true }");
+  SendRequest(
+      "rewrites { id: 7 status: SUCCESS } "
+      "rewrites { id: 8 key: \"b\" }");
+  ExpectResponse("decisions { id: 8 ok_to_proceed: true }");
+  SendRequest("rewrites { id: 8 status: SUCCESS }");
+  sync.Wait();
+}
+
+TEST_F(ScheduleRewriteBatchRpcHandlerTest, ClientDisconnectDuringRewrite) {
+  WorkerTestBase::SyncPoint func_saved(thread_system_.get());
+  WorkerTestBase::SyncPoint running_failed(thread_system_.get());
+  WorkerTestBase::SyncPoint waiting_failed(thread_system_.get());
+  EXPECT_CALL(mock_controller_, ScheduleRewrite("running", _))
+      .WillOnce(WithArgs<1>(Invoke(&RunFunction)));
+  EXPECT_CALL(mock_controller_, ScheduleRewrite("waiting", _))
+      .WillOnce(DoAll(
+          WithArgs<1>(Invoke(&mock_controller_,
+                             &MockScheduleRewriteController::SaveFunction)),
+          InvokeWithoutArgs(&func_saved, &WorkerTestBase::SyncPoint::Notify)));
+  // Both rewrites must be failed: the running one as soon as the server notices
+  // the client is gone, the waiting one once the controller lets it proceed.
+  EXPECT_CALL(mock_controller_, NotifyRewriteFailed("running"))
+      .WillOnce(InvokeWithoutArgs(&running_failed,
+                                  &WorkerTestBase::SyncPoint::Notify));
+  EXPECT_CALL(mock_controller_, NotifyRewriteFailed("waiting"))
+      .WillOnce(InvokeWithoutArgs(&waiting_failed,
+                                  &WorkerTestBase::SyncPoint::Notify));
+  StartHandler();
+
+  SendRequest(
+      "rewrites { id: 1 key: \"running\" } "
+      "rewrites { id: 2 key: \"waiting\" }");
+  ExpectResponse("decisions { id: 1 ok_to_proceed: true }");
+  func_saved.Wait();
+  client_.reset();
+
+  // Now "wake up" the server and have it allow the waiting rewrite.
+  QueueFunctionForServerThread(mock_controller_.saved_function_);
+  running_failed.Wait();
+  waiting_failed.Wait();
+}
+
+TEST_F(ScheduleRewriteBatchRpcHandlerTest, DisconnectWhileWaitingForDeny) {
+  WorkerTestBase::SyncPoint func_saved(thread_system_.get());
+  WorkerTestBase::SyncPoint func_run(thread_system_.get());
+  EXPECT_CALL(mock_controller_, ScheduleRewrite("broken", _))
+      .WillOnce(DoAll(
+          WithArgs<1>(Invoke(&mock_controller_,
+                             &MockScheduleRewriteController::SaveFunction)),
+          InvokeWithoutArgs(&func_saved, &WorkerTestBase::SyncPoint::Notify)));
+  EXPECT_CALL(mock_controller_, NotifyRewriteFailed("broken")).Times(0);
+  StartHandler();
+
+  SendRequest("rewrites { id: 1 key: \"broken\" }");
+  func_saved.Wait();
+  client_.reset();
+
+  // Deny the rewrite, which must not call NotifyRewriteFailed.
+  QueueFunctionForServerThread(
+      MakeFunction(mock_controller_.saved_function_, &Function::CallCancel));
+  // Queue another event to notify once that has been processed.
+  QueueFunctionForServerThread(
+      MakeFunction(&func_run, &WorkerTestBase::SyncPoint::Notify));
+  func_run.Wait();
+}
+
+TEST_F(ScheduleRewriteBatchRpcHandlerTest, NoKey) {
+  StartHandler();
+
+  SendRequest("rewrites { id: 1 }");
+  ExpectFinalStatus(::grpc::StatusCode::ABORTED);
+}
+
+TEST_F(ScheduleRewriteBatchRpcHandlerTest, DuplicateId) {
+  WorkerTestBase::SyncPoint sync(thread_system_.get());
+  EXPECT_CALL(mock_controller_, ScheduleRewrite("a", _))
+      .WillOnce(WithArgs<1>(Invoke(&RunFunction)));
+  EXPECT_CALL(mock_controller_, NotifyRewriteFailed("a"))
+      .WillOnce(InvokeWithoutArgs(&sync, &WorkerTestBase::SyncPoint::Notify));
+  StartHandler();
+
+  SendRequest("rewrites { id: 1 key: \"a\" }");
+  ExpectResponse("decisions { id: 1 ok_to_proceed: true }");
+  SendRequest("rewrites { id: 1 key: \"b\" }");
+  ExpectFinalStatus(::grpc::StatusCode::ABORTED);
+  sync.Wait();
+}
+
+TEST_F(ScheduleRewriteBatchRpcHandlerTest, ResultForUnknownId) {
+  StartHandler();
+
+  SendRequest("rewrites { id: 1 status: SUCCESS }");
+  ExpectFinalStatus(::grpc::StatusCode::ABORTED);
+}
+
+TEST_F(ScheduleRewriteBatchRpcHandlerTest, ResultWhileWaiting) {
+  WorkerTestBase::SyncPoint sync(thread_system_.get());
+  EXPECT_CALL(mock_controller_, ScheduleRewrite("hello", _))
+      .WillOnce(WithArgs<1>(Invoke(
+          &mock_controller_, &MockScheduleRewriteController::SaveFunction)));
+  EXPECT_CALL(mock_controller_, NotifyRewriteFailed("hello"))
+      .WillOnce(InvokeWithoutArgs(&sync, &WorkerTestBase::SyncPoint::Notify));
+  StartHandler();
+
+  SendRequest("rewrites { id: 1 key: \"hello\" }");
+  SendRequest("rewrites { id: 1 status: SUCCESS }");
+
+  ExpectFinalStatus(::grpc::StatusCode::ABORTED);
+  QueueFunctionForServerThread(mock_controller_.saved_function_);
+  sync.Wait();
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -27,6 +27,7 @@
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/file_system.h"
 #include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/timer.h"
@@ -119,6 +120,30 @@ void FileSystemTest::TestWriteRead() {
                                        &buffer, &handler_));
 }
 
+// Write a named file, then read it into a SharedString.
+void FileSystemTest::TestReadFileToSharedString() {
+  GoogleString msg("Hello, world!");
+  GoogleString filename = WriteNewFile("/shared.txt", msg);
+  SharedString buffer("old contents");
+  SharedString old_buffer = buffer;
+  EXPECT_TRUE(file_system()->ReadFileToSharedString(
+      filename.c_str(), FileSystem::kUnlimitedSize, &buffer, &handler_));
+  EXPECT_EQ(msg, buffer.Value());
+  EXPECT_EQ("old contents", old_buffer.Value());
+
+  // Empty files, and the size limit.
+  EXPECT_FALSE(file_system()->ReadFileToSharedString(filename.c_str(), 5,
+                                                     &buffer, &handler_));
+  filename = WriteNewFile("/empty.txt", "");
+  EXPECT_TRUE(file_system()->ReadFileToSharedString(
+      filename.c_str(), FileSystem::kUnlimitedSize, &buffer, &handler_));
+  EXPECT_TRUE(buffer.empty());
+
+  DeleteRecursively(filename);
+  EXPECT_FALSE(file_system()->ReadFileToSharedString(
+      filename.c_str(), FileSystem::kUnlimitedSize, &buffer, &handler_));
+}
+
 // Write a temp file, then read it.
 void FileSystemTest::TestTemp() {
   GoogleString prefix = StrCat(test_tmpdir(), "/temp_prefix");
@@ -90,6 +90,7 @@ class FileSystemTest : public testing::Test {
   // Note: If you add a test below, please add invocations in:
   // AprFileSystemTest, StdioFileSystemTest, MemFileSystemTest.
   void TestWriteRead();
+  void TestReadFileToSharedString();
   void TestTemp();
   void TestAppend();
   void TestRename();
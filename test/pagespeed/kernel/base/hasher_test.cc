@@ -19,6 +19,8 @@
 
 #include "pagespeed/kernel/base/hasher.h"
 
+#include <memory>
+
 #include "base/logging.h"
 #include "test/pagespeed/kernel/base/gtest.h"
 
@@ -60,6 +62,15 @@ TEST(HasherTest, HashToUint64) {
                                 "\x31\x33\x70\x31\x33\x70"));
 }
 
+TEST(HasherTest, DefaultStreamHashesConcatenation) {
+  const DummyHasher hasher;
+  std::unique_ptr<Hasher::Stream> stream(hasher.NewStream());
+  stream->Update("0123");
+  stream->Update("456789");
+  stream->Update("abcdefghijklmnop");
+  EXPECT_EQ("0123456789abcdef", stream->RawFinalize());
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
@@ -19,7 +19,10 @@
 
 #include "pagespeed/kernel/base/md5_hasher.h"
 
+#include <memory>
+
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "test/pagespeed/kernel/base/gtest.h"
 
 namespace net_instaweb {
@@ -51,6 +54,19 @@ TEST_F(MD5HasherTest, HashesDiffer) {
             hasher.Hash(GoogleString(5001, 'z')));
 }
 
+TEST_F(MD5HasherTest, StreamMatchesOneShot) {
+  MD5Hasher hasher;
+  std::unique_ptr<Hasher::Stream> stream(hasher.NewStream());
+  stream->Update("foo");
+  stream->Update("");
+  stream->Update(GoogleString(5000, 'z'));
+  EXPECT_EQ(hasher.Hash(StrCat("foo", GoogleString(5000, 'z'))),
+            stream->Finalize());
+
+  std::unique_ptr<Hasher::Stream> empty_stream(hasher.NewStream());
+  EXPECT_EQ(hasher.RawHash(""), empty_stream->RawFinalize());
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
@@ -68,6 +68,11 @@ class MemFileSystemTest : public FileSystemTest {
 // Write a named file, then read it.
 TEST_F(MemFileSystemTest, TestWriteRead) { TestWriteRead(); }
 
+// Write a named file, then read it into a SharedString.
+TEST_F(MemFileSystemTest, TestReadFileToSharedString) {
+  TestReadFileToSharedString();
+}
+
 // Write a temp file, then read it.
 TEST_F(MemFileSystemTest, TestTemp) { TestTemp(); }
 
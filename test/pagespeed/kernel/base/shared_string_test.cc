@@ -19,6 +19,9 @@
 
 #include "pagespeed/kernel/base/shared_string.h"
 
+#include <cstring>
+
+#include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/string.h"
 #include "test/pagespeed/kernel/base/gtest.h"
 
@@ -28,6 +31,19 @@ class SharedStringTest : public testing::Test {
  protected:
 };
 
+// ExternalStorage over a string literal that notes when it is released.
+class TestExternalStorage : public SharedString::ExternalStorage {
+ public:
+  TestExternalStorage(const char* data, bool* released)
+      : ExternalStorage(data, strlen(data)), released_(released) {}
+  ~TestExternalStorage() override { *released_ = true; }
+
+ private:
+  bool* released_;
+
+  DISALLOW_COPY_AND_ASSIGN(TestExternalStorage);
+};
+
 TEST_F(SharedStringTest, ConstructFromStringPiece) {
   SharedString ss(StringPiece("hello"));
   EXPECT_STREQ("hello", ss.Value());
@@ -230,4 +246,62 @@ TEST_F(SharedStringTest, ExtendUniqueTruncated) {
       << "Re-use the same storage across truncate/extend of unique string";
 }
 
+TEST_F(SharedStringTest, ExternalStorage) {
+  static const char kData[] = "external";
+  bool released = false;
+  {
+    SharedString ss("old value");
+    SharedString old_copy = ss;
+    ss.AdoptExternalStorage(new TestExternalStorage(kData, &released));
+    EXPECT_FALSE(ss.SharesStorage(old_copy));
+    EXPECT_EQ("old value", old_copy.Value());
+    EXPECT_TRUE(ss.has_external_storage());
+    EXPECT_EQ(kData, ss.data()) << "no copy was made";
+    EXPECT_EQ("external", ss.Value());
+    EXPECT_FALSE(ss.trimmed());
+
+    // Copies and trimming share the external storage.
+    SharedString ss2 = ss;
+    EXPECT_TRUE(ss.SharesStorage(ss2));
+    EXPECT_FALSE(ss.unique());
+    ss2.RemovePrefix(1);
+    ss2.RemoveSuffix(1);
+    EXPECT_EQ("xterna", ss2.Value());
+    EXPECT_EQ(kData + 1, ss2.data());
+    EXPECT_TRUE(ss2.trimmed());
+
+    // Mutations copy what is visible into string storage, leaving the
+    // external storage and the other references alone.
+    ss2.Append("!");
+    EXPECT_FALSE(ss2.has_external_storage());
+    EXPECT_EQ("xterna!", ss2.Value());
+    EXPECT_FALSE(ss.SharesStorage(ss2));
+    EXPECT_TRUE(ss.unique());
+    ss.WriteAt(0, "E", 1);
+    EXPECT_EQ("External", ss.Value());
+    EXPECT_STREQ("external", kData);
+
+    // The last reference has gone.
+    EXPECT_TRUE(released);
+  }
+  released = false;
+  {
+    SharedString ss;
+    ss.AdoptExternalStorage(new TestExternalStorage(kData, &released));
+    GoogleString str("swapped");
+    ss.SwapWithString(&str);
+    EXPECT_EQ("external", str);
+    EXPECT_EQ("swapped", ss.Value());
+    EXPECT_TRUE(released);
+  }
+  released = false;
+  {
+    SharedString ss;
+    ss.AdoptExternalStorage(new TestExternalStorage(kData, &released));
+    ss.Assign(ss.Value().substr(2, 3));
+    EXPECT_EQ("ter", ss.Value());
+    EXPECT_TRUE(released);
+  }
+}
+
 }  // namespace net_instaweb
@@ -19,6 +19,9 @@
 
 #include "pagespeed/kernel/base/source_map.h"
 
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_writer.h"
 #include "test/pagespeed/kernel/base/gtest.h"
 
 namespace net_instaweb {
@@ -27,6 +30,26 @@ namespace {
 
 class SourceMapTest : public ::testing::Test {
  protected:
+  // Checks that StreamingEncoder produces the same source map as Encode().
+  void ExpectStreamingMatchesEncode(StringPiece generated_url,
+                                    StringPiece source_url,
+                                    const source_map::MappingVector& mappings) {
+    GoogleString expected;
+    ASSERT_TRUE(
+        source_map::Encode(generated_url, source_url, mappings, &expected));
+
+    GoogleString result;
+    StringWriter writer(&result);
+    NullMessageHandler handler;
+    source_map::StreamingEncoder encoder(generated_url, source_url, &writer,
+                                         &handler);
+    for (const source_map::Mapping& mapping : mappings) {
+      EXPECT_TRUE(encoder.AddMapping(mapping));
+    }
+    EXPECT_TRUE(encoder.Finish());
+    EXPECT_EQ(expected, result);
+    EXPECT_EQ(mappings.size(), encoder.num_mappings());
+  }
 };
 
 TEST_F(SourceMapTest, EncodeBase64) {
@@ -178,6 +201,45 @@ TEST_F(SourceMapTest, Encode_Fail) {
       "Mappings are not sorted");
 }
 
+TEST_F(SourceMapTest, StreamingEncoder) {
+  source_map::MappingVector mappings;
+  ExpectStreamingMatchesEncode("http://example.com/generated.js",
+                               "http://example.com/original.js", mappings);
+  ExpectStreamingMatchesEncode("", "<\"escaped\">\x01", mappings);
+
+  mappings.push_back(source_map::Mapping(1, 1, 0, 10, 0));
+  mappings.push_back(source_map::Mapping(1, 21, 1, 11, 0));
+  mappings.push_back(source_map::Mapping(1, 25, 1, 11, 81));
+  mappings.push_back(source_map::Mapping(2, 13, 2, 11, 105));
+  mappings.push_back(source_map::Mapping(5, 8, 13, 132, 7));
+  mappings.push_back(source_map::Mapping(5, 472, 0, 436, 13));
+  ExpectStreamingMatchesEncode("http://example.com/generated.js",
+                               "http://example.com/original.js", mappings);
+
+  // Enough mappings that the encoder has to write them out in several pieces.
+  mappings.clear();
+  for (int i = 0; i < 100000; ++i) {
+    mappings.push_back(
+        source_map::Mapping(i / 7, (i % 7) * 10, 0, i / 3, (i % 3) * 20));
+  }
+  ExpectStreamingMatchesEncode("", "http://example.com/original.js",
+                               mappings);
+}
+
+TEST_F(SourceMapTest, StreamingEncoder_Fail) {
+  GoogleString result;
+  StringWriter writer(&result);
+  NullMessageHandler handler;
+  source_map::StreamingEncoder encoder("http://example.com/generated.js",
+                                       "http://example.com/original.js",
+                                       &writer, &handler);
+  EXPECT_TRUE(encoder.AddMapping(source_map::Mapping(1, 0, 0, 0, 0)));
+  // Invalid: mappings must be sorted.
+  EXPECT_DEBUG_DEATH(
+      { EXPECT_FALSE(encoder.AddMapping(source_map::Mapping(0, 0, 0, 0, 0))); },
+      "Mappings are not sorted");
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
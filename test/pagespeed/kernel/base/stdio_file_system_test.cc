@@ -25,6 +25,7 @@
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/google_message_handler.h"
 #include "pagespeed/kernel/base/posix_timer.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/timer.h"
@@ -84,7 +85,7 @@ class StdioFileSystemTest : public FileSystemTest {
       // Remove everything inside first.
       StringVector files;
       stdio_file_system_.ListContents(filename, &files, &handler_);
-      for (int i = 0; i < files.size(); ++i) {
+      for (int i = 0, n = files.size(); i < n; ++i) {
         ASSERT_TRUE(strings::StartsWith(files[i], "/"));
         DeleteRecursivelyImpl(files[i]);
       }
@@ -106,6 +107,36 @@ class StdioFileSystemTest : public FileSystemTest {
 // Write a named file, then read it.
 TEST_F(StdioFileSystemTest, TestWriteRead) { TestWriteRead(); }
 
+// Write a named file, then read it into a SharedString.
+TEST_F(StdioFileSystemTest, TestReadFileToSharedString) {
+  TestReadFileToSharedString();
+}
+
+// Large files are mapped rather than copied, and stay readable through the
+// SharedString after being replaced or removed.
+TEST_F(StdioFileSystemTest, ReadFileToSharedStringMapsLargeFiles) {
+  GoogleString contents(StdioFileSystem::kMinMappedFileSize, 'a');
+  contents += "end";
+  GoogleString filename = WriteNewFile("/large.txt", contents);
+  SharedString value;
+  ASSERT_TRUE(file_system()->ReadFileToSharedString(
+      filename.c_str(), FileSystem::kUnlimitedSize, &value, &handler_));
+  EXPECT_TRUE(value.has_external_storage());
+  EXPECT_EQ(contents, value.Value());
+
+  EXPECT_TRUE(file_system()->WriteFileAtomic(filename, "new", &handler_));
+  EXPECT_EQ(contents, value.Value());
+  EXPECT_TRUE(file_system()->RemoveFile(filename.c_str(), &handler_));
+  EXPECT_EQ(contents, value.Value());
+
+  // Small files are just read.
+  filename = WriteNewFile("/small.txt", "small");
+  ASSERT_TRUE(file_system()->ReadFileToSharedString(
+      filename.c_str(), FileSystem::kUnlimitedSize, &value, &handler_));
+  EXPECT_FALSE(value.has_external_storage());
+  EXPECT_EQ("small", value.Value());
+}
+
 // Write a temp file, then read it.
 TEST_F(StdioFileSystemTest, TestTemp) { TestTemp(); }
 
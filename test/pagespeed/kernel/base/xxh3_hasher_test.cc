@@ -0,0 +1,116 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/kernel/base/xxh3_hasher.h"
+
+#include <memory>
+
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+
+namespace net_instaweb {
+
+namespace {
+
+class XXH3HasherTest : public ::testing::Test {
+ protected:
+  GoogleString HexRawHash(const StringPiece& content) {
+    GoogleString raw_hash = hasher_.RawHash(content);
+    GoogleString hex;
+    for (unsigned char c : raw_hash) {
+      StrAppend(&hex, absl::StrFormat("%02x", c));
+    }
+    return hex;
+  }
+
+  // Contents with no repeating pattern, so that every stripe differs.
+  static GoogleString Contents(int size) {
+    GoogleString contents(size, '\0');
+    for (int i = 0; i < size; ++i) {
+      contents[i] = static_cast<char>((i * 2654435761U) >> 13);
+    }
+    return contents;
+  }
+
+  XXH3Hasher hasher_;
+};
+
+TEST_F(XXH3HasherTest, CorrectHashSize) {
+  // XXH3 is 128-bit, like MD5, which is 21.333 6-bit chars.
+  const int kMaxHashSize = 21;
+  EXPECT_EQ(16, hasher_.RawHashSizeInBytes());
+  for (int i = kMaxHashSize; i >= 0; --i) {
+    XXH3Hasher hasher(i);
+    EXPECT_EQ(i, hasher.HashSizeInChars());
+    EXPECT_EQ(i, hasher.Hash("foobar").size());
+    EXPECT_EQ(i, hasher.Hash(GoogleString(5000, 'z')).size());
+  }
+}
+
+// The expected values are those of xxh128sum, and cover each of the code
+// paths for different sizes of input.
+TEST_F(XXH3HasherTest, KnownValues) {
+  EXPECT_EQ("99aa06d3014798d86001c324468d497f", HexRawHash(""));
+  EXPECT_EQ("a96faf705af16834e6c632b61e964e1f", HexRawHash("a"));
+  EXPECT_EQ("3c9e102628997f44ac87b0b131c6992d", HexRawHash("foobar"));
+  EXPECT_EQ("11c83d9c1ee368164c0abe17b55db69c", HexRawHash("hello, world"));
+  EXPECT_EQ("576e398442e2e9e465609b9966713518",
+            HexRawHash(GoogleString(100, 'z')));
+  EXPECT_EQ("65d792960f2c877db7702962a1b9b1ec",
+            HexRawHash(GoogleString(200, 'z')));
+  EXPECT_EQ("b78841e19ae52793b5c9aac0c64f5a2f",
+            HexRawHash(GoogleString(5000, 'z')));
+  EXPECT_EQ("0e87a1b3d126350a907a8298205bab05",
+            HexRawHash(GoogleString(1 << 20, 'z')));
+}
+
+TEST_F(XXH3HasherTest, HashesDiffer) {
+  EXPECT_NE(hasher_.Hash("foo"), hasher_.Hash("bar"));
+  EXPECT_NE(hasher_.Hash(GoogleString(5000, 'z')),
+            hasher_.Hash(GoogleString(5001, 'z')));
+}
+
+TEST_F(XXH3HasherTest, StreamMatchesOneShot) {
+  // Sizes either side of each boundary: the short paths, the 240-byte
+  // one-shot limit, the 256-byte stream buffer, stripes and blocks.
+  const int kSizes[] = {0, 1, 3, 4, 8, 9, 16, 17, 128, 129, 240, 241, 255,
+                        256, 257, 320, 321, 1023, 1024, 1025, 1088, 1089,
+                        2048, 4097, 100003};
+  const int kChunkSizes[] = {1, 7, 63, 64, 65, 256, 257, 1000, 1 << 20};
+  for (int size : kSizes) {
+    GoogleString contents = Contents(size);
+    GoogleString expected = hasher_.Hash(contents);
+    for (int chunk_size : kChunkSizes) {
+      std::unique_ptr<Hasher::Stream> stream(hasher_.NewStream());
+      StringPiece remaining(contents);
+      while (!remaining.empty()) {
+        StringPiece chunk = remaining.substr(0, chunk_size);
+        stream->Update(chunk);
+        remaining.remove_prefix(chunk.size());
+      }
+      EXPECT_EQ(expected, stream->Finalize())
+          << "size " << size << " chunk " << chunk_size;
+    }
+  }
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
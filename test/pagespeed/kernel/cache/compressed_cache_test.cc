@@ -27,9 +27,12 @@
 #include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/stack_buffer.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/util/gzip_inflater.h"
 #include "pagespeed/kernel/util/platform.h"
 #include "pagespeed/kernel/util/simple_random.h"
 #include "pagespeed/kernel/util/simple_stats.h"
@@ -93,6 +96,10 @@ TEST_F(CompressedCacheTest, PutGetDelete) {
   EXPECT_EQ(0, compressed_cache_->CorruptPayloads());
 }
 
+TEST_F(CompressedCacheTest, MultiGet) {
+  TestMultiGet();
+}
+
 TEST_F(CompressedCacheTest, SizeTest) {
   GoogleString value(3 * kStackBufferSize, 'a');
   CheckPut("Name", value);
@@ -184,4 +191,90 @@ TEST_F(CompressedCacheTest, RemoveOneByteFromMiddle) {
   EXPECT_EQ(1, compressed_cache_->CorruptPayloads());
 }
 
+TEST_F(CompressedCacheTest, ParseCodec) {
+  CompressedCache::Codec codec;
+  EXPECT_TRUE(CompressedCache::ParseCodec("none", &codec));
+  EXPECT_EQ(CompressedCache::kNone, codec);
+  EXPECT_TRUE(CompressedCache::ParseCodec("Deflate", &codec));
+  EXPECT_EQ(CompressedCache::kDeflate, codec);
+  EXPECT_TRUE(CompressedCache::ParseCodec("brotli", &codec));
+  EXPECT_EQ(CompressedCache::kBrotli, codec);
+  EXPECT_FALSE(CompressedCache::ParseCodec("zstd", &codec));
+}
+
+TEST_F(CompressedCacheTest, Brotli) {
+  compressed_cache_->SetCodec(CompressedCache::kBrotli,
+                              CompressedCache::kDefaultLevel);
+  GoogleString value(3 * kStackBufferSize, 'a');
+  CheckPut("Name", value);
+  CheckGet("Name", value);
+  EXPECT_GT(100, lru_cache_->size_bytes());
+  EXPECT_EQ(0, compressed_cache_->CorruptPayloads());
+}
+
+TEST_F(CompressedCacheTest, ReadAfterCodecChange) {
+  GoogleString value(3 * kStackBufferSize, 'a');
+  compressed_cache_->SetCodec(CompressedCache::kBrotli, 11);
+  CheckPut("brotli", value);
+  compressed_cache_->SetCodec(CompressedCache::kDeflate, 1);
+  CheckPut("deflate", value);
+  compressed_cache_->SetCodec(CompressedCache::kNone,
+                              CompressedCache::kDefaultLevel);
+  CheckPut("none", value);
+  CheckGet("brotli", value);
+  CheckGet("deflate", value);
+  CheckGet("none", value);
+  EXPECT_EQ(0, compressed_cache_->CorruptPayloads());
+  EXPECT_EQ(0, compressed_cache_->IncompressiblePayloads());
+}
+
+TEST_F(CompressedCacheTest, LegacyEntry) {
+  // Entries written before the codec was recorded are a zlib stream
+  // followed by the trailer.
+  GoogleString value(3 * kStackBufferSize, 'a');
+  GoogleString raw_value;
+  StringWriter writer(&raw_value);
+  ASSERT_TRUE(GzipInflater::Deflate(value, GzipInflater::kDeflate, &writer));
+  StrAppend(&raw_value, "[[]]");
+  lru_cache_->PutSwappingString("key", &raw_value);
+  CheckGet("key", value);
+  EXPECT_EQ(0, compressed_cache_->CorruptPayloads());
+}
+
+TEST_F(CompressedCacheTest, IncompressibleStoredAsIs) {
+  GoogleString value = random_.GenerateHighEntropyString(5 * kStackBufferSize);
+  CheckPut("key", value);
+  CheckGet("key", value);
+  EXPECT_EQ(1, compressed_cache_->IncompressiblePayloads());
+  EXPECT_GT(static_cast<int64>(value.size()) + 10,
+            compressed_cache_->CompressedSize());
+
+  // Compressible values are still compressed, including ones that end
+  // with a few incompressible bytes.
+  GoogleString compressible(3 * kStackBufferSize, 'a');
+  CheckPut("compressible", compressible);
+  GoogleString mixed =
+      StrCat(compressible, random_.GenerateHighEntropyString(100));
+  CheckPut("mixed", mixed);
+  CheckGet("mixed", mixed);
+  EXPECT_EQ(1, compressed_cache_->IncompressiblePayloads());
+  EXPECT_EQ(0, compressed_cache_->CorruptPayloads());
+}
+
+TEST_F(CompressedCacheTest, SmallValueStoredAsIs) {
+  CheckPut("key", "small");
+  CheckGet("key", "small");
+  EXPECT_EQ(1, compressed_cache_->IncompressiblePayloads());
+}
+
+TEST_F(CompressedCacheTest, FlipByteInStoredValue) {
+  GoogleString value = random_.GenerateHighEntropyString(5 * kStackBufferSize);
+  CheckPut("key", value);
+  GoogleString raw_value = GetRawValue("key");
+  raw_value[raw_value.size() / 2] ^= 1;
+  lru_cache_->PutSwappingString("key", &raw_value);
+  CheckNotFound("key");
+  EXPECT_EQ(1, compressed_cache_->CorruptPayloads());
+}
+
 }  // namespace net_instaweb
@@ -0,0 +1,537 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Unit-test LRU cache snapshots, and warm-starting LRUCache and
+// ShardedLRUCache from them.
+
+#include "pagespeed/kernel/cache/lru_cache_snapshot.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/file_cache.h"
+#include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
+#include "pagespeed/kernel/thread/slow_worker.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+#include "test/pagespeed/kernel/base/mem_file_system.h"
+#include "test/pagespeed/kernel/base/mock_timer.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kSnapshotKey[] = "lru_cache/snapshot";
+const int64 kIntervalMs = 5 * Timer::kMinuteMs;
+
+// For the simulated restarts: a Zipf-distributed workload over kNumKeys
+// keys, with a cache that holds a quarter of them.
+const int kNumKeys = 10000;
+const int kValueSize = 100;
+const size_t kCacheBytes = (kNumKeys / 4) * (kValueSize + 6);
+const int kWindow = 500;
+
+class LRUCacheSnapshotTest : public testing::Test {
+ protected:
+  LRUCacheSnapshotTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        worker_("snapshotter", thread_system_.get()),
+        timer_(thread_system_->NewMutex(), MockTimer::kApr_5_2010_ms),
+        file_system_(thread_system_.get(), &timer_),
+        stats_(thread_system_.get()) {
+    FileCache::InitStats(&stats_);
+    file_cache_ = std::make_unique<FileCache>(
+        GTestTempDir(), &file_system_, thread_system_.get(), &worker_,
+        new FileCache::CachePolicy(&timer_, &hasher_,
+                                   FileCache::kDisableCleaning, 0, 0),
+        &stats_, &handler_);
+  }
+
+  ~LRUCacheSnapshotTest() override { worker_.ShutDown(); }
+
+  LRUCacheSnapshotter* NewSnapshotter() {
+    return new LRUCacheSnapshotter(file_cache_.get(), kSnapshotKey,
+                                   kIntervalMs, &timer_);
+  }
+
+  static GoogleString Get(CacheInterface* cache, const GoogleString& key) {
+    CacheInterface::SynchronousCallback callback;
+    cache->Get(key, &callback);
+    EXPECT_TRUE(callback.called());
+    if (callback.state() != CacheInterface::kAvailable) {
+      return "<miss>";
+    }
+    return callback.value().Value().as_string();
+  }
+
+  static void Put(CacheInterface* cache, const GoogleString& key,
+                  const GoogleString& value) {
+    cache->Put(key, SharedString(value));
+  }
+
+  // Encodes writer, and parses it back into *snapshot.
+  static void RoundTrip(const LRUCacheSnapshot::Writer& writer,
+                        LRUCacheSnapshot* snapshot) {
+    GoogleString encoded;
+    writer.Encode(&encoded);
+    ASSERT_TRUE(snapshot->Parse(SharedString(encoded)));
+  }
+
+  void WaitForWorker() {
+    while (worker_.IsBusy()) {
+      usleep(10);
+    }
+  }
+
+  std::unique_ptr<ThreadSystem> thread_system_;
+  SlowWorker worker_;
+  MockTimer timer_;
+  MemFileSystem file_system_;
+  MD5Hasher hasher_;
+  SimpleStats stats_;
+  GoogleMessageHandler handler_;
+  std::unique_ptr<FileCache> file_cache_;
+};
+
+TEST_F(LRUCacheSnapshotTest, EncodeAndTake) {
+  LRUCacheSnapshot::Writer writer;
+  writer.Add("a", SharedString("apple"));
+  writer.Add("b", SharedString("banana"));
+  writer.Add("c", SharedString(""));
+  EXPECT_EQ(3, writer.num_entries());
+  EXPECT_EQ(14, writer.size_bytes());
+
+  LRUCacheSnapshot snapshot;
+  RoundTrip(writer, &snapshot);
+  EXPECT_EQ(3, snapshot.num_entries());
+  EXPECT_EQ(3, snapshot.num_remaining());
+
+  SharedString value;
+  EXPECT_FALSE(snapshot.Take("d", &value));
+  EXPECT_TRUE(snapshot.Take("b", &value));
+  EXPECT_EQ("banana", value.Value());
+  EXPECT_EQ(2, snapshot.num_remaining());
+
+  // Each entry can only be taken once.
+  EXPECT_FALSE(snapshot.Take("b", &value));
+
+  snapshot.Forget("a");
+  EXPECT_FALSE(snapshot.Take("a", &value));
+  EXPECT_EQ(1, snapshot.num_remaining());
+
+  EXPECT_TRUE(snapshot.Take("c", &value));
+  EXPECT_EQ("", value.Value());
+  EXPECT_EQ(0, snapshot.num_remaining());
+}
+
+TEST_F(LRUCacheSnapshotTest, HashCollisions) {
+  // These two keys hash alike: 1 * 131 + 131 == 2 * 131 + 0.
+  const GoogleString kKey1("\x01\x83", 2);
+  const GoogleString kKey2("\x02\x00", 2);
+  ASSERT_EQ(LRUCacheSnapshot::HashKey(kKey1),
+            LRUCacheSnapshot::HashKey(kKey2));
+
+  LRUCacheSnapshot::Writer writer;
+  writer.Add(kKey1, SharedString("one"));
+  writer.Add("x", SharedString("x"));
+  writer.Add(kKey2, SharedString("two"));
+  LRUCacheSnapshot snapshot;
+  RoundTrip(writer, &snapshot);
+
+  SharedString value;
+  EXPECT_TRUE(snapshot.Take(kKey2, &value));
+  EXPECT_EQ("two", value.Value());
+  EXPECT_TRUE(snapshot.Take(kKey1, &value));
+  EXPECT_EQ("one", value.Value());
+}
+
+TEST_F(LRUCacheSnapshotTest, LaterEntriesWin) {
+  LRUCacheSnapshot::Writer writer;
+  writer.Add("a", SharedString("apple"));
+  writer.Add("b", SharedString("banana"));
+  writer.Add("a", SharedString("apricot"));
+  LRUCacheSnapshot snapshot;
+  RoundTrip(writer, &snapshot);
+  EXPECT_EQ(2, snapshot.num_entries());
+
+  SharedString value;
+  EXPECT_TRUE(snapshot.Take("a", &value));
+  EXPECT_EQ("apricot", value.Value());
+  EXPECT_FALSE(snapshot.Take("a", &value));
+  EXPECT_TRUE(snapshot.Take("b", &value));
+  EXPECT_EQ("banana", value.Value());
+}
+
+TEST_F(LRUCacheSnapshotTest, RejectsBadSnapshots) {
+  LRUCacheSnapshot::Writer writer;
+  writer.Add("key1", SharedString("value1"));
+  writer.Add("key2", SharedString("value2"));
+  GoogleString encoded;
+  writer.Encode(&encoded);
+
+  LRUCacheSnapshot snapshot;
+  EXPECT_TRUE(snapshot.Parse(SharedString(encoded)));
+  EXPECT_FALSE(snapshot.Parse(SharedString("")));
+  EXPECT_FALSE(snapshot.Parse(SharedString("not a snapshot at all, no")));
+  EXPECT_EQ(0, snapshot.num_remaining());
+
+  // Truncated.
+  EXPECT_FALSE(snapshot.Parse(SharedString(
+      StringPiece(encoded.data(), encoded.size() - 1))));
+
+  // Wrong version.
+  GoogleString bad = encoded;
+  bad[8] ^= 0x40;
+  EXPECT_FALSE(snapshot.Parse(SharedString(bad)));
+
+  // An entry pointing past the end.  The first record's offset is at 36.
+  bad = encoded;
+  uint32 offset = encoded.size();
+  memcpy(&bad[36], &offset, sizeof(offset));
+  EXPECT_FALSE(snapshot.Parse(SharedString(bad)));
+
+  // Corrupting bytes anywhere must never let a lookup stray outside the
+  // snapshot.
+  std::mt19937 random(1234);
+  for (int trial = 0; trial < 1000; ++trial) {
+    bad = encoded;
+    bad[random() % bad.size()] = random();
+    if (snapshot.Parse(SharedString(bad))) {
+      SharedString value;
+      snapshot.Take("key1", &value);
+      snapshot.Take("key2", &value);
+    }
+  }
+}
+
+TEST_F(LRUCacheSnapshotTest, LRUCacheWarmStart) {
+  LRUCache old_cache(1000);
+  Put(&old_cache, "a", "apple");
+  Put(&old_cache, "b", "banana");
+  Put(&old_cache, "c", "cherry");
+  LRUCacheSnapshot::Writer writer;
+  old_cache.AddToSnapshot(&writer);
+  EXPECT_EQ(3, writer.num_entries());
+
+  LRUCache cache(1000);
+  LRUCacheSnapshot* snapshot = new LRUCacheSnapshot;
+  RoundTrip(writer, snapshot);
+  cache.WarmStart(snapshot);
+  EXPECT_EQ(0, cache.num_elements());
+
+  EXPECT_EQ("apple", Get(&cache, "a"));
+  EXPECT_EQ(1, cache.num_warm_start_hits());
+  EXPECT_EQ(1, cache.num_elements());
+  // The second lookup is an ordinary hit.
+  EXPECT_EQ("apple", Get(&cache, "a"));
+  EXPECT_EQ(1, cache.num_warm_start_hits());
+  EXPECT_EQ(1, cache.num_hits());
+
+  // Writes and deletes win over the snapshot, even after the new value
+  // is gone again.
+  Put(&cache, "b", "blueberry");
+  cache.Delete("b");
+  EXPECT_EQ("<miss>", Get(&cache, "b"));
+  cache.Delete("c");
+  EXPECT_EQ("<miss>", Get(&cache, "c"));
+  EXPECT_EQ(1, cache.num_warm_start_hits());
+  cache.SanityCheck();
+}
+
+TEST_F(LRUCacheSnapshotTest, UnusedEntriesCarryOver) {
+  LRUCacheSnapshot::Writer writer;
+  writer.Add("a", SharedString("apple"));
+  writer.Add("b", SharedString("banana"));
+  writer.Add("c", SharedString("cherry"));
+
+  LRUCache cache(1000);
+  LRUCacheSnapshot* snapshot = new LRUCacheSnapshot;
+  RoundTrip(writer, snapshot);
+  cache.WarmStart(snapshot);
+  EXPECT_EQ("banana", Get(&cache, "b"));
+  Put(&cache, "d", "date");
+
+  // The next snapshot holds what the cache has now, plus the entries from
+  // the last one that haven't been asked for yet.
+  LRUCacheSnapshot::Writer next_writer;
+  cache.AddToSnapshot(&next_writer);
+  EXPECT_EQ(4, next_writer.num_entries());
+  LRUCache next_cache(1000);
+  snapshot = new LRUCacheSnapshot;
+  RoundTrip(next_writer, snapshot);
+  next_cache.WarmStart(snapshot);
+  EXPECT_EQ("apple", Get(&next_cache, "a"));
+  EXPECT_EQ("banana", Get(&next_cache, "b"));
+  EXPECT_EQ("cherry", Get(&next_cache, "c"));
+  EXPECT_EQ("date", Get(&next_cache, "d"));
+
+  // Carried-over entries are limited by the size of the cache.
+  LRUCache small_cache(12);
+  snapshot = new LRUCacheSnapshot;
+  RoundTrip(writer, snapshot);
+  small_cache.WarmStart(snapshot);
+  LRUCacheSnapshot::Writer small_writer;
+  small_cache.AddToSnapshot(&small_writer);
+  EXPECT_GT(3, small_writer.num_entries());
+}
+
+TEST_F(LRUCacheSnapshotTest, ShardedWarmStart) {
+  ShardedLRUCache old_cache(10000, 4, thread_system_.get());
+  for (int i = 0; i < 100; ++i) {
+    Put(&old_cache, StrCat("key", IntegerToString(i)),
+        StrCat("value", IntegerToString(i)));
+  }
+  LRUCacheSnapshot::Writer writer;
+  old_cache.AddToSnapshot(&writer);
+  EXPECT_EQ(100, writer.num_entries());
+  LRUCacheSnapshot snapshot;
+  RoundTrip(writer, &snapshot);
+
+  ShardedLRUCache cache(10000, 4, thread_system_.get());
+  cache.WarmStart(snapshot);
+  Put(&cache, "key7", "new");
+  for (int i = 0; i < 100; ++i) {
+    GoogleString expected =
+        (i == 7) ? "new" : StrCat("value", IntegerToString(i));
+    EXPECT_EQ(expected, Get(&cache, StrCat("key", IntegerToString(i))));
+  }
+  EXPECT_EQ(99, cache.num_warm_start_hits());
+  cache.SanityCheck();
+}
+
+TEST_F(LRUCacheSnapshotTest, SnapshotsThroughFileCache) {
+  worker_.Start();
+  std::unique_ptr<LRUCache> cache(new LRUCache(1000));
+  cache->set_snapshotter(NewSnapshotter());
+  Put(cache.get(), "a", "apple");
+  timer_.AdvanceMs(kIntervalMs - 1);
+  Put(cache.get(), "b", "banana");
+  WaitForWorker();
+
+  // Nothing is due yet, so a new process starts cold.
+  std::unique_ptr<LRUCache> next_cache(new LRUCache(1000));
+  next_cache->set_snapshotter(NewSnapshotter());
+  EXPECT_EQ("<miss>", Get(next_cache.get(), "a"));
+
+  // Once the interval has passed, a Put writes one in the background.
+  timer_.AdvanceMs(1);
+  Put(cache.get(), "c", "cherry");
+  WaitForWorker();
+  next_cache = std::make_unique<LRUCache>(1000);
+  next_cache->set_snapshotter(NewSnapshotter());
+  EXPECT_EQ("apple", Get(next_cache.get(), "a"));
+  EXPECT_EQ("cherry", Get(next_cache.get(), "c"));
+
+  // ShutDown writes out the latest contents.
+  Put(cache.get(), "d", "date");
+  cache->ShutDown();
+  EXPECT_EQ("<miss>", Get(cache.get(), "d"));
+  next_cache = std::make_unique<LRUCache>(1000);
+  next_cache->set_snapshotter(NewSnapshotter());
+  EXPECT_EQ("date", Get(next_cache.get(), "d"));
+  EXPECT_EQ(1, next_cache->num_warm_start_hits());
+
+  // A process that never used its cache leaves the snapshot alone.
+  std::unique_ptr<ShardedLRUCache> idle_cache(
+      new ShardedLRUCache(1000, 2, thread_system_.get()));
+  idle_cache->set_snapshotter(NewSnapshotter());
+  idle_cache->ShutDown();
+  std::unique_ptr<ShardedLRUCache> sharded_cache(
+      new ShardedLRUCache(1000, 2, thread_system_.get()));
+  sharded_cache->set_snapshotter(NewSnapshotter());
+  EXPECT_EQ("date", Get(sharded_cache.get(), "d"));
+  EXPECT_EQ("banana", Get(sharded_cache.get(), "b"));
+}
+
+TEST_F(LRUCacheSnapshotTest, CollectsSnapshotOverSeveralPuts) {
+  worker_.Start();
+  std::unique_ptr<LRUCache> cache(new LRUCache(100000));
+  cache->set_snapshotter(NewSnapshotter());
+  for (int i = 0; i < 250; ++i) {
+    Put(cache.get(), StrCat("key", IntegerToString(i)), "old");
+  }
+
+  // The Put that finds a snapshot due only collects the oldest entries, so
+  // nothing is written yet.
+  timer_.AdvanceMs(kIntervalMs);
+  Put(cache.get(), "key250", "old");
+  WaitForWorker();
+  std::unique_ptr<LRUCache> next_cache(new LRUCache(100000));
+  next_cache->set_snapshotter(NewSnapshotter());
+  EXPECT_EQ("<miss>", Get(next_cache.get(), "key1"));
+
+  // Changes made while the snapshot is collected are picked up, and
+  // freshening an entry already collected doesn't collect it again.
+  Put(cache.get(), "key0", "new");
+  EXPECT_EQ("old", Get(cache.get(), "key50"));
+  cache->Delete("key220");
+  Put(cache.get(), "key251", "old");
+  WaitForWorker();
+  next_cache = std::make_unique<LRUCache>(100000);
+  next_cache->set_snapshotter(NewSnapshotter());
+  EXPECT_EQ("new", Get(next_cache.get(), "key0"));
+  EXPECT_EQ("old", Get(next_cache.get(), "key50"));
+  EXPECT_EQ("old", Get(next_cache.get(), "key199"));
+  EXPECT_EQ("<miss>", Get(next_cache.get(), "key220"));
+  EXPECT_EQ("old", Get(next_cache.get(), "key251"));
+  EXPECT_EQ(4, next_cache->num_warm_start_hits());
+  cache->SanityCheck();
+}
+
+TEST_F(LRUCacheSnapshotTest, ShardedCollectsSnapshotOverSeveralPuts) {
+  worker_.Start();
+  ShardedLRUCache cache(1000000, 4, thread_system_.get());
+  cache.set_snapshotter(NewSnapshotter());
+  for (int i = 0; i < 1000; ++i) {
+    Put(&cache, StrCat("key", IntegerToString(i)), "old");
+  }
+
+  // Each Put collects kEntriesPerPut entries, moving from shard to shard,
+  // so the 1000 entries take ten Puts, and the eleventh finds the last
+  // shard done.
+  timer_.AdvanceMs(kIntervalMs);
+  int num_puts = 0;
+  std::unique_ptr<LRUCache> next_cache;
+  do {
+    Put(&cache, StrCat("extra", IntegerToString(num_puts++)), "x");
+    WaitForWorker();
+    next_cache = std::make_unique<LRUCache>(1000000);
+    next_cache->set_snapshotter(NewSnapshotter());
+  } while ((Get(next_cache.get(), "key1") == "<miss>") && (num_puts < 100));
+  EXPECT_EQ(1000 / LRUCacheSnapshotter::kEntriesPerPut + 1, num_puts);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ("old", Get(next_cache.get(), StrCat("key", IntegerToString(i))));
+  }
+  cache.SanityCheck();
+}
+
+// Draws keys for the simulated workload.
+class ZipfKeys {
+ public:
+  explicit ZipfKeys(int seed) : random_(seed) {
+    double total = 0;
+    for (int i = 1; i <= kNumKeys; ++i) {
+      total += 1.0 / i;
+      cdf_.push_back(total);
+    }
+    for (double& p : cdf_) {
+      p /= total;
+    }
+  }
+
+  GoogleString Next() {
+    double p = std::uniform_real_distribution<double>(0, 1)(random_);
+    int rank = std::lower_bound(cdf_.begin(), cdf_.end(), p) - cdf_.begin();
+    return StrCat("key", IntegerToString(rank));
+  }
+
+ private:
+  std::mt19937 random_;
+  std::vector<double> cdf_;
+};
+
+// Runs num_requests lookups through cache, filling it on each miss as a
+// server would after fetching, and returns the hit rate in each window.
+std::vector<double> HitRates(CacheInterface* cache, ZipfKeys* keys,
+                             int num_requests) {
+  const GoogleString kValue(kValueSize, 'v');
+  std::vector<double> rates;
+  int hits = 0;
+  for (int i = 1; i <= num_requests; ++i) {
+    GoogleString key = keys->Next();
+    CacheInterface::SynchronousCallback callback;
+    cache->Get(key, &callback);
+    if (callback.state() == CacheInterface::kAvailable) {
+      ++hits;
+    } else {
+      cache->Put(key, SharedString(kValue));
+    }
+    if (i % kWindow == 0) {
+      rates.push_back(static_cast<double>(hits) / kWindow);
+      hits = 0;
+    }
+  }
+  return rates;
+}
+
+// Returns how many requests were served before the hit rate over a window
+// first reached target.
+int RequestsToWarm(const std::vector<double>& rates, double target) {
+  for (int i = 0, n = rates.size(); i < n; ++i) {
+    if (rates[i] >= target) {
+      return i * kWindow;
+    }
+  }
+  return rates.size() * kWindow;
+}
+
+TEST_F(LRUCacheSnapshotTest, TimeToWarm) {
+  // Run one process long enough to reach its steady-state hit rate, and
+  // snapshot it.
+  ZipfKeys keys(5678);
+  LRUCache old_cache(kCacheBytes);
+  std::vector<double> old_rates = HitRates(&old_cache, &keys, 50000);
+  double steady_rate = old_rates.back();
+  LRUCacheSnapshot::Writer writer;
+  old_cache.AddToSnapshot(&writer);
+
+  // Then replace it with a cold process and a warm-started one, serving
+  // the same requests.
+  LRUCache cold_cache(kCacheBytes);
+  ZipfKeys cold_keys(9012);
+  std::vector<double> cold_rates = HitRates(&cold_cache, &cold_keys, 10000);
+
+  LRUCache warm_cache(kCacheBytes);
+  LRUCacheSnapshot* snapshot = new LRUCacheSnapshot;
+  RoundTrip(writer, snapshot);
+  warm_cache.WarmStart(snapshot);
+  ZipfKeys warm_keys(9012);
+  std::vector<double> warm_rates = HitRates(&warm_cache, &warm_keys, 10000);
+
+  // The warm-started cache is at 90% of the old process's hit rate from
+  // its first window on; the cold one takes a good while to get there.
+  double target = 0.9 * steady_rate;
+  int cold_requests = RequestsToWarm(cold_rates, target);
+  int warm_requests = RequestsToWarm(warm_rates, target);
+  EXPECT_EQ(0, warm_requests);
+  EXPECT_LE(5 * kWindow, cold_requests);
+  EXPECT_LT(cold_rates[0] + 0.3, warm_rates[0]);
+  EXPECT_LT(0, warm_cache.num_warm_start_hits());
+  warm_cache.SanityCheck();
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
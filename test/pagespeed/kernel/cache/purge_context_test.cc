@@ -172,6 +172,36 @@ class PurgeContextTest : public ::testing::Test,
     return statistics_->GetVariable(PurgeContext::kFileWrites)->Get();
   }
 
+  int journal_appends() {
+    return statistics_->GetVariable(PurgeContext::kJournalAppends)->Get();
+  }
+
+  int journal_compactions() {
+    return statistics_->GetVariable(PurgeContext::kJournalCompactions)->Get();
+  }
+
+  void EnableJournal() {
+    purge_context1_->set_enable_journal(true);
+    purge_context2_->set_enable_journal(true);
+  }
+
+  // Without shared statistics, other processes only notice changes when
+  // they next poll the file system.
+  void WaitForPollIfNoStats() {
+    if (!HasValidStats()) {
+      scheduler_.AdvanceTimeMs(6000);
+    }
+  }
+
+  GoogleString JournalName() { return purge_context1_->JournalName(); }
+  GoogleString CompactingJournalName() {
+    return purge_context1_->CompactingJournalName();
+  }
+
+  bool FileExists(const GoogleString& filename) {
+    return file_system_.Exists(filename.c_str(), &message_handler_).is_true();
+  }
+
   void UpdatePurgeSet1(const CopyOnWrite<PurgeSet>& purge_set) {
     purge_set1_ = purge_set;
   }
@@ -369,6 +399,117 @@ TEST_P(PurgeContextTest, InvalidTimestampInPurgeRecord) {
   EXPECT_EQ(ExpectStat(6), file_parse_failures());
 }
 
+TEST_P(PurgeContextTest, JournalInvalidationSharing) {
+  EnableJournal();
+  purge_context1_->SetCachePurgeGlobalTimestampMs(400000, ExpectSuccess());
+  purge_context1_->AddPurgeUrl("a", 500000, ExpectSuccess());
+  EXPECT_EQ(ExpectStat(2), journal_appends());
+  EXPECT_EQ(0, file_writes());
+  EXPECT_FALSE(FileExists(kPurgeFile));
+  WaitForPollIfNoStats();
+
+  EXPECT_FALSE(PollAndTest1("a", 500000));
+  EXPECT_TRUE(PollAndTest1("a", 500001));
+  EXPECT_FALSE(PollAndTest1("b", 400000));
+  EXPECT_TRUE(PollAndTest1("b", 400001));
+  EXPECT_FALSE(PollAndTest2("a", 500000));
+  EXPECT_TRUE(PollAndTest2("a", 500001));
+  EXPECT_FALSE(PollAndTest2("b", 400000));
+  EXPECT_TRUE(PollAndTest2("b", 400001));
+
+  // The other direction is seen immediately as well.
+  purge_context2_->AddPurgeUrl("b", 700000, ExpectSuccess());
+  WaitForPollIfNoStats();
+  EXPECT_FALSE(PollAndTest1("b", 700000));
+  EXPECT_TRUE(PollAndTest1("b", 700001));
+  EXPECT_EQ(0, file_parse_failures());
+}
+
+TEST_P(PurgeContextTest, JournalBatchesRequests) {
+  EnableJournal();
+  purge_context1_->set_request_batching_delay_ms(1000);
+  purge_context1_->AddPurgeUrl("a", 500000, ExpectSuccess());
+  purge_context1_->AddPurgeUrl("b", 500000, ExpectSuccess());
+  EXPECT_EQ(0, journal_appends());
+  scheduler_.AdvanceTimeMs(1000);
+  EXPECT_EQ(ExpectStat(1), journal_appends());
+  WaitForPollIfNoStats();
+  EXPECT_FALSE(PollAndTest2("a", 500000));
+  EXPECT_FALSE(PollAndTest2("b", 500000));
+}
+
+TEST_P(PurgeContextTest, JournalAppendsWithoutLock) {
+  // Purges are appended even while another process holds the lock.
+  EnableJournal();
+  scheduler_.AdvanceTimeMs(10 * Timer::kSecondMs);
+  lock_.reset(lock_manager_.CreateNamedLock(LockName()));
+  ASSERT_TRUE(lock_tester_.LockTimedWaitStealOld(0, 0, lock_.get()));
+  int64 now_ms = timer_.NowMs();
+  purge_context1_->SetCachePurgeGlobalTimestampMs(now_ms, ExpectSuccess());
+  WaitForPollIfNoStats();
+  EXPECT_FALSE(PollAndTest1("b", now_ms - 1));
+  EXPECT_FALSE(PollAndTest2("b", now_ms - 1));
+  EXPECT_EQ(0, num_cancellations());
+  EXPECT_EQ(0, num_contentions());
+}
+
+TEST_P(PurgeContextTest, JournalPrefixPurge) {
+  EnableJournal();
+  purge_context1_->AddPurgeUrl("http://a.com/img/*", 500000, ExpectSuccess());
+  WaitForPollIfNoStats();
+  EXPECT_FALSE(PollAndTest2("http://a.com/img/x.png", 500000));
+  EXPECT_TRUE(PollAndTest2("http://a.com/img/x.png", 500001));
+  EXPECT_TRUE(PollAndTest2("http://a.com/js/x.js", 500000));
+}
+
+TEST_P(PurgeContextTest, JournalSkipsPartialRecord) {
+  EnableJournal();
+  ASSERT_TRUE(file_system_.WriteFile(JournalName().c_str(),
+                                     "500 a\n"
+                                     "x\n"  // not a timestamp
+                                     "600 b",  // still being appended
+                                     &message_handler_));
+  EXPECT_FALSE(PollAndTest1("a", 500));
+  EXPECT_EQ(ExpectStat(1), file_parse_failures());
+  EXPECT_TRUE(PollAndTest1("b", 500));
+}
+
+TEST_P(PurgeContextTest, JournalCompaction) {
+  EnableJournal();
+
+  // Each record is about 10 bytes, so this crosses the compaction threshold
+  // of 4 times the purge set size.
+  const int kNumPurges = 50;
+  for (int i = 0; i < kNumPurges; ++i) {
+    purge_context1_->AddPurgeUrl(IntegerToString(i % 5), 500000 + i,
+                                 ExpectSuccess());
+  }
+  EXPECT_EQ(0, journal_compactions());
+  EXPECT_TRUE(FileExists(CompactingJournalName()));
+
+  // Purges made while the compaction waits go to a new journal.
+  purge_context1_->AddPurgeUrl("late", 600000, ExpectSuccess());
+  EXPECT_TRUE(FileExists(JournalName()));
+  WaitForPollIfNoStats();
+  EXPECT_FALSE(PollAndTest2("4", 500000 + kNumPurges - 1));
+  EXPECT_FALSE(PollAndTest2("late", 600000));
+
+  scheduler_.AdvanceTimeMs(1000);
+  EXPECT_EQ(ExpectStat(1), journal_compactions());
+  EXPECT_EQ(ExpectStat(1), file_writes());
+  EXPECT_FALSE(FileExists(CompactingJournalName()));
+  EXPECT_TRUE(FileExists(kPurgeFile));
+
+  // The compacted purges are now read from the purge file.
+  scheduler_.AdvanceTimeMs(10 * Timer::kSecondMs);  // force poll
+  EXPECT_FALSE(PollAndTest1("4", 500000 + kNumPurges - 1));
+  EXPECT_TRUE(PollAndTest1("4", 500000 + kNumPurges));
+  EXPECT_FALSE(PollAndTest1("late", 600000));
+  EXPECT_FALSE(PollAndTest2("0", 500000 + kNumPurges - 5));
+  EXPECT_TRUE(PollAndTest2("0", 500000 + kNumPurges - 4));
+  EXPECT_EQ(0, file_parse_failures());
+}
+
 // We test with use_null_statistics == GetParam() as both true and false.
 INSTANTIATE_TEST_SUITE_P(PurgeContextTestInstance, PurgeContextTest,
                          ::testing::Bool());
@@ -167,6 +167,72 @@ TEST_F(PurgeSetTest, Assign) {
   EXPECT_TRUE(purge_set_.Equals(other));
 }
 
+TEST_F(PurgeSetTest, PrefixPurge) {
+  ASSERT_TRUE(purge_set_.Put("http://a.com/img/*", 100));
+  EXPECT_FALSE(purge_set_.IsValid("http://a.com/img/x.png", 100));
+  EXPECT_TRUE(purge_set_.IsValid("http://a.com/img/x.png", 101));
+  EXPECT_FALSE(purge_set_.IsValid("http://a.com/img/", 100));
+  EXPECT_TRUE(purge_set_.IsValid("http://a.com/im", 1));
+  EXPECT_TRUE(purge_set_.IsValid("http://a.com/js/x.js", 1));
+  EXPECT_FALSE(purge_set_.has_global_invalidation_timestamp_ms());
+}
+
+TEST_F(PurgeSetTest, NestedPrefixPurges) {
+  // Longer and shorter prefixes on the same path each apply on their own.
+  ASSERT_TRUE(purge_set_.Put("http://a.com/*", 50));
+  ASSERT_TRUE(purge_set_.Put("http://a.com/img/*", 100));
+  ASSERT_TRUE(purge_set_.Put("http://a.com/img/big/*", 200));
+  EXPECT_FALSE(purge_set_.IsValid("http://a.com/img/big/x.png", 200));
+  EXPECT_TRUE(purge_set_.IsValid("http://a.com/img/big/x.png", 201));
+  EXPECT_FALSE(purge_set_.IsValid("http://a.com/img/small/x.png", 100));
+  EXPECT_TRUE(purge_set_.IsValid("http://a.com/img/small/x.png", 101));
+  EXPECT_FALSE(purge_set_.IsValid("http://a.com/js/x.js", 50));
+  EXPECT_TRUE(purge_set_.IsValid("http://a.com/js/x.js", 51));
+}
+
+TEST_F(PurgeSetTest, PrefixPurgeAndExactPurge) {
+  ASSERT_TRUE(purge_set_.Put("http://a.com/*", 100));
+  ASSERT_TRUE(purge_set_.Put("http://a.com/x", 200));
+  EXPECT_FALSE(purge_set_.IsValid("http://a.com/x", 150));
+  EXPECT_TRUE(purge_set_.IsValid("http://a.com/y", 150));
+}
+
+TEST_F(PurgeSetTest, EmptyPrefixPurgesEverything) {
+  ASSERT_TRUE(purge_set_.Put("*", 100));
+  EXPECT_FALSE(purge_set_.IsValid("a", 100));
+  EXPECT_FALSE(purge_set_.IsValid("", 100));
+  EXPECT_TRUE(purge_set_.IsValid("a", 101));
+}
+
+TEST_F(PurgeSetTest, PrefixPurgeCopiedAndMerged) {
+  ASSERT_TRUE(purge_set_.Put("a/*", 100));
+  PurgeSet copy(purge_set_);
+  EXPECT_FALSE(copy.IsValid("a/b", 100));
+
+  PurgeSet other(kMaxSize);
+  ASSERT_TRUE(other.Put("b/*", 100));
+  other.Merge(purge_set_);
+  EXPECT_FALSE(other.IsValid("a/b", 100));
+  EXPECT_FALSE(other.IsValid("b/a", 100));
+
+  other.Clear();
+  EXPECT_TRUE(other.IsValid("a/b", 100));
+  other.Swap(&copy);
+  EXPECT_FALSE(other.IsValid("a/b", 100));
+  EXPECT_TRUE(copy.IsValid("a/b", 100));
+}
+
+TEST_F(PurgeSetTest, EvictedPrefixPurgeStaysPurged) {
+  ASSERT_TRUE(purge_set_.Put("a/*", 100));
+  int64 timestamp_ms = 100;
+  for (int i = 0; i < kMaxSize; ++i) {
+    ASSERT_TRUE(purge_set_.Put(IntegerToString(i), ++timestamp_ms));
+  }
+  EXPECT_LE(100, purge_set_.global_invalidation_timestamp_ms());
+  EXPECT_FALSE(purge_set_.IsValid("a/b", 100));
+  EXPECT_TRUE(purge_set_.IsValid("a/b", timestamp_ms + 1));
+}
+
 TEST_F(PurgeSetTest, ToString) {
   ASSERT_TRUE(purge_set_.UpdateGlobalInvalidationTimestampMs(
       MockTimer::kApr_5_2010_ms));
@@ -0,0 +1,212 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Unit-test the sharded LRU cache.
+
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
+
+#include <cstddef>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/cache_interface.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+#include "test/pagespeed/kernel/cache/cache_spammer.h"
+#include "test/pagespeed/kernel/cache/cache_test_base.h"
+
+namespace {
+const size_t kMaxSize = 100;
+const int kNumShards = 4;
+const int kNumThreads = 4;
+const int kNumIters = 10000;
+const int kNumInserts = 10;
+}  // namespace
+
+namespace net_instaweb {
+
+class ShardedLRUCacheTest : public CacheTestBase {
+ protected:
+  ShardedLRUCacheTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        cache_(new ShardedLRUCache(kMaxSize, kNumShards,
+                                   thread_system_.get())) {}
+
+  CacheInterface* Cache() override { return cache_.get(); }
+  void PostOpCleanup() override { cache_->SanityCheck(); }
+
+  void ResetCache(size_t max_size, int num_shards) {
+    cache_.reset(
+        new ShardedLRUCache(max_size, num_shards, thread_system_.get()));
+  }
+
+  void TestHelper(bool expecting_evictions, bool do_deletes,
+                  const char* value_pattern) {
+    CacheSpammer::RunTests(kNumThreads, kNumIters, kNumInserts,
+                           expecting_evictions, do_deletes, value_pattern,
+                           cache_.get(), thread_system_.get());
+    cache_->SanityCheck();
+  }
+
+  std::unique_ptr<ThreadSystem> thread_system_;
+  std::unique_ptr<ShardedLRUCache> cache_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ShardedLRUCacheTest);
+};
+
+// Validates each hit by looking the key up again, which would deadlock if
+// the shard were still locked.
+class ReentrantCallback : public CacheTestBase::Callback {
+ public:
+  explicit ReentrantCallback(CacheInterface* cache) : cache_(cache) {}
+
+  bool ValidateCandidate(const GoogleString& key,
+                         CacheInterface::KeyState state) override {
+    if (state == CacheInterface::kAvailable) {
+      CacheTestBase::Callback nested;
+      cache_->Get(key, &nested);
+      EXPECT_EQ(CacheInterface::kAvailable, nested.state());
+      cache_->Put(key, SharedString("replaced"));
+    }
+    return CacheTestBase::Callback::ValidateCandidate(key, state);
+  }
+
+ private:
+  CacheInterface* cache_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReentrantCallback);
+};
+
+TEST_F(ShardedLRUCacheTest, PutGetDelete) {
+  EXPECT_EQ(static_cast<size_t>(0), cache_->size_bytes());
+  EXPECT_EQ(static_cast<size_t>(0), cache_->num_elements());
+  CheckPut("Name", "Value");
+  CheckGet("Name", "Value");
+  EXPECT_EQ(static_cast<size_t>(9), cache_->size_bytes());  // "Name" + "Value"
+  EXPECT_EQ(static_cast<size_t>(1), cache_->num_elements());
+  CheckNotFound("Another Name");
+
+  CheckPut("Name", "NewValue");
+  CheckGet("Name", "NewValue");
+  EXPECT_EQ(static_cast<size_t>(12), cache_->size_bytes());
+  EXPECT_EQ(static_cast<size_t>(1), cache_->num_elements());
+
+  CheckDelete("Name");
+  CheckNotFound("Name");
+  EXPECT_EQ(static_cast<size_t>(0), cache_->size_bytes());
+  EXPECT_EQ(static_cast<size_t>(0), cache_->num_elements());
+
+  EXPECT_EQ(static_cast<size_t>(2), cache_->num_hits());
+  EXPECT_EQ(static_cast<size_t>(2), cache_->num_misses());
+  EXPECT_EQ(static_cast<size_t>(2), cache_->num_inserts());
+}
+
+TEST_F(ShardedLRUCacheTest, DeleteWithPrefix) {
+  CheckPut("N1", "Value1");
+  CheckPut("N2", "Value2");
+  CheckPut("M3", "Value3");
+  CheckPut("M4", "Value4");
+  EXPECT_EQ(static_cast<size_t>(32), cache_->size_bytes());
+
+  cache_->DeleteWithPrefixForTesting("N");
+  EXPECT_EQ(static_cast<size_t>(16), cache_->size_bytes());
+  CheckNotFound("N1");
+  CheckNotFound("N2");
+  CheckGet("M3", "Value3");
+  CheckGet("M4", "Value4");
+}
+
+TEST_F(ShardedLRUCacheTest, BudgetIsSplitOverShards) {
+  ResetCache(kMaxSize + 3, kNumShards);
+  EXPECT_EQ(kNumShards, cache_->num_shards());
+  EXPECT_EQ(kMaxSize + 3, cache_->max_bytes_in_cache());
+
+  // However the keys fall, the shards together never hold more than the
+  // budget.
+  for (int i = 0; i < 100; ++i) {
+    CheckPut(StrCat("name", IntegerToString(i)), "value");
+    EXPECT_GE(kMaxSize + 3, cache_->size_bytes());
+  }
+  EXPECT_LT(static_cast<size_t>(0), cache_->num_evictions());
+
+  // Each shard gets a quarter of the budget, so a value larger than that
+  // can't be stored.
+  GoogleString big(kMaxSize / 2, 'x');
+  CheckPut("big", big);
+  CheckNotFound("big");
+}
+
+TEST_F(ShardedLRUCacheTest, OneShardIsAnLRU) {
+  ResetCache(kMaxSize, 1);
+  for (int i = 0; i < 10; ++i) {
+    CheckPut(StrCat("name", IntegerToString(i)),
+             StrCat("valu", IntegerToString(i)));
+  }
+  CheckGet("name0", "valu0");
+  CheckPut("nameA", "valuA");
+  CheckGet("name0", "valu0");
+  CheckNotFound("name1");
+  CheckGet("name2", "valu2");
+}
+
+TEST_F(ShardedLRUCacheTest, ValidatorRunsOutsideLock) {
+  CheckPut("Name", "Value");
+  ReentrantCallback callback(cache_.get());
+  cache_->Get("Name", &callback);
+  EXPECT_EQ(CacheInterface::kAvailable, callback.state());
+  EXPECT_EQ("Value", callback.value_str());
+  CheckGet("Name", "replaced");
+}
+
+TEST_F(ShardedLRUCacheTest, ShutDown) {
+  CheckPut("Name", "Value");
+  EXPECT_TRUE(cache_->IsHealthy());
+  cache_->ShutDown();
+  EXPECT_FALSE(cache_->IsHealthy());
+  CheckNotFound("Name");
+  CheckPut("Other", "Value");
+  EXPECT_EQ(static_cast<size_t>(1), cache_->num_elements());
+}
+
+TEST_F(ShardedLRUCacheTest, SpamCacheNoEvictionsOrDeletions) {
+  // Give every shard room for all 10 of the 10-byte entries, so nothing is
+  // evicted however the keys are distributed.
+  ResetCache(kNumShards * kMaxSize, kNumShards);
+  TestHelper(false, false, "valu");
+  EXPECT_EQ(static_cast<size_t>(0), cache_->num_evictions());
+}
+
+TEST_F(ShardedLRUCacheTest, SpamCacheWithEvictions) {
+  TestHelper(true, false, "value");
+}
+
+TEST_F(ShardedLRUCacheTest, SpamCacheWithDeletions) {
+  ResetCache(kNumShards * kMaxSize, kNumShards);
+  TestHelper(false, true, "valu");
+}
+
+TEST_F(ShardedLRUCacheTest, SpamCacheWithDeletionsAndEvictions) {
+  TestHelper(true, true, "value");
+}
+
+}  // namespace net_instaweb
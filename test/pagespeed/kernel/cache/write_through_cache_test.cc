@@ -21,6 +21,8 @@
 
 #include "pagespeed/kernel/cache/write_through_cache.h"
 
+#include <cstddef>
+
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/cache/lru_cache.h"
 #include "test/pagespeed/kernel/base/gtest.h"
@@ -28,6 +30,28 @@
 
 namespace net_instaweb {
 
+// Counts the MultiGets it receives.
+class MultiGetCountingCache : public LRUCache {
+ public:
+  explicit MultiGetCountingCache(size_t max_size)
+      : LRUCache(max_size), num_multi_gets_(0), num_multi_get_keys_(0) {}
+
+  void MultiGet(MultiGetRequest* request) override {
+    ++num_multi_gets_;
+    num_multi_get_keys_ += request->size();
+    LRUCache::MultiGet(request);
+  }
+
+  int num_multi_gets() const { return num_multi_gets_; }
+  int num_multi_get_keys() const { return num_multi_get_keys_; }
+
+ private:
+  int num_multi_gets_;
+  int num_multi_get_keys_;
+
+  DISALLOW_COPY_AND_ASSIGN(MultiGetCountingCache);
+};
+
 class WriteThroughCacheTest : public CacheTestBase {
  protected:
   WriteThroughCacheTest()
@@ -36,7 +60,7 @@ class WriteThroughCacheTest : public CacheTestBase {
         write_through_cache_(&small_cache_, &big_cache_) {}
 
   LRUCache small_cache_;
-  LRUCache big_cache_;
+  MultiGetCountingCache big_cache_;
   WriteThroughCache write_through_cache_;
 
   CacheInterface* Cache() override { return &write_through_cache_; }
@@ -121,4 +145,31 @@ TEST_F(WriteThroughCacheTest, FindShadowedValid) {
   CheckGet(&small_cache_, "Name", "valid");
 }
 
+TEST_F(WriteThroughCacheTest, MultiGet) {
+  TestMultiGet();
+}
+
+TEST_F(WriteThroughCacheTest, MultiGetBatchesCache2Lookups) {
+  // n0 is in both caches; n1 and n2 only in the big one.
+  CheckPut(&big_cache_, "n1", "v1");
+  CheckPut(&big_cache_, "n2", "v2");
+  CheckPut("n0", "v0");
+
+  Callback* n0 = AddCallback();
+  Callback* n1 = AddCallback();
+  Callback* n2 = AddCallback();
+  IssueMultiGet(n0, "n0", n1, "n1", n2, "n2");
+  WaitAndCheck(n0, "v0");
+  WaitAndCheck(n1, "v1");
+  WaitAndCheck(n2, "v2");
+
+  // The two misses in the small cache went to the big one together.
+  EXPECT_EQ(1, big_cache_.num_multi_gets());
+  EXPECT_EQ(2, big_cache_.num_multi_get_keys());
+
+  // And were written back to the small cache.
+  CheckGet(&small_cache_, "n1", "v1");
+  CheckGet(&small_cache_, "n2", "v2");
+}
+
 }  // namespace net_instaweb
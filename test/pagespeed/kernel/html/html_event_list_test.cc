@@ -0,0 +1,204 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Unit-test the intrusive HtmlEventList and the HtmlEventArena that
+// HtmlParse allocates its events from.
+
+#include "pagespeed/kernel/html/html_event_list.h"
+
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/html/html_event.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+
+namespace net_instaweb {
+
+class HtmlEventListTest : public testing::Test {
+ protected:
+  ~HtmlEventListTest() override {
+    STLDeleteElements(&list_);
+    STLDeleteElements(&other_);
+  }
+
+  // The line number serves to identify each event.
+  HtmlEvent* NewEvent(int id) {
+    return new (&arena_) HtmlStartDocumentEvent(id);
+  }
+
+  static GoogleString Ids(const HtmlEventList& list) {
+    GoogleString ids;
+    for (HtmlEventListIterator p = list.begin(); p != list.end(); ++p) {
+      StrAppend(&ids, ids.empty() ? "" : ",",
+                IntegerToString((*p)->line_number()));
+    }
+    return ids;
+  }
+
+  // Also walk backwards, to make sure the prev links are consistent.
+  static GoogleString ReverseIds(const HtmlEventList& list) {
+    GoogleString ids;
+    HtmlEventListIterator p = list.end();
+    while (p != list.begin()) {
+      --p;
+      StrAppend(&ids, ids.empty() ? "" : ",",
+                IntegerToString((*p)->line_number()));
+    }
+    return ids;
+  }
+
+  HtmlEventArena arena_;  // Must outlive the events in the lists.
+  HtmlEventList list_;
+  HtmlEventList other_;
+};
+
+TEST_F(HtmlEventListTest, Empty) {
+  EXPECT_TRUE(list_.empty());
+  EXPECT_EQ(0, list_.size());
+  EXPECT_TRUE(list_.begin() == list_.end());
+}
+
+TEST_F(HtmlEventListTest, PushAndInsert) {
+  list_.push_back(NewEvent(2));
+  list_.push_front(NewEvent(1));
+  list_.push_back(NewEvent(4));
+  HtmlEventListIterator four = list_.end();
+  --four;
+  HtmlEventListIterator three = list_.insert(four, NewEvent(3));
+  EXPECT_EQ(3, (*three)->line_number());
+  EXPECT_EQ("1,2,3,4", Ids(list_));
+  EXPECT_EQ("4,3,2,1", ReverseIds(list_));
+  EXPECT_EQ(4, list_.size());
+  EXPECT_FALSE(list_.empty());
+}
+
+TEST_F(HtmlEventListTest, EraseKeepsOtherIteratorsValid) {
+  for (int i = 1; i <= 4; ++i) {
+    list_.push_back(NewEvent(i));
+  }
+  HtmlEventListIterator two = list_.begin();
+  ++two;
+  HtmlEventListIterator three = two;
+  ++three;
+  HtmlEvent* event = *two;
+  HtmlEventListIterator next = list_.erase(two);
+  delete event;
+  EXPECT_TRUE(next == three);
+  EXPECT_EQ(3, (*three)->line_number());
+  EXPECT_EQ("1,3,4", Ids(list_));
+  EXPECT_EQ("4,3,1", ReverseIds(list_));
+  EXPECT_EQ(3, list_.size());
+}
+
+TEST_F(HtmlEventListTest, SpliceWithinList) {
+  for (int i = 1; i <= 5; ++i) {
+    list_.push_back(NewEvent(i));
+  }
+  // Move [2, 4) to the end.
+  HtmlEventListIterator two = list_.begin();
+  ++two;
+  HtmlEventListIterator four = two;
+  ++four;
+  ++four;
+  list_.splice(list_.end(), list_, two, four);
+  EXPECT_EQ("1,4,5,2,3", Ids(list_));
+  EXPECT_EQ("3,2,5,4,1", ReverseIds(list_));
+  EXPECT_EQ(5, list_.size());
+  EXPECT_EQ(2, (*two)->line_number());
+}
+
+TEST_F(HtmlEventListTest, SpliceAcrossLists) {
+  for (int i = 1; i <= 5; ++i) {
+    list_.push_back(NewEvent(i));
+  }
+  other_.push_back(NewEvent(10));
+  HtmlEventListIterator two = list_.begin();
+  ++two;
+  HtmlEventListIterator last = list_.end();
+  --last;
+  other_.splice(other_.end(), list_, two, last);
+  EXPECT_EQ("1,5", Ids(list_));
+  EXPECT_EQ("5,1", ReverseIds(list_));
+  EXPECT_EQ(2, list_.size());
+  EXPECT_EQ("10,2,3,4", Ids(other_));
+  EXPECT_EQ("4,3,2,10", ReverseIds(other_));
+  EXPECT_EQ(4, other_.size());
+
+  // Splicing everything back empties other_.
+  list_.splice(last, other_, other_.begin(), other_.end());
+  EXPECT_EQ("1,10,2,3,4,5", Ids(list_));
+  EXPECT_EQ(6, list_.size());
+  EXPECT_TRUE(other_.empty());
+  EXPECT_TRUE(other_.begin() == other_.end());
+}
+
+TEST_F(HtmlEventListTest, ArenaReusesFreedSlots) {
+  HtmlEvent* first = NewEvent(1);
+  HtmlEvent* second = NewEvent(2);
+  EXPECT_EQ(2, arena_.live_events());
+  EXPECT_EQ(1, arena_.num_chunks());
+  delete first;
+  EXPECT_EQ(1, arena_.live_events());
+  HtmlEvent* third = NewEvent(3);
+  EXPECT_EQ(first, third);
+  delete second;
+  delete third;
+  EXPECT_EQ(0, arena_.live_events());
+}
+
+TEST_F(HtmlEventListTest, ArenaRewind) {
+  // Fill more than one chunk.
+  for (int i = 0; i < 1000; ++i) {
+    list_.push_back(NewEvent(i));
+  }
+  int num_chunks = arena_.num_chunks();
+  EXPECT_LT(1, num_chunks);
+  HtmlEvent* first = *list_.begin();
+
+  // Can't rewind while events are live.
+  EXPECT_FALSE(arena_.Rewind());
+  STLDeleteElements(&list_);
+  EXPECT_TRUE(arena_.Rewind());
+
+  // The next flush window starts over from the first chunk, without
+  // allocating new ones.
+  for (int i = 0; i < 1000; ++i) {
+    list_.push_back(NewEvent(i));
+  }
+  EXPECT_EQ(first, *list_.begin());
+  EXPECT_EQ(num_chunks, arena_.num_chunks());
+
+  EXPECT_FALSE(arena_.Release());
+  STLDeleteElements(&list_);
+  EXPECT_TRUE(arena_.Release());
+  EXPECT_EQ(0, arena_.num_chunks());
+}
+
+TEST_F(HtmlEventListTest, HeapAllocatedEvents) {
+  // Events made with plain new don't touch the arena, and mix freely with
+  // arena events in a list.
+  list_.push_back(new HtmlStartDocumentEvent(1));
+  list_.push_back(NewEvent(2));
+  EXPECT_EQ(1, arena_.live_events());
+  EXPECT_EQ("1,2", Ids(list_));
+  STLDeleteElements(&list_);
+  EXPECT_EQ(0, arena_.live_events());
+}
+
+}  // namespace net_instaweb
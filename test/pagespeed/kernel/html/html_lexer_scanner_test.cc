@@ -0,0 +1,247 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Unit-test the block scanners HtmlLexer uses to skip inert runs of bytes,
+// and check that the lexer produces the same events with and without them.
+
+#include "pagespeed/kernel/html/html_lexer_scanner.h"
+
+#include <random>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/string_writer.h"
+#include "pagespeed/kernel/html/empty_html_filter.h"
+#include "pagespeed/kernel/html/html_element.h"
+#include "pagespeed/kernel/html/html_node.h"
+#include "pagespeed/kernel/html/html_parse.h"
+#include "pagespeed/kernel/html/html_writer_filter.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Bytes the lexer cares about inside <script>, plus enough letters to spell
+// "script" so random strings hit the interesting cases.
+const char kScriptAlphabet[] = "-/> \t\n\r\f<!scriptSCRIPTxy";
+
+GoogleString RandomString(std::mt19937* random, const char* alphabet,
+                          int size) {
+  int alphabet_size = strlen(alphabet);
+  GoogleString str;
+  for (int i = 0; i < size; ++i) {
+    str += alphabet[(*random)() % alphabet_size];
+  }
+  return str;
+}
+
+TEST(HtmlLexerScannerTest, SkipToByte) {
+  const char kText[] = "hello <world>";
+  int size = STATIC_STRLEN(kText);
+  EXPECT_EQ(6, html_lexer_scanner::SkipToByte(kText, size, '<'));
+  EXPECT_EQ(12, html_lexer_scanner::SkipToByte(kText, size, '>'));
+  EXPECT_EQ(size, html_lexer_scanner::SkipToByte(kText, size, '-'));
+  EXPECT_EQ(0, html_lexer_scanner::SkipToByte(kText, 0, '<'));
+}
+
+TEST(HtmlLexerScannerTest, SkipScriptBody) {
+  // The leading 'x' is text[-1] for each call.
+  const GoogleString kScript =
+      "xvar a = b;\nif (c > d) {}";
+  const char* text = kScript.data() + 1;
+  int size = kScript.size() - 1;
+  // "a = b" has spaces, but not after a 't', so the first stop is '>'.
+  EXPECT_EQ(kScript.find('>') - 1, html_lexer_scanner::SkipScriptBody(
+                                       text, size));
+
+  // Whitespace or '/' after a 't' might be ending "</script".
+  const GoogleString kEnd = "xabc</script >";
+  EXPECT_EQ(kEnd.find(' ') - 1,
+            html_lexer_scanner::SkipScriptBody(kEnd.data() + 1,
+                                               kEnd.size() - 1));
+  const GoogleString kUpperEnd = "xabc</SCRIPT/";
+  EXPECT_EQ(kUpperEnd.rfind('/') - 1,
+            html_lexer_scanner::SkipScriptBody(kUpperEnd.data() + 1,
+                                               kUpperEnd.size() - 1));
+
+  // The byte before the buffer counts too.
+  const GoogleString kSplit = "t\nfoo";
+  EXPECT_EQ(0, html_lexer_scanner::SkipScriptBody(kSplit.data() + 1,
+                                                  kSplit.size() - 1));
+
+  const GoogleString kNoStops(100, 'z');
+  EXPECT_EQ(99, html_lexer_scanner::SkipScriptBody(kNoStops.data() + 1,
+                                                   kNoStops.size() - 1));
+}
+
+TEST(HtmlLexerScannerTest, SkipScriptBodyMatchesScalar) {
+  std::mt19937 random(1234);
+  for (int trial = 0; trial < 2000; ++trial) {
+    // Mostly inert bytes, with an occasional interesting one, at lengths
+    // that exercise both the 16-byte blocks and the tail.
+    int size = 1 + random() % 80;
+    GoogleString str = RandomString(&random, "abcdefgh", size + 1);
+    int num_specials = random() % 4;
+    for (int i = 0; i < num_specials; ++i) {
+      str[random() % str.size()] =
+          kScriptAlphabet[random() % STATIC_STRLEN(kScriptAlphabet)];
+    }
+    EXPECT_EQ(html_lexer_scanner::SkipScriptBodyScalar(str.data() + 1, size),
+              html_lexer_scanner::SkipScriptBody(str.data() + 1, size))
+        << str;
+  }
+}
+
+// Records every event the parser emits, with line numbers.
+class EventRecorder : public EmptyHtmlFilter {
+ public:
+  EventRecorder() {}
+
+  void StartElement(HtmlElement* element) override {
+    StrAppend(&events_, "+", element->name_str(), "@",
+              IntegerToString(element->begin_line_number()));
+    for (const HtmlElement::Attribute& attr : element->attributes()) {
+      StrAppend(&events_, " ", attr.name_str(), "=",
+                attr.escaped_value() == nullptr ? "" : attr.escaped_value());
+    }
+    events_ += "\n";
+  }
+  void EndElement(HtmlElement* element) override {
+    StrAppend(&events_, "-", element->name_str(), "@",
+              IntegerToString(element->end_line_number()), "\n");
+  }
+  void Cdata(HtmlCdataNode* cdata) override { Leaf("cdata", cdata); }
+  void Comment(HtmlCommentNode* comment) override { Leaf("comment", comment); }
+  void IEDirective(HtmlIEDirectiveNode* directive) override {
+    Leaf("ie", directive);
+  }
+  void Characters(HtmlCharactersNode* characters) override {
+    Leaf("chars", characters);
+  }
+  void Directive(HtmlDirectiveNode* directive) override {
+    StrAppend(&events_, "directive[", directive->contents(), "]\n");
+  }
+  const char* Name() const override { return "EventRecorder"; }
+
+  const GoogleString& events() const { return events_; }
+
+ private:
+  void Leaf(const char* kind, HtmlLeafNode* node) {
+    StrAppend(&events_, kind, "[", node->contents(), "]\n");
+  }
+
+  GoogleString events_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventRecorder);
+};
+
+class HtmlLexerScannerParseTest : public testing::Test {
+ protected:
+  // Parses html in pieces of chunk_size bytes, or all at once if
+  // chunk_size is 0, returning the events and the serialized output.
+  // One-byte chunks leave the lexer nothing to skip, so they give the
+  // byte-at-a-time reference behavior.
+  static GoogleString Parse(StringPiece html, int chunk_size) {
+    GoogleMessageHandler handler;
+    HtmlParse html_parse(&handler);
+    EventRecorder recorder;
+    GoogleString output;
+    StringWriter writer(&output);
+    HtmlWriterFilter writer_filter(&html_parse);
+    writer_filter.set_writer(&writer);
+    html_parse.AddFilter(&recorder);
+    html_parse.AddFilter(&writer_filter);
+    html_parse.StartParse("http://example.com/");
+    if (chunk_size == 0) {
+      html_parse.ParseText(html);
+    } else {
+      for (size_t pos = 0; pos < html.size(); pos += chunk_size) {
+        html_parse.ParseText(html.substr(pos, chunk_size));
+      }
+    }
+    html_parse.FinishParse();
+    return StrCat(recorder.events(), "=====\n", output);
+  }
+
+  static void ExpectSameEvents(StringPiece html) {
+    GoogleString reference = Parse(html, 1);
+    EXPECT_EQ(reference, Parse(html, 0)) << html;
+    EXPECT_EQ(reference, Parse(html, 7)) << html;
+    EXPECT_EQ(reference, Parse(html, 16)) << html;
+  }
+};
+
+TEST_F(HtmlLexerScannerParseTest, Text) {
+  ExpectSameEvents(
+      "<html><head><title>A page</title></head>\n"
+      "<body>\nSome text &amp; more text,\nspread over lines.\n"
+      "a < b and c<d</body></html>\n");
+}
+
+TEST_F(HtmlLexerScannerParseTest, Attributes) {
+  ExpectSameEvents(
+      "<a href=\"http://example.com/a long/path?x=1&amp;y='2'\" "
+      "title='it\"s\nhere' class=\"\" data-x=unquoted>link</a>\n"
+      "<img src=\"unterminated.png>");
+}
+
+TEST_F(HtmlLexerScannerParseTest, Comments) {
+  ExpectSameEvents(
+      "<p>before<!-- a - comment -- with -- dashes --->after</p>\n"
+      "<!--[if IE]>ie only<![endif]-->\n<!-- unterminated - comment");
+}
+
+TEST_F(HtmlLexerScannerParseTest, Cdata) {
+  ExpectSameEvents(
+      "<svg><![CDATA[ x ] y ]] z ]]]></svg>\n<![CDATA[ unterminated ]");
+}
+
+TEST_F(HtmlLexerScannerParseTest, LiteralTags) {
+  ExpectSameEvents(
+      "<style>a > b { color: red }\n</sty</STYLE >x</style>\n"
+      "<textarea><b>not bold</b></textarea><iframe>x</iframe >");
+}
+
+TEST_F(HtmlLexerScannerParseTest, Scripts) {
+  ExpectSameEvents(
+      "<script>if (a > b && c-- > 0) { s = \"</scrip\" + 't>'; }</script>\n"
+      "<script>var x = 1;\n</SCRIPT\tfoo=bar>after\n"
+      "<script><!-- <script> </script> still script --> </script >\n"
+      "<script>document.write('</script/>');</script>tail\n"
+      "<script type=\"text/template\"><div>t </div>t\nt/</script>");
+}
+
+TEST_F(HtmlLexerScannerParseTest, RandomDocuments) {
+  const char kAlphabet[] =
+      "<>/!-[]= \n\tabcdeipprsttTSCRIPT\"'";
+  const char* kPrefixes[] = {"", "<script>", "<style>", "<!--", "<![CDATA["};
+  std::mt19937 random(5678);
+  for (int trial = 0; trial < 500; ++trial) {
+    GoogleString html = kPrefixes[trial % arraysize(kPrefixes)];
+    html += RandomString(&random, kAlphabet, random() % 200);
+    ExpectSameEvents(html);
+  }
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
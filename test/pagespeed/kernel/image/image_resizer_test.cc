@@ -19,12 +19,16 @@
 
 #include "pagespeed/kernel/image/image_resizer.h"
 
+#include <algorithm>
+#include <cstdlib>
+
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/null_mutex.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/image/jpeg_optimizer.h"
+#include "pagespeed/kernel/image/jpeg_reader.h"
 #include "pagespeed/kernel/image/png_optimizer.h"
 #include "pagespeed/kernel/image/read_image.h"
 #include "pagespeed/kernel/image/webp_optimizer.h"
@@ -44,7 +48,9 @@ using pagespeed::image_compression::RGB_888;
 using pagespeed::image_compression::RGBA_8888;
 // Readers and writers
 using pagespeed::image_compression::JpegCompressionOptions;
+using pagespeed::image_compression::JpegScanlineReader;
 using pagespeed::image_compression::JpegScanlineWriter;
+using pagespeed::image_compression::kJpegTestDir;
 using pagespeed::image_compression::kMessagePatternPixelFormat;
 using pagespeed::image_compression::kMessagePatternStats;
 using pagespeed::image_compression::kMessagePatternUnexpectedEOF;
@@ -54,7 +60,9 @@ using pagespeed::image_compression::kPngTestDir;
 using pagespeed::image_compression::kResizedTestDir;
 using pagespeed::image_compression::PngScanlineReaderRaw;
 using pagespeed::image_compression::ReadTestFile;
+using pagespeed::image_compression::ScanlineReaderInterface;
 using pagespeed::image_compression::ScanlineResizer;
+using pagespeed::image_compression::ScanlineStatus;
 using pagespeed::image_compression::ScanlineWriterInterface;
 using pagespeed::image_compression::WebpConfiguration;
 
@@ -347,6 +355,79 @@ TEST_F(ScanlineResizerTest, ResizeFractionalRatio) {
   EXPECT_EQ(new_height, num_rows);
 }
 
+// Forwards to another reader, but always decodes at full size.
+class FullSizeReader : public ScanlineReaderInterface {
+ public:
+  explicit FullSizeReader(ScanlineReaderInterface* reader) : reader_(reader) {}
+
+  bool Reset() override { return reader_->Reset(); }
+  size_t GetBytesPerScanline() override {
+    return reader_->GetBytesPerScanline();
+  }
+  bool HasMoreScanLines() override { return reader_->HasMoreScanLines(); }
+  ScanlineStatus InitializeWithStatus(const void* image_buffer,
+                                      size_t buffer_length) override {
+    return reader_->InitializeWithStatus(image_buffer, buffer_length);
+  }
+  ScanlineStatus ReadNextScanlineWithStatus(void** out_scanline) override {
+    return reader_->ReadNextScanlineWithStatus(out_scanline);
+  }
+  size_t GetImageHeight() override { return reader_->GetImageHeight(); }
+  size_t GetImageWidth() override { return reader_->GetImageWidth(); }
+  PixelFormat GetPixelFormat() override { return reader_->GetPixelFormat(); }
+  bool IsProgressive() override { return reader_->IsProgressive(); }
+
+ private:
+  ScanlineReaderInterface* reader_;
+};
+
+// JPEGs are shrunk partly by libjpeg while decoding. The result should be
+// close to shrinking the fully decoded image.
+TEST_F(ScanlineResizerTest, ResizeJpegAtReducedDecodeSize) {
+  const int kWidth = 60;
+  const int kHeight = 45;
+  ASSERT_TRUE(ReadTestFile(kJpegTestDir, "sjpeg4", "jpg", &input_image_));
+
+  JpegScanlineReader jpeg_reader(&message_handler_);
+  ASSERT_TRUE(
+      jpeg_reader.Initialize(input_image_.data(), input_image_.length()));
+  ASSERT_TRUE(resizer_.Initialize(&jpeg_reader, kWidth, kHeight));
+  // 512x384 is decoded at 1/4 scale, leaving 2x for the resizer.
+  EXPECT_EQ(128, jpeg_reader.GetImageWidth());
+  EXPECT_EQ(96, jpeg_reader.GetImageHeight());
+
+  JpegScanlineReader full_jpeg_reader(&message_handler_);
+  FullSizeReader full_reader(&full_jpeg_reader);
+  ScanlineResizer full_resizer(&message_handler_);
+  ASSERT_TRUE(
+      full_reader.Initialize(input_image_.data(), input_image_.length()));
+  ASSERT_TRUE(full_resizer.Initialize(&full_reader, kWidth, kHeight));
+  EXPECT_EQ(512, full_reader.GetImageWidth());
+
+  ASSERT_EQ(kWidth, resizer_.GetImageWidth());
+  ASSERT_EQ(kHeight, resizer_.GetImageHeight());
+  ASSERT_EQ(kWidth, full_resizer.GetImageWidth());
+  ASSERT_EQ(kHeight, full_resizer.GetImageHeight());
+
+  int64 total_diff = 0;
+  int max_diff = 0;
+  while (resizer_.HasMoreScanLines()) {
+    uint8* scanline = nullptr;
+    uint8* full_scanline = nullptr;
+    ASSERT_TRUE(resizer_.ReadNextScanline(reinterpret_cast<void**>(&scanline)));
+    ASSERT_TRUE(full_resizer.ReadNextScanline(
+        reinterpret_cast<void**>(&full_scanline)));
+    for (size_t i = 0; i < resizer_.GetBytesPerScanline(); ++i) {
+      int diff = std::abs(scanline[i] - full_scanline[i]);
+      total_diff += diff;
+      max_diff = std::max(max_diff, diff);
+    }
+  }
+  EXPECT_FALSE(full_resizer.HasMoreScanLines());
+  EXPECT_GT(32, max_diff);
+  EXPECT_GT(3 * kWidth * kHeight * 3, total_diff);  // Mean difference < 3.
+}
+
 TEST_F(ScanlineResizerTest, LargeImage) {
   ASSERT_TRUE(ReadTestFile(kPngTestDir, kLarge4096x2048, "png", &input_image_));
   ResizeAndValidateImage(kLarge4096x2048, input_image_);
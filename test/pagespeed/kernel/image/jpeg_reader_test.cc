@@ -142,4 +142,57 @@ TEST(JpegReaderTest, PartialRead) {
   ASSERT_TRUE(reader4.ReadNextScanline(&scanline));
 }
 
+// Verify that the reader picks the smallest libjpeg scale that still covers
+// the requested size.
+TEST(JpegReaderTest, ReducedSizeDecode) {
+  GoogleString image;
+  void* scanline = nullptr;
+  MockMessageHandler message_handler(new NullMutex);
+  ReadTestFile(kJpegTestDir, "sjpeg4", "jpg", &image);  // 512x384 RGB
+
+  JpegScanlineReader reader(&message_handler);
+  ASSERT_TRUE(reader.Initialize(image.c_str(), image.length()));
+  // 1/8 would give 64x48, which is too small.
+  ASSERT_TRUE(reader.SetMinimumDecodeSize(100, 90));
+  EXPECT_EQ(128, reader.GetImageWidth());
+  EXPECT_EQ(96, reader.GetImageHeight());
+  EXPECT_EQ(3 * 128, reader.GetBytesPerScanline());
+  int num_rows = 0;
+  while (reader.HasMoreScanLines()) {
+    ASSERT_TRUE(reader.ReadNextScanline(&scanline));
+    ++num_rows;
+  }
+  EXPECT_EQ(96, num_rows);
+
+  // Scaled dimensions are rounded up.
+  ReadTestFile(kJpegTestDir, "testgray", "jpg", &image);  // 130x97 gray
+  ASSERT_TRUE(reader.Initialize(image.c_str(), image.length()));
+  ASSERT_TRUE(reader.SetMinimumDecodeSize(1, 1));
+  EXPECT_EQ(17, reader.GetImageWidth());
+  EXPECT_EQ(13, reader.GetImageHeight());
+  EXPECT_EQ(17, reader.GetBytesPerScanline());
+  while (reader.HasMoreScanLines()) {
+    ASSERT_TRUE(reader.ReadNextScanline(&scanline));
+  }
+}
+
+TEST(JpegReaderTest, NoReducedSizeDecode) {
+  GoogleString image;
+  void* scanline = nullptr;
+  MockMessageHandler message_handler(new NullMutex);
+  ReadTestFile(kJpegTestDir, "sjpeg4", "jpg", &image);  // 512x384 RGB
+
+  // Not even 1/2 is big enough.
+  JpegScanlineReader reader(&message_handler);
+  ASSERT_TRUE(reader.Initialize(image.c_str(), image.length()));
+  EXPECT_FALSE(reader.SetMinimumDecodeSize(257, 10));
+  EXPECT_EQ(512, reader.GetImageWidth());
+  EXPECT_EQ(384, reader.GetImageHeight());
+
+  // Too late once decoding has started.
+  ASSERT_TRUE(reader.ReadNextScanline(&scanline));
+  EXPECT_FALSE(reader.SetMinimumDecodeSize(10, 10));
+  EXPECT_EQ(512, reader.GetImageWidth());
+}
+
 }  // namespace
@@ -26,9 +26,11 @@
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/null_mutex.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/image/gif_reader.h"
 #include "pagespeed/kernel/image/read_image.h"
 #include "pagespeed/kernel/image/scanline_utils.h"
+#include "pagespeed/kernel/util/platform.h"
 #include "test/pagespeed/kernel/base/gtest.h"
 #include "test/pagespeed/kernel/base/mock_message_handler.h"
 #include "test/pagespeed/kernel/image/test_utils.h"
@@ -51,6 +53,8 @@ namespace {
 
 using net_instaweb::MockMessageHandler;
 using net_instaweb::NullMutex;
+using net_instaweb::Platform;
+using net_instaweb::ThreadSystem;
 using pagespeed::image_compression::GifReader;
 using pagespeed::image_compression::GRAY_8;
 using pagespeed::image_compression::IMAGE_PNG;
@@ -619,6 +623,30 @@ TEST_F(PngOptimizerTest, ValidPngs) {
   }
 }
 
+// Trying the compression settings on several threads, and abandoning the
+// ones that fall behind, must pick exactly the output a single thread does.
+TEST_F(PngOptimizerTest, ConcurrentBestCompression) {
+  std::unique_ptr<ThreadSystem> thread_system(Platform::CreateThreadSystem());
+  reader_ = std::make_unique<PngReader>(&message_handler_);
+  for (size_t i = 0; i < kValidImageCount; i++) {
+    GoogleString in, serial_out;
+    ReadTestFile(kPngSuiteTestDir, kValidImages[i].filename, "png", &in);
+    ASSERT_TRUE(PngOptimizer::OptimizePngBestCompression(
+        *reader_, in, &serial_out, &message_handler_))
+        << kValidImages[i].filename;
+    EXPECT_EQ(kValidImages[i].compressed_size_best, serial_out.size())
+        << kValidImages[i].filename;
+    for (int threads = 1; threads <= 4; threads *= 2) {
+      GoogleString out;
+      ASSERT_TRUE(PngOptimizer::OptimizePngBestCompression(
+          *reader_, in, &out, thread_system.get(), threads, &message_handler_))
+          << kValidImages[i].filename << " threads=" << threads;
+      EXPECT_EQ(serial_out, out)
+          << kValidImages[i].filename << " threads=" << threads;
+    }
+  }
+}
+
 TEST(PngScanlineReaderTest, InitializeRead_validPngs) {
   MockMessageHandler message_handler(new NullMutex);
   PngScanlineReader scanline_reader(&message_handler);
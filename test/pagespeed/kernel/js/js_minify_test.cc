@@ -19,10 +19,14 @@
 
 #include "pagespeed/kernel/js/js_minify.h"
 
+#include <random>
+
 #include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
 #include "pagespeed/kernel/base/stdio_file_system.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/js/js_keywords.h"
 #include "test/pagespeed/kernel/base/gtest.h"
 
@@ -152,6 +156,54 @@ class JsMinifyTest : public testing::Test {
     EXPECT_STREQ(expected, actual);
   }
 
+  GoogleString ReadTestFile(StringPiece filename) {
+    net_instaweb::StdioFileSystem file_system;
+    net_instaweb::GoogleMessageHandler message_handler;
+    const GoogleString filepath =
+        StrCat(net_instaweb::GTestSrcDir(), kTestRootDir, filename);
+    GoogleString contents;
+    EXPECT_TRUE(
+        file_system.ReadFile(filepath.c_str(), &contents, &message_handler));
+    return contents;
+  }
+
+  // Feeds input to a StreamingJsMinifier in pieces of chunk_size bytes, and
+  // checks that the output and source map are the same as when minifying it
+  // all at once.
+  void CheckStreamingMinification(StringPiece input, int chunk_size) {
+    GoogleString expected;
+    net_instaweb::source_map::MappingVector mappings;
+    const bool expected_ok = pagespeed::js::MinifyUtf8JsWithSourceMap(
+        &patterns_, input, &expected, &mappings);
+    GoogleString expected_map;
+    ASSERT_TRUE(net_instaweb::source_map::Encode(
+        "gen.js", "src.js", mappings, &expected_map));
+
+    net_instaweb::NullMessageHandler handler;
+    GoogleString actual;
+    net_instaweb::StringWriter writer(&actual);
+    GoogleString actual_map;
+    net_instaweb::StringWriter map_writer(&actual_map);
+    net_instaweb::source_map::StreamingEncoder encoder(
+        "gen.js", "src.js", &map_writer, &handler);
+    pagespeed::js::StreamingJsMinifier minifier(&patterns_, &writer, &encoder,
+                                                &handler);
+    for (size_t pos = 0; pos < input.size(); pos += chunk_size) {
+      EXPECT_TRUE(minifier.Minify(input.substr(pos, chunk_size)));
+    }
+    EXPECT_EQ(expected_ok, minifier.Finish());
+    EXPECT_EQ(!expected_ok, minifier.has_error());
+    EXPECT_TRUE(encoder.Finish());
+    EXPECT_STREQ(expected, actual) << "chunk_size=" << chunk_size;
+    EXPECT_STREQ(expected_map, actual_map) << "chunk_size=" << chunk_size;
+  }
+
+  void CheckStreamingMinification(StringPiece input) {
+    for (int chunk_size : {1, 2, 7, 16, 17, 100, 4096, 100000}) {
+      CheckStreamingMinification(input, chunk_size);
+    }
+  }
+
   pagespeed::js::JsTokenizerPatterns patterns_;
 };
 
@@ -692,4 +744,81 @@ TEST_F(JsMinifyTest, SourceMapsComplex) {
   EXPECT_EQ(expected_map, MappingsToString(mappings));
 }
 
+TEST_F(JsMinifyTest, StreamingBasic) {
+  CheckStreamingMinification("");
+  CheckStreamingMinification(kBeforeCompilation);
+  CheckStreamingMinification(kCrashTestString);
+  CheckStreamingMinification(kCollapsingStringTestString);
+}
+
+TEST_F(JsMinifyTest, StreamingTokensAcrossChunks) {
+  // Each of these has a token or a decision about whitespace or semicolon
+  // insertion that depends on input from more than one chunk.
+  CheckStreamingMinification(
+      "var identifierThatIsMuchLongerThanSixteenBytes = 1234567890.5e+10;\n"
+      "a = 'a string with \\'escapes\\' in it' + \"another\";\n"
+      "a = \"\\\"\\])*?)\\\\3)|)*\\\\]\" + '\\'\\\\\\'';\n"
+      "b = /a regex[/]that contains slashes/gi.test(c) / d / e;\n"
+      "f = g\n++h\ni\n--\nj;\n"
+      "return\n/* comment */ 42;\n"
+      "k = l instanceof\nm;\n"
+      "n = o + ++p - -q - --r + +s;\n"
+      "/* a long block comment that spans several chunks at most sizes */\n"
+      "// a line comment\rt = 1.\n.toString();\n");
+}
+
+TEST_F(JsMinifyTest, StreamingIEConditionalComments) {
+  CheckStreamingMinification(
+      "var a = 1;\n/*@cc_on\n  @if (@_jscript_version >= 5)\n"
+      "    document.write('JScript');\n  @end\n@*/\nvar b = 2;\n");
+}
+
+TEST_F(JsMinifyTest, StreamingErrors) {
+  CheckStreamingMinification("var a = 1;\nvar b = 'unclosed string\nc();\n");
+  CheckStreamingMinification("var a = 1;\n/* unclosed comment\nb();");
+  CheckStreamingMinification("var a = /unclosed regex\n;b();");
+  CheckStreamingMinification("a = (b + c;\n}\nfunction d() { return 1; }\n");
+}
+
+TEST_F(JsMinifyTest, StreamingLongToken) {
+  // A token longer than the window in which the minifier keeps state for
+  // backing up.
+  GoogleString input = "var a = 1;\nvar s = '";
+  input.append(10000, 'x');
+  input += "';\nvar b = 2;\n";
+  CheckStreamingMinification(input);
+  CheckStreamingMinification(input, 5000);
+}
+
+TEST_F(JsMinifyTest, StreamingLibraries) {
+  for (const char* filename :
+       {"angular.original", "jquery.original", "prototype.original"}) {
+    const GoogleString original = ReadTestFile(filename);
+    for (int chunk_size : {1, 997, 65536}) {
+      CheckStreamingMinification(original, chunk_size);
+    }
+  }
+}
+
+TEST_F(JsMinifyTest, StreamingRandomChunks) {
+  const GoogleString original = ReadTestFile("jquery.original");
+  GoogleString expected;
+  ASSERT_TRUE(pagespeed::js::MinifyUtf8Js(&patterns_, original, &expected));
+  std::mt19937 random(1234);
+  for (int trial = 0; trial < 20; ++trial) {
+    net_instaweb::NullMessageHandler handler;
+    GoogleString actual;
+    net_instaweb::StringWriter writer(&actual);
+    pagespeed::js::StreamingJsMinifier minifier(&patterns_, &writer, nullptr,
+                                                &handler);
+    for (size_t pos = 0; pos < original.size();) {
+      const size_t size = random() % 3000;
+      EXPECT_TRUE(minifier.Minify(StringPiece(original).substr(pos, size)));
+      pos += size;
+    }
+    EXPECT_TRUE(minifier.Finish());
+    EXPECT_STREQ(expected, actual);
+  }
+}
+
 }  // namespace
@@ -20,6 +20,7 @@
 #include "pagespeed/kernel/js/js_tokenizer.h"
 
 #include <memory>
+#include <random>
 #include <utility>
 
 #include "pagespeed/kernel/base/google_message_handler.h"
@@ -74,17 +75,19 @@ class JsTokenizerTest : public testing::Test {
     EXPECT_TRUE(tokenizer_->has_error());
   }
 
+  static void ReadTestFile(StringPiece filename, GoogleString* contents) {
+    net_instaweb::StdioFileSystem file_system;
+    const GoogleString filepath =
+        StrCat(net_instaweb::GTestSrcDir(), kTestRootDir, filename);
+    net_instaweb::GoogleMessageHandler message_handler;
+    ASSERT_TRUE(
+        file_system.ReadFile(filepath.c_str(), contents, &message_handler));
+  }
+
   void ExpectTokenizeFileSuccessfully(StringPiece filename) {
     // Read in the JavaScript file.
     GoogleString original;
-    {
-      net_instaweb::StdioFileSystem file_system;
-      const GoogleString filepath =
-          StrCat(net_instaweb::GTestSrcDir(), kTestRootDir, filename);
-      net_instaweb::GoogleMessageHandler message_handler;
-      ASSERT_TRUE(
-          file_system.ReadFile(filepath.c_str(), &original, &message_handler));
-    }
+    ReadTestFile(filename, &original);
     // Tokenize the JavaScript, appending each token onto the output string.
     // There should be no tokenizer errors.
     GoogleString output;
@@ -103,6 +106,25 @@ class JsTokenizerTest : public testing::Test {
     EXPECT_STREQ(original, output);
   }
 
+  // Tokenizes input both with and without the byte-class fast paths, and
+  // checks that we get the same tokens and parse states either way.
+  void ExpectSameTokensWithoutFastPaths(StringPiece input) {
+    JsTokenizer fast(&patterns_, input);
+    JsTokenizer slow(&patterns_, input);
+    slow.DisableFastPathsForTest();
+    JsKeywords::Type type;
+    do {
+      StringPiece fast_token, slow_token;
+      type = slow.NextToken(&slow_token);
+      const JsKeywords::Type fast_type = fast.NextToken(&fast_token);
+      ASSERT_EQ(std::make_pair(type, slow_token),
+                std::make_pair(fast_type, fast_token))
+          << "Input: " << input.substr(0, 200);
+      ASSERT_EQ(slow.ParseStackForTest(), fast.ParseStackForTest())
+          << "Input: " << input.substr(0, 200);
+    } while (type != JsKeywords::kEndOfInput && type != JsKeywords::kError);
+  }
+
  private:
   JsTokenizerPatterns patterns_;
   std::unique_ptr<JsTokenizer> tokenizer_;
@@ -1660,4 +1682,65 @@ TEST_F(JsTokenizerTest, TokenizePrototype) {
   ExpectTokenizeFileSuccessfully("prototype.original");
 }
 
+TEST_F(JsTokenizerTest, FastPathsMatchRegexesOnLibraries) {
+  for (const char* filename :
+       {"angular.original", "jquery.original", "prototype.original"}) {
+    GoogleString original;
+    ReadTestFile(filename, &original);
+    ExpectSameTokensWithoutFastPaths(original);
+  }
+}
+
+TEST_F(JsTokenizerTest, FastPathsMatchRegexesOnEdgeCases) {
+  const char* const kInputs[] = {
+      "a = 019.5 + 017.5 + 0x1Fe3 + 0X + 08e+5 + 1.e5 + .5e-3 + 00.5 + 1E+;",
+      "x = a >>>= b >>= c << d <= e !== f != g === h == i && j || k;",
+      "x = ~a ^ b % c & d | e; x++ + ++y - --z - -w; x+++y; x---y;",
+      "x = a <<< b >>>> c;",
+      "x = /a[/\\]]b\\/c/gi.test(y) + /[]/ + /\\u00/u\\u0041$_9\\x;",
+      "x = /a\nb/;", "x = /[a\nb]/;", "x = /ab", "x = /a\\",
+      "x = 'a\\'b' + \"a\\\"b\" + 'a\\\r\nb' + 'a\\\n\rb' + '\\\r';",
+      "x = 'a\\\r\rb';", "x = 'a\\\n\nb';",
+      "x = 'unterminated\nfoo';", "x = 'a\\", "x = 'a", "x = 'a\\'",
+      "x = 'a\xE2\x80\xA8" "b';", "x = 'a\\\xE2\x80\xA8" "b';",
+      "x = '\xE2\xE2\x80\xA9';", "x = '\\\xFF';",
+      "x = /\xC3\xA9/;", "x = /a/\xC3\xA9;", "x = /\\\xC3\xA9/;",
+      "a // comment\nb -->\n--> also comment\n<!-- and this\rc",
+      "a // comment\xE2\x80\xA8" "b // \xE2\x80\xA9 c // \xE2\x80x",
+      "a\n+b\n-c\n++d\n--e\n!f\n!=g\nin h\ninstanceof i\ninx\nin",
+      "a\n+\xC3\xA9\nb\nin\xC3\xA9\nc\ninstanceof\xC3\xA9",
+      "a\n+", "a\n-", "a\nin", "a\ninstanceof", "a\n\xE2\x80\xA8" "b",
+      "a\n+\xFF", "a\n-\xFF", "a\nin\xFF", "a\ninstanceof\xFF",
+  };
+  for (const char* input : kInputs) {
+    ExpectSameTokensWithoutFastPaths(input);
+  }
+}
+
+TEST_F(JsTokenizerTest, FastPathsMatchRegexesOnRandomInput) {
+  // Random sequences of fragments that exercise the fast paths, including
+  // non-ASCII and invalid UTF-8 bytes.
+  const char* const kFragments[] = {
+      "a", "x9", "$_", "in", "instanceof", "return", "if", "var", "0", "07",
+      "019", "0x1F", ".5", "1e", "e+5", "'", "\"", "\\", "\\u0041", "\\\r\r",
+      "/", "//", "/*", "*/", "<!--", "-->", "[", "]", "(", ")", "{", "}", ";",
+      ",", ":", "?", ".", "=", "!", "+", "-", "*", "%", "&", "|", "^", "~",
+      "<", "<<<", ">", ">>>=", " ", "\t", "\n", "\r", "\xE2\x80\xA8",
+      "\xE2\x80\xA9", "\xC3\xA9", "\xFF", "\xE2",
+  };
+  // Most random input is a syntax error early on, so start some of it in the
+  // middle of a literal or statement.
+  const char* const kPrefixes[] = {"", "x = ", "x = '", "x = \"", "x = /",
+                                   "a\n", "x = 0"};
+  std::mt19937 random(4321);
+  for (int trial = 0; trial < 20000; ++trial) {
+    GoogleString input = kPrefixes[trial % arraysize(kPrefixes)];
+    const int num_fragments = 1 + random() % 30;
+    for (int i = 0; i < num_fragments; ++i) {
+      input += kFragments[random() % arraysize(kFragments)];
+    }
+    ExpectSameTokensWithoutFastPaths(input);
+  }
+}
+
 }  // namespace
@@ -49,6 +49,26 @@ const int kSpinRuns = 100;
 // Tests don't actually rely on this value, it just needs to be >0.
 const int kSnapshotIntervalMs = 1000;
 
+// Values written by TestLockFreeReadsChild, which vary in size so that
+// rewrites move the entry between blocks. A torn read would not be all one
+// letter, or would have the wrong length for it.
+const int kLockFreeReadsRounds = 26;
+const int kLockFreeReadsGets = 100000;
+
+GoogleString LockFreeReadsValue(int round) {
+  int letter = round % kLockFreeReadsRounds;
+  return GoogleString(1 + letter * 97, 'a' + letter);
+}
+
+bool IsLockFreeReadsValue(StringPiece value) {
+  if (value.empty()) {
+    return false;
+  }
+  int letter = value[0] - 'a';
+  return (letter >= 0) && (letter < kLockFreeReadsRounds) &&
+         (value == LockFreeReadsValue(letter));
+}
+
 // In some tests we have tight consumer/producer spinloops assuming they'll get
 // preempted to let other end proceed. Valgrind does not actually do that
 // sometimes.
@@ -246,6 +266,67 @@ void SharedMemCacheTestBase::TestReaderWriterChild() {
   }
 }
 
+void SharedMemCacheTestBase::TestLockFreeReads() {
+  CreateChild(&SharedMemCacheTestBase::TestLockFreeReadsChild);
+
+  // Wait for the child to start writing.
+  CacheTestBase::Callback callback;
+  while (callback.state() != CacheInterface::kAvailable) {
+    cache_->Get("key", callback.Reset());
+    YieldToThread();
+  }
+
+  // Every value we get while the child rewrites and deletes the key must be
+  // one it wrote in full.
+  int hits = 0;
+  for (int i = 0; i < kLockFreeReadsGets; ++i) {
+    cache_->Get("key", callback.Reset());
+    ASSERT_TRUE(callback.called());
+    if (callback.state() == CacheInterface::kAvailable) {
+      ++hits;
+      EXPECT_TRUE(IsLockFreeReadsValue(callback.value().Value()))
+          << callback.value().Value();
+    }
+    if (i % 100 == 0) {
+      YieldToThread();
+    }
+  }
+  EXPECT_LT(0, hits);
+  CheckPut("stop", "");
+  test_env_->WaitForChildren();
+  SanityCheck();
+
+  // An entry that hasn't been touched for a while is read with the lock
+  // held, which touches it, and then again without.
+  CheckPut("key2", "val2");
+  timer_.AdvanceMs(SharedMemCache<kBlockSize>::kTouchIntervalMs + 1);
+  CheckGet("key2", "val2");
+  CheckGet("key2", "val2");
+
+  // And reads with the lock can be forced.
+  cache_->SetLockFreeReadsForTesting(false);
+  CheckGet("key2", "val2");
+  CheckNotFound("404");
+}
+
+void SharedMemCacheTestBase::TestLockFreeReadsChild() {
+  std::unique_ptr<SharedMemCache<kBlockSize>> child_cache(MakeCache());
+  if (!child_cache->Attach()) {
+    test_env_->ChildFailed();
+  }
+
+  CacheTestBase::Callback callback;
+  for (int round = 0; callback.state() != CacheInterface::kAvailable;
+       ++round) {
+    if (round % 5 == 4) {
+      child_cache->Delete("key");
+    } else {
+      child_cache->Put("key", SharedString(LockFreeReadsValue(round)));
+    }
+    child_cache->Get("stop", callback.Reset());
+  }
+}
+
 void SharedMemCacheTestBase::TestConflict() {
   const int kAssociativity = SharedMemCache<kBlockSize>::kAssociativity;
 
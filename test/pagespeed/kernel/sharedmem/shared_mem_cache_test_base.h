@@ -56,6 +56,7 @@ class SharedMemCacheTestBase : public CacheTestBase {
   void TestReinsert();
   void TestReplacement();
   void TestReaderWriter();
+  void TestLockFreeReads();
   void TestConflict();
   void TestEvict();
   void TestSnapshot();
@@ -73,6 +74,7 @@ class SharedMemCacheTestBase : public CacheTestBase {
   SharedMemCache<kBlockSize>* MakeCache();
   void CheckDelete(const char* key);
   void TestReaderWriterChild();
+  void TestLockFreeReadsChild();
 
   std::unique_ptr<SharedMemTestEnv> test_env_;
   std::unique_ptr<AbstractSharedMem> shmem_runtime_;
@@ -144,6 +146,10 @@ TYPED_TEST_P(SharedMemCacheTestTemplate, TestReaderWriter) {
   SharedMemCacheTestBase::TestReaderWriter();
 }
 
+TYPED_TEST_P(SharedMemCacheTestTemplate, TestLockFreeReads) {
+  SharedMemCacheTestBase::TestLockFreeReads();
+}
+
 TYPED_TEST_P(SharedMemCacheTestTemplate, TestConflict) {
   SharedMemCacheTestBase::TestConflict();
 }
@@ -165,8 +171,9 @@ TYPED_TEST_P(SharedMemCacheTestTemplate, TestCheckpointAndRestore) {
 }
 
 REGISTER_TYPED_TEST_SUITE_P(SharedMemCacheTestTemplate, TestBasic, TestReinsert,
-                            TestReplacement, TestReaderWriter, TestConflict,
-                            TestEvict, TestSnapshot,
+                            TestReplacement, TestReaderWriter,
+                            TestLockFreeReads, TestConflict, TestEvict,
+                            TestSnapshot,
                             TestRegisterSnapshotFileCache,
                             TestCheckpointAndRestore);
 GTEST_ALLOW_UNINSTANTIATED_PARAMETERIZED_TEST(SharedMemCacheTestTemplate);
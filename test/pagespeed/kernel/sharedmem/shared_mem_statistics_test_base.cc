@@ -40,6 +40,7 @@ namespace {
 const char kPrefix[] = "/prefix/";
 const char kVar1[] = "v1";
 const char kVar2[] = "num_flushes";
+const char kCounter[] = "counter";
 const char kHist1[] = "H1";
 const char kHist2[] = "Html Time us Histogram";
 
@@ -88,7 +89,8 @@ bool SharedMemStatisticsTestBase::CreateChild(TestMethod method) {
 bool SharedMemStatisticsTestBase::AddVars(SharedMemStatistics* stats) {
   UpDownCounter* v1 = stats->AddUpDownCounter(kVar1);
   UpDownCounter* v2 = stats->AddUpDownCounter(kVar2);
-  return ((v1 != nullptr) && (v2 != nullptr));
+  Variable* counter = stats->AddVariable(kCounter);
+  return ((v1 != nullptr) && (v2 != nullptr) && (counter != nullptr));
 }
 
 bool SharedMemStatisticsTestBase::AddHistograms(SharedMemStatistics* stats) {
@@ -264,6 +266,39 @@ void SharedMemStatisticsTestBase::TestAdd() {
   EXPECT_EQ(4, hist2->Maximum());
 }
 
+// Variables are sharded, so check that adds from many children, which may
+// well land on different shards, all get summed up.
+void SharedMemStatisticsTestBase::TestVariableAdd() {
+  ParentInit();
+
+  Variable* counter = stats_->GetVariable(kCounter);
+  EXPECT_EQ(0, counter->Get());
+  counter->Add(5);
+  EXPECT_EQ(5, counter->Get());
+
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(
+        CreateChild(&SharedMemStatisticsTestBase::TestVariableAddChild));
+  }
+  test_env_->WaitForChildren();
+  EXPECT_EQ(5 + 10 * 1000, counter->Get());
+  counter->Add(1);
+  EXPECT_EQ(5 + 10 * 1000 + 1, counter->Get());
+
+  counter->Clear();
+  EXPECT_EQ(0, counter->Get());
+  counter->Add(2);
+  EXPECT_EQ(2, counter->Get());
+}
+
+void SharedMemStatisticsTestBase::TestVariableAddChild() {
+  std::unique_ptr<SharedMemStatistics> stats(ChildInit());
+  Variable* counter = stats->GetVariable(kCounter);
+  for (int i = 0; i < 1000; ++i) {
+    counter->Add(1);
+  }
+}
+
 void SharedMemStatisticsTestBase::TestSetReturningPrevious() {
   ParentInit();
 
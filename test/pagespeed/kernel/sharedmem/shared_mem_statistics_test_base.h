@@ -54,6 +54,7 @@ class SharedMemStatisticsTestBase : public testing::Test {
   void TestSet();
   void TestClear();
   void TestAdd();
+  void TestVariableAdd();
   void TestSetReturningPrevious();
   void TestHistogram();
   void TestHistogramRender();
@@ -79,6 +80,8 @@ class SharedMemStatisticsTestBase : public testing::Test {
 
   // Adds 10x +1 to variable 1, and 10x +2 to variable 2.
   void TestAddChild();
+  // Adds 1000x +1 to the sharded counter.
+  void TestVariableAddChild();
   bool AddVars(SharedMemStatistics* stats);
   bool AddHistograms(SharedMemStatistics* stats);
   // Helper function for TestHistogramRender().
@@ -120,6 +123,10 @@ TYPED_TEST_P(SharedMemStatisticsTestTemplate, TestAdd) {
   SharedMemStatisticsTestBase::TestAdd();
 }
 
+TYPED_TEST_P(SharedMemStatisticsTestTemplate, TestVariableAdd) {
+  SharedMemStatisticsTestBase::TestVariableAdd();
+}
+
 TYPED_TEST_P(SharedMemStatisticsTestTemplate, TestSetReturningPrevious) {
   SharedMemStatisticsTestBase::TestSetReturningPrevious();
 }
@@ -145,7 +152,7 @@ TYPED_TEST_P(SharedMemStatisticsTestTemplate, TestTimedVariableEmulation) {
 }
 
 REGISTER_TYPED_TEST_SUITE_P(SharedMemStatisticsTestTemplate, TestCreate,
-                            TestSet, TestClear, TestAdd,
+                            TestSet, TestClear, TestAdd, TestVariableAdd,
                             TestSetReturningPrevious, TestHistogram,
                             TestHistogramRender, TestHistogramNoExtraClear,
                             TestHistogramExtremeBuckets,
@@ -19,6 +19,8 @@
 
 #include "test/pagespeed/kernel/thread/mock_scheduler.h"
 
+#include <vector>
+
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/function.h"
@@ -95,6 +97,13 @@ class MockSchedulerTest : public testing::Test {
 
   void Run() { was_run_ = true; }
 
+  void RecordTime() { run_times_us_.push_back(timer_.NowUs()); }
+
+  Scheduler::Alarm* AddRecordTimeAlarmUs(int64 wakeup_time_us) {
+    return scheduler_->AddAlarmAtUs(
+        wakeup_time_us, MakeFunction(this, &MockSchedulerTest::RecordTime));
+  }
+
   void Cancel() { was_cancelled_ = true; }
 
   Scheduler::Alarm* AddRunCancelAlarmUs(int64 wakeup_time_us) {
@@ -116,6 +125,7 @@ class MockSchedulerTest : public testing::Test {
   MockTimer timer_;
   std::unique_ptr<MockScheduler> scheduler_;
   GoogleString string_;
+  std::vector<int64> run_times_us_;
   bool was_run_;
   bool was_cancelled_;
 
@@ -226,4 +236,62 @@ TEST_F(MockSchedulerTest, WakeupOnAdvancementOfSimulatedTime) {
   }
 }
 
+// The scheduler keeps alarms in a timing wheel with ~1ms ticks and coarser
+// slots for later times.  Alarms on different levels must still run in
+// wakeup order, with ties in the order they were added.
+TEST_F(MockSchedulerTest, OrderingAcrossWheelLevels) {
+  AddTask(5 * Timer::kDayMs * Timer::kMsUs, 'f');
+  AddTask(3 * Timer::kSecondUs, 'c');
+  AddTask(2000, 'b');
+  AddTask(Timer::kHourMs * Timer::kMsUs, 'e');
+  AddTask(10, 'a');
+  AddTask(3 * Timer::kSecondUs, 'd');  // Same time as 'c', added later.
+  AdvanceTimeMs(6 * Timer::kDayMs);
+  EXPECT_EQ("abcdef", string_);
+}
+
+TEST_F(MockSchedulerTest, AlarmsRunAtTheirWakeupTime) {
+  // Times that don't fall on tick or slot boundaries, so running early
+  // when a coarse slot is cascaded would show up.
+  const int64 kTimesUs[] = {
+      7, 1500, 65 * Timer::kMsUs + 3, 4 * Timer::kSecondUs + 999,
+      17 * Timer::kMinuteUs + 1, 3 * Timer::kHourMs * Timer::kMsUs + 12345,
+      40 * Timer::kDayMs * Timer::kMsUs + 1};
+  std::vector<int64> expected;
+  for (int i = arraysize(kTimesUs) - 1; i >= 0; --i) {
+    AddRecordTimeAlarmUs(kTimesUs[i]);
+    expected.insert(expected.begin(), kTimesUs[i]);
+  }
+  AdvanceTimeMs(41 * Timer::kDayMs);
+  EXPECT_EQ(expected, run_times_us_);
+}
+
+TEST_F(MockSchedulerTest, CancelAfterCascade) {
+  AddTask(Timer::kSecondUs, '1');
+  Scheduler::Alarm* alarm = AddTask(Timer::kMinuteUs + 10, 'x');
+  AddTask(Timer::kMinuteUs + 20, '2');
+  // Get close enough that the alarms one minute out have been moved down
+  // to the finest level of the wheel, then cancel one of them.
+  AdvanceTimeUs(Timer::kMinuteUs);
+  EXPECT_EQ("1", string_);
+  {
+    ScopedMutex lock(scheduler_->mutex());
+    EXPECT_TRUE(scheduler_->CancelAlarm(alarm));
+  }
+  AdvanceTimeUs(Timer::kSecondUs);
+  EXPECT_EQ("12", string_);
+}
+
+TEST_F(MockSchedulerTest, AddAlarmsAfterLongIdle) {
+  // Nothing scheduled while a long stretch of time passes; alarms added
+  // afterwards, including ones already in the past, run in order.
+  AdvanceTimeMs(Timer::kYearMs);
+  int64 now_us = timer_.NowUs();
+  AddTask(now_us + 2 * Timer::kMsUs, 'c');
+  AddTask(now_us + Timer::kMsUs, 'b');
+  AddTask(now_us - Timer::kSecondUs, 'a');
+  AdvanceTimeMs(2);
+  EXPECT_EQ("abc", string_);
+}
+
 }  // namespace net_instaweb
@@ -21,6 +21,8 @@
 
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
 
+#include <vector>
+
 #include "base/logging.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/function.h"
@@ -319,6 +321,130 @@ TEST_F(QueuedWorkerPoolTest, CancelPending) {
   EXPECT_EQ(-300, count);
 }
 
+// Runs the same Sequence guarantees with per-worker deques.
+class QueuedWorkerPoolStealingTest : public QueuedWorkerPoolTest {
+ public:
+  static const int kNumWorkers = 4;
+
+  QueuedWorkerPoolStealingTest() {
+    worker_.reset(new QueuedWorkerPool(kNumWorkers, "stealing_pool_test",
+                                       thread_runtime_.get()));
+    worker_->EnableWorkStealing();
+  }
+};
+
+TEST_F(QueuedWorkerPoolStealingTest, ManySequencesRunInOrder) {
+  const int kNumSequences = 16;
+  const int kBound = 200;
+  int counts[kNumSequences] = {0};
+  std::vector<QueuedWorkerPool::Sequence*> sequences;
+  for (int s = 0; s < kNumSequences; ++s) {
+    sequences.push_back(worker_->NewSequence());
+  }
+
+  // Interleave the adds so the sequences keep going idle and being
+  // re-queued on different deques while they run.
+  for (int i = 0; i < kBound; ++i) {
+    for (int s = 0; s < kNumSequences; ++s) {
+      sequences[s]->Add(new Increment(i + 1, &counts[s]));
+    }
+  }
+  for (int s = 0; s < kNumSequences; ++s) {
+    WaitUntilSequenceCompletes(sequences[s]);
+    EXPECT_EQ(kBound, counts[s]);
+    worker_->FreeSequence(sequences[s]);
+  }
+}
+
+TEST_F(QueuedWorkerPoolStealingTest, SlowAndFastSequences) {
+  const int kBound = 42;
+  int count = 0;
+  SyncPoint sync(thread_runtime_.get());
+  SyncPoint wait(thread_runtime_.get());
+
+  QueuedWorkerPool::Sequence* slow_sequence = worker_->NewSequence();
+  slow_sequence->Add(new WaitRunFunction(&wait));
+  slow_sequence->Add(new NotifyRunFunction(&sync));
+
+  QueuedWorkerPool::Sequence* fast_sequence = worker_->NewSequence();
+  for (int i = 0; i < kBound; ++i) {
+    fast_sequence->Add(new Increment(i + 1, &count));
+  }
+  fast_sequence->Add(new NotifyRunFunction(&wait));
+
+  sync.Wait();
+  EXPECT_EQ(kBound, count);
+  worker_->FreeSequence(fast_sequence);
+  worker_->FreeSequence(slow_sequence);
+}
+
+TEST_F(QueuedWorkerPoolStealingTest, RestartSequenceFromFunction) {
+  SyncPoint sync(thread_runtime_.get());
+  QueuedWorkerPool::Sequence* sequence = worker_->NewSequence();
+  sequence->Add(new MakeNewSequence(&sync, worker_.get(), sequence));
+  sync.Wait();
+}
+
+// Makes 'other' runnable from a pool thread, which puts it on that
+// thread's own deque, and then blocks until it has run.  Only another
+// worker stealing it can unblock us.
+class AddAndWaitForSteal : public Function {
+ public:
+  AddAndWaitForSteal(QueuedWorkerPool::Sequence* other,
+                     WorkerTestBase::SyncPoint* stolen)
+      : other_(other), stolen_(stolen) {}
+
+  void Run() override {
+    other_->Add(new WorkerTestBase::NotifyRunFunction(stolen_));
+    stolen_->Wait();
+  }
+
+ private:
+  QueuedWorkerPool::Sequence* other_;
+  WorkerTestBase::SyncPoint* stolen_;
+
+  DISALLOW_COPY_AND_ASSIGN(AddAndWaitForSteal);
+};
+
+TEST_F(QueuedWorkerPoolStealingTest, IdleWorkerSteals) {
+  SyncPoint stolen(thread_runtime_.get());
+  QueuedWorkerPool::Sequence* sequence = worker_->NewSequence();
+  QueuedWorkerPool::Sequence* other = worker_->NewSequence();
+  sequence->Add(new AddAndWaitForSteal(other, &stolen));
+  WaitUntilSequenceCompletes(sequence);
+  worker_->FreeSequence(other);
+  worker_->FreeSequence(sequence);
+}
+
+TEST_F(QueuedWorkerPoolStealingTest, ShutDownCancelsQueuedWork) {
+  // Wedge every worker, then queue functions behind the wedges.  Shutting
+  // down must let the running functions finish and cancel the rest.
+  std::vector<std::unique_ptr<SyncPoint>> waits;
+  std::vector<LogOpsFunction*> pending;
+  for (int i = 0; i < kNumWorkers; ++i) {
+    SyncPoint started(thread_runtime_.get());
+    waits.emplace_back(new SyncPoint(thread_runtime_.get()));
+    QueuedWorkerPool::Sequence* wedge = worker_->NewSequence();
+    wedge->Add(new NotifyAndWait(&started, waits.back().get()));
+    started.Wait();
+    LogOpsFunction* fn = new LogOpsFunction;
+    wedge->Add(fn);
+    pending.push_back(fn);
+  }
+
+  worker_->InitiateShutDown();
+  for (int i = 0; i < kNumWorkers; ++i) {
+    waits[i]->Notify();
+  }
+  worker_->WaitForShutDownComplete();
+
+  for (int i = 0; i < kNumWorkers; ++i) {
+    EXPECT_TRUE(pending[i]->cancel_called());
+    EXPECT_FALSE(pending[i]->run_called());
+    delete pending[i];
+  }
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
@@ -0,0 +1,126 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "pagespeed/kernel/util/brotli_deflater.h"
+
+#include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/string_writer.h"
+#include "pagespeed/kernel/util/brotli_inflater.h"
+#include "pagespeed/kernel/util/simple_random.h"
+#include "test/pagespeed/kernel/base/gtest.h"
+#include "test/pagespeed/kernel/base/message_handler_test_base.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Writer that fails every Write().
+class FailingWriter : public Writer {
+ public:
+  bool Write(const StringPiece& str, MessageHandler* handler) override {
+    return false;
+  }
+  bool Flush(MessageHandler* handler) override { return true; }
+};
+
+class BrotliDeflaterTest : public testing::Test {
+ protected:
+  BrotliDeflaterTest() : random_(new NullMutex) {}
+
+  GoogleString Decompress(StringPiece compressed) {
+    GoogleString decompressed;
+    StringWriter writer(&decompressed);
+    EXPECT_TRUE(BrotliInflater::Decompress(compressed, &handler_, &writer));
+    return decompressed;
+  }
+
+  // Text that compresses well but isn't trivial.
+  GoogleString Text(int size) {
+    GoogleString text;
+    for (int i = 0; static_cast<int>(text.size()) < size; ++i) {
+      StrAppend(&text, "body { margin: ", IntegerToString(i % 17), "px; }\n");
+    }
+    text.resize(size);
+    return text;
+  }
+
+  TestMessageHandler handler_;
+  SimpleRandom random_;
+};
+
+TEST_F(BrotliDeflaterTest, CompressRoundTrip) {
+  GoogleString text = Text(100000);
+  for (int quality = BrotliDeflater::kMinQuality;
+       quality <= BrotliDeflater::kMaxQuality; ++quality) {
+    GoogleString compressed;
+    StringWriter writer(&compressed);
+    ASSERT_TRUE(BrotliDeflater::Compress(text, quality, &handler_, &writer));
+    EXPECT_GT(text.size() / 10, compressed.size()) << quality;
+    EXPECT_EQ(text, Decompress(compressed)) << quality;
+  }
+  EXPECT_EQ(0, handler_.messages().size());
+}
+
+TEST_F(BrotliDeflaterTest, EmptyInput) {
+  GoogleString compressed;
+  StringWriter writer(&compressed);
+  ASSERT_TRUE(BrotliDeflater::Compress("", 5, &handler_, &writer));
+  EXPECT_FALSE(compressed.empty());
+  EXPECT_EQ("", Decompress(compressed));
+}
+
+TEST_F(BrotliDeflaterTest, Streaming) {
+  // Incompressible input, fed in uneven pieces, produces output before
+  // Finish() and round-trips.
+  GoogleString text = random_.GenerateHighEntropyString(200000);
+  GoogleString compressed;
+  StringWriter writer(&compressed);
+  BrotliDeflater deflater(1);
+  for (size_t pos = 0; pos < text.size(); pos += 7919) {
+    ASSERT_TRUE(deflater.Write(StringPiece(text).substr(pos, 7919), &handler_,
+                               &writer));
+  }
+  EXPECT_FALSE(compressed.empty());
+  ASSERT_TRUE(deflater.Finish(&handler_, &writer));
+  EXPECT_EQ(text, Decompress(compressed));
+
+  // Nothing more can be written.
+  EXPECT_FALSE(deflater.Write("more", &handler_, &writer));
+}
+
+TEST_F(BrotliDeflaterTest, ClampsQuality) {
+  GoogleString text = Text(10000);
+  GoogleString max, too_high;
+  StringWriter max_writer(&max), too_high_writer(&too_high);
+  ASSERT_TRUE(BrotliDeflater::Compress(text, BrotliDeflater::kMaxQuality,
+                                       &handler_, &max_writer));
+  ASSERT_TRUE(BrotliDeflater::Compress(text, 100, &handler_, &too_high_writer));
+  EXPECT_EQ(max, too_high);
+}
+
+TEST_F(BrotliDeflaterTest, WriterFailure) {
+  FailingWriter writer;
+  EXPECT_FALSE(BrotliDeflater::Compress(Text(1000), 5, &handler_, &writer));
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -198,6 +198,59 @@ TEST_F(RedisCacheClusterTest, OtherNodesPutGetDelete) {
   EXPECT_EQ(1, cache_->ClusterSlotsFetches());
 }
 
+TEST_F(RedisCacheClusterTest, MultiGetAcrossNodes) {
+  if (!InitRedisClusterOrSkip()) {
+    return;
+  }
+
+  CheckPut(kKeyOnNode1, kValue1);
+  CheckPut(kKeyOnNode2, kValue2);
+  CheckPut(kKeyOnNode3, kValue3);
+  // Populating node2 taught us the cluster layout.
+  EXPECT_EQ(1, cache_->ClusterSlotsFetches());
+  int64 redirections = cache_->Redirections();
+
+  Callback* n1 = AddCallback();
+  Callback* n2 = AddCallback();
+  Callback* n3 = AddCallback();
+  IssueMultiGet(n1, kKeyOnNode1, n2, kKeyOnNode2, n3, kKeyOnNode3);
+  WaitAndCheck(n1, kValue1);
+  WaitAndCheck(n2, kValue2);
+  WaitAndCheck(n3, kValue3);
+
+  // One pipelined batch per node, and no redirections as the mapping is
+  // already known.
+  EXPECT_EQ(3, cache_->MultiGetBatches());
+  EXPECT_EQ(3, cache_->MultiGetCommands());
+  EXPECT_EQ(redirections, cache_->Redirections());
+  EXPECT_EQ(1, cache_->ClusterSlotsFetches());
+}
+
+TEST_F(RedisCacheClusterTest, MultiGetFollowsRedirections) {
+  if (!InitRedisClusterOrSkip()) {
+    return;
+  }
+
+  CheckPut(kKeyOnNode1, kValue1);
+  CheckPut(kKeyOnNode1b, kValue4);
+  // Talk to a fresh cache that has never fetched the slot mapping, so that
+  // everything is sent to node1 and the node2 key gets redirected.
+  cache_ = std::make_unique<RedisCache>(
+      "localhost", ports_[0], thread_system_.get(), &handler_, &timer_,
+      kReconnectionDelayMs, kTimeoutUs, &statistics_, kDatabaseIndex, kTTLSec);
+  cache_->StartUp();
+  int64 slots_fetches = cache_->ClusterSlotsFetches();
+
+  Callback* n1 = AddCallback();
+  Callback* n2 = AddCallback();
+  Callback* n1b = AddCallback();
+  IssueMultiGet(n1, kKeyOnNode1, n2, kKeyOnNode2, n1b, kKeyOnNode1b);
+  WaitAndCheck(n1, kValue1);
+  WaitAndCheckNotFound(n2);
+  WaitAndCheck(n1b, kValue4);
+  EXPECT_EQ(slots_fetches + 1, cache_->ClusterSlotsFetches());
+}
+
 TEST_F(RedisCacheClusterTest, SlotBoundaries) {
   // These are designed to exercise the slot lookup code at slot boundaries.
   // 0 and 16384 are min/max slot. Slot 10999 is on node 2 and 11000 is on node
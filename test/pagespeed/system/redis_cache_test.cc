@@ -218,6 +218,30 @@ TEST_F(RedisCacheTest, MultiGet) {
   TestMultiGet();  // Test from CacheTestBase is just fine.
 }
 
+// Keys sharing a {}-section hash to the same slot and end up in one MGET;
+// different slots get their own MGET, but all of them share one pipeline.
+TEST_F(RedisCacheTest, MultiGetPipelinesSlots) {
+  if (!PrepareRedisOrSkip()) {
+    return;
+  }
+  InitRedisWithCustomDatabaseIndex(0);
+
+  CheckPut("{1}NameA", "Value1A");
+  CheckPut("{1}NameB", "Value1B");
+  CheckPut("{2}NameC", "Value2C");
+
+  Callback* a = AddCallback();
+  Callback* missing = AddCallback();
+  Callback* c = AddCallback();
+  IssueMultiGet(a, "{1}NameA", missing, "{1}Missing", c, "{2}NameC");
+  WaitAndCheck(a, "Value1A");
+  WaitAndCheckNotFound(missing);
+  WaitAndCheck(c, "Value2C");
+
+  EXPECT_EQ(1, cache_[0]->MultiGetBatches());
+  EXPECT_EQ(2, cache_[0]->MultiGetCommands());
+}
+
 TEST_F(RedisCacheTest, BasicInvalid) {
   if (!PrepareRedisOrSkip()) {
     return;
@@ -439,6 +463,70 @@ TEST_F(RedisCacheTest, DoesNotReconnectAfterShutdown) {
   CheckNotFound(kSomeKey);
 }
 
+// Answers the first of the pipelined MGETs it receives, and then closes the
+// connection without answering the rest.
+class RedisMultiGetFailingServerThread : public TcpServerThreadForTesting {
+ public:
+  RedisMultiGetFailingServerThread(apr_port_t listen_port,
+                                   ThreadSystem* thread_system)
+      : TcpServerThreadForTesting(listen_port, "redis_multi_get_failing_server",
+                                  thread_system) {}
+
+  virtual ~RedisMultiGetFailingServerThread() { ShutDown(); }
+
+ private:
+  void HandleClientConnection(apr_socket_t* sock) override {
+    static const char kSelectAnswer[] = "+OK\r\n";
+    static const char kMGetAnswer[] = "*1\r\n$6\r\nValueA\r\n";
+    GoogleString requests;
+    bool select_answered = false;
+    for (;;) {
+      char buf[1024];
+      apr_size_t size = sizeof(buf);
+      if (apr_socket_recv(sock, buf, &size) != APR_SUCCESS) {
+        break;
+      }
+      requests.append(buf, size);
+      if (!select_answered && (requests.find("SELECT") != GoogleString::npos)) {
+        apr_size_t answer_size = STATIC_STRLEN(kSelectAnswer);
+        apr_socket_send(sock, kSelectAnswer, &answer_size);
+        select_answered = true;
+      }
+      size_t first_mget = requests.find("MGET");
+      if ((first_mget != GoogleString::npos) &&
+          (requests.find("MGET", first_mget + 1) != GoogleString::npos)) {
+        apr_size_t answer_size = STATIC_STRLEN(kMGetAnswer);
+        apr_socket_send(sock, kMGetAnswer, &answer_size);
+        break;
+      }
+    }
+    apr_socket_close(sock);
+  }
+};
+
+// If the connection fails part way through the replies to a pipeline, the
+// replies still to come must not be taken for those of later commands, so
+// the connection is dropped and the whole batch fails.
+TEST_F(RedisCacheTest, MultiGetFailsWholeBatchOnConnectionFailure) {
+  InitRedisWithCustomServer();
+  ASSERT_TRUE(StartCustomServer<RedisMultiGetFailingServerThread>());
+  cache_[0]->StartUp();
+
+  Callback* a = AddCallback();
+  Callback* b = AddCallback();
+  Callback* c = AddCallback();
+  IssueMultiGet(a, "{1}NameA", b, "{1}NameB", c, "{2}NameC");
+  WaitAndCheckNotFound(a);
+  WaitAndCheckNotFound(b);
+  WaitAndCheckNotFound(c);
+  WaitForCustomServerShutdown();
+
+  // The next command goes out on a new connection.
+  ASSERT_TRUE(StartCustomServer<RedisGetRespondingServerThread>());
+  EXPECT_TRUE(Cache()->IsHealthy());
+  CheckGet(kSomeKey, kSomeValue);
+}
+
 // This server always waits until connection is received to avoid race
 // condition between server destruction and accepting connection (like in
 // ShutDownDuringConnection). Other servers do not do that because tests
@@ -21,6 +21,7 @@
 
 #include <unistd.h>
 
+#include <atomic>
 #include <cstddef>
 #include <cstdlib>
 #include <memory>
@@ -1118,4 +1119,232 @@ TEST_F(SerfUrlAsyncFetcherTestFakeWebServer, TestHangingGet) {
 #endif
 }
 
+class SerfUrlAsyncFetcherTestKeepAlive : public SerfUrlAsyncFetcherTest {
+ public:
+  // Answers the requests sent on a connection, including pipelined ones, in
+  // order.  Connections are handled one at a time, so a fetch sent on a
+  // second connection while the first is open isn't answered until the
+  // first closes.  A request whose URL contains "hang" is never answered,
+  // nor are those behind it.  One containing "truncate" gets the start of a
+  // response, after which the connection is closed.
+  class KeepAliveServerThread : public TcpServerThreadForTesting {
+   public:
+    KeepAliveServerThread(apr_port_t listen_port, ThreadSystem* thread_system)
+        : TcpServerThreadForTesting(listen_port, "keep_alive_webserver",
+                                    thread_system),
+          min_requests_(1) {}
+    ~KeepAliveServerThread() override { ShutDown(); }
+
+    // Holds the responses on a connection until n requests have arrived on
+    // it, so that they are certainly pipelined.
+    void set_min_requests(int n) { min_requests_ = n; }
+
+    void HandleClientConnection(apr_socket_t* sock) override {
+      GoogleString buffered;
+      StringVector request_lines;
+      int num_responses = 0;
+      bool hung = false;
+      for (;;) {
+        char buffer[kStackBufferSize];
+        apr_size_t size = sizeof(buffer);
+        if (apr_socket_recv(sock, buffer, &size) != APR_SUCCESS) {
+          break;  // The fetcher closed the connection.
+        }
+        buffered.append(buffer, size);
+        // None of the requests have bodies, so each ends with a blank line.
+        size_t end;
+        while ((end = buffered.find("\r\n\r\n")) != GoogleString::npos) {
+          request_lines.push_back(buffered.substr(0, buffered.find("\r\n")));
+          buffered.erase(0, end + 4);
+        }
+        if (hung || (static_cast<int>(request_lines.size()) < min_requests_)) {
+          continue;
+        }
+        for (; num_responses < static_cast<int>(request_lines.size());
+             ++num_responses) {
+          const GoogleString& request_line = request_lines[num_responses];
+          if (request_line.find("hang") != GoogleString::npos) {
+            hung = true;
+            break;
+          }
+          if (request_line.find("truncate") != GoogleString::npos) {
+            static const char kTruncated[] =
+                "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n"
+                "Content-Type: text/plain\r\n\r\nresp";
+            apr_size_t response_size = STATIC_STRLEN(kTruncated);
+            apr_socket_send(sock, kTruncated, &response_size);
+            apr_socket_close(sock);
+            return;
+          }
+          GoogleString body =
+              StrCat("response ", IntegerToString(num_responses));
+          GoogleString response =
+              StrCat("HTTP/1.1 200 OK\r\nContent-Length: ",
+                     IntegerToString(body.size()),
+                     "\r\nContent-Type: text/plain\r\n\r\n", body);
+          apr_size_t response_size = response.size();
+          apr_socket_send(sock, response.data(), &response_size);
+        }
+      }
+      apr_socket_close(sock);
+    }
+
+   private:
+    bool AcceptsAnotherConnection() override { return true; }
+
+    std::atomic<int> min_requests_;
+  };
+
+  static void SetUpTestSuite() {
+    TcpServerThreadForTesting::PickListenPortOnce(&desired_listen_port_);
+  }
+
+  void SetUp() override {
+    thread_ = std::make_unique<KeepAliveServerThread>(desired_listen_port_,
+                                                      thread_system_.get());
+    ASSERT_TRUE(thread_->Start());
+    int port = thread_->GetListeningPort();
+    GoogleString proxy_address = StrCat("127.0.0.1:", IntegerToString(port));
+    SetUpWithProxy(proxy_address.c_str());
+    for (int i = 0; i < 3; ++i) {
+      keep_alive_urls_[i] = AddTestUrl(
+          StrCat("http://", test_host_, "/keep_alive_", IntegerToString(i)),
+          "response");
+    }
+    hang_url_ = AddTestUrl(StrCat("http://", test_host_, "/hang"), "");
+    truncate_url_ = AddTestUrl(StrCat("http://", test_host_, "/truncate"), "");
+  }
+
+  int64 StatValue(const char* name) {
+    return statistics_->GetVariable(name)->Get();
+  }
+
+  // Fetches keep_alive_urls_[i], expecting it to succeed as the n-th
+  // response on its connection.
+  void FetchAndExpectResponse(int i, int n) {
+    int index = keep_alive_urls_[i];
+    StartFetches(index, index);
+    ASSERT_EQ(1, WaitTillDone(index, index));
+    EXPECT_TRUE(fetches_[index]->success());
+    EXPECT_EQ(HttpStatus::kOK, response_headers(index)->status_code());
+    EXPECT_STREQ(StrCat("response ", IntegerToString(n)), contents(index));
+  }
+
+  std::unique_ptr<KeepAliveServerThread> thread_;
+  int keep_alive_urls_[3];
+  int hang_url_;
+  int truncate_url_;
+
+ private:
+  static apr_port_t desired_listen_port_;
+};
+
+apr_port_t SerfUrlAsyncFetcherTestKeepAlive::desired_listen_port_ = 0;
+
+TEST_F(SerfUrlAsyncFetcherTestKeepAlive, ReusesIdleConnection) {
+  for (int i = 0; i < 3; ++i) {
+    FetchAndExpectResponse(i, i);
+  }
+  EXPECT_EQ(1, StatValue(SerfStats::kSerfFetchConnectionsCreated));
+  EXPECT_EQ(2, StatValue(SerfStats::kSerfFetchConnectionsReused));
+  EXPECT_EQ(0, StatValue(SerfStats::kSerfFetchRequestsPipelined));
+}
+
+TEST_F(SerfUrlAsyncFetcherTestKeepAlive, PipelinesOnBusyConnection) {
+  // With one connection allowed, fetches started together are queued on
+  // it, and their responses come back in order.  The server holds its
+  // responses until all three requests have arrived, so the last two are
+  // certainly sent while the first is in flight.
+  serf_url_async_fetcher_->set_max_connections_per_host(1);
+  thread_->set_min_requests(3);
+  int first = keep_alive_urls_[0];
+  int last = keep_alive_urls_[2];
+  StartFetches(first, last);
+  ASSERT_EQ(3, WaitTillDone(first, last));
+  for (int i = 0; i < 3; ++i) {
+    int index = keep_alive_urls_[i];
+    EXPECT_TRUE(fetches_[index]->success());
+    EXPECT_STREQ(StrCat("response ", IntegerToString(i)), contents(index));
+  }
+  EXPECT_EQ(1, StatValue(SerfStats::kSerfFetchConnectionsCreated));
+  EXPECT_EQ(2, StatValue(SerfStats::kSerfFetchConnectionsReused));
+  EXPECT_EQ(2, StatValue(SerfStats::kSerfFetchRequestsPipelined));
+}
+
+TEST_F(SerfUrlAsyncFetcherTestKeepAlive, TimedOutFetchClosesConnection) {
+  FetchAndExpectResponse(0, 0);
+  StartFetches(hang_url_, hang_url_);
+  ASSERT_EQ(1, WaitTillDone(hang_url_, hang_url_));
+  EXPECT_FALSE(fetches_[hang_url_]->success());
+  EXPECT_EQ(1, StatValue(SerfStats::kSerfFetchTimeoutCount));
+
+  // The connection the fetch timed out on was closed rather than reused.
+  FetchAndExpectResponse(1, 0);
+  EXPECT_EQ(2, StatValue(SerfStats::kSerfFetchConnectionsCreated));
+  EXPECT_EQ(1, StatValue(SerfStats::kSerfFetchConnectionsReused));
+}
+
+TEST_F(SerfUrlAsyncFetcherTestKeepAlive, TimeoutFailsFetchesQueuedBehind) {
+  // The two fetches pipelined behind the hanging one fail along with it
+  // when it times out, each calling back exactly once.
+  serf_url_async_fetcher_->set_max_connections_per_host(1);
+  StartFetches(hang_url_, hang_url_);
+  StartFetches(keep_alive_urls_[0], keep_alive_urls_[1]);
+  ASSERT_EQ(1, WaitTillDone(hang_url_, hang_url_));
+  EXPECT_TRUE(fetches_[keep_alive_urls_[0]]->IsDone());
+  EXPECT_TRUE(fetches_[keep_alive_urls_[1]]->IsDone());
+  EXPECT_FALSE(fetches_[hang_url_]->success());
+  EXPECT_FALSE(fetches_[keep_alive_urls_[0]]->success());
+  EXPECT_FALSE(fetches_[keep_alive_urls_[1]]->success());
+  EXPECT_EQ(1, StatValue(SerfStats::kSerfFetchTimeoutCount));
+  EXPECT_EQ(2, StatValue(SerfStats::kSerfFetchRequestsPipelined));
+  EXPECT_EQ(0, ActiveFetches());
+
+  FetchAndExpectResponse(2, 0);
+  EXPECT_EQ(2, StatValue(SerfStats::kSerfFetchConnectionsCreated));
+}
+
+TEST_F(SerfUrlAsyncFetcherTestKeepAlive, CancelFetchesSharingConnection) {
+  // Shutting down cancels the first fetch, which closes the connection and
+  // cancels the two queued behind it too.  None of them count as failures.
+  serf_url_async_fetcher_->set_max_connections_per_host(1);
+  thread_->set_min_requests(4);  // Never answer.
+  int first = keep_alive_urls_[0];
+  int last = keep_alive_urls_[2];
+  StartFetches(first, last);
+  while (ActiveFetches() < 3) {
+    serf_url_async_fetcher_->Poll(kThreadedPollMs);
+  }
+  serf_url_async_fetcher_->ShutDown();
+  for (int i = 0; i < 3; ++i) {
+    int index = keep_alive_urls_[i];
+    EXPECT_TRUE(fetches_[index]->IsDone());
+    EXPECT_FALSE(fetches_[index]->success());
+  }
+  EXPECT_EQ(3, StatValue(SerfStats::kSerfFetchCancelCount));
+  EXPECT_EQ(0, StatValue(SerfStats::kSerfFetchUltimateFailure));
+  EXPECT_EQ(0, ActiveFetches());
+}
+
+TEST_F(SerfUrlAsyncFetcherTestKeepAlive, ErrorRetiresConnection) {
+  // A connection the server drops part way through a response isn't
+  // reused; the next fetch opens a new one.
+  FetchAndExpectResponse(0, 0);
+  StartFetches(truncate_url_, truncate_url_);
+  ASSERT_EQ(1, WaitTillDone(truncate_url_, truncate_url_));
+  EXPECT_FALSE(fetches_[truncate_url_]->success());
+  FetchAndExpectResponse(1, 0);
+  EXPECT_EQ(2, StatValue(SerfStats::kSerfFetchConnectionsCreated));
+  EXPECT_EQ(1, StatValue(SerfStats::kSerfFetchConnectionsReused));
+}
+
+TEST_F(SerfUrlAsyncFetcherTestKeepAlive, EvictsIdleConnection) {
+  FetchAndExpectResponse(0, 0);
+  usleep((SerfUrlAsyncFetcher::kIdleConnectionTimeoutMs + 500) *
+         Timer::kMsUs);
+  FetchAndExpectResponse(1, 0);
+  EXPECT_EQ(2, StatValue(SerfStats::kSerfFetchConnectionsCreated));
+  EXPECT_EQ(0, StatValue(SerfStats::kSerfFetchConnectionsReused));
+}
+
 }  // namespace net_instaweb
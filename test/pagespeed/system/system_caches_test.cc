@@ -60,6 +60,7 @@
 #include "pagespeed/kernel/cache/fallback_cache.h"
 #include "pagespeed/kernel/cache/file_cache.h"
 #include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
 #include "pagespeed/kernel/cache/threadsafe_cache.h"
 #include "pagespeed/kernel/cache/write_through_cache.h"
 #include "pagespeed/kernel/http/content_type.h"
@@ -391,6 +392,26 @@ TEST_F(SystemCachesTest, BasicFileAndLruCache) {
   EXPECT_TRUE(server_context->filesystem_metadata_cache() == nullptr);
 }
 
+TEST_F(SystemCachesTest, BasicFileAndShardedLruCache) {
+  options_->set_file_cache_path(kCachePath);
+  options_->set_use_shared_mem_locking(false);
+  options_->set_lru_cache_kb_per_process(100);
+  options_->set_lru_cache_shards(4);
+  options_->set_default_shared_memory_cache_kb(0);
+  PrepareWithConfig(options_.get());
+
+  std::unique_ptr<ServerContext> server_context(
+      SetupServerContext(options_.release()));
+  EXPECT_STREQ(Compressed(WriteThrough(
+                   Stats("lru_cache", ShardedLRUCache::FormatName()),
+                   FileCacheWithStats())),
+               server_context->metadata_cache()->Name());
+  EXPECT_STREQ(HttpCache(WriteThrough(
+                   Stats("lru_cache", ShardedLRUCache::FormatName()),
+                   FileCacheWithStats())),
+               server_context->http_cache()->Name());
+}
+
 TEST_F(SystemCachesTest, BasicFileOnlyCache) {
   options_->set_file_cache_path(kCachePath);
   options_->set_use_shared_mem_locking(false);
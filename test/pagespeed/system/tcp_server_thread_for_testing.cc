@@ -106,6 +106,12 @@ void TcpServerThreadForTesting::Run() {
          "apr_socket_accept failed (did not receive a connection?)";
   if (status == APR_SUCCESS) {
     HandleClientConnection(accepted_socket);
+    // Once ShutDown() shuts down the listening socket, accept() fails.
+    while (AcceptsAnotherConnection() &&
+           (apr_socket_accept(&accepted_socket, local_listen_sock, pool_) ==
+            APR_SUCCESS)) {
+      HandleClientConnection(accepted_socket);
+    }
   }
   {
     ScopedMutex lock(mutex_.get());
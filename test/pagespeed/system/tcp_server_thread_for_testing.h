@@ -74,6 +74,11 @@ class TcpServerThreadForTesting : public ThreadSystem::Thread {
   // called in ShutDown().
   virtual void HandleClientConnection(apr_socket_t* sock) = 0;
 
+  // Whether to accept another connection once HandleClientConnection
+  // returns, rather than stopping after the first.  Connections are still
+  // handled one at a time.
+  virtual bool AcceptsAnotherConnection() { return false; }
+
   // Returns a socket bound to requested_listen_port_ if non-zero, otherwise
   // whatever the system picked. Updates actual_listening_port_.
   apr_socket_t* CreateAndBindSocket() EXCLUSIVE_LOCKS_REQUIRED(mutex_);